@@ -0,0 +1,388 @@
+// Microbenchmarks for wallet hot paths.
+//
+// Runs offline against synthetic wallets, so results from different gdk
+// versions built on the same machine can be compared directly.
+//
+// Usage: gdk_bench [--json] [--sizes N[,N...]] [filter]
+//   --json   Print results as a JSON array instead of a table
+//   --sizes  The synthetic wallet sizes (in txs) to run fixtures for.
+//            Default: 1000,10000. Pass 100000 for a large wallet.
+//   filter   Only run benchmarks whose name contains this string
+#include "src/autobahn_wrapper.hpp"
+#include "src/client_blob.hpp"
+#include "src/coin_selection.hpp"
+#include "src/ga_cache.hpp"
+#include "src/ga_tx.hpp"
+#include "src/ga_wally.hpp"
+#include "src/network_parameters.hpp"
+#include "src/session.hpp"
+#include "src/session_impl.hpp"
+#include "src/signer.hpp"
+#include "src/utils.hpp"
+#include "src/wamp_transport.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace green;
+
+namespace {
+    using bench_clock = std::chrono::steady_clock;
+
+    // Run micro benchmarks for at least this long to get a stable result
+    static constexpr auto MIN_RUN_TIME = std::chrono::milliseconds(200);
+
+    static const std::string BENCH_NETWORK("electrum-testnet");
+    static const std::string BENCH_MNEMONIC("abandon abandon abandon abandon abandon abandon abandon abandon abandon "
+                                            "abandon abandon about");
+
+    struct bench_state {
+        std::string filter;
+        std::vector<size_t> sizes{ 1000, 10000 };
+        bool as_json = false;
+        nlohmann::json results = nlohmann::json::array();
+    };
+
+    static bench_state g_state;
+
+    static bool is_selected(const std::string& name)
+    {
+        return g_state.filter.empty() || name.find(g_state.filter) != std::string::npos;
+    }
+
+    static void report(const std::string& name, size_t ops, bench_clock::duration elapsed)
+    {
+        const double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+        const double ns_per_op = ops ? ns / ops : ns;
+        g_state.results.push_back({ { "name", name }, { "ops", ops }, { "ns_per_op", ns_per_op } });
+        if (!g_state.as_json) {
+            std::cout << std::left << std::setw(48) << name << std::right << std::setw(10) << ops << std::setw(16)
+                      << std::fixed << std::setprecision(1) << ns_per_op << " ns/op" << std::endl;
+        }
+    }
+
+    // Run fn(iterations) doubling iterations until it runs for MIN_RUN_TIME
+    template <typename FN> static void run_timed(const std::string& name, FN&& fn)
+    {
+        if (!is_selected(name)) {
+            return;
+        }
+        for (size_t iterations = 1;; iterations *= 2) {
+            const auto start = bench_clock::now();
+            fn(iterations);
+            const auto elapsed = bench_clock::now() - start;
+            if (elapsed >= MIN_RUN_TIME || iterations >= (1u << 30)) {
+                report(name, iterations, elapsed);
+                return;
+            }
+        }
+    }
+
+    // Run fn once, reporting its cost spread over ops operations
+    template <typename FN> static void run_once(const std::string& name, size_t ops, FN&& fn)
+    {
+        if (!is_selected(name)) {
+            return;
+        }
+        const auto start = bench_clock::now();
+        fn();
+        report(name, ops, bench_clock::now() - start);
+    }
+
+    static std::vector<unsigned char> random_bytes(size_t len)
+    {
+        std::vector<unsigned char> ret(len);
+        for (size_t i = 0; i < len; i += 32) {
+            get_random_bytes(std::min<size_t>(32, len - i), ret.data() + i, len - i);
+        }
+        return ret;
+    }
+
+    //
+    // Synthetic wallet fixtures
+    //
+    struct wallet_fixture {
+        std::vector<std::string> txhashes;
+        std::vector<nlohmann::json> txs;
+    };
+
+    static nlohmann::json make_tx_json(const std::string& txhash, size_t i, std::mt19937& rng)
+    {
+        const uint64_t satoshi = rng() % 100000000 + 546;
+        nlohmann::json output = { { "address", "tb1qsynthetic" + std::to_string(i) }, { "satoshi", satoshi },
+            { "is_relevant", true }, { "subaccount", 0 }, { "pointer", i }, { "pt_idx", 0 },
+            { "address_type", "p2wpkh" }, { "script", b2h(random_bytes(22)) } };
+        nlohmann::json input = { { "satoshi", satoshi + 1000 }, { "is_relevant", false }, { "pt_idx", 0 },
+            { "prevtxhash", b2h(random_bytes(32)) } };
+        return { { "txhash", txhash }, { "block_height", 2000000 + i / 4 }, { "created_at_ts", 1600000000000000 + i },
+            { "fee", 1000 }, { "fee_rate", 7090 }, { "transaction_vsize", 141 }, { "transaction_weight", 561 },
+            { "type", "incoming" }, { "memo", std::string() }, { "can_rbf", false }, { "can_cpfp", false },
+            { "inputs", nlohmann::json::array({ std::move(input) }) },
+            { "outputs", nlohmann::json::array({ std::move(output) }) },
+            { "satoshi", { { "btc", static_cast<int64_t>(satoshi) } } } };
+    }
+
+    static wallet_fixture make_wallet(size_t num_txs)
+    {
+        std::mt19937 rng(static_cast<uint32_t>(num_txs));
+        wallet_fixture w;
+        w.txhashes.reserve(num_txs);
+        w.txs.reserve(num_txs);
+        for (size_t i = 0; i < num_txs; ++i) {
+            w.txhashes.push_back(b2h(random_bytes(32)));
+            w.txs.push_back(make_tx_json(w.txhashes.back(), i, rng));
+        }
+        return w;
+    }
+
+    //
+    // Benchmarks
+    //
+    static void bench_aes_gcm()
+    {
+        const auto key = random_bytes(32);
+        for (size_t len : { 1024u, 65536u }) {
+            const auto plaintext = random_bytes(len);
+            std::vector<unsigned char> cyphertext(aes_gcm_encrypt_get_length(plaintext));
+            run_timed("aes_gcm_encrypt/" + std::to_string(len), [&](size_t n) {
+                for (size_t i = 0; i < n; ++i) {
+                    aes_gcm_encrypt(key, plaintext, cyphertext);
+                }
+            });
+            std::vector<unsigned char> decrypted(aes_gcm_decrypt_get_length(cyphertext));
+            run_timed("aes_gcm_decrypt/" + std::to_string(len), [&](size_t n) {
+                for (size_t i = 0; i < n; ++i) {
+                    aes_gcm_decrypt(key, cyphertext, decrypted);
+                }
+            });
+        }
+    }
+
+    static void bench_cache(const network_parameters& net_params, std::shared_ptr<signer> signer,
+        const wallet_fixture& w, const std::string& suffix)
+    {
+        // Use a distinct key per wallet size so each gets its own database
+        const auto key = random_bytes(32);
+        {
+            cache c(net_params, BENCH_NETWORK);
+            c.load_db(key, signer);
+            run_once("cache/insert_transaction" + suffix, w.txs.size(), [&] {
+                cache::write_batch batch(c);
+                for (size_t i = 0; i < w.txs.size(); ++i) {
+                    c.insert_transaction(0, 1600000000000000 + i, w.txhashes[i], w.txs[i]);
+                }
+            });
+            run_once("cache/get_transactions" + suffix, w.txs.size(), [&] {
+                size_t count = 0;
+                c.get_transactions(0, 0, w.txs.size(), [&count](auto, auto&, auto, auto, auto, auto) { ++count; });
+                GDK_RUNTIME_ASSERT(count == w.txs.size());
+            });
+            run_once("cache/save" + suffix, w.txs.size(), [&] { c.flush_db(); });
+            // Re-save after a small change, as happens on each new tx
+            c.insert_transaction(0, 1700000000000000, b2h(random_bytes(32)), w.txs.front());
+            run_once("cache/save_incremental" + suffix, 1, [&] { c.flush_db(); });
+        }
+        run_once("cache/load" + suffix, w.txs.size(), [&] {
+            cache c(net_params, BENCH_NETWORK);
+            c.load_db(key, signer);
+        });
+    }
+
+    static void bench_wamp_cast_json(const wallet_fixture& w, const std::string& suffix)
+    {
+        // A get_transactions style result: a list of tx dicts
+        nlohmann::json args = nlohmann::json::array();
+        args.push_back({ { "list", w.txs } });
+        const auto packed = nlohmann::json::to_msgpack(args);
+        run_once("wamp_cast_json" + suffix, w.txs.size(), [&] {
+            msgpack::object_handle oh = msgpack::unpack(reinterpret_cast<const char*>(packed.data()), packed.size());
+            const msgpack::object obj = oh.get();
+            autobahn::wamp_call_result result(std::move(*oh.zone()));
+            result.set_arguments(obj);
+            GDK_RUNTIME_ASSERT(wamp_cast_json(result).at("list").size() == w.txs.size());
+        });
+    }
+
+    static void bench_client_blob(const wallet_fixture& w, const std::string& suffix)
+    {
+        client_blob blob;
+        blob.compute_keys(random_bytes(EC_PUBLIC_KEY_LEN));
+        for (size_t i = 0; i < w.txhashes.size(); ++i) {
+            blob.set_tx_memo(w.txhashes[i], "memo " + std::to_string(i));
+        }
+        std::pair<std::vector<unsigned char>, nlohmann::json> saved;
+        run_once("client_blob/save" + suffix, w.txhashes.size(), [&] { saved = blob.save(); });
+        const std::string hmac = saved.second.at("hmac");
+        run_once("client_blob/load" + suffix, w.txhashes.size(), [&] { blob.load(saved.first, hmac); });
+    }
+
+    static void bench_select_coins(const std::string& suffix, size_t num_utxos)
+    {
+        std::mt19937 rng(static_cast<uint32_t>(num_utxos));
+        std::vector<amount::value_type> values(num_utxos);
+        amount::value_type total = 0;
+        for (auto& v : values) {
+            v = rng() % 10000000 + 546;
+            total += v;
+        }
+        coin_selection_params params;
+        params.target = total / 3;
+        params.change_cost = 5;
+        run_once("select_coins" + suffix, num_utxos, [&] {
+            const auto selected = select_coins(values, params);
+            GDK_RUNTIME_ASSERT(!selected.empty());
+        });
+    }
+
+    static void bench_signing(session_impl& session, std::shared_ptr<signer> signer)
+    {
+        constexpr size_t num_inputs = 100;
+        Tx tx(0, WALLY_TX_VERSION_2, false);
+        std::vector<nlohmann::json> utxos;
+        const auto spk = random_bytes(22);
+        for (size_t i = 0; i < num_inputs; ++i) {
+            tx.add_input(random_bytes(32), 0, 0xfffffffd, {});
+            // P2WPKH script code
+            const auto script_code = "76a914" + b2h(random_bytes(20)) + "88ac";
+            utxos.push_back({ { "satoshi", 100000 + i }, { "prevout_script", script_code },
+                { "address_type", "p2wpkh" } });
+        }
+        tx.add_output(90000, spk);
+
+        run_timed("Tx::get_signature_hash/100_inputs", [&](size_t n) {
+            for (size_t i = 0; i < n; ++i) {
+                sighash_context ctx(session, utxos);
+                for (size_t j = 0; j < num_inputs; ++j) {
+                    tx.get_signature_hash(ctx, j, WALLY_SIGHASH_ALL);
+                }
+            }
+        });
+
+        std::vector<signer::sign_request> requests;
+        sighash_context ctx(session, utxos);
+        for (size_t j = 0; j < num_inputs; ++j) {
+            std::vector<uint32_t> path{ 0x80000054, 0x80000001, 0x80000000, 0, static_cast<uint32_t>(j) };
+            requests.push_back({ std::move(path), tx.get_signature_hash(ctx, j, WALLY_SIGHASH_ALL), false });
+        }
+        run_timed("signer::sign/100_inputs", [&](size_t n) {
+            for (size_t i = 0; i < n; ++i) {
+                signer->sign(requests);
+            }
+        });
+    }
+
+    static void bench_blinding()
+    {
+        // A blinded output, as produced when blinding a tx
+        const uint64_t value = 123456789;
+        const auto asset = random_bytes(ASSET_TAG_LEN);
+        const auto script = random_bytes(22);
+        const auto abf = random_bytes(BLINDING_FACTOR_LEN);
+        const auto vbf = random_bytes(BLINDING_FACTOR_LEN);
+        const auto blinding_keypair = get_ephemeral_keypair();
+        const auto& blinding_key = blinding_keypair.first;
+        const auto& blinding_pubkey = blinding_keypair.second;
+        const auto ephemeral_keypair = get_ephemeral_keypair();
+        const auto& ephemeral_key = ephemeral_keypair.first;
+        const auto& ephemeral_pubkey = ephemeral_keypair.second;
+        const auto generator = asset_generator_from_bytes(asset, abf);
+        const auto commitment = asset_value_commitment(value, vbf, generator);
+
+        std::vector<unsigned char> rangeproof;
+        run_timed("blind/asset_rangeproof", [&](size_t n) {
+            for (size_t i = 0; i < n; ++i) {
+                rangeproof = asset_rangeproof(value, blinding_pubkey, ephemeral_key, asset, abf, vbf, commitment,
+                    script, generator);
+            }
+        });
+
+        // A surjection proof against 3 inputs, one of the same asset
+        std::vector<unsigned char> input_assets, input_abfs, input_generators;
+        for (size_t i = 0; i < 3; ++i) {
+            const auto in_asset = i ? random_bytes(ASSET_TAG_LEN) : asset;
+            const auto in_abf = random_bytes(BLINDING_FACTOR_LEN);
+            const auto in_generator = asset_generator_from_bytes(in_asset, in_abf);
+            input_assets.insert(input_assets.end(), in_asset.begin(), in_asset.end());
+            input_abfs.insert(input_abfs.end(), in_abf.begin(), in_abf.end());
+            input_generators.insert(input_generators.end(), in_generator.begin(), in_generator.end());
+        }
+        const auto entropy = random_bytes(32);
+        run_timed("blind/asset_surjectionproof/3_inputs", [&](size_t n) {
+            for (size_t i = 0; i < n; ++i) {
+                asset_surjectionproof(asset, abf, generator, entropy, input_assets, input_abfs, input_generators);
+            }
+        });
+
+        run_timed("unblind/asset_unblind", [&](size_t n) {
+            for (size_t i = 0; i < n; ++i) {
+                const auto unblinded
+                    = asset_unblind(blinding_key, rangeproof, commitment, ephemeral_pubkey, script, generator);
+                GDK_RUNTIME_ASSERT(std::get<3>(unblinded) == value);
+            }
+        });
+    }
+
+    static std::vector<size_t> parse_sizes(const std::string& sizes)
+    {
+        std::vector<size_t> ret;
+        size_t pos = 0;
+        while (pos < sizes.size()) {
+            const auto next = sizes.find(',', pos);
+            ret.push_back(std::stoul(sizes.substr(pos, next - pos)));
+            pos = next == std::string::npos ? sizes.size() : next + 1;
+        }
+        return ret;
+    }
+} // namespace
+
+int main(int argc, char** argv)
+{
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--json") {
+            g_state.as_json = true;
+        } else if (arg == "--sizes" && i + 1 < argc) {
+            g_state.sizes = parse_sizes(argv[++i]);
+        } else {
+            g_state.filter = arg;
+        }
+    }
+
+    // Keep all generated state in a scratch directory
+    const auto datadir = std::filesystem::temp_directory_path() / ("gdk_bench_" + b2h(random_bytes(8)));
+    std::filesystem::create_directories(datadir);
+    gdk_init({ { "datadir", datadir.string() }, { "log_level", "none" }, { "cache_flush_ms", 0 } });
+
+    {
+        const nlohmann::json net_details = { { "name", BENCH_NETWORK } };
+        auto session = session_impl::create(net_details);
+        const auto& net_params = session->get_network_parameters();
+        auto signer = std::make_shared<green::signer>(
+            net_params, nlohmann::json::object(), nlohmann::json({ { "mnemonic", BENCH_MNEMONIC } }));
+
+        bench_aes_gcm();
+        bench_blinding();
+        bench_signing(*session, signer);
+
+        for (const auto num_txs : g_state.sizes) {
+            const auto suffix = "/" + std::to_string(num_txs) + "_txs";
+            const auto wallet = make_wallet(num_txs);
+            bench_cache(net_params, signer, wallet, suffix);
+            bench_wamp_cast_json(wallet, suffix);
+            bench_client_blob(wallet, suffix);
+            bench_select_coins("/" + std::to_string(num_txs) + "_utxos", num_txs);
+        }
+    }
+
+    if (g_state.as_json) {
+        std::cout << g_state.results.dump(2) << std::endl;
+    }
+    std::filesystem::remove_all(datadir);
+    return 0;
+}
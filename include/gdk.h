@@ -51,6 +51,9 @@ struct GA_auth_handler;
 /** A notification handler */
 typedef void (*GA_notification_handler)(void* context, GA_json* details);
 
+/** A completion handler for asynchronous auth_handler calls */
+typedef void (*GA_auth_handler_completion)(void* context, GA_json* status);
+
 /**
  * Perform one-time initialization of the library. This call must be made once
  * only before calling any other GDK functions, including any functions called
@@ -386,6 +389,19 @@ GDK_API int GA_update_subaccount(struct GA_session* session, GA_json* details, s
  */
 GDK_API int GA_get_transactions(struct GA_session* session, GA_json* details, struct GA_auth_handler** call);
 
+/**
+ * Search the user's cached transaction history.
+ *
+ * :param session: The session to use.
+ * :param details: :ref:`search-transactions-details` giving the criteria to search for.
+ * :param output: Destination for the matching transactions as :ref:`search-transactions-result`.
+ *|     Returned GA_json should be freed using `GA_destroy_json`.
+ *
+ * .. note:: Only transactions already synced using `GA_get_transactions` are searched.
+ *|     This call is only supported for multisig sessions.
+ */
+GDK_API int GA_search_transactions(struct GA_session* session, GA_json* details, GA_json** output);
+
 /**
  * Get a new address to receive coins to.
  *
@@ -400,6 +416,20 @@ GDK_API int GA_get_transactions(struct GA_session* session, GA_json* details, st
  */
 GDK_API int GA_get_receive_address(struct GA_session* session, GA_json* details, struct GA_auth_handler** call);
 
+/**
+ * Get a number of new addresses to receive coins to.
+ *
+ * :param session: The session to use.
+ * :param details: :ref:`receive-addresses-request`.
+ * :param call: Destination for the resulting ``GA_auth_handler`` to perform the fetch.
+ *|     The call handlers result is :ref:`receive-addresses`.
+ *
+ * .. note:: The returned ``GA_auth_handler`` should be freed using `GA_destroy_auth_handler`.
+ *
+ * .. note:: ``details`` is emptied when called directly from C or C++.
+ */
+GDK_API int GA_get_receive_addresses(struct GA_session* session, GA_json* details, struct GA_auth_handler** call);
+
 /**
  * Get a page of addresses previously generated for a subaccount.
  *
@@ -502,6 +532,16 @@ GDK_API int GA_get_available_currencies(struct GA_session* session, GA_json** cu
  */
 GDK_API int GA_convert_amount(struct GA_session* session, const GA_json* value_details, GA_json** output);
 
+/**
+ * Convert a list of Bitcoin or asset values to all available representations.
+ *
+ * :param session: The session to use.
+ * :param details: :ref:`convert-amounts-details` containing the values to convert.
+ * :param output: Destination for the converted values :ref:`convert-amounts-result`.
+ *|     Returned GA_json should be freed using `GA_destroy_json`.
+ */
+GDK_API int GA_convert_amounts(struct GA_session* session, const GA_json* details, GA_json** output);
+
 /**
  * Encrypt JSON with a server provided key protected by a PIN.
  *
@@ -746,6 +786,17 @@ GDK_API int GA_set_nlocktime(
 GDK_API int GA_set_transaction_memo(
     struct GA_session* session, const char* txhash_hex, const char* memo, uint32_t memo_type);
 
+/**
+ * Set the memos of several transactions at once.
+ *
+ * :param session: The session to use.
+ * :param details: The :ref:`tx-memos-details` giving the memos to set.
+ *
+ * The client blob is updated and saved to the server once for all
+ * memos, rather than once per memo as with `GA_set_transaction_memo`.
+ */
+GDK_API int GA_set_transaction_memos(struct GA_session* session, const GA_json* details);
+
 /**
  * Get the current network's fee estimates.
  *
@@ -762,6 +813,31 @@ GDK_API int GA_set_transaction_memo(
  */
 GDK_API int GA_get_fee_estimates(struct GA_session* session, GA_json** estimates);
 
+/**
+ * Get latency and error statistics for internal operations.
+ *
+ * :param session: The session to use.
+ * :param output: Destination for the returned :ref:`stats`.
+ *|     Returned GA_json should be freed using `GA_destroy_json`.
+ *
+ * Statistics are collected for all sessions in the process, from the
+ * time that `GA_init` is called.
+ */
+GDK_API int GA_get_stats(struct GA_session* session, GA_json** output);
+
+/**
+ * Get the memory used by the caches of a session.
+ *
+ * :param session: The session to use.
+ * :param output: Destination for the returned :ref:`memory-stats`.
+ *|     Returned GA_json should be freed using `GA_destroy_json`.
+ *
+ * Cached data can be released under memory pressure by calling
+ * `GA_cache_control` with a :ref:`cache-control-request` whose
+ * ``"data_source"`` is ``"memory"``.
+ */
+GDK_API int GA_get_memory_stats(struct GA_session* session, GA_json** output);
+
 /**
  * Get the user's credentials.
  *
@@ -837,6 +913,28 @@ GDK_API int GA_convert_json_to_string(const GA_json* json, char** output);
 
 GDK_API int GA_convert_string_to_json(const char* input, GA_json** output);
 
+/**
+ * Serialize a GA_json object to msgpack.
+ *
+ * :param json: The GA_json object to serialize.
+ * :param output_bytes: Destination for the msgpack encoded bytes.
+ * :param len: The length of ``output_bytes`` in bytes.
+ * :param written: Destination for the length of the encoded bytes. If this
+ *|     is greater than ``len`` nothing is written to ``output_bytes``, and the
+ *|     call should be retried with a buffer of at least this length.
+ */
+GDK_API int GA_convert_json_to_msgpack(const GA_json* json, unsigned char* output_bytes, size_t len, size_t* written);
+
+/**
+ * Deserialize a GA_json object from msgpack.
+ *
+ * :param input_bytes: The msgpack encoded bytes.
+ * :param len: The length of ``input_bytes`` in bytes.
+ * :param output: Destination for the resulting GA_json.
+ *|     Returned GA_json should be freed using `GA_destroy_json`.
+ */
+GDK_API int GA_convert_msgpack_to_json(const unsigned char* input_bytes, size_t len, GA_json** output);
+
 GDK_API int GA_convert_json_value_to_string(const GA_json* json, const char* path, char** output);
 
 GDK_API int GA_convert_json_value_to_uint32(const GA_json* json, const char* path, uint32_t* output);
@@ -932,6 +1030,29 @@ GDK_API int GA_auth_handler_resolve_code(struct GA_auth_handler* call, const cha
  */
 GDK_API int GA_auth_handler_call(struct GA_auth_handler* call);
 
+#ifndef SWIG
+/**
+ * Perform an action following the completion of authorization, without blocking the caller.
+ *
+ * :param call: The auth_handler representing the action to perform.
+ * :param completion: The handler to call when the action has been performed.
+ * :param context: A context pointer to be passed to the handler.
+ *
+ * This call returns immediately. The action is performed by a thread from a
+ * pool shared by all auth_handlers, and ``completion`` is then called from
+ * that thread with the resulting :ref:`auth-handler-status`, exactly as
+ * `GA_auth_handler_get_status` would return it. The ``GA_json`` object passed
+ * to the handler must be destroyed by the caller using `GA_destroy_json`.
+ *
+ * The auth_handler must be in the ``"call"`` state. It must not be used or
+ * destroyed by the caller until ``completion`` has been called, which may
+ * happen before this call returns. Errors performing the action are
+ * returned in the status with ``"status"`` set to ``"error"``.
+ */
+GDK_API int GA_auth_handler_call_async(
+    struct GA_auth_handler* call, GA_auth_handler_completion completion, void* context);
+#endif
+
 /**
  * Free an auth_handler after use.
  *
@@ -1,7 +1,10 @@
+#include <array>
 #include <cctype>
 #include <cstring>
 #include <iostream>
+#include <optional>
 #include <stdexcept>
+#include <string_view>
 
 #include "exception.hpp"
 #include "ga_strings.hpp"
@@ -25,15 +28,134 @@ namespace green {
         static constexpr int64_t SATOSHI_MAX = static_cast<int64_t>(WALLY_BTC_MAX) * WALLY_SATOSHI_PER_BTC;
         static const conversion_type COIN_VALUE_100("100");
         static const conversion_type COIN_VALUE_DECIMAL("100000000");
-        static const conversion_type COIN_VALUE_DECIMAL_MBTC("100000");
-        static const conversion_type COIN_VALUE_DECIMAL_UBTC("100");
         static const std::vector<std::string> NON_SATOSHI_KEYS{ "btc", "mbtc", "ubtc", "bits", "sats", "fiat",
             "fiat_currency", "fiat_rate", "is_current" };
 
+        static constexpr std::array<int64_t, 9> POW10{ 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000,
+            100000000 };
+
         template <typename T> static std::string fmt(const T& fiat, size_t dp = 2)
         {
             return fiat_type(fiat).str(dp, std::ios_base::fixed | std::ios_base::showpoint);
         }
+
+        // A plain decimal string parsed as an integer and its decimal places
+        struct fixed_point final {
+            int64_t value;
+            size_t dp;
+        };
+
+        // Parse a plain decimal number such as "-12.345" without allocating.
+        // At most max_dp decimal places are kept: if truncate is true any
+        // further digits are dropped, otherwise they cause the parse to fail.
+        // Anything else (exponents, whitespace, values too large to hold in
+        // an int64_t) fails, and is left to the (slower) decimal type.
+        static std::optional<fixed_point> parse_fixed(std::string_view str, size_t max_dp, bool truncate)
+        {
+            constexpr int64_t max_value = 100000000000000000; // Leaves room for another digit
+            bool is_negative = false;
+            if (!str.empty() && (str.front() == '-' || str.front() == '+')) {
+                is_negative = str.front() == '-';
+                str.remove_prefix(1);
+            }
+            fixed_point result{ 0, 0 };
+            bool have_digits = false, have_point = false;
+            for (const char c : str) {
+                if (c == '.' && !have_point) {
+                    have_point = true;
+                    continue;
+                }
+                if (c < '0' || c > '9') {
+                    return std::nullopt;
+                }
+                have_digits = true;
+                if (have_point) {
+                    if (result.dp == max_dp) {
+                        if (!truncate) {
+                            return std::nullopt;
+                        }
+                        continue;
+                    }
+                    ++result.dp;
+                }
+                if (result.value >= max_value) {
+                    return std::nullopt;
+                }
+                result.value = result.value * 10 + (c - '0');
+            }
+            if (!have_digits) {
+                return std::nullopt;
+            }
+            if (is_negative) {
+                result.value = -result.value;
+            }
+            return result;
+        }
+
+        // Parse a decimal string as an integer number of 10^-dp units,
+        // truncating towards zero as converting the decimal type does
+        static std::optional<int64_t> parse_units(std::string_view str, size_t dp)
+        {
+            const auto parsed = parse_fixed(str, dp, true);
+            if (!parsed) {
+                return std::nullopt;
+            }
+            int64_t units;
+            if (__builtin_mul_overflow(parsed->value, POW10.at(dp - parsed->dp), &units)) {
+                return std::nullopt;
+            }
+            return units;
+        }
+
+        static int64_t to_satoshi(const std::string& str, size_t dp)
+        {
+            if (const auto satoshi = parse_units(str, dp); satoshi) {
+                return *satoshi;
+            }
+            return (conversion_type(str) * conversion_type(POW10.at(dp))).convert_to<int64_t>();
+        }
+
+        static uint64_t magnitude(int64_t v) { return v < 0 ? -static_cast<uint64_t>(v) : v; }
+
+        // Format units / 10^dp with exactly dp decimal places
+        static std::string format_units(uint64_t v, size_t dp, bool is_negative)
+        {
+            std::array<char, 32> buf;
+            auto p = buf.end();
+            for (size_t i = 0; i < dp; ++i, v /= 10) {
+                *--p = '0' + v % 10;
+            }
+            if (dp) {
+                *--p = '.';
+            }
+            do {
+                *--p = '0' + v % 10;
+                v /= 10;
+            } while (v);
+            if (is_negative) {
+                *--p = '-';
+            }
+            return std::string(p, buf.end());
+        }
+
+        // Compute the fiat value of satoshi at fiat_rate, formatted to 2 DP
+        static std::string to_fiat(int64_t satoshi, const std::string& fiat_rate)
+        {
+            if (const auto rate = parse_fixed(fiat_rate, POW10.size() - 1, false); rate && rate->value >= 0) {
+                // fiat cents = satoshi * rate / 10^(8 + dp - 2), rounded half to even
+                int64_t product;
+                if (!__builtin_mul_overflow(satoshi, rate->value, &product)) {
+                    const uint64_t divisor = POW10.back() * POW10.at(rate->dp) / 100;
+                    const uint64_t remainder = magnitude(product) % divisor;
+                    uint64_t cents = magnitude(product) / divisor;
+                    if (remainder * 2 > divisor || (remainder * 2 == divisor && (cents & 1))) {
+                        ++cents;
+                    }
+                    return format_units(cents, 2, product < 0);
+                }
+            }
+            return fmt(fiat_type(conversion_type(fiat_rate) * conversion_type(satoshi) / COIN_VALUE_DECIMAL));
+        }
     } // namespace
 
     amount::amount(const nlohmann::json& json_value)
@@ -88,27 +210,23 @@ namespace green {
 
         const bool is_current = !fiat_rate.empty() && !fiat_currency.empty();
 
-        const conversion_type COIN_VALUE_WITH_PRECISION(std::pow(10, precision));
         signed_value_type satoshi;
 
         // Compute satoshi from our input
         if (satoshi_p != end_p) {
             satoshi = *satoshi_p;
         } else if (btc_p != end_p) {
-            const std::string btc_str = *btc_p;
-            satoshi = (conversion_type(btc_str) * COIN_VALUE_DECIMAL).convert_to<signed_value_type>();
+            satoshi = to_satoshi(btc_p->get_ref<const std::string&>(), 8);
         } else if (mbtc_p != end_p) {
-            const std::string mbtc_str = *mbtc_p;
-            satoshi = (conversion_type(mbtc_str) * COIN_VALUE_DECIMAL_MBTC).convert_to<signed_value_type>();
+            satoshi = to_satoshi(mbtc_p->get_ref<const std::string&>(), 5);
         } else if (ubtc_p != end_p || bits_p != end_p) {
-            const std::string ubtc_str = *(ubtc_p == end_p ? bits_p : ubtc_p);
-            satoshi = (conversion_type(ubtc_str) * COIN_VALUE_DECIMAL_UBTC).convert_to<signed_value_type>();
+            const auto& ubtc_str = (ubtc_p == end_p ? bits_p : ubtc_p)->get_ref<const std::string&>();
+            satoshi = to_satoshi(ubtc_str, 2);
         } else if (sats_p != end_p) {
-            const std::string sats_str = *sats_p;
-            satoshi = (conversion_type(sats_str)).convert_to<signed_value_type>();
+            satoshi = to_satoshi(sats_p->get_ref<const std::string&>(), 0);
         } else if (asset_p != end_p) {
-            const std::string asset_str = *asset_p;
-            satoshi = (conversion_type(asset_str) * COIN_VALUE_WITH_PRECISION).convert_to<signed_value_type>();
+            const auto& asset_str = asset_p->get_ref<const std::string&>();
+            satoshi = to_satoshi(asset_str, precision);
         } else {
             if (fiat_rate_used.empty()) {
                 throw user_error(res::id_your_favourite_exchange_rate_is);
@@ -130,10 +248,11 @@ namespace green {
         }
 
         // Then compute the other denominations and fiat amount
-        const conversion_type satoshi_conv = conversion_type(satoshi);
-        const std::string btc = fmt(btc_type(satoshi_conv / COIN_VALUE_DECIMAL), 8);
-        const std::string mbtc = fmt(btc_type(satoshi_conv / COIN_VALUE_DECIMAL_MBTC), 5);
-        const std::string ubtc = fmt(btc_type(satoshi_conv / COIN_VALUE_DECIMAL_UBTC), 2);
+        const uint64_t satoshi_units = magnitude(satoshi);
+        const bool is_negative = satoshi < 0;
+        const std::string btc = format_units(satoshi_units, 8, is_negative);
+        const std::string mbtc = format_units(satoshi_units, 5, is_negative);
+        const std::string ubtc = format_units(satoshi_units, 2, is_negative);
         const std::string sats = std::to_string(satoshi);
 
         nlohmann::json result = { { "satoshi", satoshi }, { "btc", btc }, { "mbtc", mbtc }, { "ubtc", ubtc },
@@ -142,15 +261,14 @@ namespace green {
 
         if (!fiat_rate_used.empty()) {
             result["fiat_rate"] = fiat_rate_used;
-            result["fiat"]
-                = fmt(fiat_type(conversion_type(fiat_rate_used) * conversion_type(satoshi) / COIN_VALUE_DECIMAL));
+            result["fiat"] = to_fiat(satoshi, fiat_rate_used);
         }
 
         if (have_asset_info) {
             if (precision == 0) {
                 result[asset_id] = sats;
             } else {
-                result[asset_id] = fmt(btc_type(satoshi_conv / COIN_VALUE_WITH_PRECISION), precision);
+                result[asset_id] = format_units(satoshi_units, precision, is_negative);
             }
         }
         return result;
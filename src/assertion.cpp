@@ -20,6 +20,6 @@ namespace green {
         throw assertion_error(msg);
     }
 
-    void throw_user_error(const std::string& error_message) { throw user_error(error_message); }
+    void throw_user_error(std::string_view error_message) { throw user_error(error_message); }
 
 } // namespace green
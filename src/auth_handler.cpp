@@ -1,3 +1,9 @@
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
 #include "auth_handler.hpp"
 #include "autobahn_wrapper.hpp"
 #include "exception.hpp"
@@ -9,6 +15,9 @@
 #include "session.hpp"
 #include "session_impl.hpp"
 #include "signer.hpp"
+#include "stats.hpp"
+#include "threading.hpp"
+#include "utils.hpp"
 
 namespace green {
 
@@ -20,8 +29,93 @@ namespace green {
         {
             return msg == "Invalid Two Factor Authentication Code";
         }
+
+        // Runs auth handler calls made by call_async. Calls block on network
+        // round trips, so they run on their own workers rather than the I/O
+        // pool, whose threads must remain free to complete them. Workers are
+        // started on demand up to a fixed limit and are shared by all handlers
+        class call_pool final {
+        public:
+            using task_t = std::function<void()>;
+
+            // Never destroyed, so detached workers remain valid
+            static call_pool& get()
+            {
+                static call_pool* s_pool = new call_pool();
+                return *s_pool;
+            }
+
+            void post(task_t task)
+            {
+                std::lock_guard<std::mutex> locker(m_mutex);
+                m_tasks.emplace_back(std::move(task));
+                if (m_num_idle >= m_tasks.size() || m_num_threads >= m_max_threads) {
+                    m_cv.notify_one();
+                    return;
+                }
+                try {
+                    std::thread([this] { run(); }).detach();
+                    ++m_num_threads;
+                } catch (const std::exception&) {
+                    if (!m_num_threads) {
+                        m_tasks.pop_back();
+                        throw; // No workers to run the task
+                    }
+                    m_cv.notify_one(); // Continue with the workers we have
+                }
+            }
+
+        private:
+            call_pool()
+                : m_max_threads(std::max(std::thread::hardware_concurrency() * 2, 4u))
+            {
+            }
+
+            void run()
+            {
+                std::unique_lock<std::mutex> locker(m_mutex);
+                for (;;) {
+                    ++m_num_idle;
+                    m_cv.wait(locker, [this] { return !m_tasks.empty(); });
+                    --m_num_idle;
+                    auto task = std::move(m_tasks.front());
+                    m_tasks.pop_front();
+                    unique_unlock unlocker(locker);
+                    no_std_exception_escape(task, "call_pool");
+                }
+            }
+
+            std::mutex m_mutex;
+            std::condition_variable m_cv;
+            std::deque<task_t> m_tasks;
+            const size_t m_max_threads;
+            size_t m_num_threads = 0;
+            size_t m_num_idle = 0;
+        };
     } // namespace
 
+    void call_async(auth_handler& handler, std::function<void(nlohmann::json status)> fn)
+    {
+        GDK_RUNTIME_ASSERT(fn);
+        GDK_RUNTIME_ASSERT(handler.get_state() == auth_handler::state_type::make_call);
+        call_pool::get().post([&handler, fn = std::move(fn)] {
+            nlohmann::json status;
+            try {
+                try {
+                    handler();
+                } catch (const std::exception& e) {
+                    // Report the error through the handler, so that the
+                    // status has the same fields as for any other state
+                    handler.set_error(e.what());
+                }
+                status = handler.get_status();
+            } catch (const std::exception& e) {
+                status = { { "status", "error" }, { "error", e.what() } };
+            }
+            fn(std::move(status));
+        });
+    }
+
     //
     // Common auth handling implementation
     //
@@ -71,7 +165,7 @@ namespace green {
 
     void auth_handler::signal_data_request() { GDK_RUNTIME_ASSERT(false); }
 
-    void auth_handler::set_error(const std::string& /*error_message*/) { GDK_RUNTIME_ASSERT(false); }
+    void auth_handler::set_error(std::string_view /*error_message*/) { GDK_RUNTIME_ASSERT(false); }
 
     void auth_handler::request_code_impl(const std::string& /*method*/) { GDK_RUNTIME_ASSERT(false); }
 
@@ -114,6 +208,7 @@ namespace green {
         auto hw_device = m_signer ? m_signer->get_device() : nlohmann::json();
         m_twofactor_data = { { "action", action }, { "device", hw_device } };
         m_state = state_type::resolve_code;
+        m_hw_request_start = std::chrono::steady_clock::now();
         return m_twofactor_data;
     }
 
@@ -135,7 +230,7 @@ namespace green {
         m_auth_data = nlohmann::json::object();
     }
 
-    void auth_handler_impl::set_error(const std::string& error_message)
+    void auth_handler_impl::set_error(std::string_view error_message)
     {
         GDK_LOG(warning) << m_name << " call exception: " << error_message;
         m_state = state_type::error;
@@ -190,6 +285,9 @@ namespace green {
     {
         GDK_RUNTIME_ASSERT(m_state == state_type::resolve_code);
         GDK_RUNTIME_ASSERT(m_hw_request != hw_request::none);
+        // Record the time the caller took to interact with the hardware
+        const auto elapsed = std::chrono::steady_clock::now() - m_hw_request_start;
+        stats::record("hw_request", j_strref(m_twofactor_data, "action"), elapsed);
         m_hw_reply = std::move(reply);
         m_state = state_type::make_call;
     }
@@ -198,6 +296,7 @@ namespace green {
     {
         GDK_RUNTIME_ASSERT(m_state == state_type::make_call);
         GDK_RUNTIME_ASSERT(m_session); // Must be connected
+        const auto start = std::chrono::steady_clock::now();
         bool is_invalid_code = false;
         try {
 
@@ -248,6 +347,7 @@ namespace green {
                 m_state = state_type::resolve_code;
             }
         }
+        stats::record("auth_handler", m_name, std::chrono::steady_clock::now() - start, m_state == state_type::error);
     }
 
     auth_handler::state_type auth_handler_impl::get_state() const { return m_state; }
@@ -396,6 +496,11 @@ namespace green {
 
     std::shared_ptr<signer> auto_auth_handler::get_signer() const { return get_current_handler()->get_signer(); }
 
+    void auto_auth_handler::set_error(std::string_view error_message)
+    {
+        get_current_handler()->set_error(error_message);
+    }
+
     void auto_auth_handler::advance()
     {
         while (step()) {
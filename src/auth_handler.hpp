@@ -2,9 +2,12 @@
 #define GDK_AUTH_HANDLER_HPP
 #pragma once
 
+#include <chrono>
+#include <functional>
 #include <memory>
 #include <nlohmann/json.hpp>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace green {
@@ -66,11 +69,12 @@ namespace green {
         virtual void on_next_handler_complete(auth_handler* next_handler);
 
         virtual nlohmann::json& signal_hw_request(hw_request request);
+        // Put the handler into the error state with the given message
+        virtual void set_error(std::string_view error_message);
 
     protected:
         virtual void signal_2fa_request(const std::string& action);
         virtual void signal_data_request();
-        virtual void set_error(const std::string& error_message);
 
         virtual void request_code_impl(const std::string& method);
         virtual state_type call_impl();
@@ -99,13 +103,12 @@ namespace green {
         void operator()() final;
         session_impl& get_session() const final;
         std::shared_ptr<signer> get_signer() const final;
+        void set_error(std::string_view error_message) final;
 
     protected:
         nlohmann::json& signal_hw_request(hw_request request) final;
         void signal_2fa_request(const std::string& action) final;
         void signal_data_request() final;
-        void set_error(const std::string& error_message) final;
-
         void request_code_impl(const std::string& method) final;
 
         session& m_session_parent;
@@ -125,6 +128,7 @@ namespace green {
         auth_handler::state_type m_state; // Current state
         uint32_t m_attempts_remaining;
         hw_request m_hw_request;
+        std::chrono::steady_clock::time_point m_hw_request_start; // When the caller was asked for hw_request
 
     private:
         bool has_retry_counter() const;
@@ -150,6 +154,7 @@ namespace green {
         void operator()() final;
         virtual session_impl& get_session() const final;
         virtual std::shared_ptr<signer> get_signer() const final;
+        void set_error(std::string_view error_message) final;
 
         void advance();
 
@@ -164,5 +169,10 @@ namespace green {
         nlohmann::json m_xpubs_request;
     };
 
+    // Make the handler's pending call on a shared worker thread, then pass
+    // its new status to fn from that thread. The handler must remain valid
+    // and must not be used by the caller until fn is called
+    void call_async(auth_handler& handler, std::function<void(nlohmann::json status)> fn);
+
 } // namespace green
 #endif
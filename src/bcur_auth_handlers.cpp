@@ -12,6 +12,7 @@
 
 #include <bc-ur/bc-ur.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
 #include <boost/format.hpp>
 #include <gsl/span>
 #include <urc/urc.h>
@@ -28,6 +29,8 @@ namespace green {
 
 #ifdef USE_REAL_BCUR
     namespace {
+        // Upper limit on the number of parts generated per encoder call
+        static constexpr uint32_t BCUR_MAX_PARTS = 10000;
 
         using urc_string_ptr = std::unique_ptr<char, decltype(&urc_string_free)>;
         using urc_buffer_ptr = std::unique_ptr<uint8_t, decltype(&urc_free)>;
@@ -195,6 +198,32 @@ namespace green {
         {
             return { j_strref(input, "ur_type"), j_bytesref(input, "data") };
         }
+
+        // Parse the number of further parts a streaming encoder should generate
+        static uint32_t parse_num_parts(const std::string& code)
+        {
+            uint32_t num_parts;
+            using boost::conversion::try_lexical_convert;
+            if (!try_lexical_convert(code, num_parts) || num_parts > BCUR_MAX_PARTS) {
+                throw user_error("Invalid number of parts");
+            }
+            return num_parts;
+        }
+
+        // Parse a single UR part, or a JSON array of parts to decode in a batch
+        static std::vector<std::string> parse_parts(const std::string& code)
+        {
+            if (code.empty() || code.front() != '[') {
+                return { code };
+            }
+            std::vector<std::string> parts;
+            try {
+                parts = json_parse(code).get<std::vector<std::string>>();
+            } catch (const std::exception&) {
+                throw user_error("Invalid part");
+            }
+            return parts;
+        }
     } // namespace
 #endif
 
@@ -210,7 +239,16 @@ namespace green {
         throw user_error("not available");
         return state_type::error;
 #else
-        if (!m_encoder) {
+        uint32_t num_parts = 0;
+        if (m_encoder) {
+            // Streaming: the caller resolves the number of further parts to generate
+            GDK_RUNTIME_ASSERT(m_action == "data");
+            num_parts = parse_num_parts(m_code);
+            if (!num_parts) {
+                m_result = { { "parts", nlohmann::json::array() }, { "seq_len", m_encoder->seq_len() } };
+                return state_type::done;
+            }
+        } else {
             const auto max_fragment_len = j_uint32ref(m_details, "max_fragment_len");
             const auto& ur_type = j_strref(m_details, "ur_type");
             if (ur_type == "jade-bip8539-request") {
@@ -226,13 +264,23 @@ namespace green {
                 ur::UR ur = prepare_generic_ur(m_details);
                 m_encoder = std::make_unique<ur::UREncoder>(std::move(ur), max_fragment_len);
             }
+            const uint32_t default_num_parts = m_encoder->seq_len() == 1 ? 1 : 3 * m_encoder->seq_len();
+            num_parts = j_uint32(m_details, "num_parts").value_or(default_num_parts);
+            GDK_USER_ASSERT(num_parts != 0 && num_parts <= BCUR_MAX_PARTS, "Invalid number of parts");
         }
         nlohmann::json::array_t parts;
-        const size_t num_parts = m_encoder->seq_len() == 1 ? 1 : 3 * m_encoder->seq_len();
         parts.reserve(num_parts);
         auto& encoder = this->m_encoder;
         std::generate_n(std::back_inserter(parts), num_parts, [&]() { return encoder->next_part(); });
-        m_result = { { "parts", std::move(parts) } };
+        if (j_bool_or_false(m_details, "stream") && !m_encoder->is_single_part()) {
+            // Keep the encoder, so the caller can ask for further parts
+            // without re-encoding the data
+            signal_data_request();
+            m_auth_data = { { "parts", std::move(parts) }, { "seq_len", m_encoder->seq_len() },
+                { "next_index", m_encoder->seq_num() } };
+            return m_state;
+        }
+        m_result = { { "parts", std::move(parts) }, { "seq_len", m_encoder->seq_len() } };
         return state_type::done;
 #endif
     }
@@ -251,13 +299,27 @@ namespace green {
 #else
         if (!m_decoder) {
             m_decoder = std::make_unique<ur::URDecoder>();
-            bool is_ok = m_decoder->receive_part(j_strref(m_details, "part"));
+            std::vector<std::string> parts;
+            if (const auto p = m_details.find("parts"); p != m_details.end()) {
+                parts = p->get<std::vector<std::string>>();
+            } else {
+                parts.emplace_back(j_strref(m_details, "part"));
+            }
+            bool is_ok = false;
+            for (const auto& part : parts) {
+                is_ok |= m_decoder->receive_part(part);
+            }
             if (!is_ok) {
                 throw user_error("Invalid part");
             }
         } else {
             GDK_RUNTIME_ASSERT(m_action == "data");
-            m_decoder->receive_part(m_code);
+            for (const auto& part : parse_parts(m_code)) {
+                if (m_decoder->is_complete()) {
+                    break; // Remaining parts are not needed
+                }
+                m_decoder->receive_part(part);
+            }
         }
 
         if (m_decoder->is_failure()) {
@@ -267,8 +329,9 @@ namespace green {
         if (!m_decoder->is_complete() || !m_decoder->is_success()) {
             signal_data_request();
             const uint32_t progress = std::lround(m_decoder->estimated_percent_complete() * 100.0);
-            m_auth_data
-                = { { "received_indices", m_decoder->received_part_indexes() }, { "estimated_progress", progress } };
+            m_auth_data = { { "received_indices", m_decoder->received_part_indexes() },
+                { "estimated_progress", progress }, { "expected_parts", m_decoder->expected_part_count() },
+                { "processed_parts", m_decoder->processed_parts_count() } };
             return m_state;
         }
 
@@ -299,12 +299,18 @@ namespace green {
         return {};
     }
 
-    nlohmann::json::array_t client_blob::get_bip329() const
+    nlohmann::json::array_t client_blob::get_bip329(size_t offset, size_t count) const
     {
         nlohmann::json::array_t items;
-        const auto memos = get_tx_memos();
-        for (const auto& memo : memos.items()) {
-            nlohmann::json line = { { "type", "tx" }, { "ref", memo.key() }, { "label", memo.value() } };
+        const size_t total = get_bip329_count();
+        if (offset >= total || !count) {
+            return items;
+        }
+        items.reserve(std::min(count, total - offset));
+        // Iterate the memos in place rather than copying them
+        const auto& memos = m_data[TX_MEMOS];
+        for (auto it = std::next(memos.begin(), offset); it != memos.end() && items.size() < count; ++it) {
+            nlohmann::json line = { { "type", "tx" }, { "ref", it.key() }, { "label", it.value() } };
             items.emplace_back(std::move(line));
         }
         // TODO: Once subaccounts/addresses are in the blob, add them here
@@ -312,6 +318,31 @@ namespace green {
         return items;
     }
 
+    nlohmann::json::array_t client_blob::get_bip329_after(const std::string& ref, size_t count) const
+    {
+        nlohmann::json::array_t items;
+        if (!get_bip329_count() || !count) {
+            return items;
+        }
+        const auto& memos = m_data[TX_MEMOS].get_ref<const nlohmann::json::object_t&>();
+        auto it = ref.empty() ? memos.begin() : memos.upper_bound(ref);
+        for (; it != memos.end() && items.size() < count; ++it) {
+            nlohmann::json line = { { "type", "tx" }, { "ref", it->first }, { "label", it->second } };
+            items.emplace_back(std::move(line));
+        }
+        return items;
+    }
+
+    size_t client_blob::get_bip329_count() const
+    {
+        if (is_key_encrypted(TX_MEMOS)) {
+            return 0; // Has been made unavailable to watch only sessions
+        }
+        return m_data[TX_MEMOS].size();
+    }
+
+    size_t client_blob::get_memory_size() const { return j_estimated_size(m_data); }
+
     const std::string& client_blob::get_zero_hmac() { return ZERO_HMAC_BASE64; }
 
     const std::string& client_blob::get_one_hmac() { return ONE_HMAC_BASE64; }
@@ -327,7 +358,7 @@ namespace green {
         GDK_RUNTIME_ASSERT(m_key.has_value());
 
         // Decrypt the encrypted data
-        std::vector<unsigned char> decrypted(aes_gcm_decrypt_get_length(data));
+        secure_bytes_t decrypted(aes_gcm_decrypt_get_length(data));
         GDK_RUNTIME_ASSERT(decrypted.size() > PREFIX.size());
         GDK_RUNTIME_ASSERT(aes_gcm_decrypt(*m_key, data, decrypted) == decrypted.size());
 
@@ -385,7 +416,8 @@ namespace green {
         GDK_RUNTIME_ASSERT(m_key.has_value());
 
         // Dump out data to msgpack format and compress it, prepending PREFIX
-        auto msgpack_data{ nlohmann::json::to_msgpack(m_data) };
+        secure_bytes_t msgpack_data;
+        nlohmann::json::to_msgpack(m_data, msgpack_data);
         auto compressed{ compress(PREFIX, msgpack_data) };
 
         // Clear and free the uncompressed representation immediately
@@ -94,7 +94,18 @@ namespace green {
         static const std::string& get_one_hmac();
         std::string compute_hmac(byte_span_t data) const;
 
-        nlohmann::json::array_t get_bip329() const;
+        // Get BIP329 labels for the blob contents, optionally only the
+        // count labels starting at offset. Labels are returned in ref order
+        nlohmann::json::array_t get_bip329(
+            size_t offset = 0, size_t count = std::numeric_limits<size_t>::max()) const;
+        // Get up to count BIP329 labels with refs after ref, in ref order,
+        // starting from the first label if ref is empty. Unlike paging by
+        // offset, this does not walk the labels before ref
+        nlohmann::json::array_t get_bip329_after(const std::string& ref, size_t count) const;
+        size_t get_bip329_count() const;
+
+        // Estimate the memory used by the decrypted blob contents
+        size_t get_memory_size() const;
 
     private:
         bool is_key_encrypted(uint32_t key) const;
@@ -0,0 +1,253 @@
+#include "coin_selection.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <random>
+
+#include "assertion.hpp"
+#include "utils.hpp"
+
+namespace green {
+
+    namespace {
+        using steady_clock_t = std::chrono::steady_clock;
+        using value_t = amount::value_type;
+
+        // Branch and bound tries, scaled by the number of candidates
+        static constexpr size_t BNB_TRIES_PER_COIN = 64;
+        static constexpr size_t BNB_MIN_TRIES = 10000;
+        static constexpr size_t BNB_MAX_TRIES = 1000000;
+        static constexpr size_t BNB_TRIES_PER_CLOCK_CHECK = 256;
+        // Knapsack repetitions, reduced for large candidate sets
+        static constexpr size_t KNAPSACK_MAX_ITERATIONS = 1000;
+        static constexpr size_t KNAPSACK_MAX_WORK = 50000000;
+
+        struct selector final {
+            selector(const std::vector<value_t>& values, const coin_selection_params& params)
+                : m_params(params)
+                , m_deadline(steady_clock_t::now() + params.budget)
+                , m_total(0)
+                , m_best_cost(std::numeric_limits<uint64_t>::max())
+            {
+                // Sort the non-zero candidates once, largest first
+                m_coins.reserve(values.size());
+                for (size_t i = 0; i < values.size(); ++i) {
+                    if (values[i]) {
+                        m_coins.push_back({ values[i], i });
+                        m_total += values[i];
+                    }
+                }
+                std::sort(m_coins.begin(), m_coins.end(), [](const auto& lhs, const auto& rhs) {
+                    return lhs.value > rhs.value || (lhs.value == rhs.value && lhs.index < rhs.index);
+                });
+            }
+
+            bool is_funded() const { return m_total >= m_params.target; }
+
+            bool is_expired() const { return steady_clock_t::now() >= m_deadline; }
+
+            uint64_t get_cost(size_t num_inputs, value_t sum) const
+            {
+                const value_t excess = sum - m_params.target;
+                const uint64_t change_cost = excess <= m_params.change_tolerance ? excess : m_params.change_cost;
+                return num_inputs * m_params.input_cost + change_cost;
+            }
+
+            // Offer a selection, given as positions in m_coins
+            void offer(const std::vector<size_t>& positions, value_t sum)
+            {
+                GDK_RUNTIME_ASSERT(sum >= m_params.target);
+                const uint64_t cost = get_cost(positions.size(), sum);
+                if (cost < m_best_cost || (cost == m_best_cost && positions.size() < m_best.size())) {
+                    m_best_cost = cost;
+                    m_best = positions;
+                }
+            }
+
+            void select_largest_first()
+            {
+                std::vector<size_t> positions;
+                value_t sum = 0;
+                for (size_t i = 0; i < m_coins.size() && sum < m_params.target; ++i) {
+                    positions.push_back(i);
+                    sum += m_coins[i].value;
+                }
+                offer(positions, sum);
+            }
+
+            // Depth first search, including larger values first, for a
+            // selection whose excess is within the change tolerance
+            void select_bnb()
+            {
+                const value_t upper = m_params.target + m_params.change_tolerance;
+                // Values above the upper bound can never be part of a match
+                const auto begin = std::partition_point(
+                    m_coins.begin(), m_coins.end(), [upper](const auto& c) { return c.value > upper; });
+                const size_t first = begin - m_coins.begin();
+                const size_t num_coins = m_coins.size() - first;
+                const size_t max_tries = std::clamp(num_coins * BNB_TRIES_PER_COIN, BNB_MIN_TRIES, BNB_MAX_TRIES);
+
+                value_t available = 0;
+                for (size_t i = first; i < m_coins.size(); ++i) {
+                    available += m_coins[i].value;
+                }
+                std::vector<size_t> selection;
+                value_t sum = 0;
+                size_t pos = first;
+                for (size_t tries = 0; tries < max_tries; ++tries, ++pos) {
+                    if (tries % BNB_TRIES_PER_CLOCK_CHECK == 0 && tries && is_expired()) {
+                        break;
+                    }
+                    bool backtrack = false;
+                    if (sum + available < m_params.target || sum > upper
+                        || selection.size() * m_params.input_cost >= m_best_cost) {
+                        backtrack = true; // This branch cannot improve on our best selection
+                    } else if (sum >= m_params.target) {
+                        offer(selection, sum);
+                        backtrack = true;
+                    }
+                    if (backtrack) {
+                        if (selection.empty()) {
+                            break; // Search exhausted
+                        }
+                        // Restore the values skipped after the last inclusion,
+                        // then try the branch that excludes it
+                        for (--pos; pos > selection.back(); --pos) {
+                            available += m_coins[pos].value;
+                        }
+                        sum -= m_coins[pos].value;
+                        selection.pop_back();
+                    } else {
+                        available -= m_coins[pos].value;
+                        // Skip including a value equal to one we just excluded:
+                        // that branch was already searched
+                        if (selection.empty() || pos - 1 == selection.back()
+                            || m_coins[pos].value != m_coins[pos - 1].value) {
+                            selection.push_back(pos);
+                            sum += m_coins[pos].value;
+                        }
+                    }
+                }
+            }
+
+            // Randomized approximation of the subset of values below the
+            // target with the smallest sum that still funds it
+            void select_knapsack()
+            {
+                const auto begin = std::partition_point(m_coins.begin(), m_coins.end(),
+                    [this](const auto& c) { return c.value >= m_params.target; });
+                const size_t first = begin - m_coins.begin();
+                if (first) {
+                    // The smallest single value that funds the target
+                    offer({ first - 1 }, m_coins[first - 1].value);
+                }
+                const size_t num_coins = m_coins.size() - first;
+                value_t lower_total = 0;
+                for (size_t i = first; i < m_coins.size(); ++i) {
+                    lower_total += m_coins[i].value;
+                }
+                if (!num_coins || lower_total < m_params.target) {
+                    return;
+                }
+                const size_t max_iterations
+                    = std::clamp(KNAPSACK_MAX_WORK / num_coins, size_t(1), KNAPSACK_MAX_ITERATIONS);
+                std::vector<bool> best(num_coins, true);
+                value_t best_sum = lower_total;
+                std::vector<bool> included(num_coins);
+                uniform_uint32_rng seed_rng;
+                std::mt19937_64 rng((uint64_t(seed_rng()) << 32) | seed_rng());
+
+                for (size_t rep = 0; rep < max_iterations && best_sum != m_params.target; ++rep) {
+                    if (rep && is_expired()) {
+                        break;
+                    }
+                    std::fill(included.begin(), included.end(), false);
+                    value_t sum = 0;
+                    bool reached_target = false;
+                    for (size_t pass = 0; pass < 2 && !reached_target; ++pass) {
+                        uint64_t bits = 0;
+                        for (size_t i = 0; i < num_coins; ++i) {
+                            if (pass == 0 && i % 64 == 0) {
+                                bits = rng();
+                            }
+                            // First pass: include at random. Second pass: include the rest
+                            const bool include = pass == 0 ? (bits >> (i % 64)) & 1 : !included[i];
+                            if (!include) {
+                                continue;
+                            }
+                            sum += m_coins[first + i].value;
+                            included[i] = true;
+                            if (sum >= m_params.target) {
+                                reached_target = true;
+                                if (sum < best_sum) {
+                                    best_sum = sum;
+                                    best = included;
+                                }
+                                sum -= m_coins[first + i].value;
+                                included[i] = false;
+                            }
+                        }
+                    }
+                }
+                std::vector<size_t> positions;
+                for (size_t i = 0; i < num_coins; ++i) {
+                    if (best[i]) {
+                        positions.push_back(first + i);
+                    }
+                }
+                offer(positions, best_sum);
+            }
+
+            std::vector<size_t> get_result() const
+            {
+                std::vector<size_t> result;
+                result.reserve(m_best.size());
+                for (const auto pos : m_best) {
+                    result.push_back(m_coins[pos].index);
+                }
+                return result;
+            }
+
+        private:
+            struct coin final {
+                value_t value;
+                size_t index; // Index in the callers values
+            };
+
+            const coin_selection_params& m_params;
+            const steady_clock_t::time_point m_deadline;
+            std::vector<coin> m_coins; // Sorted by value, largest first
+            value_t m_total;
+            std::vector<size_t> m_best; // Positions in m_coins
+            uint64_t m_best_cost;
+        };
+    } // namespace
+
+    std::vector<size_t> select_coins(
+        const std::vector<amount::value_type>& values, const coin_selection_params& params)
+    {
+        GDK_RUNTIME_ASSERT(params.strategies & COIN_SELECT_ALL);
+        selector s(values, params);
+        if (!s.is_funded() || !params.target) {
+            return {};
+        }
+        if (params.strategies & COIN_SELECT_LARGEST_FIRST) {
+            s.select_largest_first(); // Cheap, and gives an upper bound for pruning
+        }
+        if (params.strategies & COIN_SELECT_BNB) {
+            s.select_bnb();
+        }
+        if ((params.strategies & COIN_SELECT_KNAPSACK) && !s.is_expired()) {
+            s.select_knapsack();
+        }
+        auto result = s.get_result();
+        if (result.empty()) {
+            // Largest first was not requested, and the other strategies
+            // found nothing or ran out of time
+            s.select_largest_first();
+            result = s.get_result();
+        }
+        return result;
+    }
+
+} // namespace green
@@ -0,0 +1,47 @@
+#ifndef GDK_COIN_SELECTION_HPP
+#define GDK_COIN_SELECTION_HPP
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "amount.hpp"
+
+namespace green {
+
+    //
+    // UTXO selection.
+    //
+    // Candidate values are sorted and pruned once, then each enabled
+    // strategy is run in turn until the wall clock budget is spent. The
+    // selection with the lowest cost is returned, where the cost of a
+    // selection is the cost of its inputs, plus either its excess value if
+    // that is within the change tolerance, or the cost of creating change.
+    //
+    enum coin_selection_strategy : uint32_t {
+        COIN_SELECT_BNB = 0x1, // Branch and bound search for a selection that needs no change
+        COIN_SELECT_KNAPSACK = 0x2, // Randomized search for the smallest excess
+        COIN_SELECT_LARGEST_FIRST = 0x4, // Largest values first; always succeeds if funds are sufficient
+        COIN_SELECT_ALL = COIN_SELECT_BNB | COIN_SELECT_KNAPSACK | COIN_SELECT_LARGEST_FIRST,
+    };
+
+    struct coin_selection_params final {
+        amount::value_type target = 0; // The value to fund
+        amount::value_type change_tolerance = 0; // Excess that may be spent without creating change
+        uint64_t input_cost = 1; // The cost of spending one input
+        uint64_t change_cost = 1; // The cost of creating (and later spending) change
+        std::chrono::milliseconds budget{ 50 }; // Wall clock time allowed for searching
+        uint32_t strategies = COIN_SELECT_ALL;
+    };
+
+    // Select values to fund params.target. Returns the indices in values of
+    // the selection, largest value first, or an empty vector if the sum of
+    // values is insufficient or the target is zero. Zero values are never
+    // selected.
+    std::vector<size_t> select_coins(
+        const std::vector<amount::value_type>& values, const coin_selection_params& params);
+
+} // namespace green
+
+#endif
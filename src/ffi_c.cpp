@@ -313,6 +313,12 @@ GDK_DEFINE_C_FUNCTION_2(GA_get_watch_only_username, struct GA_session*, session,
 GDK_DEFINE_C_FUNCTION_2(GA_get_fee_estimates, struct GA_session*, session, GA_json**, estimates,
     { *json_cast(estimates) = new nlohmann::json(session->get_fee_estimates()); })
 
+GDK_DEFINE_C_FUNCTION_2(GA_get_stats, struct GA_session*, session, GA_json**, output,
+    { *json_cast(output) = new nlohmann::json(session->get_stats()); })
+
+GDK_DEFINE_C_FUNCTION_2(GA_get_memory_stats, struct GA_session*, session, GA_json**, output,
+    { *json_cast(output) = new nlohmann::json(session->get_memory_stats()); })
+
 GDK_DEFINE_C_FUNCTION_3(GA_get_credentials, struct GA_session*, session, GA_json*, details, struct GA_auth_handler**,
     call, { *call = make_call(new green::get_credentials_call(*session, json_move(details))); })
 
@@ -378,6 +384,9 @@ GDK_DEFINE_C_FUNCTION_4(GA_set_transaction_memo, struct GA_session*, session, co
         session->set_transaction_memo(txhash_hex, memo);
     })
 
+GDK_DEFINE_C_FUNCTION_2(GA_set_transaction_memos, struct GA_session*, session, const GA_json*, details,
+    { session->set_transaction_memos(*json_cast(details)); })
+
 int GA_set_notification_handler(struct GA_session* session, GA_notification_handler handler, void* context)
 {
     try {
@@ -410,10 +419,17 @@ GDK_DEFINE_C_FUNCTION_3(GA_update_subaccount, struct GA_session*, session, GA_js
 GDK_DEFINE_C_FUNCTION_3(GA_get_transactions, struct GA_session*, session, GA_json*, details, struct GA_auth_handler**,
     call, { *call = make_call(new green::get_transactions_call(*session, json_move(details))); })
 
+GDK_DEFINE_C_FUNCTION_3(GA_search_transactions, struct GA_session*, session, GA_json*, details, GA_json**, output,
+    { *json_cast(output) = new nlohmann::json(session->search_transactions(*json_cast(details))); })
+
 GDK_DEFINE_C_FUNCTION_3(GA_get_receive_address, struct GA_session*, session, GA_json*, details,
     struct GA_auth_handler**, call,
     { *call = make_call(new green::get_receive_address_call(*session, json_move(details))); })
 
+GDK_DEFINE_C_FUNCTION_3(GA_get_receive_addresses, struct GA_session*, session, GA_json*, details,
+    struct GA_auth_handler**, call,
+    { *call = make_call(new green::get_receive_addresses_call(*session, json_move(details))); })
+
 GDK_DEFINE_C_FUNCTION_3(GA_get_previous_addresses, struct GA_session*, session, GA_json*, details,
     struct GA_auth_handler**, call,
     { *call = make_call(new green::get_previous_addresses_call(*session, json_move(details))); })
@@ -442,6 +458,9 @@ GDK_DEFINE_C_FUNCTION_2(GA_get_available_currencies, struct GA_session*, session
 GDK_DEFINE_C_FUNCTION_3(GA_convert_amount, struct GA_session*, session, const GA_json*, value_details, GA_json**,
     output, { *json_cast(output) = new nlohmann::json(session->convert_amount(*json_cast(value_details))); })
 
+GDK_DEFINE_C_FUNCTION_3(GA_convert_amounts, struct GA_session*, session, const GA_json*, details, GA_json**, output,
+    { *json_cast(output) = new nlohmann::json(session->convert_amounts(*json_cast(details))); })
+
 GDK_DEFINE_C_FUNCTION_3(GA_encrypt_with_pin, struct GA_session*, session, GA_json*, details, struct GA_auth_handler**,
     call, { *call = make_call(new green::encrypt_with_pin_call(*session, json_move(details))); })
 
@@ -459,6 +478,18 @@ GDK_DEFINE_C_FUNCTION_2(GA_convert_string_to_json, const char*, input, GA_json**
 GDK_DEFINE_C_FUNCTION_2(GA_convert_json_to_string, const GA_json*, json, char**, output,
     { *output = to_c_string(json_cast(json)->dump()); })
 
+GDK_DEFINE_C_FUNCTION_4(GA_convert_json_to_msgpack, const GA_json*, json, unsigned char*, output_bytes, size_t, len,
+    size_t*, written, {
+        const auto msgpack = nlohmann::json::to_msgpack(*json_cast(json));
+        *written = msgpack.size();
+        if (msgpack.size() <= len) {
+            std::copy(msgpack.begin(), msgpack.end(), output_bytes);
+        }
+    })
+
+GDK_DEFINE_C_FUNCTION_3(GA_convert_msgpack_to_json, const unsigned char*, input_bytes, size_t, len, GA_json**, output,
+    { *json_cast(output) = new nlohmann::json(nlohmann::json::from_msgpack(input_bytes, input_bytes + len)); })
+
 GDK_DEFINE_C_FUNCTION_2(GA_register_network, const char*, name, const GA_json*, network_details,
     { green::network_parameters::add(name, *json_cast(network_details)); })
 
@@ -476,6 +507,21 @@ GDK_DEFINE_C_FUNCTION_2(GA_auth_handler_resolve_code, struct GA_auth_handler*, c
 
 GDK_DEFINE_C_FUNCTION_1(GA_auth_handler_call, struct GA_auth_handler*, call, { auth_cast(call)->operator()(); })
 
+int GA_auth_handler_call_async(struct GA_auth_handler* call, GA_auth_handler_completion completion, void* context)
+{
+    try {
+        GDK_RUNTIME_ASSERT_MSG(call && completion, "null argument calling GA_auth_handler_call_async");
+        green::call_async(*auth_cast(call), [completion, context](nlohmann::json status) {
+            completion(context, reinterpret_cast<GA_json*>(new nlohmann::json(std::move(status))));
+        });
+    } catch (const std::exception& e) {
+        set_thread_error(e.what());
+        return GA_ERROR;
+    }
+    g_thread_error.reset();
+    return GA_OK;
+}
+
 GDK_DEFINE_C_FUNCTION_2(GA_auth_handler_get_status, struct GA_auth_handler*, call, GA_json**, output,
     { *json_cast(output) = new nlohmann::json(auth_cast(call)->get_status()); })
 
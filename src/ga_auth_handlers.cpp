@@ -18,6 +18,7 @@
 #include "signer.hpp"
 #include "transaction_utils.hpp"
 #include "utils.hpp"
+#include "utxo_record.hpp"
 #include "xpub_hdkey.hpp"
 
 namespace green {
@@ -28,10 +29,15 @@ namespace green {
         // Note that this is deliberately less than the server default (25) so
         // that the code path to upload on login is always executed/doesn't bitrot.
         static const uint32_t INITIAL_UPLOAD_CA = 20;
-
-        // UTXO user_status values from the Green server
-        static constexpr uint32_t USER_STATUS_DEFAULT = 0;
-        static constexpr uint32_t USER_STATUS_FROZEN = 1;
+        // Maximum pages of txs to fetch per subaccount before requesting
+        // any blinding nonces they need from the signer in one request
+        static constexpr size_t SYNC_READ_AHEAD_PAGES = 8;
+        // Singlesig subaccounts of the same type are numbered this far apart
+        static constexpr uint32_t SS_SUBACCOUNT_TYPE_STRIDE = 16;
+        // Number of singlesig subaccounts of each type probed at once by discovery
+        static constexpr uint32_t SS_DISCOVERY_WINDOW = 4;
+        // Maximum number of addresses returned by GA_get_receive_addresses
+        static constexpr uint32_t MAX_RECEIVE_ADDRESSES = 1000;
 
         // Add anti-exfil protocol host-entropy and host-commitment to the passed json
         static void add_ae_host_data(nlohmann::json& data)
@@ -242,9 +248,7 @@ namespace green {
                 GDK_RUNTIME_ASSERT_MSG(have_master_key, "Master blinding key must be exported for PSBT operations");
             }
             // FIXME: Updating the scriptpubkey cache can be very expensive
-            for (auto subaccount : session.get_subaccount_pointers()) {
-                session.encache_new_scriptpubkeys(subaccount);
-            }
+            session.encache_new_scriptpubkeys(session.get_subaccount_pointers());
         }
     } // namespace
 
@@ -371,6 +375,9 @@ namespace green {
                 goto do_authenticate;
             }
 
+            // Let the caller show its last known state while we authenticate
+            m_session->emit_session_snapshot(m_signer);
+
             // Compute the login challenge with the master pubkey
             const auto public_key = xpub_hdkey(m_master_bip32_xpub).get_public_key();
             m_challenge = m_session->get_challenge(public_key);
@@ -735,11 +742,15 @@ namespace green {
             // BTC: Provide the previous txs data for validation, even
             // for segwit, in order to mitigate the segwit fee attack.
             // (Liquid txs are explicit fee and so not affected)
+            std::vector<std::string> txhashes;
+            txhashes.reserve(inputs.size());
             for (const auto& input : inputs) {
-                std::string txhash = input.at("txhash");
-                if (!prev_txs.contains(txhash)) {
-                    auto tx_hex = m_session->get_raw_transaction_details(txhash).to_hex();
-                    prev_txs.emplace(std::move(txhash), std::move(tx_hex));
+                txhashes.push_back(j_strref(input, "txhash"));
+            }
+            const auto txs = m_session->get_raw_transactions(txhashes);
+            for (size_t i = 0; i < txhashes.size(); ++i) {
+                if (!prev_txs.contains(txhashes[i])) {
+                    prev_txs.emplace(std::move(txhashes[i]), txs[i]->to_hex());
                 }
             }
         }
@@ -1025,6 +1036,55 @@ namespace green {
         return state_type::done;
     }
 
+    //
+    // Get receive addresses
+    //
+    get_receive_addresses_call::get_receive_addresses_call(session& session, nlohmann::json details)
+        : auth_handler_impl(session, "get_receive_addresses")
+        , m_details(std::move(details))
+        , m_initialized(false)
+    {
+    }
+
+    void get_receive_addresses_call::initialize()
+    {
+        const auto count = j_uint32(m_details, "count").value_or(1);
+        GDK_USER_ASSERT(count && count <= MAX_RECEIVE_ADDRESSES, "Invalid count");
+        m_details["count"] = count;
+        m_result["list"] = m_session->get_receive_addresses(m_details);
+
+        if (m_net_params.is_liquid() && !m_net_params.is_electrum()) {
+            // Ask the caller to provide the blinding keys for all addresses at once
+            auto& request = signal_hw_request(hw_request::get_blinding_public_keys);
+            auto& scripts = request["scripts"];
+            for (const auto& it : m_result["list"]) {
+                scripts.push_back(it.at("scriptpubkey"));
+            }
+        } else {
+            // We are done
+            m_state = state_type::done;
+        }
+    }
+
+    auth_handler::state_type get_receive_addresses_call::call_impl()
+    {
+        if (!m_initialized) {
+            initialize();
+            m_initialized = true;
+            return m_state;
+        }
+
+        // Liquid: Make our addresses confidential with the signer provided blinding keys
+        auto& addresses = m_result.at("list");
+        const auto& public_keys = j_arrayref(get_hw_reply(), "public_keys", addresses.size());
+        size_t i = 0;
+        for (auto& it : addresses) {
+            confidentialize_address(m_net_params, it, public_keys.at(i));
+            ++i;
+        }
+        return state_type::done;
+    }
+
     //
     // Get previous addresses
     //
@@ -1214,49 +1274,65 @@ namespace green {
             throw user_error("Authentication required");
         }
         const bool is_watch_only = m_session->is_watch_only();
+        auto&& is_found = [this](const std::string& sa_type) {
+            return std::find(m_found.begin(), m_found.end(), sa_type) != m_found.end();
+        };
 
-        nlohmann::json::array_t paths;
-
-        for (const auto& sa_type : ss_sa_types) {
-            if (std::find(m_found.begin(), m_found.end(), sa_type) != m_found.end()) {
-                // Already discovered all subaccounts for this type
-                continue;
-            }
-            for (;;) {
-                // Find the last empty subaccount of this type
-                auto subaccount = m_session->get_last_empty_subaccount(sa_type);
-                auto path = m_session->get_user_pubkeys().get_path_to_subaccount(subaccount);
-                if (!signer->has_bip32_xpub(path)) {
-                    if (is_watch_only) {
+        for (;;) {
+            // Probe a window of subaccounts of every type at once, starting
+            // from the last empty subaccount of each
+            nlohmann::json::array_t paths;
+            nlohmann::json::array_t probes;
+            for (const auto& sa_type : ss_sa_types) {
+                if (is_found(sa_type)) {
+                    continue; // Already discovered all subaccounts for this type
+                }
+                const auto first_subaccount = m_session->get_last_empty_subaccount(sa_type);
+                for (uint32_t i = 0; i < SS_DISCOVERY_WINDOW; ++i) {
+                    const uint32_t subaccount = first_subaccount + i * SS_SUBACCOUNT_TYPE_STRIDE;
+                    auto path = m_session->get_user_pubkeys().get_path_to_subaccount(subaccount);
+                    if (signer->has_bip32_xpub(path)) {
+                        probes.push_back({ { "subaccount", subaccount }, { "xpub", signer->get_bip32_xpub(path) },
+                            { "type", sa_type } });
+                    } else if (!is_watch_only) {
+                        // Request the xpub for the subaccount so we can discover it
+                        paths.emplace_back(std::move(path));
+                    } else {
                         // Watch only sessions can only discover subaccounts where
                         // the client blob (and thus signer) has the xpub (i.e. the
                         // subaccount was created or discovered by a full session).
-                        m_found.push_back(sa_type);
-                    } else {
-                        // Request the xpub for the subaccount so we can discover it
-                        paths.emplace_back(std::move(path));
+                        if (!i) {
+                            m_found.push_back(sa_type);
+                        }
+                        break;
                     }
-                    break;
                 }
-                // Discover whether the subaccount exists
-                const auto xpub = signer->get_bip32_xpub(path);
-                if (!m_session->discover_subaccount(subaccount, xpub, sa_type)) {
+            }
+
+            if (!paths.empty()) {
+                // Request the xpubs for all subaccounts to discover at once
+                signal_hw_request(hw_request::get_xpubs)["paths"] = std::move(paths);
+                return m_state;
+            }
+            if (probes.empty()) {
+                break;
+            }
+            // Types with every subaccount in their window discovered are probed
+            // again from their new last empty subaccount
+            const auto discovered = m_session->discover_subaccounts(probes);
+            for (size_t i = 0; i < probes.size(); ++i) {
+                const auto& sa_type = j_strref(probes[i], "type");
+                if (!discovered.at(i) && !is_found(sa_type)) {
                     // Reached the last discoverable subaccount of this type
                     m_found.push_back(sa_type);
-                    break;
                 }
             }
         }
 
-        if (paths.empty()) {
-            // We have discovered all subaccounts. When the caller calls
-            // us again, the results will be returned
-            GDK_RUNTIME_ASSERT(m_found.size() == ss_sa_types.size());
-            m_state = state_type::make_call;
-        } else {
-            // Request paths for further subaccounts to discover
-            signal_hw_request(hw_request::get_xpubs)["paths"] = std::move(paths);
-        }
+        // We have discovered all subaccounts. When the caller calls
+        // us again, the results will be returned
+        GDK_RUNTIME_ASSERT(m_found.size() == ss_sa_types.size());
+        m_state = state_type::make_call;
         return m_state;
     }
 
@@ -1282,6 +1358,9 @@ namespace green {
         : auth_handler_impl(session, "get_transactions")
         , m_details(std::move(details))
     {
+        if (j_bool_or_false(m_details, "sync_all_subaccounts") && !m_net_params.is_electrum()) {
+            m_sync_subaccounts = m_session->get_subaccount_pointers();
+        }
     }
 
     auth_handler::state_type get_transactions_call::call_impl()
@@ -1299,13 +1378,26 @@ namespace green {
             // Parse and cache the nonces we got back
             encache_blinding_data(*m_session, m_twofactor_data, get_hw_reply());
             // Unblind, cleanup and store the fetched txs
-            m_session->store_transactions(subaccount, m_result);
+            const bool is_sync_all = !m_sync_subaccounts.empty();
+            auto stored = store_sync_pages();
+            if (!is_sync_all) {
+                m_result = std::move(stored[std::to_string(subaccount)]);
+            }
             // Make sure we don't re-encache the same nonces again next time through
             m_hw_request = hw_request::none;
-            m_result.clear();
             // Continue on to check for the next page to sync
         }
 
+        if (!m_sync_subaccounts.empty()) {
+            // Sync a page of txs for every subaccount not yet fully synced
+            if (!sync_pages(m_sync_subaccounts)) {
+                return m_state; // Request the missing nonces for all pages at once
+            }
+            store_sync_pages();
+            // Call again to either continue fetching, or sync the requested subaccount
+            return state_type::make_call;
+        }
+
         if (!m_result.empty() && !m_result.value("more", false)) {
             // We have finished iterating and caching the server results,
             // return the txs the user asked for
@@ -1313,73 +1405,96 @@ namespace green {
             auto txs = m_session->get_transactions(m_details);
             if (!txs.is_boolean()) {
                 m_session->postprocess_transactions(txs);
-                m_result = { { "transactions", std::move(txs) } };
+                std::string next_cursor;
+                if (!txs.empty() && txs.size() == j_uint32ref(m_details, "count")) {
+                    // There may be more txs: the next page starts before the last returned
+                    next_cursor = std::to_string(txs.back().at("created_at_ts").get<uint64_t>());
+                }
+                m_result = { { "transactions", std::move(txs) }, { "next_cursor", std::move(next_cursor) } };
                 return state_type::done;
             }
             // Otherwise the cache was invalidated, continue on to resync
         }
 
         // Sync a page of txs from the server
-        unique_pubkeys_and_scripts_t missing;
-        m_result = m_session->sync_transactions(subaccount, missing);
-        if (!missing.empty()) {
-            // We have missing nonces we need to fetch, request them
-            auto& request = signal_hw_request(hw_request::get_blinding_nonces);
-            set_blinding_nonce_request_data(get_signer(), missing, request);
-            return m_state;
+        if (!sync_pages({ subaccount })) {
+            return m_state; // We have missing nonces we need to fetch, request them
         }
         // No missing nonces, cleanup and store the fetched txs directly
-        m_session->store_transactions(subaccount, m_result);
+        m_result = std::move(store_sync_pages()[std::to_string(subaccount)]);
         // Call again to either continue fetching, or return the result
         return state_type::make_call;
     }
 
-    struct utxo_sorter {
-        enum class sort_by_t : size_t { OLDEST = 0, NEWEST, LARGEST, SMALLEST };
-
-        utxo_sorter(const std::string& sort_by)
-        {
-            if (sort_by == "oldest") {
-                m_sort_by = sort_by_t::OLDEST;
-            } else if (sort_by == "newest") {
-                m_sort_by = sort_by_t::NEWEST;
-            } else if (sort_by == "largest") {
-                m_sort_by = sort_by_t::LARGEST;
-            } else if (sort_by == "smallest") {
-                m_sort_by = sort_by_t::SMALLEST;
-            } else {
-                throw user_error("invalid \"sort_by\" value");
+    bool get_transactions_call::sync_pages(const std::vector<uint32_t>& subaccounts)
+    {
+        // Fetch a page of txs for each subaccount. If any need blinding nonces
+        // from the signer, read ahead so that the nonces for the following
+        // pages are fetched in the same request. Returns false if a request
+        // for nonces was made, in which case the pages are stored on reply
+        GDK_RUNTIME_ASSERT(m_sync_pages.empty());
+        unique_pubkeys_and_scripts_t missing;
+        std::map<uint32_t, uint64_t> sync_from;
+        std::vector<uint32_t> to_sync = subaccounts;
+        while (!to_sync.empty() && m_sync_pages.size() < SYNC_READ_AHEAD_PAGES) {
+            auto pages = m_session->sync_transactions(to_sync, missing, sync_from);
+            std::vector<uint32_t> more;
+            for (const auto sa : to_sync) {
+                const auto& page = pages.at(std::to_string(sa));
+                if (!j_bool_or_false(page, "more")) {
+                    continue;
+                }
+                // The next page starts after the latest tx in this one
+                const uint64_t sync_ts = page.at("sync_ts");
+                uint64_t latest = sync_ts;
+                for (const auto& tx : page.at("list")) {
+                    latest = std::max(latest, tx.at("created_at_ts").get<uint64_t>());
+                }
+                if (latest != sync_ts) {
+                    sync_from[sa] = latest;
+                    more.push_back(sa);
+                }
+            }
+            m_sync_pages.emplace_back(std::move(pages));
+            if (missing.empty()) {
+                break; // Nothing to batch, store the pages now
             }
+            to_sync.swap(more);
         }
-
-        static bool compare_blockheight(const nlohmann::json& lhs, const nlohmann::json& rhs)
-        {
-            const uint32_t max_bh = 0xffffffff;
-            const auto lhs_bh = j_uint32ref(lhs, "block_height");
-            const auto rhs_bh = j_uint32ref(rhs, "block_height");
-            return (lhs_bh ? lhs_bh : max_bh) < (rhs_bh ? rhs_bh : max_bh);
+        if (missing.empty()) {
+            return true;
         }
+        GDK_LOG(debug) << "Tx sync: requesting " << missing.size() << " nonces for " << m_sync_pages.size()
+                       << " pages";
+        auto& request = signal_hw_request(hw_request::get_blinding_nonces);
+        set_blinding_nonce_request_data(get_signer(), missing, request);
+        return false;
+    }
 
-        bool operator()(const nlohmann::json& lhs, const nlohmann::json& rhs) const
-        {
-            switch (m_sort_by) {
-            case sort_by_t::OLDEST:
-                return compare_blockheight(lhs, rhs);
-                break;
-            case sort_by_t::NEWEST:
-                return compare_blockheight(rhs, lhs);
-                break;
-            case sort_by_t::LARGEST:
-                return j_amountref(rhs) < j_amountref(lhs);
-                break;
-            case sort_by_t::SMALLEST:
-                return j_amountref(lhs) < j_amountref(rhs);
-                break;
+    nlohmann::json get_transactions_call::store_sync_pages()
+    {
+        // Store the pages in the order they were fetched. If an earlier page
+        // is disrupted, the later pages fail the same check and are refetched.
+        // Returns the last page stored for each subaccount
+        nlohmann::json stored = nlohmann::json::object();
+        for (auto& pages : m_sync_pages) {
+            for (auto& page : pages.items()) {
+                const uint32_t subaccount = std::stoul(page.key());
+                m_session->store_transactions(subaccount, page.value());
+                stored[page.key()] = std::move(page.value());
             }
-            return false; // Unreachable
-        };
-        sort_by_t m_sort_by;
-    };
+        }
+        for (const auto& page : stored.items()) {
+            if (!j_bool_or_false(page.value(), "more")) {
+                // Fully synced: stop fetching for this subaccount
+                const uint32_t subaccount = std::stoul(page.key());
+                auto& sas = m_sync_subaccounts;
+                sas.erase(std::remove(sas.begin(), sas.end(), subaccount), sas.end());
+            }
+        }
+        m_sync_pages.clear();
+        return stored;
+    }
 
     //
     // Get unspent outputs
@@ -1399,11 +1514,10 @@ namespace green {
             set_error("num_confs must be set to 0 or 1");
             return;
         }
-        auto p = m_session->get_cached_utxos(j_uint32ref(m_details, "subaccount"), num_confs);
-        if (p) {
+        auto cached = m_session->get_cached_utxos(j_uint32ref(m_details, "subaccount"), num_confs);
+        if (cached.utxos) {
             // Return the cached result, after filtering it
-            m_result = *p;
-            filter_result(false);
+            filter_utxos(cached.utxos.get(), cached.index.get());
             m_state = state_type::done;
             return;
         }
@@ -1449,57 +1563,50 @@ namespace green {
         return state_type::done;
     }
 
-    template <typename T> static void filter_utxos(nlohmann::json& outputs, T&& filter)
-    {
-        for (auto& asset : outputs.items()) {
-            if (asset.key() != "error") {
-                auto& utxos = asset.value();
-                utxos.erase(std::remove_if(utxos.begin(), utxos.end(), filter), utxos.end());
-            }
-        }
-    }
-
     void get_unspent_outputs_call::filter_result(bool encache)
     {
         if (encache && !m_net_params.is_electrum()) {
-            // Encache the unfiltered results, and set our result to a copy
-            // for filtering.
-            auto p = m_session->set_cached_utxos(
+            // Encache the unfiltered results, then filter them into our result
+            auto cached = m_session->set_cached_utxos(
                 j_uint32ref(m_details, "subaccount"), j_uint32ref(m_details, "num_confs"), m_result);
-            m_result = *p;
+            filter_utxos(cached.utxos.get(), cached.index.get());
+            return;
         }
+        filter_utxos(nullptr, nullptr);
+    }
 
-        auto& outputs = m_result.at("unspent_outputs");
-        if (outputs.is_null() || outputs.empty()) {
+    void get_unspent_outputs_call::filter_utxos(const nlohmann::json* cached, const utxo_index* index)
+    {
+        // When filtering cached UTXOs, only the UTXOs that pass the filter
+        // are copied into our result, selected in order from the cache's
+        // pre-sorted index. Otherwise our result is filtered in place
+        if (cached) {
+            m_result = nlohmann::json::object();
+            for (const auto& item : cached->items()) {
+                if (item.key() != "unspent_outputs") {
+                    m_result[item.key()] = item.value();
+                }
+            }
+        }
+        const auto& src_outputs = cached ? cached->at("unspent_outputs") : m_result.at("unspent_outputs");
+        auto& outputs = m_result["unspent_outputs"];
+        if (src_outputs.is_null() || src_outputs.empty()) {
             // Nothing to filter, return an empty json object
             outputs = nlohmann::json::object();
             return;
         }
 
+        // The user only wants a particular address type, if given
         const auto address_type = j_str_or_empty(m_details, "address_type");
-        if (!address_type.empty()) {
-            // The user only wants a particular address type, filter out others
-            filter_utxos(
-                outputs, [&address_type](const auto& u) { return j_strref(u, "address_type") != address_type; });
-        }
-
-        const bool is_liquid = m_net_params.is_liquid();
-        if (is_liquid && j_bool_or_false(m_details, "confidential")) {
-            // The user only wants confidential UTXOs, filter out non-confidential
-            filter_utxos(outputs, [](const auto& u) { return !j_bool_or_false(u, "is_blinded"); });
-        }
-
-        if (!j_bool_or_false(m_details, "all_coins")) {
-            // User did not request frozen UTXOs, filter them out
-            filter_utxos(outputs, [](const auto& u) {
-                return j_uint32(u, "user_status").value_or(USER_STATUS_DEFAULT) == USER_STATUS_FROZEN;
-            });
-        }
+        // The user only wants confidential UTXOs
+        const bool confidential_only = m_net_params.is_liquid() && j_bool_or_false(m_details, "confidential");
+        // The user did not request frozen UTXOs
+        const bool unfrozen_only = !j_bool_or_false(m_details, "all_coins");
 
         const auto expired_at = j_uint32(m_details, "expired_at");
         const auto expires_in = j_uint32(m_details, "expires_in");
+        std::optional<uint64_t> expiry_height;
         if (expired_at || expires_in) {
-            uint64_t expiry_height;
             if (expired_at && expires_in) {
                 throw user_error("Only one of \"expired_at\" or \"expires_in\" may be given");
             }
@@ -1510,24 +1617,78 @@ namespace green {
                 // Add the number of relative blocks to the current block height
                 expiry_height = m_session->get_block_height() + *expires_in;
             }
+        }
+
+        // The user passed a dust limit, filter UTXOs that are below it
+        const auto dust_limit = j_amount_or_zero(m_details, "dust_limit").value();
+
+        auto&& filter = [&](const utxo_record& u) {
+            if (!address_type.empty() && u.address_type != address_type) {
+                return true;
+            }
+            if (confidential_only && !u.is_blinded) {
+                return true;
+            }
+            if (unfrozen_only && u.user_status == USER_STATUS_FROZEN) {
+                return true;
+            }
             // Return only UTXOs that have expired as at block number 'expiry_height'.
             // A UTXO is expired if its nlocktime has been reached; i.e. its
             // nlocktime is less than or equal to the block number in
             // 'expiry_height'. Therefore we filter out UTXOs where nlocktime
             // is greater than 'expiry_height', or not present (i.e. non-expiring UTXOs)
-            filter_utxos(outputs,
-                [expiry_height](const auto& u) { return j_uint32_or_zero(u, "expiry_height") > expiry_height; });
-        }
+            if (expiry_height && u.expiry_height > *expiry_height) {
+                return true;
+            }
+            return dust_limit && u.satoshi <= dust_limit;
+        };
+
+        // Filter and sort using compact records, then move the resulting
+        // UTXOs into place, rather than accessing each UTXO's JSON repeatedly.
+        std::optional<utxo_sorter> sorter;
+        auto&& filter_records = [&](const nlohmann::json& utxos) {
+            auto records = make_utxo_records(utxos);
+            records.erase(std::remove_if(records.begin(), records.end(), filter), records.end());
+            if (!records.empty()) {
+                if (!sorter) {
+                    sorter.emplace(get_sort_by());
+                }
+                std::sort(records.begin(), records.end(), *sorter);
+            }
+            return records;
+        };
 
-        const auto dust_limit = j_amount_or_zero(m_details, "dust_limit");
-        if (dust_limit.value()) {
-            // The user passed a dust limit, filter UTXOs that are below it
-            filter_utxos(outputs, [dust_limit](const auto& u) { return j_amountref(u) <= dust_limit; });
+        if (cached) {
+            GDK_RUNTIME_ASSERT(index);
+            outputs = nlohmann::json::object();
+            for (const auto& asset : src_outputs.items()) {
+                const auto& utxos = asset.value();
+                if (asset.key() == "error") {
+                    if (!utxos.empty()) {
+                        outputs[asset.key()] = utxos;
+                    }
+                    continue;
+                }
+                if (utxos.empty()) {
+                    continue;
+                }
+                if (!sorter) {
+                    sorter.emplace(get_sort_by());
+                }
+                if (auto records = index->select(asset.key(), *sorter, dust_limit, filter); !records.empty()) {
+                    outputs[asset.key()] = copy_utxo_records(utxos, records);
+                }
+            }
+            return;
         }
 
-        // Remove any keys that have become empty
         for (auto asset = outputs.begin(); asset != outputs.end(); /* no-op */) {
-            if (asset.value().empty()) {
+            auto& utxos = asset.value();
+            if (asset.key() != "error") {
+                apply_utxo_records(utxos, filter_records(utxos));
+            }
+            if (utxos.empty()) {
+                // Remove any keys that have become empty.
                 // Use post increment to increment the iterator before it
                 // is invalidated, passing the current value to erase()
                 outputs.erase(asset++);
@@ -1535,17 +1696,6 @@ namespace green {
                 ++asset;
             }
         }
-
-        // Sort the results
-        if (!outputs.empty()) {
-            const utxo_sorter sorter(get_sort_by());
-            for (auto& asset : outputs.items()) {
-                if (asset.key() != "error") {
-                    auto& utxos = asset.value();
-                    std::sort(utxos.begin(), utxos.end(), sorter);
-                }
-            }
-        }
     }
 
     std::string get_unspent_outputs_call::get_sort_by() const
@@ -1594,6 +1744,10 @@ namespace green {
 
     auth_handler::state_type get_balance_call::call_impl()
     {
+        if (!m_initialized && get_cached_balance()) {
+            m_initialized = true;
+            return state_type::done;
+        }
         auto state = get_unspent_outputs_call::call_impl(); // Get UTXOs using parent call
         if (state == state_type::done) {
             compute_balance();
@@ -1601,6 +1755,29 @@ namespace green {
         return state;
     }
 
+    bool get_balance_call::get_cached_balance()
+    {
+        // Cached balances are only for the default filtering of UTXOs
+        for (const auto& key : { "address_type", "expired_at", "expires_in", "dust_limit" }) {
+            if (m_details.contains(key)) {
+                return false;
+            }
+        }
+        if (m_net_params.is_liquid() && j_bool_or_false(m_details, "confidential")) {
+            return false;
+        }
+        const auto num_confs = j_uint32(m_details, "num_confs").value_or(0xff);
+        const bool all_coins = j_bool_or_false(m_details, "all_coins");
+        auto p = m_session->get_cached_balance(j_uint32ref(m_details, "subaccount"), num_confs, all_coins);
+        if (!p) {
+            return false;
+        }
+        nlohmann::json balance({ { m_net_params.get_policy_asset(), 0 } });
+        balance.update(p->begin(), p->end());
+        m_result.swap(balance);
+        return true;
+    }
+
     void get_balance_call::compute_balance()
     {
         // Compute the balance data from returned UTXOs
@@ -7,6 +7,7 @@
 namespace green {
 
     class Psbt;
+    struct utxo_index;
 
     class register_call : public auth_handler_impl {
     public:
@@ -144,6 +145,18 @@ namespace green {
         bool m_initialized;
     };
 
+    class get_receive_addresses_call : public auth_handler_impl {
+    public:
+        get_receive_addresses_call(session& session, nlohmann::json details);
+
+    private:
+        state_type call_impl() override;
+        void initialize();
+
+        nlohmann::json m_details;
+        bool m_initialized;
+    };
+
     class get_previous_addresses_call : public auth_handler_impl {
     public:
         get_previous_addresses_call(session& session, nlohmann::json details);
@@ -202,8 +215,12 @@ namespace green {
 
     private:
         state_type call_impl() override;
+        bool sync_pages(const std::vector<uint32_t>& subaccounts);
+        nlohmann::json store_sync_pages();
 
         nlohmann::json m_details;
+        std::vector<uint32_t> m_sync_subaccounts; // Subaccounts remaining to sync for "sync_all_subaccounts"
+        std::vector<nlohmann::json> m_sync_pages; // Fetched pages in sync order, each keyed by subaccount
     };
 
     class get_unspent_outputs_call : public auth_handler_impl {
@@ -213,13 +230,14 @@ namespace green {
     protected:
         state_type call_impl() override;
 
+        nlohmann::json m_details;
+        bool m_initialized;
+
     private:
         void initialize();
         void filter_result(bool encache);
+        void filter_utxos(const nlohmann::json* cached, const utxo_index* index);
         std::string get_sort_by() const;
-
-        nlohmann::json m_details;
-        bool m_initialized;
     };
 
     class get_unspent_outputs_for_private_key_call : public auth_handler_impl {
@@ -239,6 +257,7 @@ namespace green {
 
     private:
         state_type call_impl() override;
+        bool get_cached_balance();
         void compute_balance();
     };
 
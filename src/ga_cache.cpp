@@ -1,6 +1,14 @@
 #include <algorithm>
 #include <array>
+#include <cstdio>
+#include <exception>
 #include <fstream>
+#include <limits>
+#include <msgpack.hpp>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <thread>
 #include <vector>
 
 #include "assertion.hpp"
@@ -12,6 +20,8 @@
 #include "session.hpp"
 #include "signer.hpp"
 #include "sqlite3.h"
+#include "stats.hpp"
+#include "threading.hpp"
 #include "transaction_utils.hpp"
 #include "utils.hpp"
 
@@ -24,11 +34,21 @@ namespace green {
         constexpr uint32_t CT_HW = 1; // Hardware wallet cache
         constexpr uint32_t CT_WO = 2; // Watch-only wallet cache
 
+        // Default window in which saves are coalesced into one background write
+        constexpr uint32_t DEFAULT_FLUSH_MS = 1000;
+
         constexpr int VERSION = 1;
-        constexpr int MINOR_VERSION = 0x3;
+        constexpr int MINOR_VERSION = 0x5;
+        // Txids bound per Liquid output lookup, within sqlite's variable limit
+        constexpr size_t MAX_TXIDS_PER_QUERY = 500;
         constexpr const char* KV_SELECT = "SELECT value FROM KeyValue WHERE key = ?1;";
         constexpr const char* TX_SELECT = "SELECT timestamp, txid, block, spent, spv_status, data FROM Tx "
                                           "WHERE subaccount = ?1 ORDER BY timestamp DESC LIMIT ?2 OFFSET ?3;";
+        // Keyset pagination: seeks the (subaccount, timestamp) primary key
+        // rather than stepping over the first OFFSET rows
+        constexpr const char* TX_SELECT_BEFORE = "SELECT timestamp, txid, block, spent, spv_status, data FROM Tx "
+                                                 "WHERE subaccount = ?1 AND timestamp < ?4 "
+                                                 "ORDER BY timestamp DESC LIMIT ?2 OFFSET ?3;";
         constexpr const char* TXID_SELECT = "SELECT timestamp, txid, block, spent, spv_status, data FROM Tx "
                                             "WHERE subaccount = ?1 AND txid = ?2;";
         constexpr const char* TX_LATEST = "SELECT MAX(timestamp) FROM Tx WHERE subaccount = ?1;";
@@ -38,12 +58,33 @@ namespace green {
             = "SELECT MIN(timestamp) FROM Tx WHERE subaccount = ?1 AND block >= ?2;";
         constexpr const char* TX_UPSERT = "INSERT INTO Tx(subaccount, timestamp, txid, block, spent, spv_status, data) "
                                           "VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7) "
-                                          "ON CONFLICT(subaccount, timestamp) DO UPDATE SET data = ?4;";
+                                          "ON CONFLICT(subaccount, timestamp) DO UPDATE SET data = ?7;";
         constexpr const char* TX_SPV_UPDATE = "UPDATE Tx SET spv_status = ?1 WHERE txid = ?2;";
         constexpr const char* TX_DELETE_ALL = "DELETE FROM Tx WHERE subaccount = ?1 AND timestamp >= ?2;";
+        // Secondary indexes of cached txs, maintained by insert_transaction
+        // and removed with their txs by the TxDeleteIndexes trigger
+        constexpr const char* TX_ADDRESS_INSERT
+            = "INSERT OR IGNORE INTO TxAddress(address, subaccount, timestamp) VALUES (?1, ?2, ?3);";
+        constexpr const char* TX_ADDRESS_DELETE = "DELETE FROM TxAddress WHERE subaccount = ?1 AND timestamp = ?2;";
+        constexpr const char* TX_ASSET_INSERT
+            = "INSERT OR IGNORE INTO TxAsset(subaccount, asset, satoshi, timestamp) VALUES (?1, ?2, ?3, ?4);";
+        constexpr const char* TX_ASSET_DELETE = "DELETE FROM TxAsset WHERE subaccount = ?1 AND timestamp = ?2;";
         constexpr const char* TXDATA_INSERT = "INSERT INTO TxData(txid, rawtx) VALUES (?1, ?2) "
                                               "ON CONFLICT(txid) DO NOTHING;";
         constexpr const char* TXDATA_SELECT = "SELECT rawtx FROM TxData WHERE txid = ?1;";
+        // Eviction of data that is re-fetched or re-computed when missing.
+        // Rows are evicted in insertion order, oldest first
+        constexpr const char* TXDATA_EVICT
+            = "DELETE FROM TxData WHERE rowid IN (SELECT rowid FROM TxData ORDER BY rowid LIMIT ?1);";
+        constexpr const char* LIQUID_OUTPUT_EVICT
+            = "DELETE FROM LiquidOutput WHERE rowid IN (SELECT rowid FROM LiquidOutput ORDER BY rowid LIMIT ?1);";
+        constexpr uint64_t EVICT_ROWS_PER_STEP = 64;
+        // Evict down to this percentage of the budget, so that small
+        // additions don't cause eviction on every save
+        constexpr int64_t EVICT_TARGET_PERCENT = 75;
+        // Compact when more than 1/COMPACT_FREE_DIVISOR of the pages are free
+        constexpr int64_t COMPACT_FREE_DIVISOR = 4;
+        constexpr int64_t COMPACT_MIN_PAGES = 256;
 
         static auto get_new_memory_db()
         {
@@ -84,6 +125,21 @@ namespace green {
             exec_check(
                 "CREATE TABLE IF NOT EXISTS TxData(txid BLOB NOT NULL, rawtx BLOB NOT NULL, PRIMARY KEY(txid));");
 
+            exec_check("CREATE TABLE IF NOT EXISTS TxAddress(address TEXT NOT NULL, subaccount INTEGER NOT NULL, "
+                       "timestamp INTEGER NOT NULL, PRIMARY KEY(address, subaccount, timestamp)) WITHOUT ROWID;");
+            exec_check("CREATE INDEX IF NOT EXISTS TxAddressByTx ON TxAddress(subaccount, timestamp);");
+
+            // satoshi is the absolute net amount of the asset the tx moved
+            exec_check("CREATE TABLE IF NOT EXISTS TxAsset(subaccount INTEGER NOT NULL, asset TEXT NOT NULL, "
+                       "satoshi INTEGER NOT NULL, timestamp INTEGER NOT NULL, "
+                       "PRIMARY KEY(subaccount, asset, satoshi, timestamp)) WITHOUT ROWID;");
+            exec_check("CREATE INDEX IF NOT EXISTS TxAssetByTx ON TxAsset(subaccount, timestamp);");
+
+            exec_check("CREATE TRIGGER IF NOT EXISTS TxDeleteIndexes AFTER DELETE ON Tx BEGIN "
+                       "DELETE FROM TxAddress WHERE subaccount = OLD.subaccount AND timestamp = OLD.timestamp; "
+                       "DELETE FROM TxAsset WHERE subaccount = OLD.subaccount AND timestamp = OLD.timestamp; "
+                       "END;");
+
             exec_check("CREATE TABLE IF NOT EXISTS ScriptPubKey("
                        "scriptpubkey BLOB NOT NULL,"
                        "subaccount INTEGER NOT NULL,"
@@ -140,51 +196,280 @@ namespace green {
             }
         }
 
+        // Reset stmt when leaving scope, recording the time it was in use
         static auto stmt_clean(cache::sqlite3_stmt_ptr& stmt)
         {
-            return gsl::finally([&stmt] { stmt_check_clean(stmt); });
+            return gsl::finally([&stmt, start = std::chrono::steady_clock::now()] {
+                stats::record("cache", sqlite3_sql(stmt.get()), std::chrono::steady_clock::now() - start);
+                stmt_check_clean(stmt);
+            });
         }
 
-        static void save_db_file(byte_span_t key, byte_span_t data, const std::string& path)
+        // A buffer allocated with sqlite3_malloc, which can be handed
+        // directly to sqlite3_deserialize without copying
+        class sqlite_buffer final {
+        public:
+            sqlite_buffer() = default;
+            sqlite_buffer(const sqlite_buffer&) = delete;
+            sqlite_buffer& operator=(const sqlite_buffer&) = delete;
+            ~sqlite_buffer() { sqlite3_free(release()); }
+
+            void resize(size_t new_size)
+            {
+                if (new_size > m_capacity) {
+                    auto p = sqlite3_realloc64(m_data, new_size);
+                    GDK_RUNTIME_ASSERT(p != nullptr);
+                    m_data = static_cast<unsigned char*>(p);
+                    m_capacity = new_size;
+                }
+                if (new_size > m_size) {
+                    std::fill(m_data + m_size, m_data + new_size, 0);
+                }
+                m_size = new_size;
+            }
+            unsigned char* data() { return m_data; }
+            size_t size() const { return m_size; }
+            size_t capacity() const { return m_capacity; }
+            bool empty() const { return m_size == 0; }
+            gsl::span<unsigned char> span() { return { m_data, m_size }; }
+            // Release ownership of the buffer, e.g. to sqlite
+            unsigned char* release()
+            {
+                m_size = m_capacity = 0;
+                return std::exchange(m_data, nullptr);
+            }
+
+        private:
+            unsigned char* m_data = nullptr;
+            size_t m_size = 0;
+            size_t m_capacity = 0;
+        };
+
+        // The persisted state of a loaded database image
+        struct db_image final {
+            size_t page_size = 0;
+            std::vector<std::array<unsigned char, SHA256_LEN>> page_hashes;
+            size_t journal_size = 0; // Length of the valid journal portion
+            bool is_journal_valid = true; // False if the journal had bad records
+        };
+
+        // The journal of changed pages may grow to this fraction of the
+        // database size before the base image is rewritten and it is reset
+        constexpr size_t JOURNAL_MAX_DIVISOR = 2;
+        // Journal records are prefixed with page size, page count and number of changed pages
+        constexpr size_t JOURNAL_RECORD_HEADER_LEN = 3 * sizeof(uint32_t);
+
+        static void write_le32(std::vector<unsigned char>& out, uint32_t value)
+        {
+            for (size_t i = 0; i < sizeof(value); ++i) {
+                out.push_back((value >> (i * 8)) & 0xff);
+            }
+        }
+
+        static uint32_t read_le32(const unsigned char* p)
+        {
+            return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+        }
+
+        static size_t get_db_page_size(byte_span_t image)
+        {
+            // The page size is stored big-endian at offset 16 of the database header
+            GDK_RUNTIME_ASSERT(image.size() >= 100);
+            const size_t page_size = (image[16] << 8) | image[17];
+            return page_size == 1 ? 65536 : page_size; // 1 means 65536
+        }
+
+        static std::vector<std::array<unsigned char, SHA256_LEN>> get_page_hashes(byte_span_t image, size_t page_size)
+        {
+            std::vector<std::array<unsigned char, SHA256_LEN>> hashes;
+            hashes.reserve(image.size() / page_size);
+            for (size_t offset = 0; offset + page_size <= image.size(); offset += page_size) {
+                hashes.emplace_back(sha256(image.subspan(offset, page_size)));
+            }
+            return hashes;
+        }
+
+        static std::string get_journal_file(const std::string& path) { return path + ".journal"; }
+
+        static bool write_file(const std::string& path, byte_span_t data, std::ios_base::openmode mode)
+        {
+            std::ofstream f(path, std::ofstream::out | std::ofstream::binary | mode);
+            if (!f.is_open()) {
+                return false;
+            }
+            f.write(reinterpret_cast<const char*>(data.data()), data.size());
+            f.flush();
+            return f.good();
+        }
+
+        static bool save_db_file(byte_span_t key, byte_span_t data, const std::string& path)
         {
             GDK_RUNTIME_ASSERT(!key.empty() && !data.empty());
-            const size_t encrypted_len = aes_gcm_encrypt_get_length(data);
-            std::vector<unsigned char> cyphertext(encrypted_len);
-            GDK_RUNTIME_ASSERT(aes_gcm_encrypt(key, data, cyphertext) == encrypted_len);
-
-            std::ofstream f(path, std::ofstream::out | std::ofstream::binary);
-            if (f.is_open()) {
-                for (size_t written = 0; written != encrypted_len; written = f.tellp()) {
-                    auto p = reinterpret_cast<const char*>(&cyphertext[written]);
-                    f.write(p, encrypted_len - written);
+            const auto tmp_path = path + ".tmp";
+            bool written = false;
+            {
+                // Stream the encrypted image to disk as it is encrypted
+                std::ofstream f(tmp_path, std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+                if (f.is_open()) {
+                    written = aes_gcm_chunked_encrypt(key, data, [&f](byte_span_t cyphertext) {
+                        f.write(reinterpret_cast<const char*>(cyphertext.data()), cyphertext.size());
+                        return f.good();
+                    });
+                    f.flush();
+                    written = written && f.good();
+                }
+            }
+            if (!written) {
+                GDK_LOG(info) << "Save db, failed to write " << tmp_path;
+                unlink(tmp_path.c_str());
+                return false;
+            }
+            // Remove the journal before replacing the base image: if we are
+            // interrupted we are left with either the old base and its
+            // journal, or the old base alone; never a journal that does not
+            // match its base image.
+            unlink(get_journal_file(path).c_str());
+            if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+                // Windows does not allow renaming over an existing file
+                unlink(path.c_str());
+                if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+                    GDK_LOG(info) << "Save db, failed to rename " << tmp_path;
+                    unlink(tmp_path.c_str());
+                    return false;
                 }
             }
+            return true;
+        }
+
+        // Create a journal record containing the given changed pages of data
+        static std::vector<unsigned char> make_journal_record(
+            byte_span_t data, size_t page_size, const std::vector<size_t>& changed_pages)
+        {
+            std::vector<unsigned char> record;
+            record.reserve(JOURNAL_RECORD_HEADER_LEN + changed_pages.size() * (sizeof(uint32_t) + page_size));
+            write_le32(record, page_size);
+            write_le32(record, data.size() / page_size);
+            write_le32(record, changed_pages.size());
+            for (const auto page : changed_pages) {
+                write_le32(record, page);
+                const auto page_data = data.subspan(page * page_size, page_size);
+                record.insert(record.end(), page_data.begin(), page_data.end());
+            }
+            return record;
+        }
+
+        // The number of bytes a journal record occupies in the journal file
+        static size_t get_journal_record_length(byte_span_t record)
+        {
+            return sizeof(uint32_t) + aes_gcm_encrypt_get_length(record);
+        }
+
+        // Encrypt and append a journal record. Returns false on error.
+        static bool append_journal_record(byte_span_t key, const std::string& path, byte_span_t record)
+        {
+            const size_t encrypted_len = aes_gcm_encrypt_get_length(record);
+            std::vector<unsigned char> cyphertext;
+            cyphertext.reserve(sizeof(uint32_t) + encrypted_len);
+            write_le32(cyphertext, encrypted_len);
+            cyphertext.resize(sizeof(uint32_t) + encrypted_len);
+            const auto encrypted = gsl::make_span(cyphertext).subspan(sizeof(uint32_t));
+            GDK_RUNTIME_ASSERT(aes_gcm_encrypt(key, record, encrypted) == encrypted_len);
+
+            if (!write_file(get_journal_file(path), cyphertext, std::ofstream::app)) {
+                GDK_LOG(info) << "Save db, failed to append journal for " << path;
+                return false;
+            }
+            return true;
+        }
+
+        static void apply_journal_record(byte_span_t record, sqlite_buffer& image)
+        {
+            GDK_RUNTIME_ASSERT(record.size() >= JOURNAL_RECORD_HEADER_LEN);
+            const size_t page_size = read_le32(record.data());
+            const size_t num_pages = read_le32(record.data() + 4);
+            const size_t num_changed = read_le32(record.data() + 8);
+            GDK_RUNTIME_ASSERT(page_size == get_db_page_size(image.span()));
+            GDK_RUNTIME_ASSERT(record.size() == JOURNAL_RECORD_HEADER_LEN + num_changed * (4 + page_size));
+            const unsigned char* p = record.data() + JOURNAL_RECORD_HEADER_LEN;
+            for (size_t i = 0; i < num_changed; ++i, p += 4 + page_size) {
+                GDK_RUNTIME_ASSERT(read_le32(p) < num_pages);
+            }
+            image.resize(num_pages * page_size);
+            p = record.data() + JOURNAL_RECORD_HEADER_LEN;
+            for (size_t i = 0; i < num_changed; ++i, p += 4 + page_size) {
+                std::copy(p + 4, p + 4 + page_size, image.data() + read_le32(p) * page_size);
+            }
         }
 
-        static std::vector<unsigned char> load_db_file(byte_span_t key, const std::string& path)
+        // Apply any journalled page changes to the image loaded from path.
+        // Returns the size of the valid portion of the journal.
+        static size_t apply_journal(byte_span_t key, const std::string& path, sqlite_buffer& image, bool& is_valid)
+        {
+            std::ifstream f(get_journal_file(path), std::ifstream::in | std::ifstream::binary);
+            if (!f.is_open()) {
+                return 0;
+            }
+            size_t valid_len = 0;
+            std::vector<unsigned char> cyphertext;
+            secure_bytes_t record;
+            for (;;) {
+                std::array<unsigned char, sizeof(uint32_t)> len_bytes;
+                f.read(reinterpret_cast<char*>(len_bytes.data()), len_bytes.size());
+                if (f.gcount() == 0 && f.eof()) {
+                    break; // End of journal
+                }
+                try {
+                    GDK_RUNTIME_ASSERT(static_cast<size_t>(f.gcount()) == len_bytes.size());
+                    cyphertext.resize(read_le32(len_bytes.data()));
+                    f.read(reinterpret_cast<char*>(cyphertext.data()), cyphertext.size());
+                    GDK_RUNTIME_ASSERT(static_cast<size_t>(f.gcount()) == cyphertext.size());
+                    record.resize(aes_gcm_decrypt_get_length(cyphertext));
+                    GDK_RUNTIME_ASSERT(aes_gcm_decrypt(key, cyphertext, record) == record.size());
+                    apply_journal_record(record, image);
+                } catch (const std::exception& ex) {
+                    // A truncated or corrupt record, e.g. from an interrupted
+                    // write. Keep the changes applied so far.
+                    GDK_LOG(info) << "Bad journal record at " << valid_len << " for file " << path << " error "
+                                  << ex.what();
+                    is_valid = false;
+                    break;
+                }
+                valid_len += len_bytes.size() + cyphertext.size();
+            }
+            bzero_and_free(record);
+            return valid_len;
+        }
+
+        static void load_db_file(byte_span_t key, const std::string& path, sqlite_buffer& plaintext)
         {
             GDK_RUNTIME_ASSERT(!key.empty());
             std::ifstream f(path, std::ifstream::in | std::ifstream::binary);
             if (!f.is_open()) {
                 GDK_LOG(info) << "Load db, no file or bad file " << path;
-                return std::vector<unsigned char>();
+                return;
             }
 
             f.seekg(0, f.end);
-            std::vector<unsigned char> cyphertext(f.tellg());
+            const size_t file_size = f.tellg();
             f.seekg(0, f.beg);
 
+            // Read the cyphertext into the buffer that sqlite will take
+            // ownership of, and decrypt it in place to avoid extra copies
+            plaintext.resize(file_size);
             size_t read = 0;
-            while (read != cyphertext.size()) {
-                auto p = reinterpret_cast<char*>(&cyphertext[read]);
-                f.read(p, cyphertext.size() - read);
+            while (read != file_size) {
+                auto p = reinterpret_cast<char*>(plaintext.data() + read);
+                f.read(p, file_size - read);
+                GDK_RUNTIME_ASSERT(f.gcount() > 0);
                 read += f.gcount();
             }
-
-            const size_t decrypted_len = aes_gcm_decrypt_get_length(cyphertext);
-            std::vector<unsigned char> plaintext(decrypted_len);
-            GDK_RUNTIME_ASSERT(aes_gcm_decrypt(key, cyphertext, plaintext) == decrypted_len);
-            return plaintext;
+            if (is_aes_gcm_chunked(key, plaintext.span())) {
+                plaintext.resize(aes_gcm_chunked_decrypt_in_place(key, plaintext.span()));
+            } else {
+                // A whole image encrypted by previous versions. It is
+                // rewritten in the chunked format on the next full save
+                plaintext.resize(aes_gcm_decrypt_in_place(key, plaintext.span()));
+            }
         }
 
         static std::string get_persistent_storage_file(
@@ -205,38 +490,46 @@ namespace green {
                 }
                 GDK_LOG(info) << "Deleting old version " << version << " db file " << path;
                 unlink(path.c_str());
+                unlink(get_journal_file(path).c_str());
             }
         }
 
-        static bool load_db_impl(byte_span_t key, const std::string& path, cache::sqlite3_ptr& db)
+        static bool load_db_impl(byte_span_t key, const std::string& path, cache::sqlite3_ptr& db, db_image& image)
         {
-            std::vector<unsigned char> plaintext;
+            sqlite_buffer plaintext;
             try {
-                plaintext = load_db_file(key, path);
+                load_db_file(key, path, plaintext);
             } catch (const std::exception& ex) {
                 GDK_LOG(info) << "Bad decryption for file " << path << " error " << ex.what();
                 unlink(path.c_str());
+                unlink(get_journal_file(path).c_str());
+                return false;
             }
 
             if (plaintext.empty()) {
                 return false;
             }
 
-            const auto tmpdb = get_new_memory_db();
-            const int rc = sqlite3_deserialize(
-                tmpdb.get(), "main", plaintext.data(), plaintext.size(), plaintext.size(), SQLITE_DESERIALIZE_READONLY);
+            image.journal_size = apply_journal(key, path, plaintext, image.is_journal_valid);
+            try {
+                image.page_size = get_db_page_size(plaintext.span());
+                image.page_hashes = get_page_hashes(plaintext.span(), image.page_size);
+            } catch (const std::exception&) {
+                // Not a valid image; sqlite3_deserialize fails below
+            }
+
+            // Use the decrypted image directly as the database contents.
+            // sqlite takes ownership of the buffer, freeing it on error.
+            const sqlite3_int64 size = plaintext.size();
+            const sqlite3_int64 capacity = plaintext.capacity();
+            const int rc = sqlite3_deserialize(db.get(), "main", plaintext.release(), size, capacity,
+                SQLITE_DESERIALIZE_FREEONCLOSE | SQLITE_DESERIALIZE_RESIZEABLE);
 
             if (rc != SQLITE_OK) {
                 GDK_LOG(info) << "Bad sqlite3_deserialize for file " << path << " RC " << rc;
                 unlink(path.c_str());
-                return false;
-            }
-
-            auto backup = sqlite3_backup_init(db.get(), "main", tmpdb.get(), "main");
-            bool ok = backup != nullptr && sqlite3_backup_step(backup, -1) == SQLITE_DONE;
-            ok = ok && sqlite3_backup_finish(backup) == SQLITE_OK;
-            if (!ok) {
-                db_log_error(db.get());
+                unlink(get_journal_file(path).c_str());
+                create_db_schema(db); // Continue with an empty database
                 return false;
             }
             GDK_LOG(debug) << path << " updating schema";
@@ -257,6 +550,14 @@ namespace green {
             step_final(stmt);
         }
 
+        static int64_t get_pragma_value(cache::sqlite3_ptr& db, const char* sql)
+        {
+            auto stmt = get_stmt(true, db, sql);
+            const auto _{ stmt_clean(stmt) };
+            GDK_RUNTIME_ASSERT(sqlite3_step(stmt.get()) == SQLITE_ROW);
+            return sqlite3_column_int64(stmt.get(), 0);
+        }
+
         static uint32_t get_uint32(cache::sqlite3_stmt_ptr& stmt, int column)
         {
             const auto val = sqlite3_column_int64(stmt.get(), column);
@@ -279,6 +580,16 @@ namespace green {
             return result;
         }
 
+        // Copy a fixed size blob column of the current row
+        template <size_t N>
+        static void get_fixed_blob(cache::sqlite3_stmt_ptr& stmt, int column, std::array<unsigned char, N>& dest)
+        {
+            const auto res = reinterpret_cast<const unsigned char*>(sqlite3_column_blob(stmt.get(), column));
+            const auto len = sqlite3_column_bytes(stmt.get(), column);
+            GDK_RUNTIME_ASSERT(res && static_cast<size_t>(len) == N);
+            std::copy(res, res + N, dest.begin());
+        }
+
         static void get_blob(cache::sqlite3_stmt_ptr& stmt, int column, const cache::get_key_value_fn& callback)
         {
             const int rc = sqlite3_step(stmt.get());
@@ -298,6 +609,134 @@ namespace green {
             step_final(stmt);
         }
 
+        // Keys found in cached tx JSON, stored as their index into this table
+        // instead of as strings. Keys not listed are stored verbatim.
+        // Entries may only be appended: indices are part of the cache format.
+        constexpr std::array<std::string_view, 58> TX_KEYS = { "txhash", "block_height", "created_at_ts", "fee",
+            "fee_rate", "memo", "transaction_weight", "transaction_vsize", "type", "can_rbf", "can_cpfp", "rbf_optin",
+            "inputs", "outputs", "satoshi", "is_output", "is_relevant", "is_internal", "is_spent", "pt_idx",
+            "prevtxhash", "previdx", "prevpointer", "previous_output", "subaccount", "pointer", "branch", "subtype",
+            "address", "address_type", "addressee", "script", "script_type", "service_xpub", "user_path", "asset_id",
+            "asset_tag", "assetblinder", "amountblinder", "commitment", "nonce_commitment", "is_blinded",
+            "is_confidential", "error", "social_destination", "social_destination_type", "instant",
+            "has_payment_request", "server_signed", "user_signed", "vsize", "locktime", "transaction_version", "spent",
+            "sequence", "recovery_xpub", "blinding_key", "unconfidential_address" };
+
+        static std::optional<uint32_t> get_tx_key_index(const std::string& key)
+        {
+            static const auto indices = [] {
+                std::unordered_map<std::string_view, uint32_t> ret;
+                for (uint32_t i = 0; i < TX_KEYS.size(); ++i) {
+                    GDK_RUNTIME_ASSERT(ret.emplace(TX_KEYS[i], i).second);
+                }
+                return ret;
+            }();
+            const auto p = indices.find(key);
+            if (p == indices.end()) {
+                return {};
+            }
+            return p->second;
+        }
+
+        static void pack_tx_json(msgpack::packer<msgpack::sbuffer>& pk, const nlohmann::json& json)
+        {
+            switch (json.type()) {
+            case nlohmann::json::value_t::null:
+                pk.pack_nil();
+                return;
+            case nlohmann::json::value_t::boolean:
+                pk.pack(json.get<bool>());
+                return;
+            case nlohmann::json::value_t::number_integer:
+                pk.pack(json.get<int64_t>());
+                return;
+            case nlohmann::json::value_t::number_unsigned:
+                pk.pack(json.get<uint64_t>());
+                return;
+            case nlohmann::json::value_t::number_float:
+                pk.pack(json.get<double>());
+                return;
+            case nlohmann::json::value_t::string:
+                pk.pack(json.get_ref<const std::string&>());
+                return;
+            case nlohmann::json::value_t::binary: {
+                const auto& bin = json.get_binary();
+                pk.pack_bin(bin.size());
+                pk.pack_bin_body(reinterpret_cast<const char*>(bin.data()), bin.size());
+                return;
+            }
+            case nlohmann::json::value_t::array:
+                pk.pack_array(json.size());
+                for (const auto& item : json) {
+                    pack_tx_json(pk, item);
+                }
+                return;
+            case nlohmann::json::value_t::object:
+                pk.pack_map(json.size());
+                for (const auto& item : json.items()) {
+                    if (const auto index = get_tx_key_index(item.key()); index.has_value()) {
+                        pk.pack(*index);
+                    } else {
+                        pk.pack(item.key());
+                    }
+                    pack_tx_json(pk, item.value());
+                }
+                return;
+            case nlohmann::json::value_t::discarded:
+                break;
+            }
+            GDK_RUNTIME_ASSERT_MSG(false, "unsupported tx json type");
+        }
+
+        static nlohmann::json unpack_tx_json(const msgpack::object& obj)
+        {
+            switch (obj.type) {
+            case msgpack::type::NIL:
+                return nullptr;
+            case msgpack::type::BOOLEAN:
+                return obj.via.boolean;
+            case msgpack::type::POSITIVE_INTEGER:
+                return obj.via.u64;
+            case msgpack::type::NEGATIVE_INTEGER:
+                return obj.via.i64;
+            case msgpack::type::FLOAT32:
+            case msgpack::type::FLOAT64:
+                return obj.via.f64;
+            case msgpack::type::STR:
+                return std::string(obj.via.str.ptr, obj.via.str.size);
+            case msgpack::type::BIN: {
+                const auto p = reinterpret_cast<const uint8_t*>(obj.via.bin.ptr);
+                return nlohmann::json::binary(std::vector<uint8_t>(p, p + obj.via.bin.size));
+            }
+            case msgpack::type::ARRAY: {
+                nlohmann::json ret = nlohmann::json::array();
+                auto& arr = ret.get_ref<nlohmann::json::array_t&>();
+                arr.reserve(obj.via.array.size);
+                for (const auto& item : gsl::make_span(obj.via.array.ptr, obj.via.array.size)) {
+                    arr.emplace_back(unpack_tx_json(item));
+                }
+                return ret;
+            }
+            case msgpack::type::MAP: {
+                nlohmann::json ret = nlohmann::json::object();
+                for (const auto& kv : gsl::make_span(obj.via.map.ptr, obj.via.map.size)) {
+                    if (kv.key.type == msgpack::type::POSITIVE_INTEGER) {
+                        GDK_RUNTIME_ASSERT(kv.key.via.u64 < TX_KEYS.size());
+                        ret[std::string(TX_KEYS[kv.key.via.u64])] = unpack_tx_json(kv.val);
+                    } else {
+                        GDK_RUNTIME_ASSERT(kv.key.type == msgpack::type::STR);
+                        ret[std::string(kv.key.via.str.ptr, kv.key.via.str.size)] = unpack_tx_json(kv.val);
+                    }
+                }
+                return ret;
+            }
+            default:
+                break;
+            }
+            GDK_RUNTIME_ASSERT_MSG(false, "unsupported cached tx type");
+            return nlohmann::json(); // Unreachable
+        }
+
         static bool get_tx(cache::sqlite3_stmt_ptr& stmt, const cache::get_transactions_fn& callback)
         {
             const int rc = sqlite3_step(stmt.get());
@@ -321,9 +760,7 @@ namespace green {
             const size_t len = sqlite3_column_bytes(stmt.get(), 5);
             try {
                 const auto txhash_hex = b2h_rev({ txid, txid_len });
-                const auto span = gsl::make_span(data, len);
-                auto tx_json = nlohmann::json::from_msgpack(span.begin(), span.end());
-                callback(timestamp, txhash_hex, block, spent, spv_status, tx_json);
+                callback(timestamp, txhash_hex, block, spent, spv_status, gsl::make_span(data, len));
             } catch (const std::exception& ex) {
                 GDK_LOG(error) << "Tx callback exception: " << ex.what();
                 return false; // Stop iterating on any exception
@@ -363,6 +800,12 @@ namespace green {
             return db_pointer;
         }
 
+        static uint64_t get_scriptpubkey_hash(byte_span_t scriptpubkey)
+        {
+            const auto p = reinterpret_cast<const char*>(scriptpubkey.data());
+            return std::hash<std::string_view>()(std::string_view(p, scriptpubkey.size()));
+        }
+
         static void bind_blob(cache::sqlite3_stmt_ptr& stmt, int column, byte_span_t blob)
         {
             if (sqlite3_bind_blob(stmt.get(), column, blob.data(), blob.size(), SQLITE_STATIC) != SQLITE_OK) {
@@ -379,6 +822,13 @@ namespace green {
             }
         }
 
+        static void bind_text(cache::sqlite3_stmt_ptr& stmt, int column, const std::string& text)
+        {
+            if (sqlite3_bind_text(stmt.get(), column, text.data(), text.size(), SQLITE_STATIC) != SQLITE_OK) {
+                GDK_RUNTIME_ASSERT_MSG(false, db_log_error(stmt));
+            }
+        }
+
         static void bind_blobs(cache::sqlite3_stmt_ptr& stmt, byte_span_t blob1, byte_span_t blob2)
         {
             bind_blob(stmt, 1, blob1);
@@ -390,10 +840,20 @@ namespace green {
         : m_network_name(network_name)
         , m_data_dir(gdk_config().at("datadir"))
         , m_is_liquid(net_params.is_liquid())
+        , m_max_bytes(int64_t(j_uint32(gdk_config(), "cache_max_kb").value_or(0)) * 1024)
         , m_type(0)
         , m_db_name()
         , m_encryption_key()
         , m_require_write(false)
+        , m_read_only(false)
+        , m_page_size(0)
+        , m_journal_size(0)
+        , m_batch_depth(0)
+        , m_batch_failed(false)
+        , m_flush_window(j_uint32(gdk_config(), "cache_flush_ms").value_or(DEFAULT_FLUSH_MS))
+        , m_flush_pending(false)
+        , m_flush_exiting(false)
+        , m_scriptpubkey_filter_loaded(false)
         , m_db(get_db())
         , m_stmt_liquid_blinding_key_search(
               get_stmt(m_is_liquid, m_db, "SELECT pubkey FROM LiquidBlindingPubKey WHERE script = ?1;"))
@@ -403,8 +863,6 @@ namespace green {
               get_stmt(m_is_liquid, m_db, "SELECT nonce FROM LiquidBlindingNonce WHERE pubkey = ?1 AND script = ?2;"))
         , m_stmt_liquid_blinding_nonce_insert(get_stmt(m_is_liquid, m_db,
               "INSERT OR IGNORE INTO LiquidBlindingNonce (pubkey, script, nonce) VALUES (?1, ?2, ?3);"))
-        , m_stmt_liquid_output_search(get_stmt(
-              m_is_liquid, m_db, "SELECT assetid, satoshi, abf, vbf FROM LiquidOutput WHERE txid = ?1 AND vout = ?2;"))
         , m_stmt_liquid_output_insert(get_stmt(m_is_liquid, m_db,
               "INSERT INTO LiquidOutput (txid, vout, assetid, satoshi, abf, vbf) VALUES (?1, ?2, ?3, ?4, ?5, ?6);"))
         , m_stmt_key_value_upsert(get_stmt(
@@ -412,6 +870,11 @@ namespace green {
         , m_stmt_key_value_search(get_stmt(true, m_db, KV_SELECT))
         , m_stmt_key_value_delete(get_stmt(true, m_db, "DELETE FROM KeyValue WHERE key = ?1;"))
         , m_stmt_tx_search(get_stmt(true, m_db, TX_SELECT))
+        , m_stmt_tx_before_search(get_stmt(true, m_db, TX_SELECT_BEFORE))
+        , m_stmt_tx_address_insert(get_stmt(true, m_db, TX_ADDRESS_INSERT))
+        , m_stmt_tx_address_delete(get_stmt(true, m_db, TX_ADDRESS_DELETE))
+        , m_stmt_tx_asset_insert(get_stmt(true, m_db, TX_ASSET_INSERT))
+        , m_stmt_tx_asset_delete(get_stmt(true, m_db, TX_ASSET_DELETE))
         , m_stmt_txid_search(get_stmt(true, m_db, TXID_SELECT))
         , m_stmt_tx_latest_search(get_stmt(true, m_db, TX_LATEST))
         , m_stmt_tx_earliest_mempool_search(get_stmt(true, m_db, TX_EARLIEST_MEMPOOL))
@@ -428,10 +891,50 @@ namespace green {
               "VALUES (?1, ?2, ?3, ?4, ?5, ?6);"))
         , m_stmt_scriptpubkey_latest_search(
               get_stmt(true, m_db, "SELECT MAX(pointer) FROM ScriptPubKey WHERE subaccount = ?1;"))
+        , m_stmt_txdata_evict(get_stmt(m_max_bytes != 0, m_db, TXDATA_EVICT))
+        , m_stmt_liquid_output_evict(get_stmt(m_max_bytes != 0 && m_is_liquid, m_db, LIQUID_OUTPUT_EVICT))
     {
     }
 
-    cache::~cache() {}
+    cache::~cache()
+    {
+        no_std_exception_escape([this] {
+            {
+                std::unique_lock<std::mutex> flush_locker(m_flush_mutex);
+                m_flush_exiting = true;
+            }
+            m_flush_cv.notify_all();
+            if (m_flush_thread.joinable()) {
+                m_flush_thread.join();
+            }
+        }, "cache dtor(1)");
+        no_std_exception_escape([this] { flush_db(); }, "cache dtor(2)");
+    }
+
+    cache::write_batch::write_batch(cache& c)
+        : m_cache(c)
+        , m_locker(c.m_mutex)
+        , m_uncaught_exceptions(std::uncaught_exceptions())
+    {
+        if (m_cache.m_batch_depth++ == 0) {
+            exec_sql(m_cache.m_db, "BEGIN;");
+            m_cache.m_batch_failed = false;
+        }
+    }
+
+    cache::write_batch::~write_batch()
+    {
+        if (std::uncaught_exceptions() > m_uncaught_exceptions) {
+            // Unwinding: discard the whole batch, even if an outer guard
+            // catches the exception and completes normally
+            m_cache.m_batch_failed = true;
+        }
+        if (--m_cache.m_batch_depth == 0) {
+            const char* sql = m_cache.m_batch_failed ? "ROLLBACK;" : "COMMIT;";
+            no_std_exception_escape([this, sql] { exec_sql(m_cache.m_db, sql); }, "cache write_batch");
+            m_cache.m_batch_failed = false;
+        }
+    }
 
     const std::string& cache::get_network_name() const { return m_network_name; }
 
@@ -442,21 +945,189 @@ namespace green {
         return changed;
     }
 
+    void cache::enforce_size_limit()
+    {
+        if (m_batch_depth) {
+            return; // Can't compact within a transaction; retry on the next save
+        }
+        const auto page_size = get_pragma_value(m_db, "PRAGMA page_size;");
+        auto&& get_used_bytes = [this, page_size] {
+            const auto page_count = get_pragma_value(m_db, "PRAGMA page_count;");
+            return (page_count - get_pragma_value(m_db, "PRAGMA freelist_count;")) * page_size;
+        };
+        const auto used_bytes = m_max_bytes ? get_used_bytes() : 0;
+        if (m_max_bytes && used_bytes > m_max_bytes) {
+            // Evict raw txs first, then unblinded outputs, until under budget.
+            // The remaining data is not re-fetchable and is never evicted. Watch-only
+            // wallets keep their unblinded outputs, since they may lack the nonces.
+            // Evicting is undone if it can't bring the cache under budget, since
+            // it would then discard the data on every save without shrinking it
+            const auto target = m_max_bytes * EVICT_TARGET_PERCENT / 100;
+            const bool evict_outputs = m_type != CT_WO;
+            exec_sql(m_db, "SAVEPOINT evict;");
+            try {
+                for (auto* stmt : { &m_stmt_txdata_evict, &m_stmt_liquid_output_evict }) {
+                    if (stmt == &m_stmt_liquid_output_evict && !evict_outputs) {
+                        break;
+                    }
+                    while (*stmt && get_used_bytes() > target) {
+                        const auto _{ stmt_clean(*stmt) };
+                        bind_int(*stmt, 1, EVICT_ROWS_PER_STEP);
+                        step_final(*stmt);
+                        if (!check_db_changed()) {
+                            break; // Nothing left to evict
+                        }
+                    }
+                }
+                const auto evicted_bytes = get_used_bytes();
+                if (evicted_bytes > m_max_bytes) {
+                    exec_sql(m_db, "ROLLBACK TO evict;");
+                    GDK_LOG(warning) << "cache uses " << used_bytes << " of " << m_max_bytes
+                                     << " bytes, but only " << used_bytes - evicted_bytes << " are evictable";
+                } else {
+                    GDK_LOG(info) << "cache evicted to " << evicted_bytes << " of " << m_max_bytes << " bytes";
+                }
+            } catch (const std::exception&) {
+                exec_sql(m_db, "ROLLBACK TO evict;");
+                exec_sql(m_db, "RELEASE evict;");
+                throw;
+            }
+            exec_sql(m_db, "RELEASE evict;");
+        }
+        const auto page_count = get_pragma_value(m_db, "PRAGMA page_count;");
+        const auto free_count = get_pragma_value(m_db, "PRAGMA freelist_count;");
+        if (page_count >= COMPACT_MIN_PAGES && free_count * COMPACT_FREE_DIVISOR > page_count) {
+            // Rebuild the database without its free pages, so that it
+            // loads and saves faster. The next save rewrites it in full
+            stats::timer timer("cache", "compact_db");
+            exec_sql(m_db, "VACUUM;");
+            m_require_write = true;
+        }
+    }
+
     void cache::save_db()
     {
-        if (m_db_name.empty() || !m_require_write) {
-            return;
+        {
+            locker_t locker(m_mutex);
+            if (m_db_name.empty() || !m_require_write || m_read_only) {
+                return;
+            }
         }
-        sqlite3_int64 db_size;
-        void* db = sqlite3_serialize(m_db.get(), "main", &db_size, 0);
-        const auto _stmt_clean = gsl::finally([&db] { sqlite3_free(db); });
-        if (db == nullptr || db_size < 1) {
+        if (m_flush_window == std::chrono::milliseconds::zero()) {
+            flush_db(); // Flushing in the background is disabled
             return;
         }
-        const auto data = gsl::make_span(reinterpret_cast<const unsigned char*>(db), db_size);
-        const auto path = get_persistent_storage_file(m_data_dir, m_db_name, VERSION);
-        save_db_file(m_encryption_key, data, path);
-        m_require_write = false;
+        std::unique_lock<std::mutex> flush_locker(m_flush_mutex);
+        if (!m_flush_thread.joinable()) {
+            m_flush_thread = std::thread([this] { flush_thread_fn(); });
+        }
+        if (!m_flush_pending) {
+            // Coalesce all saves in the flush window into a single write
+            m_flush_pending = true;
+            m_flush_deadline = std::chrono::steady_clock::now() + m_flush_window;
+            flush_locker.unlock();
+            m_flush_cv.notify_all();
+        }
+    }
+
+    void cache::flush_thread_fn()
+    {
+        std::unique_lock<std::mutex> flush_locker(m_flush_mutex);
+        for (;;) {
+            m_flush_cv.wait(flush_locker, [this] { return m_flush_pending || m_flush_exiting; });
+            if (m_flush_exiting) {
+                return; // The final flush is performed by our owner
+            }
+            m_flush_cv.wait_until(flush_locker, m_flush_deadline, [this] { return m_flush_exiting; });
+            m_flush_pending = false;
+            unique_unlock unlocker(flush_locker);
+            no_std_exception_escape([this] { flush_db(); }, "cache flush");
+        }
+    }
+
+    void cache::flush_db()
+    {
+        // Serialize writers so journal records are appended in order
+        std::unique_lock<std::mutex> write_locker(m_write_mutex);
+        stats::timer timer("cache", "save_db");
+
+        std::vector<unsigned char> pending; // Full image or journal record
+        bool is_full_write;
+        std::string path;
+        std::array<unsigned char, SHA256_LEN> key;
+        {
+            // Snapshot the changes to write while we have exclusive access to
+            // the database. The encryption and I/O are done without the lock.
+            locker_t locker(m_mutex);
+            if (m_db_name.empty() || !m_require_write || m_read_only) {
+                return;
+            }
+            enforce_size_limit();
+            sqlite3_int64 db_size;
+            // Loaded databases are memdb backed and can be read without copying
+            bool is_copy = false;
+            void* db = sqlite3_serialize(m_db.get(), "main", &db_size, SQLITE_SERIALIZE_NOCOPY);
+            if (db == nullptr) {
+                db = sqlite3_serialize(m_db.get(), "main", &db_size, 0);
+                is_copy = true;
+            }
+            const auto _stmt_clean = gsl::finally([&db, is_copy] {
+                if (is_copy) {
+                    sqlite3_free(db);
+                }
+            });
+            if (db == nullptr || db_size < 1) {
+                return;
+            }
+            const auto data = gsl::make_span(reinterpret_cast<const unsigned char*>(db), db_size);
+            path = get_persistent_storage_file(m_data_dir, m_db_name, VERSION);
+            key = m_encryption_key;
+            const size_t page_size = get_db_page_size(data);
+            GDK_RUNTIME_ASSERT(data.size() % page_size == 0);
+
+            auto page_hashes = get_page_hashes(data, page_size);
+            is_full_write = m_page_hashes.empty() || page_size != m_page_size;
+            if (!is_full_write) {
+                // Journal only the pages that have changed since the last save
+                std::vector<size_t> changed_pages;
+                for (size_t i = 0; i < page_hashes.size(); ++i) {
+                    if (i >= m_page_hashes.size() || page_hashes[i] != m_page_hashes[i]) {
+                        changed_pages.push_back(i);
+                    }
+                }
+                if (changed_pages.empty() && page_hashes.size() == m_page_hashes.size()) {
+                    m_require_write = false;
+                    return; // Nothing changed
+                }
+                pending = make_journal_record(data, page_size, changed_pages);
+                const size_t record_len = get_journal_record_length(pending);
+                if (m_journal_size + record_len <= data.size() / JOURNAL_MAX_DIVISOR) {
+                    m_journal_size += record_len;
+                } else {
+                    // The journal is too large: rewrite the base image
+                    bzero_and_free(pending);
+                    is_full_write = true;
+                }
+            }
+            if (is_full_write) {
+                pending.assign(data.begin(), data.end());
+                m_journal_size = 0;
+            }
+            m_page_size = page_size;
+            m_page_hashes.swap(page_hashes);
+            m_require_write = false;
+        }
+
+        const bool written = is_full_write ? save_db_file(key, pending, path)
+                                           : append_journal_record(key, path, pending);
+        bzero_and_free(pending);
+        wally_bzero(key.data(), key.size());
+        if (!written) {
+            // Force a full rewrite on the next save
+            locker_t locker(m_mutex);
+            m_page_hashes.clear();
+            m_require_write = true;
+        }
     }
 
     std::tuple<std::string, uint32_t, std::array<unsigned char, SHA256_LEN>> cache::get_name_type_and_key(
@@ -474,19 +1145,35 @@ namespace green {
         return { std::move(db_name), type, std::move(derived_encryption_key) };
     }
 
-    void cache::load_db(byte_span_t encryption_key, std::shared_ptr<signer> signer)
+    bool cache::load_db(byte_span_t encryption_key, std::shared_ptr<signer> signer, bool read_only)
     {
+        locker_t locker(m_mutex);
+        stats::timer timer("cache", "load_db");
         std::tie(m_db_name, m_type, m_encryption_key) = get_name_type_and_key(encryption_key, m_network_name, signer);
+        m_read_only = read_only;
 
         const auto path = get_persistent_storage_file(m_data_dir, m_db_name, VERSION);
-        if (!load_db_impl(m_encryption_key, path, m_db)) {
+        db_image image;
+        const bool loaded = load_db_impl(m_encryption_key, path, m_db, image);
+        if (loaded) {
+            // Track the persisted pages so that saves only write changes
+            m_page_size = image.page_size;
+            m_page_hashes = std::move(image.page_hashes);
+            m_journal_size = image.journal_size;
+            if (!image.is_journal_valid) {
+                // Force a full rewrite to discard the bad journal portion
+                m_page_hashes.clear();
+                m_require_write = true;
+            }
+        } else if (!read_only) {
             // Failed to load the latest version.
             if (VERSION > 1) {
                 // Try to carry forward our client blob from the previous version
                 try {
                     const auto prev_path = get_persistent_storage_file(m_data_dir, m_db_name, VERSION - 1);
                     auto db{ get_db() };
-                    if (load_db_impl(m_encryption_key, prev_path, db)) {
+                    db_image prev_image;
+                    if (load_db_impl(m_encryption_key, prev_path, db, prev_image)) {
                         auto stmt{ get_stmt(true, db, KV_SELECT) };
                         const auto _{ stmt_clean(stmt) };
                         const char* blob_key = "client_blob";
@@ -522,10 +1209,45 @@ namespace green {
             // Clean up old versions only on initial DB creation
             clean_up_old_db(m_data_dir, m_db_name);
         }
+        // The loaded DB may hold scriptpubkeys not yet in our filter
+        m_scriptpubkey_filter.clear();
+        m_scriptpubkey_filter_loaded = false;
+        return loaded;
+    }
+
+    void cache::set_writable()
+    {
+        locker_t locker(m_mutex);
+        m_read_only = false;
+    }
+
+    nlohmann::json cache::get_memory_stats()
+    {
+        locker_t locker(m_mutex);
+        const auto page_size = get_pragma_value(m_db, "PRAGMA page_size;");
+        const auto page_count = get_pragma_value(m_db, "PRAGMA page_count;");
+        int cache_used = 0, highwater = 0;
+        sqlite3_db_status(m_db.get(), SQLITE_DBSTATUS_CACHE_USED, &cache_used, &highwater, 0);
+        return { { "page_size", page_size }, { "page_count", page_count },
+            { "freelist_count", get_pragma_value(m_db, "PRAGMA freelist_count;") },
+            { "db_bytes", page_size * page_count }, { "page_cache_bytes", cache_used },
+            { "journal_bytes", m_journal_size }, { "page_hashes", m_page_hashes.size() },
+            { "scriptpubkey_filter_entries", m_scriptpubkey_filter.size() },
+            { "sqlite_process_bytes", sqlite3_memory_used() } };
+    }
+
+    void cache::release_memory()
+    {
+        locker_t locker(m_mutex);
+        sqlite3_db_release_memory(m_db.get());
+        // The filter is re-loaded on the next scriptpubkey lookup
+        std::unordered_set<uint64_t>().swap(m_scriptpubkey_filter);
+        m_scriptpubkey_filter_loaded = false;
     }
 
     void cache::update_to_latest_minor_version()
     {
+        locker_t locker(m_mutex);
         uint32_t ver = 0;
         get_key_value("minor_version", { [&ver](const auto& db_blob) {
             if (db_blob) {
@@ -540,8 +1262,9 @@ namespace green {
                 exec_sql(m_db, "DELETE FROM LiquidOutput;");
                 exec_sql(m_db, "DELETE FROM LiquidBlindingNonce;");
             }
-            if (ver < 3) {
-                // Delete pre-v3 tx's
+            if (ver < 5) {
+                // Delete pre-v4 tx's, which are stored as plain msgpack, and
+                // pre-v5 tx's, which are not in the search indexes
                 exec_sql(m_db, "DELETE FROM Tx;");
             }
 
@@ -553,6 +1276,7 @@ namespace green {
 
     void cache::clear_key_value(const std::string_view& key)
     {
+        locker_t locker(m_mutex);
         GDK_RUNTIME_ASSERT(!key.empty());
         const auto _{ stmt_clean(m_stmt_key_value_delete) };
         const auto key_span = ustring_span(key);
@@ -563,6 +1287,7 @@ namespace green {
 
     std::string cache::get_key_value_string(const std::string_view& key)
     {
+        locker_t locker(m_mutex);
         std::string value;
         get_key_value(key, { [&value](const auto& db_blob) {
             if (db_blob.has_value()) {
@@ -574,6 +1299,7 @@ namespace green {
 
     void cache::get_key_value(const std::string_view& key, const cache::get_key_value_fn& callback)
     {
+        locker_t locker(m_mutex);
         GDK_RUNTIME_ASSERT(!key.empty());
         const auto _{ stmt_clean(m_stmt_key_value_search) };
         const auto key_span = ustring_span(key);
@@ -584,6 +1310,7 @@ namespace green {
     void cache::get_transactions(
         uint32_t subaccount, uint64_t start, size_t count, const cache::get_transactions_fn& callback)
     {
+        locker_t locker(m_mutex);
         const auto _{ stmt_clean(m_stmt_tx_search) };
         bind_int(m_stmt_tx_search, 1, subaccount);
         bind_int(m_stmt_tx_search, 2, count);
@@ -593,22 +1320,44 @@ namespace green {
         }
     }
 
+    void cache::get_transactions_before(uint32_t subaccount, uint64_t before_ts, uint64_t start, size_t count,
+        const cache::get_transactions_fn& callback)
+    {
+        locker_t locker(m_mutex);
+        const auto _{ stmt_clean(m_stmt_tx_before_search) };
+        bind_int(m_stmt_tx_before_search, 1, subaccount);
+        bind_int(m_stmt_tx_before_search, 2, count);
+        bind_int(m_stmt_tx_before_search, 3, start);
+        bind_int(m_stmt_tx_before_search, 4, before_ts);
+        while (get_tx(m_stmt_tx_before_search, callback)) {
+            // No-op
+        }
+    }
+
     void cache::get_transaction(
         uint32_t subaccount, const std::string& txhash_hex, const cache::get_transactions_fn& callback)
     {
+        locker_t locker(m_mutex);
         const auto txid = h2b_rev(txhash_hex);
         const auto _{ stmt_clean(m_stmt_txid_search) };
         bind_int(m_stmt_txid_search, 1, subaccount);
         bind_blob(m_stmt_txid_search, 2, txid);
         if (get_tx(m_stmt_txid_search, callback)) {
             // At most one txid should be available
-            auto&& dummy_cb = [](uint64_t, const std::string&, uint32_t, uint32_t, uint32_t, nlohmann::json&) {};
+            auto&& dummy_cb = [](uint64_t, const std::string&, uint32_t, uint32_t, uint32_t, byte_span_t) {};
             GDK_RUNTIME_ASSERT(!get_tx(m_stmt_txid_search, dummy_cb));
         }
     }
 
+    nlohmann::json cache::decode_transaction(byte_span_t tx_data)
+    {
+        const auto handle = msgpack::unpack(reinterpret_cast<const char*>(tx_data.data()), tx_data.size());
+        return unpack_tx_json(handle.get());
+    }
+
     void cache::get_transaction_data(const std::string& txhash_hex, const cache::get_key_value_fn& callback)
     {
+        locker_t locker(m_mutex);
         const auto txid = h2b_rev(txhash_hex);
         const auto _{ stmt_clean(m_stmt_txdata_search) };
         bind_blob(m_stmt_txdata_search, 1, txid);
@@ -617,6 +1366,7 @@ namespace green {
 
     void cache::insert_transaction_data(const std::string& txhash_hex, byte_span_t value)
     {
+        locker_t locker(m_mutex);
         GDK_RUNTIME_ASSERT(!txhash_hex.empty() && !value.empty());
         const auto txid = h2b_rev(txhash_hex);
         const auto _{ stmt_clean(m_stmt_txdata_insert) };
@@ -628,6 +1378,7 @@ namespace green {
 
     uint64_t cache::get_latest_transaction_timestamp(uint32_t subaccount)
     {
+        locker_t locker(m_mutex);
         const auto _{ stmt_clean(m_stmt_tx_latest_search) };
         bind_int(m_stmt_tx_latest_search, 1, subaccount);
         return get_tx_timestamp(m_stmt_tx_latest_search).value_or(0);
@@ -635,12 +1386,14 @@ namespace green {
 
     void cache::set_latest_block(uint32_t block)
     {
+        locker_t locker(m_mutex);
         const auto block_str = std::to_string(block);
         upsert_key_value("last_seen_block", ustring_span(block_str));
     }
 
     uint32_t cache::get_latest_block()
     {
+        locker_t locker(m_mutex);
         uint32_t db_block = 0;
         get_key_value("last_seen_block", { [&db_block](const auto& db_blob) {
             if (db_blob.has_value()) {
@@ -654,8 +1407,11 @@ namespace green {
     void cache::insert_transaction(
         uint32_t subaccount, uint64_t timestamp, const std::string& txhash_hex, const nlohmann::json& tx_json)
     {
+        locker_t locker(m_mutex);
         const auto txid = h2b_rev(txhash_hex);
-        const auto tx_data = nlohmann::json::to_msgpack(tx_json);
+        msgpack::sbuffer tx_data;
+        msgpack::packer<msgpack::sbuffer> pk(tx_data);
+        pack_tx_json(pk, tx_json);
         const auto _{ stmt_clean(m_stmt_tx_upsert) };
         bind_int(m_stmt_tx_upsert, 1, subaccount);
         bind_int(m_stmt_tx_upsert, 2, timestamp);
@@ -663,13 +1419,111 @@ namespace green {
         bind_int(m_stmt_tx_upsert, 4, tx_json.at("block_height"));
         bind_int(m_stmt_tx_upsert, 5, 0); // 0 = Unknown spent status
         bind_int(m_stmt_tx_upsert, 6, 3); // SPV_STATUS_DISABLED
-        bind_blob(m_stmt_tx_upsert, 7, tx_data);
+        const auto tx_data_p = reinterpret_cast<const unsigned char*>(tx_data.data());
+        bind_blob(m_stmt_tx_upsert, 7, gsl::make_span(tx_data_p, tx_data.size()));
         step_final(m_stmt_tx_upsert);
+        index_transaction(subaccount, timestamp, tx_json);
         m_require_write = true;
     }
 
+    void cache::index_transaction(uint32_t subaccount, uint64_t timestamp, const nlohmann::json& tx_json)
+    {
+        // Remove any index entries from a previous version of this tx
+        for (auto* stmt : { &m_stmt_tx_address_delete, &m_stmt_tx_asset_delete }) {
+            const auto _{ stmt_clean(*stmt) };
+            bind_int(*stmt, 1, subaccount);
+            bind_int(*stmt, 2, timestamp);
+            step_final(*stmt);
+        }
+        // Index the wallet addresses the tx pays to or spends from
+        for (const auto* key : { "inputs", "outputs" }) {
+            const auto eps = tx_json.find(key);
+            if (eps == tx_json.end()) {
+                continue;
+            }
+            for (const auto& ep : *eps) {
+                const auto address = j_str_or_empty(ep, "address");
+                if (address.empty() || !j_bool_or_false(ep, "is_relevant")) {
+                    continue;
+                }
+                const auto _{ stmt_clean(m_stmt_tx_address_insert) };
+                bind_text(m_stmt_tx_address_insert, 1, address);
+                bind_int(m_stmt_tx_address_insert, 2, subaccount);
+                bind_int(m_stmt_tx_address_insert, 3, timestamp);
+                step_final(m_stmt_tx_address_insert);
+            }
+        }
+        // Index the assets the tx moved by the absolute net amount
+        const auto totals = tx_json.find("satoshi");
+        if (totals != tx_json.end() && totals->is_object()) {
+            for (const auto& total : totals->items()) {
+                const int64_t satoshi = total.value().get<int64_t>();
+                const auto _{ stmt_clean(m_stmt_tx_asset_insert) };
+                bind_int(m_stmt_tx_asset_insert, 1, subaccount);
+                bind_text(m_stmt_tx_asset_insert, 2, total.key());
+                bind_int(m_stmt_tx_asset_insert, 3, static_cast<uint64_t>(satoshi < 0 ? -satoshi : satoshi));
+                bind_int(m_stmt_tx_asset_insert, 4, timestamp);
+                step_final(m_stmt_tx_asset_insert);
+            }
+        }
+    }
+
+    void cache::search_transactions(uint32_t subaccount, const tx_query& query, const get_transactions_fn& callback)
+    {
+        // Each filter selects the matching timestamps through its index
+        std::string sql = "SELECT timestamp, txid, block, spent, spv_status, data FROM Tx WHERE subaccount = ?1";
+        if (query.before_ts) {
+            sql += " AND timestamp < ?2";
+        }
+        if (!query.address.empty()) {
+            sql += " AND timestamp IN (SELECT timestamp FROM TxAddress WHERE address = ?3 AND subaccount = ?1)";
+        }
+        if (!query.asset_id.empty() || query.min_satoshi || query.max_satoshi) {
+            sql += " AND timestamp IN (SELECT timestamp FROM TxAsset WHERE subaccount = ?1";
+            if (!query.asset_id.empty()) {
+                sql += " AND asset = ?4";
+            }
+            sql += " AND satoshi >= ?5 AND satoshi <= ?6)";
+        }
+        sql += " ORDER BY timestamp DESC;";
+
+        locker_t locker(m_mutex);
+        auto stmt{ get_stmt(true, m_db, sql.c_str()) };
+        const auto _{ stmt_clean(stmt) };
+        bind_int(stmt, 1, subaccount);
+        if (query.before_ts) {
+            bind_int(stmt, 2, *query.before_ts);
+        }
+        if (!query.address.empty()) {
+            bind_text(stmt, 3, query.address);
+        }
+        if (!query.asset_id.empty() || query.min_satoshi || query.max_satoshi) {
+            // Only present in the SQL if the asset/amount filter is
+            if (!query.asset_id.empty()) {
+                bind_text(stmt, 4, query.asset_id);
+            }
+            bind_int(stmt, 5, query.min_satoshi.value_or(0));
+            bind_int(stmt, 6, query.max_satoshi.value_or(std::numeric_limits<int64_t>::max()));
+        }
+
+        // Rows are stepped lazily, so stopping after query.count rows
+        // avoids visiting the remainder of the history
+        size_t num_found = 0;
+        const get_transactions_fn filter_fn = [&](uint64_t ts, const std::string& txhash, uint32_t block,
+                                                  uint32_t spent, uint32_t spv_status, byte_span_t tx_data) {
+            if (!query.txhashes || query.txhashes->count(txhash)) {
+                callback(ts, txhash, block, spent, spv_status, tx_data);
+                ++num_found;
+            }
+        };
+        while (num_found < query.count && get_tx(stmt, filter_fn)) {
+            // No-op
+        }
+    }
+
     void cache::set_transaction_spv_verified(const std::string& txhash_hex)
     {
+        locker_t locker(m_mutex);
         const auto txid = h2b_rev(txhash_hex);
         const auto _{ stmt_clean(m_stmt_tx_spv_update) };
         bind_int(m_stmt_tx_spv_update, 1, 1); // SPV_STATUS_VERIFIED
@@ -680,6 +1534,7 @@ namespace green {
 
     void cache::delete_transactions(uint32_t subaccount, uint64_t start_ts)
     {
+        locker_t locker(m_mutex);
         const auto _{ stmt_clean(m_stmt_tx_delete_all) };
         bind_int(m_stmt_tx_delete_all, 1, subaccount);
         bind_int(m_stmt_tx_delete_all, 2, start_ts);
@@ -689,6 +1544,7 @@ namespace green {
 
     bool cache::delete_mempool_txs(uint32_t subaccount)
     {
+        locker_t locker(m_mutex);
         // Delete all transactions from the earliest mempool tx onwards
         std::optional<uint64_t> db_timestamp;
         {
@@ -705,6 +1561,7 @@ namespace green {
 
     bool cache::delete_block_txs(uint32_t subaccount, uint32_t start_block)
     {
+        locker_t locker(m_mutex);
         // Delete all transactions in the start block or later
         std::optional<uint64_t> db_timestamp;
         {
@@ -722,17 +1579,19 @@ namespace green {
 
     void cache::on_new_transaction(uint32_t subaccount, const std::string& txhash_hex)
     {
-        nlohmann::json existing_tx;
+        locker_t locker(m_mutex);
+        bool have_existing_tx = false;
         uint32_t existing_tx_block = 0;
 
+        // Only the block is needed, so the tx data is not decoded
         get_transaction(subaccount, txhash_hex,
-            { [&existing_tx, &existing_tx_block](uint64_t /*ts*/, const std::string& /*txhash*/, uint32_t block,
-                  uint32_t /*spent*/, uint32_t /*spv_status*/, nlohmann::json& tx_json) {
-                existing_tx = std::move(tx_json);
+            { [&have_existing_tx, &existing_tx_block](uint64_t /*ts*/, const std::string& /*txhash*/, uint32_t block,
+                  uint32_t /*spent*/, uint32_t /*spv_status*/, byte_span_t /*tx_data*/) {
+                have_existing_tx = true;
                 existing_tx_block = block;
             } });
 
-        if (!existing_tx.empty() && existing_tx_block != 0) {
+        if (have_existing_tx && existing_tx_block != 0) {
             // We have been notified of a confirmed tx we already had cached as confirmed.
             // Either the tx was reorged or the server is re-processing txs; either way
             // remove all cached txs from the block the tx was originally in onwards, along
@@ -747,6 +1606,7 @@ namespace green {
 
     std::vector<unsigned char> cache::get_liquid_blinding_nonce(byte_span_t pubkey, byte_span_t script)
     {
+        locker_t locker(m_mutex);
         GDK_RUNTIME_ASSERT(!pubkey.empty() && !script.empty());
         GDK_RUNTIME_ASSERT(m_stmt_liquid_blinding_nonce_search.get());
         const auto _{ stmt_clean(m_stmt_liquid_blinding_nonce_search) };
@@ -756,6 +1616,7 @@ namespace green {
 
     std::vector<unsigned char> cache::get_liquid_blinding_pubkey(byte_span_t script)
     {
+        locker_t locker(m_mutex);
         GDK_RUNTIME_ASSERT(!script.empty());
         GDK_RUNTIME_ASSERT(m_stmt_liquid_blinding_key_search.get());
         const auto _{ stmt_clean(m_stmt_liquid_blinding_key_search) };
@@ -763,41 +1624,55 @@ namespace green {
         return get_blob(m_stmt_liquid_blinding_key_search, 0);
     }
 
-    nlohmann::json cache::get_liquid_output(byte_span_t txhash, uint32_t vout)
+    cache::liquid_outputs_t cache::get_liquid_outputs(const std::vector<outpoint_t>& outpoints)
     {
-        nlohmann::json utxo;
-
-        GDK_RUNTIME_ASSERT(!txhash.empty());
-        GDK_RUNTIME_ASSERT(m_stmt_liquid_output_search.get());
-        const auto _{ stmt_clean(m_stmt_liquid_output_search) };
-        bind_blob(m_stmt_liquid_output_search, 1, txhash);
-        bind_int(m_stmt_liquid_output_search, 2, vout);
-        const int rc = sqlite3_step(m_stmt_liquid_output_search.get());
-        if (rc == SQLITE_DONE) {
-            return utxo;
+        liquid_outputs_t result;
+        const std::set<outpoint_t> wanted(outpoints.begin(), outpoints.end());
+        std::vector<std::array<unsigned char, SHA256_LEN>> txids;
+        for (const auto& outpoint : wanted) {
+            // Outpoints are sorted, so outputs of the same tx are adjacent
+            if (txids.empty() || txids.back() != outpoint.first) {
+                txids.push_back(outpoint.first);
+            }
         }
-        GDK_RUNTIME_ASSERT(rc == SQLITE_ROW);
-        const auto _get_reversed_result = [this](const int column, const size_t size) {
-            const size_t column_size = sqlite3_column_bytes(m_stmt_liquid_output_search.get(), column);
-            GDK_RUNTIME_ASSERT(column_size == size);
-            const auto res = reinterpret_cast<const unsigned char*>(
-                sqlite3_column_blob(m_stmt_liquid_output_search.get(), column));
-            GDK_RUNTIME_ASSERT(res);
-            // cache values are stored in byte order not display order (reversed)
-            return b2h_rev({ res, size });
-        };
-
-        utxo["asset_id"] = _get_reversed_result(0, ASSET_TAG_LEN);
-        utxo["satoshi"] = sqlite3_column_int64(m_stmt_liquid_output_search.get(), 1);
-        utxo["assetblinder"] = _get_reversed_result(2, 32);
-        utxo["amountblinder"] = _get_reversed_result(3, 32);
 
-        step_final(m_stmt_liquid_output_search);
-        return utxo;
+        locker_t locker(m_mutex);
+        for (size_t first = 0; first < txids.size(); first += MAX_TXIDS_PER_QUERY) {
+            // Select all outputs of a chunk of txids through the primary key
+            const size_t n = std::min(txids.size() - first, MAX_TXIDS_PER_QUERY);
+            std::string sql = "SELECT txid, vout, assetid, satoshi, abf, vbf FROM LiquidOutput WHERE txid IN (?1";
+            for (size_t i = 2; i <= n; ++i) {
+                sql += ", ?" + std::to_string(i);
+            }
+            sql += ");";
+            auto stmt{ get_stmt(m_is_liquid, m_db, sql.c_str()) };
+            GDK_RUNTIME_ASSERT(stmt.get());
+            const auto _{ stmt_clean(stmt) };
+            for (size_t i = 0; i < n; ++i) {
+                bind_blob(stmt, i + 1, txids[first + i]);
+            }
+            int rc;
+            while ((rc = sqlite3_step(stmt.get())) == SQLITE_ROW) {
+                outpoint_t outpoint;
+                get_fixed_blob(stmt, 0, outpoint.first);
+                outpoint.second = sqlite3_column_int64(stmt.get(), 1);
+                if (!wanted.count(outpoint)) {
+                    continue; // Another output of a tx we are looking up
+                }
+                auto& output = result[outpoint];
+                get_fixed_blob(stmt, 2, output.asset_id);
+                output.satoshi = sqlite3_column_int64(stmt.get(), 3);
+                get_fixed_blob(stmt, 4, output.assetblinder);
+                get_fixed_blob(stmt, 5, output.amountblinder);
+            }
+            GDK_RUNTIME_ASSERT(rc == SQLITE_DONE);
+        }
+        return result;
     }
 
     void cache::upsert_key_value(const std::string_view& key, byte_span_t value)
     {
+        locker_t locker(m_mutex);
         GDK_RUNTIME_ASSERT(!key.empty() && !value.empty());
         const auto _{ stmt_clean(m_stmt_key_value_upsert) };
         const auto key_span = ustring_span(key);
@@ -810,6 +1685,7 @@ namespace green {
     bool cache::insert_liquid_blinding_data(
         byte_span_t pubkey, byte_span_t script, byte_span_t nonce, byte_span_t blinding_pubkey)
     {
+        locker_t locker(m_mutex);
         GDK_RUNTIME_ASSERT(!pubkey.empty() && !script.empty() && !nonce.empty());
         {
             GDK_RUNTIME_ASSERT(m_stmt_liquid_blinding_nonce_insert.get());
@@ -830,6 +1706,7 @@ namespace green {
 
     void cache::insert_liquid_output(byte_span_t txhash, uint32_t vout, nlohmann::json& utxo)
     {
+        locker_t locker(m_mutex);
         GDK_RUNTIME_ASSERT(!txhash.empty() && !utxo.empty());
         GDK_RUNTIME_ASSERT(m_stmt_liquid_output_insert.get());
         const auto _{ stmt_clean(m_stmt_liquid_output_insert) };
@@ -855,6 +1732,7 @@ namespace green {
     void cache::insert_scriptpubkey_data(byte_span_t scriptpubkey, uint32_t subaccount, uint32_t branch,
         uint32_t pointer, uint32_t subtype, const std::string& addr_type)
     {
+        locker_t locker(m_mutex);
         GDK_RUNTIME_ASSERT(!scriptpubkey.empty());
         GDK_RUNTIME_ASSERT(pointer > 0);
         GDK_RUNTIME_ASSERT(m_stmt_scriptpubkey_insert.get());
@@ -870,14 +1748,24 @@ namespace green {
         bind_int(m_stmt_scriptpubkey_insert, 6, address_type_to_script_type(addr_type));
 
         step_final(m_stmt_scriptpubkey_insert);
+        if (m_scriptpubkey_filter_loaded) {
+            m_scriptpubkey_filter.insert(get_scriptpubkey_hash(scriptpubkey));
+        }
         m_require_write = true;
     }
 
     nlohmann::json cache::get_scriptpubkey_data(byte_span_t scriptpubkey)
     {
+        locker_t locker(m_mutex);
         nlohmann::json utxo;
 
         GDK_RUNTIME_ASSERT(!scriptpubkey.empty());
+        if (!m_scriptpubkey_filter_loaded) {
+            load_scriptpubkey_filter();
+        }
+        if (!m_scriptpubkey_filter.count(get_scriptpubkey_hash(scriptpubkey))) {
+            return utxo; // Not one of ours: avoid querying the DB
+        }
         GDK_RUNTIME_ASSERT(m_stmt_scriptpubkey_search.get());
         const auto _{ stmt_clean(m_stmt_scriptpubkey_search) };
         bind_blob(m_stmt_scriptpubkey_search, 1, scriptpubkey);
@@ -897,8 +1785,26 @@ namespace green {
         return utxo;
     }
 
+    void cache::load_scriptpubkey_filter()
+    {
+        locker_t locker(m_mutex);
+        auto stmt{ get_stmt(true, m_db, "SELECT scriptpubkey FROM ScriptPubKey;") };
+        const auto _{ stmt_clean(stmt) };
+        m_scriptpubkey_filter.clear();
+        int rc;
+        while ((rc = sqlite3_step(stmt.get())) == SQLITE_ROW) {
+            const auto data = reinterpret_cast<const unsigned char*>(sqlite3_column_blob(stmt.get(), 0));
+            const size_t len = sqlite3_column_bytes(stmt.get(), 0);
+            m_scriptpubkey_filter.insert(get_scriptpubkey_hash(gsl::make_span(data, len)));
+        }
+        GDK_RUNTIME_ASSERT(rc == SQLITE_DONE);
+        m_scriptpubkey_filter_loaded = true;
+        GDK_LOG(debug) << "Loaded " << m_scriptpubkey_filter.size() << " scriptpubkeys into filter";
+    }
+
     uint32_t cache::get_latest_scriptpubkey_pointer(uint32_t subaccount)
     {
+        locker_t locker(m_mutex);
         const auto _{ stmt_clean(m_stmt_scriptpubkey_latest_search) };
         bind_int(m_stmt_scriptpubkey_latest_search, 1, subaccount);
         return get_scriptpubkey_pointer(m_stmt_scriptpubkey_latest_search);
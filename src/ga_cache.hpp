@@ -3,10 +3,18 @@
 #pragma once
 #include "ga_wally.hpp"
 #include "gsl_wrapper.hpp"
+#include <chrono>
+#include <condition_variable>
 #include <functional>
+#include <map>
+#include <mutex>
 #include <nlohmann/json_fwd.hpp>
 #include <optional>
+#include <set>
+#include <string>
+#include <thread>
 #include <tuple>
+#include <unordered_set>
 
 struct sqlite3;
 struct sqlite3_stmt;
@@ -19,16 +27,46 @@ namespace green {
     struct cache final {
         using sqlite3_ptr = std::shared_ptr<struct ::sqlite3>;
         using sqlite3_stmt_ptr = std::shared_ptr<struct ::sqlite3_stmt>;
+        using locker_t = std::unique_lock<std::recursive_mutex>;
 
         cache(const network_parameters& net_params, const std::string& network_name);
         ~cache();
 
+        // Scoped guard that groups all writes made during its lifetime into
+        // a single database transaction. Guards may be nested; the outermost
+        // guard commits, or rolls back if any guard was destroyed by an
+        // exception. The cache is locked while a guard is alive, so the
+        // session lock must not be released while holding one.
+        class write_batch final {
+        public:
+            explicit write_batch(cache& c);
+            write_batch(const write_batch&) = delete;
+            write_batch& operator=(const write_batch&) = delete;
+            ~write_batch();
+
+        private:
+            cache& m_cache;
+            locker_t m_locker;
+            const int m_uncaught_exceptions; // At construction
+        };
+
         static std::tuple<std::string, uint32_t, std::array<unsigned char, SHA256_LEN>> get_name_type_and_key(
             byte_span_t encryption_key, const std::string& network_name, std::shared_ptr<signer> signer);
 
         const std::string& get_network_name() const;
 
-        nlohmann::json get_liquid_output(byte_span_t txhash, uint32_t vout);
+        // An unblinded Liquid output. Values are in byte order, not display order
+        struct liquid_output final {
+            asset_id_t asset_id;
+            uint64_t satoshi;
+            std::array<unsigned char, BLINDING_FACTOR_LEN> assetblinder;
+            std::array<unsigned char, BLINDING_FACTOR_LEN> amountblinder;
+        };
+        using outpoint_t = std::pair<std::array<unsigned char, SHA256_LEN>, uint32_t>;
+        using liquid_outputs_t = std::map<outpoint_t, liquid_output>;
+
+        // Look up the unblinded outputs cached for any of the given outpoints
+        liquid_outputs_t get_liquid_outputs(const std::vector<outpoint_t>& outpoints);
         void insert_liquid_output(byte_span_t txhash, uint32_t vout, nlohmann::json& utxo);
 
         std::vector<unsigned char> get_liquid_blinding_nonce(byte_span_t pubkey, byte_span_t script);
@@ -46,13 +84,31 @@ namespace green {
         void set_latest_block(uint32_t block);
         uint32_t get_latest_block();
 
+        // tx_data is only valid for the duration of the callback. Callbacks
+        // that need the tx JSON decode it using decode_transaction().
         typedef std::function<void(uint64_t ts, const std::string& txhash, uint32_t block, uint32_t spent,
-            uint32_t spv_status, nlohmann::json& tx_json)>
+            uint32_t spv_status, byte_span_t tx_data)>
             get_transactions_fn;
+        static nlohmann::json decode_transaction(byte_span_t tx_data);
         void get_transactions(
             uint32_t subaccount, uint64_t start_ts, size_t count, const get_transactions_fn& callback);
+        // As get_transactions, for txs older than before_ts only
+        void get_transactions_before(uint32_t subaccount, uint64_t before_ts, uint64_t start, size_t count,
+            const get_transactions_fn& callback);
         void get_transaction(
             uint32_t subaccount, const std::string& txhash_hex, const cache::get_transactions_fn& callback);
+        // Filters for search_transactions. Txs matching all given filters
+        // are returned, newest first.
+        struct tx_query final {
+            std::string address; // A wallet address the tx pays to or spends from
+            std::string asset_id; // An asset the tx moved ("btc" for Bitcoin)
+            std::optional<uint64_t> min_satoshi; // Absolute net amount range,
+            std::optional<uint64_t> max_satoshi; // of asset_id if given
+            std::optional<uint64_t> before_ts; // Only txs older than this
+            std::optional<std::set<std::string>> txhashes; // Only these txs
+            size_t count = 0; // Maximum number of txs to return
+        };
+        void search_transactions(uint32_t subaccount, const tx_query& query, const get_transactions_fn& callback);
         uint64_t get_latest_transaction_timestamp(uint32_t subaccount);
         void insert_transaction(
             uint32_t subaccount, uint64_t timestamp, const std::string& txhash_hex, const nlohmann::json& tx_json);
@@ -69,32 +125,82 @@ namespace green {
             uint32_t subtype, const std::string& addr_type);
         uint32_t get_latest_scriptpubkey_pointer(uint32_t subaccount);
 
+        // Schedule the database to be saved if it has changed. Saves within
+        // the "cache_flush_ms" config window are coalesced and written by a
+        // background thread; a value of 0 saves synchronously.
         void save_db();
-        void load_db(byte_span_t encryption_key, std::shared_ptr<signer> signer);
+        // Save the database now if it has changed, blocking until written.
+        void flush_db();
+        // Load the database for encryption_key. If read_only is true, a
+        // missing or outdated database is not migrated or cleaned up, and
+        // nothing is saved until set_writable() is called. Returns whether
+        // an existing database of the current version was loaded.
+        bool load_db(byte_span_t encryption_key, std::shared_ptr<signer> signer, bool read_only = false);
+        void set_writable();
 
         void update_to_latest_minor_version();
 
+        // Get the size of the database and in-memory lookup structures
+        nlohmann::json get_memory_stats();
+        // Release memory that can be recomputed or re-read when needed
+        void release_memory();
+
     private:
         bool check_db_changed();
+        // Evict re-fetchable data when over the "cache_max_kb" budget and
+        // compact the database when much of it is free. Called before saving
+        void enforce_size_limit();
+        void index_transaction(uint32_t subaccount, uint64_t timestamp, const nlohmann::json& tx_json);
+        void flush_thread_fn();
+        void load_scriptpubkey_filter();
 
         const std::string m_network_name;
         const std::string m_data_dir;
         const bool m_is_liquid;
+        const int64_t m_max_bytes; // Size budget, or 0 for unlimited
+        // Protects all members below, except where noted
+        std::recursive_mutex m_mutex;
         uint32_t m_type; // Set on first call to load_db
         std::string m_db_name; // Set on first call to load_db
         std::array<unsigned char, SHA256_LEN> m_encryption_key; // Set on first call to load_db
         bool m_require_write;
+        bool m_read_only; // Loaded read only: never saved
+        // Page size and per-page hashes of the persisted database image,
+        // used to journal only changed pages on save
+        size_t m_page_size;
+        std::vector<std::array<unsigned char, SHA256_LEN>> m_page_hashes;
+        size_t m_journal_size; // Bytes currently in the page journal
+        size_t m_batch_depth; // Number of live write_batch guards
+        bool m_batch_failed; // A write_batch guard was unwound by an exception
+        // Background flushing; protected by m_flush_mutex
+        const std::chrono::milliseconds m_flush_window;
+        std::mutex m_flush_mutex;
+        std::condition_variable m_flush_cv;
+        std::thread m_flush_thread;
+        std::chrono::steady_clock::time_point m_flush_deadline;
+        bool m_flush_pending;
+        bool m_flush_exiting;
+        std::mutex m_write_mutex; // Serializes writes to the cache files
+        // Hashes of every cached scriptpubkey, loaded on first lookup so that
+        // lookups of scripts that aren't ours never query the DB. A hash
+        // collision only costs a DB lookup that then finds no row.
+        std::unordered_set<uint64_t> m_scriptpubkey_filter;
+        bool m_scriptpubkey_filter_loaded;
         sqlite3_ptr m_db;
         sqlite3_stmt_ptr m_stmt_liquid_blinding_key_search;
         sqlite3_stmt_ptr m_stmt_liquid_blinding_key_insert;
         sqlite3_stmt_ptr m_stmt_liquid_blinding_nonce_search;
         sqlite3_stmt_ptr m_stmt_liquid_blinding_nonce_insert;
-        sqlite3_stmt_ptr m_stmt_liquid_output_search;
         sqlite3_stmt_ptr m_stmt_liquid_output_insert;
         sqlite3_stmt_ptr m_stmt_key_value_upsert;
         sqlite3_stmt_ptr m_stmt_key_value_search;
         sqlite3_stmt_ptr m_stmt_key_value_delete;
         sqlite3_stmt_ptr m_stmt_tx_search;
+        sqlite3_stmt_ptr m_stmt_tx_before_search;
+        sqlite3_stmt_ptr m_stmt_tx_address_insert;
+        sqlite3_stmt_ptr m_stmt_tx_address_delete;
+        sqlite3_stmt_ptr m_stmt_tx_asset_insert;
+        sqlite3_stmt_ptr m_stmt_tx_asset_delete;
         sqlite3_stmt_ptr m_stmt_txid_search;
         sqlite3_stmt_ptr m_stmt_tx_latest_search;
         sqlite3_stmt_ptr m_stmt_tx_earliest_mempool_search;
@@ -107,6 +213,8 @@ namespace green {
         sqlite3_stmt_ptr m_stmt_scriptpubkey_search;
         sqlite3_stmt_ptr m_stmt_scriptpubkey_insert;
         sqlite3_stmt_ptr m_stmt_scriptpubkey_latest_search;
+        sqlite3_stmt_ptr m_stmt_txdata_evict;
+        sqlite3_stmt_ptr m_stmt_liquid_output_evict;
     };
 
 } // namespace green
@@ -5,10 +5,12 @@
 #include "logging.hpp"
 #include "session_impl.hpp"
 #include "signer.hpp"
+#include "threading.hpp"
 #include "transaction_utils.hpp"
 #include "utils.hpp"
 #include "xpub_hdkey.hpp"
 
+#include <map>
 #include <nlohmann/json.hpp>
 
 #include <wally_psbt.h>
@@ -150,9 +152,24 @@ namespace green {
             GDK_VERIFY(wally_psbt_input_set_taproot_signature(psbt_input, der_sig.data(), der_sig.size()));
         }
 
-        static auto add_keypaths(session_impl& session, struct wally_psbt_input* psbt_input,
-            struct wally_psbt_output* psbt_output, wally_map& keypaths, uint32_t tx_version, const nlohmann::json& utxo,
-            const std::vector<byte_span_t>* sigs = nullptr)
+        // The Green and user master fingerprints, fetched once when adding
+        // keypaths for many inputs and outputs
+        struct keypath_fingerprints final {
+            explicit keypath_fingerprints(session_impl& session)
+                : green(session.get_network_parameters().is_electrum()
+                          ? std::vector<unsigned char>()
+                          : session.get_green_pubkeys().get_master_xpub().get_fingerprint())
+                , user(session.get_nonnull_signer()->get_master_fingerprint())
+            {
+            }
+
+            const std::vector<unsigned char> green; // Empty for singlesig
+            const std::vector<unsigned char> user;
+        };
+
+        static auto add_keypaths(session_impl& session, const keypath_fingerprints& fingerprints,
+            struct wally_psbt_input* psbt_input, struct wally_psbt_output* psbt_output, wally_map& keypaths,
+            uint32_t tx_version, const nlohmann::json& utxo, const std::vector<byte_span_t>* sigs = nullptr)
         {
             const bool is_electrum = session.get_network_parameters().is_electrum();
             const bool is_liquid = session.get_network_parameters().is_liquid();
@@ -180,17 +197,16 @@ namespace green {
 
                 if (!is_expired_csv) {
                     // First key returned is the Green key, add it
-                    const auto green_fp = session.get_green_pubkeys().get_master_xpub().get_fingerprint();
                     const auto& green_key = keys.at(user_key_index);
                     byte_span_t green_der_sig = sigs && sigs->size() == 2 ? sigs->front() : byte_span_t{};
-                    add_keypath(psbt_input, keypaths, session.get_green_pubkeys(), green_fp, green_key, subaccount,
-                        pointer, is_internal, green_der_sig);
+                    add_keypath(psbt_input, keypaths, session.get_green_pubkeys(), fingerprints.green, green_key,
+                        subaccount, pointer, is_internal, green_der_sig);
                 }
                 user_key_index = 1;
             }
 
             // Add the user's pubkey
-            auto master_fp = session.get_nonnull_signer()->get_master_fingerprint();
+            const auto& master_fp = fingerprints.user;
             const auto& user_key = keys.at(user_key_index);
             byte_span_t user_der_sig = sigs ? sigs->at(sigs->size() - 1) : byte_span_t{};
             if (addr_type == address_type::p2tr) {
@@ -234,10 +250,29 @@ namespace green {
             }
         }
 
-        static void add_input_utxo(session_impl& session, struct wally_psbt* psbt, size_t i,
+        // Transactions spent by PSBT inputs, by txhash. Inputs spending
+        // outputs of the same transaction share a single fetch
+        using utxo_tx_map_t = std::map<std::string, std::shared_ptr<const Tx>, std::less<>>;
+
+        // Fetch the transactions spent by the given inputs in one batch
+        static utxo_tx_map_t get_utxo_txs(session_impl& session, const std::vector<std::string>& txhashes)
+        {
+            utxo_tx_map_t utxo_txs;
+            auto txs = session.get_raw_transactions(txhashes);
+            for (size_t i = 0; i < txhashes.size(); ++i) {
+                utxo_txs.emplace(txhashes[i], std::move(txs[i]));
+            }
+            return utxo_txs;
+        }
+
+        static void add_input_utxo(session_impl& session, utxo_tx_map_t& utxo_txs, struct wally_psbt* psbt, size_t i,
             const std::string& txhash_hex, uint32_t vout, bool add_full_utxo, bool add_witness_utxo)
         {
-            const auto utxo_tx = session.get_raw_transaction_details(txhash_hex);
+            auto p = utxo_txs.find(txhash_hex);
+            if (p == utxo_txs.end()) {
+                p = utxo_txs.emplace(txhash_hex, session.get_raw_transaction(txhash_hex)).first;
+            }
+            const auto& utxo_tx = *p->second;
             if (add_full_utxo) {
                 GDK_VERIFY(wally_psbt_set_input_utxo(psbt, i, utxo_tx.get()));
             }
@@ -353,7 +388,9 @@ namespace green {
     {
         const auto sigs = tx.get_input_signatures(session.get_network_parameters(), utxo, index);
         auto& psbt_input = get_input(index);
-        auto keys = add_keypaths(session, &psbt_input, nullptr, psbt_input.keypaths, tx.get_version(), utxo, &sigs);
+        const keypath_fingerprints fingerprints(session);
+        auto keys = add_keypaths(
+            session, fingerprints, &psbt_input, nullptr, psbt_input.keypaths, tx.get_version(), utxo, &sigs);
         // The PSBT may be missing input scripts, add them here to ensure
         // they are present for finalization.
         add_input_scripts(psbt_input.psbt_fields, utxo, keys);
@@ -375,7 +412,7 @@ namespace green {
     nlohmann::json Psbt::get_details(session_impl& session, nlohmann::json details) const
     {
         const auto& net_params = session.get_network_parameters();
-        const auto policy_asset = net_params.get_policy_asset();
+        const auto& policy_asset = net_params.get_policy_asset();
         Tx tx(extract());
 
         auto inputs_and_assets = inputs_to_json(session, tx, std::move(details.at("utxos")));
@@ -469,6 +506,13 @@ namespace green {
         std::set<std::string> wallet_assets;
         nlohmann::json::array_t inputs;
         inputs.resize(get_num_inputs());
+        std::vector<std::string> utxo_txhashes;
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            if (const auto& psbt_input = get_input(i); !psbt_input.utxo && !psbt_input.witness_utxo) {
+                utxo_txhashes.push_back(b2h_rev(tx.get_input(i).txhash));
+            }
+        }
+        auto utxo_txs = get_utxo_txs(session, utxo_txhashes);
         for (size_t i = 0; i < inputs.size(); ++i) {
             const auto& psbt_input = get_input(i);
             auto& txin = tx.get_input(i);
@@ -497,7 +541,7 @@ namespace green {
                 // if we havent added a witness utxo.
                 const bool add_witness_utxo = have_utxo && address_type_is_segwit(j_strref(utxo, "address_type"));
                 const bool add_full_utxo = !m_is_liquid || !add_witness_utxo;
-                add_input_utxo(session, m_psbt.get(), i, txhash_hex, vout, add_full_utxo, add_witness_utxo);
+                add_input_utxo(session, utxo_txs, m_psbt.get(), i, txhash_hex, vout, add_full_utxo, add_witness_utxo);
             }
             const struct wally_tx_output* txin_utxo;
             GDK_VERIFY(wally_psbt_get_input_best_utxo(m_psbt.get(), i, &txin_utxo));
@@ -699,7 +743,35 @@ namespace green {
             }
         }
 
+        // Explicit proofs are generated for all inputs and outputs
+        // concurrently once the PSBT fields they depend on are set
+        struct explicit_proof final {
+            size_t index;
+            amount::value_type satoshi;
+            std::vector<unsigned char> asset_id;
+            std::vector<unsigned char> abf;
+            std::vector<unsigned char> vbf;
+            std::array<unsigned char, 32> nonce;
+            std::vector<unsigned char> asset_commitment;
+            std::vector<unsigned char> value_commitment;
+            std::array<unsigned char, ASSET_EXPLICIT_SURJECTIONPROOF_LEN> surjectionproof;
+            std::array<unsigned char, ASSET_EXPLICIT_RANGEPROOF_MAX_LEN> rangeproof;
+            size_t rangeproof_len;
+        };
+        std::vector<explicit_proof> input_proofs, output_proofs;
+        std::optional<keypath_fingerprints> fingerprints;
+
         const auto& inputs = j_arrayref(details, "transaction_inputs");
+        std::vector<std::string> utxo_txhashes;
+        for (size_t i = 0; i < tx.get_num_inputs(); ++i) {
+            if (const auto& psbt_input = get_input(i); !psbt_input.utxo && !psbt_input.witness_utxo) {
+                utxo_txhashes.push_back(j_strref(inputs.at(i), "txhash"));
+            }
+        }
+        auto utxo_txs = get_utxo_txs(session, utxo_txhashes);
+        if (m_is_liquid) {
+            input_proofs.reserve(tx.get_num_inputs());
+        }
         for (size_t i = 0; i < tx.get_num_inputs(); ++i) {
             const auto& input = inputs.at(i);
             auto& psbt_input = get_input(i);
@@ -709,7 +781,11 @@ namespace green {
             const bool belongs_to_wallet = is_wallet_utxo(input);
             if (belongs_to_wallet) {
                 // Wallet UTXO. Add the relevant keypaths
-                auto keys = add_keypaths(session, &psbt_input, nullptr, psbt_input.keypaths, tx_version, input);
+                if (!fingerprints) {
+                    fingerprints.emplace(session);
+                }
+                const auto& fps = *fingerprints;
+                auto keys = add_keypaths(session, fps, &psbt_input, nullptr, psbt_input.keypaths, tx_version, input);
                 add_input_scripts(psbt_input.psbt_fields, input, keys);
             }
             if (m_is_liquid) {
@@ -728,31 +804,38 @@ namespace green {
                 const bool add_witness_utxo
                     = belongs_to_wallet && address_type_is_segwit(j_strref(input, "address_type"));
                 const bool add_full_utxo = !m_is_liquid || !add_witness_utxo;
-                add_input_utxo(session, m_psbt.get(), i, txhash_hex, vout, add_full_utxo, add_witness_utxo);
+                add_input_utxo(session, utxo_txs, m_psbt.get(), i, txhash_hex, vout, add_full_utxo, add_witness_utxo);
             }
             if (m_is_liquid) {
-                // Create asset and value explicit proofs
-                const auto abf = j_rbytesref(input, "assetblinder");
-                const auto nonce = get_random_bytes<32>();
-                const auto vbf = j_rbytesref(input, "amountblinder");
-                GDK_VERIFY(wally_psbt_generate_input_explicit_proofs(m_psbt.get(), i, satoshi, asset_id.data(),
-                    asset_id.size(), abf.data(), abf.size(), vbf.data(), vbf.size(), nonce.data(), nonce.size()));
+                auto& p = input_proofs.emplace_back();
+                p.index = i;
+                p.satoshi = satoshi;
+                p.asset_id = std::move(asset_id);
+                p.abf = j_rbytesref(input, "assetblinder");
+                p.vbf = j_rbytesref(input, "amountblinder");
+                p.nonce = get_random_bytes<32>();
             }
         }
 
         const auto& outputs = j_arrayref(details, "transaction_outputs");
+        if (m_is_liquid) {
+            output_proofs.reserve(tx.get_num_outputs());
+        }
         for (size_t i = 0; i < tx.get_num_outputs(); ++i) {
             const auto& output = outputs.at(i);
             auto& psbt_output = get_output(i);
 
             if (is_wallet_utxo(output)) {
                 // Wallet UTXO. Add the relevant keypaths
-                add_keypaths(session, nullptr, &psbt_output, psbt_output.keypaths, tx_version, output);
+                if (!fingerprints) {
+                    fingerprints.emplace(session);
+                }
+                add_keypaths(session, *fingerprints, nullptr, &psbt_output, psbt_output.keypaths, tx_version, output);
             }
 
             if (m_is_liquid) {
                 // Add the output asset and amount
-                const auto asset_id = j_rbytesref(output, "asset_id");
+                auto asset_id = j_rbytesref(output, "asset_id");
                 GDK_VERIFY(wally_psbt_set_output_asset(m_psbt.get(), i, asset_id.data(), asset_id.size()));
                 const auto satoshi = j_amountref(output).value();
                 GDK_VERIFY(wally_psbt_set_output_amount(m_psbt.get(), i, satoshi));
@@ -768,32 +851,50 @@ namespace green {
                 GDK_VERIFY(wally_psbt_set_output_blinding_public_key(
                     m_psbt.get(), i, blinding_pubkey.data(), blinding_pubkey.size()));
 
-                // Create asset and value explicit proofs
-                const auto vbf = j_rbytesref(output, "amountblinder");
-                const byte_span_t asset_commitment
-                    = pset_field(psbt_output, out_asset_commitment).value_or(byte_span_t{});
-                const auto abf = j_rbytesref(output, "assetblinder");
-                GDK_RUNTIME_ASSERT(!asset_commitment.empty());
-                std::array<unsigned char, ASSET_EXPLICIT_SURJECTIONPROOF_LEN> sj_proof;
-                GDK_VERIFY(wally_explicit_surjectionproof(asset_id.data(), asset_id.size(), abf.data(), abf.size(),
-                    asset_commitment.data(), asset_commitment.size(), sj_proof.data(), sj_proof.size()));
-                GDK_VERIFY(wally_psbt_set_output_asset_blinding_surjectionproof(
-                    m_psbt.get(), i, sj_proof.data(), sj_proof.size()));
-
-                const auto nonce = get_random_bytes<32>();
-                const byte_span_t value_commitment
-                    = pset_field(psbt_output, out_value_commitment).value_or(byte_span_t{});
-                GDK_RUNTIME_ASSERT(!value_commitment.empty());
-                std::array<unsigned char, ASSET_EXPLICIT_RANGEPROOF_MAX_LEN> range_proof;
-                size_t written;
-                GDK_VERIFY(wally_explicit_rangeproof(satoshi, nonce.data(), nonce.size(), vbf.data(), vbf.size(),
-                    value_commitment.data(), value_commitment.size(), asset_commitment.data(), asset_commitment.size(),
-                    range_proof.data(), range_proof.size(), &written));
-                GDK_RUNTIME_ASSERT(written && written <= range_proof.size());
-                GDK_VERIFY(
-                    wally_psbt_set_output_value_blinding_rangeproof(m_psbt.get(), i, range_proof.data(), written));
+                auto& p = output_proofs.emplace_back();
+                p.index = i;
+                p.satoshi = satoshi;
+                p.asset_id = std::move(asset_id);
+                p.abf = j_rbytesref(output, "assetblinder");
+                p.vbf = j_rbytesref(output, "amountblinder");
+                p.nonce = get_random_bytes<32>();
+                const auto asset_commitment = pset_field(psbt_output, out_asset_commitment);
+                GDK_RUNTIME_ASSERT(asset_commitment.has_value() && !asset_commitment->empty());
+                p.asset_commitment.assign(asset_commitment->begin(), asset_commitment->end());
+                const auto value_commitment = pset_field(psbt_output, out_value_commitment);
+                GDK_RUNTIME_ASSERT(value_commitment.has_value() && !value_commitment->empty());
+                p.value_commitment.assign(value_commitment->begin(), value_commitment->end());
             }
         }
+
+        if (!m_is_liquid) {
+            return;
+        }
+
+        // Create asset and value explicit proofs. Each input proof only
+        // modifies its own input, so they can be generated in place
+        parallel_for(input_proofs.size(), [&](size_t n) {
+            const auto& p = input_proofs[n];
+            GDK_VERIFY(wally_psbt_generate_input_explicit_proofs(m_psbt.get(), p.index, p.satoshi, p.asset_id.data(),
+                p.asset_id.size(), p.abf.data(), p.abf.size(), p.vbf.data(), p.vbf.size(), p.nonce.data(),
+                p.nonce.size()));
+        });
+        parallel_for(output_proofs.size(), [&](size_t n) {
+            auto& p = output_proofs[n];
+            GDK_VERIFY(wally_explicit_surjectionproof(p.asset_id.data(), p.asset_id.size(), p.abf.data(), p.abf.size(),
+                p.asset_commitment.data(), p.asset_commitment.size(), p.surjectionproof.data(),
+                p.surjectionproof.size()));
+            GDK_VERIFY(wally_explicit_rangeproof(p.satoshi, p.nonce.data(), p.nonce.size(), p.vbf.data(), p.vbf.size(),
+                p.value_commitment.data(), p.value_commitment.size(), p.asset_commitment.data(),
+                p.asset_commitment.size(), p.rangeproof.data(), p.rangeproof.size(), &p.rangeproof_len));
+            GDK_RUNTIME_ASSERT(p.rangeproof_len && p.rangeproof_len <= p.rangeproof.size());
+        });
+        for (const auto& p : output_proofs) {
+            GDK_VERIFY(wally_psbt_set_output_asset_blinding_surjectionproof(
+                m_psbt.get(), p.index, p.surjectionproof.data(), p.surjectionproof.size()));
+            GDK_VERIFY(wally_psbt_set_output_value_blinding_rangeproof(
+                m_psbt.get(), p.index, p.rangeproof.data(), p.rangeproof_len));
+        }
     }
 
 } // namespace green
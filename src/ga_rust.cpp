@@ -17,6 +17,7 @@
 #include "json_utils.hpp"
 #include "logging.hpp"
 #include "memory.hpp"
+#include "network_state.hpp"
 #include "session.hpp"
 #include "signer.hpp"
 #include "transaction_utils.hpp"
@@ -25,8 +26,15 @@
 
 namespace green {
 
+    namespace {
+        // Maximum number of wallet scriptpubkeys whose data is cached
+        static constexpr size_t MAX_CACHED_SCRIPTPUBKEYS = 10000;
+    } // namespace
+
     ga_rust::ga_rust(network_parameters&& net_params)
         : session_impl(std::move(net_params))
+        , m_network_state(network_state::get(m_net_params))
+        , m_block_height(0)
     {
         auto np = m_net_params.get_json();
         const auto res = GDKRUST_create_session(&m_session, np.dump().c_str());
@@ -45,6 +53,7 @@ namespace green {
     {
         nlohmann::json net_params = m_net_params.get_json();
         net_params["proxy"] = session_impl::connect_tor();
+        reset_rust_cache();
         rust_call("connect", net_params, m_session);
     }
 
@@ -63,6 +72,43 @@ namespace green {
     {
         GDK_LOG(debug) << "ga_rust::disconnect_session";
         rust_call("disconnect", {}, m_session);
+        reset_rust_cache();
+    }
+
+    template <typename T, typename FN> T ga_rust::get_rust_cached(rust_cached<T>& cache, FN&& fetch) const
+    {
+        uint64_t generation;
+        {
+            std::lock_guard<std::mutex> locker(m_rust_cache_mutex);
+            if (cache.value) {
+                return *cache.value;
+            }
+            generation = cache.generation;
+        }
+        T value = fetch();
+        std::lock_guard<std::mutex> locker(m_rust_cache_mutex);
+        if (generation == cache.generation) {
+            // The value has not changed while we were fetching it
+            cache.value = value;
+        }
+        return value;
+    }
+
+    void ga_rust::invalidate_subaccounts()
+    {
+        std::lock_guard<std::mutex> locker(m_rust_cache_mutex);
+        m_subaccounts.invalidate();
+    }
+
+    void ga_rust::reset_rust_cache()
+    {
+        std::lock_guard<std::mutex> locker(m_rust_cache_mutex);
+        m_block_height.store(0, std::memory_order_release);
+        m_settings.invalidate();
+        m_subaccounts.invalidate();
+        m_available_currencies.invalidate();
+        m_min_fee_rate.invalidate();
+        m_scriptpubkey_data.clear();
     }
 
     void ga_rust::set_local_encryption_keys(
@@ -89,6 +135,7 @@ namespace green {
             store_details = { { "master_xpub", std::move(master_xpub) } };
         }
         rust_call("load_store", store_details, m_session);
+        reset_rust_cache(); // Settings are loaded from the store
 
         if (!signer->has_master_blinding_key()) {
             // Load the cached master blinding key, if we have it
@@ -271,6 +318,7 @@ namespace green {
                 details["subaccount"] = pointer;
                 details["xpub"] = bip32_xpub;
                 rust_call("create_subaccount", details, m_session);
+                invalidate_subaccounts();
                 locker_t locker(m_mutex);
                 m_user_pubkeys->add_subaccount(pointer, bip32_xpub);
             }
@@ -348,7 +396,42 @@ namespace green {
         if (!rust_call("discover_subaccount", details, m_session)) {
             return false;
         }
-        details = { { "name", std::string() }, { "subaccount", subaccount }, { "xpub", xpub }, { "discovered", true } };
+        add_discovered_subaccount(subaccount, xpub);
+        return true;
+    }
+
+    std::vector<bool> ga_rust::discover_subaccounts(const nlohmann::json::array_t& subaccounts)
+    {
+        nlohmann::json::array_t probes;
+        probes.reserve(subaccounts.size());
+        for (const auto& sa : subaccounts) {
+            probes.push_back({ { "type", j_strref(sa, "type") }, { "xpub", j_strref(sa, "xpub") } });
+        }
+        // Probe all of the subaccounts concurrently
+        const nlohmann::json details = { { "subaccounts", std::move(probes) } };
+        const auto probed = rust_call("discover_subaccounts", details, m_session).get<std::vector<bool>>();
+        GDK_RUNTIME_ASSERT(probed.size() == subaccounts.size());
+
+        std::vector<bool> discovered;
+        discovered.reserve(subaccounts.size());
+        std::set<std::string> stopped_types;
+        for (size_t i = 0; i < subaccounts.size(); ++i) {
+            const auto& sa_type = j_strref(subaccounts[i], "type");
+            const bool is_discovered = probed[i] && !stopped_types.count(sa_type);
+            if (is_discovered) {
+                add_discovered_subaccount(j_uint32ref(subaccounts[i], "subaccount"), j_strref(subaccounts[i], "xpub"));
+            } else {
+                stopped_types.insert(sa_type);
+            }
+            discovered.push_back(is_discovered);
+        }
+        return discovered;
+    }
+
+    void ga_rust::add_discovered_subaccount(uint32_t subaccount, const std::string& xpub)
+    {
+        nlohmann::json details
+            = { { "name", std::string() }, { "subaccount", subaccount }, { "xpub", xpub }, { "discovered", true } };
         {
             locker_t locker(m_mutex);
             if (m_blobserver) {
@@ -361,9 +444,9 @@ namespace green {
             }
         }
         rust_call("create_subaccount", details, m_session);
+        invalidate_subaccounts();
         locker_t locker(m_mutex);
         m_user_pubkeys->add_subaccount(subaccount, xpub);
-        return true;
     }
 
     uint32_t ga_rust::get_next_subaccount(const std::string& sa_type)
@@ -381,6 +464,7 @@ namespace green {
         details["subaccount"] = subaccount;
         details["xpub"] = xpub;
         auto ret = rust_call("create_subaccount", details, m_session);
+        invalidate_subaccounts();
         // Creating a new subaccount, set its metadata
         locker_t locker(m_mutex);
         m_user_pubkeys->add_subaccount(subaccount, xpub);
@@ -438,12 +522,35 @@ namespace green {
         ga_rust* self = static_cast<ga_rust*>(self_context);
         auto notification = json_parse(json);
         GDKRUST_destroy_string(json);
-        if (notification.at("event") == "transaction") {
+        const auto& event = j_strref(notification, "event");
+        if (event == "transaction") {
             // FIXME: Get the actual subaccounts affected from the notification
             // See gdk_rust/gdk_electrum/src/lib.rs: "// TODO account number"
             self->remove_cached_utxos(std::vector<uint32_t>());
+            // A first tx may change a subaccount's discovered state
+            self->invalidate_subaccounts();
+        } else if (event == "subaccount") {
+            self->invalidate_subaccounts();
+        } else if (event == "block") {
+            const auto block_height = j_uint32ref(notification.at("block"), "block_height");
+            self->m_block_height.store(block_height, std::memory_order_release);
+            {
+                std::lock_guard<std::mutex> locker(self->m_rust_cache_mutex);
+                self->m_min_fee_rate.invalidate();
+            }
+            auto& state = *self->m_network_state;
+            if (const auto shared_height = state.get_block_height(); shared_height != block_height) {
+                state.set_block_height(block_height);
+                if (shared_height) {
+                    // A new block may change fee rates: have them re-fetched
+                    state.invalidate_fee_estimates();
+                }
+            }
+        } else if (event == "settings") {
+            std::lock_guard<std::mutex> locker(self->m_rust_cache_mutex);
+            self->m_settings.invalidate();
         }
-        self->emit_notification(notification, false);
+        self->emit_notification(notification, true);
     }
 
     void ga_rust::set_notification_handler(GA_notification_handler handler, void* context)
@@ -471,7 +578,7 @@ namespace green {
 
     nlohmann::json ga_rust::get_subaccounts_impl(session_impl::locker_t& /*locker*/)
     {
-        return rust_call("get_subaccounts", {}, m_session);
+        return get_rust_cached(m_subaccounts, [this] { return rust_call("get_subaccounts", {}, m_session); });
     }
 
     nlohmann::json ga_rust::get_local_subaccounts_data()
@@ -500,6 +607,7 @@ namespace green {
         GDK_RUNTIME_ASSERT(j_uint32ref(details, "subaccount") == subaccount);
         // Make the rust call to ensure the subaccount is valid
         rust_call("update_subaccount", details, m_session);
+        invalidate_subaccounts();
         if (!m_watch_only) {
             session_impl::update_subaccount(subaccount, details);
         }
@@ -507,11 +615,12 @@ namespace green {
 
     nlohmann::json ga_rust::get_available_currencies() const
     {
-        nlohmann::json p = nlohmann::json::object();
-        p["currency_url"] = m_net_params.get_price_url();
-
         try {
-            return rust_call("get_available_currencies", p, m_session);
+            return get_rust_cached(m_available_currencies, [this] {
+                nlohmann::json p = nlohmann::json::object();
+                p["currency_url"] = m_net_params.get_price_url();
+                return rust_call("get_available_currencies", p, m_session);
+            });
         } catch (const std::exception& ex) {
             GDK_LOG(error) << "error fetching currencies: " << ex.what();
             return { { "error", ex.what() } };
@@ -523,9 +632,17 @@ namespace green {
         return !m_net_params.is_liquid(); // Not supported on liquid
     }
 
-    nlohmann::json ga_rust::get_settings() const { return rust_call("get_settings", nlohmann::json({}), m_session); }
+    nlohmann::json ga_rust::get_settings() const
+    {
+        return get_rust_cached(m_settings, [this] { return rust_call("get_settings", nlohmann::json({}), m_session); });
+    }
 
-    void ga_rust::change_settings(const nlohmann::json& settings) { rust_call("change_settings", settings, m_session); }
+    void ga_rust::change_settings(const nlohmann::json& settings)
+    {
+        rust_call("change_settings", settings, m_session);
+        std::lock_guard<std::mutex> locker(m_rust_cache_mutex);
+        m_settings.invalidate();
+    }
 
     std::vector<std::string> ga_rust::get_enabled_twofactor_methods() { return {}; }
 
@@ -605,11 +722,29 @@ namespace green {
 
     nlohmann::json ga_rust::get_scriptpubkey_data(byte_span_t scriptpubkey)
     {
+        auto scriptpubkey_hex = b2h(scriptpubkey);
+        {
+            std::lock_guard<std::mutex> locker(m_rust_cache_mutex);
+            if (auto p = m_scriptpubkey_data.find(scriptpubkey_hex); p != m_scriptpubkey_data.end()) {
+                return p->second;
+            }
+        }
+        nlohmann::json data;
         try {
-            return rust_call("get_scriptpubkey_data", nlohmann::json(b2h(scriptpubkey)), m_session);
+            data = rust_call("get_scriptpubkey_data", nlohmann::json(scriptpubkey_hex), m_session);
         } catch (const std::exception&) {
             return nlohmann::json();
         }
+        if (!data.is_null() && !data.empty()) {
+            // Only wallet scripts are cached: a script that isn't found may
+            // become known once more addresses have been derived
+            std::lock_guard<std::mutex> locker(m_rust_cache_mutex);
+            if (m_scriptpubkey_data.size() >= MAX_CACHED_SCRIPTPUBKEYS) {
+                m_scriptpubkey_data.clear();
+            }
+            m_scriptpubkey_data.emplace(std::move(scriptpubkey_hex), data);
+        }
+        return data;
     }
 
     nlohmann::json ga_rust::send_transaction(const nlohmann::json& details, const nlohmann::json& /*twofactor_data*/)
@@ -660,9 +795,28 @@ namespace green {
         session_impl::set_transaction_memo(txhash_hex, memo);
     }
 
+    void ga_rust::set_transaction_memos(const nlohmann::json& details)
+    {
+        for (const auto& m : j_ref(details, "memos").items()) {
+            rust_call("set_transaction_memo", { { "txid", m.key() }, { "memo", m.value() } }, m_session);
+        }
+        session_impl::set_transaction_memos(details);
+    }
+
     nlohmann::json ga_rust::get_fee_estimates()
     {
-        return rust_call("get_fee_estimates", nlohmann::json({}), m_session);
+        if (auto fee_estimates = m_network_state->get_fee_estimates(FEE_ESTIMATES_MAX_AGE)) {
+            // Recently fetched by this or another session on our network
+            return { { "fees", *fee_estimates } };
+        }
+        auto ret = rust_call("get_fee_estimates", nlohmann::json({}), m_session);
+        m_network_state->set_fee_estimates(ret.at("fees").get<network_state::fee_estimates_t>());
+        {
+            // The rust session derives its min fee rate from the estimates
+            std::lock_guard<std::mutex> locker(m_rust_cache_mutex);
+            m_min_fee_rate.invalidate();
+        }
+        return ret;
     }
 
     std::string ga_rust::get_system_message()
@@ -682,32 +836,65 @@ namespace green {
     }
 
     nlohmann::json ga_rust::convert_amount(const nlohmann::json& amount_json) const
+    {
+        std::optional<nlohmann::json> settings_pricing;
+        std::map<std::string, std::string> fiat_rates;
+        return convert_amount(amount_json, settings_pricing, fiat_rates);
+    }
+
+    nlohmann::json ga_rust::convert_amounts(const nlohmann::json& details) const
+    {
+        // Fetch the pricing settings and each distinct exchange rate once
+        std::optional<nlohmann::json> settings_pricing;
+        std::map<std::string, std::string> fiat_rates;
+        nlohmann::json::array_t amounts;
+        const auto& amounts_json = j_arrayref(details, "amounts");
+        amounts.reserve(amounts_json.size());
+        for (const auto& amount_json : amounts_json) {
+            amounts.emplace_back(convert_amount(amount_json, settings_pricing, fiat_rates));
+        }
+        return { { "amounts", std::move(amounts) } };
+    }
+
+    nlohmann::json ga_rust::convert_amount(const nlohmann::json& amount_json,
+        std::optional<nlohmann::json>& settings_pricing, std::map<std::string, std::string>& fiat_rates) const
     {
         nlohmann::json pricing;
 
         auto param_pricing = amount_json.value("pricing", nlohmann::json::object());
         if (param_pricing.empty()) {
-            pricing = get_settings().value("pricing", nlohmann::json({ { "currency", "" }, { "exchange", "" } }));
+            if (!settings_pricing) {
+                settings_pricing
+                    = get_settings().value("pricing", nlohmann::json({ { "currency", "" }, { "exchange", "" } }));
+            }
+            pricing = *settings_pricing;
         } else {
             pricing = param_pricing;
         }
 
         std::string currency = amount_json.value("fiat_currency", pricing["currency"]);
         std::string exchange = pricing["exchange"];
+        const std::string fallback_rate = amount_json.value("fiat_rate", "");
 
         std::string fiat_rate;
 
         if (!currency.empty() && !exchange.empty()) {
-            auto currency_query = nlohmann::json({ { "currencies", currency } });
-            currency_query["price_url"] = m_net_params.get_price_url();
-            currency_query["fallback_rate"] = amount_json.value("fiat_rate", "");
-            currency_query["exchange"] = exchange;
-
-            try {
-                auto xrates = rust_call("exchange_rates", currency_query, m_session)["currencies"];
-                fiat_rate = xrates.value(currency, "");
-            } catch (const std::exception& ex) {
-                GDK_LOG(warning) << "cannot fetch exchange rate " << ex.what();
+            const std::string key = currency + '\n' + exchange + '\n' + fallback_rate;
+            if (auto p = fiat_rates.find(key); p != fiat_rates.end()) {
+                fiat_rate = p->second;
+            } else {
+                auto currency_query = nlohmann::json({ { "currencies", currency } });
+                currency_query["price_url"] = m_net_params.get_price_url();
+                currency_query["fallback_rate"] = fallback_rate;
+                currency_query["exchange"] = exchange;
+
+                try {
+                    auto xrates = rust_call("exchange_rates", currency_query, m_session)["currencies"];
+                    fiat_rate = xrates.value(currency, "");
+                } catch (const std::exception& ex) {
+                    GDK_LOG(warning) << "cannot fetch exchange rate " << ex.what();
+                }
+                fiat_rates.emplace(key, fiat_rate);
             }
         }
 
@@ -719,14 +906,25 @@ namespace green {
         if (auto fee_rate = m_net_params.get_min_fee_rate(); fee_rate) {
             return amount(*fee_rate); // Overridden by the user for this session
         }
-        return rust_call("get_min_fee_rate", {}, m_session);
+        return get_rust_cached(m_min_fee_rate, [this] { return amount(rust_call("get_min_fee_rate", {}, m_session)); });
     }
     amount ga_rust::get_default_fee_rate() const
     {
         // TODO: Implement using a user block default setting when we have one
         return get_min_fee_rate();
     }
-    uint32_t ga_rust::get_block_height() const { return rust_call("get_block_height", {}, m_session); }
+    uint32_t ga_rust::get_block_height() const
+    {
+        if (const auto block_height = m_block_height.load(std::memory_order_acquire); block_height) {
+            return block_height;
+        }
+        const uint32_t block_height = rust_call("get_block_height", {}, m_session);
+        // Don't overwrite a newer height set from a notification meanwhile
+        uint32_t current = 0;
+        while (!m_block_height.compare_exchange_weak(current, std::max(current, block_height))) {
+        }
+        return std::max(current, block_height);
+    }
 
     bool ga_rust::is_spending_limits_decrease(const nlohmann::json& limit_details)
     {
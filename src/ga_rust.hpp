@@ -1,9 +1,14 @@
 #pragma once
 
+#include <map>
+#include <optional>
+
 #include "session_impl.hpp"
 
 namespace green {
 
+    class network_state;
+
     class ga_rust final : public session_impl {
     public:
         explicit ga_rust(network_parameters&& net_params);
@@ -23,6 +28,7 @@ namespace green {
         bool remove_account(const nlohmann::json& twofactor_data);
 
         bool discover_subaccount(uint32_t subaccount, const std::string& xpub, const std::string& sa_type);
+        std::vector<bool> discover_subaccounts(const nlohmann::json::array_t& subaccounts);
         uint32_t get_next_subaccount(const std::string& sa_type);
         uint32_t get_last_empty_subaccount(const std::string& sa_type);
         nlohmann::json create_subaccount(nlohmann::json details, uint32_t subaccount, const std::string& xpub);
@@ -100,6 +106,7 @@ namespace green {
         void set_nlocktime(const nlohmann::json& locktime_details, const nlohmann::json& twofactor_data);
 
         void set_transaction_memo(const std::string& txhash_hex, const std::string& memo);
+        void set_transaction_memos(const nlohmann::json& details);
 
         nlohmann::json get_fee_estimates();
 
@@ -108,6 +115,7 @@ namespace green {
         void ack_system_message(const std::string& message_hash_hex, const std::string& sig_der_hex);
 
         nlohmann::json convert_amount(const nlohmann::json& amount_json) const;
+        nlohmann::json convert_amounts(const nlohmann::json& details) const;
 
         void upload_confidential_addresses(uint32_t subaccount, const std::vector<std::string>& confidential_addresses);
 
@@ -126,14 +134,47 @@ namespace green {
             locker_t& locker, std::string data_b64, byte_span_t data, const std::string& hmac);
 
     private:
+        nlohmann::json convert_amount(const nlohmann::json& amount_json,
+            std::optional<nlohmann::json>& settings_pricing, std::map<std::string, std::string>& fiat_rates) const;
+
         static void GDKRUST_notif_handler(void* self_context, char* json);
         void set_notification_handler(GA_notification_handler handler, void* context);
 
         void on_post_login();
 
+        // Create a subaccount found by discovery
+        void add_discovered_subaccount(uint32_t subaccount, const std::string& xpub);
+
         nlohmann::json get_local_subaccounts_data();
 
+        // A value cached from the rust session until invalidated
+        template <typename T> struct rust_cached final {
+            void invalidate()
+            {
+                value.reset();
+                ++generation;
+            }
+            std::optional<T> value;
+            uint64_t generation = 0; // Incremented when value is invalidated
+        };
+        // Return the cached value, or fetch and cache it if not invalidated meanwhile
+        template <typename T, typename FN> T get_rust_cached(rust_cached<T>& cache, FN&& fetch) const;
+        void invalidate_subaccounts();
+        void reset_rust_cache();
+
         void* m_session;
+        const std::shared_ptr<network_state> m_network_state; // Shared by sessions on our network
+        // Values cached from the rust session, kept current from its
+        // notifications; protected by m_rust_cache_mutex
+        mutable std::mutex m_rust_cache_mutex;
+        mutable std::atomic<uint32_t> m_block_height; // 0 if not yet known. Atomic, not mutex protected
+        mutable rust_cached<nlohmann::json> m_settings;
+        mutable rust_cached<nlohmann::json> m_subaccounts;
+        mutable rust_cached<nlohmann::json> m_available_currencies;
+        mutable rust_cached<amount> m_min_fee_rate;
+        // Data for wallet scriptpubkeys, keyed by scriptpubkey hex. Wallet
+        // scripts never change, so these are only cleared when full
+        mutable std::map<std::string, nlohmann::json> m_scriptpubkey_data;
     };
 
 } // namespace green
@@ -1,5 +1,7 @@
 #include <array>
+#include <charconv>
 #include <cstdio>
+#include <deque>
 #include <fstream>
 #include <map>
 #include <string>
@@ -32,7 +34,9 @@
 #include "json_utils.hpp"
 #include "logging.hpp"
 #include "memory.hpp"
+#include "network_state.hpp"
 #include "signer.hpp"
+#include "stats.hpp"
 #include "threading.hpp"
 #include "transaction_utils.hpp"
 #include "utils.hpp"
@@ -57,6 +61,32 @@ namespace green {
 
         // Multi-call categories
         constexpr uint32_t MC_TX_CACHE = 0x1; // Call affects the tx cache
+        constexpr uint32_t MC_TX_CACHE_WRITE = 0x2; // Call is writing txs to the tx cache
+
+        // Number of header batches to keep in flight while syncing SPV headers
+        constexpr uint32_t SPV_HEADER_BATCHES = 4;
+        // How long to wait before retrying when the server has no new headers
+        constexpr auto SPV_RETRY_DELAY = 1000ms;
+
+        // Maximum number of receive addresses fetched ahead of use
+        // for each subaccount and address type
+        constexpr size_t MAX_ADDRESS_POOL_SIZE = 100;
+
+        // Cache key and format version of the session snapshot.
+        // Snapshots of any other version are ignored.
+        static const std::string SESSION_SNAPSHOT_KEY("session_snapshot");
+        constexpr uint32_t SESSION_SNAPSHOT_VERSION = 1;
+
+        static uint64_t parse_tx_cursor(const std::string& cursor)
+        {
+            uint64_t ts = 0;
+            const auto end = cursor.data() + cursor.size();
+            const auto result = std::from_chars(cursor.data(), end, ts);
+            if (result.ec != std::errc() || result.ptr != end) {
+                throw_user_error("Invalid transactions cursor");
+            }
+            return ts;
+        }
 
         // Transaction notification fields that we know about.
         // If we see a notification with fields other than these, we ignore
@@ -266,22 +296,53 @@ namespace green {
             }
             return ret;
         }
+
+        // Returns the outpoint of a UTXO or set_unspent_outputs_status item
+        static ga_session::outpoint_t get_outpoint_key(const std::string& txhash, uint32_t pt_idx)
+        {
+            return { h2b<WALLY_TXHASH_LEN>(txhash), pt_idx };
+        }
+
+        static ga_session::outpoint_t get_outpoint_key(const nlohmann::json& utxo)
+        {
+            return get_outpoint_key(j_strref(utxo, "txhash"), j_uint32ref(utxo, "pt_idx"));
+        }
     } // namespace
 
+    // Calls started in the background at login
+    struct prefetched_calls final {
+        std::map<std::string, wamp_transport::pending_call> calls; // By method name
+    };
+
+    // Receive address calls made ahead of use, in address order
+    struct address_pool final {
+        std::deque<wamp_transport::pending_call> calls;
+    };
+
+    // Receive address pools for each subaccount
+    struct address_pools final {
+        std::map<std::pair<uint32_t, std::string>, address_pool> pools; // By subaccount and address type
+    };
+
     ga_session::ga_session(network_parameters&& net_params)
         : session_impl(std::move(net_params))
         , m_spv_enabled(m_net_params.is_spv_enabled())
+        , m_session_snapshots(j_bool_or_false(gdk_config(), "session_snapshot"))
+        , m_network_state(network_state::get(m_net_params))
         , m_min_fee_rate(m_net_params.is_liquid() ? DEFAULT_MIN_FEE_LIQUID : DEFAULT_MIN_FEE)
         , m_earliest_block_time(0)
         , m_next_subaccount(0)
-        , m_fee_estimates_ts(std::chrono::system_clock::now())
         , m_system_message_id(0)
         , m_system_message_ack_id(0)
         , m_tx_last_notification(std::chrono::system_clock::now())
         , m_last_block_notification()
+        , m_block_height(0)
         , m_multi_call_category(0)
+        , m_tx_cache_readers(0)
         , m_cache(std::make_shared<cache>(m_net_params, m_net_params.network()))
         , m_user_agent(std::string(GDK_COMMIT) + " " + m_net_params.user_agent())
+        , m_prefetched_calls(std::make_unique<prefetched_calls>())
+        , m_address_pools(std::make_unique<address_pools>())
         , m_spv_thread_done(false)
         , m_spv_thread_stop(false)
     {
@@ -326,11 +387,7 @@ namespace green {
     void ga_session::emit_notification(nlohmann::json details, bool async)
     {
         if (m_notify) {
-            if (async) {
-                boost::asio::post(*m_strand, [this, details] { emit_notification(details, false); });
-            } else {
-                session_impl::emit_notification(details, false);
-            }
+            session_impl::emit_notification(std::move(details), async);
         }
     }
 
@@ -339,13 +396,16 @@ namespace green {
         GDK_RUNTIME_ASSERT(locker.owns_lock());
 
         if (!m_nlocktimes && !m_watch_only) {
-            auto nlocktime_json = wamp_cast_json(m_wamp->call(locker, "txs.upcoming_nlocktime"));
+            auto nlocktime_json = get_prefetched(locker, "txs.upcoming_nlocktime");
+            if (!nlocktime_json) {
+                nlocktime_json = wamp_cast_json(m_wamp->call(locker, "txs.upcoming_nlocktime"));
+            }
             m_nlocktimes = std::make_shared<nlocktime_t>();
-            for (auto& v : j_ref(nlocktime_json, "list")) {
+            for (auto& v : j_ref(*nlocktime_json, "list")) {
                 const auto vout = j_uint32ref(v, "output_n");
-                auto k{ j_strref(v, "txhash") + ":" + std::to_string(vout) };
-                m_nlocktimes->emplace(std::make_pair(std::move(k), std::move(v)));
+                m_nlocktimes->emplace(get_outpoint_key(j_strref(v, "txhash"), vout), std::move(v));
             }
+            save_session_snapshot(locker);
         }
 
         return m_nlocktimes;
@@ -419,7 +479,8 @@ namespace green {
 
             std::swap(m_fee_estimates, new_estimates);
         }
-        m_fee_estimates_ts = std::chrono::system_clock::now();
+        // Share with other sessions on this network
+        m_network_state->set_fee_estimates(m_fee_estimates);
     }
 
     nlohmann::json ga_session::register_user(std::shared_ptr<signer> signer)
@@ -655,6 +716,8 @@ namespace green {
         }
 
         subscribe_all(locker);
+        prefetch_post_login(locker);
+        save_session_snapshot(locker);
 
         // Notify the caller of their current block
         nlohmann::json block_json
@@ -668,6 +731,141 @@ namespace green {
         return post_login_data;
     }
 
+    void ga_session::prefetch_post_login(session_impl::locker_t& locker)
+    {
+        GDK_RUNTIME_ASSERT(locker.owns_lock());
+        m_prefetched_calls->calls.clear();
+        if (m_watch_only) {
+            return;
+        }
+        // Start fetching data that the caller commonly asks for after login
+        // but that isn't needed to complete it. The results are collected
+        // by the first call needing them, or discarded if never used.
+        auto&& prefetch = [this](const std::string& method_name, auto&&... args) {
+            try {
+                m_prefetched_calls->calls.emplace(method_name, m_wamp->async_call(method_name, args...));
+            } catch (const std::exception& e) {
+                GDK_LOG(info) << "prefetching " << method_name << " failed: " << e.what();
+            }
+        };
+        prefetch("twofactor.get_config");
+        prefetch("txs.upcoming_nlocktime");
+        if (m_system_message_id) {
+            prefetch("login.get_system_message", m_system_message_id);
+        }
+    }
+
+    namespace {
+        // Load the snapshot of the last login's state, or an empty object if none
+        static nlohmann::json load_session_snapshot(cache& c)
+        {
+            nlohmann::json snapshot = nlohmann::json::object();
+            c.get_key_value(SESSION_SNAPSHOT_KEY, { [&snapshot](const auto& db_blob) {
+                if (db_blob.has_value()) {
+                    try {
+                        auto j = nlohmann::json::from_msgpack(db_blob.value().begin(), db_blob.value().end());
+                        if (j_uint32_or_zero(j, "version") == SESSION_SNAPSHOT_VERSION) {
+                            snapshot = std::move(j);
+                        }
+                    } catch (const std::exception& e) {
+                        GDK_LOG(warning) << "Error reading session snapshot: " << e.what();
+                    }
+                }
+            } });
+            return snapshot;
+        }
+    } // namespace
+
+    void ga_session::save_session_snapshot(session_impl::locker_t& locker)
+    {
+        GDK_RUNTIME_ASSERT(locker.owns_lock());
+        if (!m_session_snapshots || m_watch_only) {
+            return;
+        }
+        // Start from the previous snapshot to keep any values not yet re-fetched
+        auto snapshot = load_session_snapshot(*m_cache);
+        const auto now = std::chrono::system_clock::now().time_since_epoch();
+        snapshot["version"] = SESSION_SNAPSHOT_VERSION;
+        snapshot["timestamp"] = std::chrono::duration_cast<std::chrono::seconds>(now).count();
+        snapshot["block_height"] = std::max(m_block_height.load(), j_uint32_or_zero(m_login_data, "block_height"));
+        snapshot["settings"] = get_settings(locker);
+        snapshot["subaccounts"] = get_subaccounts_impl(locker);
+        snapshot["fee_estimates"] = m_fee_estimates;
+        if (!m_twofactor_config.is_null()) {
+            snapshot["twofactor_config"] = m_twofactor_config;
+        }
+        if (m_nlocktimes) {
+            nlohmann::json::array_t nlocktimes;
+            nlocktimes.reserve(m_nlocktimes->size());
+            for (const auto& v : *m_nlocktimes) {
+                nlocktimes.push_back(v.second);
+            }
+            snapshot["nlocktimes"] = std::move(nlocktimes);
+        }
+        m_cache->upsert_key_value(SESSION_SNAPSHOT_KEY, nlohmann::json::to_msgpack(snapshot));
+        m_cache->save_db(); // No-op if unchanged
+    }
+
+    void ga_session::emit_session_snapshot(std::shared_ptr<signer> signer)
+    {
+        if (!m_session_snapshots || signer->is_watch_only()) {
+            return;
+        }
+        std::string network_name;
+        {
+            locker_t locker(m_mutex);
+            if (m_signer) {
+                return; // Re-login: the caller already has our current state
+            }
+            network_name = m_cache->get_network_name();
+        }
+        // The signer is not yet authenticated, so read the snapshot from a
+        // separate, read only cache: if the login then fails, no keys are
+        // left set and nothing is written. The key is the same as a full
+        // login's, which takes the cache over rather than decrypting it again.
+        nlohmann::json snapshot;
+        try {
+            const auto xpub = signer->get_bip32_xpub(signer::CLIENT_SECRET_PATH);
+            const auto public_key = xpub_hdkey(xpub).get_public_key();
+            const auto key = pbkdf2_hmac_sha512(public_key, signer::PASSWORD_SALT);
+            auto snapshot_cache = std::make_shared<cache>(m_net_params, network_name);
+            constexpr bool read_only = true;
+            if (snapshot_cache->load_db(key, signer, read_only)) {
+                snapshot = load_session_snapshot(*snapshot_cache);
+                locker_t locker(m_mutex);
+                if (!m_signer) {
+                    m_snapshot_cache = snapshot_cache_t{ signer, key, std::move(snapshot_cache) };
+                }
+            }
+        } catch (const std::exception& e) {
+            GDK_LOG(warning) << "Error loading session snapshot: " << e.what();
+        }
+        if (!snapshot.empty()) {
+            snapshot.erase("version");
+            emit_notification({ { "event", "session_snapshot" }, { "session_snapshot", std::move(snapshot) } }, false);
+        }
+    }
+
+    std::optional<nlohmann::json> ga_session::get_prefetched(
+        session_impl::locker_t& locker, const std::string& method_name)
+    {
+        GDK_RUNTIME_ASSERT(locker.owns_lock());
+        auto p = m_prefetched_calls->calls.find(method_name);
+        if (p == m_prefetched_calls->calls.end()) {
+            return {};
+        }
+        auto call = std::move(p->second);
+        m_prefetched_calls->calls.erase(p);
+        try {
+            unique_unlock unlocker(locker);
+            return wamp_cast_json(call.get());
+        } catch (const std::exception& e) {
+            // Fall back to making the call again
+            GDK_LOG(info) << "prefetched " << method_name << " failed: " << e.what();
+        }
+        return {};
+    }
+
     void ga_session::update_fiat_rate(session_impl::locker_t& locker, const std::string& rate_str)
     {
         GDK_RUNTIME_ASSERT(locker.owns_lock());
@@ -696,10 +894,13 @@ namespace green {
 
     amount ga_session::get_min_fee_rate() const
     {
-        locker_t locker(m_mutex);
         if (auto fee_rate = m_net_params.get_min_fee_rate(); fee_rate) {
             return amount(*fee_rate); // Overridden by the user for this session
         }
+        if (auto fee_estimates = get_latest_fee_estimates(); fee_estimates) {
+            return amount(fee_estimates->front());
+        }
+        locker_t locker(m_mutex);
         return amount(m_min_fee_rate);
     }
 
@@ -708,15 +909,25 @@ namespace green {
         locker_t locker(m_mutex);
         const auto block = j_uint32_or_zero(m_login_data["appearance"], "required_num_blocks");
         GDK_RUNTIME_ASSERT(block < NUM_FEE_ESTIMATES);
+        if (auto fee_estimates = get_latest_fee_estimates(); fee_estimates) {
+            return amount(fee_estimates->at(block));
+        }
         return amount(m_fee_estimates[block]);
     }
 
-    uint32_t ga_session::get_block_height() const
+    std::shared_ptr<const std::vector<uint32_t>> ga_session::get_latest_fee_estimates() const
     {
-        locker_t locker(m_mutex);
-        return m_last_block_notification["block_height"];
+        // The estimates shared on our network are at least as recent as
+        // ours, since ours are shared whenever we fetch them
+        auto fee_estimates = m_network_state->get_latest_fee_estimates();
+        if (fee_estimates && fee_estimates->size() != NUM_FEE_ESTIMATES) {
+            fee_estimates.reset();
+        }
+        return fee_estimates;
     }
 
+    uint32_t ga_session::get_block_height() const { return m_block_height.load(std::memory_order_acquire); }
+
     nlohmann::json ga_session::get_spending_limits() const
     {
         locker_t locker(m_mutex);
@@ -762,34 +973,61 @@ namespace green {
     std::unique_ptr<session_impl::locker_t> ga_session::get_multi_call_locker(
         uint32_t category_flags, bool wait_for_lock)
     {
-        std::unique_ptr<locker_t> locker{ new locker_t(m_mutex, std::defer_lock) };
-        for (;;) {
-            locker->lock();
-            if (!(m_multi_call_category & category_flags)) {
-                // No multi calls of this category are in progress.
-                // Exit the loop with the locker locked
-                break;
-            }
-            // Unlock and sleep to allow other threads to make progress
-            locker->unlock();
-            std::this_thread::sleep_for(1ms);
-            if (!wait_for_lock) {
-                // Exit the loop with the locker unlocked
-                break;
+        std::unique_ptr<locker_t> locker{ new locker_t(m_mutex) };
+        if (wait_for_lock) {
+            m_multi_call_cv.wait(*locker,
+                [this, category_flags] { return !(m_multi_call_category & category_flags) && !m_tx_cache_readers; });
+        } else {
+            // Readers finish without waiting on the network, so wait for them.
+            // Multi calls may not, so return unlocked if any are running
+            m_multi_call_cv.wait(*locker, [this] { return !m_tx_cache_readers; });
+            if (m_multi_call_category & category_flags) {
+                locker->unlock();
             }
-            // Continue around loop to try again
         }
         return locker;
     }
 
+    void ga_session::start_multi_call(locker_t& locker, uint32_t category_flags)
+    {
+        GDK_RUNTIME_ASSERT(locker.owns_lock());
+        GDK_RUNTIME_ASSERT(!(m_multi_call_category & category_flags));
+        m_multi_call_category |= category_flags;
+    }
+
+    void ga_session::end_multi_call(locker_t& locker, uint32_t category_flags)
+    {
+        GDK_RUNTIME_ASSERT(locker.owns_lock());
+        m_multi_call_category &= ~category_flags;
+        m_multi_call_cv.notify_all();
+        if (!m_multi_call_category) {
+            // Run any calls deferred until now
+            for (auto& fn : m_deferred_multi_calls) {
+                boost::asio::post(*m_strand, std::move(fn));
+            }
+            m_deferred_multi_calls.clear();
+        }
+    }
+
+    void ga_session::defer_multi_call(std::function<void()> fn)
+    {
+        locker_t locker(m_mutex);
+        if (m_multi_call_category) {
+            m_deferred_multi_calls.emplace_back(std::move(fn));
+        } else {
+            // The multi call finished since we checked: run fn now
+            boost::asio::post(*m_strand, std::move(fn));
+        }
+    }
+
     void ga_session::on_new_transaction(const std::vector<uint32_t>& subaccounts, nlohmann::json details)
     {
         auto locker_p{ get_multi_call_locker(MC_TX_CACHE, false) };
         auto& locker = *locker_p;
 
         if (!locker.owns_lock()) {
-            // Try again: 'post' this to allow the competing thread to proceed.
-            boost::asio::post(*m_strand, [this, subaccounts, details] { on_new_transaction(subaccounts, details); });
+            // Try again once the competing multi call has finished
+            defer_multi_call([this, subaccounts, details] { on_new_transaction(subaccounts, details); });
             return;
         }
 
@@ -833,6 +1071,7 @@ namespace green {
                 m_synced_subaccounts.erase(subaccount);
             }
             m_nlocktimes.reset();
+            m_prefetched_calls->calls.erase("txs.upcoming_nlocktime");
 
             const std::string value_str = details.value("value", std::string{});
             if (!value_str.empty()) {
@@ -849,9 +1088,10 @@ namespace green {
                 // TODO: figure out what type is for liquid
             }
             m_nlocktimes.reset();
+            m_prefetched_calls->calls.erase("txs.upcoming_nlocktime");
             unique_unlock unlocker(locker);
             remove_cached_utxos(subaccounts);
-            emit_notification({ { "event", "transaction" }, { "transaction", std::move(details) } }, false);
+            emit_notification({ { "event", "transaction" }, { "transaction", std::move(details) } }, true);
         });
     }
 
@@ -869,8 +1109,8 @@ namespace green {
         auto& locker = *locker_p;
 
         if (!locker.owns_lock()) {
-            // Try again: 'post' this to allow the competing thread to proceed.
-            boost::asio::post(*m_strand, [this, details, is_relogin] { on_new_block(details, is_relogin); });
+            // Try again once the competing multi call has finished
+            defer_multi_call([this, details, is_relogin] { on_new_block(details, is_relogin); });
             return;
         }
         on_new_block(locker, details, is_relogin);
@@ -955,7 +1195,16 @@ namespace green {
             }
 
             last = details;
-            m_cache->set_latest_block(last["block_height"]);
+            const uint32_t block_height = last["block_height"];
+            m_block_height.store(block_height, std::memory_order_release);
+            if (const auto shared_height = m_network_state->get_block_height(); shared_height != block_height) {
+                m_network_state->set_block_height(block_height);
+                if (shared_height) {
+                    // A new block may change fee rates: have them re-fetched
+                    m_network_state->invalidate_fee_estimates();
+                }
+            }
+            m_cache->set_latest_block(block_height);
             m_cache->save_db();
 
             // Start syncing headers for SPV (if enabled)
@@ -970,7 +1219,7 @@ namespace green {
                 // Otherwise just nuke the subaccounts that may have changed
                 remove_cached_utxos(modified_subaccounts);
             }
-            emit_notification({ { "event", "block" }, { "block", std::move(details) } }, false);
+            emit_notification({ { "event", "block" }, { "block", std::move(details) } }, true);
         });
     }
 
@@ -999,7 +1248,7 @@ namespace green {
                     { "ticker",
                         { { "exchange", std::move(fiat_source) }, { "currency", std::move(fiat_currency) },
                             { "rate", std::move(fiat_rate) } } } },
-                false);
+                true);
         } else {
             GDK_LOG(warning) << "Ignoring irrelevant ticker update";
         }
@@ -1152,30 +1401,33 @@ namespace green {
         GDK_RUNTIME_ASSERT(locker.owns_lock());
         const auto receiving_id = j_strref(m_login_data, "receiving_id");
 
-        {
-            unique_unlock unlocker(locker);
-            const bool is_initial = true;
-            m_wamp->subscribe(
-                "com.greenaddress.tickers", [this](nlohmann::json event) { on_new_tickers(event); }, is_initial);
+        // Subscribe to the topics selected by our "subscriptions" network parameter in a single round trip
+        std::vector<std::pair<std::string, wamp_transport::subscribe_fn_t>> topics;
+        if (m_net_params.is_subscribed(network_parameters::SUBSCRIBE_TICKERS)) {
+            topics.emplace_back("com.greenaddress.tickers", [this](nlohmann::json event) { on_new_tickers(event); });
         }
-
-        if (m_blobserver) {
-            session_impl::subscribe_all(locker);
-        } else {
-            unique_unlock unlocker(locker);
-            auto blob_feed = "com.greenaddress.cbs.wallet_" + receiving_id;
-            m_wamp->subscribe(blob_feed, [this](nlohmann::json event) { on_client_blob_updated(std::move(event)); });
+        if (!m_blobserver && m_net_params.is_subscribed(network_parameters::SUBSCRIBE_BLOB)) {
+            topics.emplace_back("com.greenaddress.cbs.wallet_" + receiving_id,
+                [this](nlohmann::json event) { on_client_blob_updated(std::move(event)); });
         }
-
-        unique_unlock unlocker(locker);
-        m_wamp->subscribe("com.greenaddress.txs.wallet_" + receiving_id, [this](nlohmann::json event) {
+        // Tx and block events are always subscribed to as they invalidate
+        // our tx and UTXO caches. network_parameters requires them for multisig
+        topics.emplace_back("com.greenaddress.txs.wallet_" + receiving_id, [this](nlohmann::json event) {
             if (!ignore_tx_notification(event)) {
                 std::vector<uint32_t> subaccounts = cleanup_tx_notification(event);
                 on_new_transaction(subaccounts, event);
             }
         });
+        topics.emplace_back("com.greenaddress.blocks", [this](nlohmann::json event) { on_new_block(event, false); });
+        {
+            unique_unlock unlocker(locker);
+            const bool is_initial = true;
+            m_wamp->subscribe(std::move(topics), is_initial);
+        }
 
-        m_wamp->subscribe("com.greenaddress.blocks", [this](nlohmann::json event) { on_new_block(event, false); });
+        if (m_blobserver) {
+            session_impl::subscribe_all(locker);
+        }
     }
 
     void ga_session::get_cached_local_client_blob(session_impl::locker_t& locker, const std::string& server_hmac)
@@ -1251,7 +1503,16 @@ namespace green {
         if (!signer->is_watch_only()) {
             m_blob->compute_keys(public_key);
         }
-        m_cache->load_db(m_local_encryption_key.value(), signer);
+        auto snapshot_cache = std::move(m_snapshot_cache);
+        m_snapshot_cache.reset();
+        if (snapshot_cache && snapshot_cache->login_signer == signer
+            && snapshot_cache->key == m_local_encryption_key.value()) {
+            // Use the cache already loaded to read our session snapshot
+            m_cache = std::move(snapshot_cache->db);
+            m_cache->set_writable();
+        } else {
+            m_cache->load_db(m_local_encryption_key.value(), signer);
+        }
         // Save the cache in case we carried forward data from a previous version
         m_cache->save_db(); // No-op if unchanged
         load_local_signer_xpubs(locker, signer);
@@ -1263,11 +1524,32 @@ namespace green {
         m_cache->save_db(); // No-op if unchanged
     }
 
+    nlohmann::json ga_session::get_memory_stats()
+    {
+        auto ret = session_impl::get_memory_stats();
+        locker_t locker(m_mutex);
+        auto cache = m_cache;
+        locker.unlock();
+        ret["cache"] = cache->get_memory_stats();
+        return ret;
+    }
+
+    void ga_session::trim_memory()
+    {
+        session_impl::trim_memory();
+        locker_t locker(m_mutex);
+        auto cache = m_cache;
+        locker.unlock();
+        cache->release_memory();
+    }
+
     void ga_session::reset_cached_session_data(session_impl::locker_t& locker)
     {
         GDK_RUNTIME_ASSERT(locker.owns_lock());
         swap_with_default(m_tx_notifications);
         m_nlocktimes.reset();
+        m_prefetched_calls->calls.erase("txs.upcoming_nlocktime");
+        m_address_pools->pools.clear(); // Pooled calls may be from a previous connection
     }
 
     void ga_session::reset_all_session_data(bool in_dtor)
@@ -1278,15 +1560,17 @@ namespace green {
             remove_cached_utxos(std::vector<uint32_t>());
             swap_with_default(m_login_data);
             m_local_encryption_key.reset();
+            m_snapshot_cache.reset();
             m_blob->reset();
             swap_with_default(m_limits_data);
             swap_with_default(m_twofactor_config);
+            m_prefetched_calls->calls.clear();
+            m_address_pools->pools.clear();
             swap_with_default(m_subaccounts);
             m_green_pubkeys.reset();
             m_user_pubkeys->clear();
             m_recovery_pubkeys.reset();
             const auto now = std::chrono::system_clock::now();
-            m_fee_estimates_ts = now;
             swap_with_default(m_tx_notifications);
             m_tx_last_notification = now;
             m_nlocktimes.reset();
@@ -1541,18 +1825,20 @@ namespace green {
 
     nlohmann::json ga_session::get_fee_estimates()
     {
-        const auto now = std::chrono::system_clock::now();
+        // TODO: augment with last_updated, user preference for display?
+        if (auto fee_estimates = m_network_state->get_fee_estimates(FEE_ESTIMATES_MAX_AGE)) {
+            // Recently fetched by this or another session on our network
+            return { { "fees", *fee_estimates } };
+        }
 
         locker_t locker(m_mutex);
-
-        if (now < m_fee_estimates_ts || now - m_fee_estimates_ts > 120s) {
-            // Time adjusted or more than 2 minutes old: Update
-            constexpr bool return_min = true;
-            auto fee_estimates = m_wamp->call(locker, "login.get_fee_estimates", return_min);
-            set_fee_estimates(locker, wamp_cast_json(fee_estimates));
+        if (auto fee_estimates = m_network_state->get_fee_estimates(FEE_ESTIMATES_MAX_AGE)) {
+            // Fetched while we waited for the lock
+            return { { "fees", *fee_estimates } };
         }
-
-        // TODO: augment with last_updated, user preference for display?
+        constexpr bool return_min = true;
+        auto fee_estimates = m_wamp->call(locker, "login.get_fee_estimates", return_min);
+        set_fee_estimates(locker, wamp_cast_json(fee_estimates));
         return { { "fees", m_fee_estimates } };
     }
 
@@ -1570,7 +1856,10 @@ namespace green {
 
         // Get the next message to ack
         const auto system_message_id = m_system_message_id;
-        nlohmann::json details = wamp_cast_json(m_wamp->call(locker, "login.get_system_message", system_message_id));
+        auto prefetched = get_prefetched(locker, "login.get_system_message");
+        nlohmann::json details = prefetched
+            ? std::move(*prefetched)
+            : wamp_cast_json(m_wamp->call(locker, "login.get_system_message", system_message_id));
 
         // Note the inconsistency with login_data key "next_system_message_id":
         // We don't rename the key as we don't expose the details JSON to callers
@@ -1613,6 +1902,18 @@ namespace green {
         return convert_amount(locker, amount_json);
     }
 
+    nlohmann::json ga_session::convert_amounts(const nlohmann::json& details) const
+    {
+        nlohmann::json::array_t amounts;
+        const auto& amounts_json = j_arrayref(details, "amounts");
+        amounts.reserve(amounts_json.size());
+        locker_t locker(m_mutex);
+        for (const auto& amount_json : amounts_json) {
+            amounts.emplace_back(convert_amount(locker, amount_json));
+        }
+        return { { "amounts", std::move(amounts) } };
+    }
+
     nlohmann::json ga_session::convert_amount(locker_t& locker, const nlohmann::json& amount_json) const
     {
         GDK_RUNTIME_ASSERT(locker.owns_lock());
@@ -1888,23 +2189,10 @@ namespace green {
         utxo.erase("surj_proof");
     }
 
-    bool ga_session::unblind_utxo(session_impl::locker_t& locker, nlohmann::json& utxo, const std::string& for_txhash,
-        unique_pubkeys_and_scripts_t& missing)
+    // Return the txhash (which may be empty) and vout to unblind utxo as
+    static std::pair<std::string, uint32_t> get_unblind_outpoint(
+        const nlohmann::json& utxo, const std::string& for_txhash)
     {
-        GDK_RUNTIME_ASSERT(locker.owns_lock());
-        amount::value_type value;
-
-        if (boost::conversion::try_lexical_convert(j_str_or_empty(utxo, "value"), value)) {
-            utxo["satoshi"] = value;
-            utxo["assetblinder"] = ZEROS;
-            utxo["amountblinder"] = ZEROS;
-            const auto asset_tag = j_bytesref(utxo, "asset_tag");
-            GDK_RUNTIME_ASSERT(asset_tag.at(0) == 0x1);
-            utxo["asset_id"] = b2h_rev(gsl::make_span(asset_tag).subspan(1));
-            utxo["is_blinded"] = false;
-            return false; // Cache not updated
-        }
-
         // 1) get_unspent_outputs UTXOs have txhash/pt_idx and implicitly
         // is_output is true but it is not present.
         // 2) get_transaction tx outputs have for_txhash(passed in)/pt_idx
@@ -1922,14 +2210,59 @@ namespace green {
         } else if (utxo.value("is_output", true)) {
             txhash = for_txhash;
         }
+        return { std::move(txhash), pt_idx };
+    }
+
+    // A confidential output whose nonce is known, pending unblinding
+    struct ga_session::pending_unblind final {
+        nlohmann::json* utxo;
+        std::string txhash;
+        uint32_t pt_idx;
+        bool has_address;
+        std::vector<unsigned char> script;
+        std::vector<unsigned char> nonce;
+        std::vector<unsigned char> rangeproof;
+        std::vector<unsigned char> commitment;
+        std::vector<unsigned char> nonce_commitment;
+        std::vector<unsigned char> asset_tag;
+        std::optional<unblind_t> unblinded;
+    };
+
+    // Unblinded outputs found in the cache, looked up together
+    struct ga_session::cached_liquid_outputs final {
+        cache::liquid_outputs_t outputs;
+    };
+
+    bool ga_session::unblind_utxo(session_impl::locker_t& locker, nlohmann::json& utxo, const std::string& for_txhash,
+        const cached_liquid_outputs& cached, unique_pubkeys_and_scripts_t& missing,
+        std::vector<pending_unblind>& pending)
+    {
+        GDK_RUNTIME_ASSERT(locker.owns_lock());
+        amount::value_type value;
+
+        if (boost::conversion::try_lexical_convert(j_str_or_empty(utxo, "value"), value)) {
+            utxo["satoshi"] = value;
+            utxo["assetblinder"] = ZEROS;
+            utxo["amountblinder"] = ZEROS;
+            const auto asset_tag = j_bytesref(utxo, "asset_tag");
+            GDK_RUNTIME_ASSERT(asset_tag.at(0) == 0x1);
+            utxo["asset_id"] = b2h_rev(gsl::make_span(asset_tag).subspan(1));
+            utxo["is_blinded"] = false;
+            return false; // Cache not updated
+        }
 
-        const auto script = j_bytesref(utxo, "script");
+        auto [txhash, pt_idx] = get_unblind_outpoint(utxo, for_txhash);
+        auto script = j_bytesref(utxo, "script");
         const bool has_address = !j_str_is_empty(utxo, "address");
 
         if (!txhash.empty()) {
-            const auto cached = m_cache->get_liquid_output(h2b(txhash), pt_idx);
-            if (!cached.empty()) {
-                utxo.update(cached.begin(), cached.end());
+            const auto p = cached.outputs.find({ h2b<SHA256_LEN>(txhash), pt_idx });
+            if (p != cached.outputs.end()) {
+                const auto& output = p->second;
+                utxo["asset_id"] = b2h_rev(output.asset_id);
+                utxo["satoshi"] = output.satoshi;
+                utxo["assetblinder"] = b2h_rev(output.assetblinder);
+                utxo["amountblinder"] = b2h_rev(output.amountblinder);
                 constexpr bool mark_unconfidential = true;
                 remove_utxo_proofs(utxo, mark_unconfidential);
                 if (has_address) {
@@ -1942,10 +2275,8 @@ namespace green {
                 return false; // Cache not updated
             }
         }
-        const auto rangeproof = j_bytesref(utxo, "range_proof");
-        const auto commitment = j_bytesref(utxo, "commitment");
-        const auto nonce_commitment = j_bytesref(utxo, "nonce_commitment");
-        const auto asset_tag = j_bytesref(utxo, "asset_tag");
+        auto nonce_commitment = j_bytesref(utxo, "nonce_commitment");
+        auto asset_tag = j_bytesref(utxo, "asset_tag");
 
         GDK_RUNTIME_ASSERT(asset_tag[0] == 0xa || asset_tag[0] == 0xb);
 
@@ -1956,48 +2287,79 @@ namespace green {
             return false; // Cache not updated
         }
 
-        // Make sure we can unblind the asset/amount details
-        unblind_t unblinded;
-        try {
-            unblinded = asset_unblind_with_nonce(nonce, rangeproof, commitment, script, asset_tag);
-        } catch (const std::exception&) {
-            nonce = get_alternate_blinding_nonce(locker, utxo, nonce_commitment);
-            if (!nonce.empty()) {
-                // Try the alternate nonce
-                try {
-                    unblinded = asset_unblind_with_nonce(nonce, rangeproof, commitment, script, asset_tag);
-                } catch (const std::exception&) {
-                    nonce.clear();
-                }
-            }
-            if (nonce.empty()) {
-                utxo["error"] = "failed to unblind utxo";
-                return false; // Cache not updated
-            }
+        // Defer the expensive unblinding until all pending outputs are
+        // collected, so they can be unblinded in parallel
+        pending.push_back({ &utxo, std::move(txhash), pt_idx, has_address, std::move(script), std::move(nonce),
+            j_bytesref(utxo, "range_proof"), j_bytesref(utxo, "commitment"), std::move(nonce_commitment),
+            std::move(asset_tag), std::nullopt });
+        return false; // Cache not updated yet
+    }
+
+    bool ga_session::unblind_pending_utxos(session_impl::locker_t& locker, std::vector<pending_unblind>& pending)
+    {
+        GDK_RUNTIME_ASSERT(locker.owns_lock());
+        if (pending.empty()) {
+            return false; // Cache not updated
         }
+        stats::timer timer("tx", "unblind_utxos");
 
-        // Unblind the asset/amount details
-        utxo["satoshi"] = std::get<3>(unblinded);
-        // Return in display order
-        utxo["assetblinder"] = b2h_rev(std::get<2>(unblinded));
-        utxo["amountblinder"] = b2h_rev(std::get<1>(unblinded));
-        utxo["asset_id"] = b2h_rev(std::get<0>(unblinded));
-        constexpr bool mark_unconfidential = true;
-        remove_utxo_proofs(utxo, mark_unconfidential);
+        auto&& unblind_fn = [](pending_unblind& p) {
+            try {
+                p.unblinded = asset_unblind_with_nonce(p.nonce, p.rangeproof, p.commitment, p.script, p.asset_tag);
+            } catch (const std::exception&) {
+                // Retried with the alternate nonce below, if available
+            }
+        };
+        // Rangeproof rewinding is CPU bound and touches no session state,
+        // so run it across cores without holding the session lock.
+        constexpr size_t min_unblinds_per_thread = 2;
+        {
+            unique_unlock unlocker(locker);
+            parallel_for(
+                pending.size(), [&pending, &unblind_fn](size_t i) { unblind_fn(pending[i]); }, min_unblinds_per_thread);
+        }
 
         bool updated_blinding_cache = false;
-        if (!txhash.empty()) {
-            m_cache->insert_liquid_output(h2b(txhash), pt_idx, utxo);
-            updated_blinding_cache = true;
-        }
+        // Note the batch must not be held while the session lock is released
+        cache::write_batch batch(*m_cache);
+        for (auto& p : pending) {
+            auto& utxo = *p.utxo;
+            if (!p.unblinded) {
+                p.nonce = get_alternate_blinding_nonce(locker, utxo, p.nonce_commitment);
+                if (!p.nonce.empty()) {
+                    // Try the alternate nonce
+                    unblind_fn(p);
+                }
+                if (!p.unblinded) {
+                    utxo["error"] = "failed to unblind utxo";
+                    continue; // Cache not updated
+                }
+            }
+            const auto& unblinded = *p.unblinded;
 
-        if (has_address) {
-            // We should now be able to make the address confidential
-            const auto blinding_pubkey = m_cache->get_liquid_blinding_pubkey(script);
-            GDK_RUNTIME_ASSERT(!blinding_pubkey.empty());
-            confidentialize_address(m_net_params, utxo, b2h(blinding_pubkey));
-        }
+            // Unblind the asset/amount details
+            utxo["satoshi"] = std::get<3>(unblinded);
+            // Return in display order
+            utxo["assetblinder"] = b2h_rev(std::get<2>(unblinded));
+            utxo["amountblinder"] = b2h_rev(std::get<1>(unblinded));
+            utxo["asset_id"] = b2h_rev(std::get<0>(unblinded));
+            constexpr bool mark_unconfidential = true;
+            remove_utxo_proofs(utxo, mark_unconfidential);
+            utxo.erase("value"); // Processed; remove the server value
 
+            if (!p.txhash.empty()) {
+                m_cache->insert_liquid_output(h2b(p.txhash), p.pt_idx, utxo);
+                updated_blinding_cache = true;
+            }
+
+            if (p.has_address) {
+                // We should now be able to make the address confidential
+                const auto blinding_pubkey = m_cache->get_liquid_blinding_pubkey(p.script);
+                GDK_RUNTIME_ASSERT(!blinding_pubkey.empty());
+                confidentialize_address(m_net_params, utxo, b2h(blinding_pubkey));
+            }
+        }
+        pending.clear();
         return updated_blinding_cache;
     }
 
@@ -2027,20 +2389,49 @@ namespace green {
 
     bool ga_session::cleanup_utxos(session_impl::locker_t& locker, nlohmann::json& utxos, const std::string& for_txhash,
         unique_pubkeys_and_scripts_t& missing)
+    {
+        std::vector<pending_unblind> pending;
+        const bool updated_blinding_cache = cleanup_utxos(locker, utxos, for_txhash, missing, pending);
+        return unblind_pending_utxos(locker, pending) || updated_blinding_cache;
+    }
+
+    bool ga_session::cleanup_utxos(session_impl::locker_t& locker, nlohmann::json& utxos, const std::string& for_txhash,
+        unique_pubkeys_and_scripts_t& missing, std::vector<pending_unblind>& pending)
     {
         GDK_RUNTIME_ASSERT(locker.owns_lock());
         const bool is_liquid = m_net_params.is_liquid();
         bool updated_blinding_cache = false;
 
+        cached_liquid_outputs cached;
+        if (is_liquid) {
+            // Look up the cached unblinded data of every UTXO at once
+            std::vector<cache::outpoint_t> outpoints;
+            for (const auto& utxo : utxos) {
+                if (utxo.contains("address_type") && j_str_or_empty(utxo, "error") != "missing blinding nonce") {
+                    continue; // Already processed
+                }
+                if (!utxo.contains("pt_idx") || !j_bool(utxo, "is_relevant").value_or(true)) {
+                    continue; // Not unblinded
+                }
+                if (const auto [txhash, pt_idx] = get_unblind_outpoint(utxo, for_txhash); !txhash.empty()) {
+                    outpoints.emplace_back(h2b<SHA256_LEN>(txhash), pt_idx);
+                }
+            }
+            cached.outputs = m_cache->get_liquid_outputs(outpoints);
+        }
+
         // Standardise key names and data types of server provided UTXOs.
         // For Liquid, unblind it if possible. If not, record the pubkey
         // and script needed to generate its blinding nonce in 'missing'.
+        // Confidential UTXOs whose nonces we have are added to 'pending'
+        // for the caller to unblind with unblind_pending_utxos().
         for (auto& utxo : utxos) {
             auto address_type_p = utxo.find("address_type");
             if (is_liquid && utxo.value("error", std::string()) == "missing blinding nonce") {
                 // UTXO was previously processed but could not be unblinded: try again
-                updated_blinding_cache |= unblind_utxo(locker, utxo, for_txhash, missing);
-                if (!utxo.contains("error")) {
+                const size_t num_pending = pending.size();
+                updated_blinding_cache |= unblind_utxo(locker, utxo, for_txhash, cached, missing, pending);
+                if (!utxo.contains("error") && pending.size() == num_pending) {
                     utxo.erase("value"); // Only remove value if we unblinded it
                 }
             } else if (address_type_p == utxo.end()) {
@@ -2049,9 +2440,10 @@ namespace green {
 
                 // Address type is non-blank for spendable UTXOs
                 auto addr_type = address_type_from_script_type(j_uint32ref(utxo, "script_type"));
+                const size_t num_pending = pending.size();
                 if (is_liquid) {
                     if (j_bool(utxo, "is_relevant").value_or(true)) {
-                        updated_blinding_cache |= unblind_utxo(locker, utxo, for_txhash, missing);
+                        updated_blinding_cache |= unblind_utxo(locker, utxo, for_txhash, cached, missing, pending);
                     } else {
                         constexpr bool mark_unconfidential = false;
                         remove_utxo_proofs(utxo, mark_unconfidential);
@@ -2063,7 +2455,7 @@ namespace green {
                     GDK_RUNTIME_ASSERT(try_lexical_convert(j_str_or_empty(utxo, "value"), value));
                     utxo["satoshi"] = value;
                 }
-                if (!utxo.contains("error")) {
+                if (!utxo.contains("error") && pending.size() == num_pending) {
                     utxo.erase("value"); // Only remove value if we unblinded it
                 }
                 json_add_if_missing(utxo, "subtype", 0u);
@@ -2077,52 +2469,93 @@ namespace green {
     }
 
     nlohmann::json ga_session::sync_transactions(uint32_t subaccount, unique_pubkeys_and_scripts_t& missing)
+    {
+        auto pages = sync_transactions(std::vector<uint32_t>{ subaccount }, missing, {});
+        return std::move(pages[std::to_string(subaccount)]);
+    }
+
+    nlohmann::json ga_session::sync_transactions(const std::vector<uint32_t>& subaccounts,
+        unique_pubkeys_and_scripts_t& missing, const std::map<uint32_t, uint64_t>& sync_from)
     {
         auto locker_p{ get_multi_call_locker(MC_TX_CACHE, true) };
         auto& locker = *locker_p;
 
         // Mark for other threads that a tx cache affecting call is running
-        m_multi_call_category |= MC_TX_CACHE;
-        const auto cleanup = gsl::finally([this]() { m_multi_call_category &= ~MC_TX_CACHE; });
+        start_multi_call(locker, MC_TX_CACHE);
+        const auto cleanup = gsl::finally([this, &locker]() { end_multi_call(locker, MC_TX_CACHE); });
 
-        const auto timestamp = m_cache->get_latest_transaction_timestamp(subaccount);
-        GDK_LOG(debug) << "Tx sync(" << subaccount << "): latest timestamp = " << timestamp;
-
-        if (m_synced_subaccounts.count(subaccount)) {
-            // We know our cache is up to date, avoid going to the server
-            GDK_LOG(debug) << "Tx sync(" << subaccount << "): already synced";
-            return { { "list", nlohmann::json::array() }, { "more", false }, { "sync_ts", timestamp } };
+        struct page_request final {
+            uint32_t subaccount;
+            uint64_t timestamp;
+            std::optional<wamp_transport::pending_call> call;
+        };
+        std::vector<page_request> requests;
+        nlohmann::json pages = nlohmann::json::object();
+        for (const auto subaccount : subaccounts) {
+            const auto from_p = sync_from.find(subaccount);
+            const bool read_ahead = from_p != sync_from.end();
+            const auto timestamp
+                = read_ahead ? from_p->second : m_cache->get_latest_transaction_timestamp(subaccount);
+            GDK_LOG(debug) << "Tx sync(" << subaccount << "): latest timestamp = " << timestamp;
+
+            if (!read_ahead && m_synced_subaccounts.count(subaccount)) {
+                // We know our cache is up to date, avoid going to the server
+                GDK_LOG(debug) << "Tx sync(" << subaccount << "): already synced";
+                pages[std::to_string(subaccount)]
+                    = { { "list", nlohmann::json::array() }, { "more", false }, { "sync_ts", timestamp } };
+            } else {
+                requests.push_back({ subaccount, timestamp, std::nullopt });
+            }
+        }
+        if (requests.empty()) {
+            return pages;
         }
 
-        // Get a page of txs from the server if any are newer than our last cached one
-        auto result = m_wamp->call(locker, "txs.get_list_v3", subaccount, timestamp);
-        nlohmann::json ret = wamp_cast_json(result);
-        GDK_LOG(debug) << "Tx sync(" << subaccount << "): server returned " << ret["list"].size()
-                       << " txs, more = " << ret["more"];
+        // Get a page of txs from the server for each subaccount if any are
+        // newer than our last cached one. The pages are fetched concurrently.
+        {
+            unique_unlock unlocker(locker);
+            for (auto& request : requests) {
+                request.call = m_wamp->async_call("txs.get_list_v3", request.subaccount, request.timestamp);
+            }
+            for (auto& request : requests) {
+                pages[std::to_string(request.subaccount)] = wamp_cast_json(request.call->get());
+            }
+        }
 
-        auto& txs = ret["list"];
+        std::vector<pending_unblind> pending;
         // TODO: Return rejected txs to the caller
         auto&& filter = [](const auto& tx) -> bool { return tx.contains("rejected") || tx.contains("replaced"); };
-        txs.erase(std::remove_if(txs.begin(), txs.end(), filter), txs.end());
+        for (const auto& request : requests) {
+            const auto subaccount = request.subaccount;
+            auto& ret = pages[std::to_string(subaccount)];
+            GDK_LOG(debug) << "Tx sync(" << subaccount << "): server returned " << ret["list"].size()
+                           << " txs, more = " << ret["more"];
 
-        for (auto& tx : txs) {
-            // Compute tx vsize from weight
-            const auto vsize = Tx::vsize_from_weight(j_uint32ref(tx, "weight"));
-            j_rename(tx, "weight", "transaction_weight");
-            tx["transaction_vsize"] = vsize;
+            auto& txs = ret["list"];
+            txs.erase(std::remove_if(txs.begin(), txs.end(), filter), txs.end());
 
-            // fee_rate is in satoshi/kb, with the best integer accuracy we have
-            tx["fee_rate"] = j_amountref(tx, "fee").value() * 1000 / vsize;
+            for (auto& tx : txs) {
+                // Compute tx vsize from weight
+                const auto vsize = Tx::vsize_from_weight(j_uint32ref(tx, "weight"));
+                j_rename(tx, "weight", "transaction_weight");
+                tx["transaction_vsize"] = vsize;
 
-            // Clean up and categorize the endpoints. For liquid, this populates
-            // 'missing' if any UTXOs require blinding nonces from the signer to unblind.
-            cleanup_utxos(locker, j_ref(tx, "eps"), j_strref(tx, "txhash"), missing);
-        }
+                // fee_rate is in satoshi/kb, with the best integer accuracy we have
+                tx["fee_rate"] = j_amountref(tx, "fee").value() * 1000 / vsize;
 
-        // Store the timestamp that we started fetching from in order to detect
-        // whether the cache was invalidated when we save it.
-        ret["sync_ts"] = timestamp;
-        return ret;
+                // Clean up and categorize the endpoints. For liquid, this populates
+                // 'missing' if any UTXOs require blinding nonces from the signer to unblind.
+                cleanup_utxos(locker, j_ref(tx, "eps"), j_strref(tx, "txhash"), missing, pending);
+            }
+
+            // Store the timestamp that we started fetching from in order to detect
+            // whether the cache was invalidated when we save it.
+            ret["sync_ts"] = request.timestamp;
+        }
+        // Unblind the confidential endpoints of all pages together
+        unblind_pending_utxos(locker, pending);
+        return pages;
     }
 
     void ga_session::store_transactions(uint32_t subaccount, nlohmann::json& txs)
@@ -2133,9 +2566,11 @@ namespace green {
         auto locker_p{ get_multi_call_locker(MC_TX_CACHE, true) };
         auto& locker = *locker_p;
 
-        // Mark for other threads that a tx cache affecting call is running
-        m_multi_call_category |= MC_TX_CACHE;
-        const auto cleanup = gsl::finally([this]() { m_multi_call_category &= ~MC_TX_CACHE; });
+        // Mark for other threads that a tx cache writing call is running.
+        // Unlike syncing, this also makes tx cache readers wait
+        constexpr uint32_t categories = MC_TX_CACHE | MC_TX_CACHE_WRITE;
+        start_multi_call(locker, categories);
+        const auto cleanup = gsl::finally([this, &locker]() { end_multi_call(locker, categories); });
 
         const auto timestamp = m_cache->get_latest_transaction_timestamp(subaccount);
         const bool sync_disrupted = txs["sync_ts"] != timestamp;
@@ -2154,6 +2589,19 @@ namespace green {
             }
         }
 
+        if (is_liquid) {
+            // Unblind, clean up and categorize the endpoints of all txs together
+            std::vector<pending_unblind> pending;
+            for (auto& tx_details : txs["list"]) {
+                cleanup_utxos(locker, tx_details["eps"], j_strref(tx_details, "txhash"), missing, pending);
+            }
+            unblind_pending_utxos(locker, pending);
+        }
+
+        // Insert the page of txs in a single DB transaction
+        std::optional<cache::write_batch> batch;
+        batch.emplace(*m_cache);
+
         for (auto& tx_details : txs["list"]) {
             const std::string txhash = tx_details["txhash"];
             const uint32_t tx_block_height = tx_details["block_height"];
@@ -2162,11 +2610,6 @@ namespace green {
             std::map<uint32_t, nlohmann::json> in_map, out_map;
             std::set<std::string> unique_asset_ids;
 
-            if (is_liquid) {
-                // Ublind, clean up and categorize the endpoints
-                cleanup_utxos(locker, tx_details["eps"], txhash, missing);
-            }
-
             for (auto& ep : tx_details["eps"]) {
                 const bool is_tx_output = ep.at("is_output");
                 const bool is_relevant = ep.at("is_relevant");
@@ -2287,6 +2730,7 @@ namespace green {
             // We have synced all available transactions, mark the subaccount up to date
             m_synced_subaccounts.insert(subaccount);
         }
+        batch.reset(); // Commit the inserted txs
         // Save the cache to store any updated cached data
         m_cache->save_db(); // No-op if unchanged
     }
@@ -2362,29 +2806,146 @@ namespace green {
         const uint32_t subaccount = details.at("subaccount");
         const uint32_t first = details.at("first");
         const uint32_t count = details.at("count");
-        nlohmann::json::array_t result;
-        result.reserve(std::min(count, 1000u)); // Prevent reallocs for reasonable fetches
-        locker_t locker(m_mutex);
-        const auto timestamp = m_cache->get_latest_transaction_timestamp(subaccount);
-        const bool sync_disrupted = details["sync_ts"] != timestamp;
-        if (sync_disrupted) {
-            GDK_LOG(debug) << "Tx sync(" << subaccount << ") disrupted before fetch: " << details["sync_ts"]
-                           << " != " << timestamp;
-            // Note we don't need to update m_synced_subaccounts here as
-            // the caller will re-iterate to sync
-            return nlohmann::json(false);
-        }
-
-        m_cache->get_transactions(subaccount, first, count,
-            { [&result](uint64_t /*ts*/, const std::string& /*txhash*/, uint32_t /*block*/, uint32_t /*spent*/,
-                  uint32_t spv_status, nlohmann::json& tx_json) {
-                // TODO: Remove transaction_size.erase when cache version
-                // is upgraded beyond 1.3 and clears transactions.
-                tx_json.erase("transaction_size");
-                tx_json["spv_verified"] = spv_get_status_string(spv_status);
-                result.emplace_back(std::move(tx_json));
-            } });
+        std::optional<uint64_t> before_ts;
+        if (const auto cursor = j_str_or_empty(details, "cursor"); !cursor.empty()) {
+            // The cursor is the timestamp of the last tx of the previous page
+            before_ts = parse_tx_cursor(cursor);
+        }
+        std::shared_ptr<cache> session_cache;
+        {
+            locker_t locker(m_mutex);
+            start_tx_cache_read(locker);
+            // Keep the cache alive for the unlocked read below, since
+            // reset_all_session_data replaces m_cache under the lock
+            session_cache = m_cache;
+            const auto timestamp = session_cache->get_latest_transaction_timestamp(subaccount);
+            const bool sync_disrupted = details["sync_ts"] != timestamp;
+            if (sync_disrupted) {
+                GDK_LOG(debug) << "Tx sync(" << subaccount << ") disrupted before fetch: " << details["sync_ts"]
+                               << " != " << timestamp;
+                // Note we don't need to update m_synced_subaccounts here as
+                // the caller will re-iterate to sync
+                end_tx_cache_read(locker);
+                return nlohmann::json(false);
+            }
+        }
+        const auto end_read = gsl::finally([this] {
+            locker_t locker(m_mutex);
+            end_tx_cache_read(locker);
+        });
+
+        // Copy the encoded txs out of the cache, then decode them without
+        // holding any lock. The cache serializes its own statements.
+        std::vector<std::pair<uint32_t, std::vector<unsigned char>>> encoded;
+        encoded.reserve(std::min(count, 1000u)); // Prevent reallocs for reasonable fetches
+        const cache::get_transactions_fn fn
+            = [&encoded](uint64_t /*ts*/, const std::string& /*txhash*/, uint32_t /*block*/, uint32_t /*spent*/,
+                  uint32_t spv_status, byte_span_t tx_data) {
+                  encoded.emplace_back(spv_status, std::vector<unsigned char>(tx_data.begin(), tx_data.end()));
+              };
+        if (before_ts) {
+            session_cache->get_transactions_before(subaccount, *before_ts, first, count, fn);
+        } else {
+            session_cache->get_transactions(subaccount, first, count, fn);
+        }
+
+        return decode_transactions(encoded);
+    }
+
+    nlohmann::json ga_session::search_transactions(const nlohmann::json& details)
+    {
+        const uint32_t subaccount = j_uint32ref(details, "subaccount");
+        cache::tx_query query;
+        query.address = j_str_or_empty(details, "address");
+        query.asset_id = j_str_or_empty(details, "asset_id");
+        for (auto [key, value] : { std::make_pair("min_satoshi", &query.min_satoshi),
+                 std::make_pair("max_satoshi", &query.max_satoshi) }) {
+            if (const auto p = details.find(key); p != details.end()) {
+                *value = p->get<uint64_t>();
+            }
+        }
+        query.count = j_uint32(details, "count").value_or(30);
+        if (const auto cursor = j_str_or_empty(details, "cursor"); !cursor.empty()) {
+            query.before_ts = parse_tx_cursor(cursor);
+        }
+        const auto memo = j_str_or_empty(details, "memo");
+        nlohmann::json::array_t empty_result;
+
+        std::shared_ptr<cache> session_cache;
+        {
+            locker_t locker(m_mutex);
+            if (!memo.empty()) {
+                // Memos are held in the client blob rather than the cache:
+                // match them here and restrict the search to their txs
+                sync_client_blob(locker);
+                query.txhashes.emplace();
+                for (const auto& item : m_blob->get_tx_memos().items()) {
+                    const auto& tx_memo = item.value().get_ref<const std::string&>();
+                    if (boost::algorithm::icontains(tx_memo, memo)) {
+                        query.txhashes->insert(item.key());
+                    }
+                }
+                if (query.txhashes->empty()) {
+                    return { { "transactions", std::move(empty_result) }, { "next_cursor", std::string() } };
+                }
+            }
+            start_tx_cache_read(locker);
+            // Keep the cache alive for the unlocked read below, since
+            // reset_all_session_data replaces m_cache under the lock
+            session_cache = m_cache;
+        }
+        nlohmann::json txs;
+        {
+            const auto end_read = gsl::finally([this] {
+                locker_t locker(m_mutex);
+                end_tx_cache_read(locker);
+            });
+            std::vector<std::pair<uint32_t, std::vector<unsigned char>>> encoded;
+            session_cache->search_transactions(subaccount, query,
+                { [&encoded](uint64_t /*ts*/, const std::string& /*txhash*/, uint32_t /*block*/, uint32_t /*spent*/,
+                      uint32_t spv_status, byte_span_t tx_data) {
+                    encoded.emplace_back(spv_status, std::vector<unsigned char>(tx_data.begin(), tx_data.end()));
+                } });
+            txs = decode_transactions(encoded);
+        }
+        postprocess_transactions(txs);
+
+        std::string next_cursor;
+        if (!txs.empty() && txs.size() == query.count) {
+            next_cursor = std::to_string(txs.back().at("created_at_ts").get<uint64_t>());
+        }
+        return { { "transactions", std::move(txs) }, { "next_cursor", std::move(next_cursor) } };
+    }
 
+    void ga_session::start_tx_cache_read(locker_t& locker)
+    {
+        GDK_RUNTIME_ASSERT(locker.owns_lock());
+        // Wait for tx cache writers, then read alongside other readers.
+        // Syncs in flight are not waited for, since they only write the
+        // fetched txs later, from store_transactions
+        m_multi_call_cv.wait(locker, [this] { return !(m_multi_call_category & MC_TX_CACHE_WRITE); });
+        ++m_tx_cache_readers;
+    }
+
+    void ga_session::end_tx_cache_read(locker_t& locker)
+    {
+        GDK_RUNTIME_ASSERT(locker.owns_lock());
+        if (!--m_tx_cache_readers) {
+            m_multi_call_cv.notify_all();
+        }
+    }
+
+    nlohmann::json ga_session::decode_transactions(
+        const std::vector<std::pair<uint32_t, std::vector<unsigned char>>>& encoded)
+    {
+        // Decoding is done without holding any lock
+        nlohmann::json::array_t result;
+        result.reserve(encoded.size());
+        for (const auto& tx : encoded) {
+            auto tx_json = cache::decode_transaction(tx.second);
+            tx_json["spv_verified"] = spv_get_status_string(tx.first);
+            result.emplace_back(std::move(tx_json));
+        }
         return nlohmann::json(std::move(result));
     }
 
@@ -2407,39 +2968,96 @@ namespace green {
         return m_cache->insert_liquid_blinding_data(pubkey, script, nonce, blinding_pubkey);
     }
 
-    void ga_session::encache_new_scriptpubkeys(uint32_t subaccount)
+    void ga_session::encache_new_scriptpubkeys(const std::vector<uint32_t>& subaccounts)
     {
-        uint32_t current_last_pointer = 0;
-        uint32_t final_last_pointer = 1;
-        auto details = nlohmann::json({ { "subaccount", subaccount } });
+        // Multisig address types and csv values are assigned per pointer by
+        // the server, so we must still list the addresses. Pages are fetched
+        // for all subaccounts concurrently, with each subaccounts next page
+        // requested before its current page is verified and cached.
+        struct subaccount_sync final {
+            uint32_t subaccount;
+            uint32_t final_last_pointer;
+            std::optional<wamp_transport::pending_call> page;
+        };
+        std::vector<subaccount_sync> syncs;
+        syncs.reserve(subaccounts.size());
+        bool verify_script;
         {
             locker_t locker(m_mutex);
-            final_last_pointer = m_cache->get_latest_scriptpubkey_pointer(subaccount);
-        }
-        do {
-            const nlohmann::json result = get_previous_addresses(details);
-            for (auto& address : result.at("list")) {
-                const bool allow_unconfidential = true;
-                const auto spk = scriptpubkey_from_address(m_net_params, address.at("address"), allow_unconfidential);
-                const uint32_t branch = j_uint32(address, "branch").value_or(1);
-                const uint32_t pointer = j_uint32ref(address, "pointer");
-                const uint32_t subtype = j_uint32_or_zero(address, "subtype");
-                const auto& addr_type = j_strref(address, "address_type");
-                locker_t locker(m_mutex);
-                m_cache->insert_scriptpubkey_data(spk, subaccount, branch, pointer, subtype, addr_type);
+            for (const auto subaccount : subaccounts) {
+                const auto final_last_pointer = m_cache->get_latest_scriptpubkey_pointer(subaccount);
+                syncs.push_back({ subaccount, final_last_pointer, std::nullopt });
             }
-            if (result.contains("last_pointer")) {
-                details["last_pointer"] = result.at("last_pointer");
-                current_last_pointer = details["last_pointer"];
-            } else {
-                current_last_pointer = 0;
+            // Old (non client blob) watch only sessions cannot validate addrs
+            verify_script = !(m_watch_only && !m_blob->has_key());
+        }
+        for (auto& sync : syncs) {
+            sync.page = m_wamp->async_call("addressbook.get_my_addresses", sync.subaccount, uint32_t(0));
+        }
+        while (!syncs.empty()) {
+            for (auto it = syncs.begin(); it != syncs.end();) {
+                auto addresses = wamp_cast_json(it->page->get());
+                it->page.reset();
+                if (!addresses.empty()) {
+                    const uint32_t last_pointer = j_uint32ref(addresses.back(), "pointer");
+                    if (last_pointer > it->final_last_pointer && last_pointer >= 2) {
+                        // More addresses remain: fetch them while we process this page
+                        it->page = m_wamp->async_call("addressbook.get_my_addresses", it->subaccount, last_pointer);
+                    }
+                    encache_scriptpubkey_page(it->subaccount, addresses, verify_script);
+                }
+                it = it->page ? std::next(it) : syncs.erase(it);
             }
-        } while (current_last_pointer > final_last_pointer);
+        }
 
         locker_t locker(m_mutex);
         m_cache->save_db();
     }
 
+    void ga_session::encache_scriptpubkey_page(uint32_t subaccount, nlohmann::json& addresses, bool verify_script)
+    {
+        for (auto& address : addresses) {
+            address["subaccount"] = subaccount;
+            json_add_if_missing(address, "subtype", 0, true); // Convert null subtype to 0
+            j_rename(address, "addr_type", "address_type");
+        }
+
+        locker_t locker(m_mutex);
+        if (verify_script) {
+            // Ensure the subaccount keys are derived before deriving in
+            // parallel, so that only the derived key cache is modified
+            get_green_pubkeys().get_subaccount(subaccount);
+        }
+        // We derive and verify the scripts ourselves, in parallel
+        std::vector<std::vector<unsigned char>> spks(addresses.size());
+        parallel_for(
+            addresses.size(),
+            [&](size_t i) {
+                auto& address = addresses[i];
+                if (verify_script) {
+                    const auto script = multisig_output_script_from_utxo(
+                        m_net_params, get_green_pubkeys(), get_user_pubkeys(), get_recovery_pubkeys(), address);
+                    GDK_RUNTIME_ASSERT(j_bytesref(address, "script") == script);
+                }
+                constexpr bool no_verify = false;
+                const auto addr = get_address_from_utxo(*this, address, no_verify);
+                constexpr bool allow_unconfidential = true;
+                spks[i] = scriptpubkey_from_address(m_net_params, addr, allow_unconfidential);
+            },
+            16);
+
+        // Insert the page of scriptpubkeys in a single DB transaction
+        cache::write_batch batch(*m_cache);
+        for (size_t i = 0; i < addresses.size(); ++i) {
+            const auto& address = addresses[i];
+            const uint32_t branch = j_uint32(address, "branch").value_or(1);
+            const uint32_t pointer = j_uint32ref(address, "pointer");
+            const uint32_t subtype = j_uint32_or_zero(address, "subtype");
+            const auto& addr_type = j_strref(address, "address_type");
+            m_cache->insert_scriptpubkey_data(spks[i], subaccount, branch, pointer, subtype, addr_type);
+        }
+    }
+
     nlohmann::json ga_session::get_scriptpubkey_data(byte_span_t scriptpubkey)
     {
         locker_t locker(m_mutex);
@@ -2485,9 +3103,7 @@ namespace green {
             const auto nlocktimes = update_nlocktime_info(locker);
             if (nlocktimes && !nlocktimes->empty()) {
                 for (auto& utxo : utxos) {
-                    const auto vout = j_uint32ref(utxo, "pt_idx");
-                    const std::string k{ j_strref(utxo, "txhash") + ":" + std::to_string(vout) };
-                    if (const auto it = nlocktimes->find(k); it != nlocktimes->end()) {
+                    if (const auto it = nlocktimes->find(get_outpoint_key(utxo)); it != nlocktimes->end()) {
                         utxo["expiry_height"] = j_uint32ref(it->second, "nlocktime_at");
                     }
                 }
@@ -2535,38 +3151,85 @@ namespace green {
         const nlohmann::json& details, const nlohmann::json& twofactor_data)
     {
         auto result = m_wamp->call("vault.set_utxo_status", mp_cast(details).get(), mp_cast(twofactor_data).get());
-        // Nuke cached UTXOs as their user_status may be out of date.
-        remove_cached_utxos(std::vector<uint32_t>());
+        // Update the user_status of any cached UTXOs to match
+        boost::unordered_flat_map<outpoint_t, uint32_t> statuses;
+        for (const auto& item : j_arrayref(details, "list")) {
+            statuses.emplace(get_outpoint_key(item), j_uint32ref(item, "user_status"));
+        }
+        update_cached_utxos([&statuses](nlohmann::json& utxos) {
+            for (auto& asset_utxos : utxos.at("unspent_outputs")) {
+                for (auto& utxo : asset_utxos) {
+                    if (auto p = statuses.find(get_outpoint_key(utxo)); p != statuses.end()) {
+                        utxo["user_status"] = p->second;
+                    }
+                }
+            }
+            return true;
+        });
         return wamp_cast_json(result);
     }
 
     // Idempotent
     Tx ga_session::get_raw_transaction_details(const std::string& txhash_hex) const
+    {
+        auto txs = get_raw_transactions_impl({ txhash_hex });
+        return std::move(txs.front());
+    }
+
+    std::vector<Tx> ga_session::get_raw_transactions_impl(const std::vector<std::string>& txhashes) const
     {
         try {
-            std::vector<unsigned char> tx_bin;
+            std::vector<std::vector<unsigned char>> txs_bin(txhashes.size());
+            std::vector<size_t> missing;
             locker_t locker(m_mutex);
             // First, try the local cache
-            m_cache->get_transaction_data(txhash_hex, { [&tx_bin](const auto& db_blob) {
-                if (db_blob.has_value()) {
-                    tx_bin.assign(db_blob.value().begin(), db_blob.value().end());
+            for (size_t i = 0; i < txhashes.size(); ++i) {
+                auto& tx_bin = txs_bin[i];
+                m_cache->get_transaction_data(txhashes[i], { [&tx_bin](const auto& db_blob) {
+                    if (db_blob.has_value()) {
+                        tx_bin.assign(db_blob.value().begin(), db_blob.value().end());
+                    }
+                } });
+                if (!tx_bin.empty()) {
+                    GDK_LOG(debug) << "Tx cache using cached " << txhashes[i];
+                } else {
+                    missing.push_back(i);
                 }
-            } });
-            if (!tx_bin.empty()) {
-                GDK_LOG(debug) << "Tx cache using cached " << txhash_hex;
-            } else {
-                // Not found, ask the server
-                auto server_tx_hex = wamp_cast(m_wamp->call(locker, "txs.get_raw_output", txhash_hex));
-                if (server_tx_hex.empty()) {
-                    throw user_error("Transaction not found");
+            }
+            if (!missing.empty()) {
+                // Not found, ask the server. All requests are made at once
+                std::vector<std::string> server_txs_hex;
+                server_txs_hex.reserve(missing.size());
+                {
+                    unique_unlock unlocker(locker);
+                    std::vector<wamp_transport::pending_call> calls;
+                    calls.reserve(missing.size());
+                    for (const auto i : missing) {
+                        calls.push_back(m_wamp->async_call("txs.get_raw_output", txhashes[i]));
+                    }
+                    for (auto& call : calls) {
+                        server_txs_hex.push_back(wamp_cast(call.get()));
+                    }
                 }
-                tx_bin = h2b(server_tx_hex);
-                // Cache the result
-                m_cache->insert_transaction_data(txhash_hex, tx_bin);
+                for (size_t j = 0; j < missing.size(); ++j) {
+                    if (server_txs_hex[j].empty()) {
+                        throw user_error("Transaction not found");
+                    }
+                    auto& tx_bin = txs_bin[missing[j]];
+                    tx_bin = h2b(server_txs_hex[j]);
+                    // Cache the result
+                    m_cache->insert_transaction_data(txhashes[missing[j]], tx_bin);
+                }
+            }
+            std::vector<Tx> ret;
+            ret.reserve(txs_bin.size());
+            for (const auto& tx_bin : txs_bin) {
+                ret.emplace_back(tx_bin, m_net_params.is_liquid());
             }
-            return Tx(tx_bin, m_net_params.is_liquid());
+            return ret;
         } catch (const std::exception& e) {
-            GDK_LOG(warning) << "Error fetching " << txhash_hex << " : " << e.what();
+            const auto& what = txhashes.size() == 1 ? txhashes.front() : std::to_string(txhashes.size()) + " txs";
+            GDK_LOG(warning) << "Error fetching " << what << " : " << e.what();
             throw user_error("Transaction not found");
         }
     }
@@ -2665,11 +3328,87 @@ namespace green {
 
         GDK_RUNTIME_ASSERT_MSG(addr_type == p2sh || addr_type == p2wsh || addr_type == csv, "Unknown address type");
 
+        // Serve from the pool if one is in use, without refilling it
+        constexpr bool resize_pool = false;
+        return std::move(get_pooled_addresses(subaccount, addr_type, 1, resize_pool).front());
+    }
+
+    std::vector<nlohmann::json> ga_session::get_receive_addresses(const nlohmann::json& details)
+    {
+        using namespace address_type;
+        const uint32_t subaccount = details.at("subaccount");
+        const size_t count = j_uint32ref(details, "count");
+        auto addr_type = j_str_or_empty(details, "address_type");
+        if (addr_type.empty()) {
+            addr_type = get_default_address_type(subaccount);
+        }
+
+        GDK_RUNTIME_ASSERT_MSG(addr_type == p2sh || addr_type == p2wsh || addr_type == csv, "Unknown address type");
+
+        constexpr bool resize_pool = true;
+        return get_pooled_addresses(subaccount, addr_type, count, resize_pool);
+    }
+
+    std::vector<nlohmann::json> ga_session::get_pooled_addresses(
+        uint32_t subaccount, const std::string& addr_type, size_t count, bool resize_pool)
+    {
         constexpr bool return_pointer = true;
-        auto address = wamp_cast_json(m_wamp->call("vault.fund", subaccount, return_pointer, addr_type));
-        update_address_info(address, false);
-        GDK_RUNTIME_ASSERT(j_strref(address, "address_type") == addr_type);
-        return address;
+        auto&& fund = [&] { return m_wamp->async_call("vault.fund", subaccount, return_pointer, addr_type); };
+
+        std::vector<wamp_transport::pending_call> calls;
+        calls.reserve(count);
+        size_t num_pooled;
+        {
+            locker_t locker(m_mutex);
+            auto& pools = m_address_pools->pools;
+            auto pool_p = pools.find({ subaccount, addr_type });
+            if (pool_p == pools.end() && resize_pool) {
+                pool_p = pools.emplace(std::make_pair(subaccount, addr_type), address_pool()).first;
+            }
+            auto* pool = pool_p == pools.end() ? nullptr : &pool_p->second;
+            if (pool) {
+                // Take the oldest pooled calls first to return addresses in order
+                num_pooled = std::min(count, pool->calls.size());
+                const auto end = pool->calls.begin() + num_pooled;
+                std::move(pool->calls.begin(), end, std::back_inserter(calls));
+                pool->calls.erase(pool->calls.begin(), end);
+            } else {
+                num_pooled = 0;
+            }
+            while (calls.size() < count) {
+                calls.emplace_back(fund());
+            }
+            if (pool && resize_pool) {
+                // Start fetching the next batch's addresses in the background.
+                // Single address requests only drain the pool, so that callers
+                // that stop using batches don't keep generating extra addresses
+                const size_t target_size = std::min(count, MAX_ADDRESS_POOL_SIZE);
+                while (pool->calls.size() < target_size) {
+                    pool->calls.emplace_back(fund());
+                }
+            }
+        }
+
+        std::vector<nlohmann::json> addresses;
+        addresses.reserve(count);
+        for (size_t i = 0; i < calls.size(); ++i) {
+            nlohmann::json address;
+            try {
+                address = wamp_cast_json(calls[i].get());
+            } catch (const std::exception& e) {
+                if (i >= num_pooled) {
+                    throw;
+                }
+                // The pooled call may have been made on a previous connection
+                GDK_LOG(info) << "pooled vault.fund failed, retrying: " << e.what();
+                address = wamp_cast_json(m_wamp->call("vault.fund", subaccount, return_pointer, addr_type));
+            }
+            // Verify the address against our locally derived keys
+            update_address_info(address, false);
+            GDK_RUNTIME_ASSERT(j_strref(address, "address_type") == addr_type);
+            addresses.emplace_back(std::move(address));
+        }
+        return addresses;
     }
 
     // Idempotent
@@ -2724,9 +3463,16 @@ namespace green {
     {
         GDK_RUNTIME_ASSERT(locker.owns_lock());
 
+        if (reset_cached) {
+            m_prefetched_calls->calls.erase("twofactor.get_config"); // May be out of date
+        }
         if (m_twofactor_config.is_null() || reset_cached) {
-            auto config = wamp_cast_json(m_wamp->call(locker, "twofactor.get_config"));
-            set_twofactor_config(locker, config);
+            auto config = get_prefetched(locker, "twofactor.get_config");
+            if (!config) {
+                config = wamp_cast_json(m_wamp->call(locker, "twofactor.get_config"));
+            }
+            set_twofactor_config(locker, *config);
+            save_session_snapshot(locker);
         }
         auto ret = m_twofactor_config;
         ret["limits"] = get_spending_limits(locker);
@@ -3107,6 +3853,7 @@ namespace green {
         // Clear cached UTXOs and nlocktimes, the backend may have generated new ones
         locker_t locker(m_mutex);
         m_nlocktimes.reset();
+        m_prefetched_calls->calls.erase("txs.upcoming_nlocktime");
     }
 
     void ga_session::set_csvtime(const nlohmann::json& locktime_details, const nlohmann::json& twofactor_data)
@@ -3120,6 +3867,11 @@ namespace green {
         auto result = m_wamp->call(locker, "login.set_csvtime", csv_blocks, mp_cast(twofactor_data).get());
         GDK_RUNTIME_ASSERT(wamp_cast<bool>(result));
         m_csv_blocks = csv_blocks;
+        // Pooled csv addresses use the previous csv_blocks value
+        auto& pools = m_address_pools->pools;
+        for (auto it = pools.begin(); it != pools.end();) {
+            it = it->first.second == address_type::csv ? pools.erase(it) : std::next(it);
+        }
     }
 
     void ga_session::set_nlocktime(const nlohmann::json& locktime_details, const nlohmann::json& twofactor_data)
@@ -3144,15 +3896,14 @@ namespace green {
             if (!m_spv_thread_done) {
                 // Thread is still running
                 if (do_start) {
-                    // Let the existing thread continue running
+                    // Wake the existing thread in case there is a new block
+                    m_spv_cv.notify_all();
                     return;
                 }
                 // Ask and wait for the thread to die
                 m_spv_thread_stop = true;
-                while (!m_spv_thread_done) {
-                    unique_unlock unlocker(locker);
-                    std::this_thread::sleep_for(100ms);
-                }
+                m_spv_cv.notify_all();
+                m_spv_cv.wait(locker, [this] { return m_spv_thread_done.load(); });
             }
             // Thread is finished, join and delete it
             m_spv_thread->join();
@@ -3172,43 +3923,52 @@ namespace green {
     void ga_session::download_headers_thread_fn()
     {
         nlohmann::json spv_params;
-        uint32_t last_fetched_height = 0;
+        uint32_t fetched_height = 0;
 
-        // Loop downloading block headers until we are caught up, then exit
+        // Download block headers until we are caught up, then wait for
+        // new blocks until asked to stop
         GDK_LOG(info) << "spv_download_headers: starting sync";
+        locker_t locker(m_mutex);
+        const auto get_block_height = [this] { return j_uint32_or_zero(m_last_block_notification, "block_height"); };
         for (;;) {
             try {
-                uint32_t block_height;
+                if (m_spv_thread_stop) {
+                    GDK_LOG(info) << "spv_download_headers: exit requested";
+                    break; // We have been asked to terminate; do so
+                }
+                const uint32_t block_height = get_block_height();
+                if (fetched_height && fetched_height >= block_height) {
+                    // Caught up: wait until a new block arrives
+                    m_spv_cv.wait(locker, [&] { return m_spv_thread_stop || get_block_height() > fetched_height; });
+                    continue;
+                }
+                if (spv_params.empty()) {
+                    constexpr uint32_t timeout_secs = 10;
+                    spv_params = get_net_call_params(locker, timeout_secs);
+                    // Have the next batches downloading while each is verified
+                    spv_params["batches"] = SPV_HEADER_BATCHES;
+                }
+                uint32_t new_height;
                 {
-                    locker_t locker(m_mutex);
-                    if (m_spv_thread_stop) {
-                        GDK_LOG(info) << "spv_download_headers: exit requested";
-                        break; // We have been asked to terminate; do so
-                    }
-                    block_height = m_last_block_notification["block_height"];
-                    if (spv_params.empty()) {
-                        constexpr uint32_t timeout_secs = 10;
-                        spv_params = get_net_call_params(locker, timeout_secs);
-                    }
+                    unique_unlock unlocker(locker);
+                    const auto ret = rust_call("spv_download_headers", spv_params);
+                    new_height = ret.at("height");
                 }
-                const auto ret = rust_call("spv_download_headers", spv_params);
-                const auto fetched_height = ret.at("height");
-                GDK_LOG(debug) << "spv_download_headers:" << fetched_height << '/' << block_height;
-                if (fetched_height == block_height) {
-                    break; // Caught up, exit
+                GDK_LOG(debug) << "spv_download_headers:" << new_height << '/' << block_height;
+                if (new_height == fetched_height && new_height < block_height) {
+                    // The server has no new headers for us yet: retry
+                    // later, or sooner if a new block arrives
+                    m_spv_cv.wait_for(locker, SPV_RETRY_DELAY,
+                        [&] { return m_spv_thread_stop || get_block_height() != block_height; });
                 }
-                // Use a short delay for initial header loading, longer
-                // if we are waiting for the current block.
-                const auto delay_ms = fetched_height == last_fetched_height ? 1000ms : 50ms;
-                last_fetched_height = fetched_height;
-                std::this_thread::sleep_for(delay_ms);
+                fetched_height = new_height;
             } catch (const std::exception& e) {
                 GDK_LOG(warning) << "spv_download_headers exception:" << e.what();
                 break; // Exception, exit
             }
         }
-        locker_t locker(m_mutex);
         m_spv_thread_done = true;
+        m_spv_cv.notify_all();
     }
 
 } // namespace green
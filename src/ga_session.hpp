@@ -4,11 +4,15 @@
 
 #include <array>
 #include <chrono>
+#include <condition_variable>
+#include <functional>
 #include <map>
 #include <optional>
 #include <string>
 #include <vector>
 
+#include <boost/unordered/unordered_flat_map.hpp>
+
 #include "amount.hpp"
 #include "ga_wally.hpp"
 #include "session_impl.hpp"
@@ -17,10 +21,15 @@ namespace green {
 
     struct cache;
     class green_user_pubkeys;
+    class network_state;
+    struct address_pools;
+    struct prefetched_calls;
 
     class ga_session final : public session_impl {
     public:
-        using nlocktime_t = std::map<std::string, nlohmann::json>; // txhash:pt_idx -> lock info
+        // A binary txhash (in display order) and output index
+        using outpoint_t = std::pair<std::array<unsigned char, WALLY_TXHASH_LEN>, uint32_t>;
+        using nlocktime_t = boost::unordered_flat_map<outpoint_t, nlohmann::json>; // outpoint -> lock info
 
         explicit ga_session(network_parameters&& net_params);
         ~ga_session();
@@ -32,6 +41,7 @@ namespace green {
         nlohmann::json register_user(std::shared_ptr<signer> signer);
 
         std::string get_challenge(const pub_key_t& public_key);
+        void emit_session_snapshot(std::shared_ptr<signer> signer);
         nlohmann::json authenticate(const std::string& sig_der_hex, std::shared_ptr<signer> signer);
 
         void register_subaccount_xpubs(
@@ -52,6 +62,7 @@ namespace green {
         uint32_t get_next_subaccount(const std::string& sa_type);
         nlohmann::json create_subaccount(nlohmann::json details, uint32_t subaccount, const std::string& xpub);
         nlohmann::json get_receive_address(const nlohmann::json& details);
+        std::vector<nlohmann::json> get_receive_addresses(const nlohmann::json& details);
         nlohmann::json get_previous_addresses(const nlohmann::json& details);
         void set_local_encryption_keys(locker_t& locker, const pub_key_t& public_key, std::shared_ptr<signer> signer);
         nlohmann::json get_available_currencies() const;
@@ -92,6 +103,7 @@ namespace green {
         void process_unspent_outputs(nlohmann::json& utxos);
         nlohmann::json set_unspent_outputs_status(const nlohmann::json& details, const nlohmann::json& twofactor_data);
         Tx get_raw_transaction_details(const std::string& txhash_hex) const;
+        std::vector<Tx> get_raw_transactions_impl(const std::vector<std::string>& txhashes) const;
 
         nlohmann::json service_sign_transaction(const nlohmann::json& details, const nlohmann::json& twofactor_data,
             std::vector<std::vector<unsigned char>>& old_scripts);
@@ -111,10 +123,11 @@ namespace green {
         void ack_system_message(const std::string& message_hash_hex, const std::string& sig_der_hex);
 
         nlohmann::json convert_amount(const nlohmann::json& amount_json) const;
+        nlohmann::json convert_amounts(const nlohmann::json& details) const;
 
         bool encache_blinding_data(const std::string& pubkey_hex, const std::string& script_hex,
             const std::string& nonce_hex, const std::string& blinding_pubkey_hex);
-        void encache_new_scriptpubkeys(uint32_t subaccount);
+        void encache_new_scriptpubkeys(const std::vector<uint32_t>& subaccounts);
         nlohmann::json get_scriptpubkey_data(byte_span_t scriptpubkey);
 
         amount get_min_fee_rate() const;
@@ -129,9 +142,12 @@ namespace green {
         void encache_signer_xpubs(std::shared_ptr<signer> signer);
 
         nlohmann::json sync_transactions(uint32_t subaccount, unique_pubkeys_and_scripts_t& missing);
+        nlohmann::json sync_transactions(const std::vector<uint32_t>& subaccounts,
+            unique_pubkeys_and_scripts_t& missing, const std::map<uint32_t, uint64_t>& sync_from);
         void store_transactions(uint32_t subaccount, nlohmann::json& txs);
         void postprocess_transactions(nlohmann::json& tx_list);
         nlohmann::json get_transactions(const nlohmann::json& details);
+        nlohmann::json search_transactions(const nlohmann::json& details);
 
     private:
         void reset_cached_session_data(locker_t& locker);
@@ -163,20 +179,51 @@ namespace green {
             const std::string& user_agent, bool with_blob);
         nlohmann::json on_post_login(locker_t& locker, nlohmann::json& login_data, const std::string& root_bip32_xpub,
             bool watch_only, bool is_relogin);
+        void prefetch_post_login(locker_t& locker);
+        // Update the snapshot with the current session state
+        void save_session_snapshot(locker_t& locker);
+        // Return the result of a prefetched call, if one was started and succeeded
+        std::optional<nlohmann::json> get_prefetched(locker_t& locker, const std::string& method_name);
+        // Return count new addresses, taking any already fetched from the
+        // subaccounts pool. Only if resize_pool is true is the pool refilled,
+        // to hold count addresses for the next request
+        std::vector<nlohmann::json> get_pooled_addresses(
+            uint32_t subaccount, const std::string& addr_type, size_t count, bool resize_pool);
         void update_fiat_rate(locker_t& locker, const std::string& rate_str);
         void update_spending_limits(locker_t& locker, const nlohmann::json& limits);
         nlohmann::json get_spending_limits(locker_t& locker) const;
         nlohmann::json convert_amount(locker_t& locker, const nlohmann::json& amount_json) const;
         nlohmann::json convert_fiat_cents(locker_t& locker, amount::value_type fiat_cents) const;
         nlohmann::json get_settings(locker_t& locker) const;
+        struct pending_unblind;
+        struct cached_liquid_outputs;
         bool unblind_utxo(locker_t& locker, nlohmann::json& utxo, const std::string& for_txhash,
-            unique_pubkeys_and_scripts_t& missing);
+            const cached_liquid_outputs& cached, unique_pubkeys_and_scripts_t& missing,
+            std::vector<pending_unblind>& pending);
+        // Unblind pending outputs in parallel, temporarily releasing the lock
+        bool unblind_pending_utxos(locker_t& locker, std::vector<pending_unblind>& pending);
         std::vector<unsigned char> get_alternate_blinding_nonce(
             locker_t& locker, nlohmann::json& utxo, const std::vector<unsigned char>& nonce_commitment);
         bool cleanup_utxos(session_impl::locker_t& locker, nlohmann::json& utxos, const std::string& for_txhash,
             unique_pubkeys_and_scripts_t& missing);
+        bool cleanup_utxos(session_impl::locker_t& locker, nlohmann::json& utxos, const std::string& for_txhash,
+            unique_pubkeys_and_scripts_t& missing, std::vector<pending_unblind>& pending);
 
+        // Lock the session once no multi calls of the given categories or
+        // tx cache readers are in progress. If wait_for_lock is false, only
+        // wait for readers, returning an unlocked locker if a multi call is
+        // in progress; the caller may then retry with defer_multi_call().
         std::unique_ptr<locker_t> get_multi_call_locker(uint32_t category_flags, bool wait_for_lock);
+        // Mark a multi call as in progress until end_multi_call() is called
+        void start_multi_call(locker_t& locker, uint32_t category_flags);
+        void end_multi_call(locker_t& locker, uint32_t category_flags);
+        // Run fn on the session strand when no multi calls are in progress
+        void defer_multi_call(std::function<void()> fn);
+        // Mark a tx cache read as in progress, once no tx cache writers are
+        void start_tx_cache_read(locker_t& locker);
+        void end_tx_cache_read(locker_t& locker);
+        static nlohmann::json decode_transactions(
+            const std::vector<std::pair<uint32_t, std::vector<unsigned char>>>& encoded);
         void on_new_transaction(const std::vector<uint32_t>& subaccounts, nlohmann::json details);
         void purge_tx_notification(const std::string& txhash_hex);
         void on_new_block(nlohmann::json details, bool is_relogin);
@@ -195,13 +242,18 @@ namespace green {
         std::pair<std::string, std::string> sign_challenge(locker_t& locker, const std::string& challenge);
 
         void set_fee_estimates(locker_t& locker, const nlohmann::json& fee_estimates);
+        // The latest fee estimates shared on our network, or null if none
+        std::shared_ptr<const std::vector<uint32_t>> get_latest_fee_estimates() const;
 
         nlohmann::json refresh_http_data(const std::string& page, const std::string& key, bool refresh);
 
         void update_address_info(nlohmann::json& address, bool is_historic);
         std::shared_ptr<nlocktime_t> update_nlocktime_info(session_impl::locker_t& locker);
+        void encache_scriptpubkey_page(uint32_t subaccount, nlohmann::json& addresses, bool verify_script);
 
         void save_cache();
+        nlohmann::json get_memory_stats();
+        void trim_memory();
 
         void subscribe_all(locker_t& locker);
 
@@ -213,6 +265,8 @@ namespace green {
         void download_headers_thread_fn();
 
         const bool m_spv_enabled;
+        const bool m_session_snapshots; // Whether to save and emit session snapshots
+        const std::shared_ptr<network_state> m_network_state; // Shared by sessions on our network
         std::optional<pbkdf2_hmac512_t> m_local_encryption_key;
         std::array<uint32_t, 32> m_gait_path;
         nlohmann::json m_limits_data;
@@ -230,7 +284,6 @@ namespace green {
         std::map<uint32_t, nlohmann::json> m_subaccounts; // Includes 0 for main
         uint32_t m_next_subaccount;
         std::vector<uint32_t> m_fee_estimates;
-        std::chrono::system_clock::time_point m_fee_estimates_ts;
 
         uint32_t m_system_message_id; // Next system message
         uint32_t m_system_message_ack_id; // Currently returned message id to ack
@@ -238,19 +291,34 @@ namespace green {
         std::vector<std::string> m_tx_notifications;
         std::chrono::system_clock::time_point m_tx_last_notification;
         nlohmann::json m_last_block_notification;
+        std::atomic<uint32_t> m_block_height; // Block height of m_last_block_notification
 
         uint32_t m_multi_call_category;
+        uint32_t m_tx_cache_readers; // Number of get_transactions calls reading the cache
+        condition_t m_multi_call_cv; // Notified when a multi call or reader ends
+        std::vector<std::function<void()>> m_deferred_multi_calls;
         std::shared_ptr<nlocktime_t> m_nlocktimes;
 
         std::shared_ptr<cache> m_cache;
+        // The cache read by emit_session_snapshot, reused by the login it
+        // precedes if that uses the same signer and key
+        struct snapshot_cache_t {
+            std::shared_ptr<signer> login_signer;
+            pbkdf2_hmac512_t key;
+            std::shared_ptr<cache> db;
+        };
+        std::optional<snapshot_cache_t> m_snapshot_cache;
         std::set<uint32_t> m_synced_subaccounts;
         const std::string m_user_agent;
         std::shared_ptr<wamp_transport> m_wamp;
+        std::unique_ptr<prefetched_calls> m_prefetched_calls; // Non-essential calls started at login
+        std::unique_ptr<address_pools> m_address_pools; // Receive addresses fetched ahead of use
 
         // SPV header downloading
         std::shared_ptr<std::thread> m_spv_thread; // Header download thread
         std::atomic_bool m_spv_thread_done; // True when m_spv_thread has exited
         std::atomic_bool m_spv_thread_stop; // True when we want m_spv_thread to stop
+        condition_t m_spv_cv; // Notified on a new block, stop request or thread exit
         // Txs that are SPV verified but not yet confirmed beyond the reorg limit
         std::set<std::string> m_spv_verified_txs;
     };
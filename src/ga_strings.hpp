@@ -4,1413 +4,1413 @@
 #define GA_SDK_GA_STRINGS_HPP
 #pragma once
 
-#include <string>
+#include <string_view>
 
 namespace green {
 
     namespace res {
 
-        extern const std::string id_1030_minutes;
-        extern const std::string id_12_confirmations;
-        extern const std::string id_12_months_51840_blocks;
-        extern const std::string id_12_words;
-        extern const std::string id_15_months_65535_blocks;
-        extern const std::string id_1_double_check_all_of_your;
-        extern const std::string id_1d_2s_ago;
-        extern const std::string id_1d_minutes;
-        extern const std::string id_1s_blocks_left_2d;
-        extern const std::string id_1s_twofactor_setup;
-        extern const std::string id_24_words;
-        extern const std::string id_2_hours;
-        extern const std::string id_2fa_dispute_in_progress;
-        extern const std::string id_2fa_expired;
-        extern const std::string id_2fa_expiry;
-        extern const std::string id_2fa_isnt_set_up_yetnnyou_can;
-        extern const std::string id_2fa_methods;
-        extern const std::string id_2fa_protected;
-        extern const std::string id_2fa_reset_in_progress;
-        extern const std::string id_2fa_shield;
-        extern const std::string id_2fa_shield_account;
-        extern const std::string id_2fa_threshold;
-        extern const std::string id_2of2;
-        extern const std::string id_2of3;
-        extern const std::string id_2of3_account;
-        extern const std::string id_2of3_with_2fa;
-        extern const std::string id_2of3_with_2fa_shield;
-        extern const std::string id_4_hours;
-        extern const std::string id_5_seconds_minimum;
-        extern const std::string id_6_months_25920_blocks;
-        extern const std::string id_a_2of3_account_requires_two_out;
-        extern const std::string id_a_funding_fee_of_s_minimum_s_is;
-        extern const std::string id_a_new_transaction_has_just;
-        extern const std::string id_a_newer_version_of_blockstream;
-        extern const std::string id_a_powerful_hardware_wallet_for;
-        extern const std::string id_a_screen_lock_must_be_enabled;
-        extern const std::string id_a_set_up_funding_fee_of_s_s;
-        extern const std::string id_a_wallet_is_detected_on_this;
-        extern const std::string id_about;
-        extern const std::string id_accept;
-        extern const std::string id_access;
-        extern const std::string id_account;
-        extern const std::string id_account__asset;
-        extern const std::string id_account_address;
-        extern const std::string id_account_archived;
-        extern const std::string id_account_balance;
-        extern const std::string id_account_extended_public_keys;
-        extern const std::string id_account_for_special_assets;
-        extern const std::string id_account_has_been_archived;
-        extern const std::string id_account_has_been_removed;
-        extern const std::string id_account_id;
-        extern const std::string id_account_name;
-        extern const std::string id_account_type;
-        extern const std::string id_accounts;
-        extern const std::string id_accounts_summary;
-        extern const std::string id_action_canceled;
-        extern const std::string id_actions;
-        extern const std::string id_add_2fa_account;
-        extern const std::string id_add_a_note_only_you_can_see_it;
-        extern const std::string id_add_a_pgp_public_key_to_receive;
-        extern const std::string id_add_amount;
-        extern const std::string id_add_amount_optional;
-        extern const std::string id_add_an_amp_wallet;
-        extern const std::string id_add_another_wallet;
-        extern const std::string id_add_custom_network_by_qr_code;
-        extern const std::string id_add_custom_network_by_url;
-        extern const std::string id_add_new_account;
-        extern const std::string id_add_note;
-        extern const std::string id_add_recipient;
-        extern const std::string id_add_wallet;
-        extern const std::string id_adding_a_2fa;
-        extern const std::string id_additional_networks;
-        extern const std::string id_additional_security;
-        extern const std::string id_address;
-        extern const std::string id_address_1s;
-        extern const std::string id_address_copied_to_clipboard;
-        extern const std::string id_address_to_receive;
-        extern const std::string id_address_type;
-        extern const std::string id_address_verified;
-        extern const std::string id_address_was_filled_by_a_payment;
-        extern const std::string id_addresses;
-        extern const std::string id_advanced;
-        extern const std::string id_advanced_network_settings;
-        extern const std::string id_advanced_options;
-        extern const std::string id_advanced_options_for_your_third;
-        extern const std::string id_all;
-        extern const std::string id_all_assets;
-        extern const std::string id_all_coins;
-        extern const std::string id_all_networks;
-        extern const std::string id_all_of_the_accounts_in_your;
-        extern const std::string id_all_the_coins_received_or;
-        extern const std::string id_all_wallets;
-        extern const std::string id_allow_collection;
-        extern const std::string id_allow_data_collection;
-        extern const std::string id_allows_you_to_quickly_check;
-        extern const std::string id_always;
-        extern const std::string id_always_ask;
-        extern const std::string id_amount;
-        extern const std::string id_amount_above_maximum_allowed;
-        extern const std::string id_amount_below_minimum_allowed;
-        extern const std::string id_amount_below_the_dust_threshold;
-        extern const std::string id_amount_in_s;
-        extern const std::string id_amount_must_be_at_least_s;
-        extern const std::string id_amount_must_be_at_most_s;
-        extern const std::string id_amount_to_receive;
-        extern const std::string id_amp;
-        extern const std::string id_amp_account;
-        extern const std::string id_amp_accounts_are_only_available;
-        extern const std::string id_amp_id;
-        extern const std::string id_amp_wallet;
-        extern const std::string id_an_unidentified_error_occurred;
-        extern const std::string id_another_2fa_method_is_already;
-        extern const std::string id_any_wallet_found_will_be;
-        extern const std::string id_app_settings;
-        extern const std::string id_archive;
-        extern const std::string id_archive_account;
-        extern const std::string id_archived;
-        extern const std::string id_archived_account;
-        extern const std::string id_archived_accounts;
-        extern const std::string id_are_you_sure_you_want_to_delete;
-        extern const std::string id_are_you_sure_you_want_to_remove;
-        extern const std::string id_are_you_sure_you_want_to_view;
-        extern const std::string id_as_easy_as_snapping_a_photo;
-        extern const std::string id_asset;
-        extern const std::string id_asset_details;
-        extern const std::string id_asset_icons_are_missing_try;
-        extern const std::string id_asset_id;
-        extern const std::string id_asset_name;
-        extern const std::string id_assets;
-        extern const std::string id_assets_cannot_be_used_on_bitcoin;
-        extern const std::string id_at_least_8_characters_required;
-        extern const std::string id_attempts_remaining_d;
-        extern const std::string id_authenticate;
-        extern const std::string id_authenticate_address;
-        extern const std::string id_authenticate_to_view_the;
-        extern const std::string id_authentication_error_s;
-        extern const std::string id_authentication_failed;
-        extern const std::string id_authentication_successful;
-        extern const std::string id_authenticator_app;
-        extern const std::string id_authenticator_qr_code;
-        extern const std::string id_authenticator_secret_key;
-        extern const std::string id_auto_logout_timeout;
-        extern const std::string id_auto_logout_timeout_expired;
-        extern const std::string id_autolock_after;
-        extern const std::string id_available;
-        extern const std::string id_available_funds_s;
-        extern const std::string id_back;
-        extern const std::string id_back_up_recovery_phrase;
-        extern const std::string id_backup_recovery_phrase;
-        extern const std::string id_backup_the_recovery_mnemonic;
-        extern const std::string id_backup_your_mnemonic_before;
-        extern const std::string id_be_aware_other_apps_can_read_or;
-        extern const std::string id_be_sure_your_recovery_phrase_is;
-        extern const std::string id_before_you_backup;
-        extern const std::string id_biometric_login_is_disabled;
-        extern const std::string id_biometric_login_is_enabled;
-        extern const std::string id_biometrics_authentication;
-        extern const std::string id_bip39_passphrase;
-        extern const std::string id_bip39_passphrase_login;
-        extern const std::string id_bip49_accounts_allow_you_to;
-        extern const std::string id_bip84_accounts_allow_you_to;
-        extern const std::string id_bitcoin_and_liquid;
-        extern const std::string id_bitcoin_denomination;
-        extern const std::string id_bitcoin_electrum_server;
-        extern const std::string id_bitcoin_is_the_worlds_leading;
-        extern const std::string id_bitcoin_testnet_and_liquid;
-        extern const std::string id_bitcoin_wallet;
-        extern const std::string id_bitcoin_wallets;
-        extern const std::string id_block;
-        extern const std::string id_block_d;
-        extern const std::string id_block_height;
-        extern const std::string id_block_height_1d;
-        extern const std::string id_blocks;
-        extern const std::string id_blocks_confirmed;
-        extern const std::string id_blockstream_devices;
-        extern const std::string id_blockstream_does_not_have;
-        extern const std::string id_blockstream_green_needs_access;
-        extern const std::string id_blockstream_green_supports_both;
-        extern const std::string id_blockstream_greennsimple_and;
-        extern const std::string id_blockstream_store;
-        extern const std::string id_bluetooth;
-        extern const std::string id_btchip_is_not_set_up_please_set;
-        extern const std::string id_by_proceeding_to_the_next_steps;
-        extern const std::string id_cable;
-        extern const std::string id_call;
-        extern const std::string id_camera_problem;
-        extern const std::string id_cancel;
-        extern const std::string id_cancel_2fa_reset;
-        extern const std::string id_cancel_a_reset_to_unlock_your;
-        extern const std::string id_cancel_twofactor_reset;
-        extern const std::string id_cannot_remove_enabled_network;
-        extern const std::string id_cant_connect_to_this_url;
-        extern const std::string id_change;
-        extern const std::string id_change_address;
-        extern const std::string id_change_pin;
-        extern const std::string id_change_speed;
-        extern const std::string id_changing_reference_exchange;
-        extern const std::string id_channel_closure_initiated_you;
-        extern const std::string id_cheaper_and_more_private;
-        extern const std::string id_cheaper_singlesig_option;
-        extern const std::string id_check_device;
-        extern const std::string id_check_for_updates;
-        extern const std::string id_check_for_updates_on_startup;
-        extern const std::string id_check_our_6_easy_steps_to_be;
-        extern const std::string id_check_your_backup;
-        extern const std::string id_check_your_device;
-        extern const std::string id_choose;
-        extern const std::string id_choose_a_name_for_your_new;
-        extern const std::string id_choose_a_name_for_your_wallet;
-        extern const std::string id_choose_a_swap_option;
-        extern const std::string id_choose_a_usb_or_bluetooth;
-        extern const std::string id_choose_bluetooth_connection_on;
-        extern const std::string id_choose_method_to_authorize_the;
-        extern const std::string id_choose_recovery_phrase_length;
-        extern const std::string id_choose_security_policy;
-        extern const std::string id_choose_the_electrum_servers_you;
-        extern const std::string id_choose_the_security_policy_that;
-        extern const std::string id_choose_the_security_policy_you;
-        extern const std::string id_choose_this_version_to_connect;
-        extern const std::string id_choose_this_version_to_disable;
-        extern const std::string id_choose_twofactor_authentication;
-        extern const std::string id_choose_watchonly;
-        extern const std::string id_choose_your_network;
-        extern const std::string id_clear;
-        extern const std::string id_clear_cache;
-        extern const std::string id_click_to_copy;
-        extern const std::string id_click_to_receive_an_email_with;
-        extern const std::string id_close;
-        extern const std::string id_close_channel;
-        extern const std::string id_code;
-        extern const std::string id_coin;
-        extern const std::string id_coins;
-        extern const std::string id_coins_for_which_2fa_protection;
-        extern const std::string id_coins_locked;
-        extern const std::string id_coins_protected_by_the_legacy;
-        extern const std::string id_coins_protected_by_the_new;
-        extern const std::string id_coins_received_or_created;
-        extern const std::string id_coins_unlocked;
-        extern const std::string id_coins_whose_asset_and_amount;
-        extern const std::string id_coins_with_a_value_lower_than;
-        extern const std::string id_collapse_sidebar;
-        extern const std::string id_coming_soon;
-        extern const std::string id_communication_timed_out_make;
-        extern const std::string id_completed;
-        extern const std::string id_confidential;
-        extern const std::string id_confidential_transaction;
-        extern const std::string id_confirm;
-        extern const std::string id_confirm_action;
-        extern const std::string id_confirm_by_typing_the_wallet;
-        extern const std::string id_confirm_code;
-        extern const std::string id_confirm_coin_selection;
-        extern const std::string id_confirm_on_your_device;
-        extern const std::string id_confirm_passphrase;
-        extern const std::string id_confirm_refund;
-        extern const std::string id_confirm_swap;
-        extern const std::string id_confirm_transaction;
-        extern const std::string id_confirm_transaction_details_on;
-        extern const std::string id_confirm_update_on_your_jade;
-        extern const std::string id_confirm_version_on_jade;
-        extern const std::string id_confirm_via_2fa_that_you;
-        extern const std::string id_confirm_your_new_pin;
-        extern const std::string id_confirmation_in_d_blocks;
-        extern const std::string id_confirmation_time;
-        extern const std::string id_confirmations;
-        extern const std::string id_confirming_your_transaction;
-        extern const std::string id_congratulations;
-        extern const std::string id_connect_a_different_hardware;
-        extern const std::string id_connect_hardware_wallet;
-        extern const std::string id_connect_jade;
-        extern const std::string id_connect_jade_with_a_usb_cable;
-        extern const std::string id_connect_through_a_proxy;
-        extern const std::string id_connect_usb_cable_or_enable;
-        extern const std::string id_connect_using_usb_or_bluetooth;
-        extern const std::string id_connect_with_bluetooth;
-        extern const std::string id_connect_with_tor;
-        extern const std::string id_connect_your_jade_to_use_it;
-        extern const std::string id_connect_your_ledger_to_use_it;
-        extern const std::string id_connected_to_jade;
-        extern const std::string id_connected_wallets;
-        extern const std::string id_connecting;
-        extern const std::string id_connecting_through_tor;
-        extern const std::string id_connecting_to_a_trusted_node;
-        extern const std::string id_connecting_to_peers;
-        extern const std::string id_connecting_to_tor_onion_nodes;
-        extern const std::string id_connecting_to_your_device;
-        extern const std::string id_connection;
-        extern const std::string id_connection_failed;
-        extern const std::string id_connection_to_device_failed;
-        extern const std::string id_contact_support_at_s_or_visit_s;
-        extern const std::string id_continue;
-        extern const std::string id_continue_with_1s;
-        extern const std::string id_copied_to_clipboard;
-        extern const std::string id_copy;
-        extern const std::string id_copy_address;
-        extern const std::string id_copy_details;
-        extern const std::string id_copy_device_id;
-        extern const std::string id_copy_id;
-        extern const std::string id_copy_raw_transaction;
-        extern const std::string id_copy_support_id;
-        extern const std::string id_copy_swap_proposal;
-        extern const std::string id_copy_to_clipboard;
-        extern const std::string id_copy_transaction_id;
-        extern const std::string id_copy_unblinded_link;
-        extern const std::string id_copy_unblinding_data;
-        extern const std::string id_copy_uri;
-        extern const std::string id_copy_xpub;
-        extern const std::string id_correct_order;
-        extern const std::string id_could_not_recognized_qr_code;
-        extern const std::string id_country;
-        extern const std::string id_create;
-        extern const std::string id_create_a_new_proposal;
-        extern const std::string id_create_a_new_swap;
-        extern const std::string id_create_a_pin;
-        extern const std::string id_create_a_pin_to_access_your;
-        extern const std::string id_create_a_wallet_for_bitcoin;
-        extern const std::string id_create_account;
-        extern const std::string id_create_invoice;
-        extern const std::string id_create_new_account;
-        extern const std::string id_create_new_wallet;
-        extern const std::string id_create_temporary_wallet;
-        extern const std::string id_create_wallet;
-        extern const std::string id_create_your_first_account_to;
-        extern const std::string id_creating_wallet;
-        extern const std::string id_creating_your_s_account;
-        extern const std::string id_csv;
-        extern const std::string id_currency;
-        extern const std::string id_current_version;
-        extern const std::string id_custom;
-        extern const std::string id_custom_network_added_enable_it;
-        extern const std::string id_custom_network_not_found;
-        extern const std::string id_custom_network_with_this_name;
-        extern const std::string id_custom_servers_and_validation;
-        extern const std::string id_customize_2fa_expiration_of;
-        extern const std::string id_d6_confirmations;
-        extern const std::string id_d_asset_in_this_account;
-        extern const std::string id_d_assets;
-        extern const std::string id_d_assets_in_this_account;
-        extern const std::string id_d_assets_in_total;
-        extern const std::string id_d_coins_selected;
-        extern const std::string id_d_words;
-        extern const std::string id_data_directory;
-        extern const std::string id_date;
-        extern const std::string id_day;
-        extern const std::string id_days;
-        extern const std::string id_days_remaining_s;
-        extern const std::string id_default_custom_fee_rate;
-        extern const std::string id_default_transaction_priority;
-        extern const std::string id_delete;
-        extern const std::string id_delete_credentials;
-        extern const std::string id_delete_permanently_your_wallet;
-        extern const std::string id_delete_s_twofactor;
-        extern const std::string id_delete_wallet;
-        extern const std::string id_deleting_your_pin_will_remove;
-        extern const std::string id_denomination;
-        extern const std::string id_denomination__exchange_rate;
-        extern const std::string id_deposit;
-        extern const std::string id_description;
-        extern const std::string id_descriptor;
-        extern const std::string id_details;
-        extern const std::string id_device;
-        extern const std::string id_devices;
-        extern const std::string id_different_passphrases_generate;
-        extern const std::string id_digital_wallets;
-        extern const std::string id_disable;
-        extern const std::string id_disable_authenticator;
-        extern const std::string id_disable_pin_access;
-        extern const std::string id_disable_pin_access_for_this;
-        extern const std::string id_disable_s_twofactor;
-        extern const std::string id_disabled;
-        extern const std::string id_disconnect;
-        extern const std::string id_display_values_in_s_and;
-        extern const std::string id_displays_the_progress_of_spv;
-        extern const std::string id_dispute_twofactor_reset;
-        extern const std::string id_disputed;
-        extern const std::string id_distributed_under_the_s_see;
-        extern const std::string id_do_you_have_the_backup;
-        extern const std::string id_domain;
-        extern const std::string id_done;
-        extern const std::string id_dont_ask_me_again;
-        extern const std::string id_dont_collect_data;
-        extern const std::string id_dont_have_a_jade_check_our_store;
-        extern const std::string id_dont_show_this_again;
-        extern const std::string id_dont_store_your_recovery_phrase;
-        extern const std::string id_dont_take_screenshots_of_your;
-        extern const std::string id_double_check_spv_with_other;
-        extern const std::string id_double_spend;
-        extern const std::string id_double_spend_by;
-        extern const std::string id_download_finished;
-        extern const std::string id_dust;
-        extern const std::string id_edit;
-        extern const std::string id_edit_fee;
-        extern const std::string id_email;
-        extern const std::string id_email_address;
-        extern const std::string id_emergency_recovery_phrase;
-        extern const std::string id_empty;
-        extern const std::string id_enable;
-        extern const std::string id_enable_2fa;
-        extern const std::string id_enable_bluetooth;
-        extern const std::string id_enable_bluetooth_from_system;
-        extern const std::string id_enable_custom_networks_debug;
-        extern const std::string id_enable_email_notifications_to;
-        extern const std::string id_enable_experimental_features;
-        extern const std::string id_enable_face_id;
-        extern const std::string id_enable_limited_usage_data;
-        extern const std::string id_enable_location_services;
-        extern const std::string id_enable_or_change_your_pin_to;
-        extern const std::string id_enable_spv;
-        extern const std::string id_enable_spv_and_modify_spv;
-        extern const std::string id_enable_testnet;
-        extern const std::string id_enable_testnet_in_app_settings;
-        extern const std::string id_enable_touch_id;
-        extern const std::string id_enable_twofactor_authentication;
-        extern const std::string id_enabled;
-        extern const std::string id_enabled_1s;
-        extern const std::string id_encryption_passphrase;
-        extern const std::string id_enhance_security;
-        extern const std::string id_enhanced_privacy;
-        extern const std::string id_enter;
-        extern const std::string id_enter_a_pgp_public_key_to_have;
-        extern const std::string id_enter_a_private_key_to_sweep;
-        extern const std::string id_enter_a_valid_onion_or_ip;
-        extern const std::string id_enter_a_valid_username;
-        extern const std::string id_enter_amount_in;
-        extern const std::string id_enter_an_address;
-        extern const std::string id_enter_an_address_or_sweep_paper;
-        extern const std::string id_enter_and_confirm_a_unique_pin;
-        extern const std::string id_enter_new_email;
-        extern const std::string id_enter_phone_number;
-        extern const std::string id_enter_pin;
-        extern const std::string id_enter_pin_on_jade;
-        extern const std::string id_enter_the_email_for_which_you;
-        extern const std::string id_enter_the_matching_words;
-        extern const std::string id_enter_the_pin_for_your_hardware;
-        extern const std::string id_enter_your_12_24_or_27_words;
-        extern const std::string id_enter_your_24_or_27_words;
-        extern const std::string id_enter_your_27_words_recovery;
-        extern const std::string id_enter_your_6digit_pin_to_access;
-        extern const std::string id_enter_your_email_address;
-        extern const std::string id_enter_your_pin;
-        extern const std::string id_enter_your_recovery_phrase;
-        extern const std::string id_enter_your_s_wallet_mnemonic;
-        extern const std::string id_enter_your_wallet_mnemonic;
-        extern const std::string id_enter_your_xpub;
-        extern const std::string id_enter_your_xpub_to_add_a;
-        extern const std::string id_enter_yournrecovery_phrase;
-        extern const std::string id_entity;
-        extern const std::string id_ephemeral_wallets;
-        extern const std::string id_error;
-        extern const std::string id_error_logging_in_with_hardware;
-        extern const std::string id_error_nfc_tag_not_writable;
-        extern const std::string id_error_nfc_tag_too_small;
-        extern const std::string id_error_passphrases_do_not_match;
-        extern const std::string id_error_setting_fee_rate;
-        extern const std::string id_establishing_session;
-        extern const std::string id_estimated_blocks_until;
-        extern const std::string id_everything_you_need_to_take;
-        extern const std::string id_example_89014283334011612858333;
-        extern const std::string id_exchange_rate;
-        extern const std::string id_existing_recovery_phrase;
-        extern const std::string id_existing_wallets;
-        extern const std::string id_exit_guide;
-        extern const std::string id_expand_sidebar;
-        extern const std::string id_experimental;
-        extern const std::string id_experimental_feature;
-        extern const std::string id_experimental_features_might;
-        extern const std::string id_expiration;
-        extern const std::string id_explore_your_wallet;
-        extern const std::string id_export;
-        extern const std::string id_export_transactions_to_csv_file;
-        extern const std::string id_exports_an_accounts_extended;
-        extern const std::string id_extended_public_key;
-        extern const std::string id_extended_public_keys;
-        extern const std::string id_face_id;
-        extern const std::string id_failed_to_load_asset_icons;
-        extern const std::string id_failed_to_load_asset_registry;
-        extern const std::string id_fast;
-        extern const std::string id_fast_transactions_on_the;
-        extern const std::string id_faster_more_confidential;
-        extern const std::string id_fastest;
-        extern const std::string id_fee;
-        extern const std::string id_fee_amount_size_fee_rate;
-        extern const std::string id_fee_rate;
-        extern const std::string id_fee_rate_is_above_maximum;
-        extern const std::string id_fee_rate_is_below_minimum;
-        extern const std::string id_fee_rate_must_be_at_least_s;
-        extern const std::string id_fee_rate_s;
-        extern const std::string id_fee_s__s;
-        extern const std::string id_feedback;
-        extern const std::string id_fees_are_collected_by_bitcoin;
-        extern const std::string id_fees_are_too_low;
-        extern const std::string id_fetching_new_firmware;
-        extern const std::string id_filters;
-        extern const std::string id_finishing_up;
-        extern const std::string id_firmware;
-        extern const std::string id_firmware_update;
-        extern const std::string id_firmware_update_completed;
-        extern const std::string id_firmware_upgrade;
-        extern const std::string id_firmware_version_s;
-        extern const std::string id_follow_the_instructions_of_your;
-        extern const std::string id_follow_the_instructions_on_jade;
-        extern const std::string id_follow_the_instructions_on_your;
-        extern const std::string id_for_investors;
-        extern const std::string id_for_long_term_storage;
-        extern const std::string id_for_more_information_read_more;
-        extern const std::string id_for_most_users;
-        extern const std::string id_from;
-        extern const std::string id_funds_received;
-        extern const std::string id_funds_received_in_this;
-        extern const std::string id_general;
-        extern const std::string id_generate;
-        extern const std::string id_generate_a_new_recovery_phrase;
-        extern const std::string id_generate_new_address;
-        extern const std::string id_get_code;
-        extern const std::string id_get_id;
-        extern const std::string id_get_jade;
-        extern const std::string id_give_bluetooth_permissions;
-        extern const std::string id_give_us_your_feedback;
-        extern const std::string id_go_to_account;
-        extern const std::string id_go_to_receive_to_get_your;
-        extern const std::string id_go_to_wallet;
-        extern const std::string id_got_it_written_down_great_you;
-        extern const std::string id_green_is_a_noncustodial_wallet;
-        extern const std::string id_green_logo;
-        extern const std::string id_green_mnemonic_qr_code;
-        extern const std::string id_green_only_supports_one_pin_for;
-        extern const std::string id_green_only_supports_one_pin_per;
-        extern const std::string id_green_uses_biometric;
-        extern const std::string id_green_uses_bluetooth_for;
-        extern const std::string id_green_uses_bluetooth_to_connect;
-        extern const std::string id_green_uses_multisig_with_one;
-        extern const std::string id_hardware_devices;
-        extern const std::string id_hardware_security;
-        extern const std::string id_hardware_wallet;
-        extern const std::string id_hardware_wallet_support_for;
-        extern const std::string id_hardware_wallets;
-        extern const std::string id_hash;
-        extern const std::string id_hash_s;
-        extern const std::string id_help;
-        extern const std::string id_help_green_improve;
-        extern const std::string id_here;
-        extern const std::string id_hex;
-        extern const std::string id_hide_advanced_options;
-        extern const std::string id_hide_amounts;
-        extern const std::string id_hide_assets;
-        extern const std::string id_hide_details;
-        extern const std::string id_high;
-        extern const std::string id_hold_button_to_send;
-        extern const std::string id_hold_the_green_button_on_the;
-        extern const std::string id_hold_your_nfc_tag_close_to_the;
-        extern const std::string id_home;
-        extern const std::string id_hour;
-        extern const std::string id_hours;
-        extern const std::string id_how_to_stop_this_reset;
-        extern const std::string id_i_agree_to_the;
-        extern const std::string id_i_agree_to_the_terms_of_service;
-        extern const std::string id_i_confirm_i_have_read_and;
-        extern const std::string id_i_confirm_i_want_to_delete_this;
-        extern const std::string id_i_confirm_i_want_to_disable_pin;
-        extern const std::string id_i_forgot_my_password;
-        extern const std::string id_i_fund_via_an_onchain_bitcoin;
-        extern const std::string id_i_lost_my_2fa;
-        extern const std::string id_i_secured_the_mnemonic_and_i;
-        extern const std::string id_i_typed_all_my_recovery_phrase;
-        extern const std::string id_i_understand_amounts_could_be;
-        extern const std::string id_id;
-        extern const std::string id_if_for_any_reason_you_cant;
-        extern const std::string id_if_you_agree_green_will_collect;
-        extern const std::string id_if_you_are_the_rightful_owner;
-        extern const std::string id_if_you_did_not_request_the;
-        extern const std::string id_if_you_forget_it_or_lose_it;
-        extern const std::string id_if_you_have_access_to_a;
-        extern const std::string id_if_you_have_some_coins_on_the;
-        extern const std::string id_if_you_initiated_the_2fa_reset;
-        extern const std::string id_import;
-        extern const std::string id_import_a_multisig_shield_wallet;
-        extern const std::string id_import_a_wallet_created_on;
-        extern const std::string id_import_a_wallet_created_with;
-        extern const std::string id_import_from_file;
-        extern const std::string id_in_progress;
-        extern const std::string id_inbound_liquidity;
-        extern const std::string id_incoming;
-        extern const std::string id_inconsistent_data_provided_for;
-        extern const std::string id_increase_fee;
-        extern const std::string id_increase_inbound_capacity_now;
-        extern const std::string id_increase_security;
-        extern const std::string id_increase_the_security_of_your;
-        extern const std::string id_information_not_available;
-        extern const std::string id_initialize_and_create_wallet;
-        extern const std::string id_initialize_jade_for_testnet;
-        extern const std::string id_initialized;
-        extern const std::string id_initializing_tor;
-        extern const std::string id_insert_your_email_to_receive;
-        extern const std::string id_insert_your_phone_number_to;
-        extern const std::string id_install_version_s;
-        extern const std::string id_instant;
-        extern const std::string id_insufficient_funds;
-        extern const std::string id_insufficient_lbtc_for_fees;
-        extern const std::string id_insufficient_lbtc_to_send_a;
-        extern const std::string id_invalid_address;
-        extern const std::string id_invalid_amount;
-        extern const std::string id_invalid_asset_id;
-        extern const std::string id_invalid_clipboard_contents;
-        extern const std::string id_invalid_merkle_proof;
-        extern const std::string id_invalid_mnemonic;
-        extern const std::string id_invalid_mnemonic_continue;
-        extern const std::string id_invalid_mnemonic_must_be_24_or;
-        extern const std::string id_invalid_network_configuration;
-        extern const std::string id_invalid_payment_request_assetid;
-        extern const std::string id_invalid_pgp_key;
-        extern const std::string id_invalid_phone_number_format;
-        extern const std::string id_invalid_pin;
-        extern const std::string id_invalid_pin_remaining_attempts;
-        extern const std::string id_invalid_pin_you_dont_have_any;
-        extern const std::string id_invalid_pin_you_have_1d;
-        extern const std::string id_invalid_private_key;
-        extern const std::string id_invalid_recovery_phrase;
-        extern const std::string id_invalid_replacement_fee_rate;
-        extern const std::string id_invalid_status_check_that_your;
-        extern const std::string id_invalid_swap_proposal;
-        extern const std::string id_invalid_twofactor_code;
-        extern const std::string id_invalid_url;
-        extern const std::string id_invalid_xpub;
-        extern const std::string id_invoice_expired;
-        extern const std::string id_invoices;
-        extern const std::string id_is_a_noncustodial;
-        extern const std::string id_issuer;
-        extern const std::string id_issuer_domain_s;
-        extern const std::string id_it_looks_like_you_have_no;
-        extern const std::string id_jade_is_a_specialized_device;
-        extern const std::string id_jade_is_an_isolated_device_not;
-        extern const std::string id_jade_is_an_opensource_hardware;
-        extern const std::string id_jade_unlocked;
-        extern const std::string id_jade_was_initialized_for_testnet;
-        extern const std::string id_just_a_few_more_steps_to_get;
-        extern const std::string id_label;
-        extern const std::string id_language;
-        extern const std::string id_last_attempt_if_failed_you_will;
-        extern const std::string id_last_ping_1d_ms;
-        extern const std::string id_later;
-        extern const std::string id_latest_transactions;
-        extern const std::string id_lbtc_has_no_issuer_and_is;
-        extern const std::string id_learn_more;
-        extern const std::string id_learn_more_about_amp_the_assets;
-        extern const std::string id_learn_more_about_s;
-        extern const std::string id_ledger_dashboard_detected;
-        extern const std::string id_ledger_devices;
-        extern const std::string id_ledger_supports_a_limited_set;
-        extern const std::string id_legacy;
-        extern const std::string id_legacy_account;
-        extern const std::string id_legacy_bip44;
-        extern const std::string id_legacy_script_coins;
-        extern const std::string id_legacy_segwit;
-        extern const std::string id_legacy_segwit_account;
-        extern const std::string id_legacy_segwit_bip49;
-        extern const std::string id_lets_get_you_set_up;
-        extern const std::string id_lightning;
-        extern const std::string id_lightning_invoice;
-        extern const std::string id_lightning_invoice__lnurl;
-        extern const std::string id_lightning_invoice_is_expired;
-        extern const std::string id_lightning_network_account;
-        extern const std::string id_limits_s__s;
-        extern const std::string id_liquid_electrum_server;
-        extern const std::string id_liquid_is_a_sidechainbased;
-        extern const std::string id_liquid_securities;
-        extern const std::string id_liquid_testnet_electrum_server;
-        extern const std::string id_liquid_testnet_wallets;
-        extern const std::string id_liquid_wallet;
-        extern const std::string id_liquid_wallets;
-        extern const std::string id_loading;
-        extern const std::string id_loading_accounts;
-        extern const std::string id_loading_assets;
-        extern const std::string id_loading_transactions;
-        extern const std::string id_loading_wallet;
-        extern const std::string id_location_services_are_disabled;
-        extern const std::string id_lock;
-        extern const std::string id_lock_after_1_minute;
-        extern const std::string id_lock_immediately;
-        extern const std::string id_locked;
-        extern const std::string id_locked_coins_will_not_be_spent;
-        extern const std::string id_locking_coins;
-        extern const std::string id_locking_coins_can_help_protect;
-        extern const std::string id_log_file;
-        extern const std::string id_log_in;
-        extern const std::string id_log_in_into_your_s_wallet;
-        extern const std::string id_log_in_to_your_multisig_shield;
-        extern const std::string id_log_in_using_mnemonic;
-        extern const std::string id_log_in_via_watchonly_to_receive;
-        extern const std::string id_log_out;
-        extern const std::string id_logged_in_wallets;
-        extern const std::string id_logging_in;
-        extern const std::string id_login;
-        extern const std::string id_login_failed;
-        extern const std::string id_login_options;
-        extern const std::string id_login_with_biometrics;
-        extern const std::string id_login_with_bip39_passphrase;
-        extern const std::string id_logout;
-        extern const std::string id_logout_and_switch;
-        extern const std::string id_look_at_the_device_for_the;
-        extern const std::string id_looking_for_device;
-        extern const std::string id_looking_for_wallets;
-        extern const std::string id_looks_like_you_havent_used_a;
-        extern const std::string id_low;
-        extern const std::string id_main_account;
-        extern const std::string id_make_sure_to_be_in_a_private;
-        extern const std::string id_make_sure_you_are_alone_and_no;
-        extern const std::string id_make_sure_you_got_everything;
-        extern const std::string id_make_sure_you_have_enabled_otg;
-        extern const std::string id_make_sure_you_made_a_proper;
-        extern const std::string id_malleated;
-        extern const std::string id_managed_assets;
-        extern const std::string id_managed_assets_account;
-        extern const std::string id_managed_assets_accounts_are;
-        extern const std::string id_manual_coin_selection;
-        extern const std::string id_manual_restore;
-        extern const std::string id_max_limit_s;
-        extern const std::string id_max_payable_amount;
-        extern const std::string id_max_receivable_amount;
-        extern const std::string id_max_single_payment_amount;
-        extern const std::string id_medium;
-        extern const std::string id_memo;
-        extern const std::string id_message;
-        extern const std::string id_message_hash;
-        extern const std::string id_migrate_another_wallet;
-        extern const std::string id_migrating_to_blockstream_green;
-        extern const std::string id_minimum;
-        extern const std::string id_minute;
-        extern const std::string id_minutes;
-        extern const std::string id_mnemonic;
-        extern const std::string id_mnemonic_not_available;
-        extern const std::string id_model;
-        extern const std::string id_month;
-        extern const std::string id_months;
-        extern const std::string id_more_info;
-        extern const std::string id_more_options;
-        extern const std::string id_move_to_2fa_protected;
-        extern const std::string id_multi_server_validation;
-        extern const std::string id_multiple_assets;
-        extern const std::string id_multisig;
-        extern const std::string id_multisig_shield;
-        extern const std::string id_my_assets;
-        extern const std::string id_my_notes;
-        extern const std::string id_name;
-        extern const std::string id_native_segwit;
-        extern const std::string id_need_help;
-        extern const std::string id_network;
-        extern const std::string id_network_configuration;
-        extern const std::string id_network_fee;
-        extern const std::string id_network_monitor;
-        extern const std::string id_networks;
-        extern const std::string id_new_account_created;
-        extern const std::string id_new_accounts_functionality;
-        extern const std::string id_new_fee;
-        extern const std::string id_new_incoming_transaction_in;
-        extern const std::string id_new_jade_firmware_available;
-        extern const std::string id_new_jade_firmware_required;
-        extern const std::string id_new_outgoing_transaction_from;
-        extern const std::string id_new_recovery_phrase;
-        extern const std::string id_new_s_transaction_of_s_in;
-        extern const std::string id_new_transaction;
-        extern const std::string id_new_transaction_involving;
-        extern const std::string id_new_version;
-        extern const std::string id_new_wallet;
-        extern const std::string id_next;
-        extern const std::string id_nfc_logo;
-        extern const std::string id_nfc_tags_written;
-        extern const std::string id_no_addresses;
-        extern const std::string id_no_amount_specified;
-        extern const std::string id_no_archived_accounts;
-        extern const std::string id_no_asset_in_this_account;
-        extern const std::string id_no_attempts_remaining;
-        extern const std::string id_no_coins_selected;
-        extern const std::string id_no_device_connected;
-        extern const std::string id_no_existing_wallet_could_be;
-        extern const std::string id_no_more_assets;
-        extern const std::string id_no_multisig_shield_wallet;
-        extern const std::string id_no_peers_connected;
-        extern const std::string id_no_personal_data_will_be_shared;
-        extern const std::string id_no_pin_provided_exiting;
-        extern const std::string id_no_recipients;
-        extern const std::string id_no_registered_name_for_this;
-        extern const std::string id_no_registered_ticker_for_this;
-        extern const std::string id_no_utxos_found;
-        extern const std::string id_node_info;
-        extern const std::string id_non_confidential;
-        extern const std::string id_non_confidential_transaction;
-        extern const std::string id_nonconfidential_addresses_not;
-        extern const std::string id_noradio_firmware;
-        extern const std::string id_normal;
-        extern const std::string id_not_a_valid_email_address;
-        extern const std::string id_not_a_valid_phone_number;
-        extern const std::string id_not_a_valid_word;
-        extern const std::string id_not_available_noradio_build;
-        extern const std::string id_not_confidential;
-        extern const std::string id_not_connected_connecting_in_ds_;
-        extern const std::string id_not_initialized;
-        extern const std::string id_not_now;
-        extern const std::string id_not_on_longest_chain;
-        extern const std::string id_note;
-        extern const std::string id_note_down_your_recovery_phrase;
-        extern const std::string id_notifications;
-        extern const std::string id_now;
-        extern const std::string id_of_24;
-        extern const std::string id_of_s;
-        extern const std::string id_offline_key_storage;
-        extern const std::string id_ok;
-        extern const std::string id_on_average;
-        extern const std::string id_once_selected_this_spending;
-        extern const std::string id_onchain_address;
-        extern const std::string id_onchain_swaps;
-        extern const std::string id_one_attempt_remaining;
-        extern const std::string id_one_network_must_be_selected;
-        extern const std::string id_onion_addresses_require_tor;
-        extern const std::string id_only_connect_to_trusted_nodes;
-        extern const std::string id_only_this_time;
-        extern const std::string id_open;
-        extern const std::string id_operation_failure;
-        extern const std::string id_optimal_if_you_rarely_spend;
-        extern const std::string id_optimal_if_you_spend_coins;
-        extern const std::string id_optional;
-        extern const std::string id_optional_memo;
-        extern const std::string id_optional_password;
-        extern const std::string id_or;
-        extern const std::string id_original_swap_address;
-        extern const std::string id_os__app_version_loading_times;
-        extern const std::string id_our_support_page;
-        extern const std::string id_outdated_hardware_wallet;
-        extern const std::string id_outgoing;
-        extern const std::string id_output_descriptors;
-        extern const std::string id_overview;
-        extern const std::string id_p2sh;
-        extern const std::string id_p2wsh;
-        extern const std::string id_page_visits_button_presses;
-        extern const std::string id_passphrase;
-        extern const std::string id_passphrase_protected;
-        extern const std::string id_password;
-        extern const std::string id_password_protected;
-        extern const std::string id_paste;
-        extern const std::string id_paste_an_existing_proposal;
-        extern const std::string id_path_used_for_signing;
-        extern const std::string id_payment_requested_by_s;
-        extern const std::string id_payments_to_self_are_not;
-        extern const std::string id_pending_confirmation;
-        extern const std::string id_permanent_2fa_account_ideal_for;
-        extern const std::string id_permanently_block_this_wallet;
-        extern const std::string id_personal_electrum_server;
-        extern const std::string id_pgp_key;
-        extern const std::string id_phone_call;
-        extern const std::string id_phone_number;
-        extern const std::string id_pin;
-        extern const std::string id_pin_access_disabled;
-        extern const std::string id_pin_has_to_be_between_4_and_15;
-        extern const std::string id_pins_do_not_match_please_try;
-        extern const std::string id_please_activate_at_least_one;
-        extern const std::string id_please_contribute_if_you_find;
-        extern const std::string id_please_disable_biometric;
-        extern const std::string id_please_disconnect_your_ledger;
-        extern const std::string id_please_enable_another;
-        extern const std::string id_please_enable_camera;
-        extern const std::string id_please_enable_pin;
-        extern const std::string id_please_enter_the_passphrase_for;
-        extern const std::string id_please_follow_the_instructions;
-        extern const std::string id_please_hold_on_while_your;
-        extern const std::string id_please_provide_your_1s;
-        extern const std::string id_please_provide_your_1s_code;
-        extern const std::string id_please_provide_your_passphrase;
-        extern const std::string id_please_reconnect_your_hardware;
-        extern const std::string id_please_secure_your_mnemonic_and;
-        extern const std::string id_please_select_the_checkbox;
-        extern const std::string id_please_set_and_enable_socks5;
-        extern const std::string id_please_tap_card;
-        extern const std::string id_please_verify_that_the_address;
-        extern const std::string id_please_verify_that_this_address;
-        extern const std::string id_please_wait_until_your_ledger;
-        extern const std::string id_power_on_jade;
-        extern const std::string id_precision;
-        extern const std::string id_previous_fee;
-        extern const std::string id_price_feed;
-        extern const std::string id_print_backup_template;
-        extern const std::string id_privacy_policy;
-        extern const std::string id_private_but_less_stable;
-        extern const std::string id_private_key;
-        extern const std::string id_problem_with_key_1s;
-        extern const std::string id_protect_your_bitcoin_with_a;
-        extern const std::string id_provide_this_id_to_the_asset;
-        extern const std::string id_provide_your_amp_id_to_the;
-        extern const std::string id_proxy_host;
-        extern const std::string id_proxy_port;
-        extern const std::string id_proxy_settings;
-        extern const std::string id_pseudonymous_identifier_country;
-        extern const std::string id_qr_code;
-        extern const std::string id_qr_scanner;
-        extern const std::string id_quick_setup_2fa_account_ideal;
-        extern const std::string id_radio_firmware;
-        extern const std::string id_rate;
-        extern const std::string id_rate_us;
-        extern const std::string id_rate_your_experience;
-        extern const std::string id_read_more;
-        extern const std::string id_read_more_at_our_s;
-        extern const std::string id_ready;
-        extern const std::string id_ready_to_start;
-        extern const std::string id_receive;
-        extern const std::string id_receive_any_liquid_asset;
-        extern const std::string id_receive_email_notifications_for;
-        extern const std::string id_received;
-        extern const std::string id_received_on;
-        extern const std::string id_receiving;
-        extern const std::string id_recently_used_wallets;
-        extern const std::string id_recipient;
-        extern const std::string id_recipient_address;
-        extern const std::string id_recovery;
-        extern const std::string id_recovery_and_notifications;
-        extern const std::string id_recovery_key_type;
-        extern const std::string id_recovery_mnemonic;
-        extern const std::string id_recovery_phrase;
-        extern const std::string id_recovery_phrase_check;
-        extern const std::string id_recovery_phrase_length;
-        extern const std::string id_recovery_phrases_key_material;
-        extern const std::string id_recovery_tool;
-        extern const std::string id_recovery_transaction_emails;
-        extern const std::string id_recovery_transaction_request;
-        extern const std::string id_recovery_transactions;
-        extern const std::string id_recovery_words;
-        extern const std::string id_recovery_xpub;
-        extern const std::string id_redeem;
-        extern const std::string id_redeem_your_deposited_funds;
-        extern const std::string id_redeposited;
-        extern const std::string id_reference_exchange_rate;
-        extern const std::string id_refresh;
-        extern const std::string id_refund;
-        extern const std::string id_refund_in_progress;
-        extern const std::string id_refund_initiated;
-        extern const std::string id_refundable;
-        extern const std::string id_reload;
-        extern const std::string id_remember_device;
-        extern const std::string id_remember_device_connection;
-        extern const std::string id_remember_me;
-        extern const std::string id_remember_my_device;
-        extern const std::string id_remove;
-        extern const std::string id_remove_custom_network;
-        extern const std::string id_remove_wallet;
-        extern const std::string id_rename;
-        extern const std::string id_rename_account;
-        extern const std::string id_rename_wallet;
-        extern const std::string id_replaceable;
-        extern const std::string id_report;
-        extern const std::string id_request_amount;
-        extern const std::string id_request_failed;
-        extern const std::string id_request_recovery_transactions;
-        extern const std::string id_request_sent;
-        extern const std::string id_request_twofactor_reset;
-        extern const std::string id_requested_fee_rate_too_low;
-        extern const std::string id_reset;
-        extern const std::string id_reset_spv;
-        extern const std::string id_resetting_your_twofactor_takes;
-        extern const std::string id_restore;
-        extern const std::string id_restore_a_blockstream_green;
-        extern const std::string id_restore_a_singlesig_wallet;
-        extern const std::string id_restore_a_wallet;
-        extern const std::string id_restore_green_wallet;
-        extern const std::string id_restore_temporary_wallet;
-        extern const std::string id_restore_wallet;
-        extern const std::string id_restore_with_recovery_phrase;
-        extern const std::string id_restoring_your_wallet;
-        extern const std::string id_review;
-        extern const std::string id_review_account_information;
-        extern const std::string id_review_output_s;
-        extern const std::string id_s_blocks_left;
-        extern const std::string id_s_from_s;
-        extern const std::string id_s_is_a_liquid_asset_you_can;
-        extern const std::string id_s_is_a_liquid_asset_you_need_a;
-        extern const std::string id_s_is_an_amp_asset_you_can;
-        extern const std::string id_s_is_an_amp_asset_you_need_an;
-        extern const std::string id_s_network;
-        extern const std::string id_s_will_send_you_the_funds_it;
-        extern const std::string id_safe_environment;
-        extern const std::string id_safely_stored;
-        extern const std::string id_save;
-        extern const std::string id_save_a_summary_of_your_accounts;
-        extern const std::string id_save_your_mnemonic;
-        extern const std::string id_scan_a_proposal;
-        extern const std::string id_scan_a_qr_code_for_spv_pairing;
-        extern const std::string id_scan_from_image;
-        extern const std::string id_scan_or_paste_your_extended;
-        extern const std::string id_scan_or_paste_your_public;
-        extern const std::string id_scan_qr_code;
-        extern const std::string id_scan_the_qr_code_with_an;
-        extern const std::string id_scan_to_send_here;
-        extern const std::string id_screen_lock;
-        extern const std::string id_search;
-        extern const std::string id_search_address;
-        extern const std::string id_second;
-        extern const std::string id_seconds;
-        extern const std::string id_security;
-        extern const std::string id_security_change;
-        extern const std::string id_see_archived_accounts_s;
-        extern const std::string id_see_our_privacy_policy_s;
-        extern const std::string id_see_our_terms_of_service_s;
-        extern const std::string id_segwit;
-        extern const std::string id_segwit_account;
-        extern const std::string id_segwit_bip84;
-        extern const std::string id_select_a_fiat_currency_and;
-        extern const std::string id_select_account;
-        extern const std::string id_select_an_app_on_s;
-        extern const std::string id_select_asset;
-        extern const std::string id_select_duration_of_twofactor;
-        extern const std::string id_select_initalize_to_create_a;
-        extern const std::string id_select_initialize_and_choose_to;
-        extern const std::string id_select_network;
-        extern const std::string id_select_the_s_app_on_your_ledger;
-        extern const std::string id_select_wallet;
-        extern const std::string id_select_watchonly_type;
-        extern const std::string id_select_word_number_d;
-        extern const std::string id_select_your_coins;
-        extern const std::string id_select_your_jade_to_login;
-        extern const std::string id_select_your_recovery_key;
-        extern const std::string id_send;
-        extern const std::string id_send_all;
-        extern const std::string id_send_all_funds;
-        extern const std::string id_send_all_requires_a_single;
-        extern const std::string id_send_and_receive_liquidbased;
-        extern const std::string id_send_error_report;
-        extern const std::string id_send_more_than_s_and_up_to_s_to;
-        extern const std::string id_send_to;
-        extern const std::string id_sending;
-        extern const std::string id_sending_request;
-        extern const std::string id_sensitive_information;
-        extern const std::string id_sent;
-        extern const std::string id_sent_to;
-        extern const std::string id_server_ip_and_port_ipport;
-        extern const std::string id_set_2fa_expiry;
-        extern const std::string id_set_a_limit_to_spend_without;
-        extern const std::string id_set_a_new_pin;
-        extern const std::string id_set_a_pin;
-        extern const std::string id_set_a_timeout_to_logout_after;
-        extern const std::string id_set_an_email_address_to_receive;
-        extern const std::string id_set_an_email_for_recovery;
-        extern const std::string id_set_custom_fee_rate;
-        extern const std::string id_set_locktime;
-        extern const std::string id_set_timelock;
-        extern const std::string id_set_twofactor_threshold;
-        extern const std::string id_set_up_a_passcode_for_your_ios;
-        extern const std::string id_set_up_a_screen_lock_for_your;
-        extern const std::string id_set_up_an_email_to_get;
-        extern const std::string id_set_up_credentials_to_access_in;
-        extern const std::string id_set_up_pgp_key_for;
-        extern const std::string id_set_up_twofactor_authentication;
-        extern const std::string id_set_up_watchonly;
-        extern const std::string id_set_up_watchonly_credentials;
-        extern const std::string id_set_wallet_name;
-        extern const std::string id_setting_up_your_wallet;
-        extern const std::string id_setting_updated;
-        extern const std::string id_settings;
-        extern const std::string id_setup_2fa_now;
-        extern const std::string id_setup_a_new_wallet;
-        extern const std::string id_setup_guide;
-        extern const std::string id_setup_jade;
-        extern const std::string id_setup_pin;
-        extern const std::string id_setup_pin_and_s;
-        extern const std::string id_setup_your_jade;
-        extern const std::string id_share;
-        extern const std::string id_share_address;
-        extern const std::string id_share_nonconfidential;
-        extern const std::string id_share_unblinding_data;
-        extern const std::string id_show;
-        extern const std::string id_show_address;
-        extern const std::string id_show_advanced_options;
-        extern const std::string id_show_all;
-        extern const std::string id_show_all_assets;
-        extern const std::string id_show_bitcoin_amounts_in;
-        extern const std::string id_show_coins_with_expiring;
-        extern const std::string id_show_details;
-        extern const std::string id_show_fiat;
-        extern const std::string id_show_lightning_invoice;
-        extern const std::string id_show_my_wallet_backup;
-        extern const std::string id_show_onchain_address;
-        extern const std::string id_show_qr_code;
-        extern const std::string id_show_recovery_phrase;
-        extern const std::string id_sign_message;
-        extern const std::string id_sign_transaction;
-        extern const std::string id_signature_validation_failed_if;
-        extern const std::string id_signup_in_progress;
-        extern const std::string id_simple;
-        extern const std::string id_simple__secure_selfcustody;
-        extern const std::string id_simple_portable_standard;
-        extern const std::string id_simplified_payment_verification;
-        extern const std::string id_singlesig;
-        extern const std::string id_singlesig_wallets_are_not_yet;
-        extern const std::string id_skip;
-        extern const std::string id_skip_not_recommended;
-        extern const std::string id_slide_to_send;
-        extern const std::string id_slow;
-        extern const std::string id_sms;
-        extern const std::string id_snnreset_this_setting_and_then;
-        extern const std::string id_socks5_hostname;
-        extern const std::string id_socks5_port;
-        extern const std::string id_socks5_proxy_and_port_must_be;
-        extern const std::string id_something_went_wrong;
-        extern const std::string id_spend_your_bitcoin_without_2fa;
-        extern const std::string id_spv_is_always_synchronized_on;
-        extern const std::string id_spv_mode_is_currently_available;
-        extern const std::string id_spv_not_fully_synced;
-        extern const std::string id_spv_notifications;
-        extern const std::string id_spv_reset_and_restarted;
-        extern const std::string id_spv_synchronization;
-        extern const std::string id_spv_synchronization_using_tor;
-        extern const std::string id_spv_unverified;
-        extern const std::string id_spv_verification;
-        extern const std::string id_standard;
-        extern const std::string id_standard_account;
-        extern const std::string id_standard_accounts_allow_you_to;
-        extern const std::string id_standard_wallet;
-        extern const std::string id_start_a_2fa_reset_process_if;
-        extern const std::string id_start_receiving_funds_and_set;
-        extern const std::string id_status;
-        extern const std::string id_step;
-        extern const std::string id_store_it_somewhere_safe;
-        extern const std::string id_submit;
-        extern const std::string id_success;
-        extern const std::string id_successfully_sent_your_funds;
-        extern const std::string id_support;
-        extern const std::string id_support_page;
-        extern const std::string id_swap;
-        extern const std::string id_swap_is_in_progress;
-        extern const std::string id_swap_proposal;
-        extern const std::string id_swapped;
-        extern const std::string id_sweep;
-        extern const std::string id_sweep_from_paper_wallet;
-        extern const std::string id_sweep_into_s;
-        extern const std::string id_switch_network;
-        extern const std::string id_synchronize_spv_on_mobile;
-        extern const std::string id_syou_need_ton1_reset_greens;
-        extern const std::string id_system_location;
-        extern const std::string id_system_message;
-        extern const std::string id_take_control_your_keys_your;
-        extern const std::string id_tap_on_the_card_to_view;
-        extern const std::string id_tap_to_restart_the_simplified;
-        extern const std::string id_tap_to_scan_a_qr_code_and;
-        extern const std::string id_taproot;
-        extern const std::string id_taproot_account;
-        extern const std::string id_taproot_bip86;
-        extern const std::string id_telegram;
-        extern const std::string id_terms_of_service;
-        extern const std::string id_terms_of_use;
-        extern const std::string id_testnet_and_liquid_testnet;
-        extern const std::string id_testnet_electrum_server;
-        extern const std::string id_testnet_wallets;
-        extern const std::string id_thank_you_for_downloading_green;
-        extern const std::string id_thank_you_for_your_feedback;
-        extern const std::string id_the_1_year_2fa_reset_process;
-        extern const std::string id_the_address_is_valid;
-        extern const std::string id_the_addresses_dont_match;
-        extern const std::string id_the_asset_registry_is_currently;
-        extern const std::string id_the_camera_has_a_problem_you;
-        extern const std::string id_the_default_value_is_90_days_if;
-        extern const std::string id_the_easier_safer_and_faster;
-        extern const std::string id_the_email_will_also_be_used_to;
-        extern const std::string id_the_hardware_wallet_you_are;
-        extern const std::string id_the_importance_of_twofactor;
-        extern const std::string id_the_liquid_network_is_a_bitcoin;
-        extern const std::string id_the_network_selected_on_the;
-        extern const std::string id_the_new_email_will_be_used_for;
-        extern const std::string id_the_new_firmware_requires_you;
-        extern const std::string id_the_password_cant_be_empty;
-        extern const std::string id_the_qr_code_does_not_include;
-        extern const std::string id_the_recovery_key_below_will_not;
-        extern const std::string id_the_recovery_phrase_can_be_used;
-        extern const std::string id_the_recovery_phrase_doesnt;
-        extern const std::string id_the_source_code_is_available_at;
-        extern const std::string id_the_transaction_contains;
-        extern const std::string id_the_username_cant_be_empty;
-        extern const std::string id_the_waiting_period_is_necessary;
-        extern const std::string id_there_are_no_results_for_the;
-        extern const std::string id_there_is_already_a_pin_set_for;
-        extern const std::string id_there_is_already_a_swap_in;
-        extern const std::string id_there_is_already_an_archived;
-        extern const std::string id_these_are_some_compatible;
-        extern const std::string id_these_settings_apply_for_every;
-        extern const std::string id_this_amount_is_below_the;
-        extern const std::string id_this_feature_is_coming_soon;
-        extern const std::string id_this_might_take_up_to_a;
-        extern const std::string id_this_signature_is_a_proof_of;
-        extern const std::string id_this_transaction_spent;
-        extern const std::string id_this_wallet_is_based_on_your;
-        extern const std::string id_this_wallet_operates_on_a_test;
-        extern const std::string id_this_will_disable_pin_login_for;
-        extern const std::string id_this_will_log_you_out_and;
-        extern const std::string id_ticker;
-        extern const std::string id_time_s;
-        extern const std::string id_tip_we_recommend_you_enable;
-        extern const std::string id_tip_you_can_use_the;
-        extern const std::string id_to;
-        extern const std::string id_to_authorize_the_transaction;
-        extern const std::string id_to_keep_you_in_control_of_your;
-        extern const std::string id_too_many_pin_attempts;
-        extern const std::string id_tor;
-        extern const std::string id_tor_connectivity_disabled;
-        extern const std::string id_tor_is_connected;
-        extern const std::string id_tor_is_not_yet_available_for;
-        extern const std::string id_tor_status;
-        extern const std::string id_tor_will_use_1s_and_only_work;
-        extern const std::string id_total;
-        extern const std::string id_total_assets;
-        extern const std::string id_total_balance;
-        extern const std::string id_total_with_fee;
-        extern const std::string id_touch_id;
-        extern const std::string id_touch_to_display;
-        extern const std::string id_touchface_id_not_available;
-        extern const std::string id_transaction_already_confirmed;
-        extern const std::string id_transaction_copied_to_clipboard;
-        extern const std::string id_transaction_details;
-        extern const std::string id_transaction_id;
-        extern const std::string id_transaction_sent;
-        extern const std::string id_transaction_status;
-        extern const std::string id_transactions;
-        extern const std::string id_troubleshoot;
-        extern const std::string id_try_again;
-        extern const std::string id_try_now;
-        extern const std::string id_turn_on_bluetooth_to_connect;
-        extern const std::string id_two_factor_authentication;
-        extern const std::string id_twofactor;
-        extern const std::string id_twofactor_authentication;
-        extern const std::string id_twofactor_authentication_expiry;
-        extern const std::string id_twofactor_expiration_period;
-        extern const std::string id_twofactor_protection_does_not;
-        extern const std::string id_twofactor_reset_in_progress;
-        extern const std::string id_twofactor_settings;
-        extern const std::string id_twofactor_threshold;
-        extern const std::string id_tx_count;
-        extern const std::string id_txid;
-        extern const std::string id_type_the_next_word;
-        extern const std::string id_unable_to_contact_the_green;
-        extern const std::string id_unarchive;
-        extern const std::string id_unarchive_account;
-        extern const std::string id_unblinding_data;
-        extern const std::string id_unconfirmed;
-        extern const std::string id_undo_2fa_dispute;
-        extern const std::string id_unknown;
-        extern const std::string id_unknown_bip21_parameter;
-        extern const std::string id_unknown_custom;
-        extern const std::string id_unknown_firmware;
-        extern const std::string id_unlock;
-        extern const std::string id_unlock_green;
-        extern const std::string id_unlock_jade_to_continue;
-        extern const std::string id_unlock_your_device_to_continue;
-        extern const std::string id_unlocked_coins_can_be_spent_and;
-        extern const std::string id_unlocking_coins;
-        extern const std::string id_unstable_internet_connection;
-        extern const std::string id_update;
-        extern const std::string id_updated;
-        extern const std::string id_updating_firmware;
-        extern const std::string id_uploading_firmware;
-        extern const std::string id_use_a_hardware_wallet_as_your;
-        extern const std::string id_use_a_public_key;
-        extern const std::string id_use_all_available_coins;
-        extern const std::string id_use_an_existing_recovery_phrase;
-        extern const std::string id_use_an_xpub_for_which_you_own;
-        extern const std::string id_use_android_screen_lock_to_log;
-        extern const std::string id_use_comma_separated_values_or;
-        extern const std::string id_use_hardware_device;
-        extern const std::string id_use_secure_display_and_screen;
-        extern const std::string id_use_the_jogwheel_to_select_the;
-        extern const std::string id_use_this_recovery_phrase_to;
-        extern const std::string id_use_your_email_to_receive;
-        extern const std::string id_user_contact_info_ip_address;
-        extern const std::string id_user_not_found_or_invalid;
-        extern const std::string id_username;
-        extern const std::string id_username_not_available;
-        extern const std::string id_value_must_be_between_144_and;
-        extern const std::string id_verified;
-        extern const std::string id_verify;
-        extern const std::string id_verify_on_device;
-        extern const std::string id_verify_recovery_phrase;
-        extern const std::string id_verify_your_bitcoin;
-        extern const std::string id_verify_your_pin;
-        extern const std::string id_verifying_transactions;
-        extern const std::string id_version;
-        extern const std::string id_version_1s;
-        extern const std::string id_version_1s_2s;
-        extern const std::string id_view_account;
-        extern const std::string id_view_archived_accounts;
-        extern const std::string id_view_archived_accounts_d;
-        extern const std::string id_view_in_explorer;
-        extern const std::string id_view_more;
-        extern const std::string id_visit_s_for_further_information;
-        extern const std::string id_visit_the_blockstream_help;
-        extern const std::string id_waiting_for_transaction;
-        extern const std::string id_wallet;
-        extern const std::string id_wallet_already_restored;
-        extern const std::string id_wallet_assets;
-        extern const std::string id_wallet_backup;
-        extern const std::string id_wallet_coins_will_require;
-        extern const std::string id_wallet_creation_failed;
-        extern const std::string id_wallet_found;
-        extern const std::string id_wallet_name;
-        extern const std::string id_wallet_not_found;
-        extern const std::string id_wallet_pockets;
-        extern const std::string id_wallet_transactions;
-        extern const std::string id_wallets;
-        extern const std::string id_warning;
-        extern const std::string id_warning_no_trusted_node_set;
-        extern const std::string id_warning_nononion_address;
-        extern const std::string id_warning_resetting_twofactor;
-        extern const std::string id_warning_there_is_already_a;
-        extern const std::string id_warning_wallet_locked_by;
-        extern const std::string id_warning_watchonly_credentials;
-        extern const std::string id_warning_you_need_a_positive;
-        extern const std::string id_watchonly;
-        extern const std::string id_watchonly_credentials;
-        extern const std::string id_watchonly_details;
-        extern const std::string id_watchonly_disabled;
-        extern const std::string id_watchonly_login;
-        extern const std::string id_watchonly_mode_can_be_activated;
-        extern const std::string id_watchonly_mode_cannot_be;
-        extern const std::string id_watchonly_wallet;
-        extern const std::string id_we_use_the_camera_to_scan_qr;
-        extern const std::string id_we_will_do_our_best_to_find_a;
-        extern const std::string id_welcome;
-        extern const std::string id_welcome_to;
-        extern const std::string id_welcome_to_blockstream_jade;
-        extern const std::string id_welcome_to_your_wallet;
-        extern const std::string id_well_done_you_can_continue;
-        extern const std::string id_well_done_you_can_continue_with;
-        extern const std::string id_well_get_you_set_up_in_no_time;
-        extern const std::string id_well_get_you_set_up_with_an_amp;
-        extern const std::string id_what_is_word_number_s;
-        extern const std::string id_what_type_of_account_would_you;
-        extern const std::string id_whats_collected;
-        extern const std::string id_whats_new;
-        extern const std::string id_whats_not_collected;
-        extern const std::string id_where_would_you_like_to;
-        extern const std::string id_whomever_can_access_your;
-        extern const std::string id_wireless;
-        extern const std::string id_withdraw;
-        extern const std::string id_withdraw_limits_s__s;
-        extern const std::string id_word;
-        extern const std::string id_word_d_of_d;
-        extern const std::string id_write_down_the_words;
-        extern const std::string id_write_down_your_recovery_phrase;
-        extern const std::string id_wrong_choice_check_your;
-        extern const std::string id_xpub;
-        extern const std::string id_year;
-        extern const std::string id_years;
-        extern const std::string id_you_are_not_connected;
-        extern const std::string id_you_are_not_connected_please;
-        extern const std::string id_you_are_now_connected;
-        extern const std::string id_you_are_redeeming_funds_from_s;
-        extern const std::string id_you_can_change_these_later_on;
-        extern const std::string id_you_can_send_up_to;
-        extern const std::string id_you_can_still_receive_funds_but;
-        extern const std::string id_you_can_sweep_s_of_your_funds;
-        extern const std::string id_you_can_use_your_wallet_to;
-        extern const std::string id_you_cannot_create_or_restore_a;
-        extern const std::string id_you_cannot_receive_more_than_s;
-        extern const std::string id_you_have_a_significant_amount;
-        extern const std::string id_you_have_clicked_a_payment_uri;
-        extern const std::string id_you_have_clicked_a_uri_select_a;
-        extern const std::string id_you_have_control_on_your_funds;
-        extern const std::string id_you_have_just_received_s;
-        extern const std::string id_you_have_no_coins_to_send;
-        extern const std::string id_you_have_received_s;
-        extern const std::string id_you_have_successfully_changed;
-        extern const std::string id_you_have_successfully_sent_a;
-        extern const std::string id_you_have_to_authenticate_using;
-        extern const std::string id_you_have_tor_enabled_are_you;
-        extern const std::string id_you_must_first_log_out_before;
-        extern const std::string id_you_must_save_this_mnemonic_now;
-        extern const std::string id_you_need_a_liquid_account_in;
-        extern const std::string id_you_only_have_one_twofactor;
-        extern const std::string id_you_will_be_asked_to_enter_your;
-        extern const std::string id_you_will_need_to_reenter_your;
-        extern const std::string id_you_will_see_your_coins_here;
-        extern const std::string id_youll_need_to_back_up_your;
-        extern const std::string id_youll_need_your_pin_to_log_in;
-        extern const std::string id_youll_need_your_recovery_phrase;
-        extern const std::string id_youll_see_your_coins_here_when;
-        extern const std::string id_your_2fa_expires_so_that_if_you;
-        extern const std::string id_your_bitcoin_and_liquid_assets;
-        extern const std::string id_your_bluetooth_adapter_is;
-        extern const std::string id_your_current_receive_capacity;
-        extern const std::string id_your_device_was_disconnected;
-        extern const std::string id_your_favourite_exchange_rate_is;
-        extern const std::string id_your_funds_are_secured_by;
-        extern const std::string id_your_funds_are_secured_by_a;
-        extern const std::string id_your_funds_are_secured_by_your;
-        extern const std::string id_your_funds_have_grown;
-        extern const std::string id_your_green_wallet_is_now_ready;
-        extern const std::string id_your_ios_device_might_not_be;
-        extern const std::string id_your_keys_secure_your_coins_on;
-        extern const std::string id_your_notifications_will_be;
-        extern const std::string id_your_pin_or_your_mnemonic_will;
-        extern const std::string id_your_s_sent_to_s_has_been;
-        extern const std::string id_your_settings_are_unsavednndo;
-        extern const std::string id_your_swap_proposal_is_generated;
-        extern const std::string id_your_transactions_will_be_shown;
-        extern const std::string id_your_twofactor_threshold_is_s;
-        extern const std::string id_your_wallet_backup_is_made_of;
-        extern const std::string id_your_wallet_is_locked_for_a;
-        extern const std::string id_your_wallet_is_locked_under_2fa;
-        extern const std::string id_your_wallet_is_not_yet_fully;
-        extern const std::string id_your_watchonly_username_and;
-        extern const std::string id_youve_entered_an_invalid_pin;
+        extern const std::string_view id_1030_minutes;
+        extern const std::string_view id_12_confirmations;
+        extern const std::string_view id_12_months_51840_blocks;
+        extern const std::string_view id_12_words;
+        extern const std::string_view id_15_months_65535_blocks;
+        extern const std::string_view id_1_double_check_all_of_your;
+        extern const std::string_view id_1d_2s_ago;
+        extern const std::string_view id_1d_minutes;
+        extern const std::string_view id_1s_blocks_left_2d;
+        extern const std::string_view id_1s_twofactor_setup;
+        extern const std::string_view id_24_words;
+        extern const std::string_view id_2_hours;
+        extern const std::string_view id_2fa_dispute_in_progress;
+        extern const std::string_view id_2fa_expired;
+        extern const std::string_view id_2fa_expiry;
+        extern const std::string_view id_2fa_isnt_set_up_yetnnyou_can;
+        extern const std::string_view id_2fa_methods;
+        extern const std::string_view id_2fa_protected;
+        extern const std::string_view id_2fa_reset_in_progress;
+        extern const std::string_view id_2fa_shield;
+        extern const std::string_view id_2fa_shield_account;
+        extern const std::string_view id_2fa_threshold;
+        extern const std::string_view id_2of2;
+        extern const std::string_view id_2of3;
+        extern const std::string_view id_2of3_account;
+        extern const std::string_view id_2of3_with_2fa;
+        extern const std::string_view id_2of3_with_2fa_shield;
+        extern const std::string_view id_4_hours;
+        extern const std::string_view id_5_seconds_minimum;
+        extern const std::string_view id_6_months_25920_blocks;
+        extern const std::string_view id_a_2of3_account_requires_two_out;
+        extern const std::string_view id_a_funding_fee_of_s_minimum_s_is;
+        extern const std::string_view id_a_new_transaction_has_just;
+        extern const std::string_view id_a_newer_version_of_blockstream;
+        extern const std::string_view id_a_powerful_hardware_wallet_for;
+        extern const std::string_view id_a_screen_lock_must_be_enabled;
+        extern const std::string_view id_a_set_up_funding_fee_of_s_s;
+        extern const std::string_view id_a_wallet_is_detected_on_this;
+        extern const std::string_view id_about;
+        extern const std::string_view id_accept;
+        extern const std::string_view id_access;
+        extern const std::string_view id_account;
+        extern const std::string_view id_account__asset;
+        extern const std::string_view id_account_address;
+        extern const std::string_view id_account_archived;
+        extern const std::string_view id_account_balance;
+        extern const std::string_view id_account_extended_public_keys;
+        extern const std::string_view id_account_for_special_assets;
+        extern const std::string_view id_account_has_been_archived;
+        extern const std::string_view id_account_has_been_removed;
+        extern const std::string_view id_account_id;
+        extern const std::string_view id_account_name;
+        extern const std::string_view id_account_type;
+        extern const std::string_view id_accounts;
+        extern const std::string_view id_accounts_summary;
+        extern const std::string_view id_action_canceled;
+        extern const std::string_view id_actions;
+        extern const std::string_view id_add_2fa_account;
+        extern const std::string_view id_add_a_note_only_you_can_see_it;
+        extern const std::string_view id_add_a_pgp_public_key_to_receive;
+        extern const std::string_view id_add_amount;
+        extern const std::string_view id_add_amount_optional;
+        extern const std::string_view id_add_an_amp_wallet;
+        extern const std::string_view id_add_another_wallet;
+        extern const std::string_view id_add_custom_network_by_qr_code;
+        extern const std::string_view id_add_custom_network_by_url;
+        extern const std::string_view id_add_new_account;
+        extern const std::string_view id_add_note;
+        extern const std::string_view id_add_recipient;
+        extern const std::string_view id_add_wallet;
+        extern const std::string_view id_adding_a_2fa;
+        extern const std::string_view id_additional_networks;
+        extern const std::string_view id_additional_security;
+        extern const std::string_view id_address;
+        extern const std::string_view id_address_1s;
+        extern const std::string_view id_address_copied_to_clipboard;
+        extern const std::string_view id_address_to_receive;
+        extern const std::string_view id_address_type;
+        extern const std::string_view id_address_verified;
+        extern const std::string_view id_address_was_filled_by_a_payment;
+        extern const std::string_view id_addresses;
+        extern const std::string_view id_advanced;
+        extern const std::string_view id_advanced_network_settings;
+        extern const std::string_view id_advanced_options;
+        extern const std::string_view id_advanced_options_for_your_third;
+        extern const std::string_view id_all;
+        extern const std::string_view id_all_assets;
+        extern const std::string_view id_all_coins;
+        extern const std::string_view id_all_networks;
+        extern const std::string_view id_all_of_the_accounts_in_your;
+        extern const std::string_view id_all_the_coins_received_or;
+        extern const std::string_view id_all_wallets;
+        extern const std::string_view id_allow_collection;
+        extern const std::string_view id_allow_data_collection;
+        extern const std::string_view id_allows_you_to_quickly_check;
+        extern const std::string_view id_always;
+        extern const std::string_view id_always_ask;
+        extern const std::string_view id_amount;
+        extern const std::string_view id_amount_above_maximum_allowed;
+        extern const std::string_view id_amount_below_minimum_allowed;
+        extern const std::string_view id_amount_below_the_dust_threshold;
+        extern const std::string_view id_amount_in_s;
+        extern const std::string_view id_amount_must_be_at_least_s;
+        extern const std::string_view id_amount_must_be_at_most_s;
+        extern const std::string_view id_amount_to_receive;
+        extern const std::string_view id_amp;
+        extern const std::string_view id_amp_account;
+        extern const std::string_view id_amp_accounts_are_only_available;
+        extern const std::string_view id_amp_id;
+        extern const std::string_view id_amp_wallet;
+        extern const std::string_view id_an_unidentified_error_occurred;
+        extern const std::string_view id_another_2fa_method_is_already;
+        extern const std::string_view id_any_wallet_found_will_be;
+        extern const std::string_view id_app_settings;
+        extern const std::string_view id_archive;
+        extern const std::string_view id_archive_account;
+        extern const std::string_view id_archived;
+        extern const std::string_view id_archived_account;
+        extern const std::string_view id_archived_accounts;
+        extern const std::string_view id_are_you_sure_you_want_to_delete;
+        extern const std::string_view id_are_you_sure_you_want_to_remove;
+        extern const std::string_view id_are_you_sure_you_want_to_view;
+        extern const std::string_view id_as_easy_as_snapping_a_photo;
+        extern const std::string_view id_asset;
+        extern const std::string_view id_asset_details;
+        extern const std::string_view id_asset_icons_are_missing_try;
+        extern const std::string_view id_asset_id;
+        extern const std::string_view id_asset_name;
+        extern const std::string_view id_assets;
+        extern const std::string_view id_assets_cannot_be_used_on_bitcoin;
+        extern const std::string_view id_at_least_8_characters_required;
+        extern const std::string_view id_attempts_remaining_d;
+        extern const std::string_view id_authenticate;
+        extern const std::string_view id_authenticate_address;
+        extern const std::string_view id_authenticate_to_view_the;
+        extern const std::string_view id_authentication_error_s;
+        extern const std::string_view id_authentication_failed;
+        extern const std::string_view id_authentication_successful;
+        extern const std::string_view id_authenticator_app;
+        extern const std::string_view id_authenticator_qr_code;
+        extern const std::string_view id_authenticator_secret_key;
+        extern const std::string_view id_auto_logout_timeout;
+        extern const std::string_view id_auto_logout_timeout_expired;
+        extern const std::string_view id_autolock_after;
+        extern const std::string_view id_available;
+        extern const std::string_view id_available_funds_s;
+        extern const std::string_view id_back;
+        extern const std::string_view id_back_up_recovery_phrase;
+        extern const std::string_view id_backup_recovery_phrase;
+        extern const std::string_view id_backup_the_recovery_mnemonic;
+        extern const std::string_view id_backup_your_mnemonic_before;
+        extern const std::string_view id_be_aware_other_apps_can_read_or;
+        extern const std::string_view id_be_sure_your_recovery_phrase_is;
+        extern const std::string_view id_before_you_backup;
+        extern const std::string_view id_biometric_login_is_disabled;
+        extern const std::string_view id_biometric_login_is_enabled;
+        extern const std::string_view id_biometrics_authentication;
+        extern const std::string_view id_bip39_passphrase;
+        extern const std::string_view id_bip39_passphrase_login;
+        extern const std::string_view id_bip49_accounts_allow_you_to;
+        extern const std::string_view id_bip84_accounts_allow_you_to;
+        extern const std::string_view id_bitcoin_and_liquid;
+        extern const std::string_view id_bitcoin_denomination;
+        extern const std::string_view id_bitcoin_electrum_server;
+        extern const std::string_view id_bitcoin_is_the_worlds_leading;
+        extern const std::string_view id_bitcoin_testnet_and_liquid;
+        extern const std::string_view id_bitcoin_wallet;
+        extern const std::string_view id_bitcoin_wallets;
+        extern const std::string_view id_block;
+        extern const std::string_view id_block_d;
+        extern const std::string_view id_block_height;
+        extern const std::string_view id_block_height_1d;
+        extern const std::string_view id_blocks;
+        extern const std::string_view id_blocks_confirmed;
+        extern const std::string_view id_blockstream_devices;
+        extern const std::string_view id_blockstream_does_not_have;
+        extern const std::string_view id_blockstream_green_needs_access;
+        extern const std::string_view id_blockstream_green_supports_both;
+        extern const std::string_view id_blockstream_greennsimple_and;
+        extern const std::string_view id_blockstream_store;
+        extern const std::string_view id_bluetooth;
+        extern const std::string_view id_btchip_is_not_set_up_please_set;
+        extern const std::string_view id_by_proceeding_to_the_next_steps;
+        extern const std::string_view id_cable;
+        extern const std::string_view id_call;
+        extern const std::string_view id_camera_problem;
+        extern const std::string_view id_cancel;
+        extern const std::string_view id_cancel_2fa_reset;
+        extern const std::string_view id_cancel_a_reset_to_unlock_your;
+        extern const std::string_view id_cancel_twofactor_reset;
+        extern const std::string_view id_cannot_remove_enabled_network;
+        extern const std::string_view id_cant_connect_to_this_url;
+        extern const std::string_view id_change;
+        extern const std::string_view id_change_address;
+        extern const std::string_view id_change_pin;
+        extern const std::string_view id_change_speed;
+        extern const std::string_view id_changing_reference_exchange;
+        extern const std::string_view id_channel_closure_initiated_you;
+        extern const std::string_view id_cheaper_and_more_private;
+        extern const std::string_view id_cheaper_singlesig_option;
+        extern const std::string_view id_check_device;
+        extern const std::string_view id_check_for_updates;
+        extern const std::string_view id_check_for_updates_on_startup;
+        extern const std::string_view id_check_our_6_easy_steps_to_be;
+        extern const std::string_view id_check_your_backup;
+        extern const std::string_view id_check_your_device;
+        extern const std::string_view id_choose;
+        extern const std::string_view id_choose_a_name_for_your_new;
+        extern const std::string_view id_choose_a_name_for_your_wallet;
+        extern const std::string_view id_choose_a_swap_option;
+        extern const std::string_view id_choose_a_usb_or_bluetooth;
+        extern const std::string_view id_choose_bluetooth_connection_on;
+        extern const std::string_view id_choose_method_to_authorize_the;
+        extern const std::string_view id_choose_recovery_phrase_length;
+        extern const std::string_view id_choose_security_policy;
+        extern const std::string_view id_choose_the_electrum_servers_you;
+        extern const std::string_view id_choose_the_security_policy_that;
+        extern const std::string_view id_choose_the_security_policy_you;
+        extern const std::string_view id_choose_this_version_to_connect;
+        extern const std::string_view id_choose_this_version_to_disable;
+        extern const std::string_view id_choose_twofactor_authentication;
+        extern const std::string_view id_choose_watchonly;
+        extern const std::string_view id_choose_your_network;
+        extern const std::string_view id_clear;
+        extern const std::string_view id_clear_cache;
+        extern const std::string_view id_click_to_copy;
+        extern const std::string_view id_click_to_receive_an_email_with;
+        extern const std::string_view id_close;
+        extern const std::string_view id_close_channel;
+        extern const std::string_view id_code;
+        extern const std::string_view id_coin;
+        extern const std::string_view id_coins;
+        extern const std::string_view id_coins_for_which_2fa_protection;
+        extern const std::string_view id_coins_locked;
+        extern const std::string_view id_coins_protected_by_the_legacy;
+        extern const std::string_view id_coins_protected_by_the_new;
+        extern const std::string_view id_coins_received_or_created;
+        extern const std::string_view id_coins_unlocked;
+        extern const std::string_view id_coins_whose_asset_and_amount;
+        extern const std::string_view id_coins_with_a_value_lower_than;
+        extern const std::string_view id_collapse_sidebar;
+        extern const std::string_view id_coming_soon;
+        extern const std::string_view id_communication_timed_out_make;
+        extern const std::string_view id_completed;
+        extern const std::string_view id_confidential;
+        extern const std::string_view id_confidential_transaction;
+        extern const std::string_view id_confirm;
+        extern const std::string_view id_confirm_action;
+        extern const std::string_view id_confirm_by_typing_the_wallet;
+        extern const std::string_view id_confirm_code;
+        extern const std::string_view id_confirm_coin_selection;
+        extern const std::string_view id_confirm_on_your_device;
+        extern const std::string_view id_confirm_passphrase;
+        extern const std::string_view id_confirm_refund;
+        extern const std::string_view id_confirm_swap;
+        extern const std::string_view id_confirm_transaction;
+        extern const std::string_view id_confirm_transaction_details_on;
+        extern const std::string_view id_confirm_update_on_your_jade;
+        extern const std::string_view id_confirm_version_on_jade;
+        extern const std::string_view id_confirm_via_2fa_that_you;
+        extern const std::string_view id_confirm_your_new_pin;
+        extern const std::string_view id_confirmation_in_d_blocks;
+        extern const std::string_view id_confirmation_time;
+        extern const std::string_view id_confirmations;
+        extern const std::string_view id_confirming_your_transaction;
+        extern const std::string_view id_congratulations;
+        extern const std::string_view id_connect_a_different_hardware;
+        extern const std::string_view id_connect_hardware_wallet;
+        extern const std::string_view id_connect_jade;
+        extern const std::string_view id_connect_jade_with_a_usb_cable;
+        extern const std::string_view id_connect_through_a_proxy;
+        extern const std::string_view id_connect_usb_cable_or_enable;
+        extern const std::string_view id_connect_using_usb_or_bluetooth;
+        extern const std::string_view id_connect_with_bluetooth;
+        extern const std::string_view id_connect_with_tor;
+        extern const std::string_view id_connect_your_jade_to_use_it;
+        extern const std::string_view id_connect_your_ledger_to_use_it;
+        extern const std::string_view id_connected_to_jade;
+        extern const std::string_view id_connected_wallets;
+        extern const std::string_view id_connecting;
+        extern const std::string_view id_connecting_through_tor;
+        extern const std::string_view id_connecting_to_a_trusted_node;
+        extern const std::string_view id_connecting_to_peers;
+        extern const std::string_view id_connecting_to_tor_onion_nodes;
+        extern const std::string_view id_connecting_to_your_device;
+        extern const std::string_view id_connection;
+        extern const std::string_view id_connection_failed;
+        extern const std::string_view id_connection_to_device_failed;
+        extern const std::string_view id_contact_support_at_s_or_visit_s;
+        extern const std::string_view id_continue;
+        extern const std::string_view id_continue_with_1s;
+        extern const std::string_view id_copied_to_clipboard;
+        extern const std::string_view id_copy;
+        extern const std::string_view id_copy_address;
+        extern const std::string_view id_copy_details;
+        extern const std::string_view id_copy_device_id;
+        extern const std::string_view id_copy_id;
+        extern const std::string_view id_copy_raw_transaction;
+        extern const std::string_view id_copy_support_id;
+        extern const std::string_view id_copy_swap_proposal;
+        extern const std::string_view id_copy_to_clipboard;
+        extern const std::string_view id_copy_transaction_id;
+        extern const std::string_view id_copy_unblinded_link;
+        extern const std::string_view id_copy_unblinding_data;
+        extern const std::string_view id_copy_uri;
+        extern const std::string_view id_copy_xpub;
+        extern const std::string_view id_correct_order;
+        extern const std::string_view id_could_not_recognized_qr_code;
+        extern const std::string_view id_country;
+        extern const std::string_view id_create;
+        extern const std::string_view id_create_a_new_proposal;
+        extern const std::string_view id_create_a_new_swap;
+        extern const std::string_view id_create_a_pin;
+        extern const std::string_view id_create_a_pin_to_access_your;
+        extern const std::string_view id_create_a_wallet_for_bitcoin;
+        extern const std::string_view id_create_account;
+        extern const std::string_view id_create_invoice;
+        extern const std::string_view id_create_new_account;
+        extern const std::string_view id_create_new_wallet;
+        extern const std::string_view id_create_temporary_wallet;
+        extern const std::string_view id_create_wallet;
+        extern const std::string_view id_create_your_first_account_to;
+        extern const std::string_view id_creating_wallet;
+        extern const std::string_view id_creating_your_s_account;
+        extern const std::string_view id_csv;
+        extern const std::string_view id_currency;
+        extern const std::string_view id_current_version;
+        extern const std::string_view id_custom;
+        extern const std::string_view id_custom_network_added_enable_it;
+        extern const std::string_view id_custom_network_not_found;
+        extern const std::string_view id_custom_network_with_this_name;
+        extern const std::string_view id_custom_servers_and_validation;
+        extern const std::string_view id_customize_2fa_expiration_of;
+        extern const std::string_view id_d6_confirmations;
+        extern const std::string_view id_d_asset_in_this_account;
+        extern const std::string_view id_d_assets;
+        extern const std::string_view id_d_assets_in_this_account;
+        extern const std::string_view id_d_assets_in_total;
+        extern const std::string_view id_d_coins_selected;
+        extern const std::string_view id_d_words;
+        extern const std::string_view id_data_directory;
+        extern const std::string_view id_date;
+        extern const std::string_view id_day;
+        extern const std::string_view id_days;
+        extern const std::string_view id_days_remaining_s;
+        extern const std::string_view id_default_custom_fee_rate;
+        extern const std::string_view id_default_transaction_priority;
+        extern const std::string_view id_delete;
+        extern const std::string_view id_delete_credentials;
+        extern const std::string_view id_delete_permanently_your_wallet;
+        extern const std::string_view id_delete_s_twofactor;
+        extern const std::string_view id_delete_wallet;
+        extern const std::string_view id_deleting_your_pin_will_remove;
+        extern const std::string_view id_denomination;
+        extern const std::string_view id_denomination__exchange_rate;
+        extern const std::string_view id_deposit;
+        extern const std::string_view id_description;
+        extern const std::string_view id_descriptor;
+        extern const std::string_view id_details;
+        extern const std::string_view id_device;
+        extern const std::string_view id_devices;
+        extern const std::string_view id_different_passphrases_generate;
+        extern const std::string_view id_digital_wallets;
+        extern const std::string_view id_disable;
+        extern const std::string_view id_disable_authenticator;
+        extern const std::string_view id_disable_pin_access;
+        extern const std::string_view id_disable_pin_access_for_this;
+        extern const std::string_view id_disable_s_twofactor;
+        extern const std::string_view id_disabled;
+        extern const std::string_view id_disconnect;
+        extern const std::string_view id_display_values_in_s_and;
+        extern const std::string_view id_displays_the_progress_of_spv;
+        extern const std::string_view id_dispute_twofactor_reset;
+        extern const std::string_view id_disputed;
+        extern const std::string_view id_distributed_under_the_s_see;
+        extern const std::string_view id_do_you_have_the_backup;
+        extern const std::string_view id_domain;
+        extern const std::string_view id_done;
+        extern const std::string_view id_dont_ask_me_again;
+        extern const std::string_view id_dont_collect_data;
+        extern const std::string_view id_dont_have_a_jade_check_our_store;
+        extern const std::string_view id_dont_show_this_again;
+        extern const std::string_view id_dont_store_your_recovery_phrase;
+        extern const std::string_view id_dont_take_screenshots_of_your;
+        extern const std::string_view id_double_check_spv_with_other;
+        extern const std::string_view id_double_spend;
+        extern const std::string_view id_double_spend_by;
+        extern const std::string_view id_download_finished;
+        extern const std::string_view id_dust;
+        extern const std::string_view id_edit;
+        extern const std::string_view id_edit_fee;
+        extern const std::string_view id_email;
+        extern const std::string_view id_email_address;
+        extern const std::string_view id_emergency_recovery_phrase;
+        extern const std::string_view id_empty;
+        extern const std::string_view id_enable;
+        extern const std::string_view id_enable_2fa;
+        extern const std::string_view id_enable_bluetooth;
+        extern const std::string_view id_enable_bluetooth_from_system;
+        extern const std::string_view id_enable_custom_networks_debug;
+        extern const std::string_view id_enable_email_notifications_to;
+        extern const std::string_view id_enable_experimental_features;
+        extern const std::string_view id_enable_face_id;
+        extern const std::string_view id_enable_limited_usage_data;
+        extern const std::string_view id_enable_location_services;
+        extern const std::string_view id_enable_or_change_your_pin_to;
+        extern const std::string_view id_enable_spv;
+        extern const std::string_view id_enable_spv_and_modify_spv;
+        extern const std::string_view id_enable_testnet;
+        extern const std::string_view id_enable_testnet_in_app_settings;
+        extern const std::string_view id_enable_touch_id;
+        extern const std::string_view id_enable_twofactor_authentication;
+        extern const std::string_view id_enabled;
+        extern const std::string_view id_enabled_1s;
+        extern const std::string_view id_encryption_passphrase;
+        extern const std::string_view id_enhance_security;
+        extern const std::string_view id_enhanced_privacy;
+        extern const std::string_view id_enter;
+        extern const std::string_view id_enter_a_pgp_public_key_to_have;
+        extern const std::string_view id_enter_a_private_key_to_sweep;
+        extern const std::string_view id_enter_a_valid_onion_or_ip;
+        extern const std::string_view id_enter_a_valid_username;
+        extern const std::string_view id_enter_amount_in;
+        extern const std::string_view id_enter_an_address;
+        extern const std::string_view id_enter_an_address_or_sweep_paper;
+        extern const std::string_view id_enter_and_confirm_a_unique_pin;
+        extern const std::string_view id_enter_new_email;
+        extern const std::string_view id_enter_phone_number;
+        extern const std::string_view id_enter_pin;
+        extern const std::string_view id_enter_pin_on_jade;
+        extern const std::string_view id_enter_the_email_for_which_you;
+        extern const std::string_view id_enter_the_matching_words;
+        extern const std::string_view id_enter_the_pin_for_your_hardware;
+        extern const std::string_view id_enter_your_12_24_or_27_words;
+        extern const std::string_view id_enter_your_24_or_27_words;
+        extern const std::string_view id_enter_your_27_words_recovery;
+        extern const std::string_view id_enter_your_6digit_pin_to_access;
+        extern const std::string_view id_enter_your_email_address;
+        extern const std::string_view id_enter_your_pin;
+        extern const std::string_view id_enter_your_recovery_phrase;
+        extern const std::string_view id_enter_your_s_wallet_mnemonic;
+        extern const std::string_view id_enter_your_wallet_mnemonic;
+        extern const std::string_view id_enter_your_xpub;
+        extern const std::string_view id_enter_your_xpub_to_add_a;
+        extern const std::string_view id_enter_yournrecovery_phrase;
+        extern const std::string_view id_entity;
+        extern const std::string_view id_ephemeral_wallets;
+        extern const std::string_view id_error;
+        extern const std::string_view id_error_logging_in_with_hardware;
+        extern const std::string_view id_error_nfc_tag_not_writable;
+        extern const std::string_view id_error_nfc_tag_too_small;
+        extern const std::string_view id_error_passphrases_do_not_match;
+        extern const std::string_view id_error_setting_fee_rate;
+        extern const std::string_view id_establishing_session;
+        extern const std::string_view id_estimated_blocks_until;
+        extern const std::string_view id_everything_you_need_to_take;
+        extern const std::string_view id_example_89014283334011612858333;
+        extern const std::string_view id_exchange_rate;
+        extern const std::string_view id_existing_recovery_phrase;
+        extern const std::string_view id_existing_wallets;
+        extern const std::string_view id_exit_guide;
+        extern const std::string_view id_expand_sidebar;
+        extern const std::string_view id_experimental;
+        extern const std::string_view id_experimental_feature;
+        extern const std::string_view id_experimental_features_might;
+        extern const std::string_view id_expiration;
+        extern const std::string_view id_explore_your_wallet;
+        extern const std::string_view id_export;
+        extern const std::string_view id_export_transactions_to_csv_file;
+        extern const std::string_view id_exports_an_accounts_extended;
+        extern const std::string_view id_extended_public_key;
+        extern const std::string_view id_extended_public_keys;
+        extern const std::string_view id_face_id;
+        extern const std::string_view id_failed_to_load_asset_icons;
+        extern const std::string_view id_failed_to_load_asset_registry;
+        extern const std::string_view id_fast;
+        extern const std::string_view id_fast_transactions_on_the;
+        extern const std::string_view id_faster_more_confidential;
+        extern const std::string_view id_fastest;
+        extern const std::string_view id_fee;
+        extern const std::string_view id_fee_amount_size_fee_rate;
+        extern const std::string_view id_fee_rate;
+        extern const std::string_view id_fee_rate_is_above_maximum;
+        extern const std::string_view id_fee_rate_is_below_minimum;
+        extern const std::string_view id_fee_rate_must_be_at_least_s;
+        extern const std::string_view id_fee_rate_s;
+        extern const std::string_view id_fee_s__s;
+        extern const std::string_view id_feedback;
+        extern const std::string_view id_fees_are_collected_by_bitcoin;
+        extern const std::string_view id_fees_are_too_low;
+        extern const std::string_view id_fetching_new_firmware;
+        extern const std::string_view id_filters;
+        extern const std::string_view id_finishing_up;
+        extern const std::string_view id_firmware;
+        extern const std::string_view id_firmware_update;
+        extern const std::string_view id_firmware_update_completed;
+        extern const std::string_view id_firmware_upgrade;
+        extern const std::string_view id_firmware_version_s;
+        extern const std::string_view id_follow_the_instructions_of_your;
+        extern const std::string_view id_follow_the_instructions_on_jade;
+        extern const std::string_view id_follow_the_instructions_on_your;
+        extern const std::string_view id_for_investors;
+        extern const std::string_view id_for_long_term_storage;
+        extern const std::string_view id_for_more_information_read_more;
+        extern const std::string_view id_for_most_users;
+        extern const std::string_view id_from;
+        extern const std::string_view id_funds_received;
+        extern const std::string_view id_funds_received_in_this;
+        extern const std::string_view id_general;
+        extern const std::string_view id_generate;
+        extern const std::string_view id_generate_a_new_recovery_phrase;
+        extern const std::string_view id_generate_new_address;
+        extern const std::string_view id_get_code;
+        extern const std::string_view id_get_id;
+        extern const std::string_view id_get_jade;
+        extern const std::string_view id_give_bluetooth_permissions;
+        extern const std::string_view id_give_us_your_feedback;
+        extern const std::string_view id_go_to_account;
+        extern const std::string_view id_go_to_receive_to_get_your;
+        extern const std::string_view id_go_to_wallet;
+        extern const std::string_view id_got_it_written_down_great_you;
+        extern const std::string_view id_green_is_a_noncustodial_wallet;
+        extern const std::string_view id_green_logo;
+        extern const std::string_view id_green_mnemonic_qr_code;
+        extern const std::string_view id_green_only_supports_one_pin_for;
+        extern const std::string_view id_green_only_supports_one_pin_per;
+        extern const std::string_view id_green_uses_biometric;
+        extern const std::string_view id_green_uses_bluetooth_for;
+        extern const std::string_view id_green_uses_bluetooth_to_connect;
+        extern const std::string_view id_green_uses_multisig_with_one;
+        extern const std::string_view id_hardware_devices;
+        extern const std::string_view id_hardware_security;
+        extern const std::string_view id_hardware_wallet;
+        extern const std::string_view id_hardware_wallet_support_for;
+        extern const std::string_view id_hardware_wallets;
+        extern const std::string_view id_hash;
+        extern const std::string_view id_hash_s;
+        extern const std::string_view id_help;
+        extern const std::string_view id_help_green_improve;
+        extern const std::string_view id_here;
+        extern const std::string_view id_hex;
+        extern const std::string_view id_hide_advanced_options;
+        extern const std::string_view id_hide_amounts;
+        extern const std::string_view id_hide_assets;
+        extern const std::string_view id_hide_details;
+        extern const std::string_view id_high;
+        extern const std::string_view id_hold_button_to_send;
+        extern const std::string_view id_hold_the_green_button_on_the;
+        extern const std::string_view id_hold_your_nfc_tag_close_to_the;
+        extern const std::string_view id_home;
+        extern const std::string_view id_hour;
+        extern const std::string_view id_hours;
+        extern const std::string_view id_how_to_stop_this_reset;
+        extern const std::string_view id_i_agree_to_the;
+        extern const std::string_view id_i_agree_to_the_terms_of_service;
+        extern const std::string_view id_i_confirm_i_have_read_and;
+        extern const std::string_view id_i_confirm_i_want_to_delete_this;
+        extern const std::string_view id_i_confirm_i_want_to_disable_pin;
+        extern const std::string_view id_i_forgot_my_password;
+        extern const std::string_view id_i_fund_via_an_onchain_bitcoin;
+        extern const std::string_view id_i_lost_my_2fa;
+        extern const std::string_view id_i_secured_the_mnemonic_and_i;
+        extern const std::string_view id_i_typed_all_my_recovery_phrase;
+        extern const std::string_view id_i_understand_amounts_could_be;
+        extern const std::string_view id_id;
+        extern const std::string_view id_if_for_any_reason_you_cant;
+        extern const std::string_view id_if_you_agree_green_will_collect;
+        extern const std::string_view id_if_you_are_the_rightful_owner;
+        extern const std::string_view id_if_you_did_not_request_the;
+        extern const std::string_view id_if_you_forget_it_or_lose_it;
+        extern const std::string_view id_if_you_have_access_to_a;
+        extern const std::string_view id_if_you_have_some_coins_on_the;
+        extern const std::string_view id_if_you_initiated_the_2fa_reset;
+        extern const std::string_view id_import;
+        extern const std::string_view id_import_a_multisig_shield_wallet;
+        extern const std::string_view id_import_a_wallet_created_on;
+        extern const std::string_view id_import_a_wallet_created_with;
+        extern const std::string_view id_import_from_file;
+        extern const std::string_view id_in_progress;
+        extern const std::string_view id_inbound_liquidity;
+        extern const std::string_view id_incoming;
+        extern const std::string_view id_inconsistent_data_provided_for;
+        extern const std::string_view id_increase_fee;
+        extern const std::string_view id_increase_inbound_capacity_now;
+        extern const std::string_view id_increase_security;
+        extern const std::string_view id_increase_the_security_of_your;
+        extern const std::string_view id_information_not_available;
+        extern const std::string_view id_initialize_and_create_wallet;
+        extern const std::string_view id_initialize_jade_for_testnet;
+        extern const std::string_view id_initialized;
+        extern const std::string_view id_initializing_tor;
+        extern const std::string_view id_insert_your_email_to_receive;
+        extern const std::string_view id_insert_your_phone_number_to;
+        extern const std::string_view id_install_version_s;
+        extern const std::string_view id_instant;
+        extern const std::string_view id_insufficient_funds;
+        extern const std::string_view id_insufficient_lbtc_for_fees;
+        extern const std::string_view id_insufficient_lbtc_to_send_a;
+        extern const std::string_view id_invalid_address;
+        extern const std::string_view id_invalid_amount;
+        extern const std::string_view id_invalid_asset_id;
+        extern const std::string_view id_invalid_clipboard_contents;
+        extern const std::string_view id_invalid_merkle_proof;
+        extern const std::string_view id_invalid_mnemonic;
+        extern const std::string_view id_invalid_mnemonic_continue;
+        extern const std::string_view id_invalid_mnemonic_must_be_24_or;
+        extern const std::string_view id_invalid_network_configuration;
+        extern const std::string_view id_invalid_payment_request_assetid;
+        extern const std::string_view id_invalid_pgp_key;
+        extern const std::string_view id_invalid_phone_number_format;
+        extern const std::string_view id_invalid_pin;
+        extern const std::string_view id_invalid_pin_remaining_attempts;
+        extern const std::string_view id_invalid_pin_you_dont_have_any;
+        extern const std::string_view id_invalid_pin_you_have_1d;
+        extern const std::string_view id_invalid_private_key;
+        extern const std::string_view id_invalid_recovery_phrase;
+        extern const std::string_view id_invalid_replacement_fee_rate;
+        extern const std::string_view id_invalid_status_check_that_your;
+        extern const std::string_view id_invalid_swap_proposal;
+        extern const std::string_view id_invalid_twofactor_code;
+        extern const std::string_view id_invalid_url;
+        extern const std::string_view id_invalid_xpub;
+        extern const std::string_view id_invoice_expired;
+        extern const std::string_view id_invoices;
+        extern const std::string_view id_is_a_noncustodial;
+        extern const std::string_view id_issuer;
+        extern const std::string_view id_issuer_domain_s;
+        extern const std::string_view id_it_looks_like_you_have_no;
+        extern const std::string_view id_jade_is_a_specialized_device;
+        extern const std::string_view id_jade_is_an_isolated_device_not;
+        extern const std::string_view id_jade_is_an_opensource_hardware;
+        extern const std::string_view id_jade_unlocked;
+        extern const std::string_view id_jade_was_initialized_for_testnet;
+        extern const std::string_view id_just_a_few_more_steps_to_get;
+        extern const std::string_view id_label;
+        extern const std::string_view id_language;
+        extern const std::string_view id_last_attempt_if_failed_you_will;
+        extern const std::string_view id_last_ping_1d_ms;
+        extern const std::string_view id_later;
+        extern const std::string_view id_latest_transactions;
+        extern const std::string_view id_lbtc_has_no_issuer_and_is;
+        extern const std::string_view id_learn_more;
+        extern const std::string_view id_learn_more_about_amp_the_assets;
+        extern const std::string_view id_learn_more_about_s;
+        extern const std::string_view id_ledger_dashboard_detected;
+        extern const std::string_view id_ledger_devices;
+        extern const std::string_view id_ledger_supports_a_limited_set;
+        extern const std::string_view id_legacy;
+        extern const std::string_view id_legacy_account;
+        extern const std::string_view id_legacy_bip44;
+        extern const std::string_view id_legacy_script_coins;
+        extern const std::string_view id_legacy_segwit;
+        extern const std::string_view id_legacy_segwit_account;
+        extern const std::string_view id_legacy_segwit_bip49;
+        extern const std::string_view id_lets_get_you_set_up;
+        extern const std::string_view id_lightning;
+        extern const std::string_view id_lightning_invoice;
+        extern const std::string_view id_lightning_invoice__lnurl;
+        extern const std::string_view id_lightning_invoice_is_expired;
+        extern const std::string_view id_lightning_network_account;
+        extern const std::string_view id_limits_s__s;
+        extern const std::string_view id_liquid_electrum_server;
+        extern const std::string_view id_liquid_is_a_sidechainbased;
+        extern const std::string_view id_liquid_securities;
+        extern const std::string_view id_liquid_testnet_electrum_server;
+        extern const std::string_view id_liquid_testnet_wallets;
+        extern const std::string_view id_liquid_wallet;
+        extern const std::string_view id_liquid_wallets;
+        extern const std::string_view id_loading;
+        extern const std::string_view id_loading_accounts;
+        extern const std::string_view id_loading_assets;
+        extern const std::string_view id_loading_transactions;
+        extern const std::string_view id_loading_wallet;
+        extern const std::string_view id_location_services_are_disabled;
+        extern const std::string_view id_lock;
+        extern const std::string_view id_lock_after_1_minute;
+        extern const std::string_view id_lock_immediately;
+        extern const std::string_view id_locked;
+        extern const std::string_view id_locked_coins_will_not_be_spent;
+        extern const std::string_view id_locking_coins;
+        extern const std::string_view id_locking_coins_can_help_protect;
+        extern const std::string_view id_log_file;
+        extern const std::string_view id_log_in;
+        extern const std::string_view id_log_in_into_your_s_wallet;
+        extern const std::string_view id_log_in_to_your_multisig_shield;
+        extern const std::string_view id_log_in_using_mnemonic;
+        extern const std::string_view id_log_in_via_watchonly_to_receive;
+        extern const std::string_view id_log_out;
+        extern const std::string_view id_logged_in_wallets;
+        extern const std::string_view id_logging_in;
+        extern const std::string_view id_login;
+        extern const std::string_view id_login_failed;
+        extern const std::string_view id_login_options;
+        extern const std::string_view id_login_with_biometrics;
+        extern const std::string_view id_login_with_bip39_passphrase;
+        extern const std::string_view id_logout;
+        extern const std::string_view id_logout_and_switch;
+        extern const std::string_view id_look_at_the_device_for_the;
+        extern const std::string_view id_looking_for_device;
+        extern const std::string_view id_looking_for_wallets;
+        extern const std::string_view id_looks_like_you_havent_used_a;
+        extern const std::string_view id_low;
+        extern const std::string_view id_main_account;
+        extern const std::string_view id_make_sure_to_be_in_a_private;
+        extern const std::string_view id_make_sure_you_are_alone_and_no;
+        extern const std::string_view id_make_sure_you_got_everything;
+        extern const std::string_view id_make_sure_you_have_enabled_otg;
+        extern const std::string_view id_make_sure_you_made_a_proper;
+        extern const std::string_view id_malleated;
+        extern const std::string_view id_managed_assets;
+        extern const std::string_view id_managed_assets_account;
+        extern const std::string_view id_managed_assets_accounts_are;
+        extern const std::string_view id_manual_coin_selection;
+        extern const std::string_view id_manual_restore;
+        extern const std::string_view id_max_limit_s;
+        extern const std::string_view id_max_payable_amount;
+        extern const std::string_view id_max_receivable_amount;
+        extern const std::string_view id_max_single_payment_amount;
+        extern const std::string_view id_medium;
+        extern const std::string_view id_memo;
+        extern const std::string_view id_message;
+        extern const std::string_view id_message_hash;
+        extern const std::string_view id_migrate_another_wallet;
+        extern const std::string_view id_migrating_to_blockstream_green;
+        extern const std::string_view id_minimum;
+        extern const std::string_view id_minute;
+        extern const std::string_view id_minutes;
+        extern const std::string_view id_mnemonic;
+        extern const std::string_view id_mnemonic_not_available;
+        extern const std::string_view id_model;
+        extern const std::string_view id_month;
+        extern const std::string_view id_months;
+        extern const std::string_view id_more_info;
+        extern const std::string_view id_more_options;
+        extern const std::string_view id_move_to_2fa_protected;
+        extern const std::string_view id_multi_server_validation;
+        extern const std::string_view id_multiple_assets;
+        extern const std::string_view id_multisig;
+        extern const std::string_view id_multisig_shield;
+        extern const std::string_view id_my_assets;
+        extern const std::string_view id_my_notes;
+        extern const std::string_view id_name;
+        extern const std::string_view id_native_segwit;
+        extern const std::string_view id_need_help;
+        extern const std::string_view id_network;
+        extern const std::string_view id_network_configuration;
+        extern const std::string_view id_network_fee;
+        extern const std::string_view id_network_monitor;
+        extern const std::string_view id_networks;
+        extern const std::string_view id_new_account_created;
+        extern const std::string_view id_new_accounts_functionality;
+        extern const std::string_view id_new_fee;
+        extern const std::string_view id_new_incoming_transaction_in;
+        extern const std::string_view id_new_jade_firmware_available;
+        extern const std::string_view id_new_jade_firmware_required;
+        extern const std::string_view id_new_outgoing_transaction_from;
+        extern const std::string_view id_new_recovery_phrase;
+        extern const std::string_view id_new_s_transaction_of_s_in;
+        extern const std::string_view id_new_transaction;
+        extern const std::string_view id_new_transaction_involving;
+        extern const std::string_view id_new_version;
+        extern const std::string_view id_new_wallet;
+        extern const std::string_view id_next;
+        extern const std::string_view id_nfc_logo;
+        extern const std::string_view id_nfc_tags_written;
+        extern const std::string_view id_no_addresses;
+        extern const std::string_view id_no_amount_specified;
+        extern const std::string_view id_no_archived_accounts;
+        extern const std::string_view id_no_asset_in_this_account;
+        extern const std::string_view id_no_attempts_remaining;
+        extern const std::string_view id_no_coins_selected;
+        extern const std::string_view id_no_device_connected;
+        extern const std::string_view id_no_existing_wallet_could_be;
+        extern const std::string_view id_no_more_assets;
+        extern const std::string_view id_no_multisig_shield_wallet;
+        extern const std::string_view id_no_peers_connected;
+        extern const std::string_view id_no_personal_data_will_be_shared;
+        extern const std::string_view id_no_pin_provided_exiting;
+        extern const std::string_view id_no_recipients;
+        extern const std::string_view id_no_registered_name_for_this;
+        extern const std::string_view id_no_registered_ticker_for_this;
+        extern const std::string_view id_no_utxos_found;
+        extern const std::string_view id_node_info;
+        extern const std::string_view id_non_confidential;
+        extern const std::string_view id_non_confidential_transaction;
+        extern const std::string_view id_nonconfidential_addresses_not;
+        extern const std::string_view id_noradio_firmware;
+        extern const std::string_view id_normal;
+        extern const std::string_view id_not_a_valid_email_address;
+        extern const std::string_view id_not_a_valid_phone_number;
+        extern const std::string_view id_not_a_valid_word;
+        extern const std::string_view id_not_available_noradio_build;
+        extern const std::string_view id_not_confidential;
+        extern const std::string_view id_not_connected_connecting_in_ds_;
+        extern const std::string_view id_not_initialized;
+        extern const std::string_view id_not_now;
+        extern const std::string_view id_not_on_longest_chain;
+        extern const std::string_view id_note;
+        extern const std::string_view id_note_down_your_recovery_phrase;
+        extern const std::string_view id_notifications;
+        extern const std::string_view id_now;
+        extern const std::string_view id_of_24;
+        extern const std::string_view id_of_s;
+        extern const std::string_view id_offline_key_storage;
+        extern const std::string_view id_ok;
+        extern const std::string_view id_on_average;
+        extern const std::string_view id_once_selected_this_spending;
+        extern const std::string_view id_onchain_address;
+        extern const std::string_view id_onchain_swaps;
+        extern const std::string_view id_one_attempt_remaining;
+        extern const std::string_view id_one_network_must_be_selected;
+        extern const std::string_view id_onion_addresses_require_tor;
+        extern const std::string_view id_only_connect_to_trusted_nodes;
+        extern const std::string_view id_only_this_time;
+        extern const std::string_view id_open;
+        extern const std::string_view id_operation_failure;
+        extern const std::string_view id_optimal_if_you_rarely_spend;
+        extern const std::string_view id_optimal_if_you_spend_coins;
+        extern const std::string_view id_optional;
+        extern const std::string_view id_optional_memo;
+        extern const std::string_view id_optional_password;
+        extern const std::string_view id_or;
+        extern const std::string_view id_original_swap_address;
+        extern const std::string_view id_os__app_version_loading_times;
+        extern const std::string_view id_our_support_page;
+        extern const std::string_view id_outdated_hardware_wallet;
+        extern const std::string_view id_outgoing;
+        extern const std::string_view id_output_descriptors;
+        extern const std::string_view id_overview;
+        extern const std::string_view id_p2sh;
+        extern const std::string_view id_p2wsh;
+        extern const std::string_view id_page_visits_button_presses;
+        extern const std::string_view id_passphrase;
+        extern const std::string_view id_passphrase_protected;
+        extern const std::string_view id_password;
+        extern const std::string_view id_password_protected;
+        extern const std::string_view id_paste;
+        extern const std::string_view id_paste_an_existing_proposal;
+        extern const std::string_view id_path_used_for_signing;
+        extern const std::string_view id_payment_requested_by_s;
+        extern const std::string_view id_payments_to_self_are_not;
+        extern const std::string_view id_pending_confirmation;
+        extern const std::string_view id_permanent_2fa_account_ideal_for;
+        extern const std::string_view id_permanently_block_this_wallet;
+        extern const std::string_view id_personal_electrum_server;
+        extern const std::string_view id_pgp_key;
+        extern const std::string_view id_phone_call;
+        extern const std::string_view id_phone_number;
+        extern const std::string_view id_pin;
+        extern const std::string_view id_pin_access_disabled;
+        extern const std::string_view id_pin_has_to_be_between_4_and_15;
+        extern const std::string_view id_pins_do_not_match_please_try;
+        extern const std::string_view id_please_activate_at_least_one;
+        extern const std::string_view id_please_contribute_if_you_find;
+        extern const std::string_view id_please_disable_biometric;
+        extern const std::string_view id_please_disconnect_your_ledger;
+        extern const std::string_view id_please_enable_another;
+        extern const std::string_view id_please_enable_camera;
+        extern const std::string_view id_please_enable_pin;
+        extern const std::string_view id_please_enter_the_passphrase_for;
+        extern const std::string_view id_please_follow_the_instructions;
+        extern const std::string_view id_please_hold_on_while_your;
+        extern const std::string_view id_please_provide_your_1s;
+        extern const std::string_view id_please_provide_your_1s_code;
+        extern const std::string_view id_please_provide_your_passphrase;
+        extern const std::string_view id_please_reconnect_your_hardware;
+        extern const std::string_view id_please_secure_your_mnemonic_and;
+        extern const std::string_view id_please_select_the_checkbox;
+        extern const std::string_view id_please_set_and_enable_socks5;
+        extern const std::string_view id_please_tap_card;
+        extern const std::string_view id_please_verify_that_the_address;
+        extern const std::string_view id_please_verify_that_this_address;
+        extern const std::string_view id_please_wait_until_your_ledger;
+        extern const std::string_view id_power_on_jade;
+        extern const std::string_view id_precision;
+        extern const std::string_view id_previous_fee;
+        extern const std::string_view id_price_feed;
+        extern const std::string_view id_print_backup_template;
+        extern const std::string_view id_privacy_policy;
+        extern const std::string_view id_private_but_less_stable;
+        extern const std::string_view id_private_key;
+        extern const std::string_view id_problem_with_key_1s;
+        extern const std::string_view id_protect_your_bitcoin_with_a;
+        extern const std::string_view id_provide_this_id_to_the_asset;
+        extern const std::string_view id_provide_your_amp_id_to_the;
+        extern const std::string_view id_proxy_host;
+        extern const std::string_view id_proxy_port;
+        extern const std::string_view id_proxy_settings;
+        extern const std::string_view id_pseudonymous_identifier_country;
+        extern const std::string_view id_qr_code;
+        extern const std::string_view id_qr_scanner;
+        extern const std::string_view id_quick_setup_2fa_account_ideal;
+        extern const std::string_view id_radio_firmware;
+        extern const std::string_view id_rate;
+        extern const std::string_view id_rate_us;
+        extern const std::string_view id_rate_your_experience;
+        extern const std::string_view id_read_more;
+        extern const std::string_view id_read_more_at_our_s;
+        extern const std::string_view id_ready;
+        extern const std::string_view id_ready_to_start;
+        extern const std::string_view id_receive;
+        extern const std::string_view id_receive_any_liquid_asset;
+        extern const std::string_view id_receive_email_notifications_for;
+        extern const std::string_view id_received;
+        extern const std::string_view id_received_on;
+        extern const std::string_view id_receiving;
+        extern const std::string_view id_recently_used_wallets;
+        extern const std::string_view id_recipient;
+        extern const std::string_view id_recipient_address;
+        extern const std::string_view id_recovery;
+        extern const std::string_view id_recovery_and_notifications;
+        extern const std::string_view id_recovery_key_type;
+        extern const std::string_view id_recovery_mnemonic;
+        extern const std::string_view id_recovery_phrase;
+        extern const std::string_view id_recovery_phrase_check;
+        extern const std::string_view id_recovery_phrase_length;
+        extern const std::string_view id_recovery_phrases_key_material;
+        extern const std::string_view id_recovery_tool;
+        extern const std::string_view id_recovery_transaction_emails;
+        extern const std::string_view id_recovery_transaction_request;
+        extern const std::string_view id_recovery_transactions;
+        extern const std::string_view id_recovery_words;
+        extern const std::string_view id_recovery_xpub;
+        extern const std::string_view id_redeem;
+        extern const std::string_view id_redeem_your_deposited_funds;
+        extern const std::string_view id_redeposited;
+        extern const std::string_view id_reference_exchange_rate;
+        extern const std::string_view id_refresh;
+        extern const std::string_view id_refund;
+        extern const std::string_view id_refund_in_progress;
+        extern const std::string_view id_refund_initiated;
+        extern const std::string_view id_refundable;
+        extern const std::string_view id_reload;
+        extern const std::string_view id_remember_device;
+        extern const std::string_view id_remember_device_connection;
+        extern const std::string_view id_remember_me;
+        extern const std::string_view id_remember_my_device;
+        extern const std::string_view id_remove;
+        extern const std::string_view id_remove_custom_network;
+        extern const std::string_view id_remove_wallet;
+        extern const std::string_view id_rename;
+        extern const std::string_view id_rename_account;
+        extern const std::string_view id_rename_wallet;
+        extern const std::string_view id_replaceable;
+        extern const std::string_view id_report;
+        extern const std::string_view id_request_amount;
+        extern const std::string_view id_request_failed;
+        extern const std::string_view id_request_recovery_transactions;
+        extern const std::string_view id_request_sent;
+        extern const std::string_view id_request_twofactor_reset;
+        extern const std::string_view id_requested_fee_rate_too_low;
+        extern const std::string_view id_reset;
+        extern const std::string_view id_reset_spv;
+        extern const std::string_view id_resetting_your_twofactor_takes;
+        extern const std::string_view id_restore;
+        extern const std::string_view id_restore_a_blockstream_green;
+        extern const std::string_view id_restore_a_singlesig_wallet;
+        extern const std::string_view id_restore_a_wallet;
+        extern const std::string_view id_restore_green_wallet;
+        extern const std::string_view id_restore_temporary_wallet;
+        extern const std::string_view id_restore_wallet;
+        extern const std::string_view id_restore_with_recovery_phrase;
+        extern const std::string_view id_restoring_your_wallet;
+        extern const std::string_view id_review;
+        extern const std::string_view id_review_account_information;
+        extern const std::string_view id_review_output_s;
+        extern const std::string_view id_s_blocks_left;
+        extern const std::string_view id_s_from_s;
+        extern const std::string_view id_s_is_a_liquid_asset_you_can;
+        extern const std::string_view id_s_is_a_liquid_asset_you_need_a;
+        extern const std::string_view id_s_is_an_amp_asset_you_can;
+        extern const std::string_view id_s_is_an_amp_asset_you_need_an;
+        extern const std::string_view id_s_network;
+        extern const std::string_view id_s_will_send_you_the_funds_it;
+        extern const std::string_view id_safe_environment;
+        extern const std::string_view id_safely_stored;
+        extern const std::string_view id_save;
+        extern const std::string_view id_save_a_summary_of_your_accounts;
+        extern const std::string_view id_save_your_mnemonic;
+        extern const std::string_view id_scan_a_proposal;
+        extern const std::string_view id_scan_a_qr_code_for_spv_pairing;
+        extern const std::string_view id_scan_from_image;
+        extern const std::string_view id_scan_or_paste_your_extended;
+        extern const std::string_view id_scan_or_paste_your_public;
+        extern const std::string_view id_scan_qr_code;
+        extern const std::string_view id_scan_the_qr_code_with_an;
+        extern const std::string_view id_scan_to_send_here;
+        extern const std::string_view id_screen_lock;
+        extern const std::string_view id_search;
+        extern const std::string_view id_search_address;
+        extern const std::string_view id_second;
+        extern const std::string_view id_seconds;
+        extern const std::string_view id_security;
+        extern const std::string_view id_security_change;
+        extern const std::string_view id_see_archived_accounts_s;
+        extern const std::string_view id_see_our_privacy_policy_s;
+        extern const std::string_view id_see_our_terms_of_service_s;
+        extern const std::string_view id_segwit;
+        extern const std::string_view id_segwit_account;
+        extern const std::string_view id_segwit_bip84;
+        extern const std::string_view id_select_a_fiat_currency_and;
+        extern const std::string_view id_select_account;
+        extern const std::string_view id_select_an_app_on_s;
+        extern const std::string_view id_select_asset;
+        extern const std::string_view id_select_duration_of_twofactor;
+        extern const std::string_view id_select_initalize_to_create_a;
+        extern const std::string_view id_select_initialize_and_choose_to;
+        extern const std::string_view id_select_network;
+        extern const std::string_view id_select_the_s_app_on_your_ledger;
+        extern const std::string_view id_select_wallet;
+        extern const std::string_view id_select_watchonly_type;
+        extern const std::string_view id_select_word_number_d;
+        extern const std::string_view id_select_your_coins;
+        extern const std::string_view id_select_your_jade_to_login;
+        extern const std::string_view id_select_your_recovery_key;
+        extern const std::string_view id_send;
+        extern const std::string_view id_send_all;
+        extern const std::string_view id_send_all_funds;
+        extern const std::string_view id_send_all_requires_a_single;
+        extern const std::string_view id_send_and_receive_liquidbased;
+        extern const std::string_view id_send_error_report;
+        extern const std::string_view id_send_more_than_s_and_up_to_s_to;
+        extern const std::string_view id_send_to;
+        extern const std::string_view id_sending;
+        extern const std::string_view id_sending_request;
+        extern const std::string_view id_sensitive_information;
+        extern const std::string_view id_sent;
+        extern const std::string_view id_sent_to;
+        extern const std::string_view id_server_ip_and_port_ipport;
+        extern const std::string_view id_set_2fa_expiry;
+        extern const std::string_view id_set_a_limit_to_spend_without;
+        extern const std::string_view id_set_a_new_pin;
+        extern const std::string_view id_set_a_pin;
+        extern const std::string_view id_set_a_timeout_to_logout_after;
+        extern const std::string_view id_set_an_email_address_to_receive;
+        extern const std::string_view id_set_an_email_for_recovery;
+        extern const std::string_view id_set_custom_fee_rate;
+        extern const std::string_view id_set_locktime;
+        extern const std::string_view id_set_timelock;
+        extern const std::string_view id_set_twofactor_threshold;
+        extern const std::string_view id_set_up_a_passcode_for_your_ios;
+        extern const std::string_view id_set_up_a_screen_lock_for_your;
+        extern const std::string_view id_set_up_an_email_to_get;
+        extern const std::string_view id_set_up_credentials_to_access_in;
+        extern const std::string_view id_set_up_pgp_key_for;
+        extern const std::string_view id_set_up_twofactor_authentication;
+        extern const std::string_view id_set_up_watchonly;
+        extern const std::string_view id_set_up_watchonly_credentials;
+        extern const std::string_view id_set_wallet_name;
+        extern const std::string_view id_setting_up_your_wallet;
+        extern const std::string_view id_setting_updated;
+        extern const std::string_view id_settings;
+        extern const std::string_view id_setup_2fa_now;
+        extern const std::string_view id_setup_a_new_wallet;
+        extern const std::string_view id_setup_guide;
+        extern const std::string_view id_setup_jade;
+        extern const std::string_view id_setup_pin;
+        extern const std::string_view id_setup_pin_and_s;
+        extern const std::string_view id_setup_your_jade;
+        extern const std::string_view id_share;
+        extern const std::string_view id_share_address;
+        extern const std::string_view id_share_nonconfidential;
+        extern const std::string_view id_share_unblinding_data;
+        extern const std::string_view id_show;
+        extern const std::string_view id_show_address;
+        extern const std::string_view id_show_advanced_options;
+        extern const std::string_view id_show_all;
+        extern const std::string_view id_show_all_assets;
+        extern const std::string_view id_show_bitcoin_amounts_in;
+        extern const std::string_view id_show_coins_with_expiring;
+        extern const std::string_view id_show_details;
+        extern const std::string_view id_show_fiat;
+        extern const std::string_view id_show_lightning_invoice;
+        extern const std::string_view id_show_my_wallet_backup;
+        extern const std::string_view id_show_onchain_address;
+        extern const std::string_view id_show_qr_code;
+        extern const std::string_view id_show_recovery_phrase;
+        extern const std::string_view id_sign_message;
+        extern const std::string_view id_sign_transaction;
+        extern const std::string_view id_signature_validation_failed_if;
+        extern const std::string_view id_signup_in_progress;
+        extern const std::string_view id_simple;
+        extern const std::string_view id_simple__secure_selfcustody;
+        extern const std::string_view id_simple_portable_standard;
+        extern const std::string_view id_simplified_payment_verification;
+        extern const std::string_view id_singlesig;
+        extern const std::string_view id_singlesig_wallets_are_not_yet;
+        extern const std::string_view id_skip;
+        extern const std::string_view id_skip_not_recommended;
+        extern const std::string_view id_slide_to_send;
+        extern const std::string_view id_slow;
+        extern const std::string_view id_sms;
+        extern const std::string_view id_snnreset_this_setting_and_then;
+        extern const std::string_view id_socks5_hostname;
+        extern const std::string_view id_socks5_port;
+        extern const std::string_view id_socks5_proxy_and_port_must_be;
+        extern const std::string_view id_something_went_wrong;
+        extern const std::string_view id_spend_your_bitcoin_without_2fa;
+        extern const std::string_view id_spv_is_always_synchronized_on;
+        extern const std::string_view id_spv_mode_is_currently_available;
+        extern const std::string_view id_spv_not_fully_synced;
+        extern const std::string_view id_spv_notifications;
+        extern const std::string_view id_spv_reset_and_restarted;
+        extern const std::string_view id_spv_synchronization;
+        extern const std::string_view id_spv_synchronization_using_tor;
+        extern const std::string_view id_spv_unverified;
+        extern const std::string_view id_spv_verification;
+        extern const std::string_view id_standard;
+        extern const std::string_view id_standard_account;
+        extern const std::string_view id_standard_accounts_allow_you_to;
+        extern const std::string_view id_standard_wallet;
+        extern const std::string_view id_start_a_2fa_reset_process_if;
+        extern const std::string_view id_start_receiving_funds_and_set;
+        extern const std::string_view id_status;
+        extern const std::string_view id_step;
+        extern const std::string_view id_store_it_somewhere_safe;
+        extern const std::string_view id_submit;
+        extern const std::string_view id_success;
+        extern const std::string_view id_successfully_sent_your_funds;
+        extern const std::string_view id_support;
+        extern const std::string_view id_support_page;
+        extern const std::string_view id_swap;
+        extern const std::string_view id_swap_is_in_progress;
+        extern const std::string_view id_swap_proposal;
+        extern const std::string_view id_swapped;
+        extern const std::string_view id_sweep;
+        extern const std::string_view id_sweep_from_paper_wallet;
+        extern const std::string_view id_sweep_into_s;
+        extern const std::string_view id_switch_network;
+        extern const std::string_view id_synchronize_spv_on_mobile;
+        extern const std::string_view id_syou_need_ton1_reset_greens;
+        extern const std::string_view id_system_location;
+        extern const std::string_view id_system_message;
+        extern const std::string_view id_take_control_your_keys_your;
+        extern const std::string_view id_tap_on_the_card_to_view;
+        extern const std::string_view id_tap_to_restart_the_simplified;
+        extern const std::string_view id_tap_to_scan_a_qr_code_and;
+        extern const std::string_view id_taproot;
+        extern const std::string_view id_taproot_account;
+        extern const std::string_view id_taproot_bip86;
+        extern const std::string_view id_telegram;
+        extern const std::string_view id_terms_of_service;
+        extern const std::string_view id_terms_of_use;
+        extern const std::string_view id_testnet_and_liquid_testnet;
+        extern const std::string_view id_testnet_electrum_server;
+        extern const std::string_view id_testnet_wallets;
+        extern const std::string_view id_thank_you_for_downloading_green;
+        extern const std::string_view id_thank_you_for_your_feedback;
+        extern const std::string_view id_the_1_year_2fa_reset_process;
+        extern const std::string_view id_the_address_is_valid;
+        extern const std::string_view id_the_addresses_dont_match;
+        extern const std::string_view id_the_asset_registry_is_currently;
+        extern const std::string_view id_the_camera_has_a_problem_you;
+        extern const std::string_view id_the_default_value_is_90_days_if;
+        extern const std::string_view id_the_easier_safer_and_faster;
+        extern const std::string_view id_the_email_will_also_be_used_to;
+        extern const std::string_view id_the_hardware_wallet_you_are;
+        extern const std::string_view id_the_importance_of_twofactor;
+        extern const std::string_view id_the_liquid_network_is_a_bitcoin;
+        extern const std::string_view id_the_network_selected_on_the;
+        extern const std::string_view id_the_new_email_will_be_used_for;
+        extern const std::string_view id_the_new_firmware_requires_you;
+        extern const std::string_view id_the_password_cant_be_empty;
+        extern const std::string_view id_the_qr_code_does_not_include;
+        extern const std::string_view id_the_recovery_key_below_will_not;
+        extern const std::string_view id_the_recovery_phrase_can_be_used;
+        extern const std::string_view id_the_recovery_phrase_doesnt;
+        extern const std::string_view id_the_source_code_is_available_at;
+        extern const std::string_view id_the_transaction_contains;
+        extern const std::string_view id_the_username_cant_be_empty;
+        extern const std::string_view id_the_waiting_period_is_necessary;
+        extern const std::string_view id_there_are_no_results_for_the;
+        extern const std::string_view id_there_is_already_a_pin_set_for;
+        extern const std::string_view id_there_is_already_a_swap_in;
+        extern const std::string_view id_there_is_already_an_archived;
+        extern const std::string_view id_these_are_some_compatible;
+        extern const std::string_view id_these_settings_apply_for_every;
+        extern const std::string_view id_this_amount_is_below_the;
+        extern const std::string_view id_this_feature_is_coming_soon;
+        extern const std::string_view id_this_might_take_up_to_a;
+        extern const std::string_view id_this_signature_is_a_proof_of;
+        extern const std::string_view id_this_transaction_spent;
+        extern const std::string_view id_this_wallet_is_based_on_your;
+        extern const std::string_view id_this_wallet_operates_on_a_test;
+        extern const std::string_view id_this_will_disable_pin_login_for;
+        extern const std::string_view id_this_will_log_you_out_and;
+        extern const std::string_view id_ticker;
+        extern const std::string_view id_time_s;
+        extern const std::string_view id_tip_we_recommend_you_enable;
+        extern const std::string_view id_tip_you_can_use_the;
+        extern const std::string_view id_to;
+        extern const std::string_view id_to_authorize_the_transaction;
+        extern const std::string_view id_to_keep_you_in_control_of_your;
+        extern const std::string_view id_too_many_pin_attempts;
+        extern const std::string_view id_tor;
+        extern const std::string_view id_tor_connectivity_disabled;
+        extern const std::string_view id_tor_is_connected;
+        extern const std::string_view id_tor_is_not_yet_available_for;
+        extern const std::string_view id_tor_status;
+        extern const std::string_view id_tor_will_use_1s_and_only_work;
+        extern const std::string_view id_total;
+        extern const std::string_view id_total_assets;
+        extern const std::string_view id_total_balance;
+        extern const std::string_view id_total_with_fee;
+        extern const std::string_view id_touch_id;
+        extern const std::string_view id_touch_to_display;
+        extern const std::string_view id_touchface_id_not_available;
+        extern const std::string_view id_transaction_already_confirmed;
+        extern const std::string_view id_transaction_copied_to_clipboard;
+        extern const std::string_view id_transaction_details;
+        extern const std::string_view id_transaction_id;
+        extern const std::string_view id_transaction_sent;
+        extern const std::string_view id_transaction_status;
+        extern const std::string_view id_transactions;
+        extern const std::string_view id_troubleshoot;
+        extern const std::string_view id_try_again;
+        extern const std::string_view id_try_now;
+        extern const std::string_view id_turn_on_bluetooth_to_connect;
+        extern const std::string_view id_two_factor_authentication;
+        extern const std::string_view id_twofactor;
+        extern const std::string_view id_twofactor_authentication;
+        extern const std::string_view id_twofactor_authentication_expiry;
+        extern const std::string_view id_twofactor_expiration_period;
+        extern const std::string_view id_twofactor_protection_does_not;
+        extern const std::string_view id_twofactor_reset_in_progress;
+        extern const std::string_view id_twofactor_settings;
+        extern const std::string_view id_twofactor_threshold;
+        extern const std::string_view id_tx_count;
+        extern const std::string_view id_txid;
+        extern const std::string_view id_type_the_next_word;
+        extern const std::string_view id_unable_to_contact_the_green;
+        extern const std::string_view id_unarchive;
+        extern const std::string_view id_unarchive_account;
+        extern const std::string_view id_unblinding_data;
+        extern const std::string_view id_unconfirmed;
+        extern const std::string_view id_undo_2fa_dispute;
+        extern const std::string_view id_unknown;
+        extern const std::string_view id_unknown_bip21_parameter;
+        extern const std::string_view id_unknown_custom;
+        extern const std::string_view id_unknown_firmware;
+        extern const std::string_view id_unlock;
+        extern const std::string_view id_unlock_green;
+        extern const std::string_view id_unlock_jade_to_continue;
+        extern const std::string_view id_unlock_your_device_to_continue;
+        extern const std::string_view id_unlocked_coins_can_be_spent_and;
+        extern const std::string_view id_unlocking_coins;
+        extern const std::string_view id_unstable_internet_connection;
+        extern const std::string_view id_update;
+        extern const std::string_view id_updated;
+        extern const std::string_view id_updating_firmware;
+        extern const std::string_view id_uploading_firmware;
+        extern const std::string_view id_use_a_hardware_wallet_as_your;
+        extern const std::string_view id_use_a_public_key;
+        extern const std::string_view id_use_all_available_coins;
+        extern const std::string_view id_use_an_existing_recovery_phrase;
+        extern const std::string_view id_use_an_xpub_for_which_you_own;
+        extern const std::string_view id_use_android_screen_lock_to_log;
+        extern const std::string_view id_use_comma_separated_values_or;
+        extern const std::string_view id_use_hardware_device;
+        extern const std::string_view id_use_secure_display_and_screen;
+        extern const std::string_view id_use_the_jogwheel_to_select_the;
+        extern const std::string_view id_use_this_recovery_phrase_to;
+        extern const std::string_view id_use_your_email_to_receive;
+        extern const std::string_view id_user_contact_info_ip_address;
+        extern const std::string_view id_user_not_found_or_invalid;
+        extern const std::string_view id_username;
+        extern const std::string_view id_username_not_available;
+        extern const std::string_view id_value_must_be_between_144_and;
+        extern const std::string_view id_verified;
+        extern const std::string_view id_verify;
+        extern const std::string_view id_verify_on_device;
+        extern const std::string_view id_verify_recovery_phrase;
+        extern const std::string_view id_verify_your_bitcoin;
+        extern const std::string_view id_verify_your_pin;
+        extern const std::string_view id_verifying_transactions;
+        extern const std::string_view id_version;
+        extern const std::string_view id_version_1s;
+        extern const std::string_view id_version_1s_2s;
+        extern const std::string_view id_view_account;
+        extern const std::string_view id_view_archived_accounts;
+        extern const std::string_view id_view_archived_accounts_d;
+        extern const std::string_view id_view_in_explorer;
+        extern const std::string_view id_view_more;
+        extern const std::string_view id_visit_s_for_further_information;
+        extern const std::string_view id_visit_the_blockstream_help;
+        extern const std::string_view id_waiting_for_transaction;
+        extern const std::string_view id_wallet;
+        extern const std::string_view id_wallet_already_restored;
+        extern const std::string_view id_wallet_assets;
+        extern const std::string_view id_wallet_backup;
+        extern const std::string_view id_wallet_coins_will_require;
+        extern const std::string_view id_wallet_creation_failed;
+        extern const std::string_view id_wallet_found;
+        extern const std::string_view id_wallet_name;
+        extern const std::string_view id_wallet_not_found;
+        extern const std::string_view id_wallet_pockets;
+        extern const std::string_view id_wallet_transactions;
+        extern const std::string_view id_wallets;
+        extern const std::string_view id_warning;
+        extern const std::string_view id_warning_no_trusted_node_set;
+        extern const std::string_view id_warning_nononion_address;
+        extern const std::string_view id_warning_resetting_twofactor;
+        extern const std::string_view id_warning_there_is_already_a;
+        extern const std::string_view id_warning_wallet_locked_by;
+        extern const std::string_view id_warning_watchonly_credentials;
+        extern const std::string_view id_warning_you_need_a_positive;
+        extern const std::string_view id_watchonly;
+        extern const std::string_view id_watchonly_credentials;
+        extern const std::string_view id_watchonly_details;
+        extern const std::string_view id_watchonly_disabled;
+        extern const std::string_view id_watchonly_login;
+        extern const std::string_view id_watchonly_mode_can_be_activated;
+        extern const std::string_view id_watchonly_mode_cannot_be;
+        extern const std::string_view id_watchonly_wallet;
+        extern const std::string_view id_we_use_the_camera_to_scan_qr;
+        extern const std::string_view id_we_will_do_our_best_to_find_a;
+        extern const std::string_view id_welcome;
+        extern const std::string_view id_welcome_to;
+        extern const std::string_view id_welcome_to_blockstream_jade;
+        extern const std::string_view id_welcome_to_your_wallet;
+        extern const std::string_view id_well_done_you_can_continue;
+        extern const std::string_view id_well_done_you_can_continue_with;
+        extern const std::string_view id_well_get_you_set_up_in_no_time;
+        extern const std::string_view id_well_get_you_set_up_with_an_amp;
+        extern const std::string_view id_what_is_word_number_s;
+        extern const std::string_view id_what_type_of_account_would_you;
+        extern const std::string_view id_whats_collected;
+        extern const std::string_view id_whats_new;
+        extern const std::string_view id_whats_not_collected;
+        extern const std::string_view id_where_would_you_like_to;
+        extern const std::string_view id_whomever_can_access_your;
+        extern const std::string_view id_wireless;
+        extern const std::string_view id_withdraw;
+        extern const std::string_view id_withdraw_limits_s__s;
+        extern const std::string_view id_word;
+        extern const std::string_view id_word_d_of_d;
+        extern const std::string_view id_write_down_the_words;
+        extern const std::string_view id_write_down_your_recovery_phrase;
+        extern const std::string_view id_wrong_choice_check_your;
+        extern const std::string_view id_xpub;
+        extern const std::string_view id_year;
+        extern const std::string_view id_years;
+        extern const std::string_view id_you_are_not_connected;
+        extern const std::string_view id_you_are_not_connected_please;
+        extern const std::string_view id_you_are_now_connected;
+        extern const std::string_view id_you_are_redeeming_funds_from_s;
+        extern const std::string_view id_you_can_change_these_later_on;
+        extern const std::string_view id_you_can_send_up_to;
+        extern const std::string_view id_you_can_still_receive_funds_but;
+        extern const std::string_view id_you_can_sweep_s_of_your_funds;
+        extern const std::string_view id_you_can_use_your_wallet_to;
+        extern const std::string_view id_you_cannot_create_or_restore_a;
+        extern const std::string_view id_you_cannot_receive_more_than_s;
+        extern const std::string_view id_you_have_a_significant_amount;
+        extern const std::string_view id_you_have_clicked_a_payment_uri;
+        extern const std::string_view id_you_have_clicked_a_uri_select_a;
+        extern const std::string_view id_you_have_control_on_your_funds;
+        extern const std::string_view id_you_have_just_received_s;
+        extern const std::string_view id_you_have_no_coins_to_send;
+        extern const std::string_view id_you_have_received_s;
+        extern const std::string_view id_you_have_successfully_changed;
+        extern const std::string_view id_you_have_successfully_sent_a;
+        extern const std::string_view id_you_have_to_authenticate_using;
+        extern const std::string_view id_you_have_tor_enabled_are_you;
+        extern const std::string_view id_you_must_first_log_out_before;
+        extern const std::string_view id_you_must_save_this_mnemonic_now;
+        extern const std::string_view id_you_need_a_liquid_account_in;
+        extern const std::string_view id_you_only_have_one_twofactor;
+        extern const std::string_view id_you_will_be_asked_to_enter_your;
+        extern const std::string_view id_you_will_need_to_reenter_your;
+        extern const std::string_view id_you_will_see_your_coins_here;
+        extern const std::string_view id_youll_need_to_back_up_your;
+        extern const std::string_view id_youll_need_your_pin_to_log_in;
+        extern const std::string_view id_youll_need_your_recovery_phrase;
+        extern const std::string_view id_youll_see_your_coins_here_when;
+        extern const std::string_view id_your_2fa_expires_so_that_if_you;
+        extern const std::string_view id_your_bitcoin_and_liquid_assets;
+        extern const std::string_view id_your_bluetooth_adapter_is;
+        extern const std::string_view id_your_current_receive_capacity;
+        extern const std::string_view id_your_device_was_disconnected;
+        extern const std::string_view id_your_favourite_exchange_rate_is;
+        extern const std::string_view id_your_funds_are_secured_by;
+        extern const std::string_view id_your_funds_are_secured_by_a;
+        extern const std::string_view id_your_funds_are_secured_by_your;
+        extern const std::string_view id_your_funds_have_grown;
+        extern const std::string_view id_your_green_wallet_is_now_ready;
+        extern const std::string_view id_your_ios_device_might_not_be;
+        extern const std::string_view id_your_keys_secure_your_coins_on;
+        extern const std::string_view id_your_notifications_will_be;
+        extern const std::string_view id_your_pin_or_your_mnemonic_will;
+        extern const std::string_view id_your_s_sent_to_s_has_been;
+        extern const std::string_view id_your_settings_are_unsavednndo;
+        extern const std::string_view id_your_swap_proposal_is_generated;
+        extern const std::string_view id_your_transactions_will_be_shown;
+        extern const std::string_view id_your_twofactor_threshold_is_s;
+        extern const std::string_view id_your_wallet_backup_is_made_of;
+        extern const std::string_view id_your_wallet_is_locked_for_a;
+        extern const std::string_view id_your_wallet_is_locked_under_2fa;
+        extern const std::string_view id_your_wallet_is_not_yet_fully;
+        extern const std::string_view id_your_watchonly_username_and;
+        extern const std::string_view id_youve_entered_an_invalid_pin;
 
     } // namespace res
 
@@ -11,6 +11,7 @@
 #include "logging.hpp"
 #include "memory.hpp"
 #include "session.hpp"
+#include "socks_client.hpp"
 #include "utils.hpp"
 
 #include <condition_variable>
@@ -226,6 +227,9 @@ namespace green {
         std::string m_tor_control_port;
         std::unique_ptr<tor_control_connection> m_conn;
         bool m_stopping;
+        // Only accessed from the control thread
+        bool m_poll_bootstrap; // True if Tor can't send us bootstrap events
+        bool m_socks_requested; // True once we have asked for the socks5 listener
 
         std::vector<uint8_t> m_cookie;
         std::array<uint8_t, TOR_NONCE_SIZE> m_client_nonce;
@@ -247,12 +251,15 @@ namespace green {
         //     protocol.
         // `authchallenge_cb`: This callback does all the crypto stuff (HMACs, etc) and then tries to authenticate
         // `auth_cb`: This callback receives the result of the authentication. It ensures that everything
-        //     went fine, and since Tor has been running in background for all this time, it asks for the current
-        //     bootstrap phase, to see whether it is already connected or not.
-        // `bootstrap_phase_cb`: This callback receives the result of a bootstrap phase query. It has two possible
-        //     outcomes:
-        //         if the "progress" has reached 100, it asks tor for the socks5 port and sets `socks_cb` as callback
-        //         otherwise it sleeps for 250ms and then asks for the bootstrap phase again
+        //     went fine, and subscribes to Tor's client status events, so that bootstrap progress is pushed to us.
+        // `setevents_cb`: This callback receives the result of the subscription. Since Tor has been running in
+        //     background for all this time, it asks for the current bootstrap phase, to see whether it is already
+        //     connected or not.
+        // `bootstrap_phase_cb`: This callback receives the result of a bootstrap phase query. If the subscription
+        //     failed and the "progress" hasn't reached 100, it sleeps for 250ms and then asks again.
+        // `status_client_cb`: This callback receives bootstrap progress events pushed by Tor.
+        // `update_bootstrap_phase`: Called with the progress from either of the above: once the "progress" has
+        //     reached 100, it asks tor for the socks5 port and sets `socks_cb` as callback
         // `socks_cb`: This is the last callback, which copies the socks5 listener into our internal field and finally
         //     completes the "chain reaction.
         //
@@ -264,7 +271,10 @@ namespace green {
         void protocolinfo_cb(tor_control_connection& conn, const tor_control_reply& reply);
         void authchallenge_cb(tor_control_connection& conn, const tor_control_reply& reply);
         void auth_cb(tor_control_connection& conn, const tor_control_reply& reply);
+        void setevents_cb(tor_control_connection& conn, const tor_control_reply& reply);
         void bootstrap_phase_cb(tor_control_connection& conn, const tor_control_reply& reply);
+        void status_client_cb(tor_control_connection& conn, const tor_control_reply& reply);
+        void update_bootstrap_phase(tor_control_connection& conn, std::map<std::string, std::string>& m);
         void socks_cb(const tor_control_reply& reply);
 
         void disconnected_cb();
@@ -463,6 +473,8 @@ namespace green {
         , m_tor_datadir(tor_datadir)
         , m_tor_control_file(get_tor_control_file(m_tor_datadir))
         , m_stopping(false)
+        , m_poll_bootstrap(false)
+        , m_socks_requested(false)
     {
         GDK_LOG(info) << "Starting up internal Tor";
 
@@ -495,6 +507,11 @@ namespace green {
             argv_conf.emplace_back("auto");
             argv_conf.emplace_back("DataDirectory");
             argv_conf.emplace_back(m_tor_datadir.c_str());
+            // Tor caches the consensus, descriptors and guards in the data
+            // directory and reuses them when restarted. Don't let a dormant
+            // state saved by a previous run delay bootstrapping from them
+            argv_conf.emplace_back("DormantCanceledByStartup");
+            argv_conf.emplace_back("1");
 #if not defined(NDEBUG)
             if (!quiet) {
                 argv_conf.emplace_back("Log");
@@ -523,6 +540,8 @@ namespace green {
         m_bootstrap_phase = std::make_shared<tor_bootstrap_phase>();
         m_bootstrap_phase->control_port = m_tor_control_port;
 
+        m_conn->m_async_handler.connect(
+            std::bind(&tor_controller_impl::status_client_cb, this, std::placeholders::_1, std::placeholders::_2));
         GDK_RUNTIME_ASSERT(m_conn->connect(std::bind(&tor_controller_impl::connected_cb, this, std::placeholders::_1),
             std::bind(&tor_controller_impl::disconnected_cb, this)));
 
@@ -636,6 +655,19 @@ namespace green {
         GDK_RUNTIME_ASSERT(reply.m_code == 250);
         GDK_LOG(info) << "tor: ready, waiting for the circuit";
 
+        if (!_conn.command("SETEVENTS STATUS_CLIENT",
+                std::bind(&tor_controller_impl::setevents_cb, this, std::placeholders::_1, std::placeholders::_2))) {
+            this->disconnected_cb();
+        }
+    }
+
+    void tor_controller_impl::setevents_cb(tor_control_connection& _conn, const tor_control_reply& reply)
+    {
+        if (reply.m_code != 250) {
+            GDK_LOG(info) << "tor: status events unavailable, polling bootstrap phase";
+            m_poll_bootstrap = true;
+        }
+
         if (!_conn.command("GETINFO status/bootstrap-phase",
                 std::bind(
                     &tor_controller_impl::bootstrap_phase_cb, this, std::placeholders::_1, std::placeholders::_2))) {
@@ -651,6 +683,34 @@ namespace green {
         auto m = parse_tor_reply_mapping(l.second);
         GDK_RUNTIME_ASSERT(!m.empty());
 
+        update_bootstrap_phase(_conn, m);
+
+        if (m_poll_bootstrap && !m_socks_requested) {
+            std::this_thread::sleep_for(250ms);
+            if (!_conn.command("GETINFO status/bootstrap-phase",
+                    std::bind(&tor_controller_impl::bootstrap_phase_cb, this, std::placeholders::_1,
+                        std::placeholders::_2))) {
+                this->disconnected_cb();
+            }
+        }
+    }
+
+    void tor_controller_impl::status_client_cb(tor_control_connection& _conn, const tor_control_reply& reply)
+    {
+        // 650 STATUS_CLIENT NOTICE BOOTSTRAP PROGRESS=50 TAG=loading_descriptors SUMMARY="..."
+        const auto l = split_tor_reply_line(reply.m_lines[0]);
+        if (l.first != "STATUS_CLIENT") {
+            return;
+        }
+        auto m = parse_tor_reply_mapping(l.second);
+        if (m.count("BOOTSTRAP") && m.count("PROGRESS")) {
+            update_bootstrap_phase(_conn, m);
+        }
+    }
+
+    void tor_controller_impl::update_bootstrap_phase(
+        tor_control_connection& _conn, std::map<std::string, std::string>& m)
+    {
         // Locking here to avoid race conditions on m_bootstrap_phase
         {
             std::lock_guard<std::mutex> _(m_init_mutex);
@@ -663,20 +723,14 @@ namespace green {
         // Notify that we updated it, so that ga_session can emit a new notification
         m_init_cv.notify_all();
 
-        if (m_bootstrap_phase->progress == 100) {
+        if (m_bootstrap_phase->progress == 100 && !m_socks_requested) {
             GDK_LOG(info) << "tor: the circuit is ready, we can finally use it!";
+            m_socks_requested = true;
 
             if (!_conn.command("GETINFO net/listeners/socks",
                     std::bind(&tor_controller_impl::socks_cb, this, std::placeholders::_2))) {
                 this->disconnected_cb();
             }
-        } else {
-            std::this_thread::sleep_for(250ms);
-            if (!_conn.command("GETINFO status/bootstrap-phase",
-                    std::bind(&tor_controller_impl::bootstrap_phase_cb, this, std::placeholders::_1,
-                        std::placeholders::_2))) {
-                this->disconnected_cb();
-            }
         }
     }
 
@@ -794,4 +848,34 @@ namespace green {
         return m_ctrl ? m_ctrl->wait_for_socks5(timeout, phase_cb) : std::string();
     }
 
+    std::string tor_controller::get_socks_isolation(const std::string& destination, const std::string& proxy_uri)
+    {
+        auto&& get_isolation = [&destination](uint32_t circuit) { return destination + '/' + std::to_string(circuit); };
+
+        uint32_t circuit;
+        bool is_new;
+        {
+            std::lock_guard<std::mutex> _(m_isolation_mutex);
+            auto p = m_next_circuit.emplace(destination, 0);
+            is_new = p.second;
+            circuit = p.first->second;
+            p.first->second = (circuit + 1) % TOR_CIRCUITS_PER_DESTINATION;
+        }
+
+        if (is_new && TOR_CIRCUITS_PER_DESTINATION > 1) {
+            // Prebuild the other circuits while the first stream builds its own.
+            // Prebuilding runs asynchronously on the io context, which owns
+            // any exchange still pending when the controller is destroyed
+            for (uint32_t i = 1; i < TOR_CIRCUITS_PER_DESTINATION; ++i) {
+                try {
+                    socks_client::prebuild_circuit(gdk_io_context(), destination, proxy_uri, get_isolation(i));
+                } catch (const std::exception& ex) {
+                    // Not fatal: the circuit will be built when first used
+                    GDK_LOG(info) << "tor: failed to prebuild circuit for " << destination << ": " << ex.what();
+                }
+            }
+        }
+        return get_isolation(circuit);
+    }
+
 } // namespace green
@@ -3,6 +3,7 @@
 #pragma once
 
 #include <functional>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -11,6 +12,7 @@
 namespace green {
 
     static constexpr uint32_t DEFAULT_TOR_SOCKS_WAIT = 120; // maximum timeout for the tor socks to get ready
+    static constexpr uint32_t TOR_CIRCUITS_PER_DESTINATION = 3; // isolated circuits used for each destination
 
     struct tor_bootstrap_phase {
         tor_bootstrap_phase();
@@ -41,6 +43,14 @@ namespace green {
         std::string wait_for_socks5(std::function<void(std::shared_ptr<tor_bootstrap_phase>)> phase_cb,
             uint32_t timeout = DEFAULT_TOR_SOCKS_WAIT);
 
+        // Returns the SOCKS5 isolation credentials for a new stream to
+        // destination ("host:port") through proxy_uri. Streams to each
+        // destination use TOR_CIRCUITS_PER_DESTINATION isolated circuits in
+        // turn, so parallel requests use separate circuits. When a
+        // destination is first seen the circuits that the first stream will
+        // not build are prebuilt in the background.
+        std::string get_socks_isolation(const std::string& destination, const std::string& proxy_uri);
+
     private:
         static std::mutex s_inst_mutex;
         static std::weak_ptr<tor_controller> s_inst;
@@ -48,6 +58,10 @@ namespace green {
         std::mutex m_ctrl_mutex;
 
         std::string m_socks5_port;
+
+        // The next circuit to use for each destination
+        std::mutex m_isolation_mutex;
+        std::map<std::string, uint32_t> m_next_circuit;
     };
 
 } // namespace green
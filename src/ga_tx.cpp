@@ -1,31 +1,38 @@
 #include <algorithm>
 #include <array>
 #include <boost/algorithm/string/predicate.hpp>
+#include <chrono>
 #include <ctime>
 #include <nlohmann/json.hpp>
+#include <numeric>
+#include <set>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "amount.hpp"
+#include "coin_selection.hpp"
 #include "containers.hpp"
 #include "exception.hpp"
 #include "ga_strings.hpp"
 #include "ga_tx.hpp"
 #include "json_utils.hpp"
 #include "logging.hpp"
+#include "session.hpp"
 #include "session_impl.hpp"
 #include "signer.hpp"
+#include "stats.hpp"
+#include "threading.hpp"
 #include "transaction_utils.hpp"
 #include "utils.hpp"
 #include "xpub_hdkey.hpp"
 
-#include <wally_coinselection.h>
-
 namespace green {
 
     namespace {
         static const std::string UTXO_SEL_DEFAULT("default"); // Use the default utxo selection strategy
         static const std::string UTXO_SEL_MANUAL("manual"); // Use manual utxo selection
+        static constexpr uint32_t DEFAULT_COIN_SELECTION_MS = 50;
 
         static const std::string ZEROS(64, '0');
 
@@ -163,8 +170,8 @@ namespace green {
                             // For unknown/non-wallet UTXOs, fetch scriptpubkey
                             // from the inputs UTXO.
                             const auto& txhash_hex = j_strref(utxo, "txhash");
-                            const auto utxo_tx = session.get_raw_transaction_details(txhash_hex);
-                            const auto& txout = utxo_tx.get_output(j_uint32ref(utxo, "pt_idx"));
+                            const auto utxo_tx = session.get_raw_transaction(txhash_hex);
+                            const auto& txout = utxo_tx->get_output(j_uint32ref(utxo, "pt_idx"));
                             script.assign(txout.script, txout.script + txout.script_len);
                         }
                     }
@@ -192,7 +199,7 @@ namespace green {
         {
             const auto& net_params = session.get_network_parameters();
             const bool is_electrum = net_params.is_electrum();
-            const auto policy_asset = net_params.get_policy_asset();
+            const auto& policy_asset = net_params.get_policy_asset();
 
             if (result.find("previous_transaction") == result.end()) {
                 return std::make_pair(false, false);
@@ -242,7 +249,8 @@ namespace green {
                 }
             }
 
-            const auto tx = session.get_raw_transaction_details(prev_tx.at("txhash"));
+            const auto prev_tx_ptr = session.get_raw_transaction(prev_tx.at("txhash"));
+            const Tx& tx = *prev_tx_ptr;
             const auto min_fee_rate = session.get_min_fee_rate();
 
             // Store the old fee and fee rate to check if replacement
@@ -443,8 +451,40 @@ namespace green {
             std::vector<size_t> addressee_indices;
             std::vector<uint32_t> utxo_indices;
             std::optional<size_t> greedy_index;
+            // Indices of the UTXOs selected by a previous incremental call
+            std::vector<size_t> previous_indices;
         };
 
+        static std::string get_utxo_key(const nlohmann::json& utxo)
+        {
+            return j_strref(utxo, "txhash") + ':' + std::to_string(j_uint32ref(utxo, "pt_idx"));
+        }
+
+        // Get the previous incremental selection, largest value first, less
+        // any UTXOs no longer needed to cover target (e.g. because the amount
+        // was lowered). Returns an empty selection if it doesn't cover target.
+        static std::vector<size_t> get_previous_selection(const std::vector<amount::value_type>& values,
+            const addressee_details_t& addressee, amount::value_type target)
+        {
+            amount::value_type total = 0;
+            for (const auto i : addressee.previous_indices) {
+                total += values[i];
+            }
+            if (addressee.previous_indices.empty() || total < target) {
+                return {};
+            }
+            auto selected = addressee.previous_indices;
+            std::stable_sort(selected.begin(), selected.end(),
+                [&values](size_t lhs, size_t rhs) { return values[lhs] > values[rhs]; });
+            // Drop the smallest UTXOs while the rest still cover the target.
+            // Once one can't be dropped, no larger one can be either.
+            while (selected.size() > 1 && total - values[selected.back()] >= target) {
+                total -= values[selected.back()];
+                selected.pop_back();
+            }
+            return selected;
+        }
+
         static bool update_greedy_output(
             Tx& tx, nlohmann::json& result, addressee_details_t& addressee, amount::value_type change_amount)
         {
@@ -509,64 +549,214 @@ namespace green {
             tx.set_output_satoshi(change_idx, asset_id, change_amount);
         }
 
+        static std::chrono::milliseconds get_coin_selection_budget()
+        {
+            const auto ms = j_uint32(gdk_config(), "coin_selection_ms").value_or(DEFAULT_COIN_SELECTION_MS);
+            return std::chrono::milliseconds(ms);
+        }
+
+        // Lower bounds on the weight that spending each address type adds
+        // to a tx, with the dummy signatures add_tx_input uses (low-R where
+        // the user may sign low-R). Since these never overstate the weight
+        // of an input, coin selection can use them to skip computing the
+        // real fee while they show that more inputs are needed.
+        struct input_weight_t final {
+            std::string_view addr_type;
+            size_t weight;
+        };
+        static constexpr std::array<input_weight_t, 7> INPUT_WEIGHTS{ {
+            { "p2wpkh", 271 }, // 41 base bytes, witness: 2, 71 byte sig, 33 byte pubkey
+            { "p2sh-p2wpkh", 363 }, // As p2wpkh plus a 23 byte scriptsig
+            { "p2tr", 230 }, // 41 base bytes, witness: 2, 64 byte schnorr sig
+            { "p2pkh", 588 }, // 147 base bytes: 41 plus a 106 byte scriptsig
+            { "p2sh", 1040 }, // 2of2 multisig: 41 base bytes plus a 219+ byte scriptsig
+            { "p2wsh", 520 }, // p2sh-p2wsh 2of2 multisig: 76 base bytes, 218 witness bytes
+            { "csv", 500 }, // p2sh-p2wsh 2of2 with a csv expiry
+        } };
+        // The weight of the smallest known input, for unknown address types
+        static constexpr size_t MIN_INPUT_WEIGHT = 230;
+
+        static constexpr size_t get_input_weight(std::string_view addr_type)
+        {
+            for (const auto& w : INPUT_WEIGHTS) {
+                if (w.addr_type == addr_type) {
+                    return w.weight;
+                }
+            }
+            return MIN_INPUT_WEIGHT;
+        }
+        static_assert(get_input_weight("p2wpkh") == 271 && get_input_weight("unknown") == MIN_INPUT_WEIGHT);
+
+        // On Liquid, the weight that the last input added to tx adds to the
+        // surjection proofs of its blinded (i.e. non-fee) outputs. This
+        // matches the proof size estimated by Tx::get_adjusted_weight()
+        static size_t get_added_surjectionproof_weight(const Tx& tx)
+        {
+            const size_t num_inputs = tx.get_num_inputs();
+            GDK_RUNTIME_ASSERT(num_inputs);
+            // Proofs are estimated for at least one input
+            const size_t old_size = varbuff_get_length(asset_surjectionproof_size(std::max<size_t>(num_inputs - 1, 1)));
+            const size_t new_size = varbuff_get_length(asset_surjectionproof_size(num_inputs));
+            const auto outputs = tx.get_outputs();
+            const auto num_blinded = std::count_if(
+                outputs.begin(), outputs.end(), [](const auto& tx_out) { return tx_out.script != nullptr; });
+            return (new_size - old_size) * num_blinded;
+        }
+
+        static size_t get_utxo_input_weight(const nlohmann::json& utxo)
+        {
+            return get_input_weight(j_str_or_empty(utxo, "address_type"));
+        }
+
+        // Approximate vsize of an input spending utxo. Only used to guide
+        // UTXO selection: fees are always computed from the actual tx
+        static amount::value_type get_estimated_input_vsize(const nlohmann::json& utxo)
+        {
+            return (get_utxo_input_weight(utxo) + 3) / 4;
+        }
+
         static void pick_asset_utxos(session_impl& session, Tx& tx, nlohmann::json& result, nlohmann::json& utxos,
             addressee_details_t& addressee)
         {
             amount::value_type total = 0;
 
             // Perform asset UTXO selection
-            std::vector<std::pair<size_t, amount>> indexed_values;
-            for (size_t i = 0; i < utxos.size(); ++i) {
-                const auto satoshi = j_amountref(utxos[i]);
-                indexed_values.emplace_back(std::make_pair(i, satoshi));
-                total += satoshi.value();
+            std::vector<amount::value_type> values;
+            values.reserve(utxos.size());
+            for (const auto& utxo : utxos) {
+                values.push_back(j_amountref(utxo).value());
+                total += values.back();
             }
-            auto required_total = addressee.required_total.value();
+            const auto required_total = addressee.required_total.value();
             if (total < required_total) {
                 throw user_error(res::id_insufficient_funds);
             }
+            std::vector<size_t> selected;
             if (addressee.greedy_index.has_value()) {
-                required_total = total; // We require all the available value
+                // We require all the available value
+                selected.resize(values.size());
+                std::iota(selected.begin(), selected.end(), 0);
+            } else {
+                // Keep what is needed of a previous selection that still covers the amount
+                selected = get_previous_selection(values, addressee, required_total);
+            }
+            if (selected.empty()) {
+                // Asset change is never donated, so only exact matches avoid
+                // change. Costs are relative: one per input versus the change
+                // output, which is cheaper to add when fees are discounted.
+                coin_selection_params params;
+                params.target = required_total;
+                params.input_cost = 1;
+                params.change_cost = session.get_network_parameters().use_discounted_fees() ? 2 : 5;
+                params.budget = get_coin_selection_budget();
+                selected = select_coins(values, params);
+            }
+
+            for (const auto i : selected) {
+                addressee.utxo_indices.push_back(i);
+                addressee.utxo_sum += add_tx_input(session, result, tx, utxos[i], true);
+            }
+        }
+
+        // Order policy asset UTXOs for the fee-aware loop in pick_policy_asset_utxos,
+        // placing a selection expected to cover the amount and fees first
+        static std::vector<size_t> get_policy_asset_utxo_order(session_impl& session, const Tx& tx,
+            const nlohmann::json& utxos, const addressee_details_t& addressee, const amount& fee_rate,
+            const amount& network_fee)
+        {
+            const auto& net_params = session.get_network_parameters();
+            std::vector<size_t> order(utxos.size());
+            std::iota(order.begin(), order.end(), 0);
+            if (utxos.size() < 2 || addressee.greedy_index.has_value()) {
+                return order; // All UTXOs are used, in order
             }
-            auto&& sort_2nd = [](auto& l, auto& r) { return l.second < r.second; };
-            std::sort(indexed_values.begin(), indexed_values.end(), sort_2nd);
+
+            // Select on effective values: the value of each UTXO less the fee to spend it
+            const auto rate = fee_rate.value();
+            const amount::value_type input_fee = get_estimated_input_vsize(utxos[0]) * rate / 1000;
             std::vector<amount::value_type> values;
-            values.reserve(indexed_values.size());
-            for (const auto& v : indexed_values) {
-                values.push_back(v.second.value());
-            }
-            const size_t attempts = 1000000; /* FIXME: dynamic? */
-            const uint32_t io_ratio = session.get_network_parameters().use_discounted_fees() ? 2 : 5;
-            size_t written;
-            addressee.utxo_indices.resize(indexed_values.size());
-            int ret = wally_coinselect_assets(values.data(), values.size(), required_total, attempts, io_ratio,
-                addressee.utxo_indices.data(), addressee.utxo_indices.size(), &written);
-            addressee.utxo_indices.resize(written);
-            GDK_RUNTIME_ASSERT(ret == WALLY_OK);
-
-            for (auto& i : addressee.utxo_indices) {
-                i = indexed_values[i].first; // Set to the index of the chosen UTXO
-                addressee.utxo_sum += add_tx_input(session, result, tx, utxos[i], true);
+            values.reserve(utxos.size());
+            for (const auto& utxo : utxos) {
+                const auto fee = get_estimated_input_vsize(utxo) * rate / 1000;
+                const auto satoshi = j_amountref(utxo).value();
+                values.push_back(satoshi > fee ? satoshi - fee : 0);
+            }
+            constexpr amount::value_type change_output_vsize = 43;
+            const auto change_fee = change_output_vsize * rate / 1000;
+            coin_selection_params params;
+            // Target enough for non-dust change, since the loop does not donate excess to fees
+            params.target = addressee.required_total.value() + tx.get_fee(net_params, rate) + network_fee.value()
+                + change_fee + session.get_dust_threshold(addressee.asset_id).value() + 1;
+            params.input_cost = input_fee;
+            params.change_cost = change_fee + input_fee;
+            params.budget = get_coin_selection_budget();
+            // Keep what is needed of any previous selection that still
+            // covers the target, rather than searching again
+            auto selected = get_previous_selection(values, addressee, params.target);
+            if (selected.empty()) {
+                selected = select_coins(values, params);
+            }
+            if (selected.empty()) {
+                return order; // Insufficient effective value: let the loop decide
+            }
+            // Use the selection largest first, then the rest in their original order
+            std::vector<bool> is_selected(utxos.size());
+            for (const auto i : selected) {
+                is_selected[i] = true;
+            }
+            order = selected;
+            for (size_t i = 0; i < utxos.size(); ++i) {
+                if (!is_selected[i]) {
+                    order.push_back(i);
+                }
             }
+            return order;
         }
 
         static void pick_policy_asset_utxos(session_impl& session, Tx& tx, nlohmann::json& result,
             nlohmann::json& utxos, addressee_details_t& addressee, const amount& fee_rate, bool manual_selection)
         {
             const auto& net_params = session.get_network_parameters();
-            const auto policy_asset = net_params.get_policy_asset();
+            const auto& policy_asset = net_params.get_policy_asset();
             const amount dust_threshold = session.get_dust_threshold(policy_asset);
             const auto network_fee = j_amount_or_zero(result, "network_fee");
             const ssize_t num_utxos = manual_selection ? 0 : utxos.size();
             const bool is_greedy = addressee.greedy_index.has_value();
             bool added_change = false;
+            std::vector<size_t> order;
+            if (!manual_selection) {
+                order = get_policy_asset_utxo_order(session, tx, utxos, addressee, fee_rate, network_fee);
+            }
+
+            // The per-output cost of each input on Liquid when not discounted
+            const bool add_sjp_weight = net_params.is_liquid() && !net_params.use_discounted_fees();
+            size_t added_weight = 0; // Lower bound on input weight added since the fee was computed
+            auto add_next_input = [&](ssize_t i) {
+                const auto& utxo = utxos[order[i]];
+                addressee.utxo_indices.push_back(order[i]);
+                addressee.utxo_sum += add_tx_input(session, result, tx, utxo, true);
+                added_weight += get_utxo_input_weight(utxo);
+                if (add_sjp_weight) {
+                    added_weight += get_added_surjectionproof_weight(tx);
+                }
+            };
 
             for (ssize_t i = 0; i <= num_utxos; ++i) {
                 const bool no_more_utxos = i == num_utxos;
                 bool have_dusty_change = false; // TODO: Allow donating dusty fees
 
+                if (added_weight && !is_greedy && !no_more_utxos) {
+                    // Computing the real fee is linear in the tx size. Skip it
+                    // while a lower bound on the fee shows we need more inputs
+                    const amount::value_type min_fee_increase = added_weight / 4 * fee_rate.value() / 1000;
+                    if (addressee.utxo_sum < addressee.required_total + addressee.fee + min_fee_increase) {
+                        add_next_input(i);
+                        continue;
+                    }
+                }
                 addressee.fee = tx.get_fee(net_params, fee_rate.value());
                 addressee.fee += network_fee;
+                added_weight = 0;
                 auto required_total = addressee.required_total + addressee.fee;
 
                 if ((!is_greedy && addressee.utxo_sum >= required_total) || (is_greedy && no_more_utxos)) {
@@ -617,13 +807,13 @@ namespace green {
                     throw user_error("Insufficient funds for fees"); // FIXME res::
                 }
                 // Add the next input
-                addressee.utxo_indices.push_back(i);
-                addressee.utxo_sum += add_tx_input(session, result, tx, utxos[i], true);
+                add_next_input(i);
             }
         }
 
         static void pick_utxos(session_impl& session, Tx& tx, nlohmann::json& result, nlohmann::json& src_utxos,
-            addressee_details_t& addressee, const amount& fee_rate, bool manual_selection)
+            addressee_details_t& addressee, const amount& fee_rate, bool manual_selection,
+            const std::set<std::string>& previous_inputs)
         {
             // Select the inputs to use
             nlohmann::json empty = nlohmann::json::array_t{};
@@ -640,6 +830,13 @@ namespace green {
             }
             auto& utxos = manual_selection ? src_utxos : use_empty ? empty : src_utxos.at(addressee.asset_id);
 
+            if (!previous_inputs.empty()) {
+                for (size_t i = 0; i < utxos.size(); ++i) {
+                    if (previous_inputs.count(get_utxo_key(utxos[i]))) {
+                        addressee.previous_indices.push_back(i);
+                    }
+                }
+            }
             addressee.utxo_indices.reserve(utxos.size());
             if (is_policy_asset) {
                 pick_policy_asset_utxos(session, tx, result, utxos, addressee, fee_rate, manual_selection);
@@ -652,7 +849,7 @@ namespace green {
         {
             const auto& net_params = session.get_network_parameters();
             const bool is_liquid = net_params.is_liquid();
-            const auto policy_asset = net_params.get_policy_asset();
+            const auto& policy_asset = net_params.get_policy_asset();
 
             const auto subaccounts = get_tx_subaccounts(result);
             const bool is_partial = j_bool_or_false(result, "is_partial");
@@ -699,6 +896,7 @@ namespace green {
 
             const std::string strategy = json_add_if_missing(result, "utxo_strategy", UTXO_SEL_DEFAULT);
             const bool manual_selection = strategy == UTXO_SEL_MANUAL;
+            std::set<std::string> previous_inputs;
             GDK_RUNTIME_ASSERT(strategy == UTXO_SEL_DEFAULT || manual_selection);
             if (is_partial) {
                 GDK_RUNTIME_ASSERT(manual_selection);
@@ -712,7 +910,15 @@ namespace green {
                     set_tx_error(result, res::id_no_utxos_found);
                 }
             } else if (!is_rbf) {
-                // We will recompute the used utxos
+                // We will recompute the used utxos. When incremental, the
+                // previous call's inputs are preferred if they still suffice
+                if (j_bool_or_false(result, "incremental")) {
+                    if (auto p = result.find("transaction_inputs"); p != result.end() && p->is_array()) {
+                        for (const auto& utxo : *p) {
+                            previous_inputs.insert(get_utxo_key(utxo));
+                        }
+                    }
+                }
                 result["transaction_inputs"] = nlohmann::json::array();
             }
 
@@ -733,12 +939,15 @@ namespace green {
             btc_details.asset_id = policy_asset;
 
             // Validate the given addressees
-            for (size_t i = 0; i < addressees_p->size(); ++i) {
-                auto& addressee = addressees_p->at(i);
-                if (auto error = validate_tx_addressee(session, net_params, addressee); !error.empty()) {
+            const auto addressee_errors = validate_tx_addressees(session, net_params, *addressees_p);
+            for (const auto& error : addressee_errors) {
+                if (!error.empty()) {
                     set_tx_error(result, error);
                     return;
                 }
+            }
+            for (size_t i = 0; i < addressees_p->size(); ++i) {
+                auto& addressee = addressees_p->at(i);
                 auto asset_id = j_assetref(is_liquid, addressee);
                 auto& a = asset_addressees[asset_id];
                 a.asset_id = asset_id;
@@ -799,7 +1008,8 @@ namespace green {
                     }
                     if (is_policy_asset || !manual_selection) {
                         // Compute the UTXOs to use and their sum
-                        pick_utxos(session, tx, result, utxos, addressee, *fee_rate, manual_selection);
+                        pick_utxos(
+                            session, tx, result, utxos, addressee, *fee_rate, manual_selection, previous_inputs);
                     }
                     if (addressee.utxo_sum < addressee.required_total) {
                         set_tx_error(result, res::id_insufficient_funds);
@@ -904,11 +1114,6 @@ namespace green {
         std::swap(m_tx, rhs.m_tx);
     }
 
-    uint32_t Tx::get_flags() const
-    {
-        return WALLY_TX_FLAG_USE_WITNESS | (m_is_liquid ? WALLY_TX_FLAG_USE_ELEMENTS : 0);
-    }
-
     std::vector<unsigned char> Tx::to_bytes() const
     {
         size_t written;
@@ -973,17 +1178,28 @@ namespace green {
 
     void Tx::add_input(byte_span_t txhash, uint32_t index, uint32_t sequence, byte_span_t script,
         const struct wally_tx_witness_stack* witness)
+    {
+        if (m_is_liquid) {
+            add_input_impl<true>(txhash, index, sequence, script, witness);
+        } else {
+            add_input_impl<false>(txhash, index, sequence, script, witness);
+        }
+    }
+
+    template <bool IS_LIQUID>
+    void Tx::add_input_impl(byte_span_t txhash, uint32_t index, uint32_t sequence, byte_span_t script,
+        const struct wally_tx_witness_stack* witness)
     {
         constexpr uint32_t flags = 0;
         const unsigned char* script_p = script.empty() ? nullptr : script.data();
-        if (!m_is_liquid) {
+        if constexpr (!IS_LIQUID) {
             GDK_VERIFY(wally_tx_add_raw_input(
                 m_tx.get(), txhash.data(), txhash.size(), index, sequence, script_p, script.size(), witness, flags));
-            return;
+        } else {
+            GDK_VERIFY(wally_tx_add_elements_raw_input(m_tx.get(), txhash.data(), txhash.size(), index, sequence,
+                script_p, script.size(), witness, nullptr, 0, nullptr, 0, nullptr, 0, nullptr, 0, nullptr, 0, nullptr,
+                0, nullptr, flags));
         }
-        GDK_VERIFY(wally_tx_add_elements_raw_input(m_tx.get(), txhash.data(), txhash.size(), index, sequence, script_p,
-            script.size(), witness, nullptr, 0, nullptr, 0, nullptr, 0, nullptr, 0, nullptr, 0, nullptr, 0, nullptr,
-            flags));
     }
 
     void Tx::set_input_script(size_t index, byte_span_t script)
@@ -1119,10 +1335,20 @@ namespace green {
     }
 
     void Tx::set_output_satoshi(size_t index, const std::string& asset_id, uint64_t satoshi)
+    {
+        if (m_is_liquid) {
+            set_output_satoshi_impl<true>(index, asset_id, satoshi);
+        } else {
+            set_output_satoshi_impl<false>(index, asset_id, satoshi);
+        }
+    }
+
+    template <bool IS_LIQUID>
+    void Tx::set_output_satoshi_impl(size_t index, const std::string& asset_id, uint64_t satoshi)
     {
         auto& txout = get_output(index);
         txout.satoshi = satoshi;
-        if (m_is_liquid) {
+        if constexpr (IS_LIQUID) {
             // The given asset must match the txout we are updating
             const auto asset_bytes = h2b_rev(asset_id, 0x1);
             GDK_RUNTIME_ASSERT(txout.asset && txout.asset_len == asset_bytes.size()
@@ -1167,12 +1393,21 @@ namespace green {
 
     size_t Tx::get_adjusted_weight(const network_parameters& net_params) const
     {
-        const bool use_discounted_fees = net_params.use_discounted_fees();
-        size_t weight = get_weight(use_discounted_fees);
         GDK_RUNTIME_ASSERT(m_is_liquid == net_params.is_liquid());
-        if (m_is_liquid) {
+        return m_is_liquid ? get_adjusted_weight_impl<true>(net_params) : get_adjusted_weight_impl<false>(net_params);
+    }
+
+    template <bool IS_LIQUID> size_t Tx::get_adjusted_weight_impl(const network_parameters& net_params) const
+    {
+        if constexpr (!IS_LIQUID) {
+            size_t weight;
+            GDK_VERIFY(wally_tx_get_weight(m_tx.get(), &weight));
+            return weight;
+        } else {
+            const bool use_discounted_fees = net_params.use_discounted_fees();
+            size_t weight = get_weight(use_discounted_fees);
             // Add the weight of any missing blinding data
-            const auto policy_asset_bytes = h2b_rev(net_params.get_policy_asset(), 0x1);
+            const auto& policy_asset_bytes = net_params.get_policy_asset_bytes();
             const auto num_inputs = get_num_inputs() ? get_num_inputs() : 1; // Assume at least 1 input
             const size_t sjp_size = varbuff_get_length(asset_surjectionproof_size(num_inputs));
             size_t blinding_weight = 0;
@@ -1256,8 +1491,8 @@ namespace green {
                 }
             }
             weight += blinding_weight;
+            return weight;
         }
-        return weight;
     }
 
     uint64_t Tx::get_fee(const network_parameters& net_params, uint64_t fee_rate) const
@@ -1268,11 +1503,51 @@ namespace green {
         return static_cast<uint64_t>(std::ceil(fee));
     }
 
+    sighash_context::sighash_context(session_impl& session, const std::vector<nlohmann::json>& utxos)
+        : m_session(session)
+        , m_utxos(utxos)
+    {
+    }
+
+    void sighash_context::map_deleter::operator()(struct wally_map* p) { wally_map_free(p); }
+
+    const struct wally_map* sighash_context::get_scriptpubkeys()
+    {
+        if (!m_scriptpubkeys) {
+            m_scriptpubkeys.reset(get_input_scriptpubkeys(m_session, m_utxos));
+        }
+        return m_scriptpubkeys.get();
+    }
+
+    const std::vector<uint64_t>& sighash_context::get_values()
+    {
+        if (m_values.empty()) {
+            m_values = get_input_values(m_utxos);
+        }
+        return m_values;
+    }
+
     std::vector<unsigned char> Tx::get_signature_hash(
         session_impl& session, const std::vector<nlohmann::json>& utxos, size_t index, uint32_t sighash_flags) const
+    {
+        sighash_context ctx(session, utxos);
+        return get_signature_hash(ctx, index, sighash_flags);
+    }
+
+    std::vector<unsigned char> Tx::get_signature_hash(sighash_context& ctx, size_t index, uint32_t sighash_flags) const
+    {
+        if (m_is_liquid) {
+            return get_signature_hash_impl<true>(ctx, index, sighash_flags);
+        }
+        return get_signature_hash_impl<false>(ctx, index, sighash_flags);
+    }
+
+    template <bool IS_LIQUID>
+    std::vector<unsigned char> Tx::get_signature_hash_impl(
+        sighash_context& ctx, size_t index, uint32_t sighash_flags) const
     {
         std::array<unsigned char, SHA256_LEN> ret;
-        const nlohmann::json& utxo = utxos.at(index);
+        const nlohmann::json& utxo = ctx.get_utxos().at(index);
         const auto satoshi = j_amountref(utxo).value();
         const auto script = j_bytesref(utxo, "prevout_script");
         const auto& addr_type = j_strref(utxo, "address_type");
@@ -1280,15 +1555,14 @@ namespace green {
         const bool is_p2tr = addr_type == address_type::p2tr;
         const uint32_t flags = is_segwit && !is_p2tr ? WALLY_TX_FLAG_USE_WITNESS : 0;
 
-        validate_sighash_flags(sighash_flags, is_p2tr, m_is_liquid);
+        validate_sighash_flags(sighash_flags, is_p2tr, IS_LIQUID);
 
-        if (!m_is_liquid) {
+        if constexpr (!IS_LIQUID) {
             if (is_p2tr) {
-                using map_ptr = std::unique_ptr<struct wally_map, decltype(&wally_map_free)>;
-                const map_ptr scripts(get_input_scriptpubkeys(session, utxos), wally_map_free);
-                const auto values = get_input_values(utxos);
+                const auto scripts = ctx.get_scriptpubkeys();
+                const auto& values = ctx.get_values();
                 const uint32_t key_version = 0;
-                GDK_VERIFY(wally_tx_get_btc_taproot_signature_hash(m_tx.get(), index, scripts.get(), values.data(),
+                GDK_VERIFY(wally_tx_get_btc_taproot_signature_hash(m_tx.get(), index, scripts, values.data(),
                     values.size(), nullptr, 0, key_version, WALLY_NO_CODESEPARATOR, nullptr, 0, sighash_flags, flags,
                     ret.data(), ret.size()));
             } else {
@@ -1296,20 +1570,20 @@ namespace green {
                     sighash_flags, flags, ret.data(), ret.size()));
             }
             return { ret.begin(), ret.end() };
-        }
-
-        // FIXME: TAPROOT: Support p2tr for Liquid
-        GDK_RUNTIME_ASSERT_MSG(!is_p2tr, "Taproot is not yet supported for Liquid");
+        } else {
+            // FIXME: TAPROOT: Support p2tr for Liquid
+            GDK_RUNTIME_ASSERT_MSG(!is_p2tr, "Taproot is not yet supported for Liquid");
 
-        // Liquid case - has a value-commitment in place of a satoshi value
-        auto ct_value = j_bytes_or_empty(utxo, "commitment");
-        if (ct_value.empty()) {
-            const auto value = tx_confidential_value_from_satoshi(satoshi);
-            ct_value.assign(std::begin(value), std::end(value));
+            // Liquid case - has a value-commitment in place of a satoshi value
+            auto ct_value = j_bytes_or_empty(utxo, "commitment");
+            if (ct_value.empty()) {
+                const auto value = tx_confidential_value_from_satoshi(satoshi);
+                ct_value.assign(std::begin(value), std::end(value));
+            }
+            GDK_VERIFY(wally_tx_get_elements_signature_hash(m_tx.get(), index, script.data(), script.size(),
+                ct_value.data(), ct_value.size(), sighash_flags, flags, ret.data(), ret.size()));
+            return { ret.begin(), ret.end() };
         }
-        GDK_VERIFY(wally_tx_get_elements_signature_hash(m_tx.get(), index, script.data(), script.size(),
-            ct_value.data(), ct_value.size(), sighash_flags, flags, ret.data(), ret.size()));
-        return { ret.begin(), ret.end() };
     }
 
     void Tx::validate_user_signatures(session_impl& session, std::vector<nlohmann::json>& inputs, bool for_rbf) const
@@ -1321,6 +1595,18 @@ namespace green {
 
         GDK_RUNTIME_ASSERT(get_num_inputs() == inputs.size());
 
+        // Signatures to verify. Collected first, since gathering them
+        // updates the inputs and looks up keys, then verified together
+        struct sig_check final {
+            size_t index;
+            uint32_t sighash_flags;
+            uint32_t flags;
+            ec_sig_t sig;
+            std::vector<unsigned char> public_key;
+        };
+        std::vector<sig_check> checks;
+        bool have_p2tr = false;
+
         for (size_t i = 0; i < inputs.size(); ++i) {
             auto& input = inputs.at(i);
             if (!is_wallet_utxo(input)) {
@@ -1356,33 +1642,49 @@ namespace green {
                     continue;
                 }
                 GDK_RUNTIME_ASSERT(!der_sig.empty()); // Must have a signature
-                uint32_t sighash_flags;
-                uint32_t flags;
-                ec_sig_t sig;
-                std::vector<unsigned char> public_key;
+                auto& check = checks.emplace_back();
+                check.index = i;
 
                 if (is_p2tr) {
                     const auto sig_len = der_sig.size();
                     GDK_RUNTIME_ASSERT(sig_len == EC_SIGNATURE_LEN || sig_len == EC_SIGNATURE_LEN + 1);
-                    sighash_flags = sig_len == EC_SIGNATURE_LEN ? WALLY_SIGHASH_DEFAULT : der_sig.back();
-                    memcpy(&sig, der_sig.data(), EC_SIGNATURE_LEN);
-                    public_key = keys.at(sig_i).get_tweaked_xonly_key(is_liquid);
-                    flags = EC_FLAG_SCHNORR;
+                    check.sighash_flags = sig_len == EC_SIGNATURE_LEN ? WALLY_SIGHASH_DEFAULT : der_sig.back();
+                    memcpy(&check.sig, der_sig.data(), EC_SIGNATURE_LEN);
+                    check.public_key = keys.at(sig_i).get_tweaked_xonly_key(is_liquid);
+                    check.flags = EC_FLAG_SCHNORR;
+                    have_p2tr = true;
                 } else {
-                    sighash_flags = der_sig.back();
+                    check.sighash_flags = der_sig.back();
                     constexpr bool has_sighash_byte = true;
-                    sig = ec_sig_from_der(der_sig, has_sighash_byte);
+                    check.sig = ec_sig_from_der(der_sig, has_sighash_byte);
                     const auto pk = keys.at(sig_i).get_public_key();
-                    public_key = { pk.begin(), pk.end() };
-                    flags = EC_FLAG_ECDSA;
+                    check.public_key = { pk.begin(), pk.end() };
+                    check.flags = EC_FLAG_ECDSA;
                 }
                 if (for_rbf) {
-                    input["user_sighash"] = sighash_flags;
+                    input["user_sighash"] = check.sighash_flags;
                 }
-                const auto signature_hash = get_signature_hash(session, inputs, i, sighash_flags);
-                GDK_RUNTIME_ASSERT(ec_sig_verify(public_key, signature_hash, sig, flags));
             }
         }
+
+        sighash_context ctx(session, inputs);
+        if (have_p2tr && !is_liquid) {
+            // Compute the shared taproot hash data up front, since the
+            // context is read concurrently when verifying below
+            ctx.get_scriptpubkeys();
+            ctx.get_values();
+        }
+        // Hash and verify each signature. Only the tx and the (now
+        // read-only) context are shared, so this can be done in parallel
+        constexpr size_t min_checks_per_thread = 8;
+        parallel_for(
+            checks.size(),
+            [&](size_t n) {
+                const auto& check = checks[n];
+                const auto signature_hash = get_signature_hash(ctx, check.index, check.sighash_flags);
+                GDK_RUNTIME_ASSERT(ec_sig_verify(check.public_key, signature_hash, check.sig, check.flags));
+            },
+            min_checks_per_thread);
     }
 
     void utxo_add_paths(session_impl& session, nlohmann::json& utxo)
@@ -1416,7 +1718,7 @@ namespace green {
         const network_parameters& net_params, nlohmann::json& addr, const std::string& blinding_pubkey_hex)
     {
         GDK_RUNTIME_ASSERT(addr.at("is_confidential") == false);
-        const std::string bech32_prefix = net_params.bech32_prefix();
+        const auto& bech32_prefix = net_params.bech32_prefix();
         auto& address = addr.at("address");
         addr["unconfidential_address"] = address;
         if (boost::starts_with(address.get<std::string>(), bech32_prefix)) {
@@ -1429,6 +1731,38 @@ namespace green {
         addr["is_confidential"] = true;
     }
 
+    size_t get_estimated_input_weight(const nlohmann::json& utxo)
+    {
+        // Allow for two high-R signatures, since the table is a lower bound
+        return get_utxo_input_weight(utxo) + 2 * 4;
+    }
+
+    size_t get_estimated_tx_weight(const network_parameters& net_params, size_t num_inputs, size_t inputs_weight,
+        size_t num_outputs, bool is_discounted)
+    {
+        // Version, locktime, 3 byte input/output counts, segwit marker/flag
+        size_t weight = (4 + 4 + 3 + 3) * 4 + 2 + inputs_weight;
+        if (!net_params.is_liquid()) {
+            // Value and a script of up to 34 bytes (p2wsh/p2tr)
+            return weight + num_outputs * (8 + 1 + 34) * 4;
+        }
+        // Blinded outputs: asset, value and nonce commitments and script
+        weight += num_outputs * (33 + 33 + 33 + 1 + 34) * 4;
+        // The explicit fee output: asset, value, empty nonce and script
+        weight += (33 + 9 + 1 + 1) * 4;
+        // Empty input witnesses
+        weight += num_inputs * 4;
+        if (!is_discounted) {
+            // Blinded output witnesses are only discounted when enabled
+            const size_t sjp_size = varbuff_get_length(asset_surjectionproof_size(std::max<size_t>(num_inputs, 1)));
+            const size_t rangeproof_size = varbuff_get_length(asset_rangeproof_max_size(amount::get_max_satoshi()));
+            weight += num_outputs * (sjp_size + rangeproof_size);
+        } else {
+            weight += num_outputs * 2;
+        }
+        return weight;
+    }
+
     void create_transaction(session_impl& session, nlohmann::json& details)
     {
         try {
@@ -1446,8 +1780,13 @@ namespace green {
     std::vector<std::string> sign_transaction(
         session_impl& session, const Tx& tx, const std::vector<nlohmann::json>& inputs)
     {
+        stats::timer timer("tx", "sign_transaction");
         std::vector<std::string> sigs(inputs.size());
+        std::vector<signer::sign_request> requests;
+        std::vector<std::pair<size_t, uint32_t>> request_inputs; // Input index, sighash
 
+        // Compute the signature hashes serially, as the context is shared
+        sighash_context ctx(session, inputs);
         for (size_t i = 0; i < inputs.size(); ++i) {
             const auto& utxo = inputs.at(i);
             GDK_RUNTIME_ASSERT(j_str_is_empty(utxo, "private_key"));
@@ -1457,23 +1796,30 @@ namespace green {
             const bool is_p2tr = j_strref(utxo, "address_type") == address_type::p2tr;
             const auto default_sighash = is_p2tr ? WALLY_SIGHASH_DEFAULT : WALLY_SIGHASH_ALL;
             const auto sighash_flags = j_uint32(utxo, "user_sighash").value_or(default_sighash);
-            const auto message = tx.get_signature_hash(session, inputs, i, sighash_flags);
 
             const uint32_t subaccount = j_uint32_or_zero(utxo, "subaccount");
             const uint32_t pointer = j_uint32_or_zero(utxo, "pointer");
             const bool is_internal = j_bool_or_false(utxo, "is_internal");
-            const auto path = session.get_user_pubkeys().get_full_path(subaccount, pointer, is_internal);
-            if (j_strref(utxo, "address_type") == address_type::p2tr) {
-                const auto sig = session.get_nonnull_signer()->schnorr_sign(path, message);
+            auto path = session.get_user_pubkeys().get_full_path(subaccount, pointer, is_internal);
+            requests.push_back({ std::move(path), tx.get_signature_hash(ctx, i, sighash_flags), is_p2tr });
+            request_inputs.emplace_back(i, sighash_flags);
+        }
+
+        // Then derive the keys and sign in parallel
+        const auto signatures = session.get_nonnull_signer()->sign(requests);
+
+        for (size_t i = 0; i < requests.size(); ++i) {
+            const auto [input_index, sighash_flags] = request_inputs[i];
+            const auto& sig = signatures[i];
+            if (requests[i].is_schnorr) {
                 std::vector<unsigned char> sig_with_sighash{ sig.begin(), sig.end() };
                 if (sighash_flags != WALLY_SIGHASH_DEFAULT) {
                     // Include the sighash flags when non-default, per BIP 341
                     sig_with_sighash.push_back(static_cast<unsigned char>(sighash_flags));
                 }
-                sigs[i] = b2h(sig_with_sighash);
+                sigs[input_index] = b2h(sig_with_sighash);
             } else {
-                const auto sig = session.get_nonnull_signer()->ecdsa_sign(path, message);
-                sigs[i] = b2h(ec_sig_to_der(sig, sighash_flags));
+                sigs[input_index] = b2h(ec_sig_to_der(sig, sighash_flags));
             }
         }
         return sigs;
@@ -1528,6 +1874,7 @@ namespace green {
 
     void blind_transaction(session_impl& session, nlohmann::json& details, const nlohmann::json& blinding_data)
     {
+        stats::timer timer("tx", "blind_transaction");
         const auto& net_params = session.get_network_parameters();
         const bool is_liquid = net_params.is_liquid();
         GDK_RUNTIME_ASSERT(is_liquid);
@@ -1596,6 +1943,34 @@ namespace green {
             blinding_nonces.reserve(transaction_outputs.size());
         }
 
+        // The proofs for an output, computed after all blinders are known
+        struct output_proofs final {
+            size_t index;
+            std::vector<unsigned char> asset_id;
+            std::vector<unsigned char> abf;
+            vbf_t vbf;
+            uint64_t value;
+            std::array<unsigned char, ASSET_GENERATOR_LEN> generator;
+            std::vector<unsigned char> value_commitment;
+            std::vector<unsigned char> scriptpubkey;
+            std::vector<unsigned char> blinding_pubkey;
+            priv_key_t eph_private_key;
+            std::vector<unsigned char> eph_public_key;
+            std::array<unsigned char, 32> entropy;
+            bool needs_rangeproof;
+            std::vector<unsigned char> rangeproof;
+            std::vector<unsigned char> surjectionproof;
+        };
+        std::vector<output_proofs> to_prove;
+        to_prove.reserve(transaction_outputs.size());
+        const auto wipe_keys = gsl::finally([&to_prove] {
+            for (auto& p : to_prove) {
+                wally_bzero(p.eph_private_key.data(), p.eph_private_key.size());
+            }
+        });
+
+        // Compute all blinders, commitments and ephemeral keys in output order,
+        // since the final vbf depends on every preceding output
         for (size_t i = 0; i < transaction_outputs.size(); ++i) {
             auto& output = transaction_outputs[i];
             if (j_str_is_empty(output, "scriptpubkey")) {
@@ -1668,24 +2043,24 @@ namespace green {
             }
 
             const auto& o = tx.get_output(i);
-            const auto generator = asset_generator_from_bytes(asset_id, abf);
-            std::vector<unsigned char> value_commitment;
+            auto& p = to_prove.emplace_back();
+            p.index = i;
+            p.value = value.value();
+            p.vbf = vbf;
+            p.generator = asset_generator_from_bytes(asset_id, abf);
             if (for_final_vbf) {
-                value_commitment = asset_value_commitment(value.value(), vbf, generator);
+                p.value_commitment = asset_value_commitment(p.value, vbf, p.generator);
             } else {
-                value_commitment = { o.value, o.value + o.value_len };
+                p.value_commitment = { o.value, o.value + o.value_len };
             }
+            p.scriptpubkey = j_bytesref(output, "scriptpubkey");
 
-            const auto scriptpubkey = j_bytesref(output, "scriptpubkey");
-
-            std::vector<unsigned char> eph_public_key;
-            std::vector<unsigned char> rangeproof;
-
-            if (is_blinded(o) && !memcmp(o.asset, generator.data(), o.asset_len)
-                && !memcmp(o.value, value_commitment.data(), o.value_len)) {
+            p.needs_rangeproof = !is_blinded(o) || memcmp(o.asset, p.generator.data(), o.asset_len)
+                || memcmp(o.value, p.value_commitment.data(), o.value_len);
+            if (!p.needs_rangeproof) {
                 // Rangeproof already created for the same commitments
-                eph_public_key.assign(o.nonce, o.nonce + o.nonce_len);
-                rangeproof.assign(o.rangeproof, o.rangeproof + o.rangeproof_len);
+                p.eph_public_key.assign(o.nonce, o.nonce + o.nonce_len);
+                p.rangeproof.assign(o.rangeproof, o.rangeproof + o.rangeproof_len);
                 if (blinding_nonces_required) {
                     // Add the pre-blinded outputs blinding nonce
                     GDK_RUNTIME_ASSERT(output.contains("blinding_nonce"));
@@ -1693,29 +2068,40 @@ namespace green {
                 }
             } else {
                 GDK_RUNTIME_ASSERT(!output.contains("nonce_commitment"));
-                priv_key_t eph_private_key;
-                std::tie(eph_private_key, eph_public_key) = get_ephemeral_keypair();
-                output["eph_public_key"] = b2h(eph_public_key);
-                const auto blinding_pubkey = j_bytesref(output, "blinding_key");
+                std::tie(p.eph_private_key, p.eph_public_key) = get_ephemeral_keypair();
+                output["eph_public_key"] = b2h(p.eph_public_key);
+                p.blinding_pubkey = j_bytesref(output, "blinding_key");
                 GDK_RUNTIME_ASSERT(!output.contains("blinding_nonce"));
                 if (blinding_nonces_required) {
                     // Generate the blinding nonce for the caller
-                    const auto nonce = sha256(ecdh(blinding_pubkey, eph_private_key));
+                    const auto nonce = sha256(ecdh(p.blinding_pubkey, p.eph_private_key));
                     blinding_nonces.emplace_back(b2h(nonce));
                 }
-
-                rangeproof = asset_rangeproof(value.value(), blinding_pubkey, eph_private_key, asset_id, abf, vbf,
-                    value_commitment, scriptpubkey, generator);
             }
+            if (!is_partial) {
+                p.entropy = get_random_bytes<32>();
+            }
+            p.asset_id = asset_id;
+            p.abf = std::move(abf);
+        }
 
-            std::vector<unsigned char> surjectionproof;
+        // Generate the range and surjection proofs, which dominate the cost
+        // of blinding, for all outputs concurrently
+        parallel_for(to_prove.size(), [&](size_t n) {
+            auto& p = to_prove[n];
+            if (p.needs_rangeproof) {
+                p.rangeproof = asset_rangeproof(p.value, p.blinding_pubkey, p.eph_private_key, p.asset_id, p.abf,
+                    p.vbf, p.value_commitment, p.scriptpubkey, p.generator);
+            }
             if (!is_partial) {
-                const auto entropy = get_random_bytes<32>();
-                surjectionproof
-                    = asset_surjectionproof(asset_id, abf, generator, entropy, assets, all_abfs, generators);
+                p.surjectionproof = asset_surjectionproof(
+                    p.asset_id, p.abf, p.generator, p.entropy, assets, all_abfs, generators);
             }
+        });
 
-            tx.set_output_commitments(i, generator, value_commitment, eph_public_key, surjectionproof, rangeproof);
+        for (const auto& p : to_prove) {
+            tx.set_output_commitments(
+                p.index, p.generator, p.value_commitment, p.eph_public_key, p.surjectionproof, p.rangeproof);
         }
 
         details["is_blinded"] = true;
@@ -1734,6 +2120,7 @@ namespace green {
         // FIXME: this is another place where unblinding is performed (the other is ga_session::unblind_utxo).
         //        This is not ideal and we should aim to have a single place to perform unblinding,
         //        but unfortunately it is quite complex so for now we have this duplication.
+        stats::timer timer("tx", "unblind_output");
         const auto& net_params = session.get_network_parameters();
         GDK_RUNTIME_ASSERT(net_params.is_liquid());
         GDK_RUNTIME_ASSERT(vout < tx.get_num_outputs());
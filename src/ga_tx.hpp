@@ -3,6 +3,7 @@
 #pragma once
 
 #include "ga_wally.hpp"
+#include <memory>
 #include <nlohmann/json_fwd.hpp>
 #include <optional>
 
@@ -11,6 +12,32 @@ namespace green {
     class network_parameters;
     class session_impl;
 
+    // Input data shared by the signature hashes of all inputs of a tx.
+    // Computed on first use and reused for each input, so that hashing
+    // every input is not quadratic in the number of inputs.
+    class sighash_context final {
+    public:
+        sighash_context(session_impl& session, const std::vector<nlohmann::json>& utxos);
+        sighash_context(const sighash_context&) = delete;
+        sighash_context& operator=(const sighash_context&) = delete;
+
+        const std::vector<nlohmann::json>& get_utxos() const { return m_utxos; }
+
+        // The scriptpubkeys and amounts of every input, as used by BIP 341
+        const struct wally_map* get_scriptpubkeys();
+        const std::vector<uint64_t>& get_values();
+
+    private:
+        struct map_deleter {
+            void operator()(struct wally_map* p);
+        };
+
+        session_impl& m_session;
+        const std::vector<nlohmann::json>& m_utxos;
+        std::unique_ptr<struct wally_map, map_deleter> m_scriptpubkeys;
+        std::vector<uint64_t> m_values;
+    };
+
     class Tx {
     public:
         Tx(uint32_t locktime, uint32_t version, bool is_liquid);
@@ -78,6 +105,9 @@ namespace green {
         size_t get_adjusted_weight(const network_parameters& net_params) const;
         uint64_t get_fee(const network_parameters& net_params, uint64_t fee_rate) const;
 
+        std::vector<unsigned char> get_signature_hash(sighash_context& ctx, size_t index, uint32_t sighash) const;
+        // Compute a single signature hash. When hashing multiple inputs,
+        // use the sighash_context overload with one context for all inputs.
         std::vector<unsigned char> get_signature_hash(
             session_impl& session, const std::vector<nlohmann::json>& utxos, size_t index, uint32_t sighash) const;
 
@@ -86,7 +116,22 @@ namespace green {
         void validate_user_signatures(session_impl& session, std::vector<nlohmann::json>& inputs, bool for_rbf) const;
 
     private:
-        uint32_t get_flags() const;
+        // Chain specific implementations. The public methods above dispatch
+        // to these once on m_is_liquid, so the Bitcoin paths compile without
+        // any of the Liquid handling.
+        template <bool IS_LIQUID> static constexpr uint32_t get_flags_impl()
+        {
+            return WALLY_TX_FLAG_USE_WITNESS | (IS_LIQUID ? WALLY_TX_FLAG_USE_ELEMENTS : 0);
+        }
+        uint32_t get_flags() const { return m_is_liquid ? get_flags_impl<true>() : get_flags_impl<false>(); }
+        template <bool IS_LIQUID>
+        void add_input_impl(byte_span_t txhash, uint32_t index, uint32_t sequence, byte_span_t script,
+            const struct wally_tx_witness_stack* witness);
+        template <bool IS_LIQUID>
+        void set_output_satoshi_impl(size_t index, const std::string& asset_id, uint64_t satoshi);
+        template <bool IS_LIQUID> size_t get_adjusted_weight_impl(const network_parameters& net_params) const;
+        template <bool IS_LIQUID>
+        std::vector<unsigned char> get_signature_hash_impl(sighash_context& ctx, size_t index, uint32_t sighash) const;
 
         struct tx_deleter {
             void operator()(struct wally_tx* p);
@@ -103,6 +148,15 @@ namespace green {
         const network_parameters& net_params, nlohmann::json& addr, const std::string& blinding_pubkey_hex);
     nlohmann::json unblind_output(session_impl& session, const Tx& tx, uint32_t vout);
 
+    // Conservative estimates of the weight of spending a wallet utxo, and
+    // of a tx with num_outputs wallet outputs, for planning txs before
+    // they are created. Fees are always computed from the actual tx.
+    // If is_discounted is true, Liquid output witnesses are discounted
+    // as for fee computation when discounted fees are enabled.
+    size_t get_estimated_input_weight(const nlohmann::json& utxo);
+    size_t get_estimated_tx_weight(const network_parameters& net_params, size_t num_inputs, size_t inputs_weight,
+        size_t num_outputs, bool is_discounted);
+
     void create_transaction(session_impl& session, nlohmann::json& details);
 
     std::vector<std::string> sign_transaction(
@@ -1,5 +1,10 @@
 #include <boost/algorithm/string/predicate.hpp>
 
+#include <cctype>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "exception.hpp"
 #include "ga_strings.hpp"
 #include "ga_wally.hpp"
@@ -412,33 +417,156 @@ namespace green {
     //
     // Strings/Addresses
     //
+    namespace {
+        static const char HEX_DIGITS[] = "0123456789abcdef";
+
+        // The value of each hex character, or 0xff if not a hex character
+        static const std::array<uint8_t, 256> HEX_VALUES = [] {
+            std::array<uint8_t, 256> values;
+            values.fill(0xff);
+            for (uint8_t i = 0; i < 16; ++i) {
+                values[static_cast<uint8_t>(HEX_DIGITS[i])] = i;
+                values[static_cast<uint8_t>(std::toupper(HEX_DIGITS[i]))] = i;
+            }
+            return values;
+        }();
+
+#ifdef __SSE2__
+        // Reverse the bytes of v
+        static __m128i reverse_bytes(__m128i v)
+        {
+            v = _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3));
+            v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+            v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+            return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        }
+
+        // Hex encode 16 bytes into 32 characters
+        static void b2h_16(const unsigned char* src, char* dst, bool reverse)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+            if (reverse) {
+                v = reverse_bytes(v);
+            }
+            const __m128i nibble_mask = _mm_set1_epi8(0xf);
+            auto&& to_chars = [](__m128i nibbles) {
+                // '0'-'9' for 0-9, then 'a'-'f' for 10-15
+                const __m128i is_letter = _mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9));
+                const __m128i chars = _mm_add_epi8(nibbles, _mm_set1_epi8('0'));
+                return _mm_add_epi8(chars, _mm_and_si128(is_letter, _mm_set1_epi8('a' - '0' - 10)));
+            };
+            const __m128i hi = to_chars(_mm_and_si128(_mm_srli_epi16(v, 4), nibble_mask));
+            const __m128i lo = to_chars(_mm_and_si128(v, nibble_mask));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_unpacklo_epi8(hi, lo));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16), _mm_unpackhi_epi8(hi, lo));
+        }
+
+        // Decode 16 hex characters into their values, clearing is_valid if any are invalid
+        static __m128i hex_values_16(const char* src, bool& is_valid)
+        {
+            const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+            const __m128i minus_one = _mm_set1_epi8(-1);
+            // Digits. Characters >= 0x80 compare as negative or out of range
+            const __m128i digit = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+            const __m128i is_digit
+                = _mm_and_si128(_mm_cmpgt_epi8(digit, minus_one), _mm_cmplt_epi8(digit, _mm_set1_epi8(10)));
+            // Letters of either case
+            const __m128i letter = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+            const __m128i is_letter
+                = _mm_and_si128(_mm_cmpgt_epi8(letter, minus_one), _mm_cmplt_epi8(letter, _mm_set1_epi8(6)));
+            if (_mm_movemask_epi8(_mm_or_si128(is_digit, is_letter)) != 0xffff) {
+                is_valid = false;
+            }
+            return _mm_or_si128(_mm_and_si128(is_digit, digit),
+                _mm_and_si128(is_letter, _mm_add_epi8(letter, _mm_set1_epi8(10))));
+        }
+
+        // Hex decode 32 characters into 16 bytes, returning false if any are invalid
+        static bool h2b_16(const char* src, unsigned char* dst, bool reverse)
+        {
+            bool is_valid = true;
+            const __m128i low_byte_mask = _mm_set1_epi16(0xff);
+            auto&& combine = [&](__m128i values) {
+                // Each 16 bit lane holds the high nibble in its low byte
+                const __m128i hi = _mm_slli_epi16(_mm_and_si128(values, low_byte_mask), 4);
+                return _mm_or_si128(hi, _mm_srli_epi16(values, 8));
+            };
+            const __m128i first = combine(hex_values_16(src, is_valid));
+            const __m128i second = combine(hex_values_16(src + 16, is_valid));
+            __m128i v = _mm_packus_epi16(first, second);
+            if (reverse) {
+                v = reverse_bytes(v);
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), v);
+            return is_valid;
+        }
+#endif
+    } // namespace
+
+    void b2h(byte_span_t data, gsl::span<char> hex, bool reverse)
+    {
+        const size_t n = data.size();
+        GDK_RUNTIME_ASSERT(hex.size() == n * 2);
+        const unsigned char* src = data.data();
+        char* dst = hex.data();
+        size_t i = 0;
+#ifdef __SSE2__
+        for (; i + 16 <= n; i += 16) {
+            // When reversing, bytes [i, i+16) of the output come from the end
+            b2h_16(reverse ? src + n - i - 16 : src + i, dst + i * 2, reverse);
+        }
+#endif
+        for (; i < n; ++i) {
+            const unsigned char b = src[reverse ? n - i - 1 : i];
+            dst[i * 2] = HEX_DIGITS[b >> 4];
+            dst[i * 2 + 1] = HEX_DIGITS[b & 0xf];
+        }
+    }
+
+    void h2b(std::string_view hex, gsl::span<unsigned char> bytes, bool reverse)
+    {
+        const size_t n = bytes.size();
+        GDK_RUNTIME_ASSERT(hex.size() == n * 2);
+        const char* src = hex.data();
+        unsigned char* dst = bytes.data();
+        size_t i = 0;
+        bool is_valid = true;
+#ifdef __SSE2__
+        for (; i + 16 <= n; i += 16) {
+            is_valid &= h2b_16(src + i * 2, reverse ? dst + n - i - 16 : dst + i, reverse);
+        }
+#endif
+        for (; i < n; ++i) {
+            const uint8_t hi = HEX_VALUES[static_cast<uint8_t>(src[i * 2])];
+            const uint8_t lo = HEX_VALUES[static_cast<uint8_t>(src[i * 2 + 1])];
+            is_valid &= (hi | lo) != 0xff;
+            dst[reverse ? n - i - 1 : i] = (hi << 4) | lo;
+        }
+        GDK_RUNTIME_ASSERT(is_valid);
+    }
+
     std::string b2h(byte_span_t data)
     {
-        char* ret;
-        GDK_VERIFY(wally_hex_from_bytes(data.data(), data.size(), &ret));
-        return make_string(ret);
+        std::string ret(data.size() * 2, '\0');
+        b2h(data, ret, false);
+        return ret;
     }
 
     std::string b2h_rev(byte_span_t data)
     {
-        char* ret;
-        std::vector<unsigned char> buff(data.rbegin(), data.rend());
-        GDK_VERIFY(wally_hex_from_bytes(buff.data(), buff.size(), &ret));
-        return make_string(ret);
+        std::string ret(data.size() * 2, '\0');
+        b2h(data, ret, true);
+        return ret;
     }
 
     static auto h2b(const char* hex, size_t siz, bool rev, uint8_t prefix = 0)
     {
         GDK_RUNTIME_ASSERT(hex != nullptr && siz != 0);
-        size_t written;
+        GDK_RUNTIME_ASSERT(siz % 2 == 0);
         const size_t bytes_siz = siz / 2;
-        std::vector<unsigned char> buff(bytes_siz + (prefix != 0 ? 1 : 0));
-        auto buff_data = buff.data() + (prefix != 0 ? 1 : 0);
-        GDK_VERIFY(wally_hex_to_bytes(hex, buff_data, bytes_siz, &written));
-        GDK_RUNTIME_ASSERT(written == bytes_siz);
-        if (rev) {
-            std::reverse(buff_data, buff_data + bytes_siz);
-        }
+        const size_t offset = prefix != 0 ? 1 : 0;
+        std::vector<unsigned char> buff(bytes_siz + offset);
+        h2b(std::string_view(hex, siz), gsl::make_span(buff.data() + offset, bytes_siz), rev);
         if (prefix != 0) {
             buff[0] = prefix;
         }
@@ -6,6 +6,7 @@
 #include <cstring>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "gsl_wrapper.hpp"
@@ -184,16 +185,20 @@ namespace green {
     //
     std::string b2h(byte_span_t data);
     std::string b2h_rev(byte_span_t data);
+    // Hex encode data into hex, which must be exactly twice its size. If
+    // reverse is true the bytes are encoded last first, as for txhashes
+    void b2h(byte_span_t data, gsl::span<char> hex, bool reverse = false);
 
     std::vector<unsigned char> h2b(const char* hex);
     std::vector<unsigned char> h2b(const std::string& hex);
     std::vector<unsigned char> h2b(const std::string& hex, uint8_t prefix);
+    // Hex decode hex into bytes, which must be exactly half its size. If
+    // reverse is true the bytes are written last first, as for txhashes
+    void h2b(std::string_view hex, gsl::span<unsigned char> bytes, bool reverse = false);
     template <size_t N> std::array<unsigned char, N> h2b_array(const std::string& hex)
     {
-        const auto vec = h2b(hex);
-        GDK_RUNTIME_ASSERT(vec.size() == N);
         std::array<unsigned char, N> ret;
-        std::copy(vec.begin(), vec.end(), ret.begin());
+        h2b(hex, ret);
         return ret;
     }
 
@@ -203,25 +208,15 @@ namespace green {
 
     template <std::size_t N> std::array<unsigned char, N> h2b(const std::string& hex)
     {
-        GDK_RUNTIME_ASSERT(hex.size() / 2 == N);
-        std::array<unsigned char, N> buff{ { 0 } };
-
-        const std::vector<unsigned char> bin = h2b(hex);
-        GDK_RUNTIME_ASSERT(bin.size() == N);
-
-        std::copy(std::begin(bin), std::end(bin), buff.begin());
+        std::array<unsigned char, N> buff;
+        h2b(hex, buff);
         return buff;
     }
 
     template <std::size_t N> std::array<unsigned char, N> h2b_rev(const std::string& hex)
     {
-        GDK_RUNTIME_ASSERT(hex.size() / 2 == N);
-        std::array<unsigned char, N> buff{ { 0 } };
-
-        const std::vector<unsigned char> bin = h2b_rev(hex);
-        GDK_RUNTIME_ASSERT(bin.size() == N);
-
-        std::copy(std::begin(bin), std::end(bin), buff.begin());
+        std::array<unsigned char, N> buff;
+        h2b(hex, buff, true);
         return buff;
     }
 
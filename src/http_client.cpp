@@ -4,10 +4,12 @@
 #include "assertion.hpp"
 #include "autobahn_wrapper.hpp"
 #include "http_client.hpp"
+#include "json_utils.hpp"
 #include "logging.hpp"
 #include "memory.hpp"
 #include "network_parameters.hpp"
 #include "socks_client.hpp"
+#include "stats.hpp"
 #include "utils.hpp"
 
 namespace asio = boost::asio;
@@ -33,6 +35,154 @@ namespace green {
         // rather than an obvious 'timeout' error.
         constexpr auto HTTP_TIMEOUT = 30s;
 
+        // How long an idle keep-alive connection is kept for reuse, and
+        // the maximum number of idle connections kept per host
+        constexpr auto HTTP_IDLE_TIMEOUT = 30s;
+        constexpr size_t HTTP_MAX_IDLE_PER_HOST = 4;
+
+        // How long resolved addresses are cached for
+        constexpr auto DNS_CACHE_TTL = 60s;
+
+        // The maximum number of endpoints to try connecting to, and how long
+        // to wait for an attempt before starting the next in parallel
+        constexpr size_t MAX_CONNECT_ATTEMPTS = 4;
+        constexpr auto CONNECT_ATTEMPT_DELAY = 250ms;
+
+        // Order endpoints alternating between address families, keeping the
+        // resolver's preference order within each family (RFC 8305 4)
+        static std::vector<asio::ip::tcp::endpoint> interleave_endpoints(
+            const asio::ip::tcp::resolver::results_type& results)
+        {
+            std::vector<asio::ip::tcp::endpoint> first, second;
+            for (const auto& result : results) {
+                const auto& endpoint = result.endpoint();
+                const bool is_first_family = first.empty() || first.front().protocol() == endpoint.protocol();
+                (is_first_family ? first : second).push_back(endpoint);
+            }
+            std::vector<asio::ip::tcp::endpoint> endpoints;
+            for (size_t i = 0; endpoints.size() < MAX_CONNECT_ATTEMPTS; ++i) {
+                if (i >= first.size() && i >= second.size()) {
+                    break;
+                }
+                if (i < first.size()) {
+                    endpoints.push_back(first[i]);
+                }
+                if (i < second.size() && endpoints.size() < MAX_CONNECT_ATTEMPTS) {
+                    endpoints.push_back(second[i]);
+                }
+            }
+            return endpoints;
+        }
+
+        // Races connections to a list of endpoints, starting a new attempt
+        // whenever the last one fails or has not connected after a delay.
+        // The first socket to connect becomes the socket of the given stream.
+        // All handlers run on the stream's executor.
+        class connection_race final : public std::enable_shared_from_this<connection_race> {
+        public:
+            using handler_t = std::function<void(beast::error_code, const asio::ip::tcp::endpoint&)>;
+
+            connection_race(beast::tcp_stream& stream, std::vector<asio::ip::tcp::endpoint> endpoints,
+                std::chrono::seconds timeout, handler_t handler)
+                : m_stream(stream)
+                , m_endpoints(std::move(endpoints))
+                , m_timeout(timeout)
+                , m_delay_timer(stream.get_executor())
+                , m_deadline(stream.get_executor())
+                , m_handler(std::move(handler))
+                , m_num_failed(0)
+                , m_done(false)
+            {
+                GDK_RUNTIME_ASSERT(!m_endpoints.empty());
+                m_sockets.reserve(m_endpoints.size());
+            }
+
+            void start()
+            {
+                asio::post(m_stream.get_executor(), [self = shared_from_this()] {
+                    self->m_deadline.expires_after(self->m_timeout);
+                    self->m_deadline.async_wait([self](beast::error_code ec) {
+                        // The deadline may expire concurrently with the race
+                        // finishing, in which case cancel() can't abort the wait
+                        if (!ec && !self->m_done) {
+                            self->finish(asio::error::timed_out, NO_WINNER);
+                        }
+                    });
+                    self->start_next();
+                });
+            }
+
+        private:
+            using socket_t = beast::tcp_stream::socket_type;
+            static constexpr size_t NO_WINNER = static_cast<size_t>(-1);
+
+            void start_next()
+            {
+                if (m_done || m_sockets.size() == m_endpoints.size()) {
+                    return;
+                }
+                const size_t i = m_sockets.size();
+                if (i) {
+                    GDK_LOG(debug) << "http_client: starting connection attempt " << i + 1;
+                }
+                auto& socket = m_sockets.emplace_back(std::make_unique<socket_t>(m_stream.get_executor()));
+                socket->async_connect(m_endpoints[i], [self = shared_from_this(), i](beast::error_code ec) {
+                    self->on_connect(ec, i);
+                });
+                if (m_sockets.size() < m_endpoints.size()) {
+                    m_delay_timer.expires_after(CONNECT_ATTEMPT_DELAY);
+                    m_delay_timer.async_wait([self = shared_from_this()](beast::error_code ec) {
+                        if (!ec) {
+                            self->start_next();
+                        }
+                    });
+                }
+            }
+
+            void on_connect(beast::error_code ec, size_t i)
+            {
+                if (m_done) {
+                    return;
+                }
+                if (!ec) {
+                    finish(ec, i);
+                    return;
+                }
+                GDK_LOG(debug) << "http_client: connect to " << m_endpoints[i] << " failed: " << ec.message();
+                if (++m_num_failed == m_endpoints.size()) {
+                    finish(ec, NO_WINNER);
+                    return;
+                }
+                start_next(); // Don't wait for the delay to try the next endpoint
+            }
+
+            void finish(beast::error_code ec, size_t winner)
+            {
+                m_done = true;
+                m_delay_timer.cancel();
+                m_deadline.cancel();
+                for (size_t i = 0; i < m_sockets.size(); ++i) {
+                    if (i == winner) {
+                        m_stream.socket() = std::move(*m_sockets[i]);
+                    } else {
+                        beast::error_code ignored;
+                        m_sockets[i]->close(ignored);
+                    }
+                }
+                m_handler(ec, winner == NO_WINNER ? asio::ip::tcp::endpoint() : m_endpoints[winner]);
+            }
+
+            beast::tcp_stream& m_stream;
+            const std::vector<asio::ip::tcp::endpoint> m_endpoints;
+            const std::chrono::seconds m_timeout;
+            std::vector<std::unique_ptr<socket_t>> m_sockets;
+            asio::steady_timer m_delay_timer;
+            asio::steady_timer m_deadline;
+            handler_t m_handler;
+            size_t m_num_failed;
+            bool m_done;
+        };
+
     } // namespace
 
     static X509* cert_from_pem(const std::string& pem)
@@ -194,19 +344,36 @@ namespace green {
         : m_resolver(asio::make_strand(io))
         , m_timeout(HTTP_TIMEOUT)
         , m_io(io)
+        , m_connected(false)
     {
     }
 
+    bool http_client::is_reusable() const { return m_connected; }
+
+    std::shared_ptr<SSL_SESSION> http_client::get_tls_session() { return {}; }
+
+    void http_client::set_tls_session(std::shared_ptr<SSL_SESSION> /*session*/) {}
+
     std::future<nlohmann::json> http_client::request(beast::http::verb verb, const nlohmann::json& params)
     {
         GDK_LOG(debug) << "http_client";
 
+        m_request_start = std::chrono::steady_clock::now();
         m_host = params.at("host");
         m_port = params.at("port");
         const std::string target = params.at("target");
         const std::string proxy_uri = params.at("proxy");
 
-        GDK_LOG(debug) << "Connecting to " << m_host << ":" << m_port << " for target " << target;
+        const bool is_reused = m_connected;
+        m_connected = false; // Until a keep-alive response is read
+        GDK_LOG(debug) << (is_reused ? "Reusing connection to " : "Connecting to ") << m_host << ":" << m_port
+                       << " for target " << target;
+
+        // Reset any state from a previous request on this connection
+        m_request = {};
+        m_response.emplace();
+        m_promise = std::promise<nlohmann::json>();
+        m_timeout = HTTP_TIMEOUT;
 
         const auto timeout_p = params.find("timeout");
         if (timeout_p != params.end()) {
@@ -214,12 +381,14 @@ namespace green {
         }
         GDK_LOG(debug) << "HTTP timeout " << m_timeout.count() << " seconds";
 
-        preamble(m_host);
+        if (!is_reused) {
+            preamble(m_host);
+        }
 
         m_request.version(HTTP_VERSION);
         m_request.method(verb);
         m_request.target(target);
-        m_request.set(beast::http::field::connection, "close");
+        m_request.keep_alive(true);
         m_request.set(beast::http::field::host, m_host);
         m_request.set(beast::http::field::user_agent, "GreenAddress SDK");
 
@@ -247,13 +416,19 @@ namespace green {
 
         m_accept = params.value("accept", "");
 
-        if (!proxy_uri.empty()) {
+        if (is_reused) {
+            get_lowest_layer().expires_after(m_timeout);
+            async_write();
+        } else if (!proxy_uri.empty()) {
             get_lowest_layer().expires_after(m_timeout);
             auto proxy = std::make_shared<socks_client>(m_io, get_next_layer());
             GDK_RUNTIME_ASSERT(proxy != nullptr);
-            auto f = proxy->run(m_host + ":" + m_port, proxy_uri);
+            auto f = proxy->run(m_host + ":" + m_port, proxy_uri, j_str_or_empty(params, "socks_isolation"));
             f.get();
             async_handshake();
+        } else if (auto results = dns_cache::get().lookup(m_host, m_port)) {
+            GDK_LOG(debug) << "Using cached addresses for " << m_host;
+            async_connect(std::move(*results));
         } else {
             async_resolve(m_host, m_port);
         }
@@ -266,17 +441,38 @@ namespace green {
         GDK_LOG(debug) << "http_client:on_resolve";
 
         NET_ERROR_CODE_CHECK("on resolve", ec);
-        get_lowest_layer().expires_after(m_timeout);
+        dns_cache::get().store(m_host, m_port, results);
         async_connect(std::move(results));
     }
 
+    void http_client::race_connect(asio::ip::tcp::resolver::results_type results,
+        std::function<void(beast::error_code, const asio::ip::tcp::endpoint&)> handler)
+    {
+        auto endpoints = interleave_endpoints(results);
+        if (endpoints.empty()) {
+            set_exception("on connect: no addresses for " + m_host);
+            return;
+        }
+        auto&& on_done = [this, handler = std::move(handler)](beast::error_code ec, const auto& endpoint) {
+            if (ec) {
+                // The cached addresses may be stale: resolve again next time
+                dns_cache::get().erase(m_host, m_port);
+            } else {
+                get_lowest_layer().expires_after(m_timeout);
+            }
+            handler(ec, endpoint);
+        };
+        auto race = std::make_shared<connection_race>(get_lowest_layer(), std::move(endpoints), m_timeout, on_done);
+        race->start();
+    }
+
     void http_client::on_write(beast::error_code ec, size_t __attribute__((unused)) bytes_transferred)
     {
         GDK_LOG(debug) << "http_client:on_write";
 
         NET_ERROR_CODE_CHECK("on write", ec);
         get_lowest_layer().expires_after(m_timeout);
-        m_response.body_limit(64 * 1024 * 1024);
+        m_response->body_limit(64 * 1024 * 1024);
         async_read();
     }
 
@@ -285,6 +481,13 @@ namespace green {
         GDK_LOG(debug) << "http_client:on_read";
 
         NET_ERROR_CODE_CHECK("on read", ec);
+        if (m_response->keep_alive()) {
+            // Leave the connection open for the next request
+            get_lowest_layer().expires_never();
+            m_connected = true;
+            set_result();
+            return;
+        }
         get_lowest_layer().cancel();
         async_shutdown();
     }
@@ -305,18 +508,20 @@ namespace green {
 
     void http_client::set_result()
     {
-        auto response = m_response.release();
+        auto response = m_response->release();
         const auto result = response.result();
 
         if (result == beast::http::status::not_modified) {
             const nlohmann::json body = { { "not_modified", true } };
             GDK_LOG(debug) << "using cached resource";
+            record_stats(false);
             m_promise.set_value(body);
             return;
         }
 
         if (beast::http::to_status_class(result) == beast::http::status_class::redirection) {
             const nlohmann::json body = { { "location", response[beast::http::field::location] } };
+            record_stats(false);
             m_promise.set_value(body);
             return;
         }
@@ -345,17 +550,25 @@ namespace green {
                 body["headers"][boost::algorithm::to_lower_copy(field_name)] = field_value;
             }
 
+            record_stats(false);
             m_promise.set_value(body);
         } catch (const std::exception& ex) {
+            record_stats(true);
             m_promise.set_exception(std::make_exception_ptr(ex));
         }
     }
 
     void http_client::set_exception(const std::string& what)
     {
+        record_stats(true);
         m_promise.set_exception(std::make_exception_ptr(std::runtime_error(what)));
     }
 
+    void http_client::record_stats(bool failed)
+    {
+        stats::record("http_request", m_host, std::chrono::steady_clock::now() - m_request_start, failed);
+    }
+
     tls_http_client::tls_http_client(asio::io_context& io, asio::ssl::context& ssl_ctx)
         : http_client(io)
         , m_stream(asio::make_strand(io), ssl_ctx)
@@ -371,6 +584,23 @@ namespace green {
         async_handshake();
     }
 
+    std::shared_ptr<SSL_SESSION> tls_http_client::get_tls_session()
+    {
+        SSL_SESSION* session = SSL_get1_session(m_stream.native_handle());
+        if (!session) {
+            return {};
+        }
+        return std::shared_ptr<SSL_SESSION>(session, SSL_SESSION_free);
+    }
+
+    void tls_http_client::set_tls_session(std::shared_ptr<SSL_SESSION> session)
+    {
+        // Failure is not an error; a full handshake is done instead
+        if (session && !SSL_set_session(m_stream.native_handle(), session.get())) {
+            GDK_LOG(debug) << "http_client: unable to resume TLS session";
+        }
+    }
+
     void tls_http_client::on_handshake(beast::error_code ec)
     {
         GDK_LOG(debug) << "http_client:on_handshake";
@@ -397,8 +627,7 @@ namespace green {
 
     void tls_http_client::async_connect(asio::ip::tcp::resolver::results_type results)
     {
-        get_lowest_layer().async_connect(
-            results, beast::bind_front_handler(&tls_http_client::on_connect, shared_from_this()));
+        race_connect(std::move(results), beast::bind_front_handler(&tls_http_client::on_connect, shared_from_this()));
     }
 
     void tls_http_client::async_read() { ASYNC_READ; }
@@ -439,7 +668,7 @@ namespace green {
 
     void tcp_http_client::async_connect(asio::ip::tcp::resolver::results_type results)
     {
-        m_stream.async_connect(results, beast::bind_front_handler(&tcp_http_client::on_connect, shared_from_this()));
+        race_connect(std::move(results), beast::bind_front_handler(&tcp_http_client::on_connect, shared_from_this()));
     }
 
     void tcp_http_client::async_read() { ASYNC_READ; }
@@ -476,4 +705,100 @@ namespace green {
 #undef ASYNC_RESOLVE
 #undef ASYNC_READ
 
+    http_client_pool& http_client_pool::get()
+    {
+        static http_client_pool pool;
+        return pool;
+    }
+
+    void http_client_pool::expire_idle(std::vector<idle_client>& clients, std::chrono::steady_clock::time_point now)
+    {
+        auto&& is_expired = [now](const auto& c) { return now - c.idle_since > HTTP_IDLE_TIMEOUT; };
+        clients.erase(std::remove_if(clients.begin(), clients.end(), is_expired), clients.end());
+    }
+
+    std::pair<std::shared_ptr<http_client>, std::shared_ptr<asio::ssl::context>> http_client_pool::acquire(
+        const std::string& key)
+    {
+        std::unique_lock<std::mutex> locker(m_mutex);
+        auto p = m_idle.find(key);
+        if (p == m_idle.end()) {
+            return {};
+        }
+        auto& clients = p->second;
+        expire_idle(clients, std::chrono::steady_clock::now());
+        if (clients.empty()) {
+            m_idle.erase(p);
+            return {};
+        }
+        // Use the most recently released connection, as the least likely
+        // to have been closed by the server
+        auto client = std::move(clients.back());
+        clients.pop_back();
+        return { std::move(client.client), std::move(client.ssl_ctx) };
+    }
+
+    void http_client_pool::release(
+        const std::string& key, std::shared_ptr<http_client> client, std::shared_ptr<asio::ssl::context> ssl_ctx)
+    {
+        if (!client) {
+            return;
+        }
+        auto tls_session = ssl_ctx ? client->get_tls_session() : std::shared_ptr<SSL_SESSION>();
+        std::unique_lock<std::mutex> locker(m_mutex);
+        if (tls_session) {
+            m_tls_sessions[key] = std::move(tls_session);
+        }
+        if (!client->is_reusable()) {
+            return;
+        }
+        const auto now = std::chrono::steady_clock::now();
+        auto& clients = m_idle[key];
+        expire_idle(clients, now);
+        if (clients.size() >= HTTP_MAX_IDLE_PER_HOST) {
+            clients.erase(clients.begin()); // Drop the oldest
+        }
+        clients.push_back({ std::move(client), std::move(ssl_ctx), now });
+    }
+
+    std::shared_ptr<SSL_SESSION> http_client_pool::get_tls_session(const std::string& key)
+    {
+        std::unique_lock<std::mutex> locker(m_mutex);
+        auto p = m_tls_sessions.find(key);
+        return p == m_tls_sessions.end() ? std::shared_ptr<SSL_SESSION>() : p->second;
+    }
+
+    dns_cache& dns_cache::get()
+    {
+        static dns_cache cache;
+        return cache;
+    }
+
+    std::optional<dns_cache::results_type> dns_cache::lookup(const std::string& host, const std::string& port)
+    {
+        std::unique_lock<std::mutex> locker(m_mutex);
+        auto p = m_entries.find(host + ':' + port);
+        if (p == m_entries.end()) {
+            return {};
+        }
+        if (std::chrono::steady_clock::now() > p->second.expiry) {
+            m_entries.erase(p);
+            return {};
+        }
+        return p->second.results;
+    }
+
+    void dns_cache::store(const std::string& host, const std::string& port, results_type results)
+    {
+        const auto expiry = std::chrono::steady_clock::now() + DNS_CACHE_TTL;
+        std::unique_lock<std::mutex> locker(m_mutex);
+        m_entries[host + ':' + port] = { std::move(results), expiry };
+    }
+
+    void dns_cache::erase(const std::string& host, const std::string& port)
+    {
+        std::unique_lock<std::mutex> locker(m_mutex);
+        m_entries.erase(host + ':' + port);
+    }
+
 } // namespace green
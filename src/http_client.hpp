@@ -6,9 +6,14 @@
 #include <boost/beast/http.hpp>
 #include <boost/beast/ssl.hpp>
 #include <chrono>
+#include <functional>
 #include <future>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <nlohmann/json.hpp>
+#include <optional>
+#include <vector>
 
 #include "gsl_wrapper.hpp"
 
@@ -24,6 +29,15 @@ namespace green {
 
         std::future<nlohmann::json> request(boost::beast::http::verb verb, const nlohmann::json& params);
 
+        // Whether the connection was kept alive by the server after the last
+        // request, and so can be used for another request to the same host
+        bool is_reusable() const;
+
+        // The TLS session to resume when connecting, and the session to
+        // resume for later connections to the same host
+        virtual std::shared_ptr<SSL_SESSION> get_tls_session();
+        virtual void set_tls_session(std::shared_ptr<SSL_SESSION> session);
+
         void on_resolve(boost::beast::error_code ec, boost::asio::ip::tcp::resolver::results_type results);
         void on_write(boost::beast::error_code ec, size_t bytes_transferred);
         void on_read(boost::beast::error_code ec, size_t bytes_transferred);
@@ -42,14 +56,21 @@ namespace green {
         virtual void async_resolve(const std::string& host, const std::string& port) = 0;
         virtual void preamble(const std::string& host);
 
+        // Connect to the first endpoint in results that accepts, racing
+        // connections to several of them if the first is slow (RFC 8305)
+        void race_connect(boost::asio::ip::tcp::resolver::results_type results,
+            std::function<void(boost::beast::error_code, const boost::asio::ip::tcp::endpoint&)> handler);
+
         void set_result();
         void set_exception(const std::string& what);
+        void record_stats(bool failed);
 
         boost::asio::ip::tcp::resolver m_resolver;
         boost::beast::flat_buffer m_buffer;
         boost::beast::http::request<boost::beast::http::string_body> m_request;
-        boost::beast::http::response_parser<boost::beast::http::string_body> m_response;
+        std::optional<boost::beast::http::response_parser<boost::beast::http::string_body>> m_response;
         std::chrono::seconds m_timeout;
+        std::chrono::steady_clock::time_point m_request_start;
         std::string m_host;
         std::string m_port;
         std::string m_accept;
@@ -57,6 +78,7 @@ namespace green {
         std::promise<nlohmann::json> m_promise;
 
         boost::asio::io_context& m_io;
+        bool m_connected; // True if connected and idle between requests
     };
 
     class tls_http_client final : public std::enable_shared_from_this<tls_http_client>, public http_client {
@@ -78,6 +100,9 @@ namespace green {
             boost::beast::error_code ec, const boost::asio::ip::tcp::resolver::results_type::endpoint_type& type);
         void on_handshake(boost::beast::error_code ec);
 
+        std::shared_ptr<SSL_SESSION> get_tls_session() override;
+        void set_tls_session(std::shared_ptr<SSL_SESSION> session) override;
+
         boost::beast::ssl_stream<boost::beast::tcp_stream> m_stream;
     };
 
@@ -104,6 +129,60 @@ namespace green {
     std::shared_ptr<boost::asio::ssl::context> tls_init(const std::string& host_name,
         const std::vector<std::string>& roots, const std::vector<std::string>& pins, uint32_t cert_expiry_threshold);
 
+    // Process-wide pool of idle keep-alive connections. Connections are
+    // keyed by everything that affects how they were established, so they
+    // can be shared between requests and between sessions that connect to
+    // the same host with the same proxy and certificate roots.
+    class http_client_pool final {
+    public:
+        static http_client_pool& get();
+
+        // Returns an idle connection and its TLS context, or nullptr
+        std::pair<std::shared_ptr<http_client>, std::shared_ptr<boost::asio::ssl::context>> acquire(
+            const std::string& key);
+        // Returns a connection to the pool if it is still reusable
+        void release(const std::string& key, std::shared_ptr<http_client> client,
+            std::shared_ptr<boost::asio::ssl::context> ssl_ctx);
+        // Returns the last TLS session used for key, if any
+        std::shared_ptr<SSL_SESSION> get_tls_session(const std::string& key);
+
+    private:
+        struct idle_client {
+            std::shared_ptr<http_client> client;
+            std::shared_ptr<boost::asio::ssl::context> ssl_ctx;
+            std::chrono::steady_clock::time_point idle_since;
+        };
+
+        void expire_idle(std::vector<idle_client>& clients, std::chrono::steady_clock::time_point now);
+
+        std::mutex m_mutex;
+        std::map<std::string, std::vector<idle_client>> m_idle;
+        std::map<std::string, std::shared_ptr<SSL_SESSION>> m_tls_sessions;
+    };
+
+    // Process-wide cache of resolved host addresses. Entries are kept for
+    // a fixed time, as the system resolver does not return record TTLs
+    class dns_cache final {
+    public:
+        using results_type = boost::asio::ip::tcp::resolver::results_type;
+
+        static dns_cache& get();
+
+        std::optional<results_type> lookup(const std::string& host, const std::string& port);
+        void store(const std::string& host, const std::string& port, results_type results);
+        // Remove an entry, e.g. after failing to connect to any of its addresses
+        void erase(const std::string& host, const std::string& port);
+
+    private:
+        struct entry {
+            results_type results;
+            std::chrono::steady_clock::time_point expiry;
+        };
+
+        std::mutex m_mutex;
+        std::map<std::string, entry> m_entries;
+    };
+
     inline std::shared_ptr<http_client> make_http_client(
         boost::asio::io_context& io, boost::asio::ssl::context* ssl_ctx)
     {
@@ -1,5 +1,6 @@
 
 #include "io_runner.hpp"
+#include "assertion.hpp"
 
 namespace green {
 
@@ -28,4 +29,30 @@ namespace green {
             "io_context pool");
     }
 
+    io_pool::io_pool(size_t num_threads)
+        : m_pool(num_threads)
+        , m_next(0)
+    {
+        GDK_RUNTIME_ASSERT(num_threads != 0);
+        m_io.reserve(num_threads);
+        for (size_t i = 0; i < num_threads; ++i) {
+            m_io.emplace_back(std::make_unique<io_container>());
+            m_io.back()->start(gsl::make_span(&m_pool[i], 1));
+        }
+    }
+
+    io_pool::~io_pool()
+    {
+        for (size_t i = 0; i < m_io.size(); ++i) {
+            m_io[i]->shutdown(gsl::make_span(&m_pool[i], 1));
+        }
+    }
+
+    size_t io_pool::size() const { return m_io.size(); }
+
+    boost::asio::io_context& io_pool::get_io_context()
+    {
+        return m_io[m_next.fetch_add(1, std::memory_order_relaxed) % m_io.size()]->get_io_context();
+    }
+
 } // namespace green
@@ -4,10 +4,12 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <boost/asio/io_context.hpp>
 #include <gsl/span>
 #include <memory>
 #include <thread>
+#include <vector>
 
 #include "utils.hpp"
 
@@ -37,6 +39,27 @@ namespace green {
         std::array<std::thread, PoolSize> m_pool;
     };
 
+    // A fixed set of io_contexts shared by all sessions, each run by its
+    // own thread. Callers are handed contexts round-robin, so the number of
+    // I/O threads does not grow with the number of sessions, while handlers
+    // posted to any one context (and hence to a session's strand) still
+    // execute serially.
+    class io_pool final {
+    public:
+        explicit io_pool(size_t num_threads);
+        io_pool(const io_pool&) = delete;
+        io_pool& operator=(const io_pool&) = delete;
+        ~io_pool();
+
+        size_t size() const;
+        boost::asio::io_context& get_io_context();
+
+    private:
+        std::vector<std::unique_ptr<io_container>> m_io;
+        std::vector<std::thread> m_pool;
+        std::atomic<size_t> m_next;
+    };
+
 } // namespace green
 //
 #endif
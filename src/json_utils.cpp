@@ -12,6 +12,13 @@
 #include "logging.hpp"
 
 namespace {
+    // Lookups by std::string_view must not construct temporary std::string
+    // keys. nlohmann::json uses a transparent comparator for its object map
+    // when built as C++14 or later, which makes find(), contains(), at() etc
+    // with a string_view key heterogeneous lookups.
+    static_assert(std::is_same_v<nlohmann::json::object_comparator_t, std::less<>>,
+        "nlohmann::json must use a transparent object key comparator");
+
     static auto find(const nlohmann::json& src, std::string_view key)
     {
         if (src.is_null()) {
@@ -200,7 +207,9 @@ namespace green {
     static std::vector<unsigned char> bytes_impl(const nlohmann::json& src, std::string_view key, bool allow_empty,
         bool do_reverse, std::optional<size_t> expected_size)
     {
-        const auto hex = j_str_or_empty(src, key);
+        static const std::string empty;
+        const auto it = find(src, key);
+        const auto& hex = it == src.end() ? empty : it->get_ref<const std::string&>();
         if (expected_size.has_value() && hex.size() != expected_size.value() * 2) {
             auto num = std::to_string(expected_size.value() * 2);
             throw_user_error(std::string("key ") + std::string(key) + " is not " + num + " hex chars");
@@ -265,4 +274,35 @@ namespace green {
             data.erase(key);
         }
     }
+
+    size_t j_estimated_size(const nlohmann::json& data)
+    {
+        // Child values are stored inline in their containers, objects
+        // are red-black trees with a key and a value per node
+        constexpr size_t node_overhead = 4 * sizeof(void*);
+        switch (data.type()) {
+        case nlohmann::json::value_t::object: {
+            size_t total = sizeof(nlohmann::json::object_t);
+            for (const auto& item : data.get_ref<const nlohmann::json::object_t&>()) {
+                total += node_overhead + sizeof(item) + item.first.capacity();
+                total += j_estimated_size(item.second) - sizeof(nlohmann::json);
+            }
+            return total + sizeof(nlohmann::json);
+        }
+        case nlohmann::json::value_t::array: {
+            const auto& arr = data.get_ref<const nlohmann::json::array_t&>();
+            size_t total = sizeof(nlohmann::json::array_t) + arr.capacity() * sizeof(nlohmann::json);
+            for (const auto& item : arr) {
+                total += j_estimated_size(item) - sizeof(nlohmann::json);
+            }
+            return total + sizeof(nlohmann::json);
+        }
+        case nlohmann::json::value_t::string:
+            return sizeof(nlohmann::json) + sizeof(std::string) + data.get_ref<const std::string&>().capacity();
+        case nlohmann::json::value_t::binary:
+            return sizeof(nlohmann::json) + sizeof(nlohmann::json::binary_t) + data.get_binary().capacity();
+        default:
+            return sizeof(nlohmann::json);
+        }
+    }
 } // namespace green
@@ -74,5 +74,8 @@ namespace green {
 
     // Erase an element, do not throw if data is null
     void j_erase(nlohmann::json& data, std::string_view key);
+
+    // Estimate the heap memory used by a JSON value, including its children
+    size_t j_estimated_size(const nlohmann::json& data);
 } // namespace green
 #endif
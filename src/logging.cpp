@@ -0,0 +1,257 @@
+#include "logging.hpp"
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <mutex>
+#include <sstream>
+
+#include <boost/date_time/c_time.hpp>
+#include <boost/log/sinks/basic_sink_frontend.hpp>
+
+namespace green {
+
+    namespace {
+        // Must be a power of two
+        static constexpr size_t LOG_QUEUE_SIZE = 8192;
+        static_assert((LOG_QUEUE_SIZE & (LOG_QUEUE_SIZE - 1)) == 0);
+        // The writer is woken by a producer when it is waiting, but re-checks
+        // the queue at least this often in case a wakeup is missed
+        static constexpr auto LOG_WRITER_POLL = std::chrono::milliseconds(100);
+        // Formatted output is written in batches of up to this size
+        static constexpr size_t LOG_OUTPUT_SIZE = 64 * 1024;
+
+        struct log_entry final {
+            std::string message;
+            log_level::severity_level level;
+            std::chrono::system_clock::time_point timestamp;
+            std::thread::id thread_id;
+        };
+
+        // A bounded multi-producer queue of pending log messages.
+        // Producers never take a lock unless the queue is full
+        class log_queue final {
+        public:
+            log_queue()
+            {
+                for (size_t i = 0; i < LOG_QUEUE_SIZE; ++i) {
+                    m_slots[i].sequence.store(i, std::memory_order_relaxed);
+                }
+            }
+
+            bool push(log_entry&& entry)
+            {
+                slot* s;
+                size_t pos = m_push_pos.load(std::memory_order_relaxed);
+                for (;;) {
+                    s = &m_slots[pos & (LOG_QUEUE_SIZE - 1)];
+                    const size_t sequence = s->sequence.load(std::memory_order_acquire);
+                    const auto diff = static_cast<std::ptrdiff_t>(sequence - pos);
+                    if (diff == 0) {
+                        if (m_push_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                            break;
+                        }
+                    } else if (diff < 0) {
+                        return false; // Full
+                    } else {
+                        pos = m_push_pos.load(std::memory_order_relaxed);
+                    }
+                }
+                s->entry = std::move(entry);
+                s->sequence.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+
+            // Only called by one consumer at a time (under m_pop_mutex)
+            bool pop(log_entry& entry)
+            {
+                slot& s = m_slots[m_pop_pos & (LOG_QUEUE_SIZE - 1)];
+                if (s.sequence.load(std::memory_order_acquire) != m_pop_pos + 1) {
+                    return false; // Empty
+                }
+                entry = std::move(s.entry);
+                s.entry = log_entry{};
+                s.sequence.store(m_pop_pos + LOG_QUEUE_SIZE, std::memory_order_release);
+                ++m_pop_pos;
+                return true;
+            }
+
+            std::mutex m_pop_mutex;
+
+        private:
+            struct slot final {
+                std::atomic<size_t> sequence;
+                log_entry entry;
+            };
+
+            std::array<slot, LOG_QUEUE_SIZE> m_slots;
+            alignas(64) std::atomic<size_t> m_push_pos{ 0 };
+            alignas(64) size_t m_pop_pos{ 0 };
+        };
+
+#ifdef __ANDROID__
+        static void write_android(log_level::severity_level level, const std::string& message)
+        {
+            int priority = ANDROID_LOG_DEBUG;
+            if (level >= log_level::error) {
+                priority = ANDROID_LOG_ERROR;
+            } else if (level == log_level::warning) {
+                priority = ANDROID_LOG_WARN;
+            } else if (level == log_level::info) {
+                priority = ANDROID_LOG_INFO;
+            }
+            constexpr size_t MAX_LINE = 1024; // Maximum size of an Android log message
+            for (size_t i = 0; i < message.size(); i += MAX_LINE) {
+                const std::string part = message.substr(i, MAX_LINE);
+                __android_log_write(priority, "GDK", part.c_str());
+            }
+        }
+#endif
+
+        // Boost.Log sink that only queues messages. Formatting and output
+        // are done by a background writer thread
+        class async_log_sink final : public boost::log::sinks::basic_sink_frontend {
+        public:
+            async_log_sink()
+                : basic_sink_frontend(false)
+            {
+                std::thread([this] { run(); }).detach();
+                std::atexit([] { get()->flush(); });
+            }
+
+            // Never destroyed, so messages logged during static
+            // destruction and the writer thread remain valid
+            static async_log_sink* get()
+            {
+                static async_log_sink* s_sink = new async_log_sink();
+                return s_sink;
+            }
+
+            void consume(const boost::log::record_view& record) override
+            {
+                const auto message = record[boost::log::expressions::smessage];
+                const auto severity = record[log_level::severity];
+                log_entry entry{ message ? message.get() : std::string(), severity ? severity.get() : log_level::info,
+                    std::chrono::system_clock::now(), std::this_thread::get_id() };
+                while (!m_queue.push(std::move(entry))) {
+                    // Queue is full: write out the backlog from this thread
+                    write_pending();
+                }
+                if (m_writer_waiting.load(std::memory_order_acquire)) {
+                    std::lock_guard<std::mutex> locker(m_wait_mutex);
+                    m_wait_cv.notify_one();
+                }
+            }
+
+            void flush() override { write_pending(); }
+
+        private:
+            // Write any queued messages. Returns false if there were none
+            bool write_pending()
+            {
+                std::lock_guard<std::mutex> locker(m_queue.m_pop_mutex);
+                bool wrote = false;
+                log_entry entry;
+                while (m_queue.pop(entry)) {
+#ifdef __ANDROID__
+                    // Android logging adds its own timestamp and thread id
+                    write_android(entry.level, entry.message);
+#else
+                    append_line(entry);
+                    if (m_output.size() >= LOG_OUTPUT_SIZE) {
+                        write_output();
+                    }
+#endif
+                    wrote = true;
+                }
+#ifndef __ANDROID__
+                write_output();
+#endif
+                return wrote;
+            }
+
+#ifndef __ANDROID__
+            // Format a message as "[date time.us] [thread] [level] message"
+            void append_line(const log_entry& entry)
+            {
+                using namespace std::chrono;
+                const auto t = system_clock::to_time_t(entry.timestamp);
+                if (t != m_time_second) {
+                    // Only convert the time once per second
+                    std::tm tm_buf;
+                    const auto tm = boost::date_time::c_time::localtime(&t, &tm_buf);
+                    m_time_size = tm ? std::strftime(m_time, sizeof(m_time), "%Y-%m-%d %H:%M:%S", tm) : 0;
+                    m_time_second = t;
+                }
+                const auto us = duration_cast<microseconds>(entry.timestamp.time_since_epoch()).count() % 1000000;
+                char us_buf[16];
+                std::snprintf(us_buf, sizeof(us_buf), ".%06d] [", static_cast<int>(us));
+                if (entry.thread_id != m_thread_id) {
+                    std::ostringstream os;
+                    os << entry.thread_id;
+                    m_thread_id_str = os.str();
+                    m_thread_id = entry.thread_id;
+                }
+                m_output.append(1, '[').append(m_time, m_time_size).append(us_buf);
+                m_output.append(m_thread_id_str).append("] [").append(log_level::to_string(entry.level)).append("] ");
+                m_output.append(entry.message).append(1, '\n');
+            }
+
+            void write_output()
+            {
+                if (!m_output.empty()) {
+                    std::fwrite(m_output.data(), 1, m_output.size(), stderr);
+                    std::fflush(stderr);
+                    m_output.clear();
+                }
+            }
+#endif
+
+            void run()
+            {
+                for (;;) {
+                    if (write_pending()) {
+                        continue;
+                    }
+                    std::unique_lock<std::mutex> locker(m_wait_mutex);
+                    m_writer_waiting.store(true, std::memory_order_release);
+                    m_wait_cv.wait_for(locker, LOG_WRITER_POLL);
+                    m_writer_waiting.store(false, std::memory_order_relaxed);
+                }
+            }
+
+            log_queue m_queue;
+#ifndef __ANDROID__
+            // Writer state, guarded by m_queue.m_pop_mutex
+            std::string m_output;
+            std::time_t m_time_second = 0;
+            char m_time[32];
+            size_t m_time_size = 0;
+            std::thread::id m_thread_id;
+            std::string m_thread_id_str;
+#endif
+            std::atomic_bool m_writer_waiting{ false };
+            std::mutex m_wait_mutex;
+            std::condition_variable m_wait_cv;
+        };
+    } // namespace
+
+    void init_logging(log_level::severity_level level)
+    {
+        static std::once_flag s_sink_once;
+        if (level < log_level::fatal) {
+            // Logging is enabled: start the writer on first use
+            std::call_once(s_sink_once, [] {
+                auto sink = boost::shared_ptr<async_log_sink>(async_log_sink::get(), [](auto) {});
+                boost::log::core::get()->add_sink(sink);
+            });
+        }
+        current_log_level.store(level, std::memory_order_relaxed);
+        boost::log::core::get()->set_filter(log_level::severity >= level);
+    }
+
+} // namespace green
@@ -9,11 +9,11 @@
 #include <boost/log/attributes/named_scope.hpp>
 #include <boost/log/core.hpp>
 #include <boost/log/expressions.hpp>
-#include <boost/log/sinks/async_frontend.hpp>
-#include <boost/log/sinks/basic_sink_backend.hpp>
 #include <boost/log/sources/global_logger_storage.hpp>
 #include <boost/log/sources/logger.hpp>
 #include <boost/log/trivial.hpp>
+
+#include <atomic>
 #include <thread>
 
 namespace green {
@@ -22,28 +22,25 @@ namespace green {
 
     using gdk_logger_t = boost::log::sources::severity_logger_mt<log_level::severity_level>;
 
-#ifdef __ANDROID__
-    class android_backend : public boost::log::sinks::basic_formatted_sink_backend<char> {
-    public:
-        void consume(const boost::log::record_view&, const std::string& formatted_message)
-        {
-            // TODO: severity levels
-            constexpr size_t MAX_LINE = 1024; // Maximum size of an Android log message
-            if (formatted_message.size() < MAX_LINE) {
-                __android_log_write(ANDROID_LOG_DEBUG, "GDK", formatted_message.c_str());
-            } else {
-                char buf[MAX_LINE + 1];
-                for (size_t i = 0; i < formatted_message.size(); i += MAX_LINE) {
-                    strncpy(buf, formatted_message.c_str() + i, MAX_LINE);
-                    buf[MAX_LINE] = '\0';
-                    if (buf[0] != '\0') {
-                        __android_log_write(ANDROID_LOG_DEBUG, "GDK", buf);
-                    }
-                }
-            }
-        }
-    };
+// Messages below this level are compiled out of GDK_LOG entirely.
+// Builds may define it as e.g. info or warning to drop debug logging
+#ifndef GDK_MIN_LOG_LEVEL
+#define GDK_MIN_LOG_LEVEL debug
 #endif
+    constexpr auto min_log_level = log_level::GDK_MIN_LOG_LEVEL;
+
+    // The runtime log level, checked before a record is opened so that
+    // disabled messages are never formatted. Set by init_logging()
+    inline std::atomic<log_level::severity_level> current_log_level{ log_level::fatal };
+
+    // Set the log level and install the asynchronous log sink.
+    // May be called again to change the level
+    void init_logging(log_level::severity_level level);
+
+    inline bool is_log_enabled(log_level::severity_level level)
+    {
+        return level >= min_log_level && level >= current_log_level.load(std::memory_order_relaxed);
+    }
 
 #if defined(__ANDROID__) and not defined(NDEBUG)
     inline void start_android_std_outerr_bridge()
@@ -72,15 +69,13 @@ namespace green {
 
     BOOST_LOG_INLINE_GLOBAL_LOGGER_INIT(gdk_logger, gdk_logger_t)
     {
-#ifdef __ANDROID__
-        using sink_t = boost::log::sinks::asynchronous_sink<android_backend>;
-        auto sink = boost::make_shared<sink_t>(boost::make_shared<android_backend>());
-        boost::log::core::get()->add_sink(sink);
-#endif
         return gdk_logger_t{};
     }
 
-#define GDK_LOG(sev) BOOST_LOG_SEV(::green::gdk_logger::get(), log_level::sev)
+#define GDK_LOG(sev)                                                                                                   \
+    if (!::green::is_log_enabled(::green::log_level::sev)) {                                                           \
+    } else                                                                                                             \
+        BOOST_LOG_SEV(::green::gdk_logger::get(), ::green::log_level::sev)
 
 } // namespace green
 
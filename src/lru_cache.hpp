@@ -0,0 +1,113 @@
+#ifndef GDK_LRU_CACHE_HPP
+#define GDK_LRU_CACHE_HPP
+#pragma once
+
+#include <functional>
+#include <list>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+#include "assertion.hpp"
+
+namespace green {
+
+    //
+    // Bounded, thread-safe LRU cache of immutable values. Inserting a key
+    // that is already cached only marks it as most recently used.
+    //
+    template <typename Key, typename Value, typename Compare = std::less<>> class lru_cache final {
+    public:
+        using key_t = Key;
+        using value_t = Value;
+
+        explicit lru_cache(size_t max_size)
+            : m_max_size(max_size)
+        {
+            GDK_RUNTIME_ASSERT(m_max_size != 0);
+        }
+
+        lru_cache(const lru_cache& rhs)
+            : m_max_size(rhs.m_max_size)
+        {
+            *this = rhs;
+        }
+
+        lru_cache& operator=(const lru_cache& rhs)
+        {
+            if (this != &rhs) {
+                std::scoped_lock locker(m_mutex, rhs.m_mutex);
+                m_max_size = rhs.m_max_size;
+                m_entries.clear();
+                m_index.clear();
+                // Insert from least to most recently used to preserve the order
+                for (auto it = rhs.m_entries.rbegin(); it != rhs.m_entries.rend(); ++it) {
+                    insert_impl(it->first, it->second);
+                }
+            }
+            return *this;
+        }
+
+        ~lru_cache() = default;
+
+        std::optional<Value> get(const Key& key)
+        {
+            std::unique_lock<std::mutex> locker(m_mutex);
+            const auto p = m_index.find(key);
+            if (p == m_index.end()) {
+                return {};
+            }
+            // Mark as most recently used
+            m_entries.splice(m_entries.begin(), m_entries, p->second);
+            return p->second->second;
+        }
+
+        void insert(const Key& key, Value value)
+        {
+            std::unique_lock<std::mutex> locker(m_mutex);
+            insert_impl(key, std::move(value));
+        }
+
+        size_t size()
+        {
+            std::unique_lock<std::mutex> locker(m_mutex);
+            return m_entries.size();
+        }
+
+        void clear()
+        {
+            entries_t tmp_entries; // Delete outside of lock
+            {
+                std::unique_lock<std::mutex> locker(m_mutex);
+                m_index.clear();
+                std::swap(m_entries, tmp_entries);
+            }
+        }
+
+    private:
+        using entries_t = std::list<std::pair<Key, Value>>;
+
+        void insert_impl(const Key& key, Value value)
+        {
+            if (const auto p = m_index.find(key); p != m_index.end()) {
+                m_entries.splice(m_entries.begin(), m_entries, p->second);
+                return; // Values never change; no need to update
+            }
+            if (m_entries.size() >= m_max_size) {
+                m_index.erase(m_entries.back().first);
+                m_entries.pop_back();
+            }
+            m_entries.emplace_front(key, std::move(value));
+            m_index.emplace(key, m_entries.begin());
+        }
+
+        mutable std::mutex m_mutex;
+        size_t m_max_size;
+        entries_t m_entries; // Most recently used first
+        std::map<Key, typename entries_t::iterator, Compare> m_index;
+    };
+
+} // namespace green
+
+#endif
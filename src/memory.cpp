@@ -0,0 +1,160 @@
+#include "memory.hpp"
+
+#if defined _WIN32 || defined WIN32 || defined __CYGWIN__
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <mutex>
+
+#include "logging.hpp"
+
+namespace green {
+
+    namespace {
+        // Slots are power of two sizes from MIN_SLOT_SIZE to MAX_SLOT_SIZE.
+        // Larger allocations are given their own locked pages
+        static constexpr size_t MIN_SLOT_SIZE = 32;
+        static constexpr size_t MAX_SLOT_SIZE = 4096;
+        static constexpr size_t NUM_SLOT_SIZES = 8; // 32 .. 4096
+        static constexpr size_t CHUNK_SIZE = 64 * 1024;
+        static_assert(MIN_SLOT_SIZE << (NUM_SLOT_SIZES - 1) == MAX_SLOT_SIZE);
+
+        static size_t get_page_size()
+        {
+#if defined _WIN32 || defined WIN32 || defined __CYGWIN__
+            SYSTEM_INFO info;
+            GetSystemInfo(&info);
+            return info.dwPageSize;
+#else
+            return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+        }
+
+        static void* map_locked(size_t size)
+        {
+            bool is_locked;
+#if defined _WIN32 || defined WIN32 || defined __CYGWIN__
+            void* p = VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+            if (!p) {
+                throw std::bad_alloc();
+            }
+            is_locked = VirtualLock(p, size) != 0;
+#else
+            void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p == MAP_FAILED) {
+                throw std::bad_alloc();
+            }
+            is_locked = mlock(p, size) == 0;
+#if defined MADV_DONTDUMP
+            madvise(p, size, MADV_DONTDUMP);
+#endif
+#endif
+            if (!is_locked) {
+                // Usually due to the process locked memory limit. The memory
+                // is still usable, and is still zeroed when freed
+                static std::once_flag s_log_once;
+                std::call_once(s_log_once, [] { GDK_LOG(warning) << "secure memory could not be locked"; });
+            }
+            return p;
+        }
+
+        static void unmap_locked(void* p, size_t size) noexcept
+        {
+#if defined _WIN32 || defined WIN32 || defined __CYGWIN__
+            VirtualUnlock(p, size);
+            VirtualFree(p, 0, MEM_RELEASE);
+#else
+            munlock(p, size);
+            munmap(p, size);
+#endif
+        }
+
+        static size_t get_slot_index(size_t size)
+        {
+            size_t index = 0;
+            for (size_t slot_size = MIN_SLOT_SIZE; slot_size < size; slot_size <<= 1) {
+                ++index;
+            }
+            return index;
+        }
+
+        struct secure_pool final {
+            // Free slots for each size are kept in an intrusive list,
+            // threaded through the first bytes of each free slot
+            struct free_slot final {
+                free_slot* next;
+            };
+
+            void* allocate(size_t size)
+            {
+                if (size > MAX_SLOT_SIZE) {
+                    return map_locked(round_to_page(size));
+                }
+                const size_t index = get_slot_index(size);
+                std::lock_guard<std::mutex> locker(m_mutex);
+                if (!m_free[index]) {
+                    add_chunk(index);
+                }
+                free_slot* slot = m_free[index];
+                m_free[index] = slot->next;
+                slot->next = nullptr;
+                return slot;
+            }
+
+            void deallocate(void* p, size_t size) noexcept
+            {
+                wally_bzero(p, size);
+                if (size > MAX_SLOT_SIZE) {
+                    unmap_locked(p, round_to_page(size));
+                    return;
+                }
+                const size_t index = get_slot_index(size);
+                auto slot = static_cast<free_slot*>(p);
+                std::lock_guard<std::mutex> locker(m_mutex);
+                slot->next = m_free[index];
+                m_free[index] = slot;
+            }
+
+        private:
+            size_t round_to_page(size_t size) const { return (size + m_page_size - 1) / m_page_size * m_page_size; }
+
+            // Split a new locked chunk into slots of the given size.
+            // Chunks are kept for the lifetime of the process
+            void add_chunk(size_t index)
+            {
+                const size_t slot_size = MIN_SLOT_SIZE << index;
+                auto chunk = static_cast<unsigned char*>(map_locked(CHUNK_SIZE));
+                for (size_t offset = 0; offset < CHUNK_SIZE; offset += slot_size) {
+                    auto slot = reinterpret_cast<free_slot*>(chunk + offset);
+                    slot->next = m_free[index];
+                    m_free[index] = slot;
+                }
+            }
+
+            const size_t m_page_size = get_page_size();
+            std::mutex m_mutex;
+            std::array<free_slot*, NUM_SLOT_SIZES> m_free{};
+        };
+
+        static secure_pool& get_secure_pool()
+        {
+            // Never destroyed, so secure objects may be freed during static destruction
+            static secure_pool* s_pool = new secure_pool();
+            return *s_pool;
+        }
+    } // namespace
+
+    void* secure_alloc(size_t size) { return get_secure_pool().allocate(size ? size : 1); }
+
+    void secure_free(void* p, size_t size) noexcept
+    {
+        if (p) {
+            get_secure_pool().deallocate(p, size ? size : 1);
+        }
+    }
+
+} // namespace green
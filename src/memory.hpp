@@ -5,6 +5,7 @@
 #include <array>
 #include <memory>
 #include <new>
+#include <type_traits>
 #include <vector>
 
 #include "assertion.hpp"
@@ -32,12 +33,58 @@ namespace green {
 
     template <typename T> void swap_with_default(T& obj) { T().swap(obj); }
 
-    template <typename T> void bzero_and_free(std::vector<T>& data)
+    template <typename T, typename A> void bzero_and_free(std::vector<T, A>& data)
     {
-        wally_bzero(data.data(), data.size());
+        wally_bzero(data.data(), data.size() * sizeof(T));
         swap_with_default(data);
     }
 
+    //
+    // Secure memory for secrets.
+    //
+    // Allocations are served from pages that are reserved in chunks and
+    // locked into memory where the platform allows, so that secrets are not
+    // written to swap or core dumps. Small allocations are handed out from
+    // fixed-size slots, so locking happens once per chunk rather than per
+    // secret. All secure memory is zeroed when it is freed.
+    //
+    void* secure_alloc(size_t size);
+    void secure_free(void* p, size_t size) noexcept;
+
+    template <typename T> struct secure_allocator {
+        using value_type = T;
+
+        secure_allocator() noexcept = default;
+        template <typename U> secure_allocator(const secure_allocator<U>& /*other*/) noexcept {}
+
+        T* allocate(size_t n) { return static_cast<T*>(secure_alloc(n * sizeof(T))); }
+        void deallocate(T* p, size_t n) noexcept { secure_free(p, n * sizeof(T)); }
+    };
+
+    template <typename T, typename U> bool operator==(const secure_allocator<T>&, const secure_allocator<U>&)
+    {
+        return true;
+    }
+    template <typename T, typename U> bool operator!=(const secure_allocator<T>&, const secure_allocator<U>&)
+    {
+        return false;
+    }
+
+    using secure_bytes_t = std::vector<unsigned char, secure_allocator<unsigned char>>;
+
+    // A single object in secure memory. T must be trivially destructible,
+    // e.g. a wally struct or a std::array of key bytes
+    template <typename T> struct secure_delete {
+        void operator()(T* p) const noexcept { secure_free(p, sizeof(T)); }
+    };
+    template <typename T> using secure_unique_ptr = std::unique_ptr<T, secure_delete<T>>;
+
+    template <typename T> secure_unique_ptr<T> make_secure_unique()
+    {
+        static_assert(std::is_trivially_destructible_v<T>, "secure objects are freed without destruction");
+        return secure_unique_ptr<T>(new (secure_alloc(sizeof(T))) T());
+    }
+
     template <typename T, typename U, typename V> inline void init_container(T& dst, const U& arg1, const V& arg2)
     {
         GDK_RUNTIME_ASSERT(arg1.data() && arg2.data());
@@ -1,8 +1,10 @@
+#include <array>
 #include <boost/algorithm/string/predicate.hpp>
 #include <mutex>
 
 #include "assertion.hpp"
 #include "exception.hpp"
+#include "ga_wally.hpp"
 #include "json_utils.hpp"
 #include "network_parameters.hpp"
 #include "session.hpp" // TODO: gdk_config() doesn't belong in session
@@ -799,6 +801,7 @@ namespace green {
             set_override(defaults, "spv_enabled", user_overrides, false);
             set_override(defaults, "spv_multi", user_overrides, false);
             set_override(defaults, "spv_servers", user_overrides, nlohmann::json::array());
+            set_override(defaults, "subscriptions", user_overrides, nlohmann::json());
             set_override(defaults, "use_tor", user_overrides, false);
             set_override(defaults, "user_agent", user_overrides, empty);
             set_override(defaults, "blob_server_onion_url", user_overrides, empty);
@@ -820,18 +823,108 @@ namespace green {
             }
             return defaults;
         }
+
+        static uint32_t parse_subscriptions(const nlohmann::json& details)
+        {
+            const auto p = details.find("subscriptions");
+            if (p == details.end() || p->is_null()) {
+                return network_parameters::SUBSCRIBE_ALL; // Subscribe to everything by default
+            }
+            static const std::array<std::pair<std::string, uint32_t>, 4> feeds{ {
+                { "txs", network_parameters::SUBSCRIBE_TXS },
+                { "blocks", network_parameters::SUBSCRIBE_BLOCKS },
+                { "tickers", network_parameters::SUBSCRIBE_TICKERS },
+                { "blob", network_parameters::SUBSCRIBE_BLOB },
+            } };
+            GDK_USER_ASSERT(p->is_array(), "subscriptions must be an array");
+            uint32_t subscriptions = 0;
+            for (const auto& name : *p) {
+                GDK_USER_ASSERT(name.is_string(), "Unknown subscription");
+                const auto& name_str = name.get_ref<const std::string&>();
+                const auto f = std::find_if(
+                    feeds.begin(), feeds.end(), [&name_str](const auto& feed) { return feed.first == name_str; });
+                GDK_USER_ASSERT(f != feeds.end(), "Unknown subscription");
+                subscriptions |= f->second;
+            }
+            return subscriptions;
+        }
+
+        // Identical network details are shared between all instances, so
+        // that sessions and the objects copying their parameters do not
+        // each hold a copy of the (large, immutable) network JSON.
+        static std::mutex interned_details_mutex;
+        static std::map<std::string, std::weak_ptr<const network_parameters::details>> interned_details;
+
+        static std::shared_ptr<const network_parameters::details> intern_details(const nlohmann::json& details)
+        {
+            auto key = details.dump();
+            std::unique_lock<std::mutex> l{ interned_details_mutex };
+            auto& existing = interned_details[key];
+            if (auto p = existing.lock(); p) {
+                return p;
+            }
+            // Prune details no longer used by any instance
+            for (auto it = interned_details.begin(); it != interned_details.end();) {
+                if (it->second.expired() && it->first != key) {
+                    it = interned_details.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            auto p = std::make_shared<const network_parameters::details>(details);
+            interned_details[key] = p;
+            return p;
+        }
     } // namespace
 
+    // Keys that every network must have are read with at(), so networks
+    // without them are rejected when registered. Others are defaulted
+    network_parameters::details::details(const nlohmann::json& json_)
+        : json(json_)
+        , network(json.at("network").get<std::string>())
+        , policy_asset(json.value("policy_asset", "btc"))
+        , chain_code(json.at("service_chain_code").get<std::string>())
+        , pub_key(json.at("service_pubkey").get<std::string>())
+        , bip21_prefix(json.at("bip21_prefix").get<std::string>())
+        , bech32_prefix(json.at("bech32_prefix").get<std::string>())
+        , blech32_prefix(j_str_or_empty(json, "blech32_prefix"))
+        , blinded_prefix(j_uint32_or_zero(json, "blinded_prefix"))
+        , cert_expiry_threshold(j_uint32_or_zero(json, "cert_expiry_threshold"))
+        , subscriptions(parse_subscriptions(json))
+        , btc_version(json.at("p2pkh_version").get<unsigned char>())
+        , btc_p2sh_version(json.at("p2sh_version").get<unsigned char>())
+        , is_main_net(json.at("mainnet").get<bool>())
+        , is_liquid(j_bool_or_false(json, "liquid"))
+        , is_development(json.at("development").get<bool>())
+        , is_electrum(j_str_or_empty(json, "server_type") == "electrum")
+        , use_tor(j_bool_or_false(json, "use_tor"))
+        , use_discounted_fees(j_bool_or_false(json, "discount_fees") && is_liquid)
+    {
+        if (is_liquid) {
+            policy_asset_bytes = h2b_rev(policy_asset, 0x1);
+        }
+        if (!chain_code.empty()) {
+            chain_code_bytes = h2b(chain_code);
+        }
+        if (!pub_key.empty()) {
+            pub_key_bytes = h2b(pub_key);
+        }
+    }
+
     network_parameters::network_parameters(const nlohmann::json& details)
-        : m_details(details)
+        : m_details(intern_details(details))
     {
         GDK_RUNTIME_ASSERT_MSG(
             !is_main_net() || get_blob_server_url().empty(), "Blobserver is not yet enabled on mainnet");
     }
 
     network_parameters::network_parameters(const nlohmann::json& user_overrides, nlohmann::json& defaults)
-        : m_details(get_network_overrides(user_overrides, defaults))
+        : m_details(intern_details(get_network_overrides(user_overrides, defaults)))
     {
+        // Multisig tx and block events are what keep the session tx and UTXO
+        // caches current, so they can't be turned off
+        GDK_USER_ASSERT(is_electrum() || is_subscribed(SUBSCRIBE_TXS | SUBSCRIBE_BLOCKS),
+            "Multisig sessions require the txs and blocks subscriptions");
     }
 
     void network_parameters::add(const std::string& name, const nlohmann::json& details)
@@ -881,14 +974,13 @@ namespace green {
         return *p->second;
     }
 
-    std::string network_parameters::network() const { return m_details.at("network"); }
     std::string network_parameters::gait_wamp_url(const std::string& config_prefix) const
     {
-        return m_details.at(config_prefix + "_url");
+        return m_details->json.at(config_prefix + "_url");
     }
     std::vector<std::string> network_parameters::gait_wamp_cert_pins() const
     {
-        auto certificates = m_details.value("wamp_cert_pins", std::vector<std::string>{});
+        auto certificates = m_details->json.value("wamp_cert_pins", std::vector<std::string>{});
         auto pos = std::find(certificates.cbegin(), certificates.cend(), "default");
         if (pos == certificates.cend()) {
             return certificates;
@@ -899,7 +991,7 @@ namespace green {
     }
     std::vector<std::string> network_parameters::gait_wamp_cert_roots() const
     {
-        auto certificates = m_details.value("wamp_cert_roots", std::vector<std::string>{});
+        auto certificates = m_details->json.value("wamp_cert_roots", std::vector<std::string>{});
         auto pos = std::find(certificates.cbegin(), certificates.cend(), "default");
         if (pos == certificates.cend()) {
             return certificates;
@@ -910,57 +1002,42 @@ namespace green {
     }
     std::string network_parameters::block_explorer_address() const
     {
-        return get_url(m_details, "address_explorer_url", "address_explorer_onion_url", use_tor());
+        return get_url(m_details->json, "address_explorer_url", "address_explorer_onion_url", use_tor());
     }
     std::string network_parameters::block_explorer_tx() const
     {
-        return get_url(m_details, "tx_explorer_url", "tx_explorer_onion_url", use_tor());
+        return get_url(m_details->json, "tx_explorer_url", "tx_explorer_onion_url", use_tor());
     }
-    std::string network_parameters::chain_code() const { return m_details.at("service_chain_code"); }
-    bool network_parameters::electrum_tls() const { return m_details.at("electrum_tls"); }
+    bool network_parameters::electrum_tls() const { return m_details->json.at("electrum_tls"); }
     std::string network_parameters::electrum_url() const
     {
-        return get_url(m_details, "electrum_url", "electrum_onion_url", use_tor());
+        return get_url(m_details->json, "electrum_url", "electrum_onion_url", use_tor());
     }
-    bool network_parameters::use_discounted_fees() const
+    std::string network_parameters::get_pin_server_url() const
     {
-        return j_bool_or_false(m_details, "discount_fees") && is_liquid();
+        return get_url(m_details->json, "pin_server_url", "pin_server_onion_url", use_tor());
     }
-    std::string network_parameters::get_pin_server_url() const
+    std::string network_parameters::get_pin_server_public_key() const
     {
-        return get_url(m_details, "pin_server_url", "pin_server_onion_url", use_tor());
+        return m_details->json.at("pin_server_public_key");
     }
-    std::string network_parameters::get_pin_server_public_key() const { return m_details.at("pin_server_public_key"); }
     std::string network_parameters::get_blob_server_url() const
     {
-        return get_url(m_details, "blob_server_url", "blob_server_onion_url", use_tor());
+        return get_url(m_details->json, "blob_server_url", "blob_server_onion_url", use_tor());
     }
-    std::string network_parameters::pub_key() const { return m_details.at("service_pubkey"); }
     std::string network_parameters::gait_onion(const std::string& config_prefix) const
     {
-        return m_details.at(config_prefix + "_onion_url");
+        return m_details->json.at(config_prefix + "_onion_url");
     }
-    std::string network_parameters::get_policy_asset() const { return m_details.value("policy_asset", "btc"); }
-    std::string network_parameters::bip21_prefix() const { return m_details.at("bip21_prefix"); }
-    std::string network_parameters::bech32_prefix() const { return m_details.at("bech32_prefix"); }
-    std::string network_parameters::blech32_prefix() const { return m_details.value("blech32_prefix", std::string()); }
-    unsigned char network_parameters::btc_version() const { return m_details.at("p2pkh_version"); }
-    unsigned char network_parameters::btc_p2sh_version() const { return m_details.at("p2sh_version"); }
-    uint32_t network_parameters::blinded_prefix() const { return m_details.at("blinded_prefix"); }
-    bool network_parameters::is_main_net() const { return m_details.at("mainnet"); }
-    bool network_parameters::is_liquid() const { return m_details.value("liquid", false); }
-    bool network_parameters::is_development() const { return m_details.at("development"); }
-    bool network_parameters::is_electrum() const { return m_details.value("server_type", std::string()) == "electrum"; }
-    bool network_parameters::use_tor() const { return m_details.value("use_tor", false); }
-    bool network_parameters::is_spv_enabled() const { return m_details.at("spv_enabled"); }
-    std::string network_parameters::user_agent() const { return m_details.value("user_agent", std::string()); }
+    bool network_parameters::is_spv_enabled() const { return m_details->json.at("spv_enabled"); }
+    std::string network_parameters::user_agent() const { return m_details->json.value("user_agent", std::string()); }
     std::string network_parameters::get_connection_string(const std::string& config_prefix) const
     {
         return use_tor() ? gait_onion(config_prefix) : gait_wamp_url(config_prefix);
     }
     std::string network_parameters::get_registry_connection_string() const
     {
-        return get_url(m_details, "asset_registry_url", "asset_registry_onion_url", use_tor());
+        return get_url(m_details->json, "asset_registry_url", "asset_registry_onion_url", use_tor());
     }
     bool network_parameters::is_tls_connection(const std::string& config_prefix) const
     {
@@ -968,16 +1045,15 @@ namespace green {
     }
     bool network_parameters::are_matching_csv_buckets(const nlohmann::json::array_t& buckets) const
     {
-        return j_arrayref(m_details, "csv_buckets") == buckets;
+        return j_arrayref(m_details->json, "csv_buckets") == buckets;
     }
 
     bool network_parameters::is_valid_csv_value(uint32_t csv_blocks) const
     {
-        const auto& buckets = j_arrayref(m_details, "csv_buckets");
+        const auto& buckets = j_arrayref(m_details->json, "csv_buckets");
         return std::find(buckets.begin(), buckets.end(), csv_blocks) != buckets.end();
     }
 
-    uint32_t network_parameters::cert_expiry_threshold() const { return m_details.at("cert_expiry_threshold"); }
     // max_reorg_blocks indicates the maximum number of blocks that gdk will expect to re-org on-chain.
     // In the event that a re-org is larger than this value, AND the user has a tx re-orged in a block
     // older than the current tip minus max_reorg_blocks, cached data may become out of date and will
@@ -987,11 +1063,14 @@ namespace green {
     // BTC testnet/regtest are set to one week (7 * 144 blocks), this allows regtest test runs under
     // a weeks worth of blocks without cache deletion, and for testnet still allows cache finalization
     // testing while being unnaffected by normal chain operation.
-    uint32_t network_parameters::get_max_reorg_blocks() const { return m_details.at("max_reorg_blocks"); }
-    std::optional<uint32_t> network_parameters::get_min_fee_rate() const { return j_uint32(m_details, "min_fee_rate"); }
+    uint32_t network_parameters::get_max_reorg_blocks() const { return m_details->json.at("max_reorg_blocks"); }
+    std::optional<uint32_t> network_parameters::get_min_fee_rate() const
+    {
+        return j_uint32(m_details->json, "min_fee_rate");
+    }
     std::string network_parameters::get_price_url() const
     {
-        return get_url(m_details, "price_url", "price_onion_url", use_tor());
+        return get_url(m_details->json, "price_url", "price_onion_url", use_tor());
     }
 
 } // namespace green
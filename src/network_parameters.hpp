@@ -32,34 +32,47 @@ namespace green {
         network_parameters(network_parameters&&) = default;
         network_parameters& operator=(network_parameters&&) = default;
 
-        const nlohmann::json& get_json() const { return m_details; }
+        // Server event feeds, selected by the "subscriptions" parameter
+        static constexpr uint32_t SUBSCRIBE_TXS = 0x1;
+        static constexpr uint32_t SUBSCRIBE_BLOCKS = 0x2;
+        static constexpr uint32_t SUBSCRIBE_TICKERS = 0x4;
+        static constexpr uint32_t SUBSCRIBE_BLOB = 0x8;
+        static constexpr uint32_t SUBSCRIBE_ALL = 0xf;
 
-        std::string network() const;
+        const nlohmann::json& get_json() const { return m_details->json; }
+
+        const std::string& network() const { return m_details->network; }
         std::string gait_wamp_url(const std::string& config_prefix) const;
         std::vector<std::string> gait_wamp_cert_pins() const;
         std::vector<std::string> gait_wamp_cert_roots() const;
         std::string block_explorer_address() const;
         std::string block_explorer_tx() const;
-        std::string chain_code() const;
+        const std::string& chain_code() const { return m_details->chain_code; }
+        const std::vector<unsigned char>& chain_code_bytes() const { return m_details->chain_code_bytes; }
         std::string electrum_url() const;
-        bool use_discounted_fees() const;
+        bool use_discounted_fees() const { return m_details->use_discounted_fees; }
         std::string get_pin_server_url() const;
         std::string get_pin_server_public_key() const;
-        std::string pub_key() const;
+        const std::string& pub_key() const { return m_details->pub_key; }
+        const std::vector<unsigned char>& pub_key_bytes() const { return m_details->pub_key_bytes; }
         std::string gait_onion(const std::string& config_prefix) const;
-        std::string get_policy_asset() const;
-        std::string bip21_prefix() const;
-        std::string bech32_prefix() const;
-        std::string blech32_prefix() const;
-        unsigned char btc_version() const;
-        unsigned char btc_p2sh_version() const;
-        uint32_t blinded_prefix() const;
-        bool is_main_net() const;
-        bool is_liquid() const;
-        bool is_development() const;
-        bool is_electrum() const;
-        bool use_tor() const;
+        const std::string& get_policy_asset() const { return m_details->policy_asset; }
+        // The policy asset as an explicit (0x01 prefixed) confidential asset, empty if not Liquid
+        const std::vector<unsigned char>& get_policy_asset_bytes() const { return m_details->policy_asset_bytes; }
+        const std::string& bip21_prefix() const { return m_details->bip21_prefix; }
+        const std::string& bech32_prefix() const { return m_details->bech32_prefix; }
+        const std::string& blech32_prefix() const { return m_details->blech32_prefix; }
+        unsigned char btc_version() const { return m_details->btc_version; }
+        unsigned char btc_p2sh_version() const { return m_details->btc_p2sh_version; }
+        uint32_t blinded_prefix() const { return m_details->blinded_prefix; }
+        bool is_main_net() const { return m_details->is_main_net; }
+        bool is_liquid() const { return m_details->is_liquid; }
+        bool is_development() const { return m_details->is_development; }
+        bool is_electrum() const { return m_details->is_electrum; }
+        bool use_tor() const { return m_details->use_tor; }
         bool is_spv_enabled() const;
+        // Whether sessions should subscribe to the given event feed(s)
+        bool is_subscribed(uint32_t feeds) const { return (m_details->subscriptions & feeds) == feeds; }
         bool electrum_tls() const;
         std::string user_agent() const;
         std::string get_connection_string(const std::string& prefix) const;
@@ -68,13 +81,43 @@ namespace green {
         bool is_tls_connection(const std::string& config_prefix) const;
         bool are_matching_csv_buckets(const nlohmann::json::array_t& buckets) const;
         bool is_valid_csv_value(uint32_t csv_blocks) const;
-        uint32_t cert_expiry_threshold() const;
+        uint32_t cert_expiry_threshold() const { return m_details->cert_expiry_threshold; }
         uint32_t get_max_reorg_blocks() const;
         std::optional<uint32_t> get_min_fee_rate() const;
         std::string get_price_url() const;
 
+        // The network details JSON, with the values read in hot paths
+        // parsed once into typed and pre-decoded forms
+        struct details final {
+            explicit details(const nlohmann::json& json_);
+
+            nlohmann::json json;
+            std::string network;
+            std::string policy_asset;
+            std::vector<unsigned char> policy_asset_bytes;
+            std::string chain_code;
+            std::vector<unsigned char> chain_code_bytes;
+            std::string pub_key;
+            std::vector<unsigned char> pub_key_bytes;
+            std::string bip21_prefix;
+            std::string bech32_prefix;
+            std::string blech32_prefix;
+            uint32_t blinded_prefix;
+            uint32_t cert_expiry_threshold;
+            uint32_t subscriptions;
+            unsigned char btc_version;
+            unsigned char btc_p2sh_version;
+            bool is_main_net;
+            bool is_liquid;
+            bool is_development;
+            bool is_electrum;
+            bool use_tor;
+            bool use_discounted_fees;
+        };
+
     private:
-        nlohmann::json m_details;
+        // Immutable and shared by all instances with the same details
+        std::shared_ptr<const details> m_details;
     };
 
 } // namespace green
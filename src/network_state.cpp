@@ -0,0 +1,93 @@
+#include "network_state.hpp"
+
+#include <iterator>
+#include <map>
+#include <mutex>
+
+#include "network_parameters.hpp"
+
+namespace green {
+
+    namespace {
+        // Instances live while any session is using them
+        static std::mutex s_inst_mutex;
+        static std::map<std::string, std::weak_ptr<network_state>> s_instances;
+
+        static std::string get_key(const network_parameters& net_params)
+        {
+            // Sessions share state only when they talk to the same server
+            const auto url = net_params.is_electrum() ? net_params.electrum_url() : net_params.gait_wamp_url("wamp");
+            return net_params.network() + ' ' + url;
+        }
+    } // namespace
+
+    network_state::network_state()
+        : m_block_height(0)
+    {
+    }
+
+    std::shared_ptr<network_state> network_state::get(const network_parameters& net_params)
+    {
+        const auto key = get_key(net_params);
+        std::lock_guard<std::mutex> locker(s_inst_mutex);
+        auto& weak = s_instances[key];
+        auto shared = weak.lock();
+        if (!shared) {
+            weak = shared = std::make_shared<network_state>();
+        }
+        // Remove any expired instances
+        for (auto it = s_instances.begin(); it != s_instances.end();) {
+            it = it->second.expired() ? s_instances.erase(it) : std::next(it);
+        }
+        return shared;
+    }
+
+    void network_state::set_block_height(uint32_t block_height)
+    {
+        m_block_height.store(block_height, std::memory_order_release);
+    }
+
+    std::shared_ptr<const network_state::fee_estimates_t> network_state::get_fee_estimates(
+        std::chrono::seconds max_age) const
+    {
+        auto fees = std::atomic_load(&m_fees);
+        if (!fees || fees->is_stale) {
+            return {};
+        }
+        const auto now = std::chrono::steady_clock::now();
+        if (now - fees->timestamp > max_age) {
+            return {}; // Too old
+        }
+        // Share ownership with the entry to avoid copying the estimates
+        return { fees, &fees->fee_estimates };
+    }
+
+    std::shared_ptr<const network_state::fee_estimates_t> network_state::get_latest_fee_estimates() const
+    {
+        auto fees = std::atomic_load(&m_fees);
+        if (!fees) {
+            return {};
+        }
+        return { fees, &fees->fee_estimates };
+    }
+
+    void network_state::set_fee_estimates(fee_estimates_t fee_estimates)
+    {
+        const auto now = std::chrono::steady_clock::now();
+        auto fees = std::make_shared<const fee_entry>(fee_entry{ std::move(fee_estimates), now, false });
+        std::atomic_store(&m_fees, std::move(fees));
+    }
+
+    void network_state::invalidate_fee_estimates()
+    {
+        // Keep the estimates available to get_latest_fee_estimates()
+        auto fees = std::atomic_load(&m_fees);
+        while (fees && !fees->is_stale) {
+            auto stale = std::make_shared<const fee_entry>(fee_entry{ fees->fee_estimates, fees->timestamp, true });
+            if (std::atomic_compare_exchange_weak(&m_fees, &fees, std::shared_ptr<const fee_entry>(stale))) {
+                break;
+            }
+        }
+    }
+
+} // namespace green
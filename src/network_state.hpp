@@ -0,0 +1,59 @@
+#ifndef GDK_NETWORK_STATE_HPP
+#define GDK_NETWORK_STATE_HPP
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace green {
+
+    class network_parameters;
+
+    // Maximum age of fee estimates before they are re-fetched
+    static constexpr auto FEE_ESTIMATES_MAX_AGE = std::chrono::seconds(120);
+
+    // Chain state shared by all sessions connected to the same backend:
+    // the current block height and the latest fee estimates.
+    // Reads are atomic loads and never block on a session or network call.
+    class network_state final {
+    public:
+        using fee_estimates_t = std::vector<uint32_t>;
+
+        network_state();
+        network_state(const network_state&) = delete;
+        network_state& operator=(const network_state&) = delete;
+
+        // Get the shared state for the backend the given parameters connect to
+        static std::shared_ptr<network_state> get(const network_parameters& net_params);
+
+        // The current block height, or 0 if not known
+        uint32_t get_block_height() const { return m_block_height.load(std::memory_order_acquire); }
+        void set_block_height(uint32_t block_height);
+
+        // Get the latest fee estimates, or null if there are none
+        // or they were fetched more than max_age ago
+        std::shared_ptr<const fee_estimates_t> get_fee_estimates(std::chrono::seconds max_age) const;
+        // Get the latest fee estimates regardless of age, or null if there are none
+        std::shared_ptr<const fee_estimates_t> get_latest_fee_estimates() const;
+        void set_fee_estimates(fee_estimates_t fee_estimates);
+        // Mark the current estimates as out of date, e.g. on a new block
+        void invalidate_fee_estimates();
+
+    private:
+        struct fee_entry final {
+            fee_estimates_t fee_estimates;
+            std::chrono::steady_clock::time_point timestamp;
+            bool is_stale; // Invalidated, to be re-fetched
+        };
+
+        std::atomic<uint32_t> m_block_height;
+        // Only accessed via std::atomic_load/std::atomic_store
+        std::shared_ptr<const fee_entry> m_fees;
+    };
+
+} // namespace green
+
+#endif
@@ -0,0 +1,189 @@
+#include "notification_queue.hpp"
+
+#include <algorithm>
+#include <array>
+#include <string_view>
+
+#include "logging.hpp"
+#include "threading.hpp"
+#include "utils.hpp"
+
+namespace green {
+
+    namespace {
+        // Events that only report the latest state, and so may be coalesced,
+        // or dropped if the queue is full. Other events, such as "block" and
+        // "transaction", are always delivered
+        static const std::array<std::string_view, 4> COALESCED_EVENTS = { "network", "stats", "ticker", "tor" };
+
+        // The number of deliveries the current thread is making, so that
+        // handlers that call back into the session do not wait on themselves
+        static thread_local size_t t_delivery_depth = 0;
+
+        static bool is_coalesced(const nlohmann::json& details)
+        {
+            const auto p = details.find("event");
+            if (p == details.end() || !p->is_string()) {
+                return false;
+            }
+            const auto& event = p->get_ref<const std::string&>();
+            return std::find(COALESCED_EVENTS.begin(), COALESCED_EVENTS.end(), event) != COALESCED_EVENTS.end();
+        }
+    } // namespace
+
+    notification_queue::notification_queue()
+        : m_periodic_interval(0)
+        , m_num_delivering(0)
+        , m_num_dropped(0)
+        , m_stopped(false)
+    {
+    }
+
+    notification_queue::~notification_queue() { stop(); }
+
+    void notification_queue::set_handler(handler_fn_t fn)
+    {
+        locker_t locker(m_mutex);
+        m_handler = std::move(fn);
+        // Wait for deliveries to the previous handler, other than any
+        // being made by this thread, to complete
+        m_cv.wait(locker, [this] { return m_num_delivering <= t_delivery_depth; });
+    }
+
+    void notification_queue::push(nlohmann::json details)
+    {
+        locker_t locker(m_mutex);
+        if (m_stopped || !m_handler) {
+            return;
+        }
+        if (is_coalesced(details)) {
+            // Remove any undelivered event this one supersedes
+            const auto& event = details["event"];
+            auto&& same_event = [&event](const auto& queued) {
+                const auto q = queued.find("event");
+                return q != queued.end() && *q == event;
+            };
+            auto p = std::find_if(m_queue.begin(), m_queue.end(), same_event);
+            if (p != m_queue.end()) {
+                m_queue.erase(p);
+            }
+        }
+        if (m_queue.size() >= MAX_QUEUED) {
+            // Full: drop the oldest state event rather than blocking the
+            // producer, which may be the strand the handler is waiting on.
+            // If only events that must be delivered are queued, the queue grows
+            auto p = std::find_if(m_queue.begin(), m_queue.end(), is_coalesced);
+            if (p != m_queue.end()) {
+                if (!m_num_dropped++) {
+                    GDK_LOG(warning) << "notification queue full, dropping state notifications";
+                }
+                m_queue.erase(p);
+            }
+        }
+        m_queue.emplace_back(std::move(details));
+        if (!m_thread.joinable()) {
+            m_thread = std::thread([this] { thread_fn(); });
+        }
+        m_cv.notify_all();
+    }
+
+    void notification_queue::deliver(nlohmann::json details)
+    {
+        locker_t locker(m_mutex);
+        if (!m_stopped) {
+            deliver(locker, std::move(details));
+        }
+    }
+
+    void notification_queue::set_periodic(std::chrono::milliseconds interval, periodic_fn_t fn)
+    {
+        GDK_RUNTIME_ASSERT(interval.count() > 0 && fn);
+        locker_t locker(m_mutex);
+        GDK_RUNTIME_ASSERT(!m_thread.joinable());
+        m_periodic_fn = std::move(fn);
+        m_periodic_interval = interval;
+        if (!m_stopped) {
+            m_thread = std::thread([this] { thread_fn(); });
+        }
+    }
+
+    void notification_queue::deliver(locker_t& locker, nlohmann::json details)
+    {
+        GDK_RUNTIME_ASSERT(locker.owns_lock());
+        if (!m_handler) {
+            return;
+        }
+        auto handler = m_handler;
+        ++m_num_delivering;
+        ++t_delivery_depth;
+        {
+            unique_unlock unlocker(locker);
+            no_std_exception_escape([&handler, &details] { handler(std::move(details)); }, "notification");
+        }
+        --t_delivery_depth;
+        --m_num_delivering;
+        m_cv.notify_all();
+    }
+
+    void notification_queue::stop()
+    {
+        std::thread thread;
+        {
+            locker_t locker(m_mutex);
+            m_stopped = true;
+            m_queue.clear();
+            std::swap(m_thread, thread);
+            m_cv.notify_all();
+        }
+        if (thread.joinable()) {
+            if (thread.get_id() == std::this_thread::get_id()) {
+                thread.detach(); // Stopped from a handler: it exits on return
+            } else {
+                thread.join();
+            }
+        }
+    }
+
+    size_t notification_queue::size()
+    {
+        locker_t locker(m_mutex);
+        return m_queue.size();
+    }
+
+    void notification_queue::thread_fn()
+    {
+        locker_t locker(m_mutex);
+        auto next_periodic = std::chrono::steady_clock::now() + m_periodic_interval;
+        for (;;) {
+            auto&& is_ready = [this] { return m_stopped || !m_queue.empty(); };
+            if (!m_periodic_fn) {
+                m_cv.wait(locker, is_ready);
+            } else if (!m_cv.wait_until(locker, next_periodic, is_ready)) {
+                // Interval elapsed with nothing queued: deliver the periodic notification
+                next_periodic = std::chrono::steady_clock::now() + m_periodic_interval;
+                if (m_handler) {
+                    nlohmann::json details;
+                    {
+                        unique_unlock unlocker(locker);
+                        no_std_exception_escape([this, &details] { details = m_periodic_fn(); }, "periodic");
+                    }
+                    if (!m_stopped && !details.is_null()) {
+                        deliver(locker, std::move(details));
+                    }
+                }
+                continue;
+            }
+            if (m_stopped) {
+                break;
+            }
+            auto details = std::move(m_queue.front());
+            m_queue.pop_front();
+            if (m_queue.empty() && m_num_dropped) {
+                GDK_LOG(warning) << "notification queue dropped " << m_num_dropped << " notifications";
+                m_num_dropped = 0;
+            }
+            deliver(locker, std::move(details));
+        }
+    }
+
+} // namespace green
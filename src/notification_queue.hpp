@@ -0,0 +1,81 @@
+#ifndef GDK_NOTIFICATION_QUEUE_HPP
+#define GDK_NOTIFICATION_QUEUE_HPP
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include <nlohmann/json.hpp>
+
+namespace green {
+
+    //
+    // Delivers a session's notifications to the user's handler.
+    //
+    // Asynchronous notifications are queued and delivered in order by a
+    // dedicated thread, so that slow handlers do not stall the network
+    // threads that produce them. Queued state events that are superseded
+    // by a later event of the same kind ("network", "stats", "ticker",
+    // "tor") are coalesced, so only the latest is delivered. Producers never
+    // wait, since they may be network threads the handler depends on. If
+    // the handler falls too far behind, state events are dropped to make
+    // space. Other events, e.g. "block" and "transaction", are never dropped.
+    // A periodic notification may also be generated by the delivery thread.
+    //
+    class notification_queue final {
+    public:
+        using handler_fn_t = std::function<void(nlohmann::json details)>;
+        using periodic_fn_t = std::function<nlohmann::json()>;
+
+        static constexpr size_t MAX_QUEUED = 1024;
+
+        notification_queue();
+        notification_queue(const notification_queue&) = delete;
+        notification_queue& operator=(const notification_queue&) = delete;
+        ~notification_queue();
+
+        // Set the handler to deliver to. When this returns, no other thread
+        // is delivering to the previous handler.
+        void set_handler(handler_fn_t fn);
+
+        // Queue a notification for delivery by the delivery thread
+        void push(nlohmann::json details);
+
+        // Deliver a notification from the calling thread
+        void deliver(nlohmann::json details);
+
+        // Deliver the notification returned by fn every interval. Must be
+        // called before any notifications are queued.
+        void set_periodic(std::chrono::milliseconds interval, periodic_fn_t fn);
+
+        // Stop delivering, discarding any queued notifications
+        void stop();
+
+        // Get the number of notifications awaiting delivery
+        size_t size();
+
+    private:
+        using locker_t = std::unique_lock<std::mutex>;
+
+        void deliver(locker_t& locker, nlohmann::json details);
+        void thread_fn();
+
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+        handler_fn_t m_handler;
+        std::deque<nlohmann::json> m_queue;
+        periodic_fn_t m_periodic_fn;
+        std::chrono::milliseconds m_periodic_interval;
+        size_t m_num_delivering; // Number of deliveries in progress
+        size_t m_num_dropped; // Dropped since the queue last drained
+        std::thread m_thread; // Started on first push
+        bool m_stopped;
+    };
+
+} // namespace green
+
+#endif
@@ -7,14 +7,32 @@
 #include "json_utils.hpp"
 #include "network_parameters.hpp"
 #include "session_impl.hpp"
+#include "threading.hpp"
+#include "transaction_utils.hpp"
 
 #include <algorithm>
 #include <iterator>
 #include <memory>
+#include <numeric>
 
 namespace green {
 
     namespace {
+        // Bounds on "max_tx_weight" for planned redeposits
+        static constexpr uint32_t MIN_PLANNED_TX_WEIGHT = 4000;
+        static constexpr uint32_t MAX_PLANNED_TX_WEIGHT = 400000; // Standardness limit
+        // Maximum addresses fetched by one get_receive_addresses_call
+        static constexpr size_t MAX_ADDRESSES_PER_CALL = 1000;
+
+        // A planned redeposit tx under construction
+        struct planned_tx final {
+            nlohmann::json utxos = nlohmann::json::object();
+            size_t num_inputs = 0;
+            size_t inputs_weight = 0;
+            size_t num_outputs = 0;
+            bool has_policy_asset = false;
+        };
+
         // Remove non-expired utxos and return them
         static auto filter_unexpired_utxos(nlohmann::json& utxos, uint64_t block_height)
         {
@@ -52,8 +70,11 @@ namespace green {
                 return state_type::done;
             }
         }
+        if (m_max_tx_weight) {
+            return planned_call_impl();
+        }
 
-        const auto policy_asset = m_net_params.get_policy_asset();
+        const auto& policy_asset = m_net_params.get_policy_asset();
         auto& utxos = j_ref(m_details, "utxos");
         auto& addressees = j_arrayref(m_result, "addressees");
         if (addressees.size() < utxos.size()) {
@@ -80,7 +101,7 @@ namespace green {
 
     void create_redeposit_transaction_call::initialize()
     {
-        const auto policy_asset = m_net_params.get_policy_asset();
+        const auto& policy_asset = m_net_params.get_policy_asset();
         uint64_t block_height;
         auto& utxos = j_ref(m_details, "utxos");
         std::set<std::string> to_erase;
@@ -169,6 +190,188 @@ namespace green {
             }
         }
         m_result["addressees"] = std::move(addressees);
+
+        m_max_tx_weight = j_uint32(m_details, "max_tx_weight");
+        if (m_max_tx_weight) {
+            if (*m_max_tx_weight < MIN_PLANNED_TX_WEIGHT || *m_max_tx_weight > MAX_PLANNED_TX_WEIGHT) {
+                throw user_error("Invalid max_tx_weight");
+            }
+            if (const auto max_fee = j_amount(m_details, "max_fee"); max_fee) {
+                m_max_fee = max_fee->value();
+            }
+            plan_transactions();
+        }
+    }
+
+    uint32_t create_redeposit_transaction_call::get_asset_subaccount(const std::string& asset_id) const
+    {
+        const bool is_fee = asset_id == m_net_params.get_policy_asset();
+        return is_fee ? *m_fee_subaccount : *m_subaccount;
+    }
+
+    std::vector<nlohmann::json> plan_redeposit_transactions(const network_parameters& net_params,
+        nlohmann::json& utxos, uint32_t max_tx_weight, std::optional<uint64_t> max_fee, uint64_t fee_rate,
+        size_t fee_input_weight)
+    {
+        // Partition the UTXOs in order into txs that are estimated to fit
+        // within the weight limit and (if given) the fee budget
+        const auto& policy_asset = net_params.get_policy_asset();
+        const bool is_liquid = net_params.is_liquid();
+        const bool is_discounted = net_params.use_discounted_fees();
+
+        auto&& is_within_limits = [&](const planned_tx& tx) {
+            const bool needs_fee_input = is_liquid && !tx.has_policy_asset;
+            const size_t num_inputs = tx.num_inputs + needs_fee_input;
+            const size_t num_outputs = tx.num_outputs + needs_fee_input;
+            const size_t inputs_weight = tx.inputs_weight + (needs_fee_input ? fee_input_weight : 0);
+            // The weight limits apply to the raw weight, while fees may be
+            // computed from a discounted weight
+            constexpr bool discounted = false;
+            const size_t weight
+                = get_estimated_tx_weight(net_params, num_inputs, inputs_weight, num_outputs, discounted);
+            if (weight > max_tx_weight || weight > MAX_PLANNED_TX_WEIGHT) {
+                return false;
+            }
+            if (!max_fee) {
+                return true;
+            }
+            const size_t fee_weight = is_discounted
+                ? get_estimated_tx_weight(net_params, num_inputs, inputs_weight, num_outputs, is_discounted)
+                : weight;
+            return Tx::vsize_from_weight(fee_weight) * fee_rate / 1000 <= *max_fee;
+        };
+
+        std::vector<nlohmann::json> txs;
+        planned_tx tx;
+        for (auto& asset : utxos.items()) {
+            const bool is_policy_asset = asset.key() == policy_asset;
+            for (auto& utxo : asset.value()) {
+                const size_t input_weight = get_estimated_input_weight(utxo);
+                // Check the limits with this UTXO added, without its utxos
+                planned_tx candidate;
+                const bool is_new_asset = !tx.utxos.contains(asset.key());
+                candidate.num_inputs = tx.num_inputs + 1;
+                candidate.inputs_weight = tx.inputs_weight + input_weight;
+                candidate.num_outputs = tx.num_outputs + is_new_asset;
+                candidate.has_policy_asset = tx.has_policy_asset || is_policy_asset;
+                if (!is_within_limits(candidate)) {
+                    if (!tx.num_inputs) {
+                        throw user_error("max_tx_weight or max_fee is too small to redeposit a UTXO");
+                    }
+                    txs.emplace_back(std::move(tx.utxos));
+                    tx = planned_tx();
+                }
+                if (!tx.utxos.contains(asset.key())) {
+                    tx.utxos[asset.key()] = nlohmann::json::array_t();
+                    ++tx.num_outputs;
+                }
+                tx.utxos[asset.key()].push_back(std::move(utxo));
+                ++tx.num_inputs;
+                tx.inputs_weight += input_weight;
+                tx.has_policy_asset |= is_policy_asset;
+            }
+        }
+        if (tx.num_inputs) {
+            txs.emplace_back(std::move(tx.utxos));
+        }
+        return txs;
+    }
+
+    void create_redeposit_transaction_call::plan_transactions()
+    {
+        const auto& policy_asset = m_net_params.get_policy_asset();
+        const bool is_liquid = m_net_params.is_liquid();
+        auto fee_rate = j_amount(m_result, "fee_rate").value_or(m_session->get_default_fee_rate()).value();
+        fee_rate = std::max(fee_rate, m_session->get_min_fee_rate().value());
+        // On Liquid, txs without L-BTC to redeposit need a fee UTXO added
+        size_t fee_input_weight = 0;
+        for (const auto& utxo : m_fee_utxos) {
+            fee_input_weight = std::max(fee_input_weight, get_estimated_input_weight(utxo));
+        }
+
+        nlohmann::json::array_t txs;
+        for (auto& tx_utxos : plan_redeposit_transactions(m_net_params, j_ref(m_details, "utxos"), *m_max_tx_weight,
+                 m_max_fee, fee_rate, fee_input_weight)) {
+            nlohmann::json planned = { { "utxos", std::move(tx_utxos) } };
+            if (is_liquid && !planned["utxos"].contains(policy_asset)) {
+                planned["utxos"][policy_asset] = nlohmann::json::array_t();
+                add_fee_utxo(planned);
+            }
+            for (const auto& asset : planned["utxos"].items()) {
+                ++m_addresses_needed[get_asset_subaccount(asset.key())];
+            }
+            if (auto p = m_result.find("fee_rate"); p != m_result.end()) {
+                planned["fee_rate"] = *p;
+            }
+            txs.emplace_back(std::move(planned));
+        }
+        m_result.erase("addressees");
+        m_result["transactions"] = std::move(txs);
+    }
+
+    auth_handler::state_type create_redeposit_transaction_call::planned_call_impl()
+    {
+        for (const auto& [subaccount, count] : m_addresses_needed) {
+            if (const size_t have = m_addresses[subaccount].size(); have < count) {
+                // Fetch the next batch of addresses for this subaccount
+                const size_t n = std::min(count - have, MAX_ADDRESSES_PER_CALL);
+                nlohmann::json details{ { "subaccount", subaccount }, { "count", n } };
+                m_address_subaccount = subaccount;
+                add_next_handler(new get_receive_addresses_call(m_session_parent, std::move(details)));
+                return state_type::make_call;
+            }
+        }
+        create_planned_transactions();
+        return state_type::done;
+    }
+
+    void create_redeposit_transaction_call::create_planned_transactions()
+    {
+        auto& txs = m_result.at("transactions");
+        std::map<uint32_t, size_t> used;
+        for (auto& tx : txs) {
+            // Redeposit each asset to a greedy addressee
+            nlohmann::json::array_t addressees;
+            for (const auto& asset : tx["utxos"].items()) {
+                const auto subaccount = get_asset_subaccount(asset.key());
+                auto addressee = std::move(m_addresses.at(subaccount).at(used[subaccount]++));
+                if (m_net_params.is_liquid()) {
+                    addressee["asset_id"] = asset.key();
+                }
+                addressee["is_greedy"] = true;
+                addressees.emplace_back(std::move(addressee));
+            }
+            tx["addressees"] = std::move(addressees);
+        }
+
+        // Create the txs in parallel. Fee UTXOs are added to any that
+        // can't pay their fees serially, and only those are re-created
+        std::vector<size_t> to_create(txs.size());
+        std::iota(to_create.begin(), to_create.end(), 0);
+        while (!to_create.empty()) {
+            parallel_for(to_create.size(), [&](size_t i) { create_transaction(*m_session, txs[to_create[i]]); });
+            std::vector<size_t> retry;
+            for (const auto i : to_create) {
+                if (j_strref(txs[i], "error") == "Insufficient funds for fees") {
+                    add_fee_utxo(txs[i]);
+                    retry.push_back(i);
+                }
+            }
+            to_create.swap(retry);
+        }
+
+        std::string error;
+        for (auto& tx : txs) {
+            if (j_str_is_empty(tx, "error") && j_uint32ref(tx, "transaction_weight") > *m_max_tx_weight) {
+                // Our estimate was too low; the caller can retry with a lower limit
+                set_tx_error(tx, "Transaction exceeds max_tx_weight");
+            }
+            if (error.empty()) {
+                error = j_str_or_empty(tx, "error");
+            }
+        }
+        // Any error is also reported for the batch as a whole
+        m_result["error"] = std::move(error);
     }
 
     std::string create_redeposit_transaction_call::get_nth_asset_id(size_t n) const
@@ -186,7 +389,7 @@ namespace green {
         if (m_fee_utxos.empty()) {
             throw user_error("Insufficient funds for fees"); // FIXME res::
         }
-        const auto policy_asset = m_net_params.get_policy_asset();
+        const auto& policy_asset = m_net_params.get_policy_asset();
         auto& fee_utxos = const_cast<json_array_t&>(j_arrayref(j_ref(to, "utxos"), policy_asset));
         fee_utxos.push_back(std::move(m_fee_utxos.back()));
         m_fee_utxos.pop_back();
@@ -194,6 +397,15 @@ namespace green {
 
     void create_redeposit_transaction_call::on_next_handler_complete(auth_handler* next_handler)
     {
+        if (m_max_tx_weight) {
+            // We have fetched a batch of addresses for the planned txs
+            auto& addresses = m_addresses[m_address_subaccount.value()];
+            nlohmann::json result = std::move(next_handler->move_result());
+            for (auto& address : j_ref(result, "list")) {
+                addresses.emplace_back(std::move(address));
+            }
+            return;
+        }
         // We have fetched a new address to redeposit to.
         // Add it as a greedy adressee for the asset we are redepositing.
         auto& addressees = const_cast<json_array_t&>(j_arrayref(m_result, "addressees"));
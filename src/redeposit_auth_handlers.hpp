@@ -3,10 +3,24 @@
 #pragma once
 
 #include "auth_handler.hpp"
+#include <map>
 #include <optional>
+#include <vector>
 
 namespace green {
 
+    class network_parameters;
+
+    // Split the UTXOs of a redeposit, in order, into txs that are estimated
+    // to be within max_tx_weight and, if given, to cost at most max_fee at
+    // fee_rate. utxos is an asset id to UTXO list map, and its UTXOs are
+    // moved into the result, one such map per tx. On Liquid, txs without
+    // policy asset UTXOs allow for a fee input of fee_input_weight, which
+    // the caller must add.
+    std::vector<nlohmann::json> plan_redeposit_transactions(const network_parameters& net_params,
+        nlohmann::json& utxos, uint32_t max_tx_weight, std::optional<uint64_t> max_fee, uint64_t fee_rate,
+        size_t fee_input_weight);
+
     class create_redeposit_transaction_call : public auth_handler_impl {
     public:
         create_redeposit_transaction_call(session& session, nlohmann::json details);
@@ -18,11 +32,23 @@ namespace green {
         void initialize();
         std::string get_nth_asset_id(size_t n) const;
         void add_fee_utxo(nlohmann::json& to);
+        uint32_t get_asset_subaccount(const std::string& asset_id) const;
+
+        // Planner: split the redeposit into several txs
+        void plan_transactions();
+        state_type planned_call_impl();
+        void create_planned_transactions();
 
         nlohmann::json m_details;
         nlohmann::json::array_t m_fee_utxos;
         std::optional<uint32_t> m_subaccount;
         std::optional<uint32_t> m_fee_subaccount;
+        std::optional<uint32_t> m_max_tx_weight;
+        std::optional<uint64_t> m_max_fee;
+        // Addresses still needed/fetched for planned txs, by subaccount
+        std::map<uint32_t, size_t> m_addresses_needed;
+        std::map<uint32_t, nlohmann::json::array_t> m_addresses;
+        std::optional<uint32_t> m_address_subaccount;
     };
 } // namespace green
 #endif // GDK_REDEPOSIT_AUTH_HANDLERS_HPP
@@ -4,6 +4,7 @@
 #include <mutex>
 #include <random>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "session.hpp"
@@ -14,10 +15,13 @@
 #include "ga_rust.hpp"
 #include "ga_session.hpp"
 #include "ga_strings.hpp"
+#include "ga_tor.hpp"
+#include "io_runner.hpp"
 #include "json_utils.hpp"
 #include "logging.hpp"
 #include "network_parameters.hpp"
 #include "signer.hpp"
+#include "stats.hpp"
 #include "utils.hpp"
 #if defined(__ANDROID__) && (__ANDROID_API__ >= __ANDROID_API_P__)
 #include <android/fdsan.h>
@@ -30,8 +34,13 @@ namespace green {
     namespace {
         static std::atomic_bool init_done{ false };
         static nlohmann::json global_config;
+        static std::mutex global_tor_mutex;
         static std::shared_ptr<tor_controller> global_tor_ctrl;
-        static auto global_log_level = log_level::severity_level::fatal;
+        static bool global_tor_in_use = false; // True once a session has used tor
+        // Never destroyed, so that sessions the caller has not destroyed
+        // can't have their I/O threads joined from under them at exit
+        static io_pool* global_io_pool = nullptr;
+        constexpr uint32_t MAX_IO_THREADS = 64;
 
         static void log_exception(const char* preamble, const std::exception& e)
         {
@@ -60,6 +69,12 @@ namespace green {
             const std::string datadir = config["datadir"];
             config.emplace("registrydir", datadir + "/registry");
         }
+        if (!config.contains("io_threads")) {
+            const uint32_t num_cpus = std::max(std::thread::hardware_concurrency(), 1u);
+            config.emplace("io_threads", std::min(num_cpus, 4u));
+        }
+        const uint32_t io_threads = config["io_threads"];
+        GDK_RUNTIME_ASSERT_MSG(io_threads != 0 && io_threads <= MAX_IO_THREADS, "Invalid io_threads");
 
         if (init_done) {
             // It is invalid to call GA_init() with different configs.
@@ -83,16 +98,22 @@ namespace green {
         // Set up logging. Default to fatal logging, effectively 'none',
         // since we don't use fatal severity for logging.
         const auto& level = j_strref(global_config, "log_level");
+        auto log_severity = log_level::severity_level::fatal;
         if (level == "debug") {
-            global_log_level = log_level::severity_level::debug;
+            log_severity = log_level::severity_level::debug;
         } else if (level == "info") {
-            global_log_level = log_level::severity_level::info;
+            log_severity = log_level::severity_level::info;
         } else if (level == "warn") {
-            global_log_level = log_level::severity_level::warning;
+            log_severity = log_level::severity_level::warning;
         } else if (level == "error") {
-            global_log_level = log_level::severity_level::error;
+            log_severity = log_level::severity_level::error;
+        }
+        init_logging(log_severity);
+
+        if (const auto trace_seconds = j_uint32(global_config, "trace_seconds").value_or(0); trace_seconds) {
+            const std::string datadir = global_config["datadir"];
+            stats::start_trace(datadir + "/gdk_trace.json", std::chrono::seconds(trace_seconds));
         }
-        boost::log::core::get()->set_filter(log_level::severity >= global_log_level);
 
         GDK_VERIFY(wally_init(0));
         auto entropy = get_random_bytes<WALLY_SECP_RANDOMIZE_LEN>();
@@ -112,8 +133,23 @@ namespace green {
 #endif /* ANDROID */
 
         init_rust(global_config);
+        global_io_pool = new io_pool(io_threads);
         init_done = true;
 
+        if (j_bool_or_false(global_config, "tor_prewarm")) {
+            // Start bootstrapping tor in the background, so it is
+            // ready or nearly so when the first session needs it
+            boost::asio::post(global_io_pool->get_io_context(), [] {
+                no_std_exception_escape([] {
+                    std::unique_lock<std::mutex> locker(global_tor_mutex);
+                    if (!global_tor_ctrl && !global_tor_in_use) {
+                        GDK_LOG(info) << "tor: pre-warming";
+                        global_tor_ctrl = tor_controller::get_shared_ref();
+                    }
+                });
+            });
+        }
+
         return GA_OK;
     }
 
@@ -123,19 +159,37 @@ namespace green {
         return global_config;
     }
 
+    boost::asio::io_context& gdk_io_context()
+    {
+        GDK_RUNTIME_ASSERT(init_done);
+        return global_io_pool->get_io_context();
+    }
+
     void gdk_set_tor_controller(std::shared_ptr<struct tor_controller> controller)
     {
         GDK_RUNTIME_ASSERT(init_done);
         GDK_RUNTIME_ASSERT(controller);
-        if (!global_tor_ctrl && j_bool_or_false(global_config, "with_shutdown")) {
-            global_tor_ctrl = std::move(controller);
+        std::unique_lock<std::mutex> locker(global_tor_mutex);
+        global_tor_in_use = true;
+        if (j_bool_or_false(global_config, "with_shutdown")) {
+            if (!global_tor_ctrl) {
+                global_tor_ctrl = std::move(controller);
+            }
+        } else {
+            // Any pre-warmed controller is now kept alive by the session
+            global_tor_ctrl.reset();
         }
     }
 
     int gdk_shutdown()
     {
         GDK_RUNTIME_ASSERT(init_done);
-        global_tor_ctrl.reset();
+        std::shared_ptr<tor_controller> tor_ctrl;
+        {
+            std::unique_lock<std::mutex> locker(global_tor_mutex);
+            tor_ctrl.swap(global_tor_ctrl);
+        }
+        tor_ctrl.reset();
         return GA_OK;
     }
 
@@ -385,6 +439,14 @@ namespace green {
         });
     }
 
+    void session::set_transaction_memos(const nlohmann::json& details)
+    {
+        exception_wrapper([&] {
+            auto p = get_nonnull_impl();
+            p->set_transaction_memos(details);
+        });
+    }
+
     nlohmann::json session::get_transaction_details(const std::string& txhash_hex)
     {
         return exception_wrapper([&] {
@@ -409,6 +471,27 @@ namespace green {
         });
     }
 
+    nlohmann::json session::get_stats()
+    {
+        return exception_wrapper([&] { return stats::get(); });
+    }
+
+    nlohmann::json session::get_memory_stats()
+    {
+        return exception_wrapper([&] {
+            auto p = get_nonnull_impl();
+            return p->get_memory_stats();
+        });
+    }
+
+    nlohmann::json session::search_transactions(const nlohmann::json& details)
+    {
+        return exception_wrapper([&] {
+            auto p = get_nonnull_impl();
+            return p->search_transactions(details);
+        });
+    }
+
     nlohmann::json session::convert_amount(const nlohmann::json& amount_json)
     {
         return exception_wrapper([&] {
@@ -422,6 +505,21 @@ namespace green {
         });
     }
 
+    nlohmann::json session::convert_amounts(const nlohmann::json& details)
+    {
+        return exception_wrapper([&] {
+            auto p = get_impl();
+            if (p) {
+                return p->convert_amounts(details);
+            }
+            nlohmann::json::array_t amounts;
+            for (const auto& amount_json : j_arrayref(details, "amounts")) {
+                amounts.emplace_back(amount::convert(amount_json, std::string(), std::string()));
+            }
+            return nlohmann::json({ { "amounts", std::move(amounts) } });
+        });
+    }
+
     const network_parameters& session::get_network_parameters() const
     {
         auto p = get_nonnull_impl();
@@ -10,6 +10,12 @@
 
 #include "ga_wally.hpp"
 
+namespace boost {
+    namespace asio {
+        class io_context;
+    } // namespace asio
+} // namespace boost
+
 namespace green {
 
     class network_parameters;
@@ -18,6 +24,8 @@ namespace green {
 
     int gdk_init(nlohmann::json config);
     const nlohmann::json& gdk_config();
+    // Get an io_context from the process-wide I/O pool created by gdk_init
+    boost::asio::io_context& gdk_io_context();
     void gdk_set_tor_controller(std::shared_ptr<struct tor_controller> controller);
     int gdk_shutdown();
 
@@ -62,12 +70,20 @@ namespace green {
         void send_nlocktimes();
 
         void set_transaction_memo(const std::string& txhash_hex, const std::string& memo);
+        void set_transaction_memos(const nlohmann::json& details);
 
         nlohmann::json get_fee_estimates();
 
+        nlohmann::json get_stats();
+
+        nlohmann::json get_memory_stats();
+
+        nlohmann::json search_transactions(const nlohmann::json& details);
+
         std::string get_system_message();
 
         nlohmann::json convert_amount(const nlohmann::json& amount_json);
+        nlohmann::json convert_amounts(const nlohmann::json& details);
 
         const network_parameters& get_network_parameters() const;
 
@@ -2,6 +2,7 @@
 #include <boost/algorithm/string.hpp>
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/strand.hpp>
+#include <fstream>
 
 #include "client_blob.hpp"
 #include "exception.hpp"
@@ -15,17 +16,26 @@
 #include "io_runner.hpp"
 #include "json_utils.hpp"
 #include "logging.hpp"
+#include "notification_queue.hpp"
 #include "session.hpp"
 #include "session_impl.hpp"
 #include "signer.hpp"
+#include "stats.hpp"
 #include "transaction_utils.hpp"
+#include "transport_recording.hpp"
 #include "utils.hpp"
+#include "utxo_record.hpp"
 #include "wamp_transport.hpp"
 #include "xpub_hdkey.hpp"
 
 namespace green {
 
     namespace {
+        // Maximum number of parsed transactions kept in memory per session
+        constexpr size_t TX_CACHE_SIZE = 128;
+        // Number of BIP329 labels converted and written at a time when exporting
+        constexpr size_t BIP329_EXPORT_BATCH_SIZE = 1000;
+
         static void check_hint(const std::string& hint, const char* hint_type)
         {
             if (hint != "connect" && hint != "disconnect") {
@@ -34,6 +44,36 @@ namespace green {
             GDK_LOG(info) << "reconnect_hint: " << hint_type << ":" << hint;
         }
 
+        // Get BIP329 labels for singlesig subaccount xpubs
+        static nlohmann::json::array_t get_bip329_xpubs(const nlohmann::json& subaccounts)
+        {
+            // TODO: Implement for multisig (needs thought/possible BIP changes)
+            nlohmann::json::array_t items;
+            for (const auto& sa : subaccounts) {
+                nlohmann::json sa_json{ { "type", "xpub" }, { "label", j_strref(sa, "name") } };
+                // We add origin information which is an extention to BIP329,
+                // which only specifies this field for transactions.
+                auto descriptor = j_arrayref(sa, "core_descriptors", 2).at(0).get<std::string>();
+                auto origin = descriptor.substr(0, descriptor.find("]", 0)) + "])";
+                auto xpub = descriptor.substr(origin.size() - 1);
+                xpub = xpub.substr(0, xpub.find("/", 0));
+                sa_json.emplace("ref", std::move(xpub));
+                if (boost::algorithm::starts_with(origin, "sh(")) {
+                    origin.append(")");
+                }
+                sa_json.emplace("origin", std::move(origin));
+                items.emplace_back(std::move(sa_json));
+            }
+            return items;
+        }
+
+        static void append_jsonl(std::string& output, const nlohmann::json::array_t& items)
+        {
+            for (const auto& item : items) {
+                output.append(item.dump()).append(1, '\n');
+            }
+        }
+
         static msgpack::object_handle mp_cast(const nlohmann::json& json)
         {
             if (json.is_null()) {
@@ -58,15 +98,15 @@ namespace green {
 
     session_impl::session_impl(network_parameters&& net_params)
         : m_net_params(net_params)
-        , m_io()
-        , m_strand(std::make_unique<boost::asio::io_context::strand>(m_io.get_io_context()))
+        , m_io(gdk_io_context())
+        , m_strand(std::make_unique<boost::asio::io_context::strand>(m_io))
         , m_user_proxy(socksify(m_net_params.get_json().value("proxy", std::string())))
-        , m_notification_handler(nullptr)
-        , m_notification_context(nullptr)
+        , m_notifications(std::make_unique<notification_queue>())
         , m_login_data{}
         , m_watch_only(true)
         , m_notify(true)
         , m_blob(std::make_unique<client_blob>())
+        , m_tx_cache(std::make_unique<tx_cache>(TX_CACHE_SIZE))
         , m_utxo_cache_mutex()
         , m_utxo_cache()
         , m_wamp_connections()
@@ -87,10 +127,19 @@ namespace green {
                 "blob_server", is_mandatory);
             m_wamp_connections.push_back(m_blobserver);
         }
+        if (const auto stats_ms = j_uint32(gdk_config(), "stats_notification_ms").value_or(0); stats_ms) {
+            m_notifications->set_periodic(std::chrono::milliseconds(stats_ms), [this]() -> nlohmann::json {
+                if (!m_notify) {
+                    return {};
+                }
+                return { { "event", "stats" }, { "stats", stats::get() } };
+            });
+        }
     }
 
     session_impl::~session_impl()
     {
+        m_notifications->stop();
         m_blobserver.reset();
         for (auto& connection : m_wamp_connections) {
             no_std_exception_escape(
@@ -100,7 +149,20 @@ namespace green {
                 },
                 "ga_session wamp_transport");
         };
-        no_std_exception_escape([this] { m_strand.reset(); }, "session_impl m_strand");
+        no_std_exception_escape(
+            [this] {
+                if (m_strand->running_in_this_thread()) {
+                    m_strand.reset();
+                    return;
+                }
+                // The shared I/O threads outlive us, and this thread may be
+                // the one that runs the strand, so don't wait on it. Our
+                // transports have already waited for the events they posted:
+                // release the strand once any other queued handlers have run
+                std::shared_ptr<boost::asio::io_context::strand> strand(std::move(m_strand));
+                boost::asio::post(*strand, [strand]() mutable { strand.reset(); });
+            },
+            "session_impl m_strand");
     }
 
     void session_impl::connect()
@@ -136,8 +198,14 @@ namespace green {
 
     void session_impl::set_notification_handler(GA_notification_handler handler, void* context)
     {
-        m_notification_handler = handler;
-        m_notification_context = context;
+        notification_queue::handler_fn_t fn;
+        if (handler) {
+            fn = [handler, context](nlohmann::json details) {
+                // We use 'new' here as it is the handlers responsibility to 'delete'
+                handler(context, reinterpret_cast<GA_json*>(new nlohmann::json(std::move(details))));
+            };
+        }
+        m_notifications->set_handler(std::move(fn));
     }
 
     bool session_impl::set_signer(locker_t& locker, std::shared_ptr<signer> signer)
@@ -154,13 +222,15 @@ namespace green {
 
     void session_impl::disable_notifications() { m_notify = false; }
 
-    void session_impl::emit_notification(nlohmann::json details, bool /*async*/)
+    void session_impl::emit_notification(nlohmann::json details, bool async)
     {
-        // By default, ignore the async flag
-        if (m_notify && m_notification_handler) {
-            // We use 'new' here as it is the handlers responsibility to 'delete'
-            const auto details_p = reinterpret_cast<GA_json*>(new nlohmann::json(std::move(details)));
-            m_notification_handler(m_notification_context, details_p);
+        if (!m_notify) {
+            return;
+        }
+        if (async) {
+            m_notifications->push(std::move(details));
+        } else {
+            m_notifications->deliver(std::move(details));
         }
     }
 
@@ -169,42 +239,201 @@ namespace green {
         const bool is_electrum = m_net_params.is_electrum();
         const auto& action = j_strref(details, "action");
         const auto& data_source = j_strref(details, "data_source");
+        if (data_source == "memory") {
+            if (action != "trim") {
+                throw user_error("Unknown cache control action");
+            }
+            trim_memory();
+            return get_memory_stats();
+        }
+        if (data_source != "client_blob") {
+            throw user_error("Unknown cache control data_source");
+        }
+        if (action == "import") {
+            return import_bip329(details);
+        }
         if (action == "fetch") {
-            if (data_source != "client_blob") {
-                throw user_error("Unknown cache control data_source");
+            // Add the subaccount xpubs after the blob labels
+            const auto xpubs = is_electrum ? get_bip329_xpubs(get_subaccounts()) : nlohmann::json::array_t();
+            if (const auto path = j_str(details, "path"); path) {
+                return { { "count", export_bip329(*path, xpubs) } };
             }
-            auto ret = m_blob->get_bip329();
-            if (is_electrum) {
-                // Add the subaccount xpubs
-                // TODO: Implement for multisig (needs thought/possible BIP changes)
-                for (const auto& sa : get_subaccounts()) {
-                    nlohmann::json sa_json{ { "type", "xpub" }, { "label", j_strref(sa, "name") } };
-                    // We add origin information which is an extention to BIP329,
-                    // which only specifies this field for transactions.
-                    auto descriptor = j_arrayref(sa, "core_descriptors", 2).at(0).get<std::string>();
-                    auto origin = descriptor.substr(0, descriptor.find("]", 0)) + "])";
-                    auto xpub = descriptor.substr(origin.size() - 1);
-                    xpub = xpub.substr(0, xpub.find("/", 0));
-                    sa_json.emplace("ref", std::move(xpub));
-                    if (boost::algorithm::starts_with(origin, "sh(")) {
-                        origin.append(")");
-                    }
-                    sa_json.emplace("origin", std::move(origin));
-                    ret.emplace_back(std::move(sa_json));
+            const auto count = j_uint32(details, "count");
+            if (!count) {
+                // Return all labels
+                locker_t locker(m_mutex);
+                auto ret = m_blob->get_bip329();
+                locker.unlock();
+                ret.insert(ret.end(), xpubs.begin(), xpubs.end());
+                return { { "bip329", std::move(ret) } };
+            }
+            // Return a page of labels
+            GDK_USER_ASSERT(*count != 0, "count must be greater than 0");
+            const size_t offset = j_uint32_or_zero(details, "offset");
+            locker_t locker(m_mutex);
+            const size_t num_blob_labels = m_blob->get_bip329_count();
+            auto ret = m_blob->get_bip329(offset, *count);
+            locker.unlock();
+            for (size_t i = std::max(offset, num_blob_labels); i - num_blob_labels < xpubs.size(); ++i) {
+                if (ret.size() == *count) {
+                    break;
                 }
+                ret.push_back(xpubs[i - num_blob_labels]);
+            }
+            nlohmann::json result = { { "bip329", std::move(ret) } };
+            if (offset + *count < num_blob_labels + xpubs.size()) {
+                result["next_offset"] = offset + *count;
             }
-            return { { "bip329", std::move(ret) } };
+            return result;
         }
         throw user_error("Unknown cache control action");
         __builtin_unreachable();
     }
 
+    nlohmann::json session_impl::get_memory_stats()
+    {
+        nlohmann::json ret = { { "notification_queue_depth", m_notifications->size() },
+            { "tx_cache_entries", m_tx_cache->size() } };
+
+        std::vector<utxo_cache_value_t> values; // Sized outside of the lock
+        {
+            locker_t locker(m_utxo_cache_mutex);
+            values.reserve(m_utxo_cache.size() * 3);
+            for (const auto& entry : m_utxo_cache) {
+                values.push_back(entry.second.utxos);
+                values.push_back(entry.second.balance);
+                values.push_back(entry.second.all_coins_balance);
+            }
+        }
+        size_t utxo_bytes = 0;
+        for (const auto& value : values) {
+            utxo_bytes += value ? j_estimated_size(*value) : 0;
+        }
+        ret["utxo_cache"] = { { "entries", values.size() / 3 }, { "estimated_bytes", utxo_bytes } };
+
+        {
+            locker_t locker(m_mutex);
+            ret["client_blob_bytes"] = m_blob->get_memory_size();
+        }
+
+        size_t num_xpubs = 0, xpub_bytes = 0;
+        if (auto signer = get_signer(); signer) {
+            for (const auto& xpub : signer->get_cached_bip32_xpubs()) {
+                ++num_xpubs;
+                xpub_bytes += xpub.first.size() * sizeof(uint32_t) + xpub.second.size();
+            }
+        }
+        ret["signer_xpub_cache"] = { { "entries", num_xpubs }, { "bytes", xpub_bytes } };
+
+        if (m_net_params.is_liquid()) {
+            // The registry is shared by all sessions in the process
+            try {
+                ret["asset_registry"] = rust_call("registry_memory_stats", nlohmann::json::object());
+            } catch (const std::exception& ex) {
+                GDK_LOG(warning) << "error fetching registry memory stats: " << ex.what();
+            }
+        }
+        return ret;
+    }
+
+    void session_impl::trim_memory()
+    {
+        remove_cached_utxos(std::vector<uint32_t>());
+        m_tx_cache->clear();
+        if (m_net_params.is_liquid()) {
+            try {
+                rust_call("trim_registry", nlohmann::json::object());
+            } catch (const std::exception& ex) {
+                GDK_LOG(warning) << "error trimming registry: " << ex.what();
+            }
+        }
+    }
+
+    size_t session_impl::export_bip329(const std::string& path, const nlohmann::json::array_t& extra_labels)
+    {
+        std::ofstream f(path, std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+        GDK_USER_ASSERT(f.is_open(), "Unable to open BIP329 export file");
+        size_t num_written = 0;
+        std::string output, last_ref;
+        for (;;) {
+            // Copy a batch of labels under the lock and write it outside of
+            // it. Paging by ref finds each batch directly, and doesn't skip
+            // or repeat labels if others are added or removed meanwhile
+            locker_t locker(m_mutex);
+            const auto items = m_blob->get_bip329_after(last_ref, BIP329_EXPORT_BATCH_SIZE);
+            locker.unlock();
+            if (items.empty()) {
+                break;
+            }
+            last_ref = j_strref(items.back(), "ref");
+            append_jsonl(output, items);
+            f.write(output.data(), output.size());
+            output.clear();
+            num_written += items.size();
+            if (items.size() < BIP329_EXPORT_BATCH_SIZE) {
+                break;
+            }
+        }
+        append_jsonl(output, extra_labels);
+        f.write(output.data(), output.size());
+        num_written += extra_labels.size();
+        f.flush();
+        GDK_USER_ASSERT(f.good(), "Unable to write BIP329 export file");
+        return num_written;
+    }
+
+    nlohmann::json session_impl::import_bip329(const nlohmann::json& details)
+    {
+        nlohmann::json memos = nlohmann::json::object();
+        size_t num_skipped = 0;
+        auto&& add_label = [&memos, &num_skipped](const nlohmann::json& label) {
+            // Only transaction labels are stored in the client blob
+            const auto ref = j_str_or_empty(label, "ref");
+            const auto text = j_str(label, "label");
+            if (j_str_or_empty(label, "type") != "tx" || !text || !validate_hex(ref, SHA256_LEN)) {
+                ++num_skipped;
+                return;
+            }
+            memos[ref] = *text; // Later labels for the same tx take precedence
+        };
+
+        if (const auto path = j_str(details, "path"); path) {
+            std::ifstream f(*path, std::ifstream::in | std::ifstream::binary);
+            GDK_USER_ASSERT(f.is_open(), "Unable to open BIP329 import file");
+            std::string line;
+            while (std::getline(f, line)) {
+                if (!line.empty() && line.back() == '\r') {
+                    line.pop_back();
+                }
+                if (!line.empty()) {
+                    add_label(json_parse(line));
+                }
+            }
+            GDK_USER_ASSERT(f.eof(), "Unable to read BIP329 import file");
+        } else {
+            for (const auto& label : j_arrayref(details, "bip329")) {
+                add_label(label);
+            }
+        }
+
+        const size_t num_imported = memos.size();
+        if (num_imported) {
+            set_transaction_memos({ { "memos", std::move(memos) } });
+        }
+        return { { "imported", num_imported }, { "skipped", num_skipped } };
+    }
+
     nlohmann::json session_impl::http_request(nlohmann::json params)
     {
         GDK_RUNTIME_ASSERT_MSG(!params.contains("proxy"), "http_request: proxy is not supported");
         const auto proxy_settings = get_proxy_settings();
         params.update(select_url(params["urls"], proxy_settings["use_tor"]));
         params["proxy"] = proxy_settings["proxy"];
+        if (m_tor_ctrl && !j_strref(params, "proxy").empty()) {
+            // Spread requests over isolated, prebuilt circuits per destination
+            const auto destination = j_strref(params, "host") + ':' + j_strref(params, "port");
+            params["socks_isolation"] = m_tor_ctrl->get_socks_isolation(destination, j_strref(params, "proxy"));
+        }
 
         nlohmann::json result;
         try {
@@ -220,23 +449,79 @@ namespace green {
             }
 
             const bool is_secure = params["is_secure"];
-            std::shared_ptr<boost::asio::ssl::context> ssl_ctx;
-            if (is_secure) {
-                ssl_ctx = tls_init(params["host"], root_certificates, {}, m_net_params.cert_expiry_threshold());
-            }
+            const auto verb = boost::beast::http::string_to_verb(params["method"]);
+            const auto threshold = m_net_params.cert_expiry_threshold();
+            auto& pool = http_client_pool::get();
 
-            std::shared_ptr<http_client> client;
             auto&& get = [&] {
-                client = make_http_client(m_io.get_io_context(), ssl_ctx.get());
+                // Connections are pooled by everything used to establish them
+                std::string key = params["host"].get<std::string>() + ':' + params["port"].get<std::string>() + '|'
+                    + params["proxy"].get<std::string>() + '|' + std::to_string(threshold);
+                if (is_secure) {
+                    std::string roots;
+                    for (const auto& root : root_certificates) {
+                        roots += root;
+                    }
+                    key += '|' + b2h(sha256(ustring_span(roots)));
+                }
+
+                // Only requests that are safe to repeat use pooled connections,
+                // since a stale connection is only detected after sending
+                const bool can_retry
+                    = verb == boost::beast::http::verb::get || verb == boost::beast::http::verb::head;
+                std::shared_ptr<http_client> client;
+                std::shared_ptr<boost::asio::ssl::context> ssl_ctx;
+                if (can_retry) {
+                    std::tie(client, ssl_ctx) = pool.acquire(key);
+                }
+                if (client) {
+                    try {
+                        auto ret = client->request(verb, params).get();
+                        pool.release(key, std::move(client), std::move(ssl_ctx));
+                        return ret;
+                    } catch (const std::exception& ex) {
+                        // The server may have closed the idle connection:
+                        // retry once using a new connection
+                        GDK_LOG(info) << "http_request: retrying on a new connection: " << ex.what();
+                    }
+                }
+
+                if (is_secure) {
+                    ssl_ctx = tls_init(params["host"], root_certificates, {}, threshold);
+                } else {
+                    ssl_ctx.reset();
+                }
+                // HTTP clients run on their own strand, so may use any pool thread
+                client = make_http_client(gdk_io_context(), ssl_ctx.get());
                 GDK_RUNTIME_ASSERT(client != nullptr);
+                client->set_tls_session(pool.get_tls_session(key));
+                auto ret = client->request(verb, params).get();
+                pool.release(key, std::move(client), std::move(ssl_ctx));
+                return ret;
+            };
 
-                const auto verb = boost::beast::http::string_to_verb(params["method"]);
-                return client->request(verb, params).get();
+            // Requests are recorded/replayed by method and URL, in order
+            const auto recording = transport_recording::get(m_net_params, "http");
+            auto&& recorded_get = [&] {
+                const auto start = std::chrono::steady_clock::now();
+                const auto name = params["method"].get<std::string>() + ' ' + params["host"].get<std::string>() + ':'
+                    + params["port"].get<std::string>() + params["target"].get<std::string>();
+                if (recording->is_replay()) {
+                    return recording->replay("http", name, start);
+                }
+                try {
+                    auto ret = get();
+                    recording->record("http", name, std::chrono::steady_clock::now() - start, ret, false);
+                    return ret;
+                } catch (const std::exception& ex) {
+                    recording->record("http", name, std::chrono::steady_clock::now() - start, ex.what(), true);
+                    throw;
+                }
             };
 
             constexpr uint8_t num_redirects = 5;
             for (uint8_t i = 0; i < num_redirects; ++i) {
-                result = get();
+                result = recording ? recorded_get() : get();
                 if (!result.value("location", std::string{}).empty()) {
                     GDK_RUNTIME_ASSERT_MSG(!m_net_params.use_tor(), "redirection over Tor is not supported");
                     params.update(parse_url(result["location"]));
@@ -617,7 +902,8 @@ namespace green {
     void session_impl::subscribe_all(session_impl::locker_t& locker)
     {
         GDK_RUNTIME_ASSERT(locker.owns_lock());
-        if (!m_blobserver || m_blob->get_server_has_failure()) {
+        if (!m_blobserver || m_blob->get_server_has_failure()
+            || !m_net_params.is_subscribed(network_parameters::SUBSCRIBE_BLOB)) {
             return;
         }
         const auto blob_feed = "blob.update." + m_blob->get_client_id();
@@ -733,6 +1019,23 @@ namespace green {
         // Overriden for ga_rust
     }
 
+    void session_impl::emit_session_snapshot(std::shared_ptr<signer> /*signer*/)
+    {
+        // Overriden for ga_session
+    }
+
+    std::vector<nlohmann::json> session_impl::get_receive_addresses(const nlohmann::json& details)
+    {
+        // Overriden for ga_session
+        const size_t count = j_uint32ref(details, "count");
+        std::vector<nlohmann::json> addresses;
+        addresses.reserve(count);
+        while (addresses.size() < count) {
+            addresses.emplace_back(get_receive_address(details));
+        }
+        return addresses;
+    }
+
     nlohmann::json session_impl::get_subaccounts()
     {
         // TODO: implement refreshing for multisig
@@ -785,6 +1088,24 @@ namespace green {
         return false;
     }
 
+    std::vector<bool> session_impl::discover_subaccounts(const nlohmann::json::array_t& subaccounts)
+    {
+        // Overriden for ga_rust
+        std::vector<bool> discovered;
+        discovered.reserve(subaccounts.size());
+        std::set<std::string> stopped_types;
+        for (const auto& sa : subaccounts) {
+            const auto& sa_type = j_strref(sa, "type");
+            const bool is_discovered = !stopped_types.count(sa_type)
+                && discover_subaccount(j_uint32ref(sa, "subaccount"), j_strref(sa, "xpub"), sa_type);
+            if (!is_discovered) {
+                stopped_types.insert(sa_type);
+            }
+            discovered.push_back(is_discovered);
+        }
+        return discovered;
+    }
+
     uint32_t session_impl::get_last_empty_subaccount(const std::string& /*sa_type*/)
     {
         // Overriden for ga_rust
@@ -797,7 +1118,7 @@ namespace green {
         return false; // No caching by default, so return 'not updated'
     }
 
-    void session_impl::encache_new_scriptpubkeys(uint32_t /*subaccount*/)
+    void session_impl::encache_new_scriptpubkeys(const std::vector<uint32_t>& /*subaccounts*/)
     {
         // Overriden for multisig
     }
@@ -810,11 +1131,64 @@ namespace green {
         return nlohmann::json();
     }
 
+    std::shared_ptr<const Tx> session_impl::get_raw_transaction(const std::string& txhash_hex) const
+    {
+        if (auto tx = m_tx_cache->get(txhash_hex); tx) {
+            return *tx;
+        }
+        auto tx = std::make_shared<const Tx>(get_raw_transaction_details(txhash_hex));
+        m_tx_cache->insert(txhash_hex, tx);
+        return tx;
+    }
+
+    std::vector<std::shared_ptr<const Tx>> session_impl::get_raw_transactions(
+        const std::vector<std::string>& txhashes) const
+    {
+        std::vector<std::shared_ptr<const Tx>> ret(txhashes.size());
+        std::vector<std::string> missing;
+        for (size_t i = 0; i < txhashes.size(); ++i) {
+            ret[i] = m_tx_cache->get(txhashes[i]).value_or(nullptr);
+            if (!ret[i]) {
+                missing.push_back(txhashes[i]);
+            }
+        }
+        if (missing.empty()) {
+            return ret;
+        }
+        std::sort(missing.begin(), missing.end());
+        missing.erase(std::unique(missing.begin(), missing.end()), missing.end());
+
+        auto txs = get_raw_transactions_impl(missing);
+        GDK_RUNTIME_ASSERT(txs.size() == missing.size());
+        std::map<std::string, std::shared_ptr<const Tx>, std::less<>> fetched;
+        for (size_t i = 0; i < missing.size(); ++i) {
+            auto tx = std::make_shared<const Tx>(std::move(txs[i]));
+            m_tx_cache->insert(missing[i], tx);
+            fetched.emplace(std::move(missing[i]), std::move(tx));
+        }
+        for (size_t i = 0; i < txhashes.size(); ++i) {
+            if (!ret[i]) {
+                ret[i] = fetched.at(txhashes[i]);
+            }
+        }
+        return ret;
+    }
+
+    std::vector<Tx> session_impl::get_raw_transactions_impl(const std::vector<std::string>& txhashes) const
+    {
+        std::vector<Tx> ret;
+        ret.reserve(txhashes.size());
+        for (const auto& txhash_hex : txhashes) {
+            ret.emplace_back(get_raw_transaction_details(txhash_hex));
+        }
+        return ret;
+    }
+
     nlohmann::json session_impl::get_transaction_details(const std::string& txhash_hex) const
     {
-        const auto tx = get_raw_transaction_details(txhash_hex);
+        const auto tx = get_raw_transaction(txhash_hex);
         nlohmann::json ret = { { "txhash", txhash_hex } };
-        update_tx_size_info(m_net_params, tx, ret);
+        update_tx_size_info(m_net_params, *tx, ret);
         return ret;
     }
 
@@ -838,16 +1212,30 @@ namespace green {
         }
     }
 
-    session_impl::utxo_cache_value_t session_impl::get_cached_utxos(uint32_t subaccount, uint32_t num_confs) const
+    session_impl::cached_utxos_t session_impl::get_cached_utxos(uint32_t subaccount, uint32_t num_confs) const
     {
         locker_t locker(m_utxo_cache_mutex);
         // FIXME: If we have no unconfirmed txs, 0 and 1 conf results are
         // identical, so we could share 0 & 1 conf storage
         auto p = m_utxo_cache.find({ subaccount, num_confs });
-        return p == m_utxo_cache.end() ? utxo_cache_value_t() : p->second;
+        if (p == m_utxo_cache.end()) {
+            return {};
+        }
+        return { p->second.utxos, p->second.index };
     }
 
-    session_impl::utxo_cache_value_t session_impl::set_cached_utxos(
+    session_impl::utxo_cache_value_t session_impl::get_cached_balance(
+        uint32_t subaccount, uint32_t num_confs, bool all_coins) const
+    {
+        locker_t locker(m_utxo_cache_mutex);
+        auto p = m_utxo_cache.find({ subaccount, num_confs });
+        if (p == m_utxo_cache.end()) {
+            return utxo_cache_value_t();
+        }
+        return all_coins ? p->second.all_coins_balance : p->second.balance;
+    }
+
+    session_impl::cached_utxos_t session_impl::set_cached_utxos(
         uint32_t subaccount, uint32_t num_confs, nlohmann::json& utxos)
     {
         // Convert null UTXOs into an empty element
@@ -856,10 +1244,13 @@ namespace green {
             outputs = nlohmann::json::object();
         }
         // Encache
+        utxo_cache_entry_t entry{ std::make_shared<nlohmann::json>(std::move(utxos)), {}, {}, {} };
+        update_utxo_cache_indices(entry);
+        cached_utxos_t result{ entry.utxos, entry.index };
         locker_t locker(m_utxo_cache_mutex);
-        auto entry = std::make_shared<const nlohmann::json>(std::move(utxos));
-        m_utxo_cache[std::make_pair(subaccount, num_confs)] = entry;
-        return entry;
+        std::swap(m_utxo_cache[std::make_pair(subaccount, num_confs)], entry);
+        locker.unlock(); // Delete any previous entry outside of lock
+        return result;
     }
 
     void session_impl::remove_cached_utxos(const std::vector<uint32_t>& subaccounts)
@@ -875,7 +1266,7 @@ namespace green {
                 // Remove all entries for affected subaccounts
                 for (auto p = m_utxo_cache.begin(); p != m_utxo_cache.end(); /* no-op */) {
                     if (std::find(subaccounts.begin(), subaccounts.end(), p->first.first) != subaccounts.end()) {
-                        tmp_values.push_back(p->second);
+                        tmp_values.push_back(p->second.utxos);
                         m_utxo_cache.erase(p++);
                     } else {
                         ++p;
@@ -885,6 +1276,43 @@ namespace green {
         }
     }
 
+    void session_impl::update_cached_utxos(const utxo_patch_fn_t& fn)
+    {
+        std::vector<utxo_cache_value_t> tmp_values; // Delete outside of lock
+        locker_t locker(m_utxo_cache_mutex);
+        for (auto p = m_utxo_cache.begin(); p != m_utxo_cache.end(); /* no-op */) {
+            if (!patch_utxo_cache_entry(p->second, fn)) {
+                tmp_values.push_back(p->second.utxos);
+                m_utxo_cache.erase(p++);
+            } else {
+                ++p;
+            }
+        }
+    }
+
+    bool session_impl::patch_utxo_cache_entry(utxo_cache_entry_t& entry, const utxo_patch_fn_t& fn)
+    {
+        if (entry.utxos.use_count() != 1) {
+            // A caller is still reading the current value: copy on write.
+            // Callers take their reference under the lock, so this is safe
+            entry.utxos = std::make_shared<nlohmann::json>(*entry.utxos);
+        }
+        if (!fn(*entry.utxos)) {
+            return false;
+        }
+        update_utxo_cache_indices(entry);
+        return true;
+    }
+
+    void session_impl::update_utxo_cache_indices(utxo_cache_entry_t& entry)
+    {
+        const auto& outputs = entry.utxos->at("unspent_outputs");
+        entry.balance = std::make_shared<const nlohmann::json>(get_utxo_balances(outputs, false));
+        entry.all_coins_balance = std::make_shared<const nlohmann::json>(get_utxo_balances(outputs, true));
+        // Sort once here rather than on every query of these UTXOs
+        entry.index = std::make_shared<const utxo_index>(outputs);
+    }
+
     void session_impl::process_unspent_outputs(nlohmann::json& /*utxos*/)
     {
         // Only needed for multisig until singlesig supports HWW
@@ -946,6 +1374,17 @@ namespace green {
         return j_bool_or_false(m_login_data, "reset_2fa_active");
     }
 
+    nlohmann::json session_impl::convert_amounts(const nlohmann::json& details) const
+    {
+        nlohmann::json::array_t amounts;
+        const auto& amounts_json = j_arrayref(details, "amounts");
+        amounts.reserve(amounts_json.size());
+        for (const auto& amount_json : amounts_json) {
+            amounts.emplace_back(convert_amount(amount_json));
+        }
+        return { { "amounts", std::move(amounts) } };
+    }
+
     nlohmann::json session_impl::get_spending_limits() const
     {
         // Singlesig does not support spending limits. Overridden for multisig.
@@ -1011,11 +1450,27 @@ namespace green {
         return nlohmann::json();
     }
 
+    nlohmann::json session_impl::sync_transactions(const std::vector<uint32_t>& subaccounts,
+        unique_pubkeys_and_scripts_t& missing, const std::map<uint32_t, uint64_t>& /*sync_from*/)
+    {
+        nlohmann::json pages = nlohmann::json::object();
+        for (const auto subaccount : subaccounts) {
+            pages[std::to_string(subaccount)] = sync_transactions(subaccount, missing);
+        }
+        return pages;
+    }
+
     void session_impl::store_transactions(uint32_t /*subaccount*/, nlohmann::json& /*txs*/)
     {
         // Overriden for multisig
     }
 
+    nlohmann::json session_impl::search_transactions(const nlohmann::json& /*details*/)
+    {
+        // Overriden for multisig
+        throw_user_error("Transaction search is not supported for this session type");
+    }
+
     void session_impl::postprocess_transactions(nlohmann::json& tx_list)
     {
         // Set tx memos in the returned txs from the blob cache
@@ -1051,6 +1506,23 @@ namespace green {
         update_client_blob(locker, std::bind(&client_blob::set_tx_memo, m_blob.get(), txhash_hex, memo));
     }
 
+    void session_impl::set_transaction_memos(const nlohmann::json& details)
+    {
+        const auto& memos = j_ref(details, "memos");
+        GDK_RUNTIME_ASSERT_MSG(memos.is_object(), "memos must be an object");
+        for (const auto& m : memos.items()) {
+            GDK_RUNTIME_ASSERT_MSG(m.value().is_string(), "Transaction memo must be a string");
+            check_tx_memo(m.value().get_ref<const std::string&>());
+        }
+        locker_t locker(m_mutex);
+        if (m_watch_only || is_twofactor_reset_active(locker)) {
+            throw user_error(m_watch_only ? "Authentication required" : res::id_2fa_reset_in_progress);
+        }
+        // Apply all memos in one update, so the blob is saved once. If the
+        // save races with another session, only these memos are re-applied
+        update_client_blob(locker, [this, &memos] { return m_blob->update_tx_memos(memos); });
+    }
+
     std::vector<unsigned char> session_impl::output_script_from_utxo(const nlohmann::json& utxo)
     {
         locker_t locker(m_mutex);
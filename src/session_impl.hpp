@@ -3,6 +3,9 @@
 #pragma once
 
 #include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <map>
 #include <mutex>
 #include <set>
 #include <thread>
@@ -10,7 +13,9 @@
 #include "amount.hpp"
 #include "ga_wally.hpp"
 #include "io_runner.hpp"
+#include "lru_cache.hpp"
 #include "network_parameters.hpp"
+#include "threading.hpp"
 
 namespace green {
 
@@ -21,15 +26,30 @@ namespace green {
     class green_pubkeys;
     class user_pubkeys;
     class green_recovery_pubkeys;
+    class notification_queue;
     class signer;
     class Tx;
     struct tor_controller;
+    struct utxo_index;
     class wamp_transport;
     class xpub_hdkey;
 
+    // Cache of parsed transactions, keyed by txhash. Cached txs are
+    // immutable and may be shared between callers
+    using tx_cache = lru_cache<std::string, std::shared_ptr<const Tx>>;
+
     class session_impl {
     public:
+#ifdef GDK_PROFILE_LOCKS
+        // Record wait and hold times of the session mutexes in the stats
+        using mutex_t = profiled_mutex;
+        using locker_t = profiled_lock;
+        using condition_t = std::condition_variable_any;
+#else
+        using mutex_t = std::mutex;
         using locker_t = std::unique_lock<std::mutex>;
+        using condition_t = std::condition_variable;
+#endif
 
         explicit session_impl(network_parameters&& net_params);
         session_impl(const session_impl& other) = delete;
@@ -44,13 +64,24 @@ namespace green {
 
         // UTXOs
         using utxo_cache_value_t = std::shared_ptr<const nlohmann::json>;
+        // Cached UTXOs with their index. The index refers to these UTXOs
+        struct cached_utxos_t {
+            utxo_cache_value_t utxos;
+            std::shared_ptr<const utxo_index> index;
+        };
 
         // Lookup cached UTXOs
-        utxo_cache_value_t get_cached_utxos(uint32_t subaccount, uint32_t num_confs) const;
+        cached_utxos_t get_cached_utxos(uint32_t subaccount, uint32_t num_confs) const;
         // Encache UTXOs. Takes ownership of utxos, returns the encached value
-        utxo_cache_value_t set_cached_utxos(uint32_t subaccount, uint32_t num_confs, nlohmann::json& utxos);
+        cached_utxos_t set_cached_utxos(uint32_t subaccount, uint32_t num_confs, nlohmann::json& utxos);
+        // Lookup the cached balance of unfiltered UTXOs, as an asset id to
+        // satoshi map. Frozen UTXOs are included only if all_coins is true.
+        utxo_cache_value_t get_cached_balance(uint32_t subaccount, uint32_t num_confs, bool all_coins) const;
         // Un-encache UTXOs
         void remove_cached_utxos(const std::vector<uint32_t>& subaccounts);
+        // Apply fn to all cached UTXOs. fn returning false removes the entry.
+        using utxo_patch_fn_t = std::function<bool(nlohmann::json& utxos)>;
+        void update_cached_utxos(const utxo_patch_fn_t& fn);
 
         virtual nlohmann::json get_unspent_outputs(const nlohmann::json& details, unique_pubkeys_and_scripts_t& missing)
             = 0;
@@ -65,6 +96,7 @@ namespace green {
         // Disable notifications from being delivered
         void disable_notifications();
         // Call the users registered notification handler. Must be called without any locks held.
+        // Async notifications are queued and delivered from the notification thread.
         virtual void emit_notification(nlohmann::json details, bool async);
         std::string connect_tor();
         void reconnect();
@@ -89,6 +121,8 @@ namespace green {
         virtual void start_sync_threads();
         virtual std::vector<uint32_t> get_subaccount_pointers() = 0;
         virtual std::string get_challenge(const pub_key_t& public_key) = 0;
+        // Emit the state saved by the last login of signer's wallet before authenticating
+        virtual void emit_session_snapshot(std::shared_ptr<signer> signer);
         virtual nlohmann::json authenticate(const std::string& sig_der_hex, std::shared_ptr<signer> signer) = 0;
         virtual void register_subaccount_xpubs(
             const std::vector<uint32_t>& pointers, const std::vector<std::string>& bip32_xpubs)
@@ -102,6 +136,10 @@ namespace green {
 
         // Returns true if the subaccount was discovered
         virtual bool discover_subaccount(uint32_t subaccount, const std::string& xpub, const std::string& sa_type);
+        // Discover several subaccounts given as {"subaccount", "xpub", "type"},
+        // with those of each type in increasing order. Returns whether each was
+        // discovered; discovery of a type stops at its first undiscovered subaccount
+        virtual std::vector<bool> discover_subaccounts(const nlohmann::json::array_t& subaccounts);
         virtual uint32_t get_next_subaccount(const std::string& sa_type) = 0;
         virtual uint32_t get_last_empty_subaccount(const std::string& sa_type);
         virtual nlohmann::json create_subaccount(nlohmann::json details, uint32_t subaccount, const std::string& xpub)
@@ -110,7 +148,14 @@ namespace green {
         virtual void change_settings_limits(const nlohmann::json& limit_details, const nlohmann::json& twofactor_data)
             = 0;
         virtual nlohmann::json get_transactions(const nlohmann::json& details) = 0;
+        // Search the txs synced to the local cache
+        virtual nlohmann::json search_transactions(const nlohmann::json& details);
         virtual nlohmann::json sync_transactions(uint32_t subaccount, unique_pubkeys_and_scripts_t& missing);
+        // Sync a page of txs for each subaccount, returned keyed by subaccount.
+        // Subaccounts in sync_from are synced from the given timestamp rather
+        // than their latest cached tx, to read ahead of pages not yet stored
+        virtual nlohmann::json sync_transactions(const std::vector<uint32_t>& subaccounts,
+            unique_pubkeys_and_scripts_t& missing, const std::map<uint32_t, uint64_t>& sync_from);
         virtual void store_transactions(uint32_t subaccount, nlohmann::json& txs);
         virtual void postprocess_transactions(nlohmann::json& tx_list);
         void check_tx_memo(const std::string& memo) const;
@@ -118,6 +163,8 @@ namespace green {
         virtual void set_notification_handler(GA_notification_handler handler, void* context);
 
         virtual nlohmann::json get_receive_address(const nlohmann::json& details) = 0;
+        // Get details["count"] new receive addresses, in address order
+        virtual std::vector<nlohmann::json> get_receive_addresses(const nlohmann::json& details);
         virtual nlohmann::json get_previous_addresses(const nlohmann::json& details) = 0;
         virtual nlohmann::json get_subaccounts();
         nlohmann::json get_subaccount(uint32_t subaccount);
@@ -165,7 +212,7 @@ namespace green {
 
         virtual bool encache_blinding_data(const std::string& pubkey_hex, const std::string& script_hex,
             const std::string& nonce_hex, const std::string& blinding_pubkey_hex);
-        virtual void encache_new_scriptpubkeys(uint32_t subaccount);
+        virtual void encache_new_scriptpubkeys(const std::vector<uint32_t>& subaccounts);
         virtual nlohmann::json get_scriptpubkey_data(byte_span_t scriptpubkey);
         virtual nlohmann::json get_address_data(const nlohmann::json& details);
         virtual void upload_confidential_addresses(
@@ -173,6 +220,13 @@ namespace green {
             = 0;
 
         virtual Tx get_raw_transaction_details(const std::string& txhash_hex) const = 0;
+        // Fetch txs that are not held in memory. The default fetches each in turn
+        virtual std::vector<Tx> get_raw_transactions_impl(const std::vector<std::string>& txhashes) const;
+        // Get a transaction by txhash. Recently used txs are returned from
+        // memory without re-fetching or re-parsing them
+        std::shared_ptr<const Tx> get_raw_transaction(const std::string& txhash_hex) const;
+        // As get_raw_transaction, for many txs. Txs not in memory are fetched together
+        std::vector<std::shared_ptr<const Tx>> get_raw_transactions(const std::vector<std::string>& txhashes) const;
         nlohmann::json get_transaction_details(const std::string& txhash_hex) const;
 
         virtual nlohmann::json service_sign_transaction(const nlohmann::json& details,
@@ -186,6 +240,7 @@ namespace green {
         virtual void set_nlocktime(const nlohmann::json& locktime_details, const nlohmann::json& twofactor_data) = 0;
 
         virtual void set_transaction_memo(const std::string& txhash_hex, const std::string& memo);
+        virtual void set_transaction_memos(const nlohmann::json& details);
 
         virtual nlohmann::json get_fee_estimates() = 0;
 
@@ -195,8 +250,13 @@ namespace green {
         virtual void ack_system_message(const std::string& message_hash_hex, const std::string& sig_der_hex) = 0;
 
         nlohmann::json cache_control(const nlohmann::json& details);
+        // Get the memory used by the sessions caches
+        virtual nlohmann::json get_memory_stats();
+        // Release cached data that can be re-fetched or recomputed
+        virtual void trim_memory();
 
         virtual nlohmann::json convert_amount(const nlohmann::json& amount_json) const = 0;
+        virtual nlohmann::json convert_amounts(const nlohmann::json& details) const;
 
         virtual amount get_min_fee_rate() const = 0;
         virtual amount get_default_fee_rate() const = 0;
@@ -281,6 +341,12 @@ namespace green {
         // Repeatedly re-tries the update if the blob was altered elsewhere.
         void update_client_blob(locker_t& locker, std::function<bool()> update_fn);
 
+        // Write the client blob's BIP329 labels and the given extra labels to
+        // path in JSON Lines format, returning the number of labels written
+        size_t export_bip329(const std::string& path, const nlohmann::json::array_t& extra_labels);
+        // Merge BIP329 transaction labels into the client blob with a single update
+        nlohmann::json import_bip329(const nlohmann::json& details);
+
         // Called when we are notified of a client blob update
         void on_client_blob_updated(nlohmann::json event);
 
@@ -297,19 +363,20 @@ namespace green {
         virtual nlohmann::json get_subaccounts_impl(locker_t& locker) = 0;
 
         // ** Under no circumstances must this mutex ever be made recursive **
-        mutable std::mutex m_mutex;
+        mutable mutex_t m_mutex;
 
         // Immutable upon construction
         const network_parameters m_net_params;
-        io_runner<1> m_io;
+        // From the shared gdk I/O pool; all handlers for this session are
+        // serialized through m_strand
+        boost::asio::io_context& m_io;
         std::unique_ptr<boost::asio::io_context::strand> m_strand;
 
         const std::string m_user_proxy;
         std::shared_ptr<tor_controller> m_tor_ctrl;
 
-        // Immutable once set by the caller (prior to connect)
-        GA_notification_handler m_notification_handler;
-        void* m_notification_context;
+        // Delivers notifications to the handler set by the caller
+        std::unique_ptr<notification_queue> m_notifications;
 
         // Immutable post-login
         nlohmann::json m_login_data;
@@ -326,12 +393,25 @@ namespace green {
         // Current client blob
         std::unique_ptr<client_blob> m_blob;
 
+        // Recently fetched transactions
+        std::unique_ptr<tx_cache> m_tx_cache;
+
         // UTXOs
         // Cached UTXOs are unfiltered; if using the cached values you
         // may need to filter them first (e.g. to removed expired or frozen UTXOS)
         using utxo_cache_key_t = std::pair<uint32_t, uint32_t>; // subaccount, num_confs
-        using utxo_cache_t = std::map<utxo_cache_key_t, utxo_cache_value_t>;
-        mutable std::mutex m_utxo_cache_mutex;
+        struct utxo_cache_entry_t {
+            std::shared_ptr<nlohmann::json> utxos;
+            // Balances and sort orders of utxos, maintained as they change
+            utxo_cache_value_t balance;
+            utxo_cache_value_t all_coins_balance;
+            std::shared_ptr<const utxo_index> index;
+        };
+        using utxo_cache_t = std::map<utxo_cache_key_t, utxo_cache_entry_t>;
+        // Patch an entry in place, copying it first if it is being read
+        static bool patch_utxo_cache_entry(utxo_cache_entry_t& entry, const utxo_patch_fn_t& fn);
+        static void update_utxo_cache_indices(utxo_cache_entry_t& entry);
+        mutable mutex_t m_utxo_cache_mutex;
         utxo_cache_t m_utxo_cache;
 
         std::vector<std::shared_ptr<wamp_transport>> m_wamp_connections;
@@ -1,3 +1,5 @@
+#include <map>
+
 #include "signer.hpp"
 #include "containers.hpp"
 #include "exception.hpp"
@@ -5,17 +7,34 @@
 #include "json_utils.hpp"
 #include "memory.hpp"
 #include "network_parameters.hpp"
+#include "threading.hpp"
 #include "utils.hpp"
 
 namespace green {
 
     namespace {
-        static wally_ext_key_ptr derive(
-            const wally_ext_key_ptr& hdkey, uint32_span_t path, uint32_t flags = BIP32_FLAG_KEY_PRIVATE)
+        static secure_ext_key_ptr derive(
+            const secure_ext_key_ptr& hdkey, uint32_span_t path, uint32_t flags = BIP32_FLAG_KEY_PRIVATE)
         {
-            // FIXME: Private keys should be derived into mlocked memory
             GDK_RUNTIME_ASSERT(hdkey);
-            return bip32_key_from_parent_path_alloc(hdkey, path, flags | BIP32_FLAG_SKIP_HASH);
+            auto derived = make_secure_unique<struct ext_key>();
+            GDK_VERIFY(::bip32_key_from_parent_path(
+                hdkey.get(), path.data(), path.size(), flags | BIP32_FLAG_SKIP_HASH, derived.get()));
+            return derived;
+        }
+
+        static ec_sig_t schnorr_sign_impl(const struct ext_key& derived, byte_span_t message)
+        {
+            const auto priv_key = gsl::make_span(derived.priv_key).subspan(1);
+            // Apply the taptweak to the private key.
+            // As we don't support script path spending we pass a null merkle_root
+            std::array<unsigned char, EC_PRIVATE_KEY_LEN> tweaked;
+            constexpr uint32_t flags = 0;
+            GDK_VERIFY(wally_ec_private_key_bip341_tweak(
+                priv_key.data(), priv_key.size(), nullptr, 0, flags, tweaked.data(), tweaked.size()));
+            auto ret = ec_sig_from_bytes(tweaked, message, EC_FLAG_SCHNORR);
+            wally_bzero(tweaked.data(), tweaked.size());
+            return ret;
         }
 
         static nlohmann::json get_credentials_json(const nlohmann::json& credentials)
@@ -163,21 +182,17 @@ namespace green {
         }
 
         if (const auto seed_hex = j_str(m_credentials, "seed"); seed_hex) {
-            // FIXME: Allocate m_master_key in mlocked memory
-            std::vector<unsigned char> seed = h2b(*seed_hex);
+            secure_bytes_t seed(seed_hex->size() / 2);
+            size_t written;
+            GDK_VERIFY(wally_hex_to_bytes(seed_hex->c_str(), seed.data(), seed.size(), &written));
+            GDK_RUNTIME_ASSERT(written == seed.size());
             const uint32_t version = m_is_main_net ? BIP32_VER_MAIN_PRIVATE : BIP32_VER_TEST_PRIVATE;
-            m_master_key = bip32_key_from_seed_alloc(seed, version, 0);
+            m_master_key = make_secure_unique<struct ext_key>();
+            GDK_VERIFY(::bip32_key_from_seed(seed.data(), seed.size(), version, 0, m_master_key.get()));
             if (m_is_liquid) {
-                m_master_blinding_key = asset_blinding_key_from_seed(seed);
+                m_master_blinding_key = make_secure_unique<blinding_key_t>();
+                *m_master_blinding_key = asset_blinding_key_from_seed(seed);
             }
-            bzero_and_free(seed);
-        }
-    }
-
-    signer::~signer()
-    {
-        if (m_master_blinding_key) {
-            wally_bzero(m_master_blinding_key->data(), m_master_blinding_key->size());
         }
     }
 
@@ -272,8 +287,8 @@ namespace green {
         if (m_is_liquid) {
             // Return the master blinding key if we have one
             std::unique_lock<std::mutex> locker{ m_mutex };
-            if (m_master_blinding_key.has_value()) {
-                auto key = gsl::make_span(m_master_blinding_key.value());
+            if (m_master_blinding_key) {
+                auto key = gsl::make_span(*m_master_blinding_key);
                 credentials["master_blinding_key"] = b2h(key.last(HMAC_SHA256_LEN));
             }
         }
@@ -415,29 +430,56 @@ namespace green {
     ec_sig_t signer::schnorr_sign(uint32_span_t path, byte_span_t message)
     {
         const auto derived = derive(m_master_key, path);
-        const auto priv_key = gsl::make_span(derived->priv_key).subspan(1);
-        // Apply the taptweak to the private key.
-        // As we don't support script path spending we pass a null merkle_root
-        std::array<unsigned char, EC_PRIVATE_KEY_LEN> tweaked;
-        constexpr uint32_t flags = 0;
-        GDK_VERIFY(wally_ec_private_key_bip341_tweak(
-            priv_key.data(), priv_key.size(), nullptr, 0, flags, tweaked.data(), tweaked.size()));
-        auto ret = ec_sig_from_bytes(tweaked, message, EC_FLAG_SCHNORR);
-        wally_bzero(tweaked.data(), tweaked.size());
-        return ret;
+        return schnorr_sign_impl(*derived, message);
+    }
+
+    std::vector<ec_sig_t> signer::sign(const std::vector<sign_request>& requests)
+    {
+        // Derive each unique parent key once. For wallet inputs this is the
+        // subaccount/branch key, leaving a single child derivation per input
+        std::map<std::vector<uint32_t>, size_t> parent_indices;
+        std::vector<size_t> request_parents(requests.size());
+        std::vector<std::vector<uint32_t>> parent_paths;
+        for (size_t i = 0; i < requests.size(); ++i) {
+            const auto& path = requests[i].path;
+            GDK_RUNTIME_ASSERT(!path.empty());
+            std::vector<uint32_t> parent_path(path.begin(), path.end() - 1);
+            auto p = parent_indices.emplace(std::move(parent_path), parent_paths.size());
+            if (p.second) {
+                parent_paths.push_back(p.first->first);
+            }
+            request_parents[i] = p.first->second;
+        }
+
+        std::vector<secure_ext_key_ptr> parents(parent_paths.size());
+        parallel_for(parent_paths.size(), [&](size_t i) { parents[i] = derive(m_master_key, parent_paths[i]); });
+
+        std::vector<ec_sig_t> sigs(requests.size());
+        parallel_for(requests.size(), [&](size_t i) {
+            const auto& request = requests[i];
+            const std::array<uint32_t, 1> child_path{ request.path.back() };
+            const auto derived = derive(parents[request_parents[i]], child_path);
+            if (request.is_schnorr) {
+                sigs[i] = schnorr_sign_impl(*derived, request.message);
+            } else {
+                const auto priv_key = gsl::make_span(derived->priv_key).subspan(1);
+                sigs[i] = ec_sig_from_bytes(priv_key, request.message);
+            }
+        });
+        return sigs;
     }
 
     bool signer::has_master_blinding_key() const
     {
         std::unique_lock<std::mutex> locker{ m_mutex };
-        return m_master_blinding_key.has_value();
+        return m_master_blinding_key != nullptr;
     }
 
     blinding_key_t signer::get_master_blinding_key() const
     {
         std::unique_lock<std::mutex> locker{ m_mutex };
-        GDK_RUNTIME_ASSERT(m_master_blinding_key.has_value());
-        return m_master_blinding_key.value();
+        GDK_RUNTIME_ASSERT(m_master_blinding_key);
+        return *m_master_blinding_key;
     }
 
     void signer::set_master_blinding_key(const std::string& blinding_key_hex)
@@ -450,14 +492,17 @@ namespace green {
             // Handle both full and half-size blinding keys
             std::copy(key_bytes.begin(), key_bytes.end(), key.begin() + (SHA512_LEN - key_size));
             std::unique_lock<std::mutex> locker{ m_mutex };
-            m_master_blinding_key = key;
+            if (!m_master_blinding_key) {
+                m_master_blinding_key = make_secure_unique<blinding_key_t>();
+            }
+            *m_master_blinding_key = key;
         }
     }
 
     priv_key_t signer::get_blinding_key_from_script(byte_span_t script)
     {
         std::unique_lock<std::mutex> locker{ m_mutex };
-        GDK_RUNTIME_ASSERT(m_master_blinding_key.has_value());
+        GDK_RUNTIME_ASSERT(m_master_blinding_key);
         return asset_blinding_key_to_ec_private_key(*m_master_blinding_key, script);
     }
 
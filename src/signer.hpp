@@ -3,6 +3,7 @@
 #pragma once
 
 #include "ga_wally.hpp"
+#include "memory.hpp"
 #include <mutex>
 #include <nlohmann/json.hpp>
 #include <optional>
@@ -25,6 +26,9 @@ namespace green {
         mandatory = 2 // AE protocol mandatory, vanilla EC sigs not supported
     };
 
+    // An HD key held in secure memory
+    using secure_ext_key_ptr = secure_unique_ptr<struct ext_key>;
+
     //
     // Interface to signing and deriving privately derived xpub keys
     //
@@ -49,7 +53,7 @@ namespace green {
         signer& operator=(const signer&) = delete;
         signer(signer&&) = delete;
         signer& operator=(signer&&) = delete;
-        virtual ~signer();
+        virtual ~signer() = default;
 
         // Returns true if this signers credentials and HW device match 'other'
         bool is_compatible_with(const std::shared_ptr<signer>& other) const;
@@ -135,6 +139,17 @@ namespace green {
         // Return the Schnorr signature for a hash using the taptweak bip32 key 'm/<path>'
         ec_sig_t schnorr_sign(uint32_span_t path, byte_span_t message);
 
+        struct sign_request {
+            std::vector<uint32_t> path;
+            std::vector<unsigned char> message;
+            bool is_schnorr;
+        };
+
+        // Return the signatures for multiple requests, computed in parallel.
+        // Keys whose paths share a parent are derived from that parent,
+        // which is itself derived only once.
+        std::vector<ec_sig_t> sign(const std::vector<sign_request>& requests);
+
         priv_key_t get_blinding_key_from_script(byte_span_t script);
 
         std::vector<unsigned char> get_blinding_pubkey_from_script(byte_span_t script);
@@ -156,10 +171,10 @@ namespace green {
         const unsigned char m_btc_version;
         const nlohmann::json m_credentials;
         const nlohmann::json m_device;
-        wally_ext_key_ptr m_master_key;
+        secure_ext_key_ptr m_master_key;
         // Mutable post construction
         mutable std::mutex m_mutex;
-        std::optional<blinding_key_t> m_master_blinding_key;
+        secure_unique_ptr<blinding_key_t> m_master_blinding_key;
         std::optional<std::vector<unsigned char>> m_master_fingerprint;
         cache_t m_cached_bip32_xpubs;
     };
@@ -6,6 +6,7 @@
 #include <boost/algorithm/string/trim.hpp>
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/read.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/asio/strand.hpp>
 #include <boost/asio/write.hpp>
 #include <boost/beast/core.hpp>
@@ -23,17 +24,45 @@ namespace beast = boost::beast;
 
 namespace green {
 
+    namespace {
+        // Time allowed for prebuilding a circuit, including connecting to the destination
+        static const std::chrono::seconds SOCKS_PREBUILD_TIMEOUT{ 60 };
+
+        // Tor accepts any credentials; only their values are used for isolation
+        static const std::string SOCKS_ISOLATION_PASSWORD("gdk");
+
+        static constexpr uint8_t SOCKS_VERSION = 0x5;
+        static constexpr uint8_t SOCKS_AUTH_NONE = 0x0;
+        static constexpr uint8_t SOCKS_AUTH_USERNAME_PASSWORD = 0x2;
+        static constexpr uint8_t SOCKS_USERNAME_PASSWORD_VERSION = 0x1;
+
+        // The stream and deadline of a circuit being prebuilt
+        struct prebuild_state {
+            explicit prebuild_state(asio::io_context& io)
+                : m_stream(asio::make_strand(io))
+                , m_deadline(m_stream.get_executor())
+            {
+            }
+
+            beast::tcp_stream m_stream;
+            asio::steady_timer m_deadline;
+        };
+    } // namespace
+
     socks_client::socks_client(asio::io_context& io, boost::beast::tcp_stream& stream)
         : m_resolver(asio::make_strand(io))
         , m_stream(stream)
     {
     }
 
-    std::future<void> socks_client::run(const std::string& endpoint, const std::string& proxy_uri)
+    std::future<void> socks_client::run(
+        const std::string& endpoint, const std::string& proxy_uri, const std::string& isolation)
     {
         GDK_LOG(debug) << "socks_client:run";
 
         m_endpoint = endpoint;
+        m_isolation = isolation;
+        GDK_RUNTIME_ASSERT(m_isolation.size() <= 255);
 
         std::string proxy = algo::trim_copy(proxy_uri);
         GDK_RUNTIME_ASSERT(algo::starts_with(proxy, "socks5://"));
@@ -51,6 +80,43 @@ namespace green {
         return m_promise.get_future();
     }
 
+    void socks_client::prebuild_circuit(asio::io_context& io, const std::string& endpoint,
+        const std::string& proxy_uri, const std::string& isolation)
+    {
+        auto state = std::make_shared<prebuild_state>(io);
+        auto client = std::make_shared<socks_client>(io, state->m_stream);
+        client->m_on_done = [state, endpoint](const std::string& error) {
+            // Called on the resolver's or the stream's strand: finish on the stream's
+            asio::post(state->m_stream.get_executor(), [state, endpoint, error] {
+                state->m_deadline.cancel();
+                beast::error_code ec;
+                state->m_stream.socket().shutdown(asio::ip::tcp::socket::shutdown_both, ec);
+                state->m_stream.close();
+                if (!error.empty()) {
+                    // Not fatal: the circuit will be built when first used
+                    GDK_LOG(info) << "tor: failed to prebuild circuit for " << endpoint << ": " << error;
+                }
+            });
+        };
+
+        // The stream's expiry only covers its own operations, so the
+        // deadline also cancels resolving the proxy
+        state->m_stream.expires_after(SOCKS_PREBUILD_TIMEOUT);
+        state->m_deadline.expires_after(SOCKS_PREBUILD_TIMEOUT);
+        state->m_deadline.async_wait([state, weak_client = std::weak_ptr<socks_client>(client)](beast::error_code ec) {
+            auto client = weak_client.lock();
+            if (!ec && client) {
+                client->cancel();
+            }
+        });
+        try {
+            client->run(endpoint, proxy_uri, isolation);
+        } catch (const std::exception&) {
+            state->m_deadline.cancel();
+            throw;
+        }
+    }
+
     void socks_client::shutdown()
     {
         GDK_LOG(debug) << "socks_client:shutdown";
@@ -77,10 +143,22 @@ namespace green {
 
         NET_ERROR_CODE_CHECK("socks_client", ec);
 
+        // Send every request at once: the proxy processes them in turn,
+        // so its replies can then be read back to back
         m_negotiation_phase = negotiation_phase::method_selection;
-
-        asio::async_write(m_stream, method_selection_request(),
-            beast::bind_front_handler(&socks_client::on_write, shared_from_this()));
+        m_request.clear();
+        try {
+            method_selection_request();
+            if (!m_isolation.empty()) {
+                authentication_request();
+            }
+            connect_request(m_endpoint);
+        } catch (const std::exception& ex) {
+            GDK_LOG(warning) << "exception creating request for endpoint '" << m_endpoint << "':" << ex.what();
+            return set_exception(ex.what());
+        }
+        asio::async_write(
+            m_stream, asio::buffer(m_request), beast::bind_front_handler(&socks_client::on_write, shared_from_this()));
     }
 
     void socks_client::on_write(boost::beast::error_code ec, size_t __attribute__((unused)) bytes_transferred)
@@ -89,46 +167,58 @@ namespace green {
 
         NET_ERROR_CODE_CHECK("socks_client", ec);
 
-        m_response.resize(m_negotiation_phase == negotiation_phase::method_selection ? 2 : 4);
-        asio::async_read(
-            m_stream, asio::buffer(m_response), beast::bind_front_handler(&socks_client::on_read, shared_from_this()));
+        read_response(2, &socks_client::on_method_read);
     }
 
-    void socks_client::on_read(boost::beast::error_code ec, size_t __attribute__((unused)) bytes_transferred)
+    void socks_client::on_method_read(boost::beast::error_code ec, size_t __attribute__((unused)) bytes_transferred)
     {
-        GDK_LOG(debug) << "socks_client:on_read";
+        GDK_LOG(debug) << "socks_client:on_method_read";
 
         NET_ERROR_CODE_CHECK("socks_client", ec);
 
-        if (m_response[1] != static_cast<uint8_t>(reply_code::success)) {
-            return set_exception(get_error_string(m_response[1]));
+        const uint8_t method = m_isolation.empty() ? SOCKS_AUTH_NONE : SOCKS_AUTH_USERNAME_PASSWORD;
+        if (m_response[0] != SOCKS_VERSION || m_response[1] != method) {
+            return set_exception("no acceptable SOCKS5 authentication method");
         }
-
-        if (m_negotiation_phase == negotiation_phase::method_selection) {
+        if (method == SOCKS_AUTH_USERNAME_PASSWORD) {
+            m_negotiation_phase = negotiation_phase::authentication;
+            read_response(2, &socks_client::on_auth_read);
+        } else {
             m_negotiation_phase = negotiation_phase::connect;
+            read_response(4, &socks_client::on_read);
+        }
+    }
 
-            asio::const_buffer request;
-            try {
-                request = connect_request(m_endpoint);
-            } catch (const std::exception& ex) {
-                GDK_LOG(warning) << "exception creating request for endpoint '" << m_endpoint << "':" << ex.what();
-                return set_exception(ex.what());
-            }
-            asio::async_write(
-                m_stream, request, beast::bind_front_handler(&socks_client::on_write, shared_from_this()));
-        } else {
+    void socks_client::on_auth_read(boost::beast::error_code ec, size_t __attribute__((unused)) bytes_transferred)
+    {
+        GDK_LOG(debug) << "socks_client:on_auth_read";
 
-            if (m_negotiation_phase != negotiation_phase::connect) {
-                return set_exception("expected negotiation phase to be connect");
-            }
+        NET_ERROR_CODE_CHECK("socks_client", ec);
+
+        if (m_response[1] != 0) {
+            return set_exception("SOCKS5 authentication failed");
+        }
+        m_negotiation_phase = negotiation_phase::connect;
+        read_response(4, &socks_client::on_read);
+    }
 
-            const bool is_single_byte = m_response[3] != 0x1 && m_response[3] != 0x4;
-            const size_t response_size = is_single_byte ? 1 : m_response[3] * 4 + sizeof(uint16_t);
-            m_response.resize(response_size);
+    void socks_client::on_read(boost::beast::error_code ec, size_t __attribute__((unused)) bytes_transferred)
+    {
+        GDK_LOG(debug) << "socks_client:on_read";
+
+        NET_ERROR_CODE_CHECK("socks_client", ec);
 
-            asio::async_read(m_stream, asio::buffer(m_response),
-                beast::bind_front_handler(&socks_client::on_connect_read, shared_from_this()));
+        if (m_negotiation_phase != negotiation_phase::connect) {
+            return set_exception("expected negotiation phase to be connect");
         }
+
+        if (m_response[1] != static_cast<uint8_t>(reply_code::success)) {
+            return set_exception(get_error_string(m_response[1]));
+        }
+
+        const bool is_single_byte = m_response[3] != 0x1 && m_response[3] != 0x4;
+        const size_t response_size = is_single_byte ? 1 : m_response[3] * 4 + sizeof(uint16_t);
+        read_response(response_size, &socks_client::on_connect_read);
     }
 
     void socks_client::on_connect_read(boost::beast::error_code ec, size_t __attribute__((unused)) bytes_transferred)
@@ -142,11 +232,9 @@ namespace green {
         }
 
         if (m_response.size() == 1) {
-            m_response.resize(m_response[0] + sizeof(uint16_t));
-            asio::async_read(m_stream, asio::buffer(m_response),
-                beast::bind_front_handler(&socks_client::on_domain_name_read, shared_from_this()));
+            read_response(m_response[0] + sizeof(uint16_t), &socks_client::on_domain_name_read);
         } else {
-            m_promise.set_value();
+            set_value();
         }
     }
 
@@ -157,19 +245,36 @@ namespace green {
 
         NET_ERROR_CODE_CHECK("socks_client", ec);
 
-        m_promise.set_value();
+        set_value();
+    }
+
+    void socks_client::read_response(size_t size, void (socks_client::*handler)(boost::beast::error_code, size_t))
+    {
+        m_response.resize(size);
+        asio::async_read(m_stream, asio::buffer(m_response), beast::bind_front_handler(handler, shared_from_this()));
     }
 
-    asio::const_buffer socks_client::method_selection_request()
+    void socks_client::method_selection_request()
     {
         // version: 5
         // methods: 1
-        // authentication: no authentication
-        m_request.assign({ 0x5, 0x1, 0x0 });
-        return asio::const_buffer(m_request.data(), m_request.size());
+        // authentication: username/password when isolating, otherwise none
+        const uint8_t method = m_isolation.empty() ? SOCKS_AUTH_NONE : SOCKS_AUTH_USERNAME_PASSWORD;
+        m_request.insert(m_request.end(), { SOCKS_VERSION, 0x1, method });
+    }
+
+    void socks_client::authentication_request()
+    {
+        // RFC 1929 version: 1
+        // username size, username, password size, password
+        m_request.insert(
+            m_request.end(), { SOCKS_USERNAME_PASSWORD_VERSION, static_cast<unsigned char>(m_isolation.size()) });
+        m_request.insert(m_request.end(), m_isolation.begin(), m_isolation.end());
+        m_request.push_back(static_cast<unsigned char>(SOCKS_ISOLATION_PASSWORD.size()));
+        m_request.insert(m_request.end(), SOCKS_ISOLATION_PASSWORD.begin(), SOCKS_ISOLATION_PASSWORD.end());
     }
 
-    asio::const_buffer socks_client::connect_request(const std::string& url)
+    void socks_client::connect_request(const std::string& url)
     {
         GDK_RUNTIME_ASSERT(!url.empty());
 
@@ -181,15 +286,14 @@ namespace green {
         // address type domain name: 3
         // address size
         const std::string host = url_info["host"];
-        m_request.assign({ 0x5, 0x1, 0x0, 0x3, static_cast<unsigned char>(host.size()) });
+        GDK_RUNTIME_ASSERT(host.size() <= 255);
+        m_request.insert(m_request.end(), { SOCKS_VERSION, 0x1, 0x0, 0x3, static_cast<unsigned char>(host.size()) });
         std::copy(std::cbegin(host), std::cend(host), std::back_inserter(m_request));
 
         const std::string port_string = url_info["port"];
         uint16_t port = htons(std::stoul(port_string, nullptr, 10));
         const auto p = reinterpret_cast<const unsigned char*>(&port);
         std::copy(p, p + sizeof(uint16_t), std::back_inserter(m_request));
-
-        return asio::const_buffer(m_request.data(), m_request.size());
     }
 
     std::string socks_client::get_error_string(uint8_t response)
@@ -224,9 +328,30 @@ namespace green {
         __builtin_unreachable();
     }
 
+    void socks_client::set_value()
+    {
+        m_promise.set_value();
+        if (m_on_done) {
+            m_on_done(std::string());
+        }
+    }
+
     void socks_client::set_exception(const std::string& what)
     {
         m_promise.set_exception(std::make_exception_ptr(std::runtime_error(what)));
+        if (m_on_done) {
+            m_on_done(what);
+        }
+    }
+
+    void socks_client::cancel()
+    {
+        GDK_LOG(debug) << "socks_client:cancel";
+
+        // Each is cancelled on its own strand; the handlers of any pending
+        // operations then fail with operation_aborted
+        asio::post(m_resolver.get_executor(), [self = shared_from_this()] { self->m_resolver.cancel(); });
+        m_stream.cancel();
     }
 
 } // namespace green
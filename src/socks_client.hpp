@@ -4,6 +4,7 @@
 
 #include <boost/asio/io_context.hpp>
 #include <boost/beast/core.hpp>
+#include <functional>
 #include <future>
 #include <memory>
 #include <string>
@@ -21,9 +22,23 @@ namespace green {
         socks_client& operator=(socks_client&&) = delete;
         ~socks_client() = default;
 
-        std::future<void> run(const std::string& endpoint, const std::string& proxy_uri);
+        // Connect to endpoint through the SOCKS5 proxy. The method selection,
+        // any authentication and the CONNECT request are sent together,
+        // saving a round trip to the proxy for each. If isolation is given it
+        // is sent as the username/password, which Tor (with its default
+        // IsolateSOCKSAuth) uses to keep the stream on its own circuit.
+        std::future<void> run(
+            const std::string& endpoint, const std::string& proxy_uri, const std::string& isolation = {});
         void shutdown();
 
+        // Start building the circuit for endpoint and isolation by connecting
+        // through the Tor proxy and then disconnecting. Tor keeps the circuit
+        // open for later streams with the same isolation. Returns at once: the
+        // exchange runs on io, and is abandoned if it has not completed within
+        // a timeout, including while resolving the proxy.
+        static void prebuild_circuit(boost::asio::io_context& io, const std::string& endpoint,
+            const std::string& proxy_uri, const std::string& isolation);
+
     private:
         enum class reply_code {
             success,
@@ -37,32 +52,42 @@ namespace green {
             addr_type_not_supported
         };
 
-        enum class negotiation_phase { method_selection, connect };
+        enum class negotiation_phase { method_selection, authentication, connect };
 
         void on_resolve(boost::beast::error_code ec, const boost::asio::ip::tcp::resolver::results_type& results);
         void on_connect(
             boost::beast::error_code ec, const boost::asio::ip::tcp::resolver::results_type::endpoint_type& type);
         void on_write(boost::beast::error_code ec, size_t bytes_transferred);
+        void on_method_read(boost::beast::error_code ec, size_t bytes_transferred);
+        void on_auth_read(boost::beast::error_code ec, size_t bytes_transferred);
         void on_read(boost::beast::error_code ec, size_t bytes_transferred);
         void on_connect_read(boost::beast::error_code ec, size_t bytes_transferred);
         void on_domain_name_read(boost::beast::error_code ec, size_t bytes_transferred);
 
         std::string get_error_string(uint8_t response);
+        void set_value();
         void set_exception(const std::string& what);
+        void cancel();
 
-        // SOCKS5 request. TODO: this is a simplified version of the code PR'd to websocketpp
-        boost::asio::const_buffer method_selection_request();
-        boost::asio::const_buffer connect_request(const std::string& url);
+        // SOCKS5 requests, appended to m_request.
+        // TODO: this is a simplified version of the code PR'd to websocketpp
+        void method_selection_request();
+        void authentication_request();
+        void connect_request(const std::string& url);
+        void read_response(size_t size, void (socks_client::*handler)(boost::beast::error_code, size_t));
 
         boost::asio::ip::tcp::resolver m_resolver;
         boost::beast::tcp_stream& m_stream;
         std::string m_endpoint;
+        std::string m_isolation;
 
         std::vector<unsigned char> m_request;
         std::vector<unsigned char> m_response;
         negotiation_phase m_negotiation_phase{ negotiation_phase::method_selection };
 
         std::promise<void> m_promise;
+        // If set, called once run completes, with the error if it failed
+        std::function<void(const std::string&)> m_on_done;
     };
 
 } // namespace green
@@ -0,0 +1,204 @@
+#include "stats.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+
+#include <nlohmann/json.hpp>
+
+namespace green {
+
+    namespace stats {
+        namespace {
+            // Bucket i counts operations taking less than 2^i microseconds,
+            // with the last bucket counting all longer operations (~16s+)
+            static constexpr size_t NUM_BUCKETS = 25;
+
+            struct op_stats final {
+                std::atomic<uint64_t> count{ 0 };
+                std::atomic<uint64_t> errors{ 0 };
+                std::atomic<uint64_t> total_ns{ 0 };
+                std::atomic<uint64_t> max_ns{ 0 };
+                std::array<std::atomic<uint64_t>, NUM_BUCKETS> buckets{};
+            };
+
+            using name_map_t = std::map<std::string, std::unique_ptr<op_stats>, std::less<>>;
+            using category_map_t = std::map<std::string, name_map_t, std::less<>>;
+
+            static std::shared_mutex s_mutex;
+            static category_map_t s_stats;
+
+            static op_stats* find_op_stats(std::string_view category, std::string_view name)
+            {
+                auto c = s_stats.find(category);
+                if (c != s_stats.end()) {
+                    auto n = c->second.find(name);
+                    if (n != c->second.end()) {
+                        return n->second.get();
+                    }
+                }
+                return nullptr;
+            }
+
+            static op_stats& get_op_stats(std::string_view category, std::string_view name)
+            {
+                {
+                    std::shared_lock<std::shared_mutex> locker(s_mutex);
+                    if (auto p = find_op_stats(category, name); p) {
+                        return *p;
+                    }
+                }
+                std::unique_lock<std::shared_mutex> locker(s_mutex);
+                auto& names = s_stats[std::string(category)];
+                auto& p = names[std::string(name)];
+                if (!p) {
+                    p = std::make_unique<op_stats>();
+                }
+                return *p;
+            }
+
+            // Tracing state. s_tracing is checked without the lock so that
+            // recording costs nothing extra when no trace is active. The
+            // remaining state is protected by s_trace_mutex
+            static std::atomic_bool s_tracing{ false };
+            static std::mutex s_trace_mutex;
+            static std::FILE* s_trace_file = nullptr;
+            static std::chrono::steady_clock::time_point s_trace_start;
+            static std::chrono::steady_clock::time_point s_trace_end;
+
+            // Small, stable per-thread ids for the trace viewer
+            static uint32_t get_trace_tid()
+            {
+                static std::atomic<uint32_t> s_next_tid{ 1 };
+                thread_local const uint32_t tid = s_next_tid.fetch_add(1, std::memory_order_relaxed);
+                return tid;
+            }
+
+            static void write_trace_event(
+                std::string_view category, std::string_view name, duration_t elapsed, bool failed)
+            {
+                using namespace std::chrono;
+                const auto now = steady_clock::now();
+                const auto start = now - elapsed;
+                std::unique_lock<std::mutex> locker(s_trace_mutex);
+                if (!s_trace_file) {
+                    return; // Stopped since s_tracing was checked
+                }
+                if (now >= s_trace_end) {
+                    locker.unlock();
+                    stop_trace();
+                    return;
+                }
+                if (start < s_trace_start) {
+                    return; // Started before tracing did
+                }
+                // Complete ("X") events: a span with its start and duration
+                nlohmann::json event = { { "name", name }, { "cat", category }, { "ph", "X" },
+                    { "ts", duration_cast<microseconds>(start - s_trace_start).count() },
+                    { "dur", duration_cast<microseconds>(elapsed).count() }, { "pid", 1 },
+                    { "tid", get_trace_tid() } };
+                if (failed) {
+                    event["args"] = { { "failed", true } };
+                }
+                std::string line(",\n");
+                line += event.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace);
+                std::fwrite(line.data(), 1, line.size(), s_trace_file);
+            }
+
+            static size_t get_bucket(uint64_t ns)
+            {
+                size_t bucket = 0;
+                for (uint64_t us = ns / 1000; us && bucket < NUM_BUCKETS - 1; us >>= 1) {
+                    ++bucket;
+                }
+                return bucket;
+            }
+        } // namespace
+
+        void record(std::string_view category, std::string_view name, duration_t elapsed, bool failed)
+        {
+            try {
+                auto& s = get_op_stats(category, name);
+                const uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+                s.count.fetch_add(1, std::memory_order_relaxed);
+                if (failed) {
+                    s.errors.fetch_add(1, std::memory_order_relaxed);
+                }
+                s.total_ns.fetch_add(ns, std::memory_order_relaxed);
+                uint64_t max_ns = s.max_ns.load(std::memory_order_relaxed);
+                while (ns > max_ns && !s.max_ns.compare_exchange_weak(max_ns, ns, std::memory_order_relaxed)) {
+                    // max_ns is reloaded by compare_exchange_weak
+                }
+                s.buckets[get_bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+                if (s_tracing.load(std::memory_order_acquire)) {
+                    write_trace_event(category, name, elapsed, failed);
+                }
+            } catch (const std::exception&) {
+                // Statistics are best effort: never fail the operation being timed
+            }
+        }
+
+        nlohmann::json get()
+        {
+            nlohmann::json result = nlohmann::json::object();
+            std::shared_lock<std::shared_mutex> locker(s_mutex);
+            for (const auto& [category, names] : s_stats) {
+                auto& category_json = result[category];
+                for (const auto& [name, s] : names) {
+                    const uint64_t count = s->count.load(std::memory_order_relaxed);
+                    const uint64_t total_ns = s->total_ns.load(std::memory_order_relaxed);
+                    nlohmann::json::array_t histogram;
+                    histogram.reserve(NUM_BUCKETS);
+                    for (const auto& bucket : s->buckets) {
+                        histogram.push_back(bucket.load(std::memory_order_relaxed));
+                    }
+                    category_json[name] = { { "count", count },
+                        { "errors", s->errors.load(std::memory_order_relaxed) }, { "total_us", total_ns / 1000 },
+                        { "mean_us", count ? total_ns / count / 1000 : 0 },
+                        { "max_us", s->max_ns.load(std::memory_order_relaxed) / 1000 },
+                        { "histogram", std::move(histogram) } };
+                }
+            }
+            return result;
+        }
+
+        void start_trace(const std::string& path, std::chrono::seconds duration)
+        {
+            static std::once_flag s_atexit_once;
+            std::call_once(s_atexit_once, [] { std::atexit(stop_trace); });
+
+            stop_trace();
+            std::lock_guard<std::mutex> locker(s_trace_mutex);
+            s_trace_file = std::fopen(path.c_str(), "w");
+            if (!s_trace_file) {
+                return; // Tracing is best effort
+            }
+            // Events follow the metadata naming the process, each prefixed
+            // by a separator, so the array is valid once closed
+            const nlohmann::json metadata
+                = { { "name", "process_name" }, { "ph", "M" }, { "pid", 1 }, { "args", { { "name", "gdk" } } } };
+            const auto header = "[\n" + metadata.dump();
+            std::fwrite(header.data(), 1, header.size(), s_trace_file);
+            s_trace_start = std::chrono::steady_clock::now();
+            s_trace_end = s_trace_start + duration;
+            s_tracing.store(true, std::memory_order_release);
+        }
+
+        void stop_trace()
+        {
+            s_tracing.store(false, std::memory_order_relaxed);
+            std::lock_guard<std::mutex> locker(s_trace_mutex);
+            if (s_trace_file) {
+                std::fputs("\n]\n", s_trace_file);
+                std::fclose(s_trace_file);
+                s_trace_file = nullptr;
+            }
+        }
+    } // namespace stats
+
+} // namespace green
@@ -0,0 +1,68 @@
+#ifndef GDK_STATS_HPP
+#define GDK_STATS_HPP
+#pragma once
+
+#include <chrono>
+#include <exception>
+#include <string>
+#include <string_view>
+
+#include <nlohmann/json_fwd.hpp>
+
+namespace green {
+
+    //
+    // Process-wide operation statistics.
+    //
+    // Operations are recorded by category (e.g. "wamp_call") and name (e.g.
+    // the method called), keeping a count, an error count, total and maximum
+    // latency, and a histogram of latencies in power of two microsecond
+    // buckets. Recording is cheap enough for per-statement use.
+    //
+    // While a trace is active, each recorded operation is also written to
+    // the trace file as a Chrome trace-event span, viewable in
+    // chrome://tracing or https://ui.perfetto.dev.
+    //
+    namespace stats {
+        using duration_t = std::chrono::steady_clock::duration;
+
+        void record(std::string_view category, std::string_view name, duration_t elapsed, bool failed = false);
+
+        // Return all recorded statistics as JSON
+        nlohmann::json get();
+
+        // Write operations recorded over the next duration to a trace file
+        void start_trace(const std::string& path, std::chrono::seconds duration);
+        // Stop any active trace, completing its file
+        void stop_trace();
+
+        // Times a scope, recording it as failed if left by an exception
+        class timer final {
+        public:
+            timer(std::string_view category, std::string name)
+                : m_category(category)
+                , m_name(std::move(name))
+                , m_start(std::chrono::steady_clock::now())
+                , m_exceptions(std::uncaught_exceptions())
+            {
+            }
+            timer(const timer&) = delete;
+            timer& operator=(const timer&) = delete;
+
+            ~timer()
+            {
+                const bool failed = std::uncaught_exceptions() > m_exceptions;
+                record(m_category, m_name, std::chrono::steady_clock::now() - m_start, failed);
+            }
+
+        private:
+            const std::string_view m_category;
+            const std::string m_name;
+            const std::chrono::steady_clock::time_point m_start;
+            const int m_exceptions;
+        };
+    } // namespace stats
+
+} // namespace green
+
+#endif
@@ -11,6 +11,7 @@
 #include "session.hpp"
 #include "session_impl.hpp"
 #include "signer.hpp"
+#include "threading.hpp"
 #include "transaction_utils.hpp"
 #include "utils.hpp"
 #include "validate.hpp"
@@ -150,7 +151,6 @@ namespace green {
     create_swap_transaction_call::create_swap_transaction_call(session& session, const nlohmann::json& details)
         : auth_handler_impl(session, "create_swap_transaction")
         , m_details(details)
-        , m_is_signed(false)
     {
     }
 
@@ -169,25 +169,35 @@ namespace green {
 
     auth_handler::state_type create_swap_transaction_call::liquidex_impl()
     {
+        // Each "send" UTXO is paired with the "receive" at the same index
+        // to create one proposal. All proposals are created in one call.
         const auto& liquidex_details = m_details.at(LIQUIDEX_STR);
-        const auto& send = j_arrayref(liquidex_details, "send", 1).at(0);
-        const auto& receive = j_arrayref(liquidex_details, "receive", 1).at(0);
+        const auto& sends = j_arrayref(liquidex_details, "send");
+        const auto& receives = j_arrayref(liquidex_details, "receive", sends.size());
+        GDK_USER_ASSERT(!sends.empty(), "send must contain at least one UTXO");
         // TODO: We may wish to allow receiving to a different subaccount.
         //       For now, receive to the same subaccount we are sending from
-        const uint32_t subaccount = send.at("subaccount");
+        const uint32_t subaccount = sends.at(0).at("subaccount");
 
-        if (m_receive_address.empty()) {
-            // Fetch a new address to receive the swapped asset on
+        if (m_receive_addresses.empty()) {
+            // Fetch new addresses to receive the swapped assets on
             // TODO: Further validate the inputs
-            const nlohmann::json addr_details = { { "subaccount", subaccount } };
-            add_next_handler(new get_receive_address_call(m_session_parent, addr_details));
+            std::set<std::pair<std::string, uint32_t>> outpoints;
+            for (const auto& send : sends) {
+                GDK_USER_ASSERT(send.at("subaccount") == subaccount, "send UTXOs must be from the same subaccount");
+                const bool is_new = outpoints.emplace(j_strref(send, "txhash"), j_uint32ref(send, "pt_idx")).second;
+                GDK_USER_ASSERT(is_new, "send UTXOs must be unique");
+            }
+            const nlohmann::json addr_details = { { "subaccount", subaccount }, { "count", sends.size() } };
+            add_next_handler(new get_receive_addresses_call(m_session_parent, addr_details));
             return state_type::make_call;
         }
+        const size_t index = m_proposals.size();
+        const auto& send = sends.at(index);
         if (m_create_details.empty()) {
             // Call create_transaction to create the swap tx
-            nlohmann::json addressee = std::move(m_receive_address);
-            m_receive_address["used"] = true; // Make sure m_receive_address.empty() isn't true
-            addressee.update(receive);
+            nlohmann::json addressee = std::move(m_receive_addresses.at("list").at(index));
+            addressee.update(receives.at(index));
             nlohmann::json::array_t addressees{ std::move(addressee) };
             std::vector<nlohmann::json> tx_inputs{ send };
             nlohmann::json utxos{ { send.at("asset_id"), tx_inputs } };
@@ -214,20 +224,22 @@ namespace green {
         const bool is_amp_tx = m_create_details.contains("blinding_nonces");
         m_create_details["sign_with"] = nlohmann::json::array_t{ is_amp_tx ? "user" : "all" };
         add_next_handler(new sign_transaction_call(m_session_parent, m_create_details));
-        return state_type::done; // We are complete once tx signing is done
+        // We are complete once the last tx signing is done
+        return index + 1 == sends.size() ? state_type::done : state_type::make_call;
     }
 
     void create_swap_transaction_call::on_next_handler_complete(auth_handler* next_handler)
     {
-        if (m_receive_address.empty()) {
-            // Call result is our new receive address
-            m_receive_address = std::move(next_handler->move_result());
+        if (m_receive_addresses.empty()) {
+            // Call result is our new receive addresses
+            m_receive_addresses = std::move(next_handler->move_result());
         } else if (m_create_details.empty()) {
             // Call result is our created/blinded tx
             m_create_details = std::move(next_handler->move_result());
-        } else if (!m_is_signed) {
+        } else {
             // Call result is our signed tx
             auto result = std::move(next_handler->move_result());
+            m_create_details = nlohmann::json(); // Create the next proposal's tx, if any
             // Create liquidex_v1 proposal to return
             auto& tx_inputs = result.at("transaction_inputs");
             auto& tx_outputs = result.at("transaction_outputs");
@@ -243,12 +255,15 @@ namespace green {
                 proposal["inputs"][0]["script"] = std::move(tx_inputs.at(0).at("prevout_script"));
                 proposal["outputs"][0]["blinding_nonce"] = p->at(0);
             }
-            m_result[LIQUIDEX_STR] = nlohmann::json::object();
-            m_result[LIQUIDEX_STR]["proposal"] = std::move(proposal);
-            m_result["error"] = std::string_view{};
-            m_is_signed = true;
-        } else {
-            GDK_RUNTIME_ASSERT_MSG(false, "Unknown next handler called");
+            m_proposals.emplace_back(std::move(proposal));
+            if (m_proposals.size() == j_arrayref(m_details.at(LIQUIDEX_STR), "send").size()) {
+                m_result[LIQUIDEX_STR] = nlohmann::json::object();
+                if (m_proposals.size() == 1) {
+                    m_result[LIQUIDEX_STR]["proposal"] = m_proposals.front();
+                }
+                m_result[LIQUIDEX_STR]["proposals"] = std::move(m_proposals);
+                m_result["error"] = std::string_view{};
+            }
         }
     }
 
@@ -348,8 +363,37 @@ namespace green {
     bool validate_call::is_liquidex() const { return m_details.contains(LIQUIDEX_STR); }
     void validate_call::liquidex_impl()
     {
-        const auto& proposal = m_details.at(LIQUIDEX_STR).at("proposal");
-        liquidex_validate_proposal(proposal);
+        const auto& liquidex_details = m_details.at(LIQUIDEX_STR);
+        if (!liquidex_details.contains("proposals")) {
+            liquidex_validate_proposal(liquidex_details.at("proposal"));
+            return;
+        }
+        // Verifying the proofs dominates for large batches, and each
+        // proposal is verified independently of the others. An invalid
+        // proposal is recorded as such and does not stop the others
+        const auto& proposals = j_arrayref(liquidex_details, "proposals");
+        constexpr size_t min_proposals_per_thread = 8;
+        std::vector<std::string> proposal_errors(proposals.size());
+        parallel_for(
+            proposals.size(),
+            [&](size_t i) {
+                try {
+                    liquidex_validate_proposal(proposals[i]);
+                } catch (const std::exception& e) {
+                    proposal_errors[i] = e.what();
+                }
+            },
+            min_proposals_per_thread);
+        nlohmann::json::array_t errors, results;
+        results.reserve(proposal_errors.size());
+        for (auto& error : proposal_errors) {
+            if (!error.empty()) {
+                errors.emplace_back(error);
+            }
+            results.push_back({ { "is_valid", error.empty() }, { "error", std::move(error) } });
+        }
+        m_result["errors"] = std::move(errors);
+        m_result["proposals"] = std::move(results);
     }
 
 } // namespace green
@@ -19,9 +19,9 @@ namespace green {
         state_type liquidex_impl();
 
         nlohmann::json m_details;
-        nlohmann::json m_receive_address;
+        nlohmann::json m_receive_addresses;
         nlohmann::json m_create_details;
-        bool m_is_signed;
+        nlohmann::json::array_t m_proposals; // Created so far, in "send" order
     };
 
     class complete_swap_transaction_call : public auth_handler_impl {
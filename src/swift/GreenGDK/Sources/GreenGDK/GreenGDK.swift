@@ -148,7 +148,46 @@ public class TwoFactorCall {
     public func call() throws {
         try callWrapper(fun: GA_auth_handler_call(self.optr))
     }
+
+#if compiler(>=5.5)
+    // Call the 2fa operation without blocking the calling thread
+    // Returns the status of the call once it completes
+    @available(macOS 10.15, iOS 13.0, *)
+    public func callAsync() async throws -> [String: Any]? {
+        let optr = self.optr
+        return try await withCheckedThrowingContinuation { continuation in
+            let ctx = Unmanaged.passRetained(CallContinuation(continuation)).toOpaque()
+            do {
+                try callWrapper(fun: GA_auth_handler_call_async(optr, callCompletion, ctx))
+            } catch {
+                Unmanaged<CallContinuation>.fromOpaque(ctx).release()
+                continuation.resume(throwing: error)
+            }
+        }
+    }
+#endif
+}
+
+#if compiler(>=5.5)
+@available(macOS 10.15, iOS 13.0, *)
+fileprivate final class CallContinuation {
+    let continuation: CheckedContinuation<[String: Any]?, Error>
+
+    init(_ continuation: CheckedContinuation<[String: Any]?, Error>) {
+        self.continuation = continuation
+    }
+}
+
+@available(macOS 10.15, iOS 13.0, *)
+fileprivate let callCompletion: @convention(c) (UnsafeMutableRawPointer?, OpaquePointer?) -> Void = { ctx, status in
+    let box = Unmanaged<CallContinuation>.fromOpaque(ctx!).takeRetainedValue()
+    do {
+        box.continuation.resume(returning: try convertOpaqueJsonToDict(o: status!))
+    } catch {
+        box.continuation.resume(throwing: error)
+    }
 }
+#endif
 
 public typealias NotificationCompletionHandler = (_ notification: [String: Any]?) -> Void
 fileprivate var notificationContexts = [NSString: NotificationCompletionHandler?]()
@@ -334,6 +373,10 @@ public class Session {
         return try jsonFuncToCallHandlerWrapper(input: details, fun: GA_get_receive_address)
     }
 
+    public func getReceiveAddresses(details: [String: Any]) throws -> TwoFactorCall {
+        return try jsonFuncToCallHandlerWrapper(input: details, fun: GA_get_receive_addresses)
+    }
+
     public func getPreviousAddresses(details: [String: Any]) throws -> TwoFactorCall {
         return try jsonFuncToCallHandlerWrapper(input: details, fun: GA_get_previous_addresses)
     }
@@ -370,6 +413,10 @@ public class Session {
         return try jsonFuncToJsonWrapper(input: input, fun: GA_convert_amount)
     }
 
+    public func convertAmounts(input: [String: Any]) throws -> [String: Any]? {
+        return try jsonFuncToJsonWrapper(input: input, fun: GA_convert_amounts)
+    }
+
     public func createTransaction(details: [String: Any]) throws -> TwoFactorCall {
         return try jsonFuncToCallHandlerWrapper(input: details, fun: GA_create_transaction)
     }
@@ -430,6 +477,14 @@ public class Session {
         try callWrapper(fun: GA_set_transaction_memo(session, txhash_hex, memo, memo_type))
     }
 
+    public func setTransactionMemos(details: [String: Any]) throws {
+        let detailsJson: OpaquePointer = try convertDictToJSON(dict: details)
+        defer {
+            GA_destroy_json(detailsJson)
+        }
+        try callWrapper(fun: GA_set_transaction_memos(session, detailsJson))
+    }
+
     public func getSystemMessage() throws -> String {
         var buff: UnsafeMutablePointer<Int8>? = nil
         try callWrapper(fun: GA_get_system_message(session, &buff))
@@ -511,6 +566,10 @@ public class Session {
         return try voidFuncToJsonWrapper(fun: GA_get_fee_estimates)
     }
 
+    public func getMemoryStats() throws -> [String: Any]? {
+        return try voidFuncToJsonWrapper(fun: GA_get_memory_stats)
+    }
+
     public func getCredentials(details: [String: Any]) throws -> TwoFactorCall {
         return try jsonFuncToCallHandlerWrapper(input: details, fun: GA_get_credentials)
     }
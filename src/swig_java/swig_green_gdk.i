@@ -2,6 +2,9 @@
 %{
 #include "gdk.h"
 #include <limits.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
 
 /* Make local functions visible to the O/S for better JVM stack traces */
 #ifdef NDEBUG
@@ -15,6 +18,14 @@ static const char* TO_OBJECT_METHOD_NAME = "toJSONObject";
 static const char* TO_OBJECT_METHOD_ARGS = "(Ljava/lang/String;)Ljava/lang/Object;";
 static const char* TO_STRING_METHOD_NAME = "toJSONString";
 static const char* TO_STRING_METHOD_ARGS = "(Ljava/lang/Object;)Ljava/lang/String;";
+static const char* FROM_MSGPACK_METHOD_NAME = "msgpackToJSONObject";
+static const char* FROM_MSGPACK_METHOD_ARGS = "([B)Ljava/lang/Object;";
+static const char* FROM_DIRECT_MSGPACK_METHOD_NAME = "directMsgpackToJSONObject";
+static const char* FROM_DIRECT_MSGPACK_METHOD_ARGS = "(Ljava/nio/ByteBuffer;)Ljava/lang/Object;";
+static const char* TO_MSGPACK_METHOD_NAME = "toMsgpack";
+static const char* TO_MSGPACK_METHOD_ARGS = "(Ljava/lang/Object;)[B";
+static const char* USE_MSGPACK_FIELD_NAME = "mUseMsgpack";
+static const char* USE_DIRECT_MSGPACK_FIELD_NAME = "mUseDirectMsgpack";
 static const char* NOTIFY_METHOD_NAME = "callNotificationHandler";
 static const char* NOTIFY_METHOD_ARGS = "(Ljava/lang/Object;Ljava/lang/Object;)V";
 static const char* OBJ_CLASS  = "com/blockstream/green_gdk/GDK$Obj";
@@ -24,6 +35,11 @@ static JavaVM* g_jvm;
 static jclass g_gasdk;
 static jmethodID g_gasdk_toJSONObject;
 static jmethodID g_gasdk_toJSONString;
+static jmethodID g_gasdk_msgpackToJSONObject;
+static jmethodID g_gasdk_directMsgpackToJSONObject;
+static jmethodID g_gasdk_toMsgpack;
+static jfieldID g_gasdk_useMsgpack;
+static jfieldID g_gasdk_useDirectMsgpack;
 static jmethodID g_gasdk_callNotificationHandler;
 
 static jclass g_gasdk_obj;
@@ -31,6 +47,19 @@ static jmethodID g_gasdk_obj_ctor;
 static jmethodID g_gasdk_obj_get_id;
 static jmethodID g_gasdk_obj_get;
 
+#ifndef _WIN32
+/* Threads attached to deliver notifications stay attached until they exit */
+static pthread_key_t g_attached_key;
+static int g_attached_key_ok;
+
+static void detach_thread(void* value)
+{
+    (void)value;
+    if (g_jvm)
+        (*g_jvm)->DetachCurrentThread(g_jvm);
+}
+#endif
+
 LOCALFUNC jclass jni_get_class(JNIEnv *jenv, const char* name) {
     jclass cls;
     jobject obj = NULL;
@@ -58,11 +87,24 @@ JNIEXPORT jint JNI_OnLoad(JavaVM* jvm, void* reserved)
 
     g_gasdk_toJSONObject = (*jenv)->GetStaticMethodID(jenv, g_gasdk, TO_OBJECT_METHOD_NAME, TO_OBJECT_METHOD_ARGS);
     g_gasdk_toJSONString = (*jenv)->GetStaticMethodID(jenv, g_gasdk, TO_STRING_METHOD_NAME, TO_STRING_METHOD_ARGS);
+    g_gasdk_msgpackToJSONObject = (*jenv)->GetStaticMethodID(jenv, g_gasdk, FROM_MSGPACK_METHOD_NAME,
+                                                             FROM_MSGPACK_METHOD_ARGS);
+    g_gasdk_directMsgpackToJSONObject = (*jenv)->GetStaticMethodID(jenv, g_gasdk, FROM_DIRECT_MSGPACK_METHOD_NAME,
+                                                                   FROM_DIRECT_MSGPACK_METHOD_ARGS);
+    g_gasdk_toMsgpack = (*jenv)->GetStaticMethodID(jenv, g_gasdk, TO_MSGPACK_METHOD_NAME, TO_MSGPACK_METHOD_ARGS);
+    g_gasdk_useMsgpack = (*jenv)->GetStaticFieldID(jenv, g_gasdk, USE_MSGPACK_FIELD_NAME, "Z");
+    g_gasdk_useDirectMsgpack = (*jenv)->GetStaticFieldID(jenv, g_gasdk, USE_DIRECT_MSGPACK_FIELD_NAME, "Z");
     g_gasdk_callNotificationHandler = (*jenv)->GetStaticMethodID(jenv, g_gasdk, NOTIFY_METHOD_NAME, NOTIFY_METHOD_ARGS);
     g_gasdk_obj_ctor = (*jenv)->GetMethodID(jenv, g_gasdk_obj, "<init>", "(JI)V");
     g_gasdk_obj_get_id = (*jenv)->GetMethodID(jenv, g_gasdk_obj, "get_id", "()I");
     g_gasdk_obj_get = (*jenv)->GetMethodID(jenv, g_gasdk_obj, "get", "()J");
+    if ((*jenv)->ExceptionOccurred(jenv))
+        return -1;
 
+#ifndef _WIN32
+    if (!g_attached_key_ok)
+        g_attached_key_ok = pthread_key_create(&g_attached_key, detach_thread) == 0;
+#endif
     g_jvm = jvm;
     return JNI_VERSION_1_6;
 }
@@ -119,34 +161,137 @@ LOCALFUNC uint32_t uint32_cast(JNIEnv *jenv, jlong value) {
     return (uint32_t)value;
 }
 
+LOCALFUNC int use_msgpack(JNIEnv *jenv) {
+    return (*jenv)->GetStaticBooleanField(jenv, g_gasdk, g_gasdk_useMsgpack) == JNI_TRUE;
+}
+
+LOCALFUNC int use_direct_msgpack(JNIEnv *jenv) {
+    return (*jenv)->GetStaticBooleanField(jenv, g_gasdk, g_gasdk_useDirectMsgpack) == JNI_TRUE;
+}
+
+/* Create and return a java byte array holding GA_json as msgpack */
+LOCALFUNC jbyteArray create_msgpack(JNIEnv *jenv, GA_json *p) {
+    unsigned char buf[4096];
+    size_t written = 0;
+    jbyteArray ret;
+    void *dst;
+    int result;
+
+    if (GA_convert_json_to_msgpack(p, buf, sizeof(buf), &written) != GA_OK)
+        return NULL;
+    if (!(ret = (*jenv)->NewByteArray(jenv, written)))
+        return NULL;
+    if (written <= sizeof(buf)) {
+        (*jenv)->SetByteArrayRegion(jenv, ret, 0, written, (const jbyte*)buf);
+        return ret;
+    }
+    /* Too large for our buffer: encode directly into the result */
+    if (!(dst = (*jenv)->GetPrimitiveArrayCritical(jenv, ret, NULL)))
+        return NULL;
+    result = GA_convert_json_to_msgpack(p, (unsigned char *)dst, written, &written);
+    (*jenv)->ReleasePrimitiveArrayCritical(jenv, ret, dst, result == GA_OK ? 0 : JNI_ABORT);
+    return result == GA_OK ? ret : NULL;
+}
+
+/* Create and return a native json object from GA_json as msgpack in a
+ * direct ByteBuffer. The buffer wraps native memory that is only valid
+ * for the duration of the conversion call, so no Java heap copy is made */
+LOCALFUNC jobject create_json_direct(JNIEnv *jenv, GA_json *p) {
+    unsigned char buf[4096];
+    unsigned char *data = buf;
+    size_t written = 0;
+    jobject json_data = NULL;
+    jobject json_obj = NULL;
+
+    if (GA_convert_json_to_msgpack(p, buf, sizeof(buf), &written) != GA_OK)
+        goto fail;
+    if (written > sizeof(buf)) {
+        /* Too large for our buffer: encode into a heap buffer */
+        if (!(data = malloc_or_throw(jenv, written)))
+            return NULL;
+        if (GA_convert_json_to_msgpack(p, data, written, &written) != GA_OK)
+            goto fail;
+    }
+    if (!(json_data = (*jenv)->NewDirectByteBuffer(jenv, data, (jlong)written)))
+        goto fail;
+    json_obj = (*jenv)->CallStaticObjectMethod(jenv, g_gasdk, g_gasdk_directMsgpackToJSONObject, json_data);
+    if ((*jenv)->ExceptionOccurred(jenv))
+        (*jenv)->ExceptionDescribe(jenv);
+    (*jenv)->DeleteLocalRef(jenv, json_data);
+    if (data != buf)
+        free(data);
+    return json_obj;
+
+fail:
+    if (data != buf)
+        free(data);
+    if (!(*jenv)->ExceptionOccurred(jenv))
+        SWIG_JavaThrowException(jenv, SWIG_JavaIllegalArgumentException, "GA_json");
+    return NULL;
+}
+
 /* Create and return a native json object from GA_json */
 LOCALFUNC jobject create_json(JNIEnv *jenv, void *p) {
     char* json_cstring = NULL;
-    jstring json_string = NULL;
+    jobject json_data = NULL;
     jobject json_obj = NULL;
+    jmethodID method = g_gasdk_toJSONObject;
 
     if (!g_jvm)
         return NULL;
 
     if (!(*jenv)->ExceptionOccurred(jenv)) {
-        if (GA_convert_json_to_string((GA_json *)p, &json_cstring) != GA_OK) {
+        if (use_msgpack(jenv) && use_direct_msgpack(jenv)) {
+            /* Pass results across without copying them to the Java heap */
+            json_obj = create_json_direct(jenv, (GA_json *)p);
+            GA_destroy_json((GA_json *)p);
+            return json_obj;
+        }
+        if (use_msgpack(jenv)) {
+            /* Pass large results across as compact binary */
+            json_data = create_msgpack(jenv, (GA_json *)p);
+            method = g_gasdk_msgpackToJSONObject;
+        } else if (GA_convert_json_to_string((GA_json *)p, &json_cstring) == GA_OK) {
+            json_data = (*jenv)->NewStringUTF(jenv, json_cstring);
+            GA_destroy_string(json_cstring);
+        }
+        if (!json_data && !(*jenv)->ExceptionOccurred(jenv)) {
+            GA_destroy_json((GA_json *)p);
             SWIG_JavaThrowException(jenv, SWIG_JavaIllegalArgumentException, "GA_json");
             return NULL;
         }
 
-        json_string = (*jenv)->NewStringUTF(jenv, json_cstring);
-        GA_destroy_string(json_cstring);
-        if (!(*jenv)->ExceptionOccurred(jenv) && json_string) {
-            json_obj = (*jenv)->CallStaticObjectMethod(jenv, g_gasdk, g_gasdk_toJSONObject, json_string);
+        if (!(*jenv)->ExceptionOccurred(jenv) && json_data) {
+            json_obj = (*jenv)->CallStaticObjectMethod(jenv, g_gasdk, method, json_data);
             if ((*jenv)->ExceptionOccurred(jenv))
                 (*jenv)->ExceptionDescribe(jenv);
         }
+        if (json_data)
+            (*jenv)->DeleteLocalRef(jenv, json_data);
     }
 
     GA_destroy_json((GA_json *)p);
     return json_obj;
 }
 
+/* Create and return a GA_json from a native json object as msgpack */
+LOCALFUNC void* get_json_from_msgpack(JNIEnv *jenv, jobject json_obj) {
+    GA_json* json = NULL;
+    jbyteArray bytes;
+    jbyte* p;
+
+    bytes = (jbyteArray)(*jenv)->CallStaticObjectMethod(jenv, g_gasdk, g_gasdk_toMsgpack, json_obj);
+    if ((*jenv)->ExceptionOccurred(jenv)) {
+        (*jenv)->ExceptionDescribe(jenv);
+        return NULL;
+    }
+    if (!bytes || !(p = (*jenv)->GetByteArrayElements(jenv, bytes, NULL)))
+        return NULL;
+    GA_convert_msgpack_to_json((const unsigned char*)p, (*jenv)->GetArrayLength(jenv, bytes), &json);
+    (*jenv)->ReleaseByteArrayElements(jenv, bytes, p, JNI_ABORT);
+    return json;
+}
+
 /* Create and return a GA_json from a native json object */
 LOCALFUNC void* get_json_or_throw(JNIEnv *jenv, jobject json_obj) {
     const char* json_cstring;
@@ -156,6 +301,12 @@ LOCALFUNC void* get_json_or_throw(JNIEnv *jenv, jobject json_obj) {
     if (!g_jvm)
         return NULL;
 
+    if (use_msgpack(jenv)) {
+        if (!(json = (GA_json*)get_json_from_msgpack(jenv, json_obj)) && !(*jenv)->ExceptionOccurred(jenv))
+            SWIG_JavaThrowException(jenv, SWIG_JavaIllegalArgumentException, "GA_json");
+        return json;
+    }
+
     json_string = (*jenv)->CallStaticObjectMethod(jenv, g_gasdk, g_gasdk_toJSONString, json_obj);
     if ((*jenv)->ExceptionOccurred(jenv)) {
         (*jenv)->ExceptionDescribe(jenv);
@@ -176,22 +327,40 @@ typedef struct notification_context
     jobject m_session_obj;
 } notify_t;
 
+/* Attach the calling native thread to the JVM if needed. Returns 0 on
+ * failure, and sets must_detach if the caller must detach when done */
+LOCALFUNC int attach_thread(JNIEnv **jenv, int *must_detach)
+{
+    JavaVMAttachArgs args = { JNI_VERSION_1_6, (char*)"gdk-notify", NULL };
+    int status = (*g_jvm)->GetEnv(g_jvm, (void**) jenv, JNI_VERSION_1_6);
+
+    *must_detach = 0;
+    if (status == JNI_OK)
+        return 1;
+    if (status != JNI_EDETACHED || (*g_jvm)->AttachCurrentThreadAsDaemon(g_jvm, (void**) jenv, &args))
+        return 0;
+#ifndef _WIN32
+    /* Stay attached: re-attaching for every notification creates a new
+     * Java thread object each time. The key destructor detaches on exit */
+    if (g_attached_key_ok && !pthread_setspecific(g_attached_key, *jenv))
+        return 1;
+#endif
+    *must_detach = 1;
+    return 1;
+}
+
 /* Call any registered notification handler */
 LOCALFUNC void notification_handler(void* context_p, GA_json* details)
 {
     JNIEnv *jenv;
     notify_t* n = (notify_t*) context_p;
     jobject json_obj;
-    int status;
+    int must_detach;
 
     if (!g_jvm || !context_p || !n->m_session)
         return; /* Called after un-registering */
 
-    status = (*g_jvm)->GetEnv(g_jvm, (void**) &jenv, JNI_VERSION_1_6);
-    if (status == JNI_EDETACHED) {
-        if ((*g_jvm)->AttachCurrentThread(g_jvm, (void**) &jenv, NULL))
-            return;
-    } else if (status != JNI_OK)
+    if (!attach_thread(&jenv, &must_detach))
         return;
 
     if (!details) {
@@ -205,13 +374,16 @@ LOCALFUNC void notification_handler(void* context_p, GA_json* details)
     json_obj = create_json(jenv, (void *)details);
     if (!(*jenv)->ExceptionOccurred(jenv) && json_obj)
         (*jenv)->CallStaticVoidMethod(jenv, g_gasdk, g_gasdk_callNotificationHandler, n->m_session_obj, json_obj);
+    /* Long-lived threads never return to Java, so free local refs now */
+    if (json_obj)
+        (*jenv)->DeleteLocalRef(jenv, json_obj);
 
 end:
     if ((*jenv)->ExceptionOccurred(jenv)) {
         (*jenv)->ExceptionDescribe(jenv);
         (*jenv)->ExceptionClear(jenv);
     }
-    if (status == JNI_EDETACHED)
+    if (must_detach)
         (*g_jvm)->DetachCurrentThread(g_jvm);
 }
 
@@ -299,7 +471,23 @@ LOCALFUNC jbyteArray create_array(JNIEnv *jenv, const unsigned char* p, size_t l
        String toJSONString(final Object jsonObject);
     }
 
+    // Optional binary JSON conversion. Converters implementing this exchange
+    // JSON with gdk as msgpack, avoiding text serialization of large results
+    public interface MsgpackJSONConverter extends JSONConverter {
+       Object msgpackToJSONObject(final byte[] msgpack);
+       byte[] toMsgpack(final Object jsonObject);
+    }
+
+    // Optional zero-copy binary JSON conversion. Results are passed as a
+    // direct ByteBuffer over native memory, which is only valid during the
+    // call: implementations must not keep a reference to it
+    public interface DirectMsgpackJSONConverter extends MsgpackJSONConverter {
+       Object msgpackToJSONObject(final java.nio.ByteBuffer msgpack);
+    }
+
     private static JSONConverter mJSONConverter = null;
+    private static boolean mUseMsgpack = false;
+    private static boolean mUseDirectMsgpack = false;
 
     private static Object toJSONObject(final String jsonString) {
         return mJSONConverter.toJSONObject(jsonString);
@@ -309,8 +497,22 @@ LOCALFUNC jbyteArray create_array(JNIEnv *jenv, const unsigned char* p, size_t l
         return mJSONConverter.toJSONString(jsonObject);
     }
 
+    private static Object msgpackToJSONObject(final byte[] msgpack) {
+        return ((MsgpackJSONConverter) mJSONConverter).msgpackToJSONObject(msgpack);
+    }
+
+    private static Object directMsgpackToJSONObject(final java.nio.ByteBuffer msgpack) {
+        return ((DirectMsgpackJSONConverter) mJSONConverter).msgpackToJSONObject(msgpack);
+    }
+
+    private static byte[] toMsgpack(final Object jsonObject) {
+        return ((MsgpackJSONConverter) mJSONConverter).toMsgpack(jsonObject);
+    }
+
     public static void init(JSONConverter _JSONConverter, final Object config) {
         mJSONConverter = _JSONConverter;
+        mUseMsgpack = _JSONConverter instanceof MsgpackJSONConverter;
+        mUseDirectMsgpack = _JSONConverter instanceof DirectMsgpackJSONConverter;
         _internal_GA_init(config);
     }
 
@@ -499,6 +701,7 @@ LOCALFUNC jbyteArray create_array(JNIEnv *jenv, const unsigned char* p, size_t l
 %returns_struct(GA_cache_control, GA_json)
 %returns_void__(GA_connect)
 %returns_struct(GA_convert_amount, GA_json)
+%returns_struct(GA_convert_amounts, GA_json)
 %returns_string(GA_convert_json_to_string)
 %returns_string(GA_convert_json_value_to_string)
 %returns_struct(GA_convert_string_to_json, GA_json)
@@ -536,11 +739,13 @@ LOCALFUNC jbyteArray create_array(JNIEnv *jenv, const unsigned char* p, size_t l
 %returns_struct(GA_update_subaccount, GA_auth_handler)
 %returns_string(GA_get_system_message)
 %returns_struct(GA_get_transactions, GA_auth_handler)
+%returns_struct(GA_search_transactions, GA_json)
 %returns_struct(GA_get_twofactor_config, GA_json)
 %returns_struct(GA_get_unspent_outputs, GA_auth_handler)
 %returns_struct(GA_get_unspent_outputs_for_private_key, GA_auth_handler)
 %returns_struct(GA_set_unspent_outputs_status, GA_auth_handler)
 %returns_struct(GA_get_receive_address, GA_auth_handler)
+%returns_struct(GA_get_receive_addresses, GA_auth_handler)
 %returns_struct(GA_login_user, GA_auth_handler)
 %returns_void__(GA_register_network)
 %returns_struct(GA_register_user, GA_auth_handler)
@@ -551,6 +756,7 @@ LOCALFUNC jbyteArray create_array(JNIEnv *jenv, const unsigned char* p, size_t l
 %returns_struct(GA_send_transaction, GA_auth_handler)
 %returns_void__(GA_disable_all_pin_logins)
 %returns_void__(GA_set_transaction_memo)
+%returns_void__(GA_set_transaction_memos)
 %returns_string(GA_get_watch_only_username)
 %returns_struct(GA_sign_transaction, GA_auth_handler)
 %returns_struct(GA_sign_message, GA_auth_handler)
@@ -568,6 +774,8 @@ LOCALFUNC jbyteArray create_array(JNIEnv *jenv, const unsigned char* p, size_t l
 %returns_struct(GA_auth_handler_get_status, GA_json)
 %returns_struct(GA_change_settings, GA_auth_handler)
 %returns_struct(GA_get_settings, GA_json)
+%returns_struct(GA_get_stats, GA_json)
+%returns_struct(GA_get_memory_stats, GA_json)
 %returns_void__(GA_auth_handler_request_code)
 %returns_void__(GA_auth_handler_resolve_code)
 %returns_uint32(GA_validate_mnemonic)
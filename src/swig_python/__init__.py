@@ -1,5 +1,5 @@
 from ._green_gdk import *
-from ._green_gdk import _python_set_callback_handler, _python_destroy_session
+from ._green_gdk import _python_set_callback_handler, _python_destroy_session, _python_set_use_msgpack
 import atexit
 import json
 import queue
@@ -9,6 +9,31 @@ import weakref
 GA_MEMO_USER = 0
 GA_MEMO_BIP70 = 1
 
+try:
+    import msgpack
+except ImportError:
+    msgpack = None
+
+_use_msgpack = False
+
+def use_msgpack(enable=True):
+    """Exchange JSON with gdk as msgpack rather than as text.
+
+    Avoids serializing and re-parsing large results such as transaction
+    lists and UTXOs as JSON text. Requires the msgpack module.
+
+    """
+    global _use_msgpack
+    if enable and msgpack is None:
+        raise RuntimeError('msgpack module is not available')
+    _python_set_use_msgpack(1 if enable else 0)
+    _use_msgpack = enable
+
+def _loads(data):
+    if isinstance(data, bytes):
+        return msgpack.unpackb(data, raw=False, strict_map_key=False)
+    return json.loads(data)
+
 class Call(object):
     """Handler class to process a call potentally requiring twofactor.
 
@@ -23,7 +48,7 @@ class Call(object):
         self.call_obj = call_obj
 
     def status(self):
-        return json.loads(auth_handler_get_status(self.call_obj))
+        return _loads(auth_handler_get_status(self.call_obj))
 
     def _select_method(self, methods):
         # Default implementation just uses the first method provided
@@ -125,7 +150,7 @@ class Session(object):
         assert obj is self.session_obj
         try:
             if obj:
-                self.callback_handler(json.loads(event))
+                self.callback_handler(_loads(event))
         except Exception as e:
             print('exception {}\n'.format(e))
 
@@ -142,7 +167,9 @@ class Session(object):
 
     @staticmethod
     def _to_json(obj):
-        return obj if isinstance(obj, str) else json.dumps(obj)
+        if isinstance(obj, str):
+            return obj
+        return msgpack.packb(obj) if _use_msgpack else json.dumps(obj)
 
     def connect(self, net_params):
         return connect(self.session_obj, self._to_json(net_params))
@@ -154,11 +181,11 @@ class Session(object):
         return reconnect_hint(self.session_obj, self._to_json(hint))
 
     def get_proxy_settings(self):
-        return json.loads(get_proxy_settings(self.session_obj))
+        return _loads(get_proxy_settings(self.session_obj))
 
     @staticmethod
     def get_wallet_identifier(net_params, params):
-        return json.loads(get_wallet_identifier(Session._to_json(net_params), Session._to_json(params)))
+        return _loads(get_wallet_identifier(Session._to_json(net_params), Session._to_json(params)))
 
     def register_user(self, hw_device, details):
         return Call(register_user(self.session_obj, self._to_json(hw_device), self._to_json(details)))
@@ -200,10 +227,16 @@ class Session(object):
     def get_transactions(self, details={'subaccount': 0, 'first': 0, 'count': 30}):
         return Call(get_transactions(self.session_obj, self._to_json(details)))
 
+    def search_transactions(self, details):
+        return _loads(search_transactions(self.session_obj, self._to_json(details)))
+
     def get_receive_address(self, details=None):
         details = details or {}
         return Call(get_receive_address(self.session_obj, self._to_json(details)))
 
+    def get_receive_addresses(self, details):
+        return Call(get_receive_addresses(self.session_obj, self._to_json(details)))
+
     def get_previous_addresses(self, details={'subaccount': 0, 'last_pointer': 0}):
         return Call(get_previous_addresses(self.session_obj, self._to_json(details)))
 
@@ -217,16 +250,19 @@ class Session(object):
         return Call(set_unspent_outputs_status(self.session_obj, self._to_json(details)))
 
     def get_transaction_details(self, txhash_hex):
-        return json.loads(get_transaction_details(self.session_obj, txhash_hex))
+        return _loads(get_transaction_details(self.session_obj, txhash_hex))
 
     def convert_amount(self, details):
-        return json.loads(convert_amount(self.session_obj, self._to_json(details)))
+        return _loads(convert_amount(self.session_obj, self._to_json(details)))
+
+    def convert_amounts(self, details):
+        return _loads(convert_amounts(self.session_obj, self._to_json(details)))
 
     def get_balance(self, details={'subaccount': 0, 'num_confs': 0}):
         return Call(get_balance(self.session_obj, self._to_json(details)))
 
     def get_available_currencies(self):
-        return json.loads(get_available_currencies(self.session_obj))
+        return _loads(get_available_currencies(self.session_obj))
 
     def create_transaction(self, transaction_details):
         return Call(create_transaction(self.session_obj, self._to_json(transaction_details)))
@@ -276,8 +312,17 @@ class Session(object):
     def set_transaction_memo(self, txhash_hex, memo, memo_type=0):
         return set_transaction_memo(self.session_obj, txhash_hex, memo, memo_type)
 
+    def set_transaction_memos(self, details):
+        return set_transaction_memos(self.session_obj, self._to_json(details))
+
     def get_fee_estimates(self):
-        return json.loads(get_fee_estimates(self.session_obj))
+        return _loads(get_fee_estimates(self.session_obj))
+
+    def get_stats(self):
+        return _loads(get_stats(self.session_obj))
+
+    def get_memory_stats(self):
+        return _loads(get_memory_stats(self.session_obj))
 
     def get_credentials(self, details):
         return Call(get_credentials(self.session_obj, self._to_json(details)))
@@ -292,13 +337,13 @@ class Session(object):
         return Call(cache_control(self.session_obj, self._to_json(details)))
 
     def get_twofactor_config(self):
-        return json.loads(get_twofactor_config(self.session_obj))
+        return _loads(get_twofactor_config(self.session_obj))
 
     def change_settings_twofactor(self, method, details):
         return Call(change_settings_twofactor(self.session_obj, method, self._to_json(details)))
 
     def get_settings(self):
-        return json.loads(get_settings(self.session_obj))
+        return _loads(get_settings(self.session_obj))
 
     def change_settings(self, settings):
         return Call(change_settings(self.session_obj, self._to_json(settings)))
@@ -322,23 +367,23 @@ class Session(object):
         return Call(bcur_decode(self.session_obj, self._to_json(details)))
 
     def http_request(self, params):
-        return json.loads(http_request(self.session_obj, self._to_json(params)))
+        return _loads(http_request(self.session_obj, self._to_json(params)))
 
     def refresh_assets(self, params):
         return refresh_assets(self.session_obj, self._to_json(params))
 
     def get_assets(self, params):
-        return json.loads(get_assets(self.session_obj, self._to_json(params)))
+        return _loads(get_assets(self.session_obj, self._to_json(params)))
 
     def validate_asset_domain_name(self, params):
-        return json.loads(validate_asset_domain_name(self.session_obj, self._to_json(params)))
+        return _loads(validate_asset_domain_name(self.session_obj, self._to_json(params)))
 
     def validate(self, details):
         return Call(validate(self.session_obj, self._to_json(details)))
 
 _old_get_networks = get_networks
 def get_networks():
-    return json.loads(_old_get_networks())
+    return _loads(_old_get_networks())
 
 _old_register_network = register_network
 def register_network(name, details):
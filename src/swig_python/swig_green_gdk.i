@@ -30,6 +30,7 @@ del swig_import_helper
 #define SWIG_FILE_WITH_INIT
 #include "gdk.h"
 #include <limits.h>
+#include <stdlib.h>
 
 static int gdk_throw(int result, const char* default_message)
 {
@@ -67,23 +68,47 @@ static int check_result(int result)
     return result;
 }
 
+/* Whether GA_json outputs are returned as msgpack bytes instead of strings */
+static int g_use_msgpack = 0;
+
+static int _python_set_use_msgpack(int use_msgpack)
+{
+    g_use_msgpack = use_msgpack;
+    return GA_OK;
+}
+
+/* Conversions between JSON and python objects are done without holding
+ * the GIL, so that converting large inputs and results does not block
+ * other python threads. Python objects are only accessed with the GIL held.
+ */
 static int python_string_to_GA_json(PyObject* in, struct GA_json** out)
 {
+    int result;
     *out = NULL;
 
 #if PY_MAJOR_VERSION >= 3
-    if (!PyUnicode_Check(in)) {
-        PyErr_SetString(PyExc_TypeError, "Expected unicode argument for GA_json");
-        return GA_ERROR;
+    if (!PyUnicode_Check(in) && PyObject_CheckBuffer(in)) {
+        /* msgpack encoded bytes, or any other object exposing a buffer
+         * (e.g. bytearray or memoryview), used in place without copying */
+        Py_buffer view;
+        if (PyObject_GetBuffer(in, &view, PyBUF_SIMPLE) != 0)
+            return GA_ERROR;
+        Py_BEGIN_ALLOW_THREADS
+        result = GA_convert_msgpack_to_json((const unsigned char*)view.buf, view.len, out);
+        Py_END_ALLOW_THREADS
+        PyBuffer_Release(&view);
+        return check_result(result);
     }
 
-    PyObject* utf8_encoded = PyUnicode_AsEncodedString(in, "utf-8", "strict");
-    if (!utf8_encoded) {
-        PyErr_SetString(PyExc_UnicodeEncodeError, "Failed to encode GA_json string as utf-8");
+    if (!PyUnicode_Check(in)) {
+        PyErr_SetString(PyExc_TypeError, "Expected unicode argument for GA_json");
         return GA_ERROR;
     }
 
-    const char* utf8_ntbs = PyBytes_AsString(utf8_encoded);
+    /* The UTF-8 representation is cached by the string object */
+    const char* utf8_ntbs = PyUnicode_AsUTF8(in);
+    if (!utf8_ntbs)
+        return GA_ERROR; /* PyUnicode_AsUTF8 has set an exception */
 #else
     if (!PyString_Check(in)) {
         PyErr_SetString(PyExc_TypeError, "Expected string argument for GA_json");
@@ -93,15 +118,88 @@ static int python_string_to_GA_json(PyObject* in, struct GA_json** out)
     const char* utf8_ntbs = PyString_AsString(in);
 #endif
 
-    const int result = check_result(GA_convert_string_to_json(utf8_ntbs, out));
+    Py_BEGIN_ALLOW_THREADS
+    result = GA_convert_string_to_json(utf8_ntbs, out);
+    Py_END_ALLOW_THREADS
+    return check_result(result);
+}
+
+static void destroy_GA_json(struct GA_json* json)
+{
+    if (json) {
+        Py_BEGIN_ALLOW_THREADS
+        GA_destroy_json(json);
+        Py_END_ALLOW_THREADS
+    }
+}
+
 
+/* Convert GA_json to a python string, or msgpack bytes if enabled */
+static PyObject* GA_json_to_python(const struct GA_json* json)
+{
+    PyObject* ret = NULL;
+    int result;
 #if PY_MAJOR_VERSION >= 3
-    Py_DECREF(utf8_encoded);
+    if (g_use_msgpack) {
+        unsigned char buf[4096];
+        unsigned char* bytes;
+        size_t written = 0;
+
+        Py_BEGIN_ALLOW_THREADS
+        result = GA_convert_json_to_msgpack(json, buf, sizeof(buf), &written);
+        Py_END_ALLOW_THREADS
+        if (check_result(result) != GA_OK)
+            return NULL;
+        if (written <= sizeof(buf))
+            return PyBytes_FromStringAndSize((const char*)buf, written);
+        /* Too large for our buffer: encode directly into the result */
+        if (!(ret = PyBytes_FromStringAndSize(NULL, written)))
+            return NULL;
+        bytes = (unsigned char*)PyBytes_AS_STRING(ret);
+        Py_BEGIN_ALLOW_THREADS
+        result = GA_convert_json_to_msgpack(json, bytes, written, &written);
+        Py_END_ALLOW_THREADS
+        if (check_result(result) != GA_OK) {
+            Py_DecRef(ret);
+            return NULL;
+        }
+        return ret;
+    }
 #endif
-
-    return result;
+    char* str = NULL;
+    Py_BEGIN_ALLOW_THREADS
+    result = GA_convert_json_to_string(json, &str);
+    Py_END_ALLOW_THREADS
+    if (check_result(result) != GA_OK)
+        return NULL;
+    ret = PyString_FromString(str);
+    GA_destroy_string(str);
+    return ret;
 }
 
+#if PY_MAJOR_VERSION >= 3
+/* Encode GA_json as msgpack into an allocated buffer which the caller must
+ * free. Called without the GIL held.
+ */
+static unsigned char* GA_json_to_msgpack_alloc(const struct GA_json* json, size_t* len)
+{
+    unsigned char size_buf[1];
+    unsigned char* bytes;
+    size_t written = 0;
+
+    /* Find the encoded length, then encode */
+    if (GA_convert_json_to_msgpack(json, size_buf, sizeof(size_buf), &written) != GA_OK)
+        return NULL;
+    if (!(bytes = (unsigned char*)malloc(written ? written : 1)))
+        return NULL;
+    if (GA_convert_json_to_msgpack(json, bytes, written, &written) != GA_OK) {
+        free(bytes);
+        return NULL;
+    }
+    *len = written;
+    return bytes;
+}
+#endif
 
 static void* get_from_capsule(PyObject *obj, const char* name)
 {
@@ -119,10 +217,19 @@ static void notification_handler(void* context_p, GA_json* details)
     PyObject* handler_ref = NULL;
     PyObject* handler = NULL;
     char* json_cstring = NULL;
+    unsigned char* msgpack_bytes = NULL;
+    size_t msgpack_len = 0;
 
     if (!session_capsule)
         return;
 
+#if PY_MAJOR_VERSION >= 3
+    if (g_use_msgpack) {
+        /* Pass the notification as msgpack bytes */
+        if (!(msgpack_bytes = GA_json_to_msgpack_alloc(details, &msgpack_len)))
+            return;
+    } else
+#endif
     if (GA_convert_json_to_string(details, &json_cstring) != GA_OK)
         return;
     GA_destroy_json(details);
@@ -144,7 +251,14 @@ static void notification_handler(void* context_p, GA_json* details)
 
     if (handler != Py_None) {
         PyObject *ret;
-        PyObject *args = Py_BuildValue("(Os)", session_capsule, json_cstring);
+        PyObject *args;
+#if PY_MAJOR_VERSION >= 3
+        if (msgpack_bytes) {
+            PyObject *event = PyBytes_FromStringAndSize((const char*)msgpack_bytes, msgpack_len);
+            args = event ? Py_BuildValue("(ON)", session_capsule, event) : NULL;
+        } else
+#endif
+        args = Py_BuildValue("(Os)", session_capsule, json_cstring);
         if (!args)
             goto end;
 
@@ -164,6 +278,7 @@ end:
 
     if (json_cstring)
         GA_destroy_string(json_cstring);
+    free(msgpack_bytes);
 }
 
 static int _python_set_callback_handler(PyObject* obj, PyObject* arg)
@@ -310,18 +425,16 @@ static void _python_destroy_GA_auth_handler(PyObject* obj)
         SWIG_fail;
 }
 %typemap (freearg) GA_json * {
-    GA_destroy_json($1);
+    destroy_GA_json($1);
 }
 %typemap(argout) GA_json ** {
     if (*$1 != NULL) {
         Py_DecRef($result);
-        char* str = NULL;
-        if (check_result(GA_convert_json_to_string(*$1, &str)) != GA_OK) {
+        $result = GA_json_to_python(*$1);
+        destroy_GA_json(*$1);
+        if (!$result) {
             SWIG_fail;
         }
-        $result = PyString_FromString(str);
-        GA_destroy_string(str);
-        GA_destroy_json(*$1);
     }
 }
 %typemap(in, numinputs=0) uint32_t * (uint32_t temp) {
@@ -343,3 +456,4 @@ typedef unsigned int uint32_t;
 
 static int _python_set_callback_handler(PyObject* obj, PyObject* arg);
 static int _python_destroy_session(PyObject* obj);
+static int _python_set_use_msgpack(int use_msgpack);
@@ -3,13 +3,25 @@
 #pragma once
 
 #include "assertion.hpp"
+#include <algorithm>
+#include <atomic>
+#include <exception>
 #include <mutex>
+#include <thread>
+#include <vector>
+#ifdef GDK_PROFILE_LOCKS
+#include <chrono>
+#include <cstring>
+#include <string>
+
+#include "stats.hpp"
+#endif
 
 namespace green {
 
     // Scoped unlocker
-    struct unique_unlock {
-        explicit unique_unlock(std::unique_lock<std::mutex>& locker)
+    template <typename Locker = std::unique_lock<std::mutex>> struct unique_unlock {
+        explicit unique_unlock(Locker& locker)
             : m_locker(locker)
         {
             unlock();
@@ -35,9 +47,137 @@ namespace green {
             m_locker.unlock();
         }
 
-        std::unique_lock<std::mutex>& m_locker;
+        Locker& m_locker;
     };
 
+#ifdef GDK_PROFILE_LOCKS
+    // A mutex whose acquisitions are recorded by profiled_lock
+    class profiled_mutex final {
+    public:
+        profiled_mutex() = default;
+        profiled_mutex(const profiled_mutex&) = delete;
+        profiled_mutex& operator=(const profiled_mutex&) = delete;
+
+        void lock() { m_mutex.lock(); }
+        void unlock() { m_mutex.unlock(); }
+        bool try_lock() { return m_mutex.try_lock(); }
+
+    private:
+        std::mutex m_mutex;
+    };
+
+    // A unique_lock for profiled_mutex that records the time spent waiting
+    // for and holding the mutex as "lock_wait" and "lock_hold" stats, named
+    // by the function and source location that created the lock. Waits on a
+    // std::condition_variable_any release the lock and are not counted as held
+    class profiled_lock final {
+    public:
+        explicit profiled_lock(profiled_mutex& mutex, const char* function = __builtin_FUNCTION(),
+            const char* file = __builtin_FILE(), int line = __builtin_LINE())
+            : m_mutex(mutex)
+            , m_function(function)
+            , m_file(file)
+            , m_line(line)
+            , m_owns(false)
+        {
+            lock();
+        }
+        profiled_lock(const profiled_lock&) = delete;
+        profiled_lock& operator=(const profiled_lock&) = delete;
+
+        ~profiled_lock()
+        {
+            if (m_owns) {
+                unlock();
+            }
+        }
+
+        void lock()
+        {
+            GDK_RUNTIME_ASSERT(!m_owns);
+            const auto start = std::chrono::steady_clock::now();
+            m_mutex.lock();
+            m_locked_at = std::chrono::steady_clock::now();
+            m_owns = true;
+            stats::record("lock_wait", get_site(), m_locked_at - start);
+        }
+
+        void unlock()
+        {
+            GDK_RUNTIME_ASSERT(m_owns);
+            const auto held = std::chrono::steady_clock::now() - m_locked_at;
+            m_owns = false;
+            m_mutex.unlock();
+            stats::record("lock_hold", get_site(), held);
+        }
+
+        bool owns_lock() const noexcept { return m_owns; }
+
+    private:
+        std::string get_site() const
+        {
+            const char* base = std::strrchr(m_file, '/');
+            return std::string(m_function) + " (" + (base ? base + 1 : m_file) + ':' + std::to_string(m_line) + ')';
+        }
+
+        profiled_mutex& m_mutex;
+        const char* m_function;
+        const char* m_file;
+        const int m_line;
+        std::chrono::steady_clock::time_point m_locked_at;
+        bool m_owns;
+    };
+#endif
+
+    // Call fn(i) for each i in [0, n), spread across the available cores.
+    // Each thread processes at least min_per_thread items, so that small
+    // batches run inline on the calling thread. If any call throws, the
+    // remaining items are skipped and the first exception is rethrown.
+    template <typename FN> void parallel_for(size_t n, FN&& fn, size_t min_per_thread = 1)
+    {
+        const size_t max_threads = std::max(std::thread::hardware_concurrency(), 1u);
+        const size_t num_threads = std::min(max_threads, n / std::max(min_per_thread, size_t(1)));
+        if (num_threads <= 1) {
+            for (size_t i = 0; i < n; ++i) {
+                fn(i);
+            }
+            return;
+        }
+
+        std::atomic<size_t> next{ 0 };
+        std::mutex error_mutex;
+        std::exception_ptr error;
+        auto&& worker = [&] {
+            for (size_t i = next++; i < n; i = next++) {
+                try {
+                    fn(i);
+                } catch (...) {
+                    std::unique_lock<std::mutex> locker(error_mutex);
+                    if (!error) {
+                        error = std::current_exception();
+                    }
+                    next = n; // Stop processing further items
+                }
+            }
+        };
+        std::vector<std::thread> threads;
+        threads.reserve(num_threads - 1);
+        for (size_t i = 1; i < num_threads; ++i) {
+            try {
+                threads.emplace_back(worker);
+            } catch (const std::exception&) {
+                break; // Continue with the threads we have
+            }
+        }
+        worker();
+        for (auto& t : threads) {
+            t.join();
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
 } // namespace green
 
 #endif
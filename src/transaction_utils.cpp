@@ -9,6 +9,7 @@
 #include "memory.hpp"
 #include "session_impl.hpp"
 #include "signer.hpp"
+#include "threading.hpp"
 #include "transaction_utils.hpp"
 #include "utils.hpp"
 #include "xpub_hdkey.hpp"
@@ -101,7 +102,7 @@ namespace green {
         static auto segwit_address(const network_parameters& net_params, byte_span_t bytes)
         {
             constexpr uint32_t flags = 0;
-            const auto family = net_params.bech32_prefix();
+            const auto& family = net_params.bech32_prefix();
             char* ret = 0;
             GDK_VERIFY(wally_addr_segwit_from_bytes(bytes.data(), bytes.size(), family.c_str(), flags, &ret));
             return make_string(ret);
@@ -110,7 +111,7 @@ namespace green {
         static auto segwit_address_decode(const network_parameters& net_params, const std::string& addr)
         {
             constexpr uint32_t flags = 0;
-            const auto family = net_params.bech32_prefix();
+            const auto& family = net_params.bech32_prefix();
             std::vector<unsigned char> ret(WALLY_WITNESSSCRIPT_MAX_LEN);
             size_t written;
             bool valid = wally_addr_segwit_to_bytes(addr.c_str(), family.c_str(), flags, &ret[0], ret.size(), &written)
@@ -266,7 +267,7 @@ namespace green {
     std::optional<uint32_t> get_segwit_address_version(const network_parameters& net_params, const std::string& addr)
     {
         std::optional<uint32_t> ret;
-        const auto family = net_params.bech32_prefix();
+        const auto& family = net_params.bech32_prefix();
         if (boost::istarts_with(addr, family)) {
             size_t version;
             if (wally_addr_segwit_get_version(addr.c_str(), family.c_str(), 0, &version) == WALLY_OK) {
@@ -348,7 +349,9 @@ namespace green {
         constexpr uint32_t default_addr_version = 1;
         if (j_uint32(utxo, "version").value_or(default_addr_version) == 0) {
             // Service keys for legacy version 0 addresses are not derived from the user's GA path
-            ga_pub_key = h2b<EC_PUBLIC_KEY_LEN>(net_params.pub_key());
+            const auto& service_pub_key = net_params.pub_key_bytes();
+            GDK_RUNTIME_ASSERT(service_pub_key.size() == ga_pub_key.size());
+            std::copy(service_pub_key.begin(), service_pub_key.end(), ga_pub_key.begin());
         } else {
             ga_pub_key = pubkeys.derive(subaccount, pointer).get_public_key();
         }
@@ -433,12 +436,12 @@ namespace green {
         return script;
     }
 
-    void set_tx_error(nlohmann::json& result, const std::string& error, bool overwrite)
+    void set_tx_error(nlohmann::json& result, std::string_view error, bool overwrite)
     {
         GDK_RUNTIME_ASSERT(!error.empty());
         auto& e = result["error"];
         if (overwrite || e.empty() || e.get<std::string>().empty()) {
-            e = error;
+            e = std::string(error);
         }
         if (!result.contains("transaction_inputs")) {
             // Callers expect to have transaction_inputs present even when an
@@ -663,7 +666,7 @@ namespace green {
     {
         const bool override_network = session.get_network_parameters().network() != net_params.network();
         const bool is_liquid = net_params.is_liquid();
-        const auto blech32_prefix = net_params.blech32_prefix();
+        const auto& blech32_prefix = net_params.blech32_prefix();
 
         try {
             auto address = j_str_or_empty(addressee, "address");
@@ -733,7 +736,7 @@ namespace green {
                 } catch (const user_error& ex) {
                     return ex.what();
                 } catch (const std::exception& ex) {
-                    return res::id_invalid_amount;
+                    return std::string(res::id_invalid_amount);
                 }
             }
 
@@ -753,6 +756,26 @@ namespace green {
         return std::string();
     }
 
+    std::vector<std::string> validate_tx_addressees(
+        session_impl& session, const network_parameters& net_params, nlohmann::json& addressees)
+    {
+        // Validate each element in iteration order, so that malformed
+        // (e.g. non-array) addressees are reported as addressee errors
+        std::vector<nlohmann::json*> elements;
+        for (auto& addressee : addressees) {
+            elements.push_back(&addressee);
+        }
+        // Address decoding and checksum verification dominate for large
+        // batches. Each addressee is only updated by the thread validating it
+        constexpr size_t min_addressees_per_thread = 64;
+        std::vector<std::string> errors(elements.size());
+        parallel_for(
+            elements.size(),
+            [&](size_t i) { errors[i] = validate_tx_addressee(session, net_params, *elements[i]); },
+            min_addressees_per_thread);
+        return errors;
+    }
+
     static void add_tx_output(const network_parameters& net_params, Tx& tx, const nlohmann::json& output)
     {
         const bool is_liquid = net_params.is_liquid();
@@ -944,7 +967,7 @@ namespace green {
         update_tx_size_info(net_params, tx, result);
 
         const bool is_liquid = net_params.is_liquid();
-        const auto policy_asset = net_params.get_policy_asset();
+        const auto& policy_asset = net_params.get_policy_asset();
 
         if (!tx.get_num_inputs() || !tx.get_num_outputs() || !j_str_is_empty(result, "error")) {
             // The tx is not valid/is incomplete
@@ -6,6 +6,7 @@
 #include <memory>
 #include <optional>
 #include <set>
+#include <string_view>
 #include <utility>
 
 #include "amount.hpp"
@@ -59,7 +60,7 @@ namespace green {
     void utxo_remove_wallet_keys(nlohmann::json& utxo);
 
     // Set the error in a transaction, if it hasn't been set already
-    void set_tx_error(nlohmann::json& result, const std::string& error, bool overwrite = false);
+    void set_tx_error(nlohmann::json& result, std::string_view error, bool overwrite = false);
 
     // Add a UTXO to a transaction, and optionally to "transaction_inputs".
     // Sets "sequence" and "user_path" in the source UTXO, and creates dummy
@@ -88,6 +89,12 @@ namespace green {
     std::string validate_tx_addressee(
         session_impl& session, const network_parameters& net_params, nlohmann::json& addressee);
 
+    // Validate an array of addressees, concurrently for large batches.
+    // Returns the error for each addressee, empty if it is valid. The
+    // elements of a non-array value are validated as addressees
+    std::vector<std::string> validate_tx_addressees(
+        session_impl& session, const network_parameters& net_params, nlohmann::json& addressees);
+
     // Add an output from a JSON addressee
     void add_tx_addressee_output(session_impl& session, Tx& tx, nlohmann::json& addressee);
 
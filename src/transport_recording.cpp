@@ -0,0 +1,155 @@
+#include "transport_recording.hpp"
+
+#include <array>
+#include <iterator>
+#include <optional>
+#include <thread>
+
+#include "assertion.hpp"
+#include "exception.hpp"
+#include "json_utils.hpp"
+#include "logging.hpp"
+#include "network_parameters.hpp"
+#include "session.hpp"
+
+namespace green {
+
+    namespace {
+        // Recordings live while any transport is using them
+        static std::mutex s_inst_mutex;
+        static std::map<std::string, std::weak_ptr<transport_recording>> s_instances;
+
+        static std::string get_key(const std::string& type, const std::string& name) { return type + ' ' + name; }
+
+        static int64_t to_us(transport_recording::clock::duration d)
+        {
+            return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+        }
+
+        static transport_recording::clock::duration from_us(int64_t us)
+        {
+            return std::chrono::duration_cast<transport_recording::clock::duration>(std::chrono::microseconds(us));
+        }
+    } // namespace
+
+    transport_recording::transport_recording(const std::string& path, bool is_replay)
+        : m_is_replay(is_replay)
+        , m_speed(gdk_config().value("transport_replay_speed", 1.0))
+        , m_start(clock::now())
+    {
+        GDK_RUNTIME_ASSERT_MSG(m_speed >= 0, "invalid transport_replay_speed");
+        if (m_is_replay) {
+            load(path);
+        } else {
+            m_file.open(path, std::ios::binary | std::ios::trunc);
+            GDK_RUNTIME_ASSERT_MSG(m_file.is_open(), "failed to create transport recording");
+        }
+        GDK_LOG(info) << (m_is_replay ? "replaying transport from " : "recording transport to ") << path;
+    }
+
+    std::shared_ptr<transport_recording> transport_recording::get(
+        const network_parameters& net_params, const std::string& name)
+    {
+        const auto record_dir = j_str_or_empty(gdk_config(), "transport_record_dir");
+        const auto replay_dir = j_str_or_empty(gdk_config(), "transport_replay_dir");
+        if (record_dir.empty() && replay_dir.empty()) {
+            return {};
+        }
+        GDK_RUNTIME_ASSERT_MSG(record_dir.empty() || replay_dir.empty(), "cannot both record and replay transports");
+        const bool is_replay = !replay_dir.empty();
+        const auto path = (is_replay ? replay_dir : record_dir) + '/' + net_params.network() + '_' + name + ".gdkrec";
+
+        std::lock_guard<std::mutex> locker(s_inst_mutex);
+        auto& weak = s_instances[path];
+        auto shared = weak.lock();
+        if (!shared) {
+            weak = shared = std::make_shared<transport_recording>(path, is_replay);
+        }
+        // Remove any expired instances
+        for (auto it = s_instances.begin(); it != s_instances.end();) {
+            it = it->second.expired() ? s_instances.erase(it) : std::next(it);
+        }
+        return shared;
+    }
+
+    transport_recording::clock::duration transport_recording::scale(clock::duration recorded) const
+    {
+        if (m_speed == 0) {
+            return {};
+        }
+        return std::chrono::duration_cast<clock::duration>(recorded / m_speed);
+    }
+
+    void transport_recording::record(
+        const std::string& type, const std::string& name, clock::duration elapsed, nlohmann::json data, bool failed)
+    {
+        GDK_RUNTIME_ASSERT(!m_is_replay);
+        nlohmann::json rec = { { "type", type }, { "name", name }, { "ts", to_us(clock::now() - m_start) },
+            { "us", to_us(elapsed) }, { "data", std::move(data) }, { "failed", failed } };
+        const auto bytes = nlohmann::json::to_msgpack(rec);
+        // Each record is prefixed with its little-endian 32 bit length
+        const uint32_t len = bytes.size();
+        const std::array<char, 4> prefix = { static_cast<char>(len), static_cast<char>(len >> 8),
+            static_cast<char>(len >> 16), static_cast<char>(len >> 24) };
+
+        std::lock_guard<std::mutex> locker(m_mutex);
+        m_file.write(prefix.data(), prefix.size());
+        m_file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+        m_file.flush(); // Keep the recording usable if the process is killed
+    }
+
+    nlohmann::json transport_recording::replay(
+        const std::string& type, const std::string& name, clock::time_point start)
+    {
+        GDK_RUNTIME_ASSERT(m_is_replay);
+        result r;
+        {
+            std::lock_guard<std::mutex> locker(m_mutex);
+            auto p = m_results.find(get_key(type, name));
+            GDK_RUNTIME_ASSERT_MSG(p != m_results.end() && !p->second.empty(), "no recorded result for " + name);
+            r = std::move(p->second.front());
+            p->second.pop_front();
+        }
+        std::this_thread::sleep_until(start + scale(r.elapsed));
+        if (r.failed) {
+            // The original error type is not recorded, only its message
+            throw user_error(r.data.get<std::string>());
+        }
+        return std::move(r.data);
+    }
+
+    void transport_recording::load(const std::string& path)
+    {
+        std::ifstream f(path, std::ios::binary);
+        GDK_RUNTIME_ASSERT_MSG(f.is_open(), "failed to open transport recording");
+        const std::vector<unsigned char> bytes{ std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>() };
+
+        std::optional<int64_t> first_subscribe_us;
+        size_t num_results = 0;
+        for (size_t pos = 0; pos < bytes.size();) {
+            GDK_RUNTIME_ASSERT_MSG(bytes.size() - pos >= 4, "truncated transport recording");
+            const uint32_t len = bytes[pos] | bytes[pos + 1] << 8 | bytes[pos + 2] << 16 | bytes[pos + 3] << 24;
+            pos += 4;
+            GDK_RUNTIME_ASSERT_MSG(bytes.size() - pos >= len, "truncated transport recording");
+            auto rec = nlohmann::json::from_msgpack(bytes.begin() + pos, bytes.begin() + pos + len);
+            pos += len;
+
+            const std::string type = rec.at("type");
+            const int64_t ts = rec.at("ts");
+            if (type == "subscribe") {
+                if (!first_subscribe_us) {
+                    first_subscribe_us = ts;
+                }
+            } else if (type == "event") {
+                GDK_RUNTIME_ASSERT(first_subscribe_us.has_value());
+                m_events.push_back({ rec.at("name"), from_us(ts - *first_subscribe_us), std::move(rec["data"]) });
+            } else {
+                m_results[get_key(type, rec.at("name"))].push_back(
+                    { from_us(rec.at("us")), std::move(rec["data"]), rec.at("failed") });
+                ++num_results;
+            }
+        }
+        GDK_LOG(info) << "loaded " << num_results << " results and " << m_events.size() << " events";
+    }
+
+} // namespace green
@@ -0,0 +1,89 @@
+#ifndef GDK_TRANSPORT_RECORDING_HPP
+#define GDK_TRANSPORT_RECORDING_HPP
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+namespace green {
+
+    class network_parameters;
+
+    // A recording of the call results and events seen by a transport.
+    //
+    // When the "transport_record_dir" GA_init config key is set, results
+    // and events are appended to a file as they occur. When
+    // "transport_replay_dir" is set instead, a previous recording is served
+    // in place of the network: calls of each name return their recorded
+    // results in order after their recorded latency, and events are delivered
+    // at their recorded offsets. Latencies and offsets are divided by
+    // "transport_replay_speed" (default 1.0); a speed of 0 replays without
+    // any delay.
+    class transport_recording final {
+    public:
+        using clock = std::chrono::steady_clock;
+
+        // An event, timed from the first subscription of the recording
+        struct event final {
+            std::string topic;
+            clock::duration offset;
+            nlohmann::json data;
+        };
+
+        transport_recording(const std::string& path, bool is_replay);
+        transport_recording(const transport_recording&) = delete;
+        transport_recording& operator=(const transport_recording&) = delete;
+
+        // Get the shared recording for the given transport name, or null
+        // if neither recording nor replaying is enabled
+        static std::shared_ptr<transport_recording> get(const network_parameters& net_params, const std::string& name);
+
+        bool is_replay() const { return m_is_replay; }
+
+        // Replay speed scaling of a recorded duration
+        clock::duration scale(clock::duration recorded) const;
+
+        // Recording: append a call result, subscription or event
+        void record(const std::string& type, const std::string& name, clock::duration elapsed, nlohmann::json data,
+            bool failed);
+
+        // Replaying: return the next recorded result for a call of the
+        // given type and name made at start, waiting out its latency.
+        // Recorded failures are thrown as user_error.
+        nlohmann::json replay(const std::string& type, const std::string& name, clock::time_point start);
+
+        // Replaying: all recorded events in the order received
+        const std::vector<event>& get_events() const { return m_events; }
+
+    private:
+        struct result final {
+            clock::duration elapsed;
+            nlohmann::json data;
+            bool failed;
+        };
+
+        void load(const std::string& path);
+
+        const bool m_is_replay;
+        const double m_speed;
+        const clock::time_point m_start;
+
+        // This mutex protects the following members
+        std::mutex m_mutex;
+        std::ofstream m_file;
+        // Unconsumed results, keyed by type and name
+        std::map<std::string, std::deque<result>> m_results;
+        // Immutable after loading
+        std::vector<event> m_events;
+    };
+
+} // namespace green
+
+#endif
@@ -10,10 +10,14 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <chrono>
+#include <cstring>
 #include <functional>
 #include <iostream>
+#include <limits>
 #include <memory>
 #include <mutex>
 #include <thread>
@@ -46,6 +50,8 @@
 #include "memory.hpp"
 #include "network_parameters.hpp"
 #include "signer.hpp"
+#include "stats.hpp"
+#include "threading.hpp"
 #include "utils.hpp"
 #include "xpub_hdkey.hpp"
 #include <zlib.h>
@@ -178,19 +184,31 @@ namespace green {
 
         static nlohmann::json rust_call_impl(const std::string& method, const nlohmann::json& input, void* session)
         {
-            char* output = nullptr;
+            stats::timer timer(session ? "rust_call" : "rust_global_call", method);
+            const auto input_str = input.dump();
+            nlohmann::json cppjson = nlohmann::json();
             int ret;
             if (session) {
-                ret = GDKRUST_call_session(session, method.c_str(), input.dump().c_str(), &output);
+                // Session calls return msgpack, avoiding a C string copy and re-parse
+                const auto input_bytes = reinterpret_cast<const unsigned char*>(input_str.data());
+                unsigned char* output = nullptr;
+                size_t output_len = 0;
+                ret = GDKRUST_call_session_bin(
+                    session, method.c_str(), input_bytes, input_str.size(), &output, &output_len);
+                if (output) {
+                    auto&& destroy = [output_len](unsigned char* p) { GDKRUST_destroy_buffer(p, output_len); };
+                    std::unique_ptr<unsigned char, decltype(destroy)> holder(output, destroy);
+                    cppjson = nlohmann::json::from_msgpack(output, output + output_len);
+                }
             } else {
-                ret = GDKRUST_call(method.c_str(), input.dump().c_str(), &output);
-            }
-            nlohmann::json cppjson = nlohmann::json();
-            if (output) {
-                // output was set by calling `std::ffi::CString::into_raw`;
-                // parse it, then destroy it with GDKRUST_destroy_string.
-                std::unique_ptr<char, decltype(&GDKRUST_destroy_string)> holder(output, GDKRUST_destroy_string);
-                cppjson = json_parse(output);
+                char* output = nullptr;
+                ret = GDKRUST_call(method.c_str(), input_str.c_str(), &output);
+                if (output) {
+                    // output was set by calling `std::ffi::CString::into_raw`;
+                    // parse it, then destroy it with GDKRUST_destroy_string.
+                    std::unique_ptr<char, decltype(&GDKRUST_destroy_string)> holder(output, GDKRUST_destroy_string);
+                    cppjson = json_parse(output);
+                }
             }
             check_rust_return_code(ret, cppjson);
             return cppjson;
@@ -252,7 +270,7 @@ namespace green {
             = { "in_progress", "verified", "not_verified", "disabled", "not_longest", "unconfirmed" };
         static constexpr size_t SPV_STATUS_DISABLED = 3;
 
-        void write_length32(uint32_t len, std::vector<unsigned char>::iterator it)
+        template <typename IT> void write_length32(uint32_t len, IT it)
         {
             *it++ = (unsigned char)(len >> 0);
             *it++ = (unsigned char)(len >> 8);
@@ -575,13 +593,13 @@ namespace green {
             + std::to_string(subaccount);
     }
 
-    std::vector<unsigned char> compress(byte_span_t prefix, byte_span_t bytes)
+    secure_bytes_t compress(byte_span_t prefix, byte_span_t bytes)
     {
         const size_t prefix_len = prefix.size();
         const size_t bytes_len = bytes.size();
         uLongf compressed_len = compressBound(bytes_len);
 
-        std::vector<unsigned char> result;
+        secure_bytes_t result;
         // Initialise result with supplied prefix bytes and decompressed length
         result.resize(prefix_len + sizeof(uint32_t) + compressed_len);
         std::copy(prefix.begin(), prefix.end(), result.begin());
@@ -597,7 +615,7 @@ namespace green {
         return result;
     }
 
-    std::vector<unsigned char> decompress(byte_span_t bytes)
+    secure_bytes_t decompress(byte_span_t bytes)
     {
         constexpr size_t minimum_compressed_size = 11;
         const size_t bytes_len = bytes.size();
@@ -606,7 +624,7 @@ namespace green {
         uLongf decompressed_len
             = (uint32_t)bytes[0] << 0 | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24;
 
-        std::vector<unsigned char> result;
+        secure_bytes_t result;
         result.resize(decompressed_len);
         int z_result = uncompress2(result.data(), &decompressed_len, bytes.data() + sizeof(uint32_t), &compressed_len);
         if (z_result != Z_OK || compressed_len + sizeof(uint32_t) != bytes_len) {
@@ -620,6 +638,25 @@ namespace green {
     namespace {
         constexpr int AES_GCM_TAG_SIZE = 16;
         constexpr int AES_GCM_IV_SIZE = 12;
+
+        // Chunked AES-GCM container layout:
+        //   header: "GDKC", version, chunk size shift, 2 zero bytes,
+        //           LE64 plaintext length, 32 byte random salt
+        //   header tag: GCM tag of the header as AAD with an all 0xff IV
+        //   chunks: the cyphertext and GCM tag of each plaintext chunk
+        // Chunks are encrypted under HMAC-SHA256(key, salt) with their index
+        // as IV, so IVs are never reused, and with the header as AAD.
+        // Chunks cannot be reordered or truncated, since each index is
+        // authenticated and the header fixes the total length.
+        constexpr std::array<unsigned char, 4> AES_GCM_CHUNKED_MAGIC = { 'G', 'D', 'K', 'C' };
+        constexpr unsigned char AES_GCM_CHUNKED_VERSION = 1;
+        constexpr unsigned char AES_GCM_CHUNK_SHIFT = 16; // 64K chunks
+        constexpr uint64_t AES_GCM_HEADER_IV_INDEX = std::numeric_limits<uint64_t>::max();
+        constexpr size_t AES_GCM_SALT_SIZE = 32;
+        constexpr size_t AES_GCM_CHUNKED_HEADER_SIZE = 4 + 1 + 1 + 2 + 8 + AES_GCM_SALT_SIZE;
+        constexpr size_t AES_GCM_CHUNKED_PREFIX_SIZE = AES_GCM_CHUNKED_HEADER_SIZE + AES_GCM_TAG_SIZE;
+        // The number of chunks encrypted at once before being written
+        constexpr size_t AES_GCM_CHUNKS_PER_BATCH = 64;
     } // namespace
     using EVP_CIPHER_CTX_ptr = const std::unique_ptr<EVP_CIPHER_CTX, decltype(&::EVP_CIPHER_CTX_free)>;
 
@@ -679,6 +716,164 @@ namespace green {
         return n + n_final;
     }
 
+    size_t aes_gcm_decrypt_in_place(byte_span_t key, gsl::span<unsigned char> data)
+    {
+        // OpenSSL supports decrypting GCM in place when input and output are identical
+        const size_t plaintext_size = aes_gcm_decrypt_get_length(data);
+        const auto plaintext = data.subspan(AES_GCM_IV_SIZE, plaintext_size);
+        GDK_RUNTIME_ASSERT(aes_gcm_decrypt(key, data, plaintext) == plaintext_size);
+        std::memmove(data.data(), plaintext.data(), plaintext_size);
+        return plaintext_size;
+    }
+
+    namespace {
+        static size_t get_num_chunks(size_t plaintext_len, size_t chunk_size)
+        {
+            return (plaintext_len + chunk_size - 1) / chunk_size;
+        }
+
+        // Encrypt or decrypt len bytes of one chunk in to out, with the given
+        // AAD. in and out may be the same. Returns false if decryption fails.
+        static bool aes_gcm_chunk_crypt(bool encrypt, byte_span_t key, uint64_t index, byte_span_t aad,
+            const unsigned char* in, size_t len, unsigned char* out, unsigned char* tag)
+        {
+            // IV: 4 zero bytes followed by the BE64 chunk index
+            std::array<unsigned char, AES_GCM_IV_SIZE> iv{};
+            for (size_t i = 0; i < sizeof(index); ++i) {
+                iv[AES_GCM_IV_SIZE - 1 - i] = static_cast<unsigned char>(index >> (i * 8));
+            }
+            EVP_CIPHER_CTX_ptr ctx{ EVP_CIPHER_CTX_new(), EVP_CIPHER_CTX_free };
+            std::array<unsigned char, AES_GCM_TAG_SIZE> unused; // GCM final produces no output
+            int n;
+            if (encrypt) {
+                OPENSSL_VERIFY(EVP_EncryptInit_ex(ctx.get(), EVP_aes_256_gcm(), NULL, key.data(), iv.data()));
+                OPENSSL_VERIFY(EVP_EncryptUpdate(ctx.get(), NULL, &n, aad.data(), aad.size()));
+                if (len) {
+                    OPENSSL_VERIFY(EVP_EncryptUpdate(ctx.get(), out, &n, in, len));
+                }
+                OPENSSL_VERIFY(EVP_EncryptFinal_ex(ctx.get(), unused.data(), &n));
+                OPENSSL_VERIFY(EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_GCM_GET_TAG, AES_GCM_TAG_SIZE, tag));
+                return true;
+            }
+            OPENSSL_VERIFY(EVP_DecryptInit_ex(ctx.get(), EVP_aes_256_gcm(), NULL, key.data(), iv.data()));
+            OPENSSL_VERIFY(EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_GCM_SET_TAG, AES_GCM_TAG_SIZE, tag));
+            OPENSSL_VERIFY(EVP_DecryptUpdate(ctx.get(), NULL, &n, aad.data(), aad.size()));
+            if (len) {
+                OPENSSL_VERIFY(EVP_DecryptUpdate(ctx.get(), out, &n, in, len));
+            }
+            return EVP_DecryptFinal_ex(ctx.get(), unused.data(), &n) == 1;
+        }
+
+        static auto get_chunked_key(byte_span_t key, byte_span_t header)
+        {
+            GDK_RUNTIME_ASSERT(key.size() == SHA256_LEN);
+            const auto salt = header.subspan(AES_GCM_CHUNKED_HEADER_SIZE - AES_GCM_SALT_SIZE, AES_GCM_SALT_SIZE);
+            return hmac_sha256(key, salt);
+        }
+
+        // Returns the chunk size and plaintext length from a valid header
+        static std::pair<size_t, uint64_t> parse_chunked_header(byte_span_t data)
+        {
+            GDK_RUNTIME_ASSERT(static_cast<size_t>(data.size()) >= AES_GCM_CHUNKED_PREFIX_SIZE);
+            GDK_RUNTIME_ASSERT(std::equal(AES_GCM_CHUNKED_MAGIC.begin(), AES_GCM_CHUNKED_MAGIC.end(), data.begin()));
+            GDK_RUNTIME_ASSERT(data[4] == AES_GCM_CHUNKED_VERSION);
+            const unsigned char shift = data[5];
+            GDK_RUNTIME_ASSERT(shift >= 10 && shift <= 30);
+            uint64_t plaintext_len = 0;
+            for (size_t i = 0; i < sizeof(plaintext_len); ++i) {
+                plaintext_len |= static_cast<uint64_t>(data[8 + i]) << (i * 8);
+            }
+            return { size_t(1) << shift, plaintext_len };
+        }
+    } // namespace
+
+    bool aes_gcm_chunked_encrypt(
+        byte_span_t key, byte_span_t plaintext, const std::function<bool(byte_span_t)>& write_fn)
+    {
+        const size_t chunk_size = size_t(1) << AES_GCM_CHUNK_SHIFT;
+        const size_t num_chunks = get_num_chunks(plaintext.size(), chunk_size);
+        GDK_RUNTIME_ASSERT(num_chunks != 0);
+
+        std::vector<unsigned char> header(AES_GCM_CHUNKED_PREFIX_SIZE);
+        std::copy(AES_GCM_CHUNKED_MAGIC.begin(), AES_GCM_CHUNKED_MAGIC.end(), header.begin());
+        header[4] = AES_GCM_CHUNKED_VERSION;
+        header[5] = AES_GCM_CHUNK_SHIFT;
+        for (size_t i = 0; i < sizeof(uint64_t); ++i) {
+            header[8 + i] = static_cast<unsigned char>(static_cast<uint64_t>(plaintext.size()) >> (i * 8));
+        }
+        get_random_bytes(AES_GCM_SALT_SIZE, header.data() + AES_GCM_CHUNKED_HEADER_SIZE - AES_GCM_SALT_SIZE,
+            AES_GCM_SALT_SIZE);
+        const auto aad = gsl::make_span(header).first(AES_GCM_CHUNKED_HEADER_SIZE);
+        auto chunked_key = get_chunked_key(key, aad);
+        aes_gcm_chunk_crypt(true, chunked_key, AES_GCM_HEADER_IV_INDEX, aad, nullptr, 0, nullptr,
+            header.data() + AES_GCM_CHUNKED_HEADER_SIZE);
+        bool written = write_fn(header);
+
+        // Encrypt batches of chunks in parallel, writing each batch in turn
+        std::vector<unsigned char> batch;
+        for (size_t first = 0; written && first < num_chunks; first += AES_GCM_CHUNKS_PER_BATCH) {
+            const size_t n = std::min(num_chunks - first, AES_GCM_CHUNKS_PER_BATCH);
+            const size_t last_len = std::min(plaintext.size() - (first + n - 1) * chunk_size, chunk_size);
+            batch.resize((n - 1) * (chunk_size + AES_GCM_TAG_SIZE) + last_len + AES_GCM_TAG_SIZE);
+            parallel_for(n, [&](size_t i) {
+                const size_t offset = (first + i) * chunk_size;
+                const size_t len = std::min(plaintext.size() - offset, chunk_size);
+                unsigned char* out = batch.data() + i * (chunk_size + AES_GCM_TAG_SIZE);
+                aes_gcm_chunk_crypt(true, chunked_key, first + i, aad, plaintext.data() + offset, len, out, out + len);
+            });
+            written = write_fn(batch);
+        }
+        wally_bzero(chunked_key.data(), chunked_key.size());
+        return written;
+    }
+
+    bool is_aes_gcm_chunked(byte_span_t key, byte_span_t data)
+    {
+        if (static_cast<size_t>(data.size()) < AES_GCM_CHUNKED_PREFIX_SIZE
+            || !std::equal(AES_GCM_CHUNKED_MAGIC.begin(), AES_GCM_CHUNKED_MAGIC.end(), data.begin())) {
+            return false;
+        }
+        const auto aad = data.first(AES_GCM_CHUNKED_HEADER_SIZE);
+        auto chunked_key = get_chunked_key(key, aad);
+        std::array<unsigned char, AES_GCM_TAG_SIZE> tag;
+        std::copy_n(data.begin() + AES_GCM_CHUNKED_HEADER_SIZE, tag.size(), tag.begin());
+        const bool is_valid
+            = aes_gcm_chunk_crypt(false, chunked_key, AES_GCM_HEADER_IV_INDEX, aad, nullptr, 0, nullptr, tag.data());
+        wally_bzero(chunked_key.data(), chunked_key.size());
+        return is_valid;
+    }
+
+    size_t aes_gcm_chunked_decrypt_in_place(byte_span_t key, gsl::span<unsigned char> data)
+    {
+        GDK_RUNTIME_ASSERT(is_aes_gcm_chunked(key, data));
+        const auto [chunk_size, plaintext_len] = parse_chunked_header(data);
+        GDK_RUNTIME_ASSERT(plaintext_len != 0 && plaintext_len <= static_cast<size_t>(data.size()));
+        const size_t num_chunks = get_num_chunks(plaintext_len, chunk_size);
+        GDK_RUNTIME_ASSERT(static_cast<size_t>(data.size())
+            == AES_GCM_CHUNKED_PREFIX_SIZE + plaintext_len + num_chunks * AES_GCM_TAG_SIZE);
+
+        const std::vector<unsigned char> aad(data.begin(), data.begin() + AES_GCM_CHUNKED_HEADER_SIZE);
+        auto chunked_key = get_chunked_key(key, aad);
+        unsigned char* chunks = data.data() + AES_GCM_CHUNKED_PREFIX_SIZE;
+        auto&& chunk_len = [&](size_t i) { return std::min<size_t>(plaintext_len - i * chunk_size, chunk_size); };
+        std::atomic<bool> is_valid{ true };
+        // Decrypt every chunk in place in parallel
+        parallel_for(num_chunks, [&](size_t i) {
+            unsigned char* p = chunks + i * (chunk_size + AES_GCM_TAG_SIZE);
+            const size_t len = chunk_len(i);
+            if (!aes_gcm_chunk_crypt(false, chunked_key, i, aad, p, len, p, p + len)) {
+                is_valid = false;
+            }
+        });
+        wally_bzero(chunked_key.data(), chunked_key.size());
+        GDK_RUNTIME_ASSERT_MSG(is_valid, "chunked decryption failed");
+        // Then move the plaintext chunks together at the start of data
+        for (size_t i = 0; i < num_chunks; ++i) {
+            std::memmove(data.data() + i * chunk_size, chunks + i * (chunk_size + AES_GCM_TAG_SIZE), chunk_len(i));
+        }
+        return plaintext_len;
+    }
+
     static EVP_PKEY* pubkey_from_pem(std::string_view pem)
     {
         using BIO_ptr = std::unique_ptr<BIO, decltype(&BIO_free)>;
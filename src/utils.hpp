@@ -4,12 +4,14 @@
 #pragma once
 
 #include <cstddef>
+#include <functional>
 #include <string>
 
 #include "ga_wally.hpp"
 #include "gdk.h"
 #include "json_utils.hpp"
 #include "logging.hpp"
+#include "memory.hpp"
 
 namespace green {
 
@@ -113,16 +115,31 @@ namespace green {
 
     size_t aes_gcm_decrypt_get_length(byte_span_t cyphertext);
     size_t aes_gcm_decrypt(byte_span_t key, byte_span_t cyphertext, gsl::span<unsigned char> plaintext);
+    // Decrypt in place, moving the plaintext to the start of data. Returns the plaintext length
+    size_t aes_gcm_decrypt_in_place(byte_span_t key, gsl::span<unsigned char> data);
     size_t aes_gcm_encrypt_get_length(byte_span_t plaintext);
     size_t aes_gcm_encrypt(byte_span_t key, byte_span_t plaintext, gsl::span<unsigned char> cyphertext);
 
+    // Chunked AES-GCM, for large payloads. The plaintext is split into
+    // independently encrypted chunks under a per-container key, which are
+    // encrypted and decrypted across cores. Encrypted output is passed to
+    // write_fn in order, in batches of bounded size; returns false if any
+    // call to write_fn returns false.
+    bool aes_gcm_chunked_encrypt(
+        byte_span_t key, byte_span_t plaintext, const std::function<bool(byte_span_t)>& write_fn);
+    // Returns true if data starts with a chunked container header
+    // authenticated by key. Legacy single AES-GCM data returns false.
+    bool is_aes_gcm_chunked(byte_span_t key, byte_span_t data);
+    // Decrypt in place, moving the plaintext to the start of data. Returns the plaintext length
+    size_t aes_gcm_chunked_decrypt_in_place(byte_span_t key, gsl::span<unsigned char> data);
+
     // Verify an RSA challenge. Throws on error.
     void rsa_verify_challenge(std::string_view pem, byte_span_t challenge, byte_span_t sig);
 
-    // Return prefix followed by compressed `bytes`
-    std::vector<unsigned char> compress(byte_span_t prefix, byte_span_t bytes);
-    // Return decompressed `bytes` (prefix is assumed removed by the caller)
-    std::vector<unsigned char> decompress(byte_span_t bytes);
+    // Return prefix followed by compressed `bytes`, in secure memory
+    secure_bytes_t compress(byte_span_t prefix, byte_span_t bytes);
+    // Return decompressed `bytes` (prefix is assumed removed by the caller), in secure memory
+    secure_bytes_t decompress(byte_span_t bytes);
 
     std::string get_wallet_hash_id(const std::string& chain_code_hex, const std::string& public_key_hex,
         bool is_mainnet, const std::string& network);
@@ -0,0 +1,198 @@
+#include "utxo_record.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+#include <nlohmann/json.hpp>
+
+#include "assertion.hpp"
+#include "exception.hpp"
+#include "json_utils.hpp"
+
+namespace green {
+
+    namespace {
+        static std::string_view get_address_type(const nlohmann::json& utxo)
+        {
+            const auto p = utxo.find("address_type");
+            return p == utxo.end() ? std::string_view() : std::string_view(p->get_ref<const std::string&>());
+        }
+
+        template <typename It, typename Fn>
+        static void select_records(
+            It begin, It end, const utxo_records_t& records, const Fn& filter, utxo_records_t& selected)
+        {
+            for (auto it = begin; it != end; ++it) {
+                const auto& record = records[*it];
+                if (!filter(record)) {
+                    selected.push_back(record);
+                }
+            }
+        }
+    } // namespace
+
+    utxo_record::utxo_record(const nlohmann::json& utxo, size_t index)
+        : satoshi(j_amountref(utxo).value())
+        , block_height(j_uint32_or_zero(utxo, "block_height"))
+        , expiry_height(j_uint32_or_zero(utxo, "expiry_height"))
+        , user_status(j_uint32_or_zero(utxo, "user_status"))
+        , is_blinded(j_bool_or_false(utxo, "is_blinded"))
+        , address_type(get_address_type(utxo))
+        , index(index)
+    {
+    }
+
+    utxo_sorter::utxo_sorter(const std::string& sort_by)
+    {
+        if (sort_by == "oldest") {
+            m_sort_by = sort_by_t::OLDEST;
+        } else if (sort_by == "newest") {
+            m_sort_by = sort_by_t::NEWEST;
+        } else if (sort_by == "largest") {
+            m_sort_by = sort_by_t::LARGEST;
+        } else if (sort_by == "smallest") {
+            m_sort_by = sort_by_t::SMALLEST;
+        } else {
+            throw user_error("invalid \"sort_by\" value");
+        }
+    }
+
+    bool utxo_sorter::compare_blockheight(const utxo_record& lhs, const utxo_record& rhs)
+    {
+        const uint32_t max_bh = 0xffffffff;
+        const auto lhs_bh = lhs.block_height;
+        const auto rhs_bh = rhs.block_height;
+        return (lhs_bh ? lhs_bh : max_bh) < (rhs_bh ? rhs_bh : max_bh);
+    }
+
+    bool utxo_sorter::operator()(const utxo_record& lhs, const utxo_record& rhs) const
+    {
+        switch (m_sort_by) {
+        case sort_by_t::OLDEST:
+            return compare_blockheight(lhs, rhs);
+        case sort_by_t::NEWEST:
+            return compare_blockheight(rhs, lhs);
+        case sort_by_t::LARGEST:
+            return rhs.satoshi < lhs.satoshi;
+        case sort_by_t::SMALLEST:
+            return lhs.satoshi < rhs.satoshi;
+        }
+        return false; // Unreachable
+    }
+
+    utxo_index::utxo_index(const nlohmann::json& asset_utxos)
+    {
+        for (const auto& asset : asset_utxos.items()) {
+            if (asset.key() == "error") {
+                continue;
+            }
+            auto& index = m_assets[asset.key()];
+            index.records = make_utxo_records(asset.value());
+            const auto& records = index.records;
+            GDK_RUNTIME_ASSERT(records.size() <= 0xffffffff);
+            index.by_height.resize(records.size());
+            std::iota(index.by_height.begin(), index.by_height.end(), 0);
+            index.by_value = index.by_height;
+            // Stable sorts give a deterministic order for equal keys. The
+            // newest and largest orders are the reverse of these orders
+            std::stable_sort(index.by_height.begin(), index.by_height.end(),
+                [&records](uint32_t lhs, uint32_t rhs) {
+                    return utxo_sorter::compare_blockheight(records[lhs], records[rhs]);
+                });
+            std::stable_sort(index.by_value.begin(), index.by_value.end(),
+                [&records](uint32_t lhs, uint32_t rhs) { return records[lhs].satoshi < records[rhs].satoshi; });
+        }
+    }
+
+    utxo_records_t utxo_index::select(const std::string& asset_id, const utxo_sorter& sorter,
+        amount::value_type dust_limit, const filter_fn_t& filter) const
+    {
+        utxo_records_t selected;
+        const auto p = m_assets.find(asset_id);
+        if (p == m_assets.end()) {
+            return selected;
+        }
+        const auto& records = p->second.records;
+        const auto& by_height = p->second.by_height;
+        const auto& by_value = p->second.by_value;
+        // Records with a value at or below the dust limit form a prefix of
+        // the value order; only the range above it needs to be scanned
+        auto&& above_dust = [&](const utxo_record& u) { return !dust_limit || u.satoshi > dust_limit; };
+        const auto dust_end = std::partition_point(
+            by_value.begin(), by_value.end(), [&](uint32_t i) { return !above_dust(records[i]); });
+        auto&& filter_all = [&](const utxo_record& u) { return !above_dust(u) || filter(u); };
+
+        switch (sorter.m_sort_by) {
+        case utxo_sorter::sort_by_t::OLDEST:
+            select_records(by_height.begin(), by_height.end(), records, filter_all, selected);
+            break;
+        case utxo_sorter::sort_by_t::NEWEST:
+            select_records(by_height.rbegin(), by_height.rend(), records, filter_all, selected);
+            break;
+        case utxo_sorter::sort_by_t::LARGEST:
+            select_records(by_value.rbegin(), std::make_reverse_iterator(dust_end), records, filter, selected);
+            break;
+        case utxo_sorter::sort_by_t::SMALLEST:
+            select_records(dust_end, by_value.end(), records, filter, selected);
+            break;
+        }
+        return selected;
+    }
+
+    utxo_records_t make_utxo_records(const nlohmann::json& utxos)
+    {
+        utxo_records_t records;
+        records.reserve(utxos.size());
+        for (size_t i = 0; i < utxos.size(); ++i) {
+            records.emplace_back(utxos[i], i);
+        }
+        return records;
+    }
+
+    void apply_utxo_records(nlohmann::json& utxos, const utxo_records_t& records)
+    {
+        auto& src = utxos.get_ref<nlohmann::json::array_t&>();
+        nlohmann::json::array_t result;
+        result.reserve(records.size());
+        for (const auto& record : records) {
+            GDK_RUNTIME_ASSERT(record.index < src.size());
+            result.emplace_back(std::move(src[record.index]));
+        }
+        src.swap(result);
+    }
+
+    nlohmann::json copy_utxo_records(const nlohmann::json& utxos, const utxo_records_t& records)
+    {
+        const auto& src = utxos.get_ref<const nlohmann::json::array_t&>();
+        nlohmann::json::array_t result;
+        result.reserve(records.size());
+        for (const auto& record : records) {
+            GDK_RUNTIME_ASSERT(record.index < src.size());
+            result.emplace_back(src[record.index]);
+        }
+        return result;
+    }
+
+    nlohmann::json get_utxo_balances(const nlohmann::json& asset_utxos, bool all_coins)
+    {
+        nlohmann::json balances = nlohmann::json::object();
+        for (const auto& asset : asset_utxos.items()) {
+            if (asset.key() == "error") {
+                continue;
+            }
+            bool have_utxo = false;
+            amount::value_type satoshi = 0;
+            for (const auto& utxo : asset.value()) {
+                if (all_coins || j_uint32_or_zero(utxo, "user_status") != USER_STATUS_FROZEN) {
+                    have_utxo = true;
+                    satoshi += j_amountref(utxo).value();
+                }
+            }
+            if (have_utxo) {
+                balances[asset.key()] = satoshi;
+            }
+        }
+        return balances;
+    }
+
+} // namespace green
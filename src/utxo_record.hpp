@@ -0,0 +1,93 @@
+#ifndef GDK_UTXO_RECORD_HPP
+#define GDK_UTXO_RECORD_HPP
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <nlohmann/json_fwd.hpp>
+
+#include "amount.hpp"
+
+namespace green {
+
+    // UTXO user_status values from the Green server
+    constexpr uint32_t USER_STATUS_DEFAULT = 0;
+    constexpr uint32_t USER_STATUS_FROZEN = 1;
+
+    // A compact view of the fields of a UTXO JSON object that are used when
+    // filtering, sorting and selecting UTXOs. Records refer to their source
+    // UTXO by index, and must not outlive the UTXO JSON they were made from.
+    struct utxo_record final {
+        utxo_record(const nlohmann::json& utxo, size_t index);
+
+        amount::value_type satoshi;
+        uint32_t block_height; // 0 if unconfirmed
+        uint32_t expiry_height; // 0 if non-expiring
+        uint32_t user_status;
+        bool is_blinded;
+        std::string_view address_type; // Refers to the source UTXO's string
+        size_t index; // The index of the source UTXO in its array
+    };
+
+    using utxo_records_t = std::vector<utxo_record>;
+
+    // Orders UTXO records according to a "sort_by" value
+    struct utxo_sorter final {
+        enum class sort_by_t : size_t { OLDEST = 0, NEWEST, LARGEST, SMALLEST };
+
+        explicit utxo_sorter(const std::string& sort_by);
+
+        // Compare by block height, treating unconfirmed UTXOs as the newest
+        static bool compare_blockheight(const utxo_record& lhs, const utxo_record& rhs);
+
+        bool operator()(const utxo_record& lhs, const utxo_record& rhs) const;
+
+        sort_by_t m_sort_by;
+    };
+
+    // Sorted orderings of UTXOs grouped by asset id, built once when cached
+    // UTXOs change so that queries can select UTXOs in any sort order
+    // without sorting them again. Like records, an index must not outlive
+    // the UTXO JSON it was made from.
+    struct utxo_index final {
+        // Returns true if a record should be excluded from a selection
+        using filter_fn_t = std::function<bool(const utxo_record&)>;
+
+        explicit utxo_index(const nlohmann::json& asset_utxos);
+
+        // Return the records of an asset's UTXOs that have a value above
+        // dust_limit and are not excluded by filter, in sort order
+        utxo_records_t select(const std::string& asset_id, const utxo_sorter& sorter,
+            amount::value_type dust_limit, const filter_fn_t& filter) const;
+
+    private:
+        struct asset_index final {
+            utxo_records_t records; // In UTXO array order
+            std::vector<uint32_t> by_height; // Positions in records, oldest first
+            std::vector<uint32_t> by_value; // Positions in records, smallest first
+        };
+        std::map<std::string, asset_index> m_assets;
+    };
+
+    // Make records for an array of UTXO JSON objects
+    utxo_records_t make_utxo_records(const nlohmann::json& utxos);
+
+    // Replace utxos with the UTXOs referenced by records, in record order
+    void apply_utxo_records(nlohmann::json& utxos, const utxo_records_t& records);
+
+    // Return a copy of the UTXOs referenced by records, in record order
+    nlohmann::json copy_utxo_records(const nlohmann::json& utxos, const utxo_records_t& records);
+
+    // Sum UTXOs grouped by asset id into an asset id to satoshi map.
+    // Frozen UTXOs are excluded unless all_coins is true; assets with
+    // no remaining UTXOs and unblinding errors are omitted.
+    nlohmann::json get_utxo_balances(const nlohmann::json& asset_utxos, bool all_coins);
+
+} // namespace green
+
+#endif
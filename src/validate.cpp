@@ -51,14 +51,14 @@ namespace green {
             caller_net_params = std::make_unique<network_parameters>(defaults);
         }
         const auto& net_params = override_network ? *caller_net_params : m_session->get_network_parameters();
-        for (auto& addressee : m_details["addressees"]) {
-            nlohmann::json result;
-            std::string error = validate_tx_addressee(*m_session, net_params, addressee);
+        auto addressee_errors = validate_tx_addressees(*m_session, net_params, m_details["addressees"]);
+        for (const auto& error : addressee_errors) {
             if (!error.empty()) {
-                errors.emplace_back(std::move(error));
+                errors.emplace_back(error);
             }
         }
         m_result["errors"] = std::move(errors);
+        m_result["addressee_errors"] = std::move(addressee_errors);
         m_result["addressees"] = std::move(m_details["addressees"]);
         if (override_network) {
             m_result.emplace("network", std::move(m_details["network"]));
@@ -4,6 +4,7 @@
 #include <map>
 #include <thread>
 
+#include <openssl/ssl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
@@ -19,6 +20,7 @@
 #include "json_utils.hpp"
 #include "logging.hpp"
 #include "network_parameters.hpp"
+#include "transport_recording.hpp"
 #include "utils.hpp"
 #include "version.h"
 #include "wamp_transport.hpp"
@@ -94,7 +96,7 @@ namespace green {
         }
 
         bool static_test(wlog::level l) const { return (m_level & l) != 0; }
-        bool dynamic_test(wlog::level l) { return (m_level & l) != 0; }
+        bool dynamic_test(wlog::level l) { return (m_level & l) != 0 && is_log_enabled(get_severity_level(l)); }
 
         wlog::level m_level;
     };
@@ -246,15 +248,63 @@ namespace green {
             return std::static_pointer_cast<transport>(t)->ping(std::string());
         }
 
+        // Convert a decoded msgpack object directly into JSON, without
+        // re-packing it and parsing it again. Matches the conversions
+        // performed by nlohmann::json::from_msgpack.
+        static nlohmann::json msgpack_to_json(const msgpack::object& obj)
+        {
+            switch (obj.type) {
+            case msgpack::type::NIL:
+                return nullptr;
+            case msgpack::type::BOOLEAN:
+                return obj.via.boolean;
+            case msgpack::type::POSITIVE_INTEGER:
+                return obj.via.u64;
+            case msgpack::type::NEGATIVE_INTEGER:
+                return obj.via.i64;
+            case msgpack::type::FLOAT32:
+            case msgpack::type::FLOAT64:
+                return obj.via.f64;
+            case msgpack::type::STR:
+                return std::string(obj.via.str.ptr, obj.via.str.size);
+            case msgpack::type::BIN: {
+                const auto p = reinterpret_cast<const uint8_t*>(obj.via.bin.ptr);
+                return nlohmann::json::binary(std::vector<uint8_t>(p, p + obj.via.bin.size));
+            }
+            case msgpack::type::EXT: {
+                const auto p = reinterpret_cast<const uint8_t*>(obj.via.ext.data());
+                return nlohmann::json::binary(
+                    std::vector<uint8_t>(p, p + obj.via.ext.size), static_cast<uint8_t>(obj.via.ext.type()));
+            }
+            case msgpack::type::ARRAY: {
+                nlohmann::json ret = nlohmann::json::array();
+                auto& arr = ret.get_ref<nlohmann::json::array_t&>();
+                arr.reserve(obj.via.array.size);
+                for (const auto& item : gsl::make_span(obj.via.array.ptr, obj.via.array.size)) {
+                    arr.emplace_back(msgpack_to_json(item));
+                }
+                return ret;
+            }
+            case msgpack::type::MAP: {
+                nlohmann::json ret = nlohmann::json::object();
+                for (const auto& kv : gsl::make_span(obj.via.map.ptr, obj.via.map.size)) {
+                    // JSON only supports string keys
+                    GDK_RUNTIME_ASSERT(kv.key.type == msgpack::type::STR);
+                    ret[std::string(kv.key.via.str.ptr, kv.key.via.str.size)] = msgpack_to_json(kv.val);
+                }
+                return ret;
+            }
+            }
+            GDK_RUNTIME_ASSERT_MSG(false, "unknown msgpack type");
+            return nlohmann::json(); // Unreachable
+        }
+
         template <typename T> static nlohmann::json wamp_cast_json_impl(const T& result)
         {
             if (!result.number_of_arguments()) {
                 return nlohmann::json();
             }
-            const auto obj = result.template argument<msgpack::object>(0);
-            msgpack::sbuffer sbuf;
-            msgpack::pack(sbuf, obj);
-            return nlohmann::json::from_msgpack(sbuf.data(), sbuf.data() + sbuf.size());
+            return msgpack_to_json(result.template argument<msgpack::object>(0));
         }
 
         template <typename T>
@@ -263,6 +313,25 @@ namespace green {
             const auto t = std::chrono::system_clock::now();
             return t < from || t - from > duration;
         }
+
+        // WAMP results are recorded as their raw msgpack arguments
+        static nlohmann::json wamp_result_to_binary(const autobahn::wamp_call_result& result)
+        {
+            msgpack::sbuffer buf;
+            msgpack::pack(buf, result.arguments());
+            const auto p = reinterpret_cast<const uint8_t*>(buf.data());
+            return nlohmann::json::binary(std::vector<uint8_t>(p, p + buf.size()));
+        }
+
+        static autobahn::wamp_call_result wamp_result_from_binary(const nlohmann::json& data)
+        {
+            const auto& bytes = data.get_binary();
+            auto oh = msgpack::unpack(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+            // The result takes ownership of the zone holding the unpacked arguments
+            autobahn::wamp_call_result result(std::move(*oh.zone()));
+            result.set_arguments(oh.get());
+            return result;
+        }
     } // namespace
 
     class connection_backoff {
@@ -297,6 +366,56 @@ namespace green {
         size_t m_num_retries;
     };
 
+    // Holds the most recent TLS session from the server, so that
+    // reconnecting can resume it instead of making a full handshake
+    class tls_session_cache {
+    public:
+        // Capture sessions negotiated by connections using ctx
+        void attach(SSL_CTX* ctx)
+        {
+            SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+            SSL_CTX_set_ex_data(ctx, get_ex_index(), this);
+            SSL_CTX_sess_set_new_cb(ctx, &tls_session_cache::on_new_session);
+        }
+
+        // Offer the cached session, if any, when ssl connects
+        void resume(SSL* ssl)
+        {
+            std::lock_guard<std::mutex> locker(m_mutex);
+            if (m_session && SSL_SESSION_is_resumable(m_session.get())) {
+                SSL_set_session(ssl, m_session.get());
+            }
+        }
+
+        void clear()
+        {
+            std::lock_guard<std::mutex> locker(m_mutex);
+            m_session.reset();
+        }
+
+    private:
+        static int get_ex_index()
+        {
+            static const int s_index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+            GDK_RUNTIME_ASSERT(s_index >= 0);
+            return s_index;
+        }
+
+        static int on_new_session(SSL* ssl, SSL_SESSION* session)
+        {
+            auto cache = static_cast<tls_session_cache*>(SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), get_ex_index()));
+            if (!cache) {
+                return 0; // Not taking ownership of the session
+            }
+            std::lock_guard<std::mutex> locker(cache->m_mutex);
+            cache->m_session.reset(session);
+            return 1;
+        }
+
+        std::mutex m_mutex;
+        std::unique_ptr<SSL_SESSION, decltype(&SSL_SESSION_free)> m_session{ nullptr, SSL_SESSION_free };
+    };
+
     nlohmann::json wamp_cast_json(const autobahn::wamp_event& event) { return wamp_cast_json_impl(*event); }
 
     nlohmann::json wamp_cast_json(const autobahn::wamp_call_result& result) { return wamp_cast_json_impl(result); }
@@ -311,10 +430,12 @@ namespace green {
         , m_wamp_call_prefix(m_server_prefix == "wamp" ? "com.greenaddress." : "")
         , m_wamp_call_options()
         , m_notify_fn(fn)
+        , m_recording(transport_recording::get(m_net_params, m_server_prefix))
         , m_is_mandatory(is_mandatory)
         , m_desired_state(state_t::disconnected)
         , m_state(state_t::disconnected)
         , m_failure_count(0)
+        , m_retry_now(false)
     {
         using namespace std::placeholders;
         m_subscriptions.reserve(4u);
@@ -336,11 +457,17 @@ namespace green {
             return;
         }
 
+        m_tls_sessions = std::make_unique<tls_session_cache>();
         m_client_tls = std::make_unique<client_tls>();
         m_client_tls->set_pong_timeout_handler(std::bind(&wamp_transport::heartbeat_timeout_cb, this, _1, _2));
         m_client_tls->set_tls_init_handler([this](const websocketpp::connection_hdl) {
-            return tls_init(m_wamp_host_name, m_net_params.gait_wamp_cert_roots(), m_net_params.gait_wamp_cert_pins(),
-                m_net_params.cert_expiry_threshold());
+            auto ctx = tls_init(m_wamp_host_name, m_net_params.gait_wamp_cert_roots(),
+                m_net_params.gait_wamp_cert_pins(), m_net_params.cert_expiry_threshold());
+            m_tls_sessions->attach(ctx->native_handle());
+            return ctx;
+        });
+        m_client_tls->set_socket_init_handler([this](const websocketpp::connection_hdl, auto& stream) {
+            m_tls_sessions->resume(stream.native_handle()); // Resume our last session if possible
         });
         m_client_tls->init_asio(&m_strand.context());
     }
@@ -349,6 +476,9 @@ namespace green {
     {
         no_std_exception_escape([this] { change_state_to(state_t::exited, std::string(), false); }, "wamp dtor(1)");
         no_std_exception_escape([this] { m_reconnect_thread.join(); }, "wamp dtor(2)");
+        if (m_replay_thread.joinable()) {
+            no_std_exception_escape([this] { m_replay_thread.join(); }, "wamp dtor(3)");
+        }
     }
 
     void wamp_transport::connect(const std::string& proxy, bool wait)
@@ -375,6 +505,12 @@ namespace green {
         if (const auto hint_p = hint.find("hint"); hint_p != hint.end()) {
             const auto new_state = *hint_p == "connect" ? state_t::connected : state_t::disconnected;
             const bool wait = m_is_mandatory || new_state == state_t::disconnected;
+            if (new_state == state_t::connected) {
+                // The network may have changed: retry without waiting out any
+                // current backoff, or check an existing connection is still alive
+                locker_t locker(m_mutex);
+                m_retry_now = true;
+            }
             change_state_to(new_state, proxy, wait);
         }
     }
@@ -429,7 +565,7 @@ namespace green {
 
     void wamp_transport::emit_state(wamp_transport::state_t current, wamp_transport::state_t desired, uint64_t wait_ms)
     {
-        constexpr bool async = false;
+        constexpr bool async = true;
         nlohmann::json state(
             { { "current_state", state_str(current) }, { "next_state", state_str(desired) }, { "wait_ms", wait_ms } });
         nlohmann::json notification = { { "event", "network" }, { "network", std::move(state) } };
@@ -478,6 +614,52 @@ namespace green {
         return std::make_pair(m_session, m_transport.get());
     }
 
+    wamp_transport::pending_call::pending_call(wamp_transport& wamp, std::shared_ptr<autobahn::wamp_session> session,
+        autobahn::wamp_websocket_transport* t, boost::future<autobahn::wamp_call_result> fn, std::string method_name)
+        : m_wamp(&wamp)
+        , m_session(std::move(session))
+        , m_transport(t)
+        , m_fn(std::move(fn))
+        , m_method_name(std::move(method_name))
+        , m_start(std::chrono::steady_clock::now())
+    {
+    }
+
+    autobahn::wamp_call_result wamp_transport::pending_call::get()
+    {
+        GDK_RUNTIME_ASSERT(m_wamp); // Must only be collected once
+        auto wamp = std::exchange(m_wamp, nullptr);
+        const auto& recording = wamp->m_recording;
+        try {
+            auto ret = wamp->is_replaying() ? wamp->replay_call(m_method_name, m_start)
+                                            : wamp->wamp_process_call(m_transport, m_fn);
+            const auto elapsed = std::chrono::steady_clock::now() - m_start;
+            stats::record("wamp_call", m_method_name, elapsed);
+            if (recording && !recording->is_replay()) {
+                recording->record("call", m_method_name, elapsed, wamp_result_to_binary(ret), false);
+            }
+            m_session.reset();
+            return ret;
+        } catch (const std::exception& ex) {
+            const auto elapsed = std::chrono::steady_clock::now() - m_start;
+            stats::record("wamp_call", m_method_name, elapsed, true);
+            // Connection failures are not server responses, so aren't recorded
+            if (recording && !recording->is_replay() && !dynamic_cast<const connection_error*>(&ex)) {
+                recording->record("call", m_method_name, elapsed, ex.what(), true);
+            }
+            m_session.reset();
+            throw;
+        }
+    }
+
+    bool wamp_transport::is_replaying() const { return m_recording && m_recording->is_replay(); }
+
+    autobahn::wamp_call_result wamp_transport::replay_call(
+        const std::string& method_name, std::chrono::steady_clock::time_point start)
+    {
+        return wamp_result_from_binary(m_recording->replay("call", method_name, start));
+    }
+
     autobahn::wamp_call_result wamp_transport::wamp_process_call(
         autobahn::wamp_websocket_transport* t, boost::future<autobahn::wamp_call_result>& fn)
     {
@@ -533,7 +715,7 @@ namespace green {
             const auto state = m_state.load();
             auto desired_state = m_desired_state.load();
             const auto failure_count = m_failure_count.load();
-            const bool need_to_ping = !m_proxy.empty();
+            const bool need_to_ping = !m_proxy.empty() || m_retry_now;
 
             if (desired_state != state_t::exited && last_handled_failure_count != failure_count) {
                 GDK_LOG(info) << unhandled_failure;
@@ -546,7 +728,8 @@ namespace green {
                         // error and loop again to reconnect if needed.
                         notify_failure(locker, dead_transport, false);
                         continue;
-                    } else if (need_to_ping && is_elapsed(m_last_ping_ts, DEFAULT_PING)) {
+                    } else if (need_to_ping && (m_retry_now || is_elapsed(m_last_ping_ts, DEFAULT_PING))) {
+                        m_retry_now = false;
                         if (!connection_ping_ok(m_transport, is_tls)) {
                             notify_failure(locker, ping_failed, false);
                             continue;
@@ -591,6 +774,14 @@ namespace green {
                 backoff.reset(); // Start our backoff sequence again when we reconnect
                 continue;
             }
+            if (desired_state == state_t::connected && is_replaying()) {
+                // Replayed calls and events need no connection
+                m_state = state_t::connected;
+                last_handled_failure_count = m_failure_count.load();
+                locker.unlock();
+                emit_state(state_t::connected, state_t::connected, 0);
+                continue;
+            }
             if (desired_state == state_t::connected) {
                 // We want the connection open
                 const std::string proxy = m_proxy;
@@ -628,7 +819,14 @@ namespace green {
                     failed = true;
                 }
                 if (failed) {
+                    if (is_tls) {
+                        // Don't offer a session that may have caused the failure
+                        m_tls_sessions->clear();
+                    }
                     backoff_handler(locker, backoff); // Wait longer before trying again
+                    if (std::exchange(m_retry_now, false)) {
+                        backoff.reset(); // Retry immediately from now on, then back off again
+                    }
                     continue;
                 }
 
@@ -639,6 +837,7 @@ namespace green {
                 m_transport.swap(t);
                 m_state = state_t::connected;
                 m_last_ping_ts = std::chrono::system_clock::now();
+                m_retry_now = false;
                 // Mark all currently notified failures as handled
                 last_handled_failure_count = m_failure_count.load();
                 locker.unlock();
@@ -660,6 +859,9 @@ namespace green {
             if (m_desired_state.load() != state_t::connected) {
                 return true; // Another thread asked to disconnect or exit
             }
+            if (m_retry_now) {
+                return true; // A reconnect hint asked to retry now
+            }
             return false;
         };
         emit_state(state_t::disconnected, state_t::connected, backoff_time.count());
@@ -670,6 +872,17 @@ namespace green {
 
     void wamp_transport::subscribe(const std::string& topic, wamp_transport::subscribe_fn_t cb, bool is_initial)
     {
+        std::vector<std::pair<std::string, subscribe_fn_t>> topics;
+        topics.emplace_back(topic, std::move(cb));
+        subscribe(std::move(topics), is_initial);
+    }
+
+    void wamp_transport::subscribe(std::vector<std::pair<std::string, subscribe_fn_t>> topics, bool is_initial)
+    {
+        if (is_replaying()) {
+            replay_subscribe(std::move(topics));
+            return;
+        }
         const autobahn::wamp_subscribe_options options("exact");
         auto st = get_session_and_transport();
         if (!st.first || !st.second) {
@@ -685,32 +898,79 @@ namespace green {
             }
         }
 
-        autobahn::wamp_subscription sub;
-        // TODO: Set m_last_ping_ts whenever we receive a subscription
-        auto fn = st.first->subscribe(
-            topic, [cb](const autobahn::wamp_event& e) { cb(wamp_cast_json(e)); }, options);
-        for (;;) {
-            const auto status = fn.wait_for(boost::chrono::seconds(1));
-            if (status == boost::future_status::ready) {
-                break;
+        // Send all subscription requests before waiting for any of them
+        std::vector<boost::future<autobahn::wamp_subscription>> pending;
+        pending.reserve(topics.size());
+        for (auto& topic : topics) {
+            auto cb = std::move(topic.second);
+            if (m_recording) {
+                m_recording->record("subscribe", topic.first, {}, nullptr, false);
+                cb = [cb = std::move(cb), recording = m_recording, name = topic.first](nlohmann::json event) {
+                    recording->record("event", name, {}, event, false);
+                    cb(std::move(event));
+                };
             }
-            if (status == boost::future_status::timeout) {
-                locker_t locker(m_mutex);
-                if (m_transport.get() != st.second || !m_transport->is_connected()) {
-                    notify_failure(locker, "subscribe transport disconnected/changed");
-                    throw timeout_error{};
+            // TODO: Set m_last_ping_ts whenever we receive a subscription
+            pending.emplace_back(st.first->subscribe(
+                topic.first, [cb = std::move(cb)](const autobahn::wamp_event& e) { cb(wamp_cast_json(e)); }, options));
+        }
+        for (size_t i = 0; i < pending.size(); ++i) {
+            auto& fn = pending[i];
+            for (;;) {
+                const auto status = fn.wait_for(boost::chrono::seconds(1));
+                if (status == boost::future_status::ready) {
+                    break;
+                }
+                if (status == boost::future_status::timeout) {
+                    locker_t locker(m_mutex);
+                    if (m_transport.get() != st.second || !m_transport->is_connected()) {
+                        notify_failure(locker, "subscribe transport disconnected/changed");
+                        throw timeout_error{};
+                    }
                 }
             }
+            autobahn::wamp_subscription sub;
+            try {
+                sub = fn.get();
+            } catch (const boost::future_error& ex) {
+                notify_failure(std::string("wamp call exception: ") + ex.what());
+                throw reconnect_error{};
+            }
+            GDK_LOG(debug) << "subscribed to " << topics[i].first << ":" << sub.id();
+            locker_t locker(m_mutex);
+            m_subscriptions.emplace_back(sub);
         }
-        try {
-            sub = fn.get();
-        } catch (const boost::future_error& ex) {
-            notify_failure(std::string("wamp call exception: ") + ex.what());
-            throw reconnect_error{};
-        }
-        GDK_LOG(debug) << "subscribed to " << topic << ":" << sub.id();
+    }
+
+    void wamp_transport::replay_subscribe(std::vector<std::pair<std::string, subscribe_fn_t>> topics)
+    {
         locker_t locker(m_mutex);
-        m_subscriptions.emplace_back(sub);
+        for (auto& topic : topics) {
+            m_replay_topics[topic.first] = std::move(topic.second);
+        }
+        if (!m_replay_thread.joinable()) {
+            // Event offsets are relative to the first subscription
+            m_replay_thread = std::thread([this] { replay_events(); });
+        }
+    }
+
+    void wamp_transport::replay_events()
+    {
+        const auto start = std::chrono::steady_clock::now();
+        auto&& exited_fn = [this] { return m_desired_state.load() == state_t::exited; };
+        for (const auto& event : m_recording->get_events()) {
+            locker_t locker(m_mutex);
+            if (m_condition.wait_until(locker, start + m_recording->scale(event.offset), exited_fn)) {
+                break;
+            }
+            const auto topic_p = m_replay_topics.find(event.topic);
+            if (topic_p != m_replay_topics.end()) {
+                // Deliver events through the strand, as for notifications
+                boost::asio::post(m_strand, [cb = topic_p->second, data = event.data] { cb(data); });
+            }
+        }
+        // Wait for any events we posted to be processed before exiting
+        boost::asio::post(m_strand, boost::asio::use_future).get();
     }
 
 } // namespace green
@@ -3,6 +3,9 @@
 #pragma once
 
 #include <boost/asio/io_context.hpp>
+#include <chrono>
+#include <map>
+#include <memory>
 #include <nlohmann/json_fwd.hpp>
 #include <optional>
 #include <string>
@@ -11,12 +14,15 @@
 #include "autobahn_wrapper.hpp"
 #include "exception.hpp"
 #include "logging.hpp"
+#include "stats.hpp"
 #include "threading.hpp"
 
 namespace green {
 
     class connection_backoff;
     class network_parameters;
+    class tls_session_cache;
+    class transport_recording;
     struct websocketpp_gdk_config;
     struct websocketpp_gdk_tls_config;
 
@@ -71,20 +77,59 @@ namespace green {
         // Subscribe to a topic. Use is_initial=true for the first
         // subscription after reconnecting
         void subscribe(const std::string& topic, subscribe_fn_t cb, bool is_initial = false);
+        // Subscribe to several topics at once, waiting for all subscriptions
+        // to complete. Equivalent to calling subscribe() for each in order
+        void subscribe(std::vector<std::pair<std::string, subscribe_fn_t>> topics, bool is_initial = false);
 
         bool is_mandatory() const { return m_is_mandatory; }
 
-        // Make a background WAMP call and return its result to the current thread.
-        // The session mutex must not be held when calling this function.
-        template <typename... Args> autobahn::wamp_call_result call(const std::string& method_name, Args&&... args)
+        // A WAMP call in flight. Any number of calls may be in flight at
+        // once; results may be collected with get() in any order.
+        class pending_call final {
+        public:
+            pending_call(pending_call&&) = default;
+            pending_call& operator=(pending_call&&) = default;
+
+            // Wait for and return the result of the call. May only be called once.
+            // The session mutex must not be held when calling this function.
+            autobahn::wamp_call_result get();
+
+        private:
+            friend class wamp_transport;
+            pending_call(wamp_transport& wamp, std::shared_ptr<autobahn::wamp_session> session,
+                autobahn::wamp_websocket_transport* t, boost::future<autobahn::wamp_call_result> fn,
+                std::string method_name);
+
+            wamp_transport* m_wamp;
+            std::shared_ptr<autobahn::wamp_session> m_session; // Keeps the session alive until collected
+            autobahn::wamp_websocket_transport* m_transport;
+            boost::future<autobahn::wamp_call_result> m_fn;
+            std::string m_method_name;
+            std::chrono::steady_clock::time_point m_start;
+        };
+
+        // Start a background WAMP call, returning without waiting for its result.
+        template <typename... Args> pending_call async_call(const std::string& method_name, Args&&... args)
         {
+            if (is_replaying()) {
+                // The result is taken from the recording when collected
+                return pending_call(*this, {}, nullptr, {}, method_name);
+            }
             const std::string method{ m_wamp_call_prefix + method_name };
             auto st = get_session_and_transport();
             if (!st.first || !st.second) {
+                stats::record("wamp_call", method_name, {}, true);
                 throw reconnect_error{};
             }
             auto fn = st.first->call(method, std::make_tuple(std::forward<Args>(args)...), m_wamp_call_options);
-            return wamp_process_call(st.second, fn);
+            return pending_call(*this, std::move(st.first), st.second, std::move(fn), method_name);
+        }
+
+        // Make a background WAMP call and return its result to the current thread.
+        // The session mutex must not be held when calling this function.
+        template <typename... Args> autobahn::wamp_call_result call(const std::string& method_name, Args&&... args)
+        {
+            return async_call(method_name, std::forward<Args>(args)...).get();
         }
 
         // Make a WAMP call on a currently locked session.
@@ -106,6 +151,13 @@ namespace green {
         };
         const char* state_str(state_t state) const;
 
+        // true if calls and events are replayed from a recording
+        bool is_replaying() const;
+        autobahn::wamp_call_result replay_call(
+            const std::string& method_name, std::chrono::steady_clock::time_point start);
+        void replay_subscribe(std::vector<std::pair<std::string, subscribe_fn_t>> topics);
+        void replay_events();
+
         void change_state_to(state_t new_state, const std::string& proxy, bool wait);
         void emit_state(state_t current, state_t desired, uint64_t wait_ms);
 
@@ -133,6 +185,10 @@ namespace green {
         const std::string m_wamp_call_prefix;
         autobahn::wamp_call_options m_wamp_call_options;
         notify_fn_t m_notify_fn;
+        // Non-null if recording or replaying this transport
+        std::shared_ptr<transport_recording> m_recording;
+        // Must outlive the TLS client and its connections
+        std::unique_ptr<tls_session_cache> m_tls_sessions;
         std::unique_ptr<client> m_client;
         std::unique_ptr<client_tls> m_client_tls;
         // true if this connection must remain alive for the session to function
@@ -149,12 +205,18 @@ namespace green {
         std::string m_proxy;
         // The count of failures detected, incremented to cause a reconnect
         std::atomic<uint32_t> m_failure_count;
+        // Set by a connect hint to skip any backoff delay, or to check
+        // that the current connection is alive
+        bool m_retry_now;
         // The time of the last ping we sent
         std::chrono::time_point<std::chrono::system_clock> m_last_ping_ts;
         // The transport, session and any subscriptions
         std::shared_ptr<autobahn::wamp_websocket_transport> m_transport;
         session_ptr m_session;
         std::vector<autobahn::wamp_subscription> m_subscriptions;
+        // When replaying, the subscribed callbacks and the thread delivering events to them
+        std::map<std::string, subscribe_fn_t> m_replay_topics;
+        std::thread m_replay_thread;
     };
 
 } // namespace green
@@ -10,24 +10,73 @@ namespace green {
     namespace {
         static const unsigned char GAIT_GENERATION_NONCE[30] = { 'G', 'r', 'e', 'e', 'n', 'A', 'd', 'd', 'r', 'e', 's',
             's', '.', 'i', 't', ' ', 'H', 'D', ' ', 'w', 'a', 'l', 'l', 'e', 't', ' ', 'p', 'a', 't', 'h' };
+
+        // Maximum number of derived keys cached per set of keys
+        constexpr size_t DERIVED_KEY_CACHE_SIZE = 2048;
+        // Cache branch value for Green keys, which have no branch
+        constexpr uint32_t NO_BRANCH = 0xffffffff;
+
+        static uint32_t get_branch(std::optional<bool> is_internal)
+        {
+            return is_internal.has_value() ? (*is_internal ? 1u : 0u) : NO_BRANCH;
+        }
     } // namespace
 
     xpub_hdkeys::xpub_hdkeys(const network_parameters& net_params)
-        : m_is_main_net(net_params.is_main_net())
+        : m_derived(DERIVED_KEY_CACHE_SIZE)
+        , m_is_main_net(net_params.is_main_net())
         , m_is_liquid(net_params.is_liquid())
     {
     }
 
-    void xpub_hdkeys::clear() { m_subaccounts.clear(); }
+    void xpub_hdkeys::clear()
+    {
+        m_subaccounts.clear();
+        m_derived.clear();
+    }
 
     xpub_hdkey xpub_hdkeys::derive(uint32_t subaccount, uint32_t pointer, std::optional<bool> is_internal)
     {
+        const xpub_hdkey_cache::key_t key{ subaccount, get_branch(is_internal), pointer };
+        if (auto cached = m_derived.get(key); cached) {
+            return std::move(*cached);
+        }
         std::vector<uint32_t> path;
         if (is_internal.has_value()) {
             path.push_back(*is_internal ? 1u : 0u);
         }
         path.push_back(pointer);
-        return get_subaccount(subaccount).derive(path);
+        auto derived = get_subaccount(subaccount).derive(path);
+        m_derived.insert(key, derived);
+        return derived;
+    }
+
+    std::vector<xpub_hdkey> xpub_hdkeys::derive_range(
+        uint32_t subaccount, uint32_t first_pointer, size_t num_keys, std::optional<bool> is_internal)
+    {
+        const uint32_t branch = get_branch(is_internal);
+        std::optional<xpub_hdkey> parent;
+        std::vector<xpub_hdkey> ret;
+        ret.reserve(num_keys);
+        for (size_t i = 0; i < num_keys; ++i) {
+            const uint32_t pointer = first_pointer + static_cast<uint32_t>(i);
+            const xpub_hdkey_cache::key_t key{ subaccount, branch, pointer };
+            if (auto cached = m_derived.get(key); cached) {
+                ret.emplace_back(std::move(*cached));
+                continue;
+            }
+            if (!parent) {
+                parent = get_subaccount(subaccount);
+                if (is_internal.has_value()) {
+                    const std::array<uint32_t, 1> branch_path{ branch };
+                    parent = parent->derive(branch_path);
+                }
+            }
+            const std::array<uint32_t, 1> pointer_path{ pointer };
+            ret.emplace_back(parent->derive(pointer_path));
+            m_derived.insert(key, ret.back());
+        }
+        return ret;
     }
 
     std::vector<uint32_t> xpub_hdkeys::get_full_path(uint32_t subaccount, uint32_t pointer, bool is_internal) const
@@ -43,7 +92,7 @@ namespace green {
     //
     green_pubkeys::green_pubkeys(const network_parameters& net_params, uint32_span_t gait_path)
         : xpub_hdkeys(net_params)
-        , m_master_xpub(m_is_main_net, h2b(net_params.pub_key()), h2b(net_params.chain_code()))
+        , m_master_xpub(m_is_main_net, net_params.pub_key_bytes(), net_params.chain_code_bytes())
     {
         GDK_RUNTIME_ASSERT(static_cast<size_t>(gait_path.size()) == m_gait_path.size());
         std::copy(std::begin(gait_path), std::end(gait_path), m_gait_path.begin());
@@ -4,13 +4,18 @@
 
 #include <map>
 #include <optional>
+#include <tuple>
 
 #include "ga_wally.hpp"
+#include "lru_cache.hpp"
 
 namespace green {
 
     class network_parameters;
 
+    // Cache of keys derived from subaccount roots, keyed by (subaccount, branch, pointer)
+    using xpub_hdkey_cache = lru_cache<std::tuple<uint32_t, uint32_t, uint32_t>, xpub_hdkey>;
+
     //
     // Base class for collections of bip32 extended keys
     //
@@ -28,8 +33,14 @@ namespace green {
 
         // If is_internal is empty, derives a Green key for a subaccount and pointer.
         // Otherwise, derives a BIP44 key for a subaccount and pointer, internal or not.
+        // Derived keys are cached, so repeated derivations are cheap.
         xpub_hdkey derive(uint32_t subaccount, uint32_t pointer, std::optional<bool> is_internal = {});
 
+        // As derive(), for the num_keys consecutive pointers from first_pointer.
+        // The subaccount and branch keys are derived only once for the range.
+        std::vector<xpub_hdkey> derive_range(
+            uint32_t subaccount, uint32_t first_pointer, size_t num_keys, std::optional<bool> is_internal = {});
+
         // Get the path to a subaccount root
         virtual std::vector<uint32_t> get_path_to_subaccount(uint32_t subaccount) const = 0;
 
@@ -44,6 +55,7 @@ namespace green {
 
     protected:
         std::map<uint32_t, xpub_hdkey> m_subaccounts;
+        xpub_hdkey_cache m_derived;
         bool m_is_main_net;
         bool m_is_liquid;
     };
@@ -179,6 +179,12 @@ pub struct DiscoverAccountOpt {
     pub xpub: Xpub,
 }
 
+#[derive(Serialize, Deserialize, Debug, Clone)]
+pub struct DiscoverAccountsOpt {
+    /// Accounts of the same type must be given in increasing account order
+    pub subaccounts: Vec<DiscoverAccountOpt>,
+}
+
 #[derive(Serialize, Deserialize, Debug, Clone)]
 pub struct GetNextAccountOpt {
     #[serde(rename = "type")]
@@ -235,6 +241,10 @@ pub struct SPVDownloadHeadersParams {
     /// Number of headers to download at every attempt, it defaults to 2016, useful to set lower
     /// for testing
     pub headers_to_download: Option<usize>,
+
+    /// Number of batches of headers to request at once, so that later batches download while
+    /// earlier ones are verified. Defaults to 1
+    pub batches: Option<usize>,
 }
 
 #[derive(Serialize, Deserialize, Debug, Clone, Default)]
@@ -1,7 +1,8 @@
 use std::cmp::Ordering;
 use std::collections::{HashMap, HashSet};
+use std::sync::Mutex;
 
-use gdk_common::electrum_client::ScriptStatus;
+use gdk_common::electrum_client::{Client, ScriptStatus};
 use gdk_common::log::info;
 
 use gdk_common::bitcoin::bip32::{DerivationPath, Fingerprint, Xpub};
@@ -899,24 +900,77 @@ pub fn discover_account(
     script_type: ScriptType,
     gap_limit: u32,
 ) -> Result<bool, Error> {
-    use gdk_common::electrum_client::ElectrumApi;
-
     // build our own client so that the subscriptions are dropped at the end
     let client = electrum_url.build_client(proxy, None)?;
+    account_has_history(&client, account_xpub, script_type, gap_limit)
+}
+
+/// Discover several accounts concurrently, returning whether each one exists.
+///
+/// Accounts of the same script type must be given in increasing account order.
+/// Since discovery of a type stops at its first unused account, probes of
+/// later accounts of that type are skipped once one is found to be unused,
+/// and return false.
+pub fn discover_accounts(
+    electrum_url: &ElectrumUrl,
+    proxy: Option<&str>,
+    accounts: &[(Xpub, ScriptType)],
+    gap_limit: u32,
+) -> Result<Vec<bool>, Error> {
+    // The position of the first unused account found for each script type
+    let first_unused: Mutex<Vec<(ScriptType, usize)>> = Mutex::new(vec![]);
+    let is_cancelled = |script_type: ScriptType, pos: usize| {
+        first_unused.lock().unwrap().iter().any(|(t, p)| *t == script_type && *p < pos)
+    };
+
+    std::thread::scope(|s| {
+        let handles: Vec<_> = accounts
+            .iter()
+            .enumerate()
+            .map(|(pos, (xpub, script_type))| {
+                let (first_unused, is_cancelled) = (&first_unused, &is_cancelled);
+                s.spawn(move || -> Result<bool, Error> {
+                    if is_cancelled(*script_type, pos) {
+                        return Ok(false);
+                    }
+                    let client = electrum_url.build_client(proxy, None)?;
+                    if is_cancelled(*script_type, pos) {
+                        return Ok(false);
+                    }
+                    let found = account_has_history(&client, xpub, *script_type, gap_limit)?;
+                    if !found {
+                        first_unused.lock().unwrap().push((*script_type, pos));
+                    }
+                    Ok(found)
+                })
+            })
+            .collect();
+        handles.into_iter().map(|h| h.join().expect("account discovery panicked")).collect()
+    })
+}
+
+/// Whether any of the first gap_limit external addresses of an account
+/// have been used, checked with a single batch request
+fn account_has_history(
+    client: &Client,
+    account_xpub: &Xpub,
+    script_type: ScriptType,
+    gap_limit: u32,
+) -> Result<bool, Error> {
+    use gdk_common::electrum_client::ElectrumApi;
 
     let external_xpub = account_xpub.ckd_pub(&crate::EC, 0.into())?;
+    let mut scripts = Vec::with_capacity(gap_limit as usize);
     for index in 0..gap_limit {
         let child_key = external_xpub.ckd_pub(&crate::EC, index.into())?;
         // Every network has the same scriptpubkey
-        let script = bitcoin_address(&child_key.to_pub(), script_type, bitcoin::Network::Bitcoin)
-            .script_pubkey();
-
-        if client.script_subscribe(&script)?.is_some() {
-            return Ok(true);
-        }
+        scripts.push(
+            bitcoin_address(&child_key.to_pub(), script_type, bitcoin::Network::Bitcoin)
+                .script_pubkey(),
+        );
     }
-
-    Ok(false)
+    let statuses = client.batch_script_subscribe(scripts.iter().map(|s| s.as_script()))?;
+    Ok(statuses.iter().any(Option::is_some))
 }
 
 fn is_blinded_inner(blinder: &str) -> bool {
@@ -94,18 +94,50 @@ pub fn download_headers(
     let client = input.params.build_client()?;
     let mut chain = input.params.headers_chain()?;
     let headers_to_download = input.headers_to_download.unwrap_or(2016);
-    let headers = client.block_headers(chain.height() as usize + 1, headers_to_download)?.headers;
-    info!("height:{} downloaded_headers:{}", chain.height(), headers.len());
+    let batches = input.batches.unwrap_or(1).max(1);
+    let start = chain.height() as usize + 1;
     let mut reorg_happened = false;
-    if let Err(Error::InvalidHeaders) = chain.push(headers) {
-        warn!(
-            "invalid headers, possible reorg, invalidating latest headers and latest verified tx"
-        );
-        let mut cache = input.params.verified_cache()?;
-        chain.remove(input.params.network.max_reorg_blocks.unwrap_or(144))?;
-        cache.remove(input.params.network.max_reorg_blocks.unwrap_or(144))?;
-        reorg_happened = true;
-    }
+    std::thread::scope(|s| -> Result<(), Error> {
+        // Request all batches up front, then verify and store each one in
+        // order while the later ones are still downloading
+        let client = &client;
+        let pending: Vec<_> = (0..batches)
+            .map(|i| {
+                let height = start + i * headers_to_download;
+                s.spawn(move || client.block_headers(height, headers_to_download))
+            })
+            .collect();
+        for (i, handle) in pending.into_iter().enumerate() {
+            let headers = match handle.join().expect("header download panicked") {
+                Ok(result) => result.headers,
+                // Keep any batches already stored; the next call retries
+                Err(e) if i > 0 => {
+                    warn!("failed downloading headers batch {}: {:?}", i, e);
+                    break;
+                }
+                Err(e) => return Err(e.into()),
+            };
+            info!("height:{} downloaded_headers:{}", chain.height(), headers.len());
+            let is_last = headers.len() < headers_to_download;
+            match chain.push(headers) {
+                Ok(()) if !is_last => {}
+                Ok(()) => break, // Caught up with the server; later batches are empty
+                Err(Error::InvalidHeaders) => {
+                    warn!(
+                        "invalid headers, possible reorg, invalidating latest headers and latest verified tx"
+                    );
+                    let mut cache = input.params.verified_cache()?;
+                    chain.remove(input.params.network.max_reorg_blocks.unwrap_or(144))?;
+                    cache.remove(input.params.network.max_reorg_blocks.unwrap_or(144))?;
+                    reorg_happened = true;
+                    break;
+                }
+                // Later batches don't connect to a chain we failed to extend
+                Err(_) => break,
+            }
+        }
+        Ok(())
+    })?;
     info!("downloaded {:?}", chain.height());
 
     Ok(SPVDownloadHeadersResult {
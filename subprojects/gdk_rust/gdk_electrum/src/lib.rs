@@ -21,7 +21,8 @@ pub mod spv;
 pub mod sweep;
 
 use crate::account::{
-    discover_account, get_account_script_purpose, get_last_next_account_nums, Account,
+    discover_account, discover_accounts, get_account_script_purpose, get_last_next_account_nums,
+    Account,
 };
 use crate::error::Error;
 use crate::interface::ElectrumUrl;
@@ -990,6 +991,12 @@ impl ElectrumSession {
         )
     }
 
+    pub fn discover_subaccounts(&self, opt: DiscoverAccountsOpt) -> Result<Vec<bool>, Error> {
+        let accounts: Vec<_> =
+            opt.subaccounts.into_iter().map(|sa| (sa.xpub, sa.script_type)).collect();
+        discover_accounts(&self.url, self.proxy.as_deref(), &accounts, self.gap_limit)
+    }
+
     pub fn get_next_subaccount(&self, opt: GetNextAccountOpt) -> Result<u32, Error> {
         let (_, next_account) = get_last_next_account_nums(
             self.accounts.read()?.keys().copied().collect(),
@@ -90,6 +90,9 @@ impl Session for ElectrumSession {
             "discover_subaccount" => {
                 self.discover_subaccount(serde_json::from_value(input)?).to_json()
             }
+            "discover_subaccounts" => {
+                self.discover_subaccounts(serde_json::from_value(input)?).to_json()
+            }
             "create_subaccount" => {
                 let opt: CreateAccountOpt = serde_json::from_value(input)?;
                 self.create_subaccount(opt).to_json()
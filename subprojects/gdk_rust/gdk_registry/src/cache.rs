@@ -105,18 +105,15 @@ impl fmt::Debug for Cache {
 impl Cache {
     /// Filters the registry agains the ids in `choose`, then extends `self`
     /// with the values from the filtered registry.
-    pub(crate) fn extend_from_registry(&mut self, registry: RegistryInfos, choose: &[AssetId]) {
-        let RegistryInfos {
-            mut assets,
-            mut icons,
-            ..
-        } = registry;
-
-        assets.retain(|id, _| choose.contains(id));
-        icons.retain(|id, _| choose.contains(id));
-
-        self.assets.extend(assets);
-        self.icons.extend(icons);
+    pub(crate) fn extend_from_registry(&mut self, registry: &RegistryInfos, choose: &[AssetId]) {
+        for id in choose {
+            if let Some(asset) = registry.assets.get(id) {
+                self.assets.insert(id.clone(), asset.clone());
+            }
+            if let Some(icon) = registry.icons.get(id) {
+                self.icons.insert(id.clone(), icon.clone());
+            }
+        }
     }
 
     pub(crate) fn filter(&mut self, ids: &[AssetId]) {
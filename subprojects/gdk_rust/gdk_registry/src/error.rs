@@ -1,5 +1,5 @@
 use gdk_common::{bitcoin, serde_cbor, ureq};
-use std::sync::{MutexGuard, PoisonError, TryLockError};
+use std::sync::{MutexGuard, PoisonError, RwLockReadGuard, RwLockWriteGuard, TryLockError};
 
 /// Result type alias of the `gdk_registry` crate.
 pub type Result<T> = std::result::Result<T, Error>;
@@ -84,6 +84,18 @@ impl<T> From<PoisonError<MutexGuard<'_, T>>> for Error {
     }
 }
 
+impl<T> From<PoisonError<RwLockReadGuard<'_, T>>> for Error {
+    fn from(e: PoisonError<RwLockReadGuard<'_, T>>) -> Self {
+        Error::Poison(e.to_string())
+    }
+}
+
+impl<T> From<PoisonError<RwLockWriteGuard<'_, T>>> for Error {
+    fn from(e: PoisonError<RwLockWriteGuard<'_, T>>) -> Self {
+        Error::Poison(e.to_string())
+    }
+}
+
 impl<T> From<TryLockError<MutexGuard<'_, T>>> for Error {
     fn from(err: TryLockError<MutexGuard<'_, T>>) -> Self {
         match err {
@@ -8,17 +8,33 @@ use gdk_common::ureq;
 use crate::Result;
 use serde_json::Value;
 
+/// The values returned by the server to validate our copy on the next call.
+#[derive(Clone, Debug, Default, PartialEq, Eq)]
+pub(crate) struct Validators {
+    pub(crate) last_modified: String,
+    pub(crate) etag: String,
+}
+
 /// Returns `None` if the response status is `304 Not Modified`.
+///
+/// Sends `If-None-Match` as well as `If-Modified-Since` when we have an
+/// `ETag`, so that servers behind caches that rewrite modification dates
+/// still avoid resending an unchanged registry.
 pub(crate) fn call(
     url: &str,
     agent: &ureq::Agent,
-    last_modified: &str,
+    validators: &Validators,
     custom_params: &HashMap<String, String>,
-) -> Result<Option<(Value, String)>> {
+) -> Result<Option<(Value, Validators)>> {
     let start = Instant::now();
 
-    let mut request =
-        agent.get(url).timeout(Duration::from_secs(30)).set("If-Modified-Since", last_modified);
+    let mut request = agent
+        .get(url)
+        .timeout(Duration::from_secs(30))
+        .set("If-Modified-Since", &validators.last_modified);
+    if !validators.etag.is_empty() {
+        request = request.set("If-None-Match", &validators.etag);
+    }
     for param in custom_params {
         request = request.set(param.0, param.1);
     }
@@ -38,6 +54,9 @@ pub(crate) fn call(
         .unwrap_or_default()
         .to_string();
 
+    let etag =
+        response.header("ETag").or_else(|| response.header("etag")).unwrap_or_default().to_string();
+
     // `respone.into_json()` is slow because of many syscalls. See:
     // https://github.com/algesten/ureq/pull/506.
     let buffered_reader = BufReader::new(response.into_reader());
@@ -45,7 +64,13 @@ pub(crate) fn call(
 
     info!("END call {} {} took: {:?}", &url, status, start.elapsed());
 
-    Ok(Some((value, last_modified)))
+    Ok(Some((
+        value,
+        Validators {
+            last_modified,
+            etag,
+        },
+    )))
 }
 
 #[cfg(test)]
@@ -68,6 +93,7 @@ mod test {
                     request::method_path("GET", what.endpoint()),
                     request::headers(contains(key("if-modified-since"))), // HTTP headers are case insensitive, and ureq it's downcasing them
                     request::headers(contains(("accept-encoding", "gzip, br"))),
+                    request::headers(not(contains(key("if-none-match")))),
                 ])
                 .respond_with(
                     status_code(200)
@@ -76,12 +102,13 @@ mod test {
                 ),
             );
 
-            let (_, last_modified) =
-                call(&server.url_str(what.endpoint()), &agent, "", &HashMap::new())
+            let validators = Validators::default();
+            let (_, new_validators) =
+                call(&server.url_str(what.endpoint()), &agent, &validators, &HashMap::new())
                     .unwrap()
                     .unwrap();
 
-            assert_eq!(expected_last_modified, last_modified);
+            assert_eq!(expected_last_modified, new_validators.last_modified);
         }
     }
 }
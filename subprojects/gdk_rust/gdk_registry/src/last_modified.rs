@@ -7,6 +7,29 @@ use serde::{Deserialize, Serialize};
 pub(crate) struct LastModified {
     assets: String,
     icons: String,
+
+    /// The `ETag`s of the assets and icons, if the server sent one. Absent
+    /// from files written by older versions.
+    #[serde(default)]
+    assets_etag: String,
+    #[serde(default)]
+    icons_etag: String,
+}
+
+impl LastModified {
+    pub(crate) fn etag(&self, what: AssetsOrIcons) -> &str {
+        match what {
+            AssetsOrIcons::Assets => &self.assets_etag,
+            AssetsOrIcons::Icons => &self.icons_etag,
+        }
+    }
+
+    pub(crate) fn set_etag(&mut self, what: AssetsOrIcons, etag: String) {
+        match what {
+            AssetsOrIcons::Assets => self.assets_etag = etag,
+            AssetsOrIcons::Icons => self.icons_etag = etag,
+        }
+    }
 }
 
 impl Index<AssetsOrIcons> for LastModified {
@@ -45,6 +45,7 @@ use gdk_common::log;
 use last_modified::LastModified;
 use params::GetAssetsQuery;
 use registry_infos::RegistrySource;
+use serde::Serialize;
 
 pub use asset_entry::AssetEntry;
 pub use error::{Error, Result};
@@ -75,7 +76,7 @@ pub fn get_assets(params: GetAssetsParams) -> Result<RegistryInfos> {
         GetAssetsQuery::FromHardCoded(matcher) => {
             return registry::filter_hard_coded(network, &*matcher)
         }
-        GetAssetsQuery::WholeRegistry => return registry::get_full(network),
+        GetAssetsQuery::WholeRegistry => return registry::get_full(network).map(|r| (*r).clone()),
     };
 
     let mut cache_files = cache::CACHE_FILES.lock()?;
@@ -129,7 +130,7 @@ pub fn get_assets(params: GetAssetsParams) -> Result<RegistryInfos> {
 
     if !in_registry.is_empty() {
         log::debug!("{:?} found in the local asset registry", in_registry);
-        cache.extend_from_registry(registry, &in_registry);
+        cache.extend_from_registry(&registry, &in_registry);
         cache.update(&mut *cache_files)?;
         cached.extend(in_registry);
         from_cache = false;
@@ -188,6 +189,33 @@ pub fn refresh_assets(params: RefreshAssetsParams) -> Result<RegistrySource> {
     Ok(RegistrySource::merge(assets_source, icons_source))
 }
 
+/// Memory used by the in-process copies of the local asset registries.
+#[derive(Debug, Default, Serialize)]
+pub struct MemoryStats {
+    /// The number of networks whose registry is loaded.
+    pub networks: usize,
+
+    /// The total number of loaded assets.
+    pub num_assets: usize,
+
+    /// The total number of loaded icons.
+    pub num_icons: usize,
+
+    /// The total size of the loaded base64 encoded icons.
+    pub icons_bytes: usize,
+}
+
+/// Returns the memory used by the loaded asset registries.
+pub fn memory_stats() -> Result<MemoryStats> {
+    registry::memory_stats()
+}
+
+/// Releases the loaded asset registries. They are read again from disk
+/// the next time they are needed.
+pub fn trim_memory() -> Result<()> {
+    registry::trim()
+}
+
 #[cfg(test)]
 mod tests {
     use super::*;
@@ -294,7 +322,7 @@ mod tests {
     }
 
     fn get_full_registry() -> RegistryInfos {
-        registry::get_full(ElementsNetwork::Liquid).unwrap()
+        (*registry::get_full(ElementsNetwork::Liquid).unwrap()).clone()
     }
 
     const DEFAULT_ASSETS: [&str; 2] = [
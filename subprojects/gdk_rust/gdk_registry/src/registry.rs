@@ -1,16 +1,16 @@
 use std::collections::HashMap;
 use std::fs::{self, File, OpenOptions};
 use std::path::Path;
-use std::sync::{Mutex, MutexGuard};
+use std::sync::{Arc, Mutex, MutexGuard, RwLock};
 
 use gdk_common::log::{debug, warn};
-use gdk_common::once_cell::sync::OnceCell;
+use gdk_common::once_cell::sync::{Lazy, OnceCell};
 use serde::{de::DeserializeOwned, Serialize};
 
 use crate::params::{ElementsNetwork, RefreshAssetsParams};
 use crate::registry_infos::{RegistryAssets, RegistryIcons, RegistrySource};
 use crate::{cache, file, hard_coded, http};
-use crate::{AssetEntry, AssetsOrIcons, Error, LastModified, RegistryInfos, Result};
+use crate::{AssetEntry, AssetsOrIcons, Error, LastModified, MemoryStats, RegistryInfos, Result};
 
 type LastModifiedFiles = HashMap<ElementsNetwork, Mutex<File>>;
 type RegistryFiles = HashMap<(ElementsNetwork, AssetsOrIcons), Mutex<File>>;
@@ -18,6 +18,12 @@ type RegistryFiles = HashMap<(ElementsNetwork, AssetsOrIcons), Mutex<File>>;
 static LAST_MODIFIED_FILES: OnceCell<LastModifiedFiles> = OnceCell::new();
 static REGISTRY_FILES: OnceCell<RegistryFiles> = OnceCell::new();
 
+/// The full local registry of each network, read once and shared read-only by
+/// every session. A refresh that downloads new data replaces the entry, so
+/// callers still holding the previous registry are unaffected.
+static FULL_REGISTRIES: Lazy<RwLock<HashMap<ElementsNetwork, Arc<RegistryInfos>>>> =
+    Lazy::new(Default::default);
+
 /// Returns the file at `path`, using `initializer` to initialize the file's
 /// contents if it doesn't already exist.
 fn get_file<T: Serialize, I: FnOnce() -> T>(path: &Path, initializer: I) -> Result<File> {
@@ -86,6 +92,7 @@ pub(crate) fn refresh_assets(params: &RefreshAssetsParams) -> Result<RegistrySou
             if let Some(xpub) = params.xpub {
                 cache::update_missing_assets(xpub, &assets)?;
             }
+            reload_full(params.network())?;
             Ok(RegistrySource::Downloaded)
         }
 
@@ -100,6 +107,7 @@ pub(crate) fn refresh_icons(params: &RefreshAssetsParams) -> Result<RegistrySour
             if let Some(xpub) = params.xpub {
                 cache::update_missing_icons(xpub, &icons)?;
             }
+            reload_full(params.network())?;
             Ok(RegistrySource::Downloaded)
         }
 
@@ -108,7 +116,50 @@ pub(crate) fn refresh_icons(params: &RefreshAssetsParams) -> Result<RegistrySour
 }
 
 /// Returns all the local assets and icons.
-pub(crate) fn get_full(network: ElementsNetwork) -> Result<RegistryInfos> {
+pub(crate) fn get_full(network: ElementsNetwork) -> Result<Arc<RegistryInfos>> {
+    if let Some(registry) = FULL_REGISTRIES.read()?.get(&network) {
+        return Ok(Arc::clone(registry));
+    }
+    // Read the files while holding the write lock, so that a concurrent
+    // reload can't be overwritten with the registry as it was before.
+    let mut registries = FULL_REGISTRIES.write()?;
+    if let Some(registry) = registries.get(&network) {
+        return Ok(Arc::clone(registry));
+    }
+    let registry = Arc::new(read_full(network)?);
+    registries.insert(network, Arc::clone(&registry));
+    Ok(registry)
+}
+
+/// Returns the number of assets and icons held by the shared registries of
+/// all networks, and the total size of the base64 encoded icons.
+pub(crate) fn memory_stats() -> Result<MemoryStats> {
+    let mut stats = MemoryStats::default();
+    for registry in FULL_REGISTRIES.read()?.values() {
+        stats.networks += 1;
+        stats.num_assets += registry.assets.len();
+        stats.num_icons += registry.icons.len();
+        stats.icons_bytes += registry.icons.values().map(String::len).sum::<usize>();
+    }
+    Ok(stats)
+}
+
+/// Drops the shared registries, which are re-read from the local files when
+/// next needed. Callers still holding a registry are unaffected.
+pub(crate) fn trim() -> Result<()> {
+    FULL_REGISTRIES.write()?.clear();
+    Ok(())
+}
+
+/// Replaces the shared registry of `network` with the current local files.
+fn reload_full(network: ElementsNetwork) -> Result<()> {
+    let mut registries = FULL_REGISTRIES.write()?;
+    let registry = Arc::new(read_full(network)?);
+    registries.insert(network, registry);
+    Ok(())
+}
+
+fn read_full(network: ElementsNetwork) -> Result<RegistryInfos> {
     let assets = {
         let mut v = fetch::<RegistryAssets>(network, AssetsOrIcons::Assets)?;
         v.extend(hard_coded::assets(network));
@@ -128,7 +179,7 @@ pub(crate) fn filter_full(
     network: ElementsNetwork,
     matcher: &dyn Fn(&AssetEntry, Option<&str>) -> bool,
 ) -> Result<RegistryInfos> {
-    filter(get_full(network)?, matcher)
+    filter(&get_full(network)?, matcher)
 }
 
 pub(crate) fn filter_hard_coded(
@@ -136,26 +187,27 @@ pub(crate) fn filter_hard_coded(
     matcher: &dyn Fn(&AssetEntry, Option<&str>) -> bool,
 ) -> Result<RegistryInfos> {
     let registry = RegistryInfos::new(hard_coded::assets(network), hard_coded::icons(network));
-    filter(registry, matcher)
+    filter(&registry, matcher)
 }
 
 fn filter(
-    mut registry: RegistryInfos,
+    registry: &RegistryInfos,
     matcher: &dyn Fn(&AssetEntry, Option<&str>) -> bool,
 ) -> Result<RegistryInfos> {
-    let matched_ids = registry
-        .assets
-        .iter()
-        .filter_map(|(id, asset)| {
-            let icon = registry.icons.get(id).map(|i| &**i);
-            matcher(asset, icon).then_some(id.clone())
-        })
-        .collect::<Vec<_>>();
-
-    registry.assets.retain(|id, _| matched_ids.contains(id));
-    registry.icons.retain(|id, _| matched_ids.contains(id));
+    // Copy out only the matches, the registry itself is shared
+    let mut filtered = RegistryInfos::default();
+
+    for (id, asset) in &registry.assets {
+        let icon = registry.icons.get(id);
+        if matcher(asset, icon.map(|i| &**i)) {
+            filtered.assets.insert(id.clone(), asset.clone());
+            if let Some(icon) = icon {
+                filtered.icons.insert(id.clone(), icon.clone());
+            }
+        }
+    }
 
-    Ok(registry)
+    Ok(filtered)
 }
 
 fn fetch<T: Default + Serialize + DeserializeOwned>(
@@ -182,19 +234,21 @@ fn refresh<T: Serialize + DeserializeOwned>(
 ) -> Result<Option<T>> {
     let file = &mut *get_registry_file(params.network(), what)?;
 
-    let last_modified = if file::read::<T>(file).is_ok() {
-        get_last_modified(params.network(), what)?
+    let validators = if file::read::<T>(file).is_ok() {
+        get_validators(params.network(), what)?
     } else {
-        String::new()
+        http::Validators::default()
     };
 
-    match http::call(&params.url(what), &params.agent()?, &last_modified, &params.custom_headers())?
-    {
-        Some((value, new_modified)) => {
-            debug!("fetched {} were last modified {}", what, new_modified);
+    match http::call(&params.url(what), &params.agent()?, &validators, &params.custom_headers())? {
+        Some((value, new_validators)) => {
+            debug!(
+                "fetched {} were last modified {} etag {}",
+                what, new_validators.last_modified, new_validators.etag
+            );
             let downloaded = serde_json::from_value::<T>(value)?;
             file::write(&downloaded, file)?;
-            set_last_modified(new_modified, params.network(), what)?;
+            set_validators(new_validators, params.network(), what)?;
             Ok(Some(downloaded))
         }
 
@@ -230,18 +284,25 @@ fn get_last_modified_file(network: ElementsNetwork) -> Result<MutexGuard<'static
         .map_err(Into::into)
 }
 
-fn get_last_modified(network: ElementsNetwork, what: AssetsOrIcons) -> Result<String> {
+fn get_validators(network: ElementsNetwork, what: AssetsOrIcons) -> Result<http::Validators> {
     get_last_modified_file(network)
         //
         .and_then(|mut file| crate::file::read::<LastModified>(&mut *file))
-        .map(|last_modified| last_modified[what].to_owned())
+        .map(|last_modified| http::Validators {
+            last_modified: last_modified[what].to_owned(),
+            etag: last_modified.etag(what).to_owned(),
+        })
 }
 
-fn set_last_modified(new: String, network: ElementsNetwork, what: AssetsOrIcons) -> Result<()> {
+fn set_validators(
+    new: http::Validators,
+    network: ElementsNetwork,
+    what: AssetsOrIcons,
+) -> Result<()> {
     get_last_modified_file(network).and_then(|mut file| {
         let mut last_modified = crate::file::read::<LastModified>(&mut *file)?;
-        let old = &mut last_modified[what];
-        *old = new;
+        last_modified[what] = new.last_modified;
+        last_modified.set_etag(what, new.etag);
         crate::file::write(&last_modified, &mut *file)
     })
 }
@@ -2,6 +2,8 @@
 #define GDK_GDK_RUST_H
 #pragma once
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -19,6 +21,17 @@ int GDKRUST_create_session(void* session, const char* network);
 
 int GDKRUST_call_session(void* session, const char *method, const char *input, char** output);
 
+/**
+ * Call a session method, returning its result as MessagePack.
+ *
+ * :param input: The json input to pass to the method, as UTF-8 text.
+ * :param input_len: The length of ``input`` in bytes.
+ * :param output: The msgpack encoded output, should be freed using `GDKRUST_destroy_buffer`.
+ * :param output_len: Destination for the length of ``output`` in bytes.
+ */
+int GDKRUST_call_session_bin(void* session, const char *method, const unsigned char *input, size_t input_len,
+    unsigned char** output, size_t* output_len);
+
 /**
  * A collection of stateless functions
  *
@@ -40,6 +53,14 @@ int GDKRUST_set_notification_handler(void* session, GDKRUST_notification_handler
  */
 void GDKRUST_destroy_string(char* str);
 
+/**
+ * Free a buffer returned by the api.
+ *
+ * :param buf: The buffer to free.
+ * :param len: The length of the buffer as returned with it.
+ */
+void GDKRUST_destroy_buffer(unsigned char* buf, size_t len);
+
 /**
  * Free a session created by the api.
  *
@@ -3,11 +3,12 @@ extern crate serde_json;
 
 pub mod error;
 mod exchange_rates;
+mod msgpack;
 
 use gdk_common::util::{make_str, read_str};
 use serde_json::Value;
 
-use std::ffi::CString;
+use std::ffi::{CStr, CString};
 use std::io::Write;
 use std::os::raw::c_char;
 use std::str::FromStr;
@@ -143,17 +144,52 @@ pub extern "C" fn GDKRUST_call_session(
     }
     let sess: &mut GdkSession = unsafe { &mut *(ptr as *mut GdkSession) };
     let method = read_str(method);
-    let input = read_str(input);
+    let input = unsafe { CStr::from_ptr(input) }.to_bytes();
 
-    match call_session(sess, &method, &input) {
-        Ok(value) => {
-            unsafe { *output = make_str(value.to_string()) };
-            GA_OK
-        }
+    let (retv, value) = call_session_ffi(sess, &method, input);
+    unsafe { *output = make_str(value.to_string()) };
+    retv
+}
+
+/// As `GDKRUST_call_session`, but takes the JSON input as a sized buffer and
+/// returns the result encoded as MessagePack, to be freed with
+/// `GDKRUST_destroy_buffer`.
+#[no_mangle]
+pub extern "C" fn GDKRUST_call_session_bin(
+    ptr: *mut libc::c_void,
+    method: *const c_char,
+    input: *const u8,
+    input_len: usize,
+    output: *mut *mut u8,
+    output_len: *mut usize,
+) -> i32 {
+    if ptr.is_null() || output.is_null() || output_len.is_null() {
+        return GA_ERROR;
+    }
+    let sess: &mut GdkSession = unsafe { &mut *(ptr as *mut GdkSession) };
+    let method = read_str(method);
+    let input = if input.is_null() {
+        &[]
+    } else {
+        unsafe { std::slice::from_raw_parts(input, input_len) }
+    };
+
+    let (retv, value) = call_session_ffi(sess, &method, input);
+    let bytes = msgpack::to_vec(&value).into_boxed_slice();
+    unsafe {
+        *output_len = bytes.len();
+        *output = Box::into_raw(bytes) as *mut u8;
+    }
+    retv
+}
+
+fn call_session_ffi(sess: &mut GdkSession, method: &str, input: &[u8]) -> (i32, Value) {
+    match call_session(sess, method, input) {
+        Ok(value) => (GA_OK, value),
 
         Err(err) => {
             let suppress_log =
-                &err.message == "Scriptpubkey not found" && &method == "get_scriptpubkey_data";
+                &err.message == "Scriptpubkey not found" && method == "get_scriptpubkey_data";
 
             if !suppress_log {
                 log::error!("error: {:?}", err);
@@ -165,14 +201,13 @@ pub extern "C" fn GDKRUST_call_session(
                 GA_ERROR
             };
 
-            unsafe { *output = make_str(to_string(&err)) };
-            retv
+            (retv, err.into())
         }
     }
 }
 
-fn call_session(sess: &mut GdkSession, method: &str, input: &str) -> Result<Value, JsonError> {
-    let input = serde_json::from_str(input)?;
+fn call_session(sess: &mut GdkSession, method: &str, input: &[u8]) -> Result<Value, JsonError> {
+    let input = serde_json::from_slice(input)?;
 
     if method == "exchange_rates" {
         let params = serde_json::from_value(input)?;
@@ -255,6 +290,16 @@ pub extern "C" fn GDKRUST_destroy_string(ptr: *mut c_char) {
     }
 }
 
+#[no_mangle]
+pub extern "C" fn GDKRUST_destroy_buffer(ptr: *mut u8, len: usize) {
+    if !ptr.is_null() {
+        unsafe {
+            // retake the boxed slice and drop
+            let _ = Box::from_raw(std::ptr::slice_from_raw_parts_mut(ptr, len));
+        }
+    }
+}
+
 #[no_mangle]
 pub extern "C" fn GDKRUST_destroy_session(ptr: *mut libc::c_void) {
     unsafe {
@@ -327,6 +372,11 @@ fn handle_call(method: &str, input: &str) -> Result<String, Error> {
             let params: gdk_registry::GetAssetsParams = serde_json::from_str(input)?;
             to_string(&gdk_registry::get_assets(params)?)
         }
+        "registry_memory_stats" => to_string(&gdk_registry::memory_stats()?),
+        "trim_registry" => {
+            gdk_registry::trim_memory()?;
+            to_string(&json!(true))
+        }
         "get_unspent_outputs_for_private_key" => {
             let param: sweep::SweepOpt = serde_json::from_str(input)?;
             to_string(&sweep::get_unspent_outputs_for_private_key(&param)?)
@@ -0,0 +1,136 @@
+//! Minimal MessagePack encoding of JSON values.
+//!
+//! Used to return call results to the C++ side in a binary form that it
+//! can decode without re-scanning JSON text.
+
+use serde_json::Value;
+
+/// Encode `value` as MessagePack.
+pub fn to_vec(value: &Value) -> Vec<u8> {
+    let mut out = Vec::with_capacity(256);
+    write_value(&mut out, value);
+    out
+}
+
+fn write_value(out: &mut Vec<u8>, value: &Value) {
+    match value {
+        Value::Null => out.push(0xc0),
+        Value::Bool(b) => out.push(if *b {
+            0xc3
+        } else {
+            0xc2
+        }),
+        Value::Number(n) => {
+            if let Some(u) = n.as_u64() {
+                write_uint(out, u);
+            } else if let Some(i) = n.as_i64() {
+                write_int(out, i);
+            } else {
+                out.push(0xcb);
+                out.extend_from_slice(&n.as_f64().unwrap_or_default().to_be_bytes());
+            }
+        }
+        Value::String(s) => write_str(out, s),
+        Value::Array(a) => {
+            write_len(out, a.len(), 0x90, 0xdc, 0xdd);
+            for v in a {
+                write_value(out, v);
+            }
+        }
+        Value::Object(m) => {
+            write_len(out, m.len(), 0x80, 0xde, 0xdf);
+            for (k, v) in m {
+                write_str(out, k);
+                write_value(out, v);
+            }
+        }
+    }
+}
+
+fn write_uint(out: &mut Vec<u8>, u: u64) {
+    if u < 0x80 {
+        out.push(u as u8);
+    } else if u <= u8::MAX as u64 {
+        out.push(0xcc);
+        out.push(u as u8);
+    } else if u <= u16::MAX as u64 {
+        out.push(0xcd);
+        out.extend_from_slice(&(u as u16).to_be_bytes());
+    } else if u <= u32::MAX as u64 {
+        out.push(0xce);
+        out.extend_from_slice(&(u as u32).to_be_bytes());
+    } else {
+        out.push(0xcf);
+        out.extend_from_slice(&u.to_be_bytes());
+    }
+}
+
+fn write_int(out: &mut Vec<u8>, i: i64) {
+    // Only called for negative values; non-negative values use write_uint
+    if i >= -32 {
+        out.push(i as i8 as u8);
+    } else if i >= i8::MIN as i64 {
+        out.push(0xd0);
+        out.push(i as i8 as u8);
+    } else if i >= i16::MIN as i64 {
+        out.push(0xd1);
+        out.extend_from_slice(&(i as i16).to_be_bytes());
+    } else if i >= i32::MIN as i64 {
+        out.push(0xd2);
+        out.extend_from_slice(&(i as i32).to_be_bytes());
+    } else {
+        out.push(0xd3);
+        out.extend_from_slice(&i.to_be_bytes());
+    }
+}
+
+fn write_str(out: &mut Vec<u8>, s: &str) {
+    let len = s.len();
+    if len < 32 {
+        out.push(0xa0 | len as u8);
+    } else if len <= u8::MAX as usize {
+        out.push(0xd9);
+        out.push(len as u8);
+    } else if len <= u16::MAX as usize {
+        out.push(0xda);
+        out.extend_from_slice(&(len as u16).to_be_bytes());
+    } else {
+        out.push(0xdb);
+        out.extend_from_slice(&(len as u32).to_be_bytes());
+    }
+    out.extend_from_slice(s.as_bytes());
+}
+
+fn write_len(out: &mut Vec<u8>, len: usize, fix: u8, tag16: u8, tag32: u8) {
+    if len < 16 {
+        out.push(fix | len as u8);
+    } else if len <= u16::MAX as usize {
+        out.push(tag16);
+        out.extend_from_slice(&(len as u16).to_be_bytes());
+    } else {
+        out.push(tag32);
+        out.extend_from_slice(&(len as u32).to_be_bytes());
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_msgpack_encoding() {
+        assert_eq!(to_vec(&json!(null)), vec![0xc0]);
+        assert_eq!(to_vec(&json!(true)), vec![0xc3]);
+        assert_eq!(to_vec(&json!(127)), vec![0x7f]);
+        assert_eq!(to_vec(&json!(255)), vec![0xcc, 0xff]);
+        assert_eq!(to_vec(&json!(-1)), vec![0xff]);
+        assert_eq!(to_vec(&json!(-33)), vec![0xd0, 0xdf]);
+        assert_eq!(to_vec(&json!(70000)), vec![0xce, 0x00, 0x01, 0x11, 0x70]);
+        assert_eq!(to_vec(&json!("ab")), vec![0xa2, b'a', b'b']);
+        assert_eq!(to_vec(&json!({"a": [1]})), vec![0x81, 0xa1, b'a', 0x91, 0x01]);
+        let long = "x".repeat(40);
+        let encoded = to_vec(&json!(long));
+        assert_eq!(&encoded[..2], &[0xd9, 40]);
+        assert_eq!(encoded.len(), 42);
+    }
+}
@@ -256,6 +256,7 @@ fn test_spv_timeout() {
             encryption_key: None,
         },
         headers_to_download: Some(1),
+        batches: None,
     };
     let _ = headers::download_headers(&param_download);
 
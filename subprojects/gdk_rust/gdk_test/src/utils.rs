@@ -39,6 +39,7 @@ pub fn spv_verify_tx(
     let param_download = SPVDownloadHeadersParams {
         params: common.clone(),
         headers_to_download,
+        batches: None,
     };
 
     let mut handle = None;
@@ -1,9 +1,39 @@
+#include <algorithm>
+#include <vector>
+
 #include "src/utils.hpp"
 
 using namespace green;
 
 // Verify AES GCM encryption/decryption
 
+namespace {
+    constexpr size_t CHUNK_SIZE = 64 * 1024;
+    constexpr size_t PREFIX_SIZE = 48 + 16; // Header and header tag
+    constexpr size_t TAG_SIZE = 16;
+
+    static std::vector<unsigned char> chunked_encrypt(byte_span_t key, byte_span_t plaintext)
+    {
+        std::vector<unsigned char> encrypted;
+        const bool written = aes_gcm_chunked_encrypt(key, plaintext, [&encrypted](byte_span_t data) {
+            encrypted.insert(encrypted.end(), data.begin(), data.end());
+            return true;
+        });
+        GDK_RUNTIME_ASSERT(written);
+        return encrypted;
+    }
+
+    static bool chunked_decrypt_fails(byte_span_t key, std::vector<unsigned char> encrypted)
+    {
+        try {
+            aes_gcm_chunked_decrypt_in_place(key, encrypted);
+        } catch (const std::exception&) {
+            return true;
+        }
+        return false;
+    }
+} // namespace
+
 int main()
 {
     unsigned char buff[32 * 32];
@@ -49,5 +79,83 @@ int main()
         free(decrypted);
     }
 
+    std::vector<unsigned char> plaintext(CHUNK_SIZE * 65 + 1);
+    for (size_t i = 0; i < plaintext.size(); ++i) {
+        plaintext[i] = buff[i % sizeof(buff)] ^ static_cast<unsigned char>(i >> 10);
+    }
+    const auto plaintext_span = gsl::make_span(plaintext);
+
+    // Verify chunked round trips either side of chunk and batch boundaries
+    for (const size_t len : { size_t(1), CHUNK_SIZE - 1, CHUNK_SIZE, CHUNK_SIZE + 1, CHUNK_SIZE * 2 + 7,
+             CHUNK_SIZE * 64, CHUNK_SIZE * 64 + 1, plaintext.size() }) {
+        const auto input = plaintext_span.first(len);
+        auto encrypted = chunked_encrypt(key, input);
+        const size_t num_chunks = (len + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        GDK_RUNTIME_ASSERT(encrypted.size() == PREFIX_SIZE + len + num_chunks * TAG_SIZE);
+        GDK_RUNTIME_ASSERT(is_aes_gcm_chunked(key, encrypted));
+        GDK_RUNTIME_ASSERT(!is_aes_gcm_chunked(bad_key, encrypted));
+        GDK_RUNTIME_ASSERT(chunked_decrypt_fails(bad_key, encrypted));
+        GDK_RUNTIME_ASSERT(aes_gcm_chunked_decrypt_in_place(key, encrypted) == len);
+        GDK_RUNTIME_ASSERT(std::equal(input.begin(), input.end(), encrypted.begin()));
+    }
+
+    // Verify tampering, truncation and reordering are detected
+    const auto encrypted = chunked_encrypt(key, plaintext_span.first(CHUNK_SIZE * 3));
+    const size_t stride = CHUNK_SIZE + TAG_SIZE;
+    {
+        // A flipped bit in a chunk's cyphertext or tag
+        for (const size_t offset : { PREFIX_SIZE + stride + 100, PREFIX_SIZE + stride * 2 - 1 }) {
+            auto tampered = encrypted;
+            tampered[offset] ^= 1;
+            GDK_RUNTIME_ASSERT(is_aes_gcm_chunked(key, tampered));
+            GDK_RUNTIME_ASSERT(chunked_decrypt_fails(key, tampered));
+        }
+        // A modified header, e.g. an altered plaintext length
+        auto tampered = encrypted;
+        tampered[8] ^= 1;
+        GDK_RUNTIME_ASSERT(!is_aes_gcm_chunked(key, tampered));
+        GDK_RUNTIME_ASSERT(chunked_decrypt_fails(key, tampered));
+    }
+    {
+        // Truncation by a byte or by a whole chunk, and extension
+        for (const size_t len : { encrypted.size() - 1, encrypted.size() - stride, PREFIX_SIZE }) {
+            const std::vector<unsigned char> truncated(encrypted.begin(), encrypted.begin() + len);
+            GDK_RUNTIME_ASSERT(chunked_decrypt_fails(key, truncated));
+        }
+        auto extended = encrypted;
+        extended.push_back(0);
+        GDK_RUNTIME_ASSERT(chunked_decrypt_fails(key, extended));
+    }
+    {
+        // Swapped chunks
+        auto reordered = encrypted;
+        const auto first = reordered.begin() + PREFIX_SIZE;
+        std::swap_ranges(first, first + stride, first + stride);
+        GDK_RUNTIME_ASSERT(is_aes_gcm_chunked(key, reordered));
+        GDK_RUNTIME_ASSERT(chunked_decrypt_fails(key, reordered));
+    }
+
+    // Verify legacy single-shot data is not detected as chunked, even if
+    // its random IV happens to start with the chunked container magic
+    {
+        const auto input = plaintext_span.first(CHUNK_SIZE);
+        std::vector<unsigned char> legacy(aes_gcm_encrypt_get_length(input));
+        GDK_RUNTIME_ASSERT(aes_gcm_encrypt(key, input, legacy) == legacy.size());
+        GDK_RUNTIME_ASSERT(!is_aes_gcm_chunked(key, legacy));
+        const unsigned char magic[] = { 'G', 'D', 'K', 'C' };
+        std::copy(std::begin(magic), std::end(magic), legacy.begin());
+        GDK_RUNTIME_ASSERT(!is_aes_gcm_chunked(key, legacy));
+        GDK_RUNTIME_ASSERT(!is_aes_gcm_chunked(key, gsl::make_span(legacy).first(PREFIX_SIZE - 1)));
+    }
+
+    // Verify a failed write stops encryption and is reported
+    {
+        size_t num_writes = 0;
+        const bool written = aes_gcm_chunked_encrypt(key, plaintext_span, [&num_writes](byte_span_t) {
+            return ++num_writes == 1; // Accept the header only
+        });
+        GDK_RUNTIME_ASSERT(!written && num_writes == 2);
+    }
+
     return 0;
 }
@@ -0,0 +1,146 @@
+#include <boost/multiprecision/cpp_dec_float.hpp>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <random>
+
+#include "src/amount.hpp"
+#include "src/assertion.hpp"
+
+using namespace green;
+
+// Verify amount conversions, including against reference conversions
+
+namespace {
+    // The reference conversions compute each value with boost cpp_dec_float
+    // decimal arithmetic: 15 digits for intermediate values, then rounding
+    // to 8 (BTC) or 2 (fiat) decimal places for display. This is how the
+    // amount conversions were computed before the integer fast paths
+    using btc_type = boost::multiprecision::number<boost::multiprecision::cpp_dec_float<8>>;
+    using fiat_type = boost::multiprecision::number<boost::multiprecision::cpp_dec_float<2>>;
+    using conversion_type = boost::multiprecision::number<boost::multiprecision::cpp_dec_float<15>>;
+
+    template <typename T> static std::string ref_fmt(const T& v, size_t dp = 2)
+    {
+        return fiat_type(v).str(dp, std::ios_base::fixed | std::ios_base::showpoint);
+    }
+
+    static int64_t ref_to_satoshi(const std::string& str, size_t dp)
+    {
+        const conversion_type scale(static_cast<int64_t>(std::pow(10, dp)));
+        return (conversion_type(str) * scale).convert_to<int64_t>();
+    }
+
+    static std::string ref_format(int64_t satoshi, size_t dp)
+    {
+        const conversion_type scale(static_cast<int64_t>(std::pow(10, dp)));
+        return ref_fmt(btc_type(conversion_type(satoshi) / scale), dp);
+    }
+
+    static std::string ref_fiat(int64_t satoshi, const std::string& rate)
+    {
+        return ref_fmt(fiat_type(conversion_type(rate) * conversion_type(satoshi) / conversion_type(100000000)));
+    }
+
+    static void check_convert(const nlohmann::json& amount_json, const std::string& rate)
+    {
+        const auto result = amount::convert(amount_json, "USD", rate);
+        const int64_t satoshi = result.at("satoshi");
+        const auto check = [&](const std::string& key, const std::string& expected) {
+            if (result.at(key) != expected) {
+                std::cerr << amount_json.dump() << " rate " << rate << ": " << key << " " << result.at(key)
+                          << " != " << expected << std::endl;
+                GDK_RUNTIME_ASSERT(false);
+            }
+        };
+        for (const auto& [key, dp] : { std::make_pair("btc", 8), std::make_pair("mbtc", 5),
+                 std::make_pair("ubtc", 2), std::make_pair("bits", 2), std::make_pair("sats", 0) }) {
+            if (amount_json.contains(key)) {
+                GDK_RUNTIME_ASSERT(satoshi == ref_to_satoshi(amount_json.at(key), dp));
+            }
+            check(key, dp ? ref_format(satoshi, dp) : std::to_string(satoshi));
+        }
+        if (!rate.empty()) {
+            check("fiat", ref_fiat(satoshi, rate));
+        }
+    }
+
+    static bool convert_throws(const nlohmann::json& amount_json)
+    {
+        try {
+            amount::convert(amount_json, "USD", "1.00");
+        } catch (const std::exception&) {
+            return true;
+        }
+        return false;
+    }
+
+    // A random decimal string with up to max_dp decimal places
+    static std::string random_decimal(std::mt19937_64& rng, uint64_t max_integer, size_t max_dp, bool is_signed)
+    {
+        std::string str = std::to_string(rng() % (max_integer + 1));
+        if (const size_t dp = rng() % (max_dp + 1); dp) {
+            str += '.';
+            for (size_t i = 0; i < dp; ++i) {
+                str += static_cast<char>('0' + rng() % 10);
+            }
+        }
+        return !is_signed || rng() % 4 ? str : '-' + str;
+    }
+} // namespace
+
+int main()
+{
+    // Fixed conversions
+    auto result = amount::convert({ { "btc", "1.5" } }, "USD", "12345.67");
+    GDK_RUNTIME_ASSERT(result.at("satoshi") == 150000000);
+    GDK_RUNTIME_ASSERT(result.at("btc") == "1.50000000");
+    GDK_RUNTIME_ASSERT(result.at("mbtc") == "1500.00000");
+    GDK_RUNTIME_ASSERT(result.at("ubtc") == "1500000.00");
+    GDK_RUNTIME_ASSERT(result.at("sats") == "150000000");
+    GDK_RUNTIME_ASSERT(result.at("fiat") == ref_fiat(150000000, "12345.67"));
+    GDK_RUNTIME_ASSERT(result.at("is_current") == true);
+
+    result = amount::convert({ { "satoshi", -1 } }, std::string(), std::string());
+    GDK_RUNTIME_ASSERT(result.at("btc") == "-0.00000001");
+    GDK_RUNTIME_ASSERT(result.at("fiat").is_null() && result.at("is_current") == false);
+
+    // Excess decimal places are truncated towards zero
+    GDK_RUNTIME_ASSERT(amount::convert({ { "btc", "0.123456789" } }, "", "").at("satoshi") == 12345678);
+    GDK_RUNTIME_ASSERT(amount::convert({ { "btc", "-0.123456789" } }, "", "").at("satoshi") == -12345678);
+
+    // Asset amounts use the asset's precision
+    const nlohmann::json asset_info = { { "asset_id", "abcd" }, { "precision", 2 } };
+    result = amount::convert({ { "abcd", "12.345" }, { "asset_info", asset_info } }, "", "");
+    GDK_RUNTIME_ASSERT(result.at("satoshi") == 1234 && result.at("abcd") == "12.34");
+
+    // Strings the fixed point parser rejects fall back to decimal parsing
+    for (const auto* str : { "1e-3", "1E2", "+0.5", ".5", "5." }) {
+        check_convert({ { "btc", str } }, "1.5");
+    }
+
+    // Invalid requests
+    GDK_RUNTIME_ASSERT(convert_throws({ { "btc", "1" }, { "sats", "1" } })); // Multiple amounts
+    GDK_RUNTIME_ASSERT(convert_throws(nlohmann::json::object())); // No amount
+    GDK_RUNTIME_ASSERT(convert_throws({ { "btc", "21000001" } })); // Above the maximum
+    GDK_RUNTIME_ASSERT(convert_throws({ { "btc", "-21000001" } })); // Below the minimum
+
+    // Parity with decimal arithmetic for edge case and random values
+    const int64_t max_satoshi = amount::get_max_satoshi();
+    for (const int64_t satoshi : { int64_t(0), int64_t(1), int64_t(-1), int64_t(50), int64_t(99999999),
+             int64_t(100000000), max_satoshi, -max_satoshi }) {
+        for (const auto* rate : { "", "0", "1", "0.5", "12345.67", "0.00000001", "99999.99999999", "1.123456789" }) {
+            check_convert({ { "satoshi", satoshi } }, rate);
+        }
+    }
+    std::mt19937_64 rng(20231014);
+    const std::array<const char*, 4> keys = { "btc", "mbtc", "ubtc", "sats" };
+    const std::array<uint64_t, 4> max_integers = { 20000000, 2000000000, 2000000000000, 2000000000000000 };
+    const std::array<size_t, 4> max_dps = { 10, 7, 4, 0 };
+    for (size_t i = 0; i < 20000; ++i) {
+        const auto rate = random_decimal(rng, 100000, 8, false);
+        const auto value = random_decimal(rng, max_integers[i % 4], max_dps[i % 4], true);
+        check_convert({ { keys[i % 4], value } }, rate);
+    }
+
+    return 0;
+}
@@ -0,0 +1,160 @@
+#include "src/assertion.hpp"
+#include "src/ga_cache.hpp"
+#include "src/network_parameters.hpp"
+#include "src/session.hpp"
+#include "src/signer.hpp"
+#include "src/utils.hpp"
+#include <nlohmann/json.hpp>
+
+using namespace green;
+
+// Verify the local cache's tx search, and its eviction and compaction
+
+namespace {
+    static const std::string ADDRESS_A("tb1qaddressa");
+    static const std::string ADDRESS_B("tb1qaddressb");
+
+    static std::string get_txhash(char c) { return std::string(64, c); }
+    static std::string get_txhash(size_t i)
+    {
+        const auto digits = std::to_string(i);
+        return std::string(64 - digits.size(), '0') + digits;
+    }
+
+    static nlohmann::json make_tx(const std::string& address, int64_t satoshi)
+    {
+        nlohmann::json ep = { { "address", address }, { "is_relevant", true } };
+        return { { "block_height", 100 }, { "inputs", nlohmann::json::array() },
+            { "outputs", nlohmann::json::array({ ep }) }, { "satoshi", { { "btc", satoshi } } } };
+    }
+
+    static const std::string MNEMONIC(
+        "abandon abandon abandon abandon abandon abandon abandon abandon abandon abandon abandon about");
+    constexpr int64_t MAX_BYTES = 256 * 1024; // "cache_max_kb" below
+
+    // Returns a cache with saving enabled, under a new random name
+    static std::unique_ptr<cache> make_saved_cache(const network_parameters& net_params)
+    {
+        auto signer = std::make_shared<green::signer>(
+            net_params, nlohmann::json(), nlohmann::json({ { "mnemonic", MNEMONIC } }));
+        std::array<unsigned char, 64> key;
+        get_random_bytes(key.size(), key.data(), key.size());
+        auto c = std::make_unique<cache>(net_params, "testnet");
+        c->load_db(key, signer);
+        return c;
+    }
+
+    static bool has_tx_data(cache& c, size_t i)
+    {
+        bool found = false;
+        c.get_transaction_data(get_txhash(i), { [&found](const auto& db_blob) { found = db_blob.has_value(); } });
+        return found;
+    }
+
+    static std::vector<std::string> search(cache& c, const cache::tx_query& query)
+    {
+        std::vector<std::string> txhashes;
+        c.search_transactions(0, query,
+            { [&txhashes](uint64_t /*ts*/, const std::string& txhash, uint32_t /*block*/, uint32_t /*spent*/,
+                  uint32_t /*spv_status*/, byte_span_t /*tx_data*/) { txhashes.push_back(txhash); } });
+        return txhashes;
+    }
+} // namespace
+
+int main()
+{
+    nlohmann::json init_config;
+    init_config["datadir"] = ".";
+    init_config["cache_flush_ms"] = 0;
+    init_config["cache_max_kb"] = MAX_BYTES / 1024;
+    gdk_init(init_config);
+
+    const network_parameters net_params(network_parameters::get("testnet"));
+    cache c(net_params, "testnet");
+
+    // Txs are returned newest (highest timestamp) first
+    c.insert_transaction(0, 1000, get_txhash('a'), make_tx(ADDRESS_A, 5000));
+    c.insert_transaction(0, 2000, get_txhash('b'), make_tx(ADDRESS_B, -7000));
+    c.insert_transaction(0, 3000, get_txhash('c'), make_tx(ADDRESS_A, 9000));
+    c.insert_transaction(1, 4000, get_txhash('d'), make_tx(ADDRESS_A, 9000));
+    const std::vector<std::string> all = { get_txhash('c'), get_txhash('b'), get_txhash('a') };
+
+    cache::tx_query query;
+    query.count = 10;
+
+    // No filters: every tx in the subaccount
+    GDK_RUNTIME_ASSERT(search(c, query) == all);
+
+    // The count limits the results
+    query.count = 2;
+    GDK_RUNTIME_ASSERT(search(c, query) == std::vector<std::string>(all.begin(), all.begin() + 2));
+    query.count = 10;
+
+    // Address only
+    query.address = ADDRESS_A;
+    GDK_RUNTIME_ASSERT(search(c, query) == std::vector<std::string>({ get_txhash('c'), get_txhash('a') }));
+    query.address = "tb1qnotours";
+    GDK_RUNTIME_ASSERT(search(c, query).empty());
+    query.address.clear();
+
+    // Cursor only
+    query.before_ts = 3000;
+    GDK_RUNTIME_ASSERT(search(c, query) == std::vector<std::string>({ get_txhash('b'), get_txhash('a') }));
+    query.before_ts.reset();
+
+    // Txhashes only (as used for memo searches)
+    query.txhashes = std::set<std::string>{ get_txhash('b') };
+    GDK_RUNTIME_ASSERT(search(c, query) == std::vector<std::string>({ get_txhash('b') }));
+    query.txhashes.reset();
+
+    // Asset and absolute amount
+    query.asset_id = "btc";
+    GDK_RUNTIME_ASSERT(search(c, query) == all);
+    query.min_satoshi = 6000;
+    GDK_RUNTIME_ASSERT(search(c, query) == std::vector<std::string>({ get_txhash('c'), get_txhash('b') }));
+    query.asset_id.clear(); // Amount only
+    query.max_satoshi = 8000;
+    GDK_RUNTIME_ASSERT(search(c, query) == std::vector<std::string>({ get_txhash('b') }));
+
+    // All filters together
+    query.address = ADDRESS_B;
+    query.asset_id = "btc";
+    query.before_ts = 2500;
+    GDK_RUNTIME_ASSERT(search(c, query) == std::vector<std::string>({ get_txhash('b') }));
+    query.before_ts = 2000;
+    GDK_RUNTIME_ASSERT(search(c, query).empty());
+
+    // Over budget: the oldest raw txs are evicted to under 75% of the
+    // budget, then the mostly free database is compacted
+    const std::vector<unsigned char> rawtx(1024, 0x55);
+    const size_t num_txs = 1024;
+    {
+        auto saved = make_saved_cache(net_params);
+        for (size_t i = 0; i < num_txs; ++i) {
+            saved->insert_transaction_data(get_txhash(i), rawtx);
+        }
+        GDK_RUNTIME_ASSERT(saved->get_memory_stats().at("db_bytes").get<int64_t>() > MAX_BYTES);
+        saved->flush_db();
+        const auto stats = saved->get_memory_stats();
+        GDK_RUNTIME_ASSERT(stats.at("freelist_count") == 0);
+        GDK_RUNTIME_ASSERT(stats.at("db_bytes").get<int64_t>() <= MAX_BYTES * 3 / 4);
+        GDK_RUNTIME_ASSERT(!has_tx_data(*saved, 0));
+        GDK_RUNTIME_ASSERT(has_tx_data(*saved, num_txs - 1));
+    }
+
+    // Over budget with mostly non-evictable data: nothing is evicted,
+    // since evicting everything would still leave the cache over budget
+    {
+        auto saved = make_saved_cache(net_params);
+        saved->upsert_key_value("non_evictable", std::vector<unsigned char>(MAX_BYTES, 0xaa));
+        for (size_t i = 0; i < num_txs / 8; ++i) {
+            saved->insert_transaction_data(get_txhash(i), rawtx);
+        }
+        saved->flush_db();
+        for (size_t i = 0; i < num_txs / 8; ++i) {
+            GDK_RUNTIME_ASSERT(has_tx_data(*saved, i));
+        }
+    }
+
+    return 0;
+}
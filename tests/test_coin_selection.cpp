@@ -0,0 +1,93 @@
+#include <numeric>
+
+#include "src/assertion.hpp"
+#include "src/coin_selection.hpp"
+
+using namespace green;
+
+// Verify coin selection strategies choose the expected UTXOs
+
+namespace {
+    using values_t = std::vector<amount::value_type>;
+
+    static amount::value_type get_sum(const values_t& values, const std::vector<size_t>& selected)
+    {
+        amount::value_type sum = 0;
+        for (const auto i : selected) {
+            GDK_RUNTIME_ASSERT(i < values.size());
+            sum += values[i];
+        }
+        return sum;
+    }
+
+    static coin_selection_params get_params(amount::value_type target, uint32_t strategies)
+    {
+        coin_selection_params params;
+        params.target = target;
+        params.strategies = strategies;
+        params.budget = std::chrono::milliseconds(1000);
+        return params;
+    }
+} // namespace
+
+int main()
+{
+    // Branch and bound finds an exact match using the fewest inputs,
+    // returned largest first
+    {
+        const values_t values = { 1, 3, 2, 7, 5 };
+        auto params = get_params(10, COIN_SELECT_BNB);
+        params.change_cost = 100;
+        const auto selected = select_coins(values, params);
+        GDK_RUNTIME_ASSERT(selected == std::vector<size_t>({ 3, 1 })); // 7 + 3
+        // All strategies prefer the exact match over largest first (7 + 5)
+        params.strategies = COIN_SELECT_ALL;
+        GDK_RUNTIME_ASSERT(get_sum(values, select_coins(values, params)) == 10);
+    }
+
+    // Knapsack is used when no selection avoids change
+    {
+        // Every value is below the target, so any two of them are needed
+        const values_t values = { 6, 6, 6 };
+        const auto params = get_params(10, COIN_SELECT_BNB | COIN_SELECT_KNAPSACK);
+        const auto selected = select_coins(values, params);
+        GDK_RUNTIME_ASSERT(selected.size() == 2 && get_sum(values, selected) == 12);
+    }
+    {
+        // The smaller values can't fund the target: the smallest value
+        // larger than it is chosen, rather than the largest value
+        const values_t values = { 50, 20, 3, 3 };
+        const auto params = get_params(15, COIN_SELECT_KNAPSACK);
+        GDK_RUNTIME_ASSERT(select_coins(values, params) == std::vector<size_t>({ 1 }));
+    }
+
+    // Change is avoided only when the excess is within the tolerance
+    {
+        const values_t values = { 1006, 1005 };
+        auto params = get_params(1000, COIN_SELECT_ALL);
+        params.input_cost = 10;
+        params.change_cost = 100;
+        params.change_tolerance = 5; // e.g. the dust limit
+        // An excess of 5 is not worth creating change for
+        GDK_RUNTIME_ASSERT(select_coins(values, params) == std::vector<size_t>({ 1 }));
+        // An excess of 6 requires change whichever value is used; only one input is needed
+        params.change_tolerance = 4;
+        GDK_RUNTIME_ASSERT(select_coins(values, params).size() == 1);
+        // With only change producing values, largest first is the result
+        params.strategies = COIN_SELECT_BNB;
+        GDK_RUNTIME_ASSERT(select_coins(values, params) == std::vector<size_t>({ 0 }));
+    }
+
+    // Insufficient funds and degenerate inputs return no selection
+    for (const uint32_t strategies : { COIN_SELECT_BNB, COIN_SELECT_KNAPSACK, COIN_SELECT_LARGEST_FIRST }) {
+        const values_t values = { 1, 0, 2 };
+        GDK_RUNTIME_ASSERT(select_coins(values, get_params(4, strategies)).empty());
+        GDK_RUNTIME_ASSERT(select_coins(values, get_params(0, strategies)).empty());
+        GDK_RUNTIME_ASSERT(select_coins({}, get_params(1, strategies)).empty());
+        // Exactly sufficient funds select every non-zero value
+        const auto selected = select_coins(values, get_params(3, strategies));
+        GDK_RUNTIME_ASSERT(selected == std::vector<size_t>({ 2, 0 }));
+    }
+
+    return 0;
+}
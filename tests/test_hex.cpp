@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <cctype>
+#include <random>
+
+#include "src/assertion.hpp"
+#include "src/ga_wally.hpp"
+
+using namespace green;
+
+// Verify hex encoding and decoding, including against the wally functions
+// that they were previously computed with
+
+namespace {
+    static std::string wally_b2h(byte_span_t data)
+    {
+        char* ret;
+        GDK_VERIFY(wally_hex_from_bytes(data.data(), data.size(), &ret));
+        std::string hex(ret);
+        wally_free_string(ret);
+        return hex;
+    }
+
+    static bool wally_h2b(const std::string& hex, std::vector<unsigned char>& bytes)
+    {
+        size_t written;
+        bytes.resize(hex.size() / 2);
+        return wally_hex_to_bytes(hex.c_str(), bytes.data(), bytes.size(), &written) == WALLY_OK
+            && written == bytes.size();
+    }
+
+    static bool h2b_fails(const std::string& hex, bool reverse)
+    {
+        std::vector<unsigned char> bytes(hex.size() / 2);
+        try {
+            h2b(hex, bytes, reverse);
+        } catch (const std::exception&) {
+            return true;
+        }
+        return false;
+    }
+} // namespace
+
+int main()
+{
+    std::mt19937 rng(20240601);
+    std::uniform_int_distribution<int> byte_dist(0, 255);
+
+    // Every length up to and beyond several SIMD chunks, so that each tail
+    // length is covered both alone and after one or more chunks
+    for (size_t len = 0; len <= 200; ++len) {
+        std::vector<unsigned char> data(len);
+        std::generate(data.begin(), data.end(), [&] { return static_cast<unsigned char>(byte_dist(rng)); });
+        const std::vector<unsigned char> reversed(data.rbegin(), data.rend());
+
+        // Encoding, in both byte orders
+        std::string hex(len * 2, '\0'), hex_rev(len * 2, '\0');
+        b2h(data, hex);
+        b2h(data, hex_rev, true);
+        GDK_RUNTIME_ASSERT(b2h(data) == hex);
+        GDK_RUNTIME_ASSERT(b2h_rev(data) == hex_rev);
+        if (len) {
+            GDK_RUNTIME_ASSERT(wally_b2h(data) == hex);
+            GDK_RUNTIME_ASSERT(wally_b2h(reversed) == hex_rev);
+        }
+
+        // Decoding, in both byte orders
+        std::vector<unsigned char> decoded(len);
+        h2b(hex, decoded);
+        GDK_RUNTIME_ASSERT(decoded == data);
+        h2b(hex_rev, decoded, true);
+        GDK_RUNTIME_ASSERT(decoded == data);
+        if (len) {
+            GDK_RUNTIME_ASSERT(h2b(hex) == data);
+            GDK_RUNTIME_ASSERT(h2b_rev(hex) == reversed);
+            GDK_RUNTIME_ASSERT(h2b(hex, 0x42).front() == 0x42);
+            GDK_RUNTIME_ASSERT(std::equal(data.begin(), data.end(), h2b(hex, 0x42).begin() + 1));
+        }
+
+        // Upper and mixed case decode identically
+        std::string upper(hex), mixed(hex);
+        std::transform(upper.begin(), upper.end(), upper.begin(), [](char c) { return std::toupper(c); });
+        for (auto& c : mixed) {
+            c = byte_dist(rng) & 1 ? std::toupper(c) : c;
+        }
+        for (const auto& h : { upper, mixed }) {
+            h2b(h, decoded);
+            GDK_RUNTIME_ASSERT(decoded == data);
+            h2b(h, decoded, true);
+            GDK_RUNTIME_ASSERT(decoded == reversed);
+            std::vector<unsigned char> wally_decoded;
+            GDK_RUNTIME_ASSERT(!len || (wally_h2b(h, wally_decoded) && wally_decoded == data));
+        }
+    }
+
+    // Every byte value, at the start and end of a SIMD chunk and in the
+    // scalar tail, is accepted exactly when it is a hex character, as wally does
+    for (const size_t len : { size_t(1), size_t(16), size_t(17), size_t(40) }) {
+        const std::string hex = b2h(std::vector<unsigned char>(len, 0x5a));
+        for (const size_t pos : { size_t(0), size_t(1), size_t(31), size_t(32), len * 2 - 1 }) {
+            if (pos >= hex.size()) {
+                continue;
+            }
+            for (int c = 0; c <= 255; ++c) {
+                std::string modified(hex);
+                modified[pos] = static_cast<char>(c);
+                const bool is_hex = std::isxdigit(c) != 0;
+                GDK_RUNTIME_ASSERT(h2b_fails(modified, false) == !is_hex);
+                GDK_RUNTIME_ASSERT(h2b_fails(modified, true) == !is_hex);
+                std::vector<unsigned char> wally_decoded;
+                GDK_RUNTIME_ASSERT(wally_h2b(modified, wally_decoded) == is_hex);
+                if (is_hex) {
+                    GDK_RUNTIME_ASSERT(h2b(modified) == wally_decoded);
+                }
+            }
+        }
+    }
+
+    // Mismatched buffer sizes and odd length hex are rejected
+    {
+        std::vector<unsigned char> bytes(4);
+        std::string hex(7, '0');
+        bool failed = false;
+        try {
+            b2h(bytes, hex);
+        } catch (const std::exception&) {
+            failed = true;
+        }
+        GDK_RUNTIME_ASSERT(failed);
+        GDK_RUNTIME_ASSERT(h2b_fails("0000000", false));
+        failed = false;
+        try {
+            h2b(std::string("000"));
+        } catch (const std::exception&) {
+            failed = true;
+        }
+        GDK_RUNTIME_ASSERT(failed);
+    }
+
+    return 0;
+}
@@ -0,0 +1,360 @@
+// A load generation and soak harness running many concurrent sessions.
+//
+// Each session logs in (registering a new wallet unless GA_MNEMONIC is
+// given), then runs a random mix of operations at a fixed rate until the
+// run ends. Latencies are reported per operation, along with throughput,
+// notification counts, the process thread count and RSS.
+//
+// Environment:
+//   GA_NETWORK        Network to connect to (default "localtest")
+//   GA_MNEMONIC       Wallet for every session instead of new wallets.
+//                     Sessions then share a cache file, so this is only
+//                     suitable for read-only soak testing against a backend
+//   GA_LOAD_SESSIONS  Number of sessions (default 10)
+//   GA_LOAD_SECONDS   Length of the run after all sessions log in (default 60)
+//   GA_LOAD_RATE      Total operations per second across all sessions (default 10)
+//   GA_LOAD_SEND      If 1, include create/sign/send of a self-payment
+#include "src/ga_auth_handlers.hpp"
+#include "src/ga_wally.hpp"
+#include "src/network_parameters.hpp"
+#include "src/session.hpp"
+#include "src/utils.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <random>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+using namespace green;
+
+namespace {
+    using clock_type = std::chrono::steady_clock;
+
+    std::string envstr(const char* name, const std::string& default_)
+    {
+        const auto p = std::getenv(name);
+        return p ? std::string(p) : default_;
+    }
+
+    uint64_t envnum(const char* name, const uint64_t default_)
+    {
+        const auto p = std::getenv(name);
+        return p ? std::strtoull(p, nullptr, 10) : default_;
+    }
+
+    nlohmann::json process_auth(auth_handler& handler)
+    {
+        while (true) {
+            const auto status_json = handler.get_status();
+            const std::string status = status_json.at("status");
+            if (status == "error") {
+                throw std::runtime_error(status_json.at("error"));
+            } else if (status == "call") {
+                handler.operator()();
+            } else if (status == "request_code") {
+                // Request a code using the first availale 2fa method
+                const std::string method = status_json.at("methods").at(0);
+                handler.request_code(method);
+            } else if (status == "resolve_code") {
+                // Only works for localtest environments
+                handler.resolve_code("555555");
+            } else if (status == "done") {
+                return status_json.at("result");
+            }
+        }
+    }
+
+    // Latencies and failures of each operation, across all sessions
+    class load_results final {
+    public:
+        void add(const std::string& op, clock_type::duration elapsed, bool failed)
+        {
+            const auto us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+            std::lock_guard<std::mutex> locker(m_mutex);
+            auto& r = m_ops[op];
+            r.latencies_us.push_back(us);
+            r.failures += failed;
+        }
+
+        void report(std::chrono::seconds duration)
+        {
+            std::lock_guard<std::mutex> locker(m_mutex);
+            const double seconds = std::max<double>(duration.count(), 1);
+            for (auto& [op, r] : m_ops) {
+                auto& l = r.latencies_us;
+                std::sort(l.begin(), l.end());
+                auto&& percentile = [&l](size_t p) { return l.empty() ? 0 : l[(l.size() - 1) * p / 100]; };
+                std::cout << op << ": count " << l.size() << " failed " << r.failures << " ops/s "
+                          << l.size() / seconds << " p50 " << percentile(50) / 1000.0 << "ms p99 "
+                          << percentile(99) / 1000.0 << "ms max " << (l.empty() ? 0 : l.back()) / 1000.0 << "ms\n";
+            }
+        }
+
+    private:
+        struct op_results {
+            std::vector<int64_t> latencies_us;
+            size_t failures = 0;
+        };
+        std::mutex m_mutex;
+        std::map<std::string, op_results> m_ops;
+    };
+
+    // Thread count and resident set size, from /proc where available
+    void report_process_usage()
+    {
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line)) {
+            if (line.rfind("Threads:", 0) == 0 || line.rfind("VmRSS:", 0) == 0 || line.rfind("VmHWM:", 0) == 0) {
+                std::cout << line << "\n";
+            }
+        }
+    }
+
+    std::atomic<uint64_t> s_notifications{ 0 };
+
+    void notification_handler(void* /*context*/, GA_json* details)
+    {
+        ++s_notifications;
+        delete reinterpret_cast<nlohmann::json*>(details);
+    }
+
+    class load_session final {
+    public:
+        load_session(const nlohmann::json& net_params, load_results& results, bool with_send)
+            : m_net_params(net_params)
+            , m_results(results)
+            , m_with_send(with_send)
+            , m_rng(std::random_device{}())
+        {
+        }
+
+        void login(std::string mnemonic)
+        {
+            m_session.set_notification_handler(notification_handler, nullptr);
+            timed("connect", [this] { return m_session.connect(m_net_params); });
+            const bool is_new = mnemonic.empty();
+            if (is_new) {
+                mnemonic = bip39_mnemonic_from_bytes(get_random_bytes<32>());
+            }
+            const nlohmann::json credentials({ { "mnemonic", mnemonic } });
+            if (is_new) {
+                timed("register", [&] {
+                    auto_auth_handler call(new register_call(m_session, nlohmann::json(), credentials));
+                    process_auth(call);
+                });
+            }
+            timed("login", [&] {
+                auto_auth_handler call(new login_user_call(m_session, nlohmann::json(), credentials));
+                process_auth(call);
+            });
+        }
+
+        // Run random operations until end, at one per interval. on_first_op
+        // is called once the first operation completes, or on returning
+        // if there was no time to make one
+        void run(clock_type::time_point end, clock_type::duration interval, const std::function<void()>& on_first_op)
+        {
+            // Stagger the start so sessions don't run in lockstep
+            const auto offset = interval * std::uniform_real_distribution<>(0, 1)(m_rng);
+            auto next = clock_type::now() + std::chrono::duration_cast<clock_type::duration>(offset);
+            bool is_first = true;
+            while (next < end) {
+                std::this_thread::sleep_until(next);
+                next += interval;
+                const auto choice = std::uniform_int_distribution<>(0, m_with_send ? 9 : 8)(m_rng);
+                try {
+                    if (choice < 4) {
+                        sync();
+                    } else if (choice < 7) {
+                        get_unspent_outputs();
+                    } else if (choice < 9) {
+                        get_receive_address();
+                    } else {
+                        send();
+                    }
+                } catch (const std::exception&) {
+                    // Recorded as a failure by timed()
+                }
+                if (is_first) {
+                    is_first = false;
+                    on_first_op();
+                }
+            }
+            if (is_first) {
+                on_first_op();
+            }
+        }
+
+    private:
+        template <typename FN> auto timed(const std::string& op, FN&& fn) -> decltype(fn())
+        {
+            const auto start = clock_type::now();
+            try {
+                if constexpr (std::is_void_v<decltype(fn())>) {
+                    fn();
+                    m_results.add(op, clock_type::now() - start, false);
+                } else {
+                    auto ret = fn();
+                    m_results.add(op, clock_type::now() - start, false);
+                    return ret;
+                }
+            } catch (const std::exception&) {
+                m_results.add(op, clock_type::now() - start, true);
+                throw;
+            }
+        }
+
+        void sync()
+        {
+            timed("get_transactions", [this] {
+                const nlohmann::json details({ { "subaccount", 0 }, { "first", 0 }, { "count", 30 } });
+                auto_auth_handler call(new get_transactions_call(m_session, details));
+                process_auth(call);
+            });
+        }
+
+        nlohmann::json get_unspent_outputs()
+        {
+            return timed("get_unspent_outputs", [this] {
+                const nlohmann::json details({ { "subaccount", 0 }, { "num_confs", 0 } });
+                auto_auth_handler call(new get_unspent_outputs_call(m_session, details));
+                return process_auth(call);
+            });
+        }
+
+        std::string get_receive_address()
+        {
+            return timed("get_receive_address", [this] {
+                const nlohmann::json details({ { "subaccount", 0 } });
+                auto_auth_handler call(new get_receive_address_call(m_session, details));
+                return process_auth(call).at("address").get<std::string>();
+            });
+        }
+
+        void send()
+        {
+            // Pay a small amount back to ourselves
+            const auto utxos = get_unspent_outputs();
+            const auto address = get_receive_address();
+            timed("send", [&] {
+                nlohmann::json details({ { "subaccount", 0 }, { "utxos", utxos.at("unspent_outputs") },
+                    { "addressees", { { { "address", address }, { "satoshi", 1000 } } } } });
+                {
+                    auto_auth_handler call(new create_transaction_call(m_session, std::move(details)));
+                    details = process_auth(call);
+                }
+                if (details.contains("error") && !details["error"].get<std::string>().empty()) {
+                    throw std::runtime_error(details["error"]);
+                }
+                {
+                    auto_auth_handler call(new sign_transaction_call(m_session, std::move(details)));
+                    details = process_auth(call);
+                }
+                auto_auth_handler call(new send_transaction_call(m_session, std::move(details)));
+                process_auth(call);
+            });
+        }
+
+        session m_session;
+        const nlohmann::json& m_net_params;
+        load_results& m_results;
+        const bool m_with_send;
+        std::mt19937 m_rng;
+    };
+} // namespace
+
+int main()
+{
+    using namespace std::chrono_literals;
+
+    nlohmann::json init_config;
+    init_config["datadir"] = ".";
+    init_config["log_level"] = "none";
+    gdk_init(init_config);
+
+    nlohmann::json net_params;
+    net_params["name"] = envstr("GA_NETWORK", "localtest");
+
+    const size_t num_sessions = std::max<uint64_t>(envnum("GA_LOAD_SESSIONS", 10), 1);
+    const auto duration = std::chrono::seconds(envnum("GA_LOAD_SECONDS", 60));
+    const auto rate = std::max<uint64_t>(envnum("GA_LOAD_RATE", 10), 1);
+    const bool with_send = envnum("GA_LOAD_SEND", 0) != 0;
+    const auto mnemonic = envstr("GA_MNEMONIC", std::string());
+    // Each session runs one operation per interval to give the total rate
+    const auto interval = std::chrono::duration_cast<clock_type::duration>(1s) * num_sessions / rate;
+
+    load_results results;
+    std::vector<std::unique_ptr<load_session>> sessions;
+    for (size_t i = 0; i < num_sessions; ++i) {
+        sessions.emplace_back(std::make_unique<load_session>(net_params, results, with_send));
+    }
+
+    // Log in all sessions concurrently
+    std::vector<std::thread> threads;
+    std::atomic<size_t> num_failed{ 0 };
+    std::vector<char> logged_in(num_sessions); // Not vector<bool>: written concurrently
+    for (size_t i = 0; i < num_sessions; ++i) {
+        threads.emplace_back([&, i] {
+            try {
+                sessions[i]->login(mnemonic);
+                logged_in[i] = true;
+            } catch (const std::exception& ex) {
+                std::cout << "session " << i << " login failed: " << ex.what() << std::endl;
+                ++num_failed;
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    threads.clear();
+    std::cout << num_sessions - num_failed << " of " << num_sessions << " sessions logged in" << std::endl;
+    report_process_usage();
+
+    // Run the workload
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t num_running = 0; // Sessions that have completed an operation
+    auto&& on_first_op = [&] {
+        std::lock_guard<std::mutex> locker(mutex);
+        ++num_running;
+        cv.notify_one();
+    };
+    const auto start = clock_type::now();
+    const auto end = start + duration;
+    for (size_t i = 0; i < num_sessions; ++i) {
+        if (logged_in[i]) {
+            threads.emplace_back([&, i] { sessions[i]->run(end, interval, on_first_op); });
+        }
+    }
+    {
+        // Report usage under load, once every session has done some work
+        std::unique_lock<std::mutex> locker(mutex);
+        cv.wait(locker, [&] { return num_running == threads.size(); });
+    }
+    report_process_usage();
+    for (auto& t : threads) {
+        t.join();
+    }
+    const auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(clock_type::now() - start);
+
+    std::cout << "ran " << threads.size() << " sessions for " << elapsed.count() << "s at " << rate << " ops/s\n";
+    results.report(elapsed);
+    std::cout << "notifications: " << s_notifications.load() << "\n";
+    report_process_usage();
+
+    sessions.clear(); // Disconnect and destroy all sessions
+    return num_failed == num_sessions ? 1 : 0;
+}
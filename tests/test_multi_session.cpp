@@ -1,8 +1,11 @@
+#include "src/assertion.hpp"
 #include "src/ga_auth_handlers.hpp"
 #include "src/network_parameters.hpp"
 #include "src/session.hpp"
+#include "src/signer.hpp"
 #include "src/utils.hpp"
 #include <assert.h>
+#include <atomic>
 #include <chrono>
 #include <iostream>
 #include <nlohmann/json.hpp>
@@ -121,11 +124,76 @@ static void test_async_disconnect(nlohmann::json net_params)
     }
 }
 
+static void count_session_snapshots(void* context, GA_json* details)
+{
+    std::unique_ptr<nlohmann::json> notification(reinterpret_cast<nlohmann::json*>(details));
+    if (notification->value("event", std::string()) == "session_snapshot") {
+        ++*static_cast<std::atomic<size_t>*>(context);
+    }
+}
+
+static void test_login_after_failed_login(nlohmann::json net_params)
+{
+    // Test that a login abandoned after reading its session snapshot
+    // doesn't leave its cache in use by a login with another mnemonic.
+    const auto mnemonic = std::getenv("GA_MNEMONIC");
+    if (!mnemonic) {
+        std::cout << "set GA_MNEMONIC to test login after a failed login\n";
+        return;
+    }
+    const nlohmann::json details({ { "mnemonic", mnemonic } });
+
+    {
+        // Log in once so that the wallet's cache holds a session snapshot
+        session session;
+        session.connect(net_params);
+        auto_auth_handler login_call(new login_user_call(session, nlohmann::json(), details));
+        process_auth(login_call);
+    }
+
+    std::atomic<size_t> num_snapshots{ 0 };
+    session session;
+    session.set_notification_handler(count_session_snapshots, &num_snapshots);
+    session.connect(net_params);
+    {
+        // Start logging in with another mnemonic, resolving its xpubs as a
+        // hardware wallet would, then fail the login by abandoning it when
+        // asked to sign the challenge
+        const nlohmann::json other_details({ { "mnemonic",
+            "abandon abandon abandon abandon abandon abandon abandon abandon abandon abandon abandon about" } });
+        login_user_call login_call(session, nlohmann::json(), other_details);
+        while (true) {
+            const auto status = login_call.get_status();
+            const std::string action = status.at("action");
+            if (status.at("status") == "call") {
+                login_call();
+            } else if (status.at("status") == "resolve_code" && action == "get_xpubs") {
+                nlohmann::json::array_t xpubs;
+                for (const auto& path : status.at("required_data").at("paths")) {
+                    xpubs.push_back(login_call.get_signer()->get_bip32_xpub(path.get<std::vector<uint32_t>>()));
+                }
+                login_call.resolve_hw_reply({ { "xpubs", std::move(xpubs) } });
+            } else {
+                GDK_RUNTIME_ASSERT(action == "sign_message");
+                break;
+            }
+        }
+    }
+
+    // Logging in with the first mnemonic must use its own cache, and so
+    // emit the snapshot saved by its previous login
+    const size_t num_failed_login_snapshots = num_snapshots;
+    auto_auth_handler login_call(new login_user_call(session, nlohmann::json(), details));
+    std::cout << process_auth(login_call) << std::endl;
+    GDK_RUNTIME_ASSERT(num_snapshots == num_failed_login_snapshots + 1);
+}
+
 int main()
 {
     nlohmann::json init_config;
     init_config["datadir"] = ".";
     init_config["log_level"] = "info";
+    init_config["session_snapshot"] = true;
     gdk_init(init_config);
 
     nlohmann::json net_params;
@@ -135,5 +203,6 @@ int main()
 
     test_two_sessions(net_params);
     test_async_disconnect(net_params);
+    test_login_after_failed_login(net_params);
     return 0;
 }
@@ -0,0 +1,159 @@
+#include <optional>
+#include <vector>
+
+#include "src/assertion.hpp"
+#include "src/exception.hpp"
+#include "src/ga_tx.hpp"
+#include "src/network_parameters.hpp"
+#include "src/redeposit_auth_handlers.hpp"
+#include "src/session.hpp"
+#include <nlohmann/json.hpp>
+
+using namespace green;
+
+// Verify that redeposits are split into txs within their weight and fee limits
+
+namespace {
+    static const std::string ASSET_ID(64, '1');
+
+    static nlohmann::json make_utxos(const std::string& asset_id, size_t count, const std::string& addr_type)
+    {
+        nlohmann::json::array_t utxos;
+        for (size_t i = 0; i < count; ++i) {
+            utxos.push_back({ { "address_type", addr_type }, { "pt_idx", i } });
+        }
+        return { { asset_id, std::move(utxos) } };
+    }
+
+    // The estimated weight of a planned tx, including any fee input needed
+    static size_t get_weight(
+        const network_parameters& net_params, const nlohmann::json& tx, size_t fee_input_weight, bool is_discounted)
+    {
+        size_t num_inputs = 0, inputs_weight = 0, num_outputs = 0;
+        for (const auto& asset : tx.items()) {
+            for (const auto& utxo : asset.value()) {
+                ++num_inputs;
+                inputs_weight += get_estimated_input_weight(utxo);
+            }
+            ++num_outputs;
+        }
+        if (net_params.is_liquid() && !tx.contains(net_params.get_policy_asset())) {
+            ++num_inputs;
+            inputs_weight += fee_input_weight;
+            ++num_outputs;
+        }
+        return get_estimated_tx_weight(net_params, num_inputs, inputs_weight, num_outputs, is_discounted);
+    }
+
+    // Verify the UTXOs are all planned, in order, and the txs are each
+    // within max_tx_weight and too full to hold the next tx's first UTXO
+    static void check_plan(const network_parameters& net_params, const nlohmann::json& utxos,
+        const std::vector<nlohmann::json>& txs, uint32_t max_tx_weight, size_t fee_input_weight)
+    {
+        GDK_RUNTIME_ASSERT(!txs.empty());
+        std::vector<nlohmann::json> planned;
+        for (size_t i = 0; i < txs.size(); ++i) {
+            GDK_RUNTIME_ASSERT(get_weight(net_params, txs[i], fee_input_weight, false) <= max_tx_weight);
+            for (const auto& asset : txs[i].items()) {
+                for (const auto& utxo : asset.value()) {
+                    planned.push_back(utxo);
+                }
+            }
+            if (i + 1 < txs.size()) {
+                auto fuller = txs[i];
+                const auto next = txs[i + 1].begin();
+                fuller[next.key()].push_back(next->front());
+                GDK_RUNTIME_ASSERT(get_weight(net_params, fuller, fee_input_weight, false) > max_tx_weight);
+            }
+        }
+        std::vector<nlohmann::json> expected;
+        for (const auto& asset : utxos.items()) {
+            for (const auto& utxo : asset.value()) {
+                expected.push_back(utxo);
+            }
+        }
+        GDK_RUNTIME_ASSERT(planned == expected);
+    }
+
+    static bool plan_fails(const network_parameters& net_params, nlohmann::json utxos, uint32_t max_tx_weight,
+        std::optional<uint64_t> max_fee)
+    {
+        try {
+            plan_redeposit_transactions(net_params, utxos, max_tx_weight, max_fee, 1000, 0);
+        } catch (const user_error&) {
+            return true;
+        }
+        return false;
+    }
+} // namespace
+
+int main()
+{
+    nlohmann::json init_config;
+    init_config["datadir"] = ".";
+    gdk_init(init_config);
+
+    // Bitcoin: UTXOs that fit are redeposited in a single tx
+    {
+        const network_parameters net_params(network_parameters::get("testnet"));
+        const auto utxos = make_utxos("btc", 50, "csv");
+        auto to_plan = utxos;
+        const auto txs = plan_redeposit_transactions(net_params, to_plan, 400000, {}, 1000, 0);
+        GDK_RUNTIME_ASSERT(txs.size() == 1 && txs[0].at("btc").size() == 50);
+        check_plan(net_params, utxos, txs, 400000, 0);
+    }
+
+    // Bitcoin: A lower weight limit splits them into full txs
+    for (const uint32_t max_tx_weight : { 4000u, 5000u, 10000u, 40000u }) {
+        const network_parameters net_params(network_parameters::get("testnet"));
+        const auto utxos = make_utxos("btc", 200, "p2wsh");
+        auto to_plan = utxos;
+        const auto txs = plan_redeposit_transactions(net_params, to_plan, max_tx_weight, {}, 1000, 0);
+        GDK_RUNTIME_ASSERT(txs.size() > 1);
+        check_plan(net_params, utxos, txs, max_tx_weight, 0);
+    }
+
+    // Bitcoin: A fee budget splits them further
+    {
+        const network_parameters net_params(network_parameters::get("testnet"));
+        const auto utxos = make_utxos("btc", 100, "p2wsh");
+        const uint64_t fee_rate = 10000, max_fee = 10000;
+        auto to_plan = utxos;
+        const auto txs = plan_redeposit_transactions(net_params, to_plan, 400000, max_fee, fee_rate, 0);
+        GDK_RUNTIME_ASSERT(txs.size() > 1);
+        for (const auto& tx : txs) {
+            const auto vsize = Tx::vsize_from_weight(get_weight(net_params, tx, 0, false));
+            GDK_RUNTIME_ASSERT(vsize * fee_rate / 1000 <= max_fee);
+        }
+    }
+
+    // Bitcoin: Limits too small for a single UTXO are rejected
+    {
+        const network_parameters net_params(network_parameters::get("testnet"));
+        GDK_RUNTIME_ASSERT(plan_fails(net_params, make_utxos("btc", 1, "p2sh"), 1000, {}));
+        GDK_RUNTIME_ASSERT(plan_fails(net_params, make_utxos("btc", 1, "p2wsh"), 400000, 1));
+        GDK_RUNTIME_ASSERT(!plan_fails(net_params, make_utxos("btc", 1, "p2wsh"), 4000, {}));
+    }
+
+    // Liquid with discounted fees: the weight limit applies to the raw
+    // weight, including a fee input for txs without any L-BTC
+    {
+        const network_parameters net_params(network_parameters::get("testnet-liquid"));
+        GDK_RUNTIME_ASSERT(net_params.use_discounted_fees());
+        const size_t fee_input_weight = 500;
+        for (const uint32_t max_tx_weight : { 20000u, 40000u, 400000u }) {
+            auto utxos = make_utxos(ASSET_ID, 150, "csv");
+            utxos.update(make_utxos(net_params.get_policy_asset(), 20, "p2wsh"));
+            auto to_plan = utxos;
+            const auto txs
+                = plan_redeposit_transactions(net_params, to_plan, max_tx_weight, {}, 100, fee_input_weight);
+            check_plan(net_params, utxos, txs, max_tx_weight, fee_input_weight);
+            for (const auto& tx : txs) {
+                const auto discounted = get_weight(net_params, tx, fee_input_weight, true);
+                GDK_RUNTIME_ASSERT(discounted < get_weight(net_params, tx, fee_input_weight, false));
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,126 @@
+#include <algorithm>
+#include <random>
+
+#include "src/assertion.hpp"
+#include "src/utxo_record.hpp"
+#include <nlohmann/json.hpp>
+
+using namespace green;
+
+// Verify that selecting UTXOs from a utxo_index matches filtering and
+// sorting their records, as is done for uncached UTXOs
+
+namespace {
+    static const std::string ASSET_ID(64, '1');
+    static const std::vector<std::string> SORT_BYS = { "oldest", "newest", "largest", "smallest" };
+
+    static nlohmann::json make_utxos(std::mt19937& rng, size_t count)
+    {
+        std::uniform_int_distribution<uint32_t> dist(0, 9);
+        const std::vector<std::string> addr_types = { "csv", "p2wsh", "p2sh" };
+        nlohmann::json::array_t utxos;
+        for (size_t i = 0; i < count; ++i) {
+            // Few distinct values and heights so that many UTXOs compare
+            // equal, with heights of 0 for unconfirmed UTXOs
+            nlohmann::json utxo = { { "satoshi", 1000 * (dist(rng) + 1) }, { "block_height", dist(rng) * 10 },
+                { "address_type", addr_types[dist(rng) % addr_types.size()] },
+                { "user_status", dist(rng) < 2 ? USER_STATUS_FROZEN : USER_STATUS_DEFAULT },
+                { "is_blinded", dist(rng) < 8 } };
+            if (dist(rng) < 5) {
+                utxo["expiry_height"] = dist(rng) * 10 + 5;
+            }
+            utxos.emplace_back(std::move(utxo));
+        }
+        return utxos;
+    }
+
+    // Filter and sort records as for uncached UTXOs
+    static utxo_records_t filter_and_sort(const nlohmann::json& utxos, const utxo_sorter& sorter,
+        amount::value_type dust_limit, const utxo_index::filter_fn_t& filter)
+    {
+        auto records = make_utxo_records(utxos);
+        records.erase(std::remove_if(records.begin(), records.end(),
+                          [&](const utxo_record& u) { return filter(u) || (dust_limit && u.satoshi <= dust_limit); }),
+            records.end());
+        std::sort(records.begin(), records.end(), sorter);
+        return records;
+    }
+
+    static std::vector<size_t> get_indices(const utxo_records_t& records)
+    {
+        std::vector<size_t> indices;
+        for (const auto& record : records) {
+            indices.push_back(record.index);
+        }
+        std::sort(indices.begin(), indices.end());
+        return indices;
+    }
+
+    // Selections must contain the same UTXOs in the same sort order. The
+    // order of UTXOs that compare equal is unspecified
+    static void check_select(const nlohmann::json& asset_utxos, const utxo_index& index, const std::string& sort_by,
+        amount::value_type dust_limit, const utxo_index::filter_fn_t& filter)
+    {
+        const utxo_sorter sorter(sort_by);
+        const auto expected = filter_and_sort(asset_utxos.at(ASSET_ID), sorter, dust_limit, filter);
+        const auto selected = index.select(ASSET_ID, sorter, dust_limit, filter);
+        GDK_RUNTIME_ASSERT(selected.size() == expected.size());
+        GDK_RUNTIME_ASSERT(std::is_sorted(selected.begin(), selected.end(), sorter));
+        for (size_t i = 0; i < selected.size(); ++i) {
+            GDK_RUNTIME_ASSERT(!sorter(selected[i], expected[i]) && !sorter(expected[i], selected[i]));
+        }
+        GDK_RUNTIME_ASSERT(get_indices(selected) == get_indices(expected));
+        for (const auto& record : selected) {
+            GDK_RUNTIME_ASSERT(!filter(record) && (!dust_limit || record.satoshi > dust_limit));
+        }
+    }
+} // namespace
+
+int main()
+{
+    std::mt19937 rng(20240601);
+
+    const std::vector<utxo_index::filter_fn_t> filters = {
+        [](const utxo_record&) { return false; },
+        [](const utxo_record& u) { return u.user_status == USER_STATUS_FROZEN; },
+        [](const utxo_record& u) { return u.address_type != "csv" || !u.is_blinded; },
+        [](const utxo_record& u) { return u.expiry_height > 45; },
+        [](const utxo_record&) { return true; },
+    };
+    // No limit, exactly on a UTXO value, between UTXO values, and
+    // above all UTXO values
+    const std::vector<amount::value_type> dust_limits = { 0, 1000, 5000, 5500, 10000 };
+
+    for (const size_t count : { size_t(0), size_t(1), size_t(2), size_t(50), size_t(500) }) {
+        nlohmann::json asset_utxos = { { ASSET_ID, make_utxos(rng, count) }, { "error", "some error" } };
+        const utxo_index index(asset_utxos);
+        for (const auto& sort_by : SORT_BYS) {
+            for (const auto dust_limit : dust_limits) {
+                for (const auto& filter : filters) {
+                    check_select(asset_utxos, index, sort_by, dust_limit, filter);
+                }
+            }
+            // Unknown assets select nothing
+            GDK_RUNTIME_ASSERT(index.select("error", utxo_sorter(sort_by), 0, filters.front()).empty());
+        }
+    }
+
+    // Unconfirmed UTXOs sort as the newest
+    {
+        nlohmann::json::array_t utxos;
+        for (const uint32_t block_height : { 0u, 20u, 0u, 10u }) {
+            utxos.push_back({ { "satoshi", 1000 }, { "block_height", block_height } });
+        }
+        const nlohmann::json asset_utxos = { { ASSET_ID, utxos } };
+        const utxo_index index(asset_utxos);
+        const auto none = [](const utxo_record&) { return false; };
+        const auto oldest = index.select(ASSET_ID, utxo_sorter("oldest"), 0, none);
+        GDK_RUNTIME_ASSERT(oldest.size() == 4 && oldest[0].index == 3 && oldest[1].index == 1);
+        GDK_RUNTIME_ASSERT(!oldest[2].block_height && !oldest[3].block_height);
+        const auto newest = index.select(ASSET_ID, utxo_sorter("newest"), 0, none);
+        GDK_RUNTIME_ASSERT(newest.size() == 4 && newest[2].index == 1 && newest[3].index == 3);
+        GDK_RUNTIME_ASSERT(!newest[0].block_height && !newest[1].block_height);
+    }
+
+    return 0;
+}
@@ -39,6 +39,7 @@ GETOPT='getopt'
 install_prefix="/"
 install=false
 enable_tests=FALSE # cmake bool format
+enable_benchmarks=FALSE # cmake bool format
 python_version=3
 enable_python=false
 no_deps_rebuild=false
@@ -58,7 +59,7 @@ if [ -f "/.dockerenv" ] && [ -f "/root/.cargo/env" ]; then
     source /root/.cargo/env
 fi
 
-TEMPOPT=`"$GETOPT" -n "build.sh" -o b:,v -l enable-tests,clang,gcc,devmode,mingw-w64,no-deps-rebuild,disable-bcur,static,install:,ndk:,iphone:,iphonesim:,buildtype:,python-version:,parallel:,external-deps-dir: -- "$@"`
+TEMPOPT=`"$GETOPT" -n "build.sh" -o b:,v -l enable-tests,enable-benchmarks,clang,gcc,devmode,mingw-w64,no-deps-rebuild,disable-bcur,static,install:,ndk:,iphone:,iphonesim:,buildtype:,python-version:,parallel:,external-deps-dir: -- "$@"`
 eval set -- "$TEMPOPT"
 while true; do
     case "$1" in
@@ -66,6 +67,7 @@ while true; do
         -v ) verbose=true; shift 1 ;;
         --install ) install=true; install_prefix="$2"; shift 2 ;;
         --enable-tests ) enable_tests=TRUE; shift ;;
+        --enable-benchmarks ) enable_benchmarks=TRUE; shift ;;
         --static ) BUILD_SHARED_LIBS="FALSE"; shift ;;
         --disable-bcur ) bcur=FALSE; shift ;;
         --clang | --gcc | --mingw-w64 ) BUILD="$1"; shift ;;
@@ -131,6 +133,7 @@ cmake_options="-B $bld_root -S . \
     -DCMAKE_TOOLCHAIN_FILE=cmake/profiles/$cmake_profile \
     -DCMAKE_BUILD_TYPE=$cmake_build_type \
     -DENABLE_TESTS:BOOL=$enable_tests \
+    -DENABLE_BENCHMARKS:BOOL=$enable_benchmarks \
     -DDEV_MODE:BOOL=$devmode \
     -DENABLE_BCUR:BOOL=$bcur"
 